@@ -79,15 +79,17 @@ public:
         return _z;
     }
 
+    template <class MathPolicy = StdMath>
     double magnitude() const
     {
-        return sqrt(_w*_w + _x*_x + _y*_y + _z*_z);
+        return MathPolicy::sqrt(_w*_w + _x*_x + _y*_y + _z*_z);
     }
 
+    template <class MathPolicy = StdMath>
     void normalize()
     {
-        double mag = magnitude();
-        *this = this->scale(1/mag);
+        double inv_mag = MathPolicy::inv_sqrt(_w*_w + _x*_x + _y*_y + _z*_z);
+        *this = this->scale(inv_mag);
     }
 
     Quaternion conjugate() const
@@ -185,6 +187,9 @@ public:
     // Note that this means result.x() is not a rotation about x;
     // similarly for result.z().
     //
+    // MathPolicy supplies atan2 and asin; see StdMath in vector.h.
+    //
+    template <class MathPolicy = StdMath>
     Vector<3> toEuler() const
     {
         Vector<3> ret;
@@ -193,9 +198,9 @@ public:
         double sqy = _y*_y;
         double sqz = _z*_z;
 
-        ret.x() = atan2(2.0*(_x*_y+_z*_w),(sqx-sqy-sqz+sqw));
-        ret.y() = asin(-2.0*(_x*_z-_y*_w)/(sqx+sqy+sqz+sqw));
-        ret.z() = atan2(2.0*(_y*_z+_x*_w),(-sqx-sqy+sqz+sqw));
+        ret.x() = MathPolicy::atan2(2.0*(_x*_y+_z*_w),(sqx-sqy-sqz+sqw));
+        ret.y() = MathPolicy::asin(-2.0*(_x*_z-_y*_w)/(sqx+sqy+sqz+sqw));
+        ret.z() = MathPolicy::atan2(2.0*(_y*_z+_x*_w),(-sqx-sqy+sqz+sqw));
 
         return ret;
     }
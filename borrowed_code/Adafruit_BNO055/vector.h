@@ -30,6 +30,17 @@
 namespace imu
 {
 
+// Default maths policy for the functions below that take one: the plain C library
+// calls. Any struct with the same static members (for example fast_math_policy in
+// my_src/fast_math.h) can be passed instead to trade accuracy for speed.
+struct StdMath
+{
+    static double sqrt(double x) { return ::sqrt(x); }
+    static double inv_sqrt(double x) { return 1.0 / ::sqrt(x); }
+    static double atan2(double y, double x) { return ::atan2(y, x); }
+    static double asin(double x) { return ::asin(x); }
+};
+
 template <uint8_t N> class Vector
 {
 public:
@@ -80,23 +91,29 @@ public:
 
     uint8_t n() { return N; }
 
+    template <class MathPolicy = StdMath>
     double magnitude() const
     {
         double res = 0;
         for (int i = 0; i < N; i++)
             res += p_vec[i] * p_vec[i];
 
-        return sqrt(res);
+        return MathPolicy::sqrt(res);
     }
 
+    template <class MathPolicy = StdMath>
     void normalize()
     {
-        double mag = magnitude();
-        if (isnan(mag) || mag == 0.0)
+        double sq = 0;
+        for (int i = 0; i < N; i++)
+            sq += p_vec[i] * p_vec[i];
+        if (isnan(sq) || sq == 0.0)
             return;
 
+        // one inverse square root and N multiplies instead of a sqrt and N divides
+        double inv_mag = MathPolicy::inv_sqrt(sq);
         for (int i = 0; i < N; i++)
-            p_vec[i] /= mag;
+            p_vec[i] *= inv_mag;
     }
 
     double dot(const Vector& v) const
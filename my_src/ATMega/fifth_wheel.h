@@ -1,18 +1,24 @@
 /**
  * Created by nate furbeyre on 11/18/18.
  * The fifth wheel is responsible for locking and unlocking the connection between the
- * semi-truck tractor and trailer. It is implemented as a child class of both a Servo,
- * and as a TaskBase, allowing it to inherit properties and methods from each parent class.
+ * semi-truck tractor and trailer. It is a TaskBase driving its servo through a PWM
+ * backend (see mega_hal.h), given as the template parameter.
  */
 
 #ifndef ME507_FIFTH_WHEEL_H
 #define ME507_FIFTH_WHEEL_H
 
-#include "avr/Servo.h"
 #include "taskbase.h"
+#include "mega_hal.h"
 #include "../semi_truck_data_t.h"
 
-class fifth_wheel : public Servo, public TaskBase {
+#define LOCKED true
+#define UNLOCKED false
+#define LOCKED_LEVEL 1      //todo: NEED TO REPLACE VALUES WHEN TESTING WITH SERVOS
+#define UNLOCKED_LEVEL 2
+
+template <class PWM>
+class fifth_wheel : public TaskBase {
 public:
 	/**
      * @brief The constructor for a fifth_wheel, which locks and unlocks the trailer hitch
@@ -36,7 +42,11 @@ public:
 	 */
     void run(); // contains a finite state machine: 2 states, open and closed
 
+	/// The servo's backend, for the simulation to read
+	PWM &get_servo() { return servo; }
+
 private:
+    PWM servo;
     semi_truck_data_t *semi_data;
 
     /**
@@ -59,5 +69,60 @@ private:
 
 };
 
+template <class PWM>
+fifth_wheel<PWM>::fifth_wheel(const char *a_name, unsigned char a_priority, size_t a_stack_size,
+                              emstream *p_ser_dev, semi_truck_data_t *semi_data_in)
+		: TaskBase::TaskBase(a_name, a_priority, a_stack_size, p_ser_dev)
+{
+    semi_data = semi_data_in;
+    state = LOCKED; // fifth wheel starts out locked
+    servo.begin();
+}
+
+template <class PWM>
+void fifth_wheel<PWM>::run()
+{
+    lock_servo();
+    state = LOCKED; // fifth wheel starts out locked
+
+    for (;;) {
+
+        if (state == LOCKED) {
+            if (semi_data->desired_5th == UNLOCKED) {
+                unlock_servo();
+                state = UNLOCKED;
+            }
+        }
+
+        else if (state == UNLOCKED) {
+            if (semi_data->desired_5th == LOCKED) {
+                lock_servo();
+                state = LOCKED;
+            }
+        }
+
+        else {                      // should not ever be in a state other than 1 or 2
+            print_status(*p_serial);
+            break;
+        }
+        delay_ms(25);
+
+    }
+}
+
+template <class PWM>
+void fifth_wheel<PWM>::lock_servo()
+{
+    servo.write(LOCKED_LEVEL);
+    semi_data->actual_5th = LOCKED;
+}
+
+template <class PWM>
+void fifth_wheel<PWM>::unlock_servo()
+{
+    servo.write(UNLOCKED_LEVEL);
+    semi_data->actual_5th = UNLOCKED;
+}
+
 
 #endif //ME507_FIFTH_WHEEL_H
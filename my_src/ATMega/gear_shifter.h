@@ -1,21 +1,31 @@
 /**
  * Created by nate furbeyre on 11/18/18.
- * The gear shifter is responsible for shifting gears for the semi-truck. It is implemented
- * as a child class of both a Servo, and as a TaskBase, allowing it to inherit properties
- * and methods from each parent class.
+ * The gear shifter is responsible for shifting gears for the semi-truck. It is a
+ * TaskBase driving its servo through a PWM backend (see mega_hal.h), given as the
+ * template parameter.
  */
 
 #ifndef ME507_GEAR_SHIFTER_H
 #define ME507_GEAR_SHIFTER_H
 
-#include "avr/Servo.h"
 #include "taskbase.h"
+#include "mega_hal.h"
 
 #include "../semi_truck_data_t.h"
 
+#define FIRST_GEAR 1
+#define SECOND_GEAR 2
+#define THIRD_GEAR 3
 
-class gear_shifter : public Servo, public TaskBase {
+#define FIRST_GEAR_LEVEL 1
+#define SECOND_GEAR_LEVEL 2
+#define THIRD_GEAR_LEVEL 3
+
+
+template <class PWM>
+class gear_shifter : public TaskBase {
 private:
+	PWM servo;
 	semi_truck_data_t *semi_data;
 
 public:
@@ -61,7 +71,100 @@ public:
 	 */
 	void set_desired_level(uint8_t in_level);
 
+	/// The servo's backend, for the simulation to read
+	PWM &get_servo() { return servo; }
+
 };
 
+template <class PWM>
+gear_shifter<PWM>::gear_shifter(const char *a_name, unsigned char a_priority, size_t a_stack_size,
+                                emstream *p_ser_dev, semi_truck_data_t *semi_data_in)
+		: TaskBase::TaskBase(a_name, a_priority, a_stack_size, p_ser_dev)
+{
+	semi_data = semi_data_in;
+	servo.begin();
+	shift_to_first();
+	semi_data->desired_gear = FIRST_GEAR;
+	state = FIRST_GEAR;
+}
+
+template <class PWM>
+void gear_shifter<PWM>::run()
+{
+	shift_to_first();
+
+	for (;;) {
+
+		if (state != semi_data->desired_gear) { // if the the same, don't need to actuate servo; should make loop faster
+
+			if (state == FIRST_GEAR) {
+				if (semi_data->desired_gear == SECOND_GEAR) {
+					shift_to_second();
+					state = SECOND_GEAR;
+				} else if (semi_data->desired_gear == THIRD_GEAR) {
+					shift_to_third();
+					state = SECOND_GEAR;
+				}
+
+			} else if (state == SECOND_GEAR) {
+				if (semi_data->desired_gear == FIRST_GEAR) {
+					shift_to_first();
+					state = FIRST_GEAR;
+				} else if (semi_data->desired_gear == THIRD_GEAR) {
+					shift_to_third();
+					state = THIRD_GEAR;
+				}
+
+			} else if (state == THIRD_GEAR) {
+				if (semi_data->desired_gear == FIRST_GEAR) {
+					shift_to_first();
+					state = FIRST_GEAR;
+				} else if (semi_data->desired_gear == SECOND_GEAR) {
+					shift_to_second();
+					state = SECOND_GEAR;
+				}
+
+			} else { // in some incorrect state; print status and break
+				print_status(*p_serial);
+				break;
+			}
+		}
+		delay_ms(25); // outside the if, so the task also sleeps while the gear is unchanged
+	}
+}
+
+template <class PWM>
+void gear_shifter<PWM>::shift_to_first()
+{
+	servo.write(FIRST_GEAR_LEVEL);
+	semi_data->actual_gear = FIRST_GEAR;
+}
+
+template <class PWM>
+void gear_shifter<PWM>::shift_to_second()
+{
+	servo.write(SECOND_GEAR_LEVEL);
+	semi_data->actual_gear = SECOND_GEAR;
+}
+
+template <class PWM>
+void gear_shifter<PWM>::shift_to_third()
+{
+	servo.write(THIRD_GEAR_LEVEL);
+	semi_data->actual_gear = THIRD_GEAR;
+}
+
+template <class PWM>
+uint8_t gear_shifter<PWM>::get_actual_level()
+{
+    return state; // actual level of the servo
+}
+
+template <class PWM>
+void gear_shifter<PWM>::set_desired_level(uint8_t in_level)
+{
+	semi_data->desired_gear = in_level;
+}
+
 
 #endif //ME507_GEAR_SHIFTER_H
@@ -1,21 +1,29 @@
 /**
  * Created by nate furbeyre on 11/19/18.
  * The imu_task is responsible for reading data from Adafruit's BNO055 IMU device.
- * This class descends both the Adafruit_BNO055 class written by Adafruit, and TaskBase,
- * written by JRR as a wrapper to the FreeRTOS task class.
+ * It is a TaskBase, written by JRR as a wrapper to the FreeRTOS task class, reading the
+ * BNO055's registers through an I2C backend (see mega_hal.h), given as the template
+ * parameter.
  */
 
 #ifndef ME507_IMU_H
 #define ME507_IMU_H
 
 #define BNO055_ADDRESS_A (0x28)
+#define BNO055_CHIP_ID_ADDR 0x00        // BNO055 registers, as in Adafruit_BNO055.h
+#define BNO055_EULER_H_LSB_ADDR 0x1A
+#define BNO055_EULER_R_LSB_ADDR 0x1C
+#define BNO055_EULER_P_LSB_ADDR 0x1E
 
-#include <Adafruit_BNO055/Adafruit_BNO055.h>
 #include <ridgely_inc/taskbase.h>
+#include "mega_hal.h"
 #include "../semi_truck_data_t.h"
 
-class imu_task : public TaskBase, public Adafruit_BNO055  {
+template <class I2C>
+class imu_task : public TaskBase {
 private:
+    I2C bus;
+    uint8_t address;
     semi_truck_data_t *semi_data;
 
 public:
@@ -25,7 +33,6 @@ public:
      * @param a_priority The priority given to this task
      * @param a_stack_size The amount of bytes given to the task
      * @param p_ser_dev A serial device that this tasks output is sent to
-     * @param sensorID The ID number for the IMU sensor
      * @param address The actual address for the BNO055 device itself
      * @param semi_data_in A pointer to the semi truck system data that is communicated between tasks
      */
@@ -33,7 +40,6 @@ public:
              unsigned char a_priority = 0,
              size_t a_stack_size = configMINIMAL_STACK_SIZE,
              emstream *p_ser_dev = NULL,
-             uint32_t sensorID = -1,
              uint8_t address = BNO055_ADDRESS_A,
              semi_truck_data_t *semi_data_in = NULL);
 
@@ -42,7 +48,51 @@ public:
      * angle data of the semi truck to be input into the control loop for a steering servo output.
      */
     void run();
+
+	/// The I2C bus's backend, for the simulation to put the BNO055 on
+	I2C &get_bus() { return bus; }
 };
 
+template <class I2C>
+imu_task<I2C>::imu_task(const char *a_name, unsigned char a_priority, size_t a_stack_size, emstream *p_ser_dev,
+                        uint8_t address_in, semi_truck_data_t *semi_data_in)
+		: TaskBase(a_name, a_priority, a_stack_size, p_ser_dev)
+{
+    address = address_in;
+    semi_data = semi_data_in;
+    state = 0;
+    bus.begin();
+
+}
+
+template <class I2C>
+void imu_task<I2C>::run()
+{
+	/* Once the device is setup to correctly read data, we can just continually read
+	 from the IMU and write to the mega task data */
+	char temp_buffer[2];
+
+	for (;;) {
+		if (state == 1) { // checked first for simple optimization as this is the primary state that the imu is in
+		    if (bus.read_registers(address, BNO055_EULER_H_LSB_ADDR, temp_buffer, 2)) { // heading LSB, then MSB
+		        semi_data->imu_angle = *((int16_t *)temp_buffer); // interesting but necessary casting to get value into semi_data
+		    }
+		}
+
+		else if (state == 0) {
+			// todo: initialize the imu either here or in the constructor
+
+			state = 1;
+		}
+		else {
+            print_status(*p_serial);
+            break;
+		}
+		delay_ms(10);
+
+	}
+
+}
+
 
 #endif //ME507_IMU_H
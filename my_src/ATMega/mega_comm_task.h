@@ -4,19 +4,26 @@
  * pi and relaying the necessary information to each of the tasks controlled by the
  * ATMega64. In addition, it sends information back to the Raspberry Pi about different
  * states of tasks on the ATMega. It uses the rs232 communication protocol and the UART/
- * USART ports on the ATMega.
+ * USART ports on the ATMega, through a UART backend (see mega_hal.h) given as the
+ * template parameter, which also picks the port.
  */
 
 #ifndef ME507_mega_comm_task_H
 #define ME507_mega_comm_task_H
 
-#include <ridgely_code/rs232int.h>
 #include "taskbase.h"
+#include "mega_hal.h"
 #include "../communication_data.h"
 
+#define PI_FRAME_BYTES 6    // motor_output, steer_output, desired_gear, desired_5th
+#define MEGA_COMM_PERIOD_MS 10      // between reports to the Pi
 
-class mega_comm_task : public TaskBase, public rs232 {
+
+template <class UART>
+class mega_comm_task : public TaskBase {
 private:
+	UART uart;
+
     /**
      * data_for_tasks is the data that will be communicated between the raspberry pi and the atmega.
      * fundamentally, the data is of the type semi_truck_data, which itself is inside a class
@@ -32,7 +39,6 @@ public:
      * @param a_stack_size The amount of bytes given to the task
      * @param p_ser_dev A serial device that this tasks output is sent to
      * @param baud The baud rate for the UART port that the mega communicates with
-     * @param port The UART port number
      * @param semi_data_in A pointer to the semi truck system data communicated between tasks
      */
     mega_comm_task(const char* a_name,
@@ -40,7 +46,6 @@ public:
     			size_t a_stack_size = configMINIMAL_STACK_SIZE,
 			    emstream* p_ser_dev = NULL,
 			    uint16_t baud = 9600,
-			    uint8_t port = 0,
 			    communication_data *comm_data_in = NULL);
 
     /**
@@ -50,39 +55,152 @@ public:
      * different desired values from the user and control loop, is then
      * relayed to each of the different tasks within the ATMega, so that each task
      * can act accordingly. In addition, this method sends information back to the Raspberry
-     * Pi about the actual state of each of the tasks in the ATMega.
+     * Pi about the actual state of each of the tasks in the ATMega, every MEGA_COMM_PERIOD_MS.
+     * In between, the task waits on the UART for a whole frame rather than for the next
+     * period, so a brake the Pi sends between periods is acted on as soon as its last
+     * byte is in (at the next tick, on the ATMega).
 	 */
     void run();
 
     /**
      * @brief Reads data from the raspberry pi through one of the USART ports of the ATMega.
-     * Since this class descents the rs232int class, it is able to use its communication based
-     * methods for talking with the Raspberry Pi.
-     *
+     * Bytes are read through the task's UART backend. Every whole frame waiting is read and
+     * the newest one is kept, so a brake the Pi sends between periods takes effect this
+     * period; a frame still arriving is left for the next period. Nothing is read until
+     * the whole frame is buffered, and only copying it into the task data is done with
+     * interrupts off: a getchar() waiting inside the critical section would wait for the
+     * receive interrupt forever.
      */
 	void read_from_pi();
 
 	/**
      * @brief Writes data to the raspberry pi through one of the USART ports of the ATMega.
-     * Since this class descents the rs232int class, it is able to use its communication based
-     * methods for talking with the Raspberry Pi.
+     * Bytes are written through the task's UART backend. The values are copied with
+     * interrupts off and sent with them on, as sending waits on the UART.
      */
 	void write_to_pi();
 
 	/**
 	 * @brief writes a 16 bit value to the rs232 port.
-	 * This function is implemented using calls to the rs232 class getchar, along with some
+	 * This function is implemented using calls to the UART's putchar, along with some
 	 * bitshifting to get a final value
 	 */
 	void write_16bit_val(int16_t write_val);
 
 	/**
 	 * @brief reads a 16 bit balue from the rs232 port.
-	 * This function is implemented using calls to the rs232 class getchar, along with some
+	 * This function is implemented using calls to the UART's getchar, along with some
 	 * bitshifting to get a final value
 	 */
 	int16_t read_16bit_val();
+
+	/// The UART's backend, for the simulation to connect
+	UART &get_uart() { return uart; }
 };
 
 
+template <class UART>
+mega_comm_task<UART>::mega_comm_task(const char* a_name, unsigned portBASE_TYPE a_priority,
+		size_t a_stack_size, emstream* p_ser_dev, uint16_t baud, communication_data *comm_data_in)
+		: TaskBase::TaskBase(a_name, a_priority, a_stack_size, p_ser_dev)
+{
+	data_for_tasks = comm_data_in; // points to data that will be held in main (or be static)
+	uart.begin(baud);
+}
+
+template <class UART>
+void mega_comm_task<UART>::run()
+{
+	TickType_t period = (TickType_t)((uint32_t)MEGA_COMM_PERIOD_MS * configTICK_RATE_HZ / 1000UL);
+	TickType_t last_report = get_tick_count();
+
+	for (;;) {
+		/// receive data from pi and relay to tasks
+		read_from_pi();
+		/// send data about tasks to the pi
+		write_to_pi();
+
+		/// until the next report, relay each frame the pi sends as soon as it is all in
+		TickType_t elapsed;
+		while ((elapsed = (TickType_t)(get_tick_count() - last_report)) < period) {
+			if (uart.wait_for(PI_FRAME_BYTES, period - elapsed))
+				read_from_pi();
+		}
+		delay_from_for(last_report, period);
+	}
+}
+
+template <class UART>
+void mega_comm_task<UART>::read_from_pi()
+{
+	int16_t motor_output = 0, steer_output = 0;
+	int8_t desired_gear = 0;
+	bool desired_5th = false;
+	bool received = false;
+
+	/// the Pi may have sent more than one frame this period (a brake is sent as soon as it
+	/// is called for), so all of them are read and the newest one is kept. A whole frame
+	/// is buffered before any of it is read, so none of these getchar() calls waits
+	while (uart.available() >= PI_FRAME_BYTES) {
+		motor_output = read_16bit_val(); // motor output is going to be a 16 bit value
+		steer_output = read_16bit_val();
+		desired_gear = uart.getchar(); // desired gear is only an 8 bit value
+		desired_5th = uart.getchar();
+		received = true;
+	}
+
+	if (received) {
+		portENTER_CRITICAL ();
+		data_for_tasks->set_motor_output(motor_output);
+		data_for_tasks->set_steer_output(steer_output);
+		data_for_tasks->set_desired_gear(desired_gear);
+		data_for_tasks->set_desired_5th(desired_5th);
+		portEXIT_CRITICAL ();
+	}
+}
+
+template <class UART>
+void mega_comm_task<UART>::write_to_pi()
+{
+	portENTER_CRITICAL ();
+	int16_t wheel_speed = data_for_tasks->get_wheel_speed();
+	int16_t imu_angle = data_for_tasks->get_imu_angle();
+	int8_t actual_gear = data_for_tasks->get_actual_gear();
+	bool actual_5th = data_for_tasks->get_actual_5th();
+	portEXIT_CRITICAL ();
+
+	write_16bit_val(wheel_speed);  /// an ugly way to do this is through bitshifting...
+	write_16bit_val(imu_angle);
+	uart.putchar(actual_gear);
+	uart.putchar(actual_5th);
+}
+
+template <class UART>
+void mega_comm_task<UART>::write_16bit_val(int16_t write_val)
+{
+	char out_val;
+	char num_bytes = 2;
+
+	for (char i=0; i < num_bytes; i++) {
+		out_val = ((char)(write_val >> 8*i)) & (char)0xFF; // shift right depending on which byte is sent
+		uart.putchar(out_val);
+	}
+}
+
+template <class UART>
+int16_t mega_comm_task<UART>::read_16bit_val()
+{
+	uint16_t ret_val = 0;
+	char num_bytes = 2;
+	char temp;
+
+	for (int i=0; i < num_bytes; i++) {
+		temp = uart.getchar();
+		ret_val |= (uint16_t)((uint8_t)temp) << 8*i; // low byte first, the order write_16bit_val() sends
+	}
+
+	return (int16_t)ret_val;
+}
+
+
 #endif //ME507_mega_comm_task_H
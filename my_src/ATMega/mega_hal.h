@@ -0,0 +1,53 @@
+/**
+ * The hardware abstraction the ATMega tasks are written against. A task takes each
+ * peripheral it drives as a template parameter, a backend class it holds by value,
+ * rather than inheriting a driver class or calling through emstream's virtual methods.
+ * On the ATMega the backends in mega_hal_avr.h have only static inline members and no
+ * data, so every access compiles to the register reads and writes themselves; in the
+ * software-in-the-loop build the backends in sim/sim_hal.h keep the simulated
+ * peripheral's state in the object, and the task's code is the same.
+ *
+ * A backend provides, for its kind of peripheral:
+ *
+ *   UART   begin(baud); putchar(ch); check_for_char(); available(), the number of bytes
+ *          received and not yet read; getchar(), which waits for a byte;
+ *          wait_for(count, ticks), which blocks the task until count bytes are received
+ *          and not yet read, or ticks pass, and is true if they are
+ *   I2C    begin(); read_registers(address, reg, buffer, len);
+ *          write_register(address, reg, value), both false if the device does not answer
+ *   PWM    begin(); write(value), with Servo::write()'s meaning: below
+ *          SERVO_MIN_PULSE_US an angle in degrees, otherwise a pulse width in us
+ *   timer  the 16-bit timer a PWM backend runs on, given to it as a template parameter;
+ *          begin_servo_frame() and compare(channel)
+ */
+
+#ifndef ME507_MEGA_HAL_H
+#define ME507_MEGA_HAL_H
+
+#include <stdint.h>
+
+#define SERVO_MIN_PULSE_US 544      // us, Servo.h's MIN_PULSE_WIDTH
+#define SERVO_MAX_PULSE_US 2400     // us, Servo.h's MAX_PULSE_WIDTH
+#define SERVO_MAX_ANGLE 180         // degrees
+#define SERVO_FRAME_US 20000        // us between the starts of two pulses
+
+/**
+ * @brief Converts a value given to a PWM backend's write() to the pulse it sends.
+ * @param value An angle in degrees if below SERVO_MIN_PULSE_US, otherwise a pulse width (us)
+ * @return the pulse width, within SERVO_MIN_PULSE_US to SERVO_MAX_PULSE_US (us)
+ */
+inline uint16_t servo_pulse_us(int value)
+{
+	if (value < SERVO_MIN_PULSE_US) {
+		if (value < 0)
+			value = 0;
+		if (value > SERVO_MAX_ANGLE)
+			value = SERVO_MAX_ANGLE;
+		return (uint16_t)(SERVO_MIN_PULSE_US
+		                  + (int32_t)value * (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US) / SERVO_MAX_ANGLE);
+	}
+	return (uint16_t)(value > SERVO_MAX_PULSE_US ? SERVO_MAX_PULSE_US : value);
+}
+
+
+#endif //ME507_MEGA_HAL_H
@@ -0,0 +1,298 @@
+/**
+ * The ATMega64's backends for the hardware abstraction in mega_hal.h. Everything is a
+ * static inline member working the registers directly, so a task's calls compile to the
+ * same instructions as hand-written register code: no Servo objects looked up by index,
+ * no emstream virtual calls and no Wire library.
+ *
+ * avr_uart keeps the rs232 class's design: bytes are received by the USART's receive
+ * interrupt into a buffer, and sent by waiting for the data register to empty. The
+ * interrupt itself has to be defined once, in main, with AVR_UART_RECEIVER(); rs232int.cpp
+ * defines the same interrupts, so a port driven by avr_uart cannot also have an rs232.
+ * A task waiting in wait_for() is blocked on a semaphore the interrupt gives once enough
+ * bytes are in; the AVR port of FreeRTOS cannot switch tasks from an interrupt, so the
+ * task runs at the next tick at the latest.
+ *
+ * avr_servo runs the servo pulses in hardware on a 16-bit timer's output compare
+ * channels, 0.5 us resolution at 16 MHz, so no interrupt is taken per pulse. Timer 1
+ * drives OC1A to OC1C on PB5 to PB7 and timer 3 OC3A to OC3C on PE3 to PE5.
+ */
+
+#ifndef ME507_MEGA_HAL_AVR_H
+#define ME507_MEGA_HAL_AVR_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "mega_hal.h"
+
+#define AVR_UART_BUFFER_SIZE 32     // bytes received per port before they are dropped; RSINT_BUF_SIZE
+#define AVR_TWI_HZ 400000UL         // I2C clock; the BNO055 runs at up to 400 kHz
+#define AVR_TWI_TIMEOUT 1000        // status polls before an I2C transfer is abandoned
+#define AVR_TIMER_PRESCALE 8
+#define AVR_TIMER_TICKS_PER_US (F_CPU / AVR_TIMER_PRESCALE / 1000000UL)
+
+#define AVR_CHANNEL_A 0             // output compare channels of a 16-bit timer
+#define AVR_CHANNEL_B 1
+#define AVR_CHANNEL_C 2
+
+/// Defines the receive interrupt of a port driven by avr_uart; use once per port, in main
+#define AVR_UART_RECEIVER(port, vector) ISR(vector) { avr_uart<port>::receive(); }
+
+/// The registers of USART 0 and 1, whose bits are in the same places
+template <uint8_t PORT> struct avr_uart_registers;
+
+template <> struct avr_uart_registers<0> {
+	static volatile uint8_t &udr() { return UDR0; }
+	static volatile uint8_t &ucsra() { return UCSR0A; }
+	static volatile uint8_t &ucsrb() { return UCSR0B; }
+	static volatile uint8_t &ucsrc() { return UCSR0C; }
+	static volatile uint8_t &ubrrh() { return UBRR0H; }
+	static volatile uint8_t &ubrrl() { return UBRR0L; }
+};
+
+template <> struct avr_uart_registers<1> {
+	static volatile uint8_t &udr() { return UDR1; }
+	static volatile uint8_t &ucsra() { return UCSR1A; }
+	static volatile uint8_t &ucsrb() { return UCSR1B; }
+	static volatile uint8_t &ucsrc() { return UCSR1C; }
+	static volatile uint8_t &ubrrh() { return UBRR1H; }
+	static volatile uint8_t &ubrrl() { return UBRR1L; }
+};
+
+/**
+ * @brief A USART, 8 data bits and no parity, receiving by interrupt into a buffer.
+ */
+template <uint8_t PORT>
+class avr_uart {
+	typedef avr_uart_registers<PORT> registers;
+
+public:
+	static void begin(uint16_t baud)
+	{
+		uint16_t divisor = (uint16_t)((F_CPU + 4UL * baud) / (8UL * baud) - 1);
+		registers::ubrrh() = (uint8_t)(divisor >> 8);
+		registers::ubrrl() = (uint8_t)divisor;
+		registers::ucsra() = (1 << U2X);
+		registers::ucsrc() = (1 << UCSZ1) | (1 << UCSZ0);
+		registers::ucsrb() = (1 << RXEN) | (1 << TXEN) | (1 << RXCIE);
+		if (ready == NULL)
+			ready = xSemaphoreCreateBinary();
+	}
+
+	static void putchar(char a_char)
+	{
+		while (!(registers::ucsra() & (1 << UDRE)))
+			;
+		registers::udr() = (uint8_t)a_char;
+	}
+
+	static bool check_for_char()
+	{
+		return read_index != write_index;
+	}
+
+	static uint8_t available()
+	{
+		return (uint8_t)((write_index + AVR_UART_BUFFER_SIZE - read_index) % AVR_UART_BUFFER_SIZE);
+	}
+
+	static char getchar()
+	{
+		while (!check_for_char())
+			;
+		char a_char = buffer[read_index];
+		read_index = (uint8_t)((read_index + 1) % AVR_UART_BUFFER_SIZE);
+		return a_char;
+	}
+
+	static bool wait_for(uint8_t count, TickType_t ticks)
+	{
+		portENTER_CRITICAL ();
+		bool enough = available() >= count;
+		if (!enough) {
+			xSemaphoreTake(ready, 0);     // drops a give left over from a wait that timed out
+			wanted = count;
+		}
+		portEXIT_CRITICAL ();
+		if (!enough) {
+			xSemaphoreTake(ready, ticks);
+			wanted = 0;
+		}
+		return available() >= count;
+	}
+
+	/// Takes the byte just received; called only by the receive interrupt
+	static void receive()
+	{
+		char a_char = (char)registers::udr();
+		uint8_t next = (uint8_t)((write_index + 1) % AVR_UART_BUFFER_SIZE);
+		if (next != read_index) {     // when full the byte is lost, as with rs232
+			buffer[write_index] = a_char;
+			write_index = next;
+		}
+		if (wanted && available() >= wanted) {
+			wanted = 0;
+			BaseType_t woken = pdFALSE;
+			xSemaphoreGiveFromISR(ready, &woken);
+		}
+	}
+
+private:
+	static volatile char buffer[AVR_UART_BUFFER_SIZE];
+	static volatile uint8_t read_index;
+	static volatile uint8_t write_index;
+	static volatile uint8_t wanted;             // bytes a task is waiting for, 0 if none
+	static SemaphoreHandle_t ready;             // given by receive() once they are in
+};
+
+template <uint8_t PORT> volatile char avr_uart<PORT>::buffer[AVR_UART_BUFFER_SIZE];
+template <uint8_t PORT> volatile uint8_t avr_uart<PORT>::read_index = 0;
+template <uint8_t PORT> volatile uint8_t avr_uart<PORT>::write_index = 0;
+template <uint8_t PORT> volatile uint8_t avr_uart<PORT>::wanted = 0;
+template <uint8_t PORT> SemaphoreHandle_t avr_uart<PORT>::ready = NULL;
+
+/**
+ * @brief The TWI as an I2C master, polled. A transfer the bus does not finish within
+ * AVR_TWI_TIMEOUT polls is abandoned, so a stuck sensor cannot hang its task.
+ */
+class avr_twi {
+public:
+	static void begin()
+	{
+		TWSR = 0;                     // prescaler 1
+		TWBR = (uint8_t)((F_CPU / AVR_TWI_HZ - 16) / 2);
+		TWCR = (1 << TWEN);
+	}
+
+	static bool read_registers(uint8_t address, uint8_t reg, char *buffer, uint8_t len)
+	{
+		bool ok = start((uint8_t)(address << 1)) && send(reg) && start((uint8_t)((address << 1) | 1));
+		for (uint8_t i = 0; ok && i < len; i++) {
+			// every byte but the last is acknowledged, telling the device to send another
+			ok = transfer((uint8_t)((1 << TWINT) | (1 << TWEN) | (i + 1 < len ? (1 << TWEA) : 0)))
+			     == (i + 1 < len ? TWI_DATA_RECEIVED_ACK : TWI_DATA_RECEIVED_NACK);
+			buffer[i] = (char)TWDR;
+		}
+		stop();
+		return ok;
+	}
+
+	static bool write_register(uint8_t address, uint8_t reg, uint8_t value)
+	{
+		bool ok = start((uint8_t)(address << 1)) && send(reg) && send(value);
+		stop();
+		return ok;
+	}
+
+private:
+	enum {
+		TWI_START = 0x08,
+		TWI_REPEATED_START = 0x10,
+		TWI_WRITE_ACK = 0x18,
+		TWI_DATA_SENT_ACK = 0x28,
+		TWI_READ_ACK = 0x40,
+		TWI_DATA_RECEIVED_ACK = 0x50,
+		TWI_DATA_RECEIVED_NACK = 0x58,
+		TWI_TIMED_OUT = 0xFF
+	};
+
+	/// Starts a bus operation and waits for it; returns the status, or TWI_TIMED_OUT
+	static uint8_t transfer(uint8_t control)
+	{
+		TWCR = control;
+		for (uint16_t count = 0; !(TWCR & (1 << TWINT)); count++)
+			if (count >= AVR_TWI_TIMEOUT)
+				return TWI_TIMED_OUT;
+		return (uint8_t)(TWSR & 0xF8);
+	}
+
+	static bool start(uint8_t address_and_direction)
+	{
+		uint8_t status = transfer((1 << TWINT) | (1 << TWSTA) | (1 << TWEN));
+		if (status != TWI_START && status != TWI_REPEATED_START)
+			return false;
+		TWDR = address_and_direction;
+		status = transfer((1 << TWINT) | (1 << TWEN));
+		return status == TWI_WRITE_ACK || status == TWI_READ_ACK;
+	}
+
+	static bool send(uint8_t data)
+	{
+		TWDR = data;
+		return transfer((1 << TWINT) | (1 << TWEN)) == TWI_DATA_SENT_ACK;
+	}
+
+	static void stop()
+	{
+		TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWEN);
+	}
+};
+
+/// The registers of 16-bit timers 1 and 3, whose bits are in the same places
+template <uint8_t TIMER> struct avr_timer16;
+
+template <> struct avr_timer16<1> {
+	static void begin_servo_frame()
+	{
+		// fast PWM counting up to ICR1, the frame, with the prescaler set last to start it
+		TCCR1A = (uint8_t)((TCCR1A & ~((1 << WGM11) | (1 << WGM10))) | (1 << WGM11));
+		ICR1 = (uint16_t)(SERVO_FRAME_US * AVR_TIMER_TICKS_PER_US - 1);
+		TCCR1B = (1 << WGM13) | (1 << WGM12) | (1 << CS11);
+	}
+
+	static void enable_output(uint8_t channel)
+	{
+		DDRB |= (uint8_t)(1 << (PB5 + channel));
+		TCCR1A |= (uint8_t)(1 << (COM1A1 - 2 * channel));     // cleared on compare match
+	}
+
+	static volatile uint16_t &compare(uint8_t channel)
+	{
+		return channel == AVR_CHANNEL_A ? OCR1A : channel == AVR_CHANNEL_B ? OCR1B : OCR1C;
+	}
+};
+
+template <> struct avr_timer16<3> {
+	static void begin_servo_frame()
+	{
+		TCCR3A = (uint8_t)((TCCR3A & ~((1 << WGM31) | (1 << WGM30))) | (1 << WGM31));
+		ICR3 = (uint16_t)(SERVO_FRAME_US * AVR_TIMER_TICKS_PER_US - 1);
+		TCCR3B = (1 << WGM33) | (1 << WGM32) | (1 << CS31);
+	}
+
+	static void enable_output(uint8_t channel)
+	{
+		DDRE |= (uint8_t)(1 << (PE3 + channel));
+		TCCR3A |= (uint8_t)(1 << (COM3A1 - 2 * channel));
+	}
+
+	static volatile uint16_t &compare(uint8_t channel)
+	{
+		return channel == AVR_CHANNEL_A ? OCR3A : channel == AVR_CHANNEL_B ? OCR3B : OCR3C;
+	}
+};
+
+/**
+ * @brief A servo on one output compare channel of a 16-bit timer. The timer is set up
+ * again by every servo on it, the same way each time, so the servos need no ordering.
+ */
+template <class TIMER, uint8_t CHANNEL>
+class avr_servo {
+public:
+	static void begin()
+	{
+		TIMER::compare(CHANNEL) = (uint16_t)(servo_pulse_us(SERVO_MAX_ANGLE / 2) * AVR_TIMER_TICKS_PER_US);
+		TIMER::begin_servo_frame();
+		TIMER::enable_output(CHANNEL);
+	}
+
+	static void write(int value)
+	{
+		TIMER::compare(CHANNEL) = (uint16_t)(servo_pulse_us(value) * AVR_TIMER_TICKS_PER_US);
+	}
+};
+
+
+#endif //ME507_MEGA_HAL_AVR_H
@@ -3,23 +3,43 @@
  * The motor_driver task holds the code that runs the motor for the semi-truck.
  * The motor involved in this project is the Tekin RX8 ESC + 1550kv combo. Output
  * levels to the motor come from the control loop running on the Raspberry Pi that
- * is based on the data from the RC controller and the wheel speed sensors.
+ * is based on the data from the RC controller and the wheel speed sensors. The ESC
+ * takes servo pulses through a PWM backend (see mega_hal.h), given as the template
+ * parameter: ESC_NEUTRAL_US is off, and ESC_RANGE_US either side of it full throttle
+ * forwards or in reverse.
+ *
+ * The ESC brakes when given throttle against the way the wheels turn, so
+ * MOTOR_OUTPUT_BRAKE is carried out as full throttle against the wheel_speed until the
+ * truck has stopped, and then as neutral, which holds it with the ESC's drag brake
+ * without starting it off the other way.
  */
 
 #ifndef ME507_MOTOR_DRIVER_H
 #define ME507_MOTOR_DRIVER_H
 
 
-#include <ridgely_inc/taskbase.h>
+#include "taskbase.h"
+#include "mega_hal.h"
 #include "../semi_truck_data_t.h"
 
+#define ESC_NEUTRAL_US 1500         // us, no throttle
+#define ESC_RANGE_US 500            // us from neutral to full throttle either way
+#define MOTOR_STOPPED_SPEED 20      // wheel_speed (mm/s) under which a brake goes to neutral
+#define MOTOR_PERIOD_MS 5           // a quarter of a servo frame, so a brake misses at most one pulse
+
+template <class PWM>
 class motor_driver : public TaskBase {
 private:
+	PWM esc;
 	semi_truck_data_t *semi_data;
-	
+
+	/// The motor_output the ESC is being driven with, MOTOR_OUTPUT_BRAKE while braking
+	int16_t applied;
+
 public:
     /**
      * @brief The constructor for the motor driver to supply power to the motor.
+     * The ESC is started at neutral, which it needs to see before it will arm.
      * @param a_name the name of the task
      * @param a_priority The priority given to this task
      * @param a_stack_size The amount of bytes given to the task
@@ -34,12 +54,81 @@ public:
 
 	/**
 	 * @brief Runs the task code for the motor driver.
-	 * This task has a two different states: (1) reading output level that comes from the control
-	 * loop running on the Raspberry pi, and actuating the motor to this level, and (2) an off state
-	 * where the motor will not output any torque
+	 * Every MOTOR_PERIOD_MS the motor_output from the Raspberry Pi is turned into the ESC's
+	 * pulse: a level from -MOTOR_OUTPUT_FULL to MOTOR_OUTPUT_FULL is throttle in proportion,
+	 * and MOTOR_OUTPUT_BRAKE brakes, as described above.
 	 */
     void run();
+
+	/**
+	 * @brief Gets the pulse width for braking at a given speed.
+	 * @param wheel_speed The measured wheel speed (mm/s)
+	 * @return full throttle against the motion, or neutral once stopped (us)
+	 */
+	static uint16_t brake_pulse_us(int16_t wheel_speed);
+
+	/**
+	 * @brief Gets the pulse width for a throttle level.
+	 * @param motor_output The level, clamped to -MOTOR_OUTPUT_FULL to MOTOR_OUTPUT_FULL
+	 * @return the pulse width (us)
+	 */
+	static uint16_t throttle_pulse_us(int16_t motor_output);
+
+	/// The motor_output last acted on, MOTOR_OUTPUT_BRAKE while braking
+	int16_t get_applied() const { return applied; }
+
+	/// The ESC's backend, for the simulation to read
+	PWM &get_esc() { return esc; }
 };
 
+template <class PWM>
+motor_driver<PWM>::motor_driver(const char *a_name, unsigned char a_priority, size_t a_stack_size,
+                                emstream *p_ser_dev, semi_truck_data_t *semi_data_in)
+		: TaskBase::TaskBase(a_name, a_priority, a_stack_size, p_ser_dev)
+{
+	semi_data = semi_data_in;
+	applied = 0;
+	esc.begin();
+	esc.write(ESC_NEUTRAL_US);
+}
+
+template <class PWM>
+void motor_driver<PWM>::run()
+{
+	for (;;) {
+		portENTER_CRITICAL ();
+		int16_t motor_output = semi_data->motor_output;
+		int16_t wheel_speed = semi_data->wheel_speed;
+		portEXIT_CRITICAL ();
+
+		if (motor_output == MOTOR_OUTPUT_BRAKE)
+			esc.write(brake_pulse_us(wheel_speed));
+		else
+			esc.write(throttle_pulse_us(motor_output));
+		applied = motor_output;
+		delay_ms(MOTOR_PERIOD_MS);
+	}
+}
+
+template <class PWM>
+uint16_t motor_driver<PWM>::brake_pulse_us(int16_t wheel_speed)
+{
+	if (wheel_speed > MOTOR_STOPPED_SPEED)
+		return ESC_NEUTRAL_US - ESC_RANGE_US;
+	if (wheel_speed < -MOTOR_STOPPED_SPEED)
+		return ESC_NEUTRAL_US + ESC_RANGE_US;
+	return ESC_NEUTRAL_US;
+}
+
+template <class PWM>
+uint16_t motor_driver<PWM>::throttle_pulse_us(int16_t motor_output)
+{
+	if (motor_output > MOTOR_OUTPUT_FULL)
+		motor_output = MOTOR_OUTPUT_FULL;
+	else if (motor_output < -MOTOR_OUTPUT_FULL)
+		motor_output = -MOTOR_OUTPUT_FULL;
+	return (uint16_t)(ESC_NEUTRAL_US + (int32_t)motor_output * ESC_RANGE_US / MOTOR_OUTPUT_FULL);
+}
+
 
 #endif //ME507_MOTOR_DRIVER_H
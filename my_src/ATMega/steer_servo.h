@@ -1,20 +1,29 @@
 /**
  * Created by nate furbeyre on 11/18/18.
- * The steering servo is responsible for steering the semi-truck. It is implemented as a
- * child class of both a Servo, and as a TaskBase, allowing it to inherit properties
- * and methods from each parent class.
+ * The steering servo is responsible for steering the semi-truck. It is a TaskBase
+ * driving its servo through a PWM backend (see mega_hal.h), given as the template
+ * parameter. steer_output, in milliradians, is sent to the servo as a pulse width
+ * around the straight ahead pulse, with the servo's 0 to 180 degrees over
+ * SERVO_MIN_PULSE_US to SERVO_MAX_PULSE_US taken as the wheel angle; a longer pulse
+ * turns left. Pulse widths rather than degrees are written, for 1.7 mrad steps
+ * instead of 17.
  */
 
 
 #ifndef ME507_STEER_SERVO_H
 #define ME507_STEER_SERVO_H
 
-#include "avr/Servo.h"
 #include "taskbase.h"
+#include "mega_hal.h"
 #include "../semi_truck_data_t.h"
 
-class steer_servo : public Servo, public TaskBase {
+#define FORWARDS 90                 // servo angle (degrees) with the front wheels straight
+#define STEER_MRAD_PER_HALF_TURN 3142   // steer_output over the servo's 180 degrees
+
+template <class PWM>
+class steer_servo : public TaskBase {
 private:
+	PWM servo;
 	semi_truck_data_t *semi_data;
 
 public:
@@ -40,8 +49,89 @@ public:
 	 */
     void run(); // contains a finite state machine: 2 states, open and closed
 
+	/**
+	 * @brief Sets the steering level that the servo task will actuate to.
+	 * @param level The steering output, in the units of steer_output in semi_truck_data_t
+	 */
+	void set_steering_level(int16_t level);
+
+	/**
+	 * @brief Gets the steering level that the servo task is actuating to.
+	 * @return the steering output, in the units of steer_output in semi_truck_data_t
+	 */
+	int16_t get_steering_level();
+
+	/**
+	 * @brief Gets the servo pulse for a steering output.
+	 * @param steer_output The steering output, in the units of steer_output in semi_truck_data_t
+	 * @return the pulse width, within SERVO_MIN_PULSE_US to SERVO_MAX_PULSE_US (us)
+	 */
+	static uint16_t steer_pulse_us(int16_t steer_output);
 
+	/**
+	 * @brief Gets the steering output a servo pulse stands for; the inverse of
+	 * steer_pulse_us(), to within a pulse step, for the simulation to read the servo.
+	 * @param pulse_us The pulse width (us)
+	 * @return the steering output, in the units of steer_output in semi_truck_data_t
+	 */
+	static int16_t pulse_steer_output(uint16_t pulse_us);
+
+	/// The servo's backend, for the simulation to read
+	PWM &get_servo() { return servo; }
 };
 
+template <class PWM>
+steer_servo<PWM>::steer_servo(const char *a_name, unsigned char a_priority, size_t a_stack_size,
+                              emstream *p_ser_dev, semi_truck_data_t *semi_data_in)
+		:TaskBase::TaskBase(a_name, a_priority, a_stack_size, p_ser_dev)
+{
+    semi_data = semi_data_in;
+    servo.begin();
+    servo.write(FORWARDS); // want the semi-truck to start facing forwards
+}
+
+template <class PWM>
+void steer_servo<PWM>::run()
+{
+	for (;;) {
+	    servo.write(steer_pulse_us(semi_data->steer_output));
+	    delay_ms(20); // one servo frame; without a delay no lower priority task would run
+	}
+}
+
+template <class PWM>
+void steer_servo<PWM>::set_steering_level(int16_t level)
+{
+	semi_data->steer_output= level;
+    delay_ms(25);
+}
+
+template <class PWM>
+int16_t steer_servo<PWM>::get_steering_level()
+{
+	return semi_data->steer_output;
+}
+
+template <class PWM>
+uint16_t steer_servo<PWM>::steer_pulse_us(int16_t steer_output)
+{
+	int32_t pulse = servo_pulse_us(FORWARDS)
+	                + (int32_t)steer_output * (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US) / STEER_MRAD_PER_HALF_TURN;
+
+	// Below SERVO_MIN_PULSE_US the backend would take the value for degrees
+	if (pulse < SERVO_MIN_PULSE_US)
+		pulse = SERVO_MIN_PULSE_US;
+	else if (pulse > SERVO_MAX_PULSE_US)
+		pulse = SERVO_MAX_PULSE_US;
+	return (uint16_t)pulse;
+}
+
+template <class PWM>
+int16_t steer_servo<PWM>::pulse_steer_output(uint16_t pulse_us)
+{
+	return (int16_t)(((int32_t)pulse_us - servo_pulse_us(FORWARDS)) * STEER_MRAD_PER_HALF_TURN
+	                 / (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US));
+}
+
 
 #endif //ME507_STEER_SERVO_H
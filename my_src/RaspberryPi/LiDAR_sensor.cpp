@@ -2,4 +2,163 @@
 // Created by nate on 11/19/18.
 //
 
+#include <chrono>
+#include <cmath>
 #include "LiDAR_sensor.h"
+
+#define OFFSET_CREEP_US 2   // us per scan the clock offset may rise; covers a device clock 80 ppm slow at 40 Hz
+#define LIDAR_RETRY_US 28000            // us to wait after a failed read until a scan gives the sweep time
+#define LIDAR_FAILURES_BEFORE_RESET 10  // failed reads in a row before the device is reset
+#define LIDAR_MAX_RESETS 3              // resets in a row without a scan before the device is given up on
+
+LiDAR_sensor::LiDAR_sensor(lidar_device *device_in, const lidar_extrinsics &mount_in, scan_merger *merger_in, uint8_t index_in)
+		: running(false), clock_offset_us(0), scan_count(0), error_count(0), reset_count(0), failed(false)
+{
+	device = device_in;
+	mount = mount_in;
+	merger = merger_in;
+	index = index_in;
+	deskew = NULL;
+	synced = false;
+	retry_us = LIDAR_RETRY_US;
+
+	float c = cosf(mount.yaw), s = sinf(mount.yaw);
+	float rot[9] = {c, -s, 0.0f, s, c, 0.0f, 0.0f, 0.0f, 1.0f};
+	for (uint8_t i = 0; i < 9; i++)
+		to_truck.rot[i] = rot[i];
+	to_truck.trans[0] = mount.x;
+	to_truck.trans[1] = mount.y;
+	to_truck.trans[2] = 0.0f;
+}
+
+LiDAR_sensor::~LiDAR_sensor()
+{
+	stop();
+}
+
+void LiDAR_sensor::set_filter(const std::function<void(lidar_scan &)> &filter_in)
+{
+	filter = filter_in;
+}
+
+void LiDAR_sensor::set_deskew(scan_deskew *deskew_in)
+{
+	deskew = deskew_in;
+}
+
+void LiDAR_sensor::start()
+{
+	if (running.load())
+		return;
+	running.store(true);
+	thread = std::thread(&LiDAR_sensor::run, this);
+}
+
+void LiDAR_sensor::stop()
+{
+	running.store(false);
+	if (thread.joinable())
+		thread.join();
+}
+
+void LiDAR_sensor::run()
+{
+	uint16_t failures = 0;
+	uint8_t resets = 0;
+	while (running.load()) {
+		if (!device->read_scan(scan)) {
+			error_count++;
+			if (!recover(failures, resets))
+				return;
+			continue;
+		}
+		failures = 0;
+		resets = 0;
+		if (scan.sweep_us)
+			retry_us = scan.sweep_us;
+
+		uint64_t arrival = host_time_us();
+		update_clock_offset(scan.time_us + scan.sweep_us, arrival);
+		scan.time_us = (uint64_t)((int64_t)scan.time_us + clock_offset_us.load());
+
+		if (filter)
+			filter(scan);
+
+		sensor_points &out = merger->back_buffer(index);
+		out.time_us = scan.time_us;
+		out.arrival_us = arrival;
+		out.sweep_us = scan.sweep_us;
+		convert(out);
+		merger->push(index);
+		scan_count++;
+	}
+}
+
+/**
+ * Waits a sweep after a failed read, and resets the device once enough reads in a row
+ * have failed. Returns false if the device is to be given up on.
+ */
+bool LiDAR_sensor::recover(uint16_t &failures, uint8_t &resets)
+{
+	std::this_thread::sleep_for(std::chrono::microseconds(retry_us));
+	if (++failures < LIDAR_FAILURES_BEFORE_RESET)
+		return true;
+
+	failures = 0;
+	if (++resets > LIDAR_MAX_RESETS || !device->reset()) {
+		failed.store(true);
+		return false;
+	}
+	reset_count++;
+	return true;
+}
+
+void LiDAR_sensor::update_clock_offset(uint64_t device_end_us, uint64_t arrival_us)
+{
+	int64_t sample = (int64_t)arrival_us - (int64_t)device_end_us;
+	int64_t offset = clock_offset_us.load();
+	if (!synced || sample < offset + OFFSET_CREEP_US)
+		offset = sample;
+	else
+		offset += OFFSET_CREEP_US;
+	synced = true;
+	clock_offset_us.store(offset);
+}
+
+/**
+ * Keeps only the valid rays, as x and y in the sensor frame, then moves them all into
+ * the truck frame in one batch and takes out the motion during the sweep.
+ */
+void LiDAR_sensor::convert(sensor_points &out)
+{
+	uint16_t n = 0;
+	float per_ray = scan.count > 1 ? 1.0f / (scan.count - 1) : 0.0f;
+	for (uint16_t i = 0; i < scan.count; i++) {
+		if (!scan_point_valid(scan, i))
+			continue;
+		float angle = scan.angle_min + i * scan.angle_increment;
+		ray_x[n] = scan.ranges[i] * cosf(angle);
+		ray_y[n] = scan.ranges[i] * sinf(angle);
+		ray_fraction[n] = i * per_ray;
+		out.flags[n] = scan.flags[i];
+		n++;
+	}
+
+	point_cloud cloud;
+	cloud.x = out.x;
+	cloud.y = out.y;
+	cloud.z = ray_z;
+	transform_planar_points(to_truck, ray_x, ray_y, cloud, n);
+	out.count = n;
+	if (!deskew || !deskew->correct(out.time_us, scan.sweep_us, ray_fraction, out.x, out.y, n))
+		return;
+
+	// The trailer moves with the truck, so its points were not smeared; put them back
+	const float *r = to_truck.rot;
+	for (uint16_t i = 0; i < n; i++) {
+		if (out.flags[i] & SCAN_FLAG_TRAILER) {
+			out.x[i] = r[0] * ray_x[i] + r[1] * ray_y[i] + to_truck.trans[0];
+			out.y[i] = r[3] * ray_x[i] + r[4] * ray_y[i] + to_truck.trans[1];
+		}
+	}
+}
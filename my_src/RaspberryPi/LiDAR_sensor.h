@@ -5,16 +5,155 @@
 #ifndef ME507_LIDAR_SENSOR_H
 #define ME507_LIDAR_SENSOR_H
 
-#include "hokuyoaist-mater/include/hokuyoaist/sensor.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include "lidar_scan.h"
+#include "point_cloud.h"
+#include "scan_deskew.h"
+#include "scan_merger.h"
 
 /**
- * This class governs the control over the lidar device that is used for object detection around the semi-truck.
- * The planned model was the Hokuyo UBG-04LX-F01 Lidar (https://www.hokuyo-aut.jp/search/single.php?serial=164) but
- * due to the time constraints of this project, none of the actual implementation was completed for this class.
+ * The source of one LiDAR's scans. The planned model was the Hokuyo UBG-04LX-F01 Lidar
+ * (https://www.hokuyo-aut.jp/search/single.php?serial=164), read through hokuyoaist;
+ * the simulation supplies its own devices.
  */
-class LiDAR_sensor public sensor {
-    //todo: implement this class and its run method so that it can accurately detect nearby objects
+class lidar_device {
+public:
+	virtual ~lidar_device() {}
 
+	/**
+	 * @brief Waits for the next sweep and reads it.
+	 * @param out Filled with the scan; time_us is on the device's own clock
+	 * @return true if a scan was read, false on a timeout or an error; either way the
+	 * call must return within a few scan periods so the thread can be stopped
+	 */
+	virtual bool read_scan(lidar_scan &out) = 0;
+
+	/**
+	 * @brief Tries to bring the device back after read_scan() has failed many times in a
+	 * row, for example by reopening its port and restarting the scan.
+	 * @return false if the device cannot be read again; the default has nothing to reset
+	 */
+	virtual bool reset() { return true; }
+};
+
+/**
+ * @brief Where a LiDAR is mounted on the tractor.
+ * @var x distance ahead of the rear axle (m)
+ * @var y distance to the left of the center line (m)
+ * @var yaw angle of the LiDAR's x axis from the tractor's (rad, counterclockwise)
+ */
+struct lidar_extrinsics {
+	float x;
+	float y;
+	float yaw;
+};
+
+/**
+ * This class governs one of the lidar devices that are used for object detection around
+ * the semi-truck. Each LiDAR_sensor reads its device on its own thread, so a slow or
+ * stalled device cannot hold up the others. Every scan is stamped on the Pi's clock,
+ * passed through an optional filter (the hitch_estimator, for the LiDAR that sees the
+ * trailer), converted to points in the truck frame with the sensor's extrinsics,
+ * deskewed if a scan_deskew is set, and pushed into a scan_merger.
+ *
+ * The device's timestamps are converted to the Pi's clock with an offset that is the
+ * smallest difference seen between a sweep's end and its arrival. Transfer delays only
+ * ever add to that difference, so the smallest one is the closest to the true offset;
+ * it is allowed to creep up slowly so a device clock running slow is followed too.
+ *
+ * A failed read is followed by a wait of one sweep before the next, so a device that
+ * fails at once cannot have the thread spin a core. After LIDAR_FAILURES_BEFORE_RESET
+ * failures in a row the device is reset, and after LIDAR_MAX_RESETS resets without a
+ * scan between them, or a reset that fails, the thread gives up on it and has_failed().
+ */
+class LiDAR_sensor {
+public:
+	/**
+	 * @brief The constructor for a LiDAR_sensor; the thread is not started yet.
+	 * @param device_in The device, which must outlive this object
+	 * @param mount_in Where the device is on the tractor
+	 * @param merger_in The merger the scans go to
+	 * @param index_in This sensor's index in the merger
+	 */
+	LiDAR_sensor(lidar_device *device_in, const lidar_extrinsics &mount_in, scan_merger *merger_in, uint8_t index_in);
+
+	/**
+	 * @brief Stops the thread if it is running.
+	 */
+	~LiDAR_sensor();
+
+	/**
+	 * @brief Sets a function run on every scan, in the sensor frame, before it is
+	 * converted. It may flag points, for example to mask the trailer.
+	 * @param filter_in The function; must be set before start()
+	 */
+	void set_filter(const std::function<void(lidar_scan &)> &filter_in);
+
+	/**
+	 * @brief Sets the odometry used to take the truck's motion out of every sweep.
+	 * @param deskew_in The deskew stage, which may be shared by several sensors, or NULL
+	 * to leave the points as measured; must be set before start()
+	 */
+	void set_deskew(scan_deskew *deskew_in);
+
+	/**
+	 * @brief Starts reading the device on a new thread.
+	 */
+	void start();
+
+	/**
+	 * @brief Asks the thread to finish and waits for it.
+	 */
+	void stop();
+
+	/**
+	 * @brief Gets the current device to host clock offset.
+	 * @return host time minus device time (us)
+	 */
+	int64_t get_clock_offset_us() const { return clock_offset_us.load(); }
+
+	/// Number of scans pushed to the merger
+	uint32_t get_scan_count() const { return scan_count.load(); }
+	/// Number of reads that failed or timed out
+	uint32_t get_error_count() const { return error_count.load(); }
+	/// Number of times the device has been reset
+	uint32_t get_reset_count() const { return reset_count.load(); }
+	/// true once the thread has given up on the device
+	bool has_failed() const { return failed.load(); }
+
+private:
+	lidar_device *device;
+	lidar_extrinsics mount;
+	rigid_transform to_truck;
+	scan_merger *merger;
+	uint8_t index;
+	std::function<void(lidar_scan &)> filter;
+	scan_deskew *deskew;
+
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<int64_t> clock_offset_us;
+	std::atomic<uint32_t> scan_count;
+	std::atomic<uint32_t> error_count;
+	std::atomic<uint32_t> reset_count;
+	std::atomic<bool> failed;
+	bool synced;
+	uint32_t retry_us;      // wait after a failed read: one sweep of the device
+
+	// Only touched by the sensor's thread
+	lidar_scan scan;
+	float ray_x[LIDAR_MAX_POINTS];
+	float ray_y[LIDAR_MAX_POINTS];
+	float ray_z[LIDAR_MAX_POINTS];
+	float ray_fraction[LIDAR_MAX_POINTS];
+
+	void run();
+	bool recover(uint16_t &failures, uint8_t &resets);
+	void update_clock_offset(uint64_t device_end_us, uint64_t arrival_us);
+	void convert(sensor_points &out);
 };
 
 
@@ -0,0 +1,38 @@
+//
+// Bit-packed occupancy grid; see bit_grid.h.
+//
+
+#include <algorithm>
+#include "bit_grid.h"
+
+bit_grid::bit_grid(const occupancy_grid &map, bool unknown_is_obstacle_in)
+{
+	width = map.get_width();
+	height = map.get_height();
+	resolution = map.get_resolution();
+	origin_x = map.get_origin_x();
+	origin_y = map.get_origin_y();
+	row_words = (width + 63) / 64 + 1;
+	unknown_is_obstacle = unknown_is_obstacle_in;
+	bits.assign((size_t)row_words * height, 0);
+	update(map, 0, 0, (int32_t)width - 1, (int32_t)height - 1);
+}
+
+void bit_grid::update(const occupancy_grid &map, int32_t cx0, int32_t cy0, int32_t cx1, int32_t cy1)
+{
+	cx0 = std::max(cx0, 0);
+	cy0 = std::max(cy0, 0);
+	cx1 = std::min(cx1, (int32_t)width - 1);
+	cy1 = std::min(cy1, (int32_t)height - 1);
+	for (int32_t cy = cy0; cy <= cy1; cy++) {
+		uint64_t *row = &bits[(size_t)cy * row_words];
+		for (int32_t cx = cx0; cx <= cx1; cx++) {
+			uint8_t value = map.get(cx, cy);
+			uint64_t bit = (uint64_t)1 << (cx & 63);
+			if (occupancy_grid::is_obstacle(value) || (unknown_is_obstacle && value == CELL_UNKNOWN))
+				row[cx >> 6] |= bit;
+			else
+				row[cx >> 6] &= ~bit;
+		}
+	}
+}
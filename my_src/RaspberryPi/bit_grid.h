@@ -0,0 +1,76 @@
+/**
+ * The bit_grid is an occupancy_grid packed down to one bit per cell, set where the cell
+ * is blocked. Each row is a run of 64-bit words, so a footprint_mask can be checked
+ * against 64 cells of a row with a single AND. Rows carry one spare word at the end,
+ * always clear, so a read of the word after the last one needs no bounds check.
+ */
+
+#ifndef ME507_BIT_GRID_H
+#define ME507_BIT_GRID_H
+
+#include <cstdint>
+#include <vector>
+#include "occupancy_grid.h"
+
+class bit_grid {
+public:
+	/**
+	 * @brief The constructor for a bit_grid matching a map.
+	 * @param map The map to pack
+	 * @param unknown_is_obstacle_in true to count unknown cells as blocked, as a planner
+	 * should
+	 */
+	bit_grid(const occupancy_grid &map, bool unknown_is_obstacle_in = true);
+
+	/**
+	 * @brief Packs a block of the map again, after its cells changed. The map must be
+	 * the size of the one the bit_grid was built from.
+	 * @param map The map
+	 * @param cx0 Lowest column
+	 * @param cy0 Lowest row
+	 * @param cx1 Highest column
+	 * @param cy1 Highest row
+	 */
+	void update(const occupancy_grid &map, int32_t cx0, int32_t cy0, int32_t cx1, int32_t cy1);
+
+	/// True if a cell, which must be inside the grid, is blocked
+	bool get(int32_t cx, int32_t cy) const
+	{
+		return (bits[(uint32_t)cy * row_words + ((uint32_t)cx >> 6)] >> (cx & 63)) & 1;
+	}
+
+	/**
+	 * @brief Reads 64 cells of a row at once.
+	 * @param cx The first cell's column, which must be inside the grid; cells past the
+	 * end of the row read as clear
+	 * @param cy The row, which must be inside the grid
+	 * @return the cells, the first in the lowest bit
+	 */
+	uint64_t read(uint32_t cx, uint32_t cy) const
+	{
+		const uint64_t *row = &bits[(size_t)cy * row_words + (cx >> 6)];
+		uint32_t shift = cx & 63;
+		return shift ? (row[0] >> shift) | (row[1] << (64 - shift)) : row[0];
+	}
+
+	uint32_t get_width() const { return width; }
+	uint32_t get_height() const { return height; }
+	float get_resolution() const { return resolution; }
+	float get_origin_x() const { return origin_x; }
+	float get_origin_y() const { return origin_y; }
+	/// Memory the bits take (bytes)
+	size_t get_bytes() const { return bits.size() * sizeof(uint64_t); }
+
+private:
+	uint32_t width;
+	uint32_t height;
+	float resolution;
+	float origin_x;
+	float origin_y;
+	uint32_t row_words;         // words per row, the spare one included
+	bool unknown_is_obstacle;
+	std::vector<uint64_t> bits;
+};
+
+
+#endif //ME507_BIT_GRID_H
@@ -0,0 +1,123 @@
+//
+// Time-to-collision check on raw scans; see collision_guard.h.
+//
+
+#include <cmath>
+#include "collision_guard.h"
+#include "host_clock.h"
+#include "../semi_truck_data_t.h"
+
+#define STRAIGHT_CURVATURE 1e-3f    // 1/m under which the corridor is taken as straight
+
+collision_guard::collision_guard(const guard_config &config_in)
+{
+	config = config_in;
+	if (config.min_points < 1)
+		config.min_points = 1;
+	else if (config.min_points > GUARD_MAX_POINTS)
+		config.min_points = GUARD_MAX_POINTS;
+	motion.store(0);
+	braking.store(false);
+	direction = 1.0f;
+	triggers = 0;
+	checks = 0;
+	max_check_us = 0;
+}
+
+void collision_guard::set_motion(int16_t wheel_speed, int16_t steer_output)
+{
+	motion.store((uint32_t)(uint16_t)wheel_speed | ((uint32_t)(uint16_t)steer_output << 16));
+}
+
+guard_result collision_guard::check(const lidar_scan &scan)
+{
+	uint64_t start = host_time_us();
+	uint32_t m = motion.load();
+	float speed = (int16_t)(uint16_t)(m & 0xFFFF) / WHEEL_SPEED_PER_M_S;
+	float steer = (int16_t)(uint16_t)(m >> 16) / STEER_OUTPUT_PER_RAD;
+	bool moving = fabsf(speed) >= config.min_speed;
+	if (moving)
+		direction = speed > 0.0f ? 1.0f : -1.0f;
+
+	guard_result out;
+	out.distance = corridor_distance(scan, tanf(steer) / config.wheelbase);
+	out.ttc = moving ? out.distance / fabsf(speed) : INFINITY;
+	out.triggered = false;
+	if (!braking.load() && out.ttc < config.brake_ttc) {
+		braking.store(true);
+		out.triggered = true;
+		triggers++;
+		if (on_brake)
+			on_brake();
+	}
+	else if (braking.load() && !moving && out.distance >= config.release_distance) {
+		braking.store(false);
+	}
+	out.brake = braking.load();
+
+	out.check_us = (uint32_t)(host_time_us() - start);
+	if (out.check_us > max_check_us)
+		max_check_us = out.check_us;
+	checks++;
+	return out;
+}
+
+/**
+ * With the rear axle at the origin and the turn center at (0, R), R = 1 / curvature, a
+ * point at (x, y) is in the corridor if its distance from the center is within the band
+ * swept between the inner side of the rear axle and the outer corner of the leading
+ * edge. The angle the axle turns through to reach it, measured the way the truck is
+ * going, is atan2(x, |R| - y sign(R)), negated in reverse; points at a negative angle
+ * are behind. The distance is that angle times |R|, less the leading edge's distance
+ * from the axle.
+ */
+float collision_guard::corridor_distance(const lidar_scan &scan, float curvature) const
+{
+	float lead = direction > 0.0f ? config.front : config.rear;
+	bool straight = fabsf(curvature) < STRAIGHT_CURVATURE;
+	float radius = straight ? 0.0f : 1.0f / curvature;
+	float inner = fabsf(radius) - config.half_width;
+	float outer = hypotf(fabsf(radius) + config.half_width, lead);
+	float cs = cosf(config.sensor_yaw), sn = sinf(config.sensor_yaw);
+
+	// The min_points nearest distances, nearest first
+	float nearest[GUARD_MAX_POINTS];
+	uint8_t found = 0;
+	for (uint16_t i = 0; i < scan.count; i++) {
+		if (!scan_point_is_obstacle(scan, i))
+			continue;
+		float angle = scan.angle_min + i * scan.angle_increment;
+		float lx = scan.ranges[i] * cosf(angle), ly = scan.ranges[i] * sinf(angle);
+		float x = config.sensor_x + cs * lx - sn * ly;
+		float y = config.sensor_y + sn * lx + cs * ly;
+
+		float along;
+		if (straight) {
+			if (fabsf(y) > config.half_width)
+				continue;
+			along = direction * x;
+		}
+		else {
+			float from_center = hypotf(x, y - radius);
+			if (from_center < inner || from_center > outer)
+				continue;
+			float turn = direction * atan2f(x, fabsf(radius) - (radius > 0.0f ? y : -y));
+			along = turn * fabsf(radius);
+		}
+		if (along < 0.0f)
+			continue;
+		float distance = along > lead ? along - lead : 0.0f;
+		if (distance > config.max_distance)
+			continue;
+
+		if (found < config.min_points)
+			found++;
+		else if (distance >= nearest[found - 1])
+			continue;
+		uint8_t k = found - 1;
+		for (; k > 0 && nearest[k - 1] > distance; k--)
+			nearest[k] = nearest[k - 1];
+		nearest[k] = distance;
+	}
+	return found < config.min_points ? INFINITY : nearest[config.min_points - 1];
+}
@@ -0,0 +1,144 @@
+/**
+ * The collision_guard is the short way from a LiDAR scan to the brakes. Localization,
+ * mapping and planning all take their time, and a command built on them leaves the Pi
+ * tens of milliseconds after the scan it saw an obstacle in. The guard needs none of
+ * them: it is run on every raw scan, in the LiDAR's own thread as the LiDAR_sensor's
+ * filter, and works only from the scan and the last wheel_speed and steer_output.
+ *
+ * From those it predicts the corridor the truck sweeps if it keeps going: the arc the
+ * rear axle follows at the commanded steering angle, widened to the truck's width, out
+ * to the leading edge (the tractor's front driving forwards, the trailer's rear in
+ * reverse, with the trailer taken as straight behind the tractor). Every obstacle point
+ * in the corridor is measured along the arc to the leading edge, and the time to
+ * collision is that distance over the speed. When it drops under brake_ttc the guard
+ * latches a brake and calls its brake function at once, which should send
+ * MOTOR_OUTPUT_BRAKE to the ATMega without waiting for the next control period
+ * (pi_comm_task::send_brake()). While is_braking(), whatever writes motor_output must
+ * write MOTOR_OUTPUT_BRAKE, as the control_loop does once given the guard with
+ * control_loop::set_guard(). The brake is let go once the truck has stopped and the
+ * corridor ahead is clear for release_distance.
+ *
+ * A check is one pass over the rays with no allocation, a few microseconds for a full
+ * sweep. Its run time is measured and kept, since it is all the latency the guard adds
+ * between a scan reaching the Pi and the brake command going out.
+ */
+
+#ifndef ME507_COLLISION_GUARD_H
+#define ME507_COLLISION_GUARD_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include "lidar_scan.h"
+
+/// Most corridor points min_points may ask for
+#define GUARD_MAX_POINTS 8
+
+/**
+ * @brief Settings of a collision_guard.
+ * @var sensor_x x of the LiDAR ahead of the rear axle (m)
+ * @var sensor_y y of the LiDAR left of the center line (m)
+ * @var sensor_yaw angle of the LiDAR's x axis from the tractor's (rad)
+ * @var wheelbase distance from the tractor's front to rear axle (m)
+ * @var front leading edge ahead of the rear axle when driving forwards (m)
+ * @var rear leading edge behind the rear axle when reversing (m)
+ * @var half_width half the width of the swept corridor, margin included (m)
+ * @var brake_ttc time to collision under which the brake is applied (s)
+ * @var release_distance clear distance ahead needed to let go of the brake once stopped (m)
+ * @var min_speed speed under which the truck counts as stopped (m/s)
+ * @var max_distance farthest along the corridor a point is looked at (m)
+ * @var min_points corridor points needed to count as an obstacle, so one stray return
+ * cannot stop the truck; the distance is that of the min_points-th nearest, at most
+ * GUARD_MAX_POINTS
+ */
+struct guard_config {
+	float sensor_x;
+	float sensor_y;
+	float sensor_yaw;
+	float wheelbase;
+	float front;
+	float rear;
+	float half_width;
+	float brake_ttc;
+	float release_distance;
+	float min_speed;
+	float max_distance;
+	uint8_t min_points;
+};
+
+/**
+ * @brief The outcome of checking one scan.
+ * @var brake true while the brake is latched
+ * @var triggered true if this scan latched it
+ * @var ttc time to collision (s), INFINITY if nothing is in the corridor or the truck
+ * has stopped
+ * @var distance free distance along the corridor (m), INFINITY if nothing is in it
+ * @var check_us run time of the check (us)
+ */
+struct guard_result {
+	bool     brake;
+	bool     triggered;
+	float    ttc;
+	float    distance;
+	uint32_t check_us;
+};
+
+class collision_guard {
+public:
+	/**
+	 * @brief The constructor for a collision_guard with the truck stopped and no brake.
+	 * @param config_in The guard settings
+	 */
+	collision_guard(const guard_config &config_in);
+
+	/**
+	 * @brief Sets the function called when a scan latches the brake. It is called on
+	 * the thread that checks the scan, so it must send the command itself rather than
+	 * leave it for another task.
+	 * @param on_brake_in The function; must be set before scans are checked
+	 */
+	void set_brake_function(const std::function<void()> &on_brake_in) { on_brake = on_brake_in; }
+
+	/**
+	 * @brief Records the latest motion. Safe to call from any thread.
+	 * @param wheel_speed The wheel_speed reported by the ATMega
+	 * @param steer_output The steering command last sent
+	 */
+	void set_motion(int16_t wheel_speed, int16_t steer_output);
+
+	/**
+	 * @brief Checks a scan against the corridor and latches or lets go of the brake.
+	 * Points flagged as the trailer or invalid are skipped. Only one thread may check
+	 * scans.
+	 * @param scan The scan, in the LiDAR frame
+	 * @return what was found
+	 */
+	guard_result check(const lidar_scan &scan);
+
+	/// true while the brake is latched; safe to read from any thread
+	bool is_braking() const { return braking.load(); }
+
+	/// Number of times the brake has been latched
+	uint32_t get_trigger_count() const { return triggers; }
+	/// Number of scans checked
+	uint32_t get_check_count() const { return checks; }
+	/// Longest run time of a check (us)
+	uint32_t get_max_check_us() const { return max_check_us; }
+
+private:
+	guard_config config;
+	std::function<void()> on_brake;
+
+	std::atomic<uint32_t> motion;       // wheel_speed in the low half, steer_output in the high
+	std::atomic<bool> braking;
+	float direction;                    // +1 forwards, -1 in reverse, as last seen moving
+
+	uint32_t triggers;
+	uint32_t checks;
+	uint32_t max_check_us;
+
+	float corridor_distance(const lidar_scan &scan, float curvature) const;
+};
+
+
+#endif //ME507_COLLISION_GUARD_H
@@ -2,4 +2,300 @@
 // Created by nate on 11/19/18.
 //
 
+#include <cmath>
 #include "control_loop.h"
+#include "mpc_steering.h"
+#include "collision_guard.h"
+
+#define SEARCH_WINDOW 50        // path points searched ahead of the last closest point
+#define GOAL_TOLERANCE 0.10f    // m from the last path point that counts as arrived
+#define SLOWDOWN_DISTANCE 1.0f  // m before the end of the path where the speed ramps down
+#define MIN_APPROACH_SPEED 0.15f
+#define MIN_STEER_GAIN 0.5f     // range of steering gains set_actuator_model() accepts
+#define MAX_STEER_GAIN 2.0f
+
+control_loop::control_loop(const truck_geometry &geometry_in, const control_gains &gains_in)
+{
+	geometry = geometry_in;
+	gains = gains_in;
+	mpc = NULL;
+	guard = NULL;
+	points = NULL;
+	count = 0;
+	reverse = false;
+	speed = 0.0f;
+	steer_gain = 1.0f;
+	top_speed = 0.0f;
+	closest = 0;
+	speed_integral = 0.0f;
+	last_time_us = 0;
+	cross_track_error = 0.0f;
+	hitch_target = 0.0f;
+	finished = true;
+}
+
+void control_loop::set_path(const path_point *points_in, uint16_t count_in, bool reverse_in, float speed_in)
+{
+	points = points_in;
+	count = count_in;
+	reverse = reverse_in;
+	speed = speed_in;
+	closest = 0;
+	speed_integral = 0.0f;
+	last_time_us = 0;
+	cross_track_error = 0.0f;
+	hitch_target = 0.0f;
+	finished = (count_in == 0);
+	if (mpc)
+		mpc->reset();
+}
+
+void control_loop::set_mpc(mpc_steering *mpc_in)
+{
+	mpc = mpc_in;
+	if (mpc)
+		mpc->reset();
+}
+
+void control_loop::update(const control_input &in, semi_truck_data_t *out_data)
+{
+	float dt = last_time_us ? (in.time_us - last_time_us) * 1e-6f : 0.0f;
+	last_time_us = in.time_us;
+
+	if (finished) {
+		write_stopped(out_data);
+		return;
+	}
+
+	float goal_x, goal_y, to_end;
+	float tx = 0.0f, ty = 0.0f, trailer_heading = 0.0f;
+	if (!reverse) {
+		track(in.x, in.y, gains.lookahead, goal_x, goal_y, to_end);
+	}
+	else {
+		// When reversing it is the trailer axle that has to follow the path
+		float hx = in.x - geometry.hitch_offset * cosf(in.heading);
+		float hy = in.y - geometry.hitch_offset * sinf(in.heading);
+		trailer_heading = in.heading + in.hitch_angle;
+		tx = hx - geometry.trailer_length * cosf(trailer_heading);
+		ty = hy - geometry.trailer_length * sinf(trailer_heading);
+		track(tx, ty, gains.reverse_lookahead, goal_x, goal_y, to_end);
+	}
+
+	if (to_end < GOAL_TOLERANCE) {
+		finished = true;
+		write_stopped(out_data);
+		return;
+	}
+
+	float target = speed;
+	if (to_end < SLOWDOWN_DISTANCE) {
+		target = speed * to_end / SLOWDOWN_DISTANCE;
+		if (target < MIN_APPROACH_SPEED)
+			target = MIN_APPROACH_SPEED;
+	}
+	if (reverse)
+		target = -target;
+
+	float steer;
+	if (mpc) {
+		steer = mpc->steer(in, points, count, closest, reverse, target);
+		if (reverse)
+			hitch_target = mpc->get_hitch_reference();
+	}
+	else if (!reverse) {
+		steer = forward_steering(in, goal_x, goal_y);
+	}
+	else {
+		steer = reverse_steering(in, tx, ty, trailer_heading, goal_x, goal_y);
+	}
+	write_outputs(in, steer, target, dt, out_data);
+}
+
+void control_loop::drive(const control_input &in, float steer, float target, semi_truck_data_t *out_data)
+{
+	float dt = last_time_us ? (in.time_us - last_time_us) * 1e-6f : 0.0f;
+	last_time_us = in.time_us;
+	if (target == 0.0f)
+		speed_integral = 0.0f;
+	write_outputs(in, steer, target, dt, out_data);
+}
+
+void control_loop::write_outputs(const control_input &in, float steer, float target, float dt,
+                                 semi_truck_data_t *out_data)
+{
+	if (steer > geometry.max_steer)
+		steer = geometry.max_steer;
+	else if (steer < -geometry.max_steer)
+		steer = -geometry.max_steer;
+
+	// Ask for more or less than the wheel angle wanted if the servo falls short of or
+	// overshoots its command, but never past the servo's travel
+	steer /= steer_gain;
+	if (steer > geometry.max_steer)
+		steer = geometry.max_steer;
+	else if (steer < -geometry.max_steer)
+		steer = -geometry.max_steer;
+
+	out_data->steer_output = (int16_t)lroundf(steer * STEER_OUTPUT_PER_RAD);
+	if (guard && guard->is_braking()) {
+		out_data->speed_setpoint = 0;
+		out_data->motor_output = MOTOR_OUTPUT_BRAKE;
+		speed_integral = 0.0f;
+		return;
+	}
+	out_data->speed_setpoint = (int16_t)lroundf(target * WHEEL_SPEED_PER_M_S);
+	out_data->motor_output = speed_control(in, target, dt);
+}
+
+void control_loop::write_stopped(semi_truck_data_t *out_data)
+{
+	out_data->steer_output = 0;
+	out_data->motor_output = guard && guard->is_braking() ? MOTOR_OUTPUT_BRAKE : 0;
+	out_data->speed_setpoint = 0;
+	speed_integral = 0.0f;
+}
+
+bool control_loop::set_actuator_model(float steer_gain_in, float top_speed_in)
+{
+	if (!(steer_gain_in >= MIN_STEER_GAIN && steer_gain_in <= MAX_STEER_GAIN) || !(top_speed_in >= 0.0f))
+		return false;
+	steer_gain = steer_gain_in;
+	top_speed = top_speed_in;
+	return true;
+}
+
+float control_loop::imu_angle_to_heading(uint16_t imu_angle)
+{
+	float heading = -(float)imu_angle / IMU_ANGLE_PER_DEG * (float)(M_PI / 180.0);
+	if (heading <= -(float)M_PI)
+		heading += 2.0f * (float)M_PI;
+	return heading;
+}
+
+/**
+ * Finds the path point nearest (px, py), searching a short window ahead of the last one
+ * so the search is O(1) and the truck cannot jump back to an earlier part of a path
+ * that crosses itself. Sets the cross-track error, the pure pursuit goal point at least
+ * lookahead away, and the distance left to the end of the path.
+ */
+void control_loop::track(float px, float py, float lookahead, float &goal_x, float &goal_y, float &to_end)
+{
+	uint16_t last = closest + SEARCH_WINDOW < count ? closest + SEARCH_WINDOW : count - 1;
+	float best = 1e30f;
+	for (uint16_t i = closest; i <= last; i++) {
+		float dx = points[i].x - px;
+		float dy = points[i].y - py;
+		float d2 = dx * dx + dy * dy;
+		if (d2 < best) {
+			best = d2;
+			closest = i;
+		}
+	}
+
+	// Cross-track error against the segment leaving the closest point
+	if (closest + 1 < count) {
+		float sx = points[closest + 1].x - points[closest].x;
+		float sy = points[closest + 1].y - points[closest].y;
+		float len = sqrtf(sx * sx + sy * sy);
+		if (len > 0.0f)
+			cross_track_error = ((px - points[closest].x) * sy - (py - points[closest].y) * sx) / len;
+		else
+			cross_track_error = sqrtf(best);
+	}
+	else {
+		cross_track_error = sqrtf(best);
+	}
+
+	uint16_t goal = closest;
+	float look2 = lookahead * lookahead;
+	while (goal + 1 < count) {
+		float dx = points[goal].x - px;
+		float dy = points[goal].y - py;
+		if (dx * dx + dy * dy >= look2)
+			break;
+		goal++;
+	}
+	goal_x = points[goal].x;
+	goal_y = points[goal].y;
+
+	// A path that loops back past its own end is not nearly done until the closest point
+	// is close to the end along the path too
+	if (count - 1 - closest > SEARCH_WINDOW) {
+		to_end = 1e30f;
+		return;
+	}
+
+	float ex = points[count - 1].x - px;
+	float ey = points[count - 1].y - py;
+	to_end = sqrtf(ex * ex + ey * ey);
+	if (closest + 1 < count && to_end < lookahead) {
+		// Near the end the straight line distance is good enough, but make sure the
+		// truck is not counted as arrived while it is still beside the last point
+		float sx = points[count - 1].x - points[count - 2].x;
+		float sy = points[count - 1].y - points[count - 2].y;
+		if (ex * sx + ey * sy < 0.0f)
+			to_end = 0.0f;
+	}
+}
+
+float control_loop::forward_steering(const control_input &in, float goal_x, float goal_y) const
+{
+	float c = cosf(in.heading);
+	float s = sinf(in.heading);
+	float dx = goal_x - in.x;
+	float dy = goal_y - in.y;
+	float lateral = -s * dx + c * dy;
+	float dist2 = dx * dx + dy * dy;
+	if (dist2 < 1e-6f)
+		return 0.0f;
+
+	// Pure pursuit: the arc through the goal point has curvature 2 y / L^2
+	return atanf(2.0f * geometry.wheelbase * lateral / dist2);
+}
+
+float control_loop::reverse_steering(const control_input &in, float tx, float ty, float trailer_heading,
+                                     float goal_x, float goal_y)
+{
+	// Pure pursuit for the trailer, as if it were a car driving the other way
+	float back = trailer_heading + (float)M_PI;
+	float dx = goal_x - tx;
+	float dy = goal_y - ty;
+	float lateral = -sinf(back) * dx + cosf(back) * dy;
+	float dist2 = dx * dx + dy * dy;
+	float curvature = dist2 > 1e-6f ? 2.0f * lateral / dist2 : 0.0f;
+
+	// In steady reversing tan(hitch) = trailer_length * curvature
+	float limit = 0.8f * geometry.max_hitch;
+	hitch_target = atanf(geometry.trailer_length * curvature);
+	if (hitch_target > limit)
+		hitch_target = limit;
+	else if (hitch_target < -limit)
+		hitch_target = -limit;
+
+	// Cancel the trailer's own unstable rotation and pull the hitch angle to its target;
+	// this makes d(hitch)/ds = -hitch_gain * (hitch - target) for the kinematic model
+	float h = in.hitch_angle;
+	float l2 = geometry.trailer_length;
+	float denom = 1.0f + geometry.hitch_offset * cosf(h) / l2;
+	float tan_steer = geometry.wheelbase * (-sinf(h) / l2 - gains.hitch_gain * (h - hitch_target)) / denom;
+	return atanf(tan_steer);
+}
+
+int16_t control_loop::speed_control(const control_input &in, float target, float dt)
+{
+	float measured = in.wheel_speed / WHEEL_SPEED_PER_M_S;
+	float error = target - measured;
+	float ff = top_speed > 0.0f ? MOTOR_OUTPUT_FULL / top_speed : gains.speed_ff;
+	float out = ff * target + gains.speed_kp * error + gains.speed_ki * speed_integral;
+
+	// Only integrate while the output is not saturated, so the integral cannot wind up
+	if (out > MOTOR_OUTPUT_FULL)
+		out = MOTOR_OUTPUT_FULL;
+	else if (out < -MOTOR_OUTPUT_FULL)
+		out = -MOTOR_OUTPUT_FULL;
+	else
+		speed_integral += error * dt;
+
+	return (int16_t)lroundf(out);
+}
@@ -1,15 +1,194 @@
 /**
  * Created by nate furbeyre on 11/18/18.
- * The control loop task runs the control loops for both the steering servo and the motor driver
- * This class has not been fully implemented due to the time constraints of the class.
+ * The control loop task runs the control loops for both the steering servo and the motor driver.
+ * Driving forwards, the tractor follows the path with pure pursuit steering. Reversing, the
+ * trailer is the vehicle that follows the path: a pure pursuit on the trailer axle picks the
+ * hitch angle needed, and an inner loop steers the tractor to hold that hitch angle, which
+ * is unstable on its own when backing up. Either way the steering can instead be planned
+ * by an mpc_steering, which looks further ahead along the path. Speed is held with a PI
+ * loop on the wheel speed.
+ * Outputs are written into the same semi_truck_data_t fields that are sent to the ATMega.
  */
 
 #ifndef ME507_CONTROL_LOOP_H
 #define ME507_CONTROL_LOOP_H
 
+#include <cstdint>
+#include "../semi_truck_data_t.h"
+
+/**
+ * @brief Fixed dimensions of the tractor and trailer.
+ * @var wheelbase distance from the tractor's front to rear axle (m)
+ * @var hitch_offset distance the fifth wheel sits behind the tractor's rear axle (m)
+ * @var trailer_length distance from the kingpin to the trailer axle (m)
+ * @var max_steer largest front wheel angle the servo can reach (rad)
+ * @var max_hitch hitch angle beyond which the truck is jackknifed (rad)
+ */
+struct truck_geometry {
+	float wheelbase;
+	float hitch_offset;
+	float trailer_length;
+	float max_steer;
+	float max_hitch;
+};
+
+/**
+ * @brief Tunable gains of the control loop.
+ * @var lookahead pure pursuit lookahead distance driving forwards (m)
+ * @var reverse_lookahead pure pursuit lookahead distance for the trailer when reversing (m)
+ * @var hitch_gain how fast the hitch angle is pulled to its target when reversing (1/m)
+ * @var speed_kp proportional speed gain (motor_output per m/s of error)
+ * @var speed_ki integral speed gain (motor_output per m of accumulated error)
+ * @var speed_ff feedforward (motor_output per m/s of target speed)
+ */
+struct control_gains {
+	float lookahead;
+	float reverse_lookahead;
+	float hitch_gain;
+	float speed_kp;
+	float speed_ki;
+	float speed_ff;
+};
+
+/// A point on the path to follow, in the same world frame as the truck's pose (m)
+struct path_point {
+	float x;
+	float y;
+};
+
+/**
+ * @brief Everything the control loop needs to know about the truck for one update.
+ * @var time_us time of the update (us)
+ * @var x x of the tractor's rear axle (m)
+ * @var y y of the tractor's rear axle (m)
+ * @var heading tractor heading, counterclockwise from the x axis (rad)
+ * @var hitch_angle trailer heading minus tractor heading (rad)
+ * @var wheel_speed the wheel_speed reported by the ATMega (mm/s)
+ */
+struct control_input {
+	uint64_t time_us;
+	float    x;
+	float    y;
+	float    heading;
+	float    hitch_angle;
+	int16_t  wheel_speed;
+};
+
+class mpc_steering;
+class collision_guard;
 
 class control_loop {
+public:
+	/**
+	 * @brief The constructor for the control loop.
+	 * @param geometry_in The dimensions of the truck
+	 * @param gains_in The controller gains
+	 */
+	control_loop(const truck_geometry &geometry_in, const control_gains &gains_in);
+
+	/**
+	 * @brief Sets the path to follow and restarts tracking from its beginning.
+	 * @param points_in The path; the array must stay valid while it is being followed
+	 * @param count_in The number of points in the path
+	 * @param reverse_in true to back the trailer along the path, false to drive forwards
+	 * @param speed_in Target speed along the path (m/s, always positive)
+	 */
+	void set_path(const path_point *points_in, uint16_t count_in, bool reverse_in, float speed_in);
+
+	/**
+	 * @brief Steers with model-predictive control instead of pure pursuit, or goes back
+	 * to pure pursuit. The speed loop is the same either way.
+	 * @param mpc_in The controller to plan the steering with, which must outlive its use
+	 * here, or NULL for pure pursuit
+	 */
+	void set_mpc(mpc_steering *mpc_in);
+
+	/**
+	 * @brief Makes the outputs hold the brake while a collision_guard is braking: motor_output
+	 * is MOTOR_OUTPUT_BRAKE and speed_setpoint zero whatever the path or target, and the
+	 * speed integral is cleared. The steering carries on as usual.
+	 * @param guard_in The guard, which must outlive its use here, or NULL for none
+	 */
+	void set_guard(const collision_guard *guard_in) { guard = guard_in; }
+
+	/**
+	 * @brief Runs one control period.
+	 * Writes steer_output, motor_output and speed_setpoint into out_data.
+	 * @param in The current state of the truck
+	 * @param out_data The data that will be sent to the ATMega
+	 */
+	void update(const control_input &in, semi_truck_data_t *out_data);
+
+	/**
+	 * @brief Runs one control period for a steering angle and speed chosen elsewhere,
+	 * such as by the trailer_coupler, instead of by following the path.
+	 * The steering is corrected and clamped and the speed held the same way as update()
+	 * does; the path being followed, if any, is left where it was. A target of zero
+	 * also clears the speed integral, so the next move starts afresh.
+	 * @param in The current state of the truck; only time_us and wheel_speed are used
+	 * @param steer The front wheel angle wanted (rad)
+	 * @param target The speed wanted (m/s, negative in reverse)
+	 * @param out_data The data that will be sent to the ATMega
+	 */
+	void drive(const control_input &in, float steer, float target, semi_truck_data_t *out_data);
+
+	/**
+	 * @brief Converts the raw BNO055 heading on the link to the heading used here.
+	 * The BNO055 heading turns clockwise from 0 to 360 degrees; this returns radians
+	 * counterclockwise between -pi and pi.
+	 * @param imu_angle The imu_angle value from semi_truck_data_t
+	 * @return the heading in radians
+	 */
+	static float imu_angle_to_heading(uint16_t imu_angle);
+
+	/// Distance of the tracked point (tractor forwards, trailer reversing) from the path (m)
+	float get_cross_track_error() const { return cross_track_error; }
+	/// Hitch angle the reverse controller is steering towards (rad)
+	float get_hitch_target() const { return hitch_target; }
+	/// true once the tracked point has reached the end of the path
+	bool is_finished() const { return finished; }
+
+	void set_gains(const control_gains &gains_in) { gains = gains_in; }
+	const control_gains &get_gains() const { return gains; }
+
+	/**
+	 * @brief Corrects the commands for actuators that have drifted from nominal, as
+	 * found by a plant_identifier. Until this is called the nominal truck is assumed.
+	 * @param steer_gain_in Front wheel angle the servo reaches per radian commanded
+	 * @param top_speed_in Steady speed at full motor_output (m/s), which replaces the
+	 * speed_ff gain; 0 keeps speed_ff
+	 * @return false, changing nothing, if either value is out of the plausible range
+	 */
+	bool set_actuator_model(float steer_gain_in, float top_speed_in);
+
+private:
+	truck_geometry geometry;
+	control_gains gains;
+	mpc_steering *mpc;
+	const collision_guard *guard;
+
+	const path_point *points;
+	uint16_t count;
+	bool reverse;
+	float speed;
+
+	float steer_gain;           // wheel angle per commanded angle
+	float top_speed;            // m/s at full motor_output, 0 to use gains.speed_ff
+
+	uint16_t closest;           // index of the path point nearest the tracked point
+	float speed_integral;
+	uint64_t last_time_us;
+	float cross_track_error;
+	float hitch_target;
+	bool finished;
 
+	void track(float px, float py, float lookahead, float &goal_x, float &goal_y, float &to_end);
+	float forward_steering(const control_input &in, float goal_x, float goal_y) const;
+	float reverse_steering(const control_input &in, float tx, float ty, float trailer_heading,
+	                       float goal_x, float goal_y);
+	int16_t speed_control(const control_input &in, float target, float dt);
+	void write_outputs(const control_input &in, float steer, float target, float dt, semi_truck_data_t *out_data);
+	void write_stopped(semi_truck_data_t *out_data);
 };
 
 
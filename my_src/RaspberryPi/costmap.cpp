@@ -0,0 +1,197 @@
+//
+// Inflated costmap over the occupancy grid; see costmap.h.
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include "costmap.h"
+#include "host_clock.h"
+
+#define CLASS_FREE 0
+#define CLASS_OBSTACLE 1
+#define CLASS_UNKNOWN 2
+
+costmap::costmap(occupancy_grid &map_in, const costmap_config &config_in)
+{
+	map = &map_in;
+	config = config_in;
+	if (config.tile_size < 1)
+		config.tile_size = 1;
+	width = map->get_width();
+	height = map->get_height();
+	origin_x = map->get_origin_x();
+	origin_y = map->get_origin_y();
+	inv_resolution = 1.0f / map->get_resolution();
+	border = (uint32_t)ceilf(config.inflation_radius * inv_resolution);
+
+	tiles_x = (width + config.tile_size - 1) / config.tile_size;
+	tiles_y = (height + config.tile_size - 1) / config.tile_size;
+	dirty.assign((size_t)tiles_x * tiles_y, 0);
+	dirty_count = 0;
+	update_us = 0;
+	distance.assign((size_t)width * height, 0.0f);
+	cost.assign((size_t)width * height, COST_LETHAL);
+	rebuild();
+}
+
+uint8_t costmap::cell_class(uint8_t value) const
+{
+	if (value == CELL_UNKNOWN)
+		return config.unknown_is_obstacle ? CLASS_OBSTACLE : CLASS_UNKNOWN;
+	return occupancy_grid::is_obstacle(value) ? CLASS_OBSTACLE : CLASS_FREE;
+}
+
+uint8_t costmap::cost_of(uint8_t value, float d) const
+{
+	if (value == CELL_UNKNOWN && !config.unknown_is_obstacle)
+		return COST_UNKNOWN;
+	if (d <= 0.0f)
+		return COST_LETHAL;
+	if (d <= config.inscribed_radius)
+		return COST_INSCRIBED;
+	if (d >= config.inflation_radius)
+		return COST_FREE;
+	return (uint8_t)(COST_INFLATED_MAX * expf(-config.cost_scaling * (d - config.inscribed_radius)));
+}
+
+bool costmap::set_cell(int32_t cx, int32_t cy, uint8_t value)
+{
+	uint8_t old = map->get(cx, cy);
+	map->set(cx, cy, value);
+	if (cell_class(old) == cell_class(value))
+		return false;
+	mark_dirty(cx, cy, cx, cy);
+	return true;
+}
+
+void costmap::mark_dirty(int32_t cx0, int32_t cy0, int32_t cx1, int32_t cy1)
+{
+	cx0 = std::max(cx0 - (int32_t)border, 0);
+	cy0 = std::max(cy0 - (int32_t)border, 0);
+	cx1 = std::min(cx1 + (int32_t)border, (int32_t)width - 1);
+	cy1 = std::min(cy1 + (int32_t)border, (int32_t)height - 1);
+	if (cx0 > cx1 || cy0 > cy1)
+		return;
+	for (int32_t ty = cy0 / config.tile_size; ty <= cy1 / config.tile_size; ty++) {
+		for (int32_t tx = cx0 / config.tile_size; tx <= cx1 / config.tile_size; tx++) {
+			uint8_t &flag = dirty[ty * tiles_x + tx];
+			dirty_count += !flag;
+			flag = 1;
+		}
+	}
+}
+
+/**
+ * Each ray is walked cell by cell from the LiDAR with Bresenham's line, clipped to the
+ * map. Clearing stops a cell short of where the ray ended, so range noise that carries a
+ * ray into a wall does not wear the wall away. Only cells whose class changes dirty any
+ * tiles, so a scan of a scene the map already agrees with costs no update at all.
+ */
+uint32_t costmap::add_scan(const lidar_scan &scan, float x, float y, float heading)
+{
+	int32_t sx = (int32_t)floorf((x - origin_x) * inv_resolution);
+	int32_t sy = (int32_t)floorf((y - origin_y) * inv_resolution);
+	float resolution = map->get_resolution();
+	uint32_t changed = 0;
+	for (uint16_t i = 0; i < scan.count; i++) {
+		if (!scan_point_is_obstacle(scan, i))
+			continue;
+		float angle = heading + scan.angle_min + i * scan.angle_increment;
+		float c = cosf(angle), s = sinf(angle);
+		float r = scan.ranges[i];
+		float clear = r - resolution;
+		if (clear > 0.0f) {
+			int32_t ex = (int32_t)floorf((x + clear * c - origin_x) * inv_resolution);
+			int32_t ey = (int32_t)floorf((y + clear * s - origin_y) * inv_resolution);
+			int32_t dx = abs(ex - sx), dy = -abs(ey - sy);
+			int32_t step_x = sx < ex ? 1 : -1, step_y = sy < ey ? 1 : -1;
+			int32_t error = dx + dy;
+			int32_t cx = sx, cy = sy;
+			while (cx != ex || cy != ey) {
+				if (map->contains(cx, cy) && map->get(cx, cy) != CELL_FREE)
+					changed += set_cell(cx, cy, CELL_FREE);
+				int32_t twice = 2 * error;
+				if (twice >= dy) {
+					error += dy;
+					cx += step_x;
+				}
+				if (twice <= dx) {
+					error += dx;
+					cy += step_y;
+				}
+			}
+		}
+
+		int32_t hx = (int32_t)floorf((x + r * c - origin_x) * inv_resolution);
+		int32_t hy = (int32_t)floorf((y + r * s - origin_y) * inv_resolution);
+		if (map->contains(hx, hy) && map->get(hx, hy) != CELL_OCCUPIED)
+			changed += set_cell(hx, hy, CELL_OCCUPIED);
+	}
+	return changed;
+}
+
+uint32_t costmap::update()
+{
+	uint64_t start = host_time_us();
+	uint32_t updated = dirty_count;
+	for (uint32_t ty = 0; ty < tiles_y && dirty_count > 0; ty++) {
+		uint32_t tx = 0;
+		while (tx < tiles_x) {
+			if (!dirty[ty * tiles_x + tx]) {
+				tx++;
+				continue;
+			}
+			uint32_t end = tx;
+			while (end < tiles_x && dirty[ty * tiles_x + end])
+				end++;
+			update_run(tx, end, ty);
+			tx = end;
+		}
+	}
+	update_us = (uint32_t)(host_time_us() - start);
+	return updated;
+}
+
+void costmap::rebuild()
+{
+	mark_dirty(0, 0, (int32_t)width - 1, (int32_t)height - 1);
+	update();
+}
+
+/**
+ * Any obstacle within the inflation radius of a cell of the run lies inside the run
+ * grown by the border, so the transform of that block, capped at the radius, is exact
+ * for the run even though the block may miss obstacles further away.
+ */
+void costmap::update_run(uint32_t tile_x0, uint32_t tile_x1, uint32_t tile_y)
+{
+	uint32_t cx0 = tile_x0 * config.tile_size, cx1 = std::min(tile_x1 * config.tile_size, width);
+	uint32_t cy0 = tile_y * config.tile_size, cy1 = std::min(cy0 + config.tile_size, height);
+	uint32_t bx0 = cx0 > border ? cx0 - border : 0, bx1 = std::min(cx1 + border, width);
+	uint32_t by0 = cy0 > border ? cy0 - border : 0, by1 = std::min(cy1 + border, height);
+	uint32_t columns = bx1 - bx0, rows = by1 - by0;
+
+	block.resize((size_t)columns * rows);
+	const uint8_t *cells = map->data();
+	for (uint32_t y = 0; y < rows; y++) {
+		const uint8_t *row = cells + (size_t)(by0 + y) * width + bx0;
+		float *out = &block[(size_t)y * columns];
+		for (uint32_t x = 0; x < columns; x++)
+			out[x] = cell_class(row[x]) == CLASS_OBSTACLE ? 0.0f : DISTANCE_FAR;
+	}
+	occupancy_grid::distance_transform(&block[0], columns, rows, scratch);
+
+	float resolution = map->get_resolution();
+	for (uint32_t cy = cy0; cy < cy1; cy++) {
+		const float *in = &block[(size_t)(cy - by0) * columns + (cx0 - bx0)];
+		for (uint32_t cx = cx0; cx < cx1; cx++) {
+			uint32_t i = cy * width + cx;
+			float d = std::min(sqrtf(in[cx - cx0]) * resolution, config.inflation_radius);
+			distance[i] = d;
+			cost[i] = cost_of(cells[i], d);
+		}
+	}
+	for (uint32_t tx = tile_x0; tx < tile_x1; tx++)
+		dirty[tile_y * tiles_x + tx] = 0;
+	dirty_count -= tile_x1 - tile_x0;
+}
@@ -0,0 +1,195 @@
+/**
+ * The costmap is the layer on top of an occupancy_grid that planning and collision
+ * checking read: for every cell the exact Euclidean distance to the nearest obstacle,
+ * capped at the inflation radius, and a cost byte derived from it. Obstacle cells are
+ * lethal, cells closer than the inscribed radius (the truck's half width) are as good
+ * as lethal for its center, and further out the cost falls off exponentially until it
+ * is zero at the inflation radius.
+ *
+ * Distances come from the separable linear-time distance transform, not from stamping
+ * a disc around every obstacle cell, so their cost does not grow with the radius. The
+ * map is split into square tiles, and changing a cell (by hand or by folding a LiDAR
+ * scan in) only marks the tiles within the inflation radius of it dirty; update() then
+ * transforms each run of dirty tiles in a row of tiles with a border of the inflation
+ * radius around it, which is all that can hold an obstacle within the radius of the
+ * run, and writes back the run alone. A scan that changes a few cells costs a few tiles
+ * rather than the whole map.
+ */
+
+#ifndef ME507_COSTMAP_H
+#define ME507_COSTMAP_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "lidar_scan.h"
+#include "occupancy_grid.h"
+
+/// Cost of a cell with nothing within the inflation radius
+#define COST_FREE 0
+/// Highest cost of a cell the truck's center can be in without touching anything
+#define COST_INFLATED_MAX 252
+/// Cost of a cell closer to an obstacle than the inscribed radius
+#define COST_INSCRIBED 253
+/// Cost of an obstacle cell, or of a point off the map
+#define COST_LETHAL 254
+/// Cost of an unknown cell, when unknown cells are not counted as obstacles
+#define COST_UNKNOWN 255
+
+/**
+ * @brief Parameters of the costmap.
+ * @var tile_size cells along each side of a tile
+ * @var inscribed_radius distance from the truck's center line to its side (m)
+ * @var inflation_radius distance out to which distances are exact and costs above zero (m)
+ * @var cost_scaling rate the cost falls off at beyond the inscribed radius (1/m)
+ * @var unknown_is_obstacle true to count unknown cells as obstacles, as a planner should
+ */
+struct costmap_config {
+	uint16_t tile_size;
+	float    inscribed_radius;
+	float    inflation_radius;
+	float    cost_scaling;
+	bool     unknown_is_obstacle;
+};
+
+class costmap {
+public:
+	/**
+	 * @brief The constructor for a costmap; builds the whole layer.
+	 * @param map_in The map; it must outlive the costmap, and cells changed other than
+	 * through the costmap have to be marked dirty
+	 * @param config_in The inflation settings
+	 */
+	costmap(occupancy_grid &map_in, const costmap_config &config_in);
+
+	/**
+	 * @brief Sets a cell of the map, marking the tiles within the inflation radius of it
+	 * dirty if that can change their costs.
+	 * @param cx The cell's column, which must be inside the map
+	 * @param cy The cell's row, which must be inside the map
+	 * @param value The new cell value
+	 * @return true if tiles were marked dirty
+	 */
+	bool set_cell(int32_t cx, int32_t cy, uint8_t value);
+
+	/**
+	 * @brief Marks every tile within the inflation radius of a block of cells dirty,
+	 * for cells changed directly in the map. The block is clipped to the map.
+	 * @param cx0 Lowest column
+	 * @param cy0 Lowest row
+	 * @param cx1 Highest column
+	 * @param cy1 Highest row
+	 */
+	void mark_dirty(int32_t cx0, int32_t cy0, int32_t cx1, int32_t cy1);
+
+	/**
+	 * @brief Folds a scan into the map: the cells each obstacle ray passes through, up
+	 * to a cell short of its end, are set free and the cell it ends in occupied. Rays that are invalid or flagged as the
+	 * trailer are left out.
+	 * @param scan The scan
+	 * @param x World x of the LiDAR (m)
+	 * @param y World y of the LiDAR (m)
+	 * @param heading Direction of the LiDAR's x axis in the world frame (rad)
+	 * @return the number of cells whose cost can have changed
+	 */
+	uint32_t add_scan(const lidar_scan &scan, float x, float y, float heading);
+
+	/**
+	 * @brief Brings the distances and costs of every dirty tile up to date.
+	 * @return the number of tiles updated
+	 */
+	uint32_t update();
+
+	/**
+	 * @brief Marks the whole map dirty and updates it.
+	 */
+	void rebuild();
+
+	/// Distance from a cell, which must be inside the map, to the nearest obstacle (m)
+	float get_distance(int32_t cx, int32_t cy) const { return distance[(uint32_t)cy * width + cx]; }
+	/// Cost of a cell, which must be inside the map
+	uint8_t get_cost(int32_t cx, int32_t cy) const { return cost[(uint32_t)cy * width + cx]; }
+
+	/**
+	 * @brief Looks up the distance to the nearest obstacle from a world point.
+	 * @return the distance, capped at the inflation radius, or 0 off the map (m)
+	 */
+	float distance_at(float x, float y) const
+	{
+		int32_t cx = (int32_t)floorf((x - origin_x) * inv_resolution);
+		int32_t cy = (int32_t)floorf((y - origin_y) * inv_resolution);
+		if ((uint32_t)cx >= width || (uint32_t)cy >= height)
+			return 0.0f;
+		return distance[(uint32_t)cy * width + cx];
+	}
+
+	/**
+	 * @brief Looks up the cost of a world point.
+	 * @return the cost, or COST_LETHAL off the map
+	 */
+	uint8_t cost_at(float x, float y) const
+	{
+		int32_t cx = (int32_t)floorf((x - origin_x) * inv_resolution);
+		int32_t cy = (int32_t)floorf((y - origin_y) * inv_resolution);
+		if ((uint32_t)cx >= width || (uint32_t)cy >= height)
+			return COST_LETHAL;
+		return cost[(uint32_t)cy * width + cx];
+	}
+
+	const occupancy_grid &get_map() const { return *map; }
+	const costmap_config &get_config() const { return config; }
+	/// Row-major distances, one per cell of the map (m)
+	const float *distances() const { return &distance[0]; }
+	/// Row-major costs, one per cell of the map
+	const uint8_t *costs() const { return &cost[0]; }
+	/// Number of tiles the map is split into
+	uint32_t get_tile_count() const { return tiles_x * tiles_y; }
+	/// Number of tiles waiting for update()
+	uint32_t get_dirty_count() const { return dirty_count; }
+	/// Time the last update() took (us)
+	uint32_t get_update_us() const { return update_us; }
+
+private:
+	occupancy_grid *map;
+	costmap_config config;
+	uint32_t width;
+	uint32_t height;
+	float origin_x;
+	float origin_y;
+	float inv_resolution;
+	uint32_t border;            // cells an obstacle can be from a cell and still count
+
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	std::vector<uint8_t> dirty;
+	uint32_t dirty_count;
+	uint32_t update_us;
+
+	std::vector<float> distance;
+	std::vector<uint8_t> cost;
+
+	// Block the runs of tiles are transformed in, and the transform's buffers
+	std::vector<float> block;
+	distance_scratch scratch;
+
+	/**
+	 * @brief Sorts a cell value into free, obstacle or unknown, as far as cost goes.
+	 */
+	uint8_t cell_class(uint8_t value) const;
+
+	/**
+	 * @brief Works out the cost of a cell from its value and distance.
+	 */
+	uint8_t cost_of(uint8_t value, float d) const;
+
+	/**
+	 * @brief Transforms one run of dirty tiles in a row of tiles and writes it back.
+	 * @param tile_x0 First tile of the run
+	 * @param tile_x1 One past the last tile of the run
+	 * @param tile_y The row of tiles
+	 */
+	void update_run(uint32_t tile_x0, uint32_t tile_x1, uint32_t tile_y);
+};
+
+
+#endif //ME507_COSTMAP_H
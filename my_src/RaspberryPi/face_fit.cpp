@@ -0,0 +1,75 @@
+//
+// Ray tables and the trailer face line fit; see face_fit.h.
+//
+
+#include <cmath>
+#include "face_fit.h"
+
+ray_table::ray_table()
+{
+	angle_min = 0.0f;
+	increment = 0.0f;
+	count = 0;
+}
+
+void ray_table::update(const lidar_scan &scan)
+{
+	if (scan.count == count && scan.angle_min == angle_min && scan.angle_increment == increment)
+		return;
+
+	for (uint16_t i = 0; i < scan.count; i++) {
+		float a = scan.angle_min + i * scan.angle_increment;
+		ray_cos[i] = cosf(a);
+		ray_sin[i] = sinf(a);
+	}
+	count = scan.count;
+	angle_min = scan.angle_min;
+	increment = scan.angle_increment;
+}
+
+bool fit_face(const float *x, const float *y, uint16_t count, float max_distance,
+              float &nx, float &ny, float &offset, uint16_t &used, float &rms)
+{
+	float sum_x = 0.0f, sum_y = 0.0f;
+	uint16_t n = 0;
+	for (uint16_t i = 0; i < count; i++) {
+		if (max_distance > 0.0f && fabsf(nx * x[i] + ny * y[i] - offset) > max_distance)
+			continue;
+		sum_x += x[i];
+		sum_y += y[i];
+		n++;
+	}
+	if (n < 2)
+		return false;
+
+	float mean_x = sum_x / n;
+	float mean_y = sum_y / n;
+	float sxx = 0.0f, syy = 0.0f, sxy = 0.0f;
+	for (uint16_t i = 0; i < count; i++) {
+		if (max_distance > 0.0f && fabsf(nx * x[i] + ny * y[i] - offset) > max_distance)
+			continue;
+		float dx = x[i] - mean_x;
+		float dy = y[i] - mean_y;
+		sxx += dx * dx;
+		syy += dy * dy;
+		sxy += dx * dy;
+	}
+
+	// The principal axis of the scatter is the face; its normal is 90 degrees from it
+	float line_angle = 0.5f * atan2f(2.0f * sxy, sxx - syy);
+	nx = -sinf(line_angle);
+	ny = cosf(line_angle);
+	if (nx < 0.0f) {
+		nx = -nx;
+		ny = -ny;
+	}
+	offset = nx * mean_x + ny * mean_y;
+	used = n;
+
+	// The smaller eigenvalue of the scatter matrix is the sum of squared distances
+	float half_trace = 0.5f * (sxx + syy);
+	float spread = sqrtf(0.25f * (sxx - syy) * (sxx - syy) + sxy * sxy);
+	float min_eigen = half_trace - spread;
+	rms = min_eigen > 0.0f ? sqrtf(min_eigen / n) : 0.0f;
+	return true;
+}
@@ -0,0 +1,65 @@
+/**
+ * The geometry shared by the stages that look for the trailer's front face in a LiDAR
+ * scan: the hitch_estimator, which measures the hitch angle of a coupled trailer, and
+ * the trailer_coupler, which finds the kingpin of a parked one. Each picks its own
+ * candidate points out of the scan, and both turn the rays into Cartesian points with a
+ * ray_table and fit a line to the face with fit_face().
+ */
+
+#ifndef ME507_FACE_FIT_H
+#define ME507_FACE_FIT_H
+
+#include <cstdint>
+#include "lidar_scan.h"
+
+#define FIT_REFINEMENTS 2   // refits using only the inliers of the previous fit
+#define SEED_GATE_SCALE 4   // gate around the previous face is this many inlier distances
+
+/**
+ * @brief cos and sin of every ray of a scan, rebuilt only when the scan geometry changes.
+ */
+class ray_table {
+public:
+	ray_table();
+
+	/**
+	 * @brief Makes the table match a scan's rays, recomputing it only if they changed.
+	 * @param scan The scan whose points are about to be converted
+	 */
+	void update(const lidar_scan &scan);
+
+	/// x of ray i of the scan last given to update(), in the LiDAR frame (m)
+	float x(const lidar_scan &scan, uint16_t i) const { return scan.ranges[i] * ray_cos[i]; }
+	/// y of ray i of the scan last given to update(), in the LiDAR frame (m)
+	float y(const lidar_scan &scan, uint16_t i) const { return scan.ranges[i] * ray_sin[i]; }
+
+private:
+	float ray_cos[LIDAR_MAX_POINTS];
+	float ray_sin[LIDAR_MAX_POINTS];
+	float angle_min;
+	float increment;
+	uint16_t count;
+};
+
+/**
+ * @brief Fits the line n . p = offset to a set of points by total least squares.
+ * With max_distance <= 0 every point is used; otherwise only the points within
+ * max_distance of the line passed in through nx, ny and offset are, so calling it again
+ * on its own result refits to the inliers. The normal is returned pointing forwards
+ * (nx >= 0), so its angle is the hitch angle.
+ * @param x The x coordinates of the points (m)
+ * @param y The y coordinates of the points (m)
+ * @param count The number of points
+ * @param max_distance Farthest a point may be from the line passed in to be used (m)
+ * @param nx The x component of the line's unit normal; in and out
+ * @param ny The y component of the line's unit normal; in and out
+ * @param offset The line's distance from the origin along its normal (m); in and out
+ * @param used Set to the number of points in the fit
+ * @param rms Set to the RMS distance of those points from the fitted line (m)
+ * @return true on success, false if fewer than two points were used
+ */
+bool fit_face(const float *x, const float *y, uint16_t count, float max_distance,
+              float &nx, float &ny, float &offset, uint16_t &used, float &rms);
+
+
+#endif //ME507_FACE_FIT_H
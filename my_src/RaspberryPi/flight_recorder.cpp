@@ -0,0 +1,216 @@
+//
+// In-memory black box written out on incidents; see flight_recorder.h.
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include "flight_recorder.h"
+#include "host_clock.h"
+
+#define RECORDER_POLL_US 10000  // longest the recorder's thread sleeps before checking for a trigger
+#define RECORDER_SPARE 1.1f     // rings hold this much more than their rates call for, for jitter
+
+static const char *const trigger_names[RECORDER_TRIGGERS] = {"failsafe", "deadline", "brake", "operator"};
+
+record_ring_base::record_ring_base(uint32_t capacity_in, uint32_t item_size_in, const std::atomic<bool> *frozen_in)
+		: busy(false), recorded(0), skipped(0)
+{
+	capacity = capacity_in;
+	item_size = item_size_in;
+	frozen = frozen_in;
+}
+
+void record_ring_base::wait_idle() const
+{
+	while (busy.load())
+		std::this_thread::yield();
+}
+
+uint32_t record_ring_base::size() const
+{
+	uint64_t total = recorded.load();
+	return total < capacity ? (uint32_t)total : capacity;
+}
+
+uint32_t flight_recorder::ring_capacity(float seconds, float rate)
+{
+	float records = ceilf(seconds * rate * RECORDER_SPARE);
+	return records > 1.0f ? (uint32_t)records : 1;
+}
+
+flight_recorder::flight_recorder(const recorder_config &config_in)
+		: frozen(false),
+		  scans(ring_capacity(config_in.seconds + config_in.post_seconds, config_in.rates[RECORDER_SCANS]), &frozen),
+		  telemetry(ring_capacity(config_in.seconds + config_in.post_seconds, config_in.rates[RECORDER_TELEMETRY]),
+		            &frozen),
+		  commands(ring_capacity(config_in.seconds + config_in.post_seconds, config_in.rates[RECORDER_COMMANDS]),
+		           &frozen),
+		  cycles(ring_capacity(config_in.seconds + config_in.post_seconds, config_in.rates[RECORDER_CYCLES]), &frozen),
+		  incident(0), seen(0), running(false)
+{
+	config = config_in;
+	rings[RECORDER_SCANS] = &scans;
+	rings[RECORDER_TELEMETRY] = &telemetry;
+	rings[RECORDER_COMMANDS] = &commands;
+	rings[RECORDER_CYCLES] = &cycles;
+	for (uint8_t i = 0; i < RECORDER_TRIGGERS; i++)
+		trigger_counts[i].store(0);
+	memset(&stats, 0, sizeof(stats));
+	status_text[0] = '\0';
+	last_path[0] = '\0';
+}
+
+flight_recorder::~flight_recorder()
+{
+	stop();
+}
+
+void flight_recorder::start()
+{
+	if (running.exchange(true))
+		return;
+	thread = std::thread(&flight_recorder::run, this);
+}
+
+void flight_recorder::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(wait_lock);
+		if (!running.exchange(false))
+			return;
+	}
+	stopping.notify_all();
+	thread.join();
+	if (incident.load())
+		dump();
+}
+
+bool flight_recorder::trigger(recorder_trigger reason, uint64_t time_us)
+{
+	trigger_counts[reason].fetch_add(1, std::memory_order_relaxed);
+	seen.fetch_or((uint8_t)(1 << reason));
+	uint64_t none = 0;
+	return incident.compare_exchange_strong(none, (time_us << 4) | (uint64_t)(reason + 1));
+}
+
+recorder_stats flight_recorder::get_stats() const
+{
+	recorder_stats s;
+	{
+		std::lock_guard<std::mutex> guard(stats_lock);
+		s = stats;
+	}
+	for (uint8_t i = 0; i < RECORDER_TRIGGERS; i++)
+		s.triggers[i] = trigger_counts[i].load();
+	return s;
+}
+
+/**
+ * Sleeps in short steps so a trigger is seen soon after it comes; waiting on the
+ * condition variable instead would need the trigger to take its lock. Once the incident
+ * has run on for post_seconds, its file is written.
+ */
+void flight_recorder::run()
+{
+	std::unique_lock<std::mutex> lock(wait_lock);
+	while (running.load()) {
+		stopping.wait_for(lock, std::chrono::microseconds(RECORDER_POLL_US));
+		uint64_t marked = incident.load();
+		if (!marked || host_time_us() < (marked >> 4) + (uint64_t)(config.post_seconds * 1e6f))
+			continue;
+		lock.unlock();
+		dump();
+		lock.lock();
+	}
+}
+
+/**
+ * Freezes the rings, writes them out and lets them go again. Triggers that come while
+ * the file is written are counted but dropped; the incident is only cleared at the end,
+ * so they do not start a new one straight after it with the rings just let go.
+ */
+void flight_recorder::dump()
+{
+	uint64_t start = host_time_us();
+	frozen.store(true);
+	for (uint8_t i = 0; i < RECORDER_RINGS; i++)
+		rings[i]->wait_idle();
+
+	uint64_t marked = incident.load();
+	recorder_file_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = RECORDER_MAGIC;
+	header.version = RECORDER_VERSION;
+	header.reason = (uint8_t)((marked & 0xF) - 1);
+	header.trigger_us = marked >> 4;
+	header.frozen_us = start;
+	for (uint8_t i = 0; i < RECORDER_RINGS; i++) {
+		header.counts[i] = rings[i]->size();
+		header.item_sizes[i] = rings[i]->get_item_size();
+		header.skipped[i] = rings[i]->get_skipped();
+	}
+
+	size_t status_size = 0;
+	if (status) {
+		status_text[0] = '\0';
+		status_size = status(status_text, sizeof(status_text));
+		if (status_size >= sizeof(status_text))
+			status_size = sizeof(status_text) - 1;
+	}
+	header.status_size = (uint32_t)status_size;
+
+	header.triggers = seen.exchange(0);
+
+	bool allowed;
+	uint16_t index;
+	{
+		std::lock_guard<std::mutex> guard(stats_lock);
+		index = stats.dumps + stats.failed;
+		allowed = index < config.max_dumps;
+		if (!allowed)
+			stats.suppressed++;
+	}
+	bool written = false;
+	if (allowed) {
+		char stamp[32];
+		time_t now = time(NULL);
+		struct tm local;
+		localtime_r(&now, &local);
+		strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+		char path[RECORDER_PATH_SIZE];
+		snprintf(path, sizeof(path), "%s/blackbox-%s-%u-%s.bin", config.directory, stamp, index,
+		         trigger_names[header.reason]);
+		written = write_file(path, header, status_size);
+		if (written)
+			strncpy(last_path, path, sizeof(last_path) - 1);
+		last_path[sizeof(last_path) - 1] = '\0';
+	}
+
+	seen.store(0);
+	incident.store(0);
+	frozen.store(false);
+
+	std::lock_guard<std::mutex> guard(stats_lock);
+	if (allowed) {
+		if (written)
+			stats.dumps++;
+		else
+			stats.failed++;
+	}
+	stats.last_dump_us = (uint32_t)(host_time_us() - start);
+}
+
+bool flight_recorder::write_file(const char *path, const recorder_file_header &header, size_t status_size)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	for (uint8_t i = 0; ok && i < RECORDER_RINGS; i++)
+		ok = rings[i]->write(file);
+	if (ok && status_size)
+		ok = fwrite(status_text, 1, status_size, file) == status_size;
+	return fclose(file) == 0 && ok;
+}
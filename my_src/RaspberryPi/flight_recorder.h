@@ -0,0 +1,373 @@
+/**
+ * The flight_recorder is the Pi's black box. Logging every scan to disk costs too much
+ * to leave on, so instead the last few seconds of everything (scans, the ATMega's
+ * telemetry, the commands sent to it and the timing of every control cycle) are kept in
+ * rings in memory, and only written out when something goes wrong: a failsafe, a missed
+ * deadline, an emergency brake, or the operator pressing the button. Each incident gets
+ * a file with the full-fidelity data from before it to a little after it.
+ *
+ * Every ring is allocated when the recorder is made and sized for the seconds it must
+ * hold at the rate its records come in, so recording is a copy into the next slot and
+ * nothing else: no allocation, no lock, no system call. Each ring has a single writer,
+ * the thread that owns that kind of record (the LiDAR's for scans, pi_comm_task's for
+ * telemetry, and so on). A trigger is a few atomic operations and may come from any
+ * thread, including the collision_guard's brake function.
+ *
+ * The recorder's own thread does the rest. After a trigger it lets the rings run on for
+ * post_seconds, so the file shows what happened next, then freezes them: writers skip
+ * their records until the file is written, and the ones skipped are counted. Each
+ * writer marks itself busy around its copy, so the freeze waits for any copy already
+ * under way and a frozen ring never holds a torn record. Triggers that come while an
+ * incident is being recorded are counted and named in its file rather than starting
+ * another one, and at most max_dumps files are written, so a fault that repeats cannot
+ * fill the SD card.
+ *
+ * A file is a recorder_file_header, then each ring's records oldest first, each record
+ * being its time in microseconds and then the item as it is in memory, then the status
+ * text, if a status function was set.
+ */
+
+#ifndef ME507_FLIGHT_RECORDER_H
+#define ME507_FLIGHT_RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "lidar_scan.h"
+#include "../semi_truck_data_t.h"
+
+/// First bytes of every recorder file, "BBOX"
+#define RECORDER_MAGIC 0x584F4242u
+#define RECORDER_VERSION 1
+/// Longest file name the recorder makes, its directory included
+#define RECORDER_PATH_SIZE 256
+/// Largest status text written at the end of a file
+#define RECORDER_STATUS_SIZE 4096
+
+/// What made the recorder write a file
+enum recorder_trigger {
+	RECORDER_FAILSAFE,          ///< the ATMega or the RC link fell back to its failsafe
+	RECORDER_DEADLINE_MISS,     ///< a command missed its scan-to-command deadline
+	RECORDER_EMERGENCY_BRAKE,   ///< the collision_guard latched the brake
+	RECORDER_OPERATOR,          ///< the operator pressed the button
+	RECORDER_TRIGGERS
+};
+
+/// The rings of a recorder, in the order they are written to a file
+enum recorder_ring {
+	RECORDER_SCANS,             ///< lidar_scan, as it reached the Pi
+	RECORDER_TELEMETRY,         ///< semi_truck_data_t, as read from the ATMega
+	RECORDER_COMMANDS,          ///< semi_truck_data_t, as sent to the ATMega
+	RECORDER_CYCLES,            ///< recorder_cycle, one per control cycle
+	RECORDER_RINGS
+};
+
+/**
+ * @brief The timing of one control cycle.
+ * @var latency_us time from the scan reaching the Pi to its command going out (us)
+ * @var deadline_us the deadline the command was held to (us)
+ * @var shed_level the load_shedder's level when it went out
+ * @var steer_output the command's steer_output, to match cycles with commands
+ * @var motor_output the command's motor_output
+ */
+struct recorder_cycle {
+	uint32_t latency_us;
+	uint32_t deadline_us;
+	uint8_t  shed_level;
+	int16_t  steer_output;
+	int16_t  motor_output;
+};
+
+/**
+ * @brief Settings of a flight_recorder.
+ * @var seconds history kept from before a trigger (s)
+ * @var post_seconds time the rings run on after a trigger before they are frozen (s)
+ * @var rates records per second expected in each ring, in recorder_ring order (Hz)
+ * @var max_dumps most files written over the recorder's life
+ * @var directory where the files go; the string must outlive the recorder
+ */
+struct recorder_config {
+	float       seconds;
+	float       post_seconds;
+	float       rates[RECORDER_RINGS];
+	uint16_t    max_dumps;
+	const char *directory;
+};
+
+/**
+ * @brief The start of every recorder file.
+ * @var magic RECORDER_MAGIC
+ * @var version RECORDER_VERSION
+ * @var reason the recorder_trigger that started the incident
+ * @var triggers every trigger seen while recording it, one bit per recorder_trigger
+ * @var trigger_us when the first trigger came (us)
+ * @var frozen_us when the rings were frozen (us)
+ * @var counts records in each ring, in recorder_ring order
+ * @var item_sizes size of one item in each ring, not counting its time (bytes)
+ * @var skipped records each ring skipped while frozen since the recorder started
+ * @var status_size length of the status text at the end (bytes)
+ */
+struct recorder_file_header {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t  reason;
+	uint8_t  triggers;
+	uint64_t trigger_us;
+	uint64_t frozen_us;
+	uint32_t counts[RECORDER_RINGS];
+	uint32_t item_sizes[RECORDER_RINGS];
+	uint32_t skipped[RECORDER_RINGS];
+	uint32_t status_size;
+};
+
+/**
+ * The part of a ring that does not depend on the item type: the count and the busy
+ * flag the freeze waits on.
+ */
+class record_ring_base {
+public:
+	/**
+	 * @brief The constructor for an empty ring.
+	 * @param capacity_in Records the ring holds
+	 * @param item_size_in Size of one item (bytes)
+	 * @param frozen_in The recorder's freeze flag
+	 */
+	record_ring_base(uint32_t capacity_in, uint32_t item_size_in, const std::atomic<bool> *frozen_in);
+
+	virtual ~record_ring_base() {}
+
+	/**
+	 * @brief Waits for a copy that was under way when the rings were frozen.
+	 */
+	void wait_idle() const;
+
+	/**
+	 * @brief Writes the records held, oldest first. Only while frozen.
+	 * @param file The file to write to
+	 * @return false if the write failed
+	 */
+	virtual bool write(FILE *file) const = 0;
+
+	/// Records held, at most the capacity
+	uint32_t size() const;
+	uint32_t get_capacity() const { return capacity; }
+	uint32_t get_item_size() const { return item_size; }
+	/// Records skipped because the ring was frozen
+	uint32_t get_skipped() const { return skipped.load(); }
+	/// Records written to the ring since it was made
+	uint64_t get_recorded() const { return recorded.load(); }
+
+protected:
+	uint32_t capacity;
+	uint32_t item_size;
+	const std::atomic<bool> *frozen;
+	std::atomic<bool> busy;
+	std::atomic<uint64_t> recorded;
+	std::atomic<uint32_t> skipped;
+
+	/**
+	 * @brief Marks the writer busy and checks the ring may be written.
+	 * @return the slot to fill, or -1 if the ring is frozen
+	 */
+	int64_t begin()
+	{
+		busy.store(true);
+		if (frozen->load()) {
+			busy.store(false);
+			skipped.fetch_add(1, std::memory_order_relaxed);
+			return -1;
+		}
+		return (int64_t)(recorded.load(std::memory_order_relaxed) % capacity);
+	}
+
+	/**
+	 * @brief Counts the record just copied and clears the busy mark.
+	 */
+	void end()
+	{
+		recorded.store(recorded.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		busy.store(false);
+	}
+};
+
+template <class T>
+class record_ring : public record_ring_base {
+public:
+	/**
+	 * @brief The constructor for an empty ring; allocates every slot it will use.
+	 * @param capacity_in Records the ring holds
+	 * @param frozen_in The recorder's freeze flag
+	 */
+	record_ring(uint32_t capacity_in, const std::atomic<bool> *frozen_in)
+			: record_ring_base(capacity_in, sizeof(T), frozen_in), times(new uint64_t[capacity_in]),
+			  items(new T[capacity_in])
+	{
+	}
+
+	/**
+	 * @brief Copies a record into the ring over its oldest one. Writer only.
+	 * @param item The record
+	 * @param time_us When it was taken, on the host clock (us)
+	 * @return false if the ring is frozen and the record was skipped
+	 */
+	bool record(const T &item, uint64_t time_us)
+	{
+		int64_t slot = begin();
+		if (slot < 0)
+			return false;
+		times[slot] = time_us;
+		items[slot] = item;
+		end();
+		return true;
+	}
+
+	bool write(FILE *file) const
+	{
+		uint64_t total = recorded.load();
+		uint32_t held = size();
+		for (uint64_t i = total - held; i < total; i++) {
+			uint32_t slot = (uint32_t)(i % capacity);
+			if (fwrite(&times[slot], sizeof(uint64_t), 1, file) != 1 || fwrite(&items[slot], sizeof(T), 1, file) != 1)
+				return false;
+		}
+		return true;
+	}
+
+private:
+	std::unique_ptr<uint64_t[]> times;
+	std::unique_ptr<T[]> items;
+};
+
+/**
+ * @brief Counters of a recorder.
+ * @var triggers triggers seen of each recorder_trigger
+ * @var dumps files written
+ * @var failed files that could not be written
+ * @var suppressed incidents not written because max_dumps had been reached
+ * @var last_dump_us time the last file took to write (us)
+ */
+struct recorder_stats {
+	uint32_t triggers[RECORDER_TRIGGERS];
+	uint16_t dumps;
+	uint16_t failed;
+	uint16_t suppressed;
+	uint32_t last_dump_us;
+};
+
+class flight_recorder {
+public:
+	/**
+	 * @brief The constructor for an empty recorder; allocates every ring it will use.
+	 * Each ring holds seconds + post_seconds at its rate, with a tenth to spare for
+	 * records that come early, and at least one record.
+	 * @param config_in The recorder settings
+	 */
+	flight_recorder(const recorder_config &config_in);
+
+	/**
+	 * @brief Stops the recorder's thread if it is still running.
+	 */
+	~flight_recorder();
+
+	/**
+	 * @brief Sets a function called on the recorder's thread when the rings are frozen,
+	 * whose text is written at the end of the file, for counters that are not recorded
+	 * cycle by cycle, such as the pipeline's stage timing. Must be set before start().
+	 * @param status_in Writes at most size bytes, terminated, and returns the length
+	 */
+	void set_status_function(const std::function<size_t(char *, size_t)> &status_in) { status = status_in; }
+
+	/**
+	 * @brief Starts the thread that waits for triggers and writes the files.
+	 */
+	void start();
+
+	/**
+	 * @brief Stops the thread. An incident still running on is written first.
+	 */
+	void stop();
+
+	/**
+	 * @brief Records a scan. The LiDAR's thread only.
+	 * @return false if the rings are frozen and it was skipped
+	 */
+	bool record_scan(const lidar_scan &scan, uint64_t time_us) { return scans.record(scan, time_us); }
+
+	/**
+	 * @brief Records a report from the ATMega. pi_comm_task's thread only.
+	 */
+	bool record_telemetry(const semi_truck_data_t &data, uint64_t time_us)
+	{
+		return telemetry.record(data, time_us);
+	}
+
+	/**
+	 * @brief Records a command to the ATMega. The thread that sends them only.
+	 */
+	bool record_command(const semi_truck_data_t &data, uint64_t time_us) { return commands.record(data, time_us); }
+
+	/**
+	 * @brief Records the timing of a control cycle. The thread that sends the commands only.
+	 */
+	bool record_cycle(const recorder_cycle &cycle, uint64_t time_us) { return cycles.record(cycle, time_us); }
+
+	/**
+	 * @brief Marks an incident, to be written once post_seconds have gone by. Any thread;
+	 * never blocks.
+	 * @param reason What happened
+	 * @param time_us When it happened, on the host clock (us)
+	 * @return true if it starts a new incident, false if one is already being recorded
+	 */
+	bool trigger(recorder_trigger reason, uint64_t time_us);
+
+	/// true while the rings are frozen for a file to be written
+	bool is_frozen() const { return frozen.load(); }
+	/// true from a trigger until its file is written
+	bool is_pending() const { return incident.load() != 0; }
+	const record_ring_base &get_ring(recorder_ring ring) const { return *rings[ring]; }
+	/// Name of the last file written, empty before the first
+	const char *get_last_path() const { return last_path; }
+	recorder_stats get_stats() const;
+	const recorder_config &get_config() const { return config; }
+
+private:
+	recorder_config config;
+	std::atomic<bool> frozen;
+
+	record_ring<lidar_scan> scans;
+	record_ring<semi_truck_data_t> telemetry;
+	record_ring<semi_truck_data_t> commands;
+	record_ring<recorder_cycle> cycles;
+	record_ring_base *rings[RECORDER_RINGS];
+
+	// The incident being recorded as (time << 4) | (reason + 1), 0 for none, and a bit
+	// per recorder_trigger seen since the last file
+	std::atomic<uint64_t> incident;
+	std::atomic<uint8_t> seen;
+	std::atomic<uint32_t> trigger_counts[RECORDER_TRIGGERS];
+
+	std::function<size_t(char *, size_t)> status;
+	char status_text[RECORDER_STATUS_SIZE];
+	char last_path[RECORDER_PATH_SIZE];
+
+	std::thread thread;
+	std::atomic<bool> running;
+	std::mutex wait_lock;
+	std::condition_variable stopping;
+
+	mutable std::mutex stats_lock;
+	recorder_stats stats;
+
+	static uint32_t ring_capacity(float seconds, float rate);
+	void run();
+	void dump();
+	bool write_file(const char *path, const recorder_file_header &header, size_t status_size);
+};
+
+
+#endif //ME507_FLIGHT_RECORDER_H
@@ -0,0 +1,116 @@
+//
+// Precomputed footprint bitmasks; see footprint_mask.h.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "footprint_mask.h"
+#include "host_clock.h"
+
+#define DIAGONAL 1.41421356f
+
+footprint_mask::footprint_mask(const truck_geometry &geometry_in, const truck_footprint &footprint,
+                               float resolution_in, uint16_t heading_bins_in)
+{
+	geometry = geometry_in;
+	resolution = resolution_in;
+	heading_bins = heading_bins_in;
+
+	uint64_t start = host_time_us();
+	rasterize(footprint.tractor_front + footprint.margin, footprint.tractor_rear + footprint.margin,
+	          footprint.tractor_width + 2.0f * footprint.margin);
+	rasterize(footprint.margin - footprint.trailer_front, footprint.trailer_rear + footprint.margin,
+	          footprint.trailer_width + 2.0f * footprint.margin);
+	build_us = (uint32_t)(host_time_us() - start);
+}
+
+/**
+ * A cell goes in the mask if its center is within reach of the rectangle at the bin's
+ * heading. Reach is half a cell diagonal for the cell's own extent, half a diagonal for
+ * where the reference point is in its cell, and the chord the furthest corner sweeps
+ * over half a bin.
+ */
+void footprint_mask::rasterize(float front, float rear, float width)
+{
+	float half_width = 0.5f * width;
+	float corner = hypotf(std::max(fabsf(front), fabsf(rear)), half_width);
+	float half_bin = (float)M_PI / heading_bins;
+	float reach = resolution * DIAGONAL + 2.0f * corner * sinf(0.5f * half_bin);
+	int32_t extent = (int32_t)ceilf((corner + reach) / resolution);
+
+	for (uint16_t bin = 0; bin < heading_bins; bin++) {
+		float heading = bin * 2.0f * half_bin;
+		float c = cosf(heading), s = sinf(heading);
+
+		// Which cells of the square around the reference point are in, and their bounds
+		std::vector<uint8_t> inside((size_t)(2 * extent + 1) * (2 * extent + 1));
+		int32_t low_x = extent, high_x = -extent, low_y = extent, high_y = -extent;
+		for (int32_t y = -extent; y <= extent; y++) {
+			for (int32_t x = -extent; x <= extent; x++) {
+				float along = (x * c + y * s) * resolution;
+				float across = (y * c - x * s) * resolution;
+				float out_along = std::max(std::max(-rear - along, along - front), 0.0f);
+				float out_across = std::max(fabsf(across) - half_width, 0.0f);
+				if (hypotf(out_along, out_across) > reach)
+					continue;
+				inside[(y + extent) * (2 * extent + 1) + x + extent] = 1;
+				low_x = std::min(low_x, x);
+				high_x = std::max(high_x, x);
+				low_y = std::min(low_y, y);
+				high_y = std::max(high_y, y);
+			}
+		}
+
+		body_mask mask;
+		mask.x0 = (int16_t)low_x;
+		mask.y0 = (int16_t)low_y;
+		mask.columns = (uint16_t)(high_x - low_x + 1);
+		mask.rows = (uint16_t)(high_y - low_y + 1);
+		mask.words = (uint16_t)((mask.columns + 63) / 64);
+		mask.first = (uint32_t)bits.size();
+		bits.resize(bits.size() + (size_t)mask.rows * mask.words, 0);
+		for (int32_t y = low_y; y <= high_y; y++) {
+			uint64_t *row = &bits[mask.first + (size_t)(y - low_y) * mask.words];
+			for (int32_t x = low_x; x <= high_x; x++)
+				if (inside[(y + extent) * (2 * extent + 1) + x + extent])
+					row[(x - low_x) >> 6] |= (uint64_t)1 << ((x - low_x) & 63);
+		}
+		masks.push_back(mask);
+	}
+}
+
+uint16_t footprint_mask::heading_bin(float heading) const
+{
+	float bin_width = 2.0f * (float)M_PI / heading_bins;
+	int32_t bin = (int32_t)lroundf(heading / bin_width) % heading_bins;
+	return (uint16_t)(bin < 0 ? bin + heading_bins : bin);
+}
+
+bool footprint_mask::hits(const bit_grid &grid, const body_mask &mask, int32_t cx, int32_t cy) const
+{
+	int32_t left = cx + mask.x0, bottom = cy + mask.y0;
+	if (left < 0 || bottom < 0 || left + mask.columns > (int32_t)grid.get_width()
+	    || bottom + mask.rows > (int32_t)grid.get_height())
+		return true;
+	const uint64_t *row = &bits[mask.first];
+	for (uint16_t r = 0; r < mask.rows; r++, row += mask.words)
+		for (uint16_t k = 0; k < mask.words; k++)
+			if (row[k] & grid.read((uint32_t)left + 64u * k, (uint32_t)bottom + r))
+				return true;
+	return false;
+}
+
+bool footprint_mask::collides(const bit_grid &grid, const plan_pose &pose) const
+{
+	float inv_resolution = 1.0f / grid.get_resolution();
+	int32_t cx = (int32_t)floorf((pose.x - grid.get_origin_x()) * inv_resolution);
+	int32_t cy = (int32_t)floorf((pose.y - grid.get_origin_y()) * inv_resolution);
+	if (hits(grid, masks[heading_bin(pose.heading)], cx, cy))
+		return true;
+
+	float kx = pose.x - geometry.hitch_offset * cosf(pose.heading);
+	float ky = pose.y - geometry.hitch_offset * sinf(pose.heading);
+	cx = (int32_t)floorf((kx - grid.get_origin_x()) * inv_resolution);
+	cy = (int32_t)floorf((ky - grid.get_origin_y()) * inv_resolution);
+	return hits(grid, masks[heading_bins + heading_bin(pose.heading + pose.hitch)], cx, cy);
+}
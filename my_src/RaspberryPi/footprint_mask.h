@@ -0,0 +1,97 @@
+/**
+ * The footprint_mask checks the outline of the tractor and trailer against a bit_grid
+ * without rasterizing it for every pose. Each body's rectangle, grown by the footprint's
+ * margin, is rasterized once into a packed bitmask per heading bin: the tractor's about
+ * its rear axle, the trailer's about the kingpin and binned by the trailer's own
+ * heading, so the hitch angle needs no masks of its own. A check then finds the cell of
+ * the rear axle and of the kingpin and ANDs each row of the two masks against the grid
+ * 64 cells at a time, stopping at the first word that overlaps.
+ *
+ * The masks are conservative: a cell is set if the rectangle comes within reach of it
+ * for any position of the reference point in its cell and any heading in the bin, so a
+ * pose whose outline touches a blocked cell is never passed, at the price of calling a
+ * little more blocked than the outline covers.
+ */
+
+#ifndef ME507_FOOTPRINT_MASK_H
+#define ME507_FOOTPRINT_MASK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bit_grid.h"
+#include "hybrid_astar.h"
+
+class footprint_mask {
+public:
+	/**
+	 * @brief The constructor; rasterizes both bodies at every heading bin.
+	 * @param geometry_in The truck's dimensions
+	 * @param footprint The outline of the tractor and trailer
+	 * @param resolution_in Side of the cells of the grids it will be checked against (m)
+	 * @param heading_bins_in Number of heading bins
+	 */
+	footprint_mask(const truck_geometry &geometry_in, const truck_footprint &footprint, float resolution_in,
+	               uint16_t heading_bins_in);
+
+	/**
+	 * @brief Checks a pose against a grid of the resolution the masks were made for.
+	 * @param grid The blocked cells
+	 * @param pose The pose; reverse is ignored
+	 * @return true if either body may touch a blocked cell or leave the grid
+	 */
+	bool collides(const bit_grid &grid, const plan_pose &pose) const;
+
+	/// Memory the masks take (bytes)
+	size_t get_bytes() const { return bits.size() * sizeof(uint64_t) + masks.size() * sizeof(body_mask); }
+	/// Time taken to rasterize the masks (us)
+	uint32_t get_build_us() const { return build_us; }
+
+private:
+	/**
+	 * @brief One body rasterized at one heading bin.
+	 * @var x0 column of the mask's first cell, from the reference point's cell
+	 * @var y0 row of the mask's first cell, from the reference point's cell
+	 * @var columns cells in a row of the mask
+	 * @var rows rows in the mask
+	 * @var words 64-bit words per row
+	 * @var first index of the mask's first word in bits
+	 */
+	struct body_mask {
+		int16_t  x0;
+		int16_t  y0;
+		uint16_t columns;
+		uint16_t rows;
+		uint16_t words;
+		uint32_t first;
+	};
+
+	truck_geometry geometry;
+	float resolution;
+	uint16_t heading_bins;
+	uint32_t build_us;
+
+	// Tractor masks for every heading bin, then trailer masks
+	std::vector<body_mask> masks;
+	std::vector<uint64_t> bits;
+
+	/**
+	 * @brief Rasterizes a rectangle reaching front ahead of the reference point and rear
+	 * behind it at every heading bin, and appends the masks.
+	 */
+	void rasterize(float front, float rear, float width);
+
+	/**
+	 * @brief Finds the heading bin of a heading.
+	 */
+	uint16_t heading_bin(float heading) const;
+
+	/**
+	 * @brief Checks one mask placed with its reference point in a cell.
+	 * @return true if it overlaps a blocked cell or is not all inside the grid
+	 */
+	bool hits(const bit_grid &grid, const body_mask &mask, int32_t cx, int32_t cy) const;
+};
+
+
+#endif //ME507_FOOTPRINT_MASK_H
@@ -0,0 +1,148 @@
+//
+// LiDAR hitch angle estimation and trailer masking; see hitch_estimator.h.
+//
+
+#include <cmath>
+#include <chrono>
+#include "hitch_estimator.h"
+
+hitch_estimator::hitch_estimator(const hitch_config &config_in)
+{
+	config = config_in;
+	last_valid.valid = false;
+	last_valid.angle = 0.0f;
+	last_valid.rms_error = 0.0f;
+	last_valid.inliers = 0;
+	last_valid.time_us = 0;
+	last_run_us = 0;
+	max_run_us = 0;
+	window_count = 0;
+}
+
+hitch_estimate hitch_estimator::process(lidar_scan &scan)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	hitch_estimate est;
+	est.valid = false;
+	est.angle = 0.0f;
+	est.rms_error = 0.0f;
+	est.inliers = 0;
+	est.time_us = scan.time_us;
+
+	rays.update(scan);
+	collect_window(scan);
+
+	// Seed from the previous estimate when there is a recent one. At large hitch angles
+	// the trailer's side fills much of the window, and gating around where the face was
+	// on the last scan keeps the fit locked onto the front face instead.
+	float nx, ny, offset, rms;
+	uint16_t used;
+	bool ok;
+	if (last_valid.valid && scan.time_us - last_valid.time_us <= config.max_age_us) {
+		nx = cosf(last_valid.angle);
+		ny = sinf(last_valid.angle);
+		offset = nx * config.hitch_x + ny * config.hitch_y - config.face_distance;
+		ok = fit_face(window_x, window_y, window_count, SEED_GATE_SCALE * config.inlier_distance,
+		              nx, ny, offset, used, rms);
+	}
+	else {
+		ok = fit_face(window_x, window_y, window_count, 0.0f, nx, ny, offset, used, rms);
+	}
+	for (uint8_t i = 0; ok && i < FIT_REFINEMENTS; i++)
+		ok = fit_face(window_x, window_y, window_count, config.inlier_distance, nx, ny, offset, used, rms);
+
+	if (ok && used >= config.min_points) {
+		// The face normal is the trailer's axis, so its direction is the hitch angle.
+		// The fitted face must also sit at the known distance behind the pivot.
+		float angle = atan2f(ny, nx);
+		float face_offset = offset - (nx * config.hitch_x + ny * config.hitch_y);
+		if (fabsf(angle) <= config.max_hitch_angle
+		    && fabsf(-face_offset - config.face_distance) <= config.face_tolerance) {
+			est.valid = true;
+			est.angle = angle;
+			est.rms_error = rms;
+			est.inliers = used;
+			last_valid = est;
+		}
+	}
+
+	if (est.valid)
+		mask_trailer(scan, est.angle);
+	else if (last_valid.valid && scan.time_us - last_valid.time_us <= config.max_age_us)
+		mask_trailer(scan, last_valid.angle);
+
+	last_run_us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	if (last_run_us > max_run_us)
+		max_run_us = last_run_us;
+	return est;
+}
+
+hitch_estimate hitch_estimator::get_last_valid() const
+{
+	return last_valid;
+}
+
+uint32_t hitch_estimator::get_last_run_us() const
+{
+	return last_run_us;
+}
+
+uint32_t hitch_estimator::get_max_run_us() const
+{
+	return max_run_us;
+}
+
+void hitch_estimator::collect_window(const lidar_scan &scan)
+{
+	window_count = 0;
+	if (scan.angle_increment <= 0.0f)
+		return;
+
+	int32_t first = (int32_t)ceilf((config.window_min - scan.angle_min) / scan.angle_increment);
+	int32_t last = (int32_t)floorf((config.window_max - scan.angle_min) / scan.angle_increment);
+	if (first < 0)
+		first = 0;
+	if (last > (int32_t)scan.count - 1)
+		last = (int32_t)scan.count - 1;
+
+	// Only points the front face could be at are kept, so anything seen past the
+	// trailer cannot pull the first, unseeded fit away from it
+	float reach = hypotf(config.face_distance, config.trailer_width / 2) + config.face_tolerance;
+	float reach2 = reach * reach;
+	for (int32_t i = first; i <= last; i++) {
+		if (!scan_point_valid(scan, (uint16_t)i))
+			continue;
+		float x = rays.x(scan, (uint16_t)i);
+		float y = rays.y(scan, (uint16_t)i);
+		float dx = x - config.hitch_x, dy = y - config.hitch_y;
+		if (dx * dx + dy * dy > reach2)
+			continue;
+		window_x[window_count] = x;
+		window_y[window_count] = y;
+		window_count++;
+	}
+}
+
+void hitch_estimator::mask_trailer(lidar_scan &scan, float angle) const
+{
+	float c = cosf(angle);
+	float s = sinf(angle);
+	float front = -config.face_distance + config.mask_margin;
+	float rear = -config.face_distance - config.trailer_length - config.mask_margin;
+	float half_width = 0.5f * config.trailer_width + config.mask_margin;
+
+	for (uint16_t i = 0; i < scan.count; i++) {
+		if (!scan_point_valid(scan, i))
+			continue;
+		float px = rays.x(scan, i) - config.hitch_x;
+		float py = rays.y(scan, i) - config.hitch_y;
+
+		// Rotate into the trailer frame, whose x axis points from the trailer to the pivot
+		float tx = c * px + s * py;
+		float ty = -s * px + c * py;
+		if (tx <= front && tx >= rear && fabsf(ty) <= half_width)
+			scan.flags[i] |= SCAN_FLAG_TRAILER;
+	}
+}
@@ -0,0 +1,122 @@
+/**
+ * The hitch_estimator runs right after the LiDAR_sensor on every scan. The truck has no
+ * hitch angle sensor, but the front face of the trailer is always visible in the rear
+ * part of the LiDAR sweep. This stage fits a line to the points in that known angular
+ * window and turns the line's orientation into the hitch angle. The same estimate then
+ * places the trailer's footprint in the scan, and every point inside it is flagged with
+ * SCAN_FLAG_TRAILER so the obstacle pipeline stops treating the trailer as an obstacle.
+ *
+ * All geometry is in the LiDAR frame: x forward, y to the left, angles counterclockwise.
+ * A positive hitch angle means the trailer has swung counterclockwise (to the left when
+ * seen from above) relative to the tractor.
+ */
+
+#ifndef ME507_HITCH_ESTIMATOR_H
+#define ME507_HITCH_ESTIMATOR_H
+
+#include <cstdint>
+#include "face_fit.h"
+#include "lidar_scan.h"
+
+/**
+ * @brief Fixed geometry of the tractor, trailer and LiDAR used by the hitch_estimator.
+ * @var hitch_x x of the fifth wheel pivot in the LiDAR frame (m, negative is behind)
+ * @var hitch_y y of the fifth wheel pivot in the LiDAR frame (m)
+ * @var face_distance distance from the pivot back to the trailer's front face (m)
+ * @var trailer_width width of the trailer (m)
+ * @var trailer_length length of the trailer from its front face to its rear (m)
+ * @var window_min first LiDAR angle where the trailer face can appear (rad)
+ * @var window_max last LiDAR angle where the trailer face can appear (rad)
+ * @var max_hitch_angle largest hitch angle accepted as a valid fit (rad)
+ * @var inlier_distance points farther than this from the fitted face are outliers (m)
+ * @var face_tolerance allowed error between the fitted and known face distance (m)
+ * @var mask_margin extra margin around the trailer footprint when masking (m)
+ * @var min_points fewest inliers needed for a valid fit
+ * @var max_age_us how long a previous estimate may still be used for masking (us)
+ */
+struct hitch_config {
+	float hitch_x;
+	float hitch_y;
+	float face_distance;
+	float trailer_width;
+	float trailer_length;
+	float window_min;
+	float window_max;
+	float max_hitch_angle;
+	float inlier_distance;
+	float face_tolerance;
+	float mask_margin;
+	uint16_t min_points;
+	uint32_t max_age_us;
+};
+
+/**
+ * @brief The result of one hitch angle fit.
+ * @var valid true if the fit passed all of its consistency checks
+ * @var angle hitch angle (rad)
+ * @var rms_error RMS distance of the inliers from the fitted face (m)
+ * @var inliers number of points used in the final fit
+ * @var time_us timestamp of the scan the estimate came from
+ */
+struct hitch_estimate {
+	bool     valid;
+	float    angle;
+	float    rms_error;
+	uint16_t inliers;
+	uint64_t time_us;
+};
+
+class hitch_estimator {
+public:
+	/**
+	 * @brief The constructor for a hitch_estimator.
+	 * @param config_in The tractor, trailer and LiDAR geometry
+	 */
+	hitch_estimator(const hitch_config &config_in);
+
+	/**
+	 * @brief Estimates the hitch angle from a scan and masks the trailer out of it.
+	 * If the fit fails, the previous valid estimate is still used for masking as long as
+	 * it is younger than max_age_us.
+	 * @param scan The scan to process; SCAN_FLAG_TRAILER bits are set in place
+	 * @return the estimate from this scan; check its valid member before using it
+	 */
+	hitch_estimate process(lidar_scan &scan);
+
+	/**
+	 * @brief Gets the most recent valid estimate.
+	 * @return the last estimate whose valid member was true
+	 */
+	hitch_estimate get_last_valid() const;
+
+	/**
+	 * @brief Gets how long the last call to process() took.
+	 * @return the run time in microseconds
+	 */
+	uint32_t get_last_run_us() const;
+
+	/**
+	 * @brief Gets the longest a call to process() has taken.
+	 * @return the run time in microseconds
+	 */
+	uint32_t get_max_run_us() const;
+
+private:
+	hitch_config config;
+	hitch_estimate last_valid;
+	uint32_t last_run_us;
+	uint32_t max_run_us;
+
+	ray_table rays;
+
+	// Cartesian points inside the window; kept as members so process() never allocates
+	float window_x[LIDAR_MAX_POINTS];
+	float window_y[LIDAR_MAX_POINTS];
+	uint16_t window_count;
+
+	void collect_window(const lidar_scan &scan);
+	void mask_trailer(lidar_scan &scan, float angle) const;
+};
+
+
+#endif //ME507_HITCH_ESTIMATOR_H
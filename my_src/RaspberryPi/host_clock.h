@@ -0,0 +1,24 @@
+/**
+ * The Pi's monotonic clock. Scan timestamps, odometry and the pipeline's timing
+ * counters are all kept on it, so times taken on different threads can be compared
+ * directly.
+ */
+
+#ifndef ME507_HOST_CLOCK_H
+#define ME507_HOST_CLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Gets the Pi's monotonic clock, which every scan timestamp is converted to.
+ * @return the time in microseconds
+ */
+inline uint64_t host_time_us()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+#endif //ME507_HOST_CLOCK_H
@@ -0,0 +1,771 @@
+//
+// Hybrid A* planning for the tractor and trailer; see hybrid_astar.h.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include "host_clock.h"
+#include "hybrid_astar.h"
+
+#define NO_PRIMITIVE 255
+#define NO_PARENT 0xFFFFFFFFu
+#define SUBSTEPS 4              // integration steps per sample along a primitive
+#define DIAGONAL 1.41421356f
+#define SHOT_MAX_ANGLE 1.0f     // most a state may be turned from the goal to try driving onto it (rad)
+#define SHOT_HITCH_SHARE 0.8f   // share of hitch_limit the drive onto the goal may ask for in reverse
+
+static float wrap_angle(float angle)
+{
+	while (angle > (float)M_PI)
+		angle -= 2.0f * (float)M_PI;
+	while (angle < -(float)M_PI)
+		angle += 2.0f * (float)M_PI;
+	return angle;
+}
+
+hybrid_astar::hybrid_astar(const truck_geometry &geometry_in, const truck_footprint &footprint_in,
+                           const hybrid_astar_config &config_in)
+{
+	geometry = geometry_in;
+	footprint = footprint_in;
+	config = config_in;
+	map = NULL;
+	clearance = NULL;
+	if (config.hitch_limit > geometry.max_hitch)
+		config.hitch_limit = geometry.max_hitch;
+
+	hitch_bins = (uint8_t)(2 * lroundf(config.hitch_limit / config.hitch_resolution) + 1);
+	steer_count = (uint8_t)(2 * config.steer_levels + 1);
+	primitives = (uint8_t)(2 * steer_count);
+	samples = (uint8_t)std::max(1L, lroundf(ceilf(config.step_length / config.sample_spacing - 0.001f)));
+	primitive_count = 0;
+	map_us = 0;
+	heuristic_width = 0;
+	heuristic_height = 0;
+	goal_x = 0.0f;
+	goal_y = 0.0f;
+	goal_heading = 0.0f;
+
+	// Each body is covered by circles no longer than it is wide, centered on its axis
+	float length = footprint.tractor_front + footprint.tractor_rear;
+	tractor_circles = (uint8_t)std::max(1.0f, ceilf(length / footprint.tractor_width));
+	for (uint8_t i = 0; i < tractor_circles; i++) {
+		float part = length / tractor_circles;
+		circle_offset.push_back(-footprint.tractor_rear + (i + 0.5f) * part);
+		circle_radius.push_back(hypotf(0.5f * footprint.tractor_width, 0.5f * part) + footprint.margin);
+	}
+	length = footprint.trailer_rear - footprint.trailer_front;
+	uint8_t trailer_circles = (uint8_t)std::max(1.0f, ceilf(length / footprint.trailer_width));
+	for (uint8_t i = 0; i < trailer_circles; i++) {
+		float part = length / trailer_circles;
+		circle_offset.push_back(footprint.trailer_front + (i + 0.5f) * part);
+		circle_radius.push_back(hypotf(0.5f * footprint.trailer_width, 0.5f * part) + footprint.margin);
+	}
+	circles = (uint8_t)(tractor_circles + trailer_circles);
+	circle_clearance = circle_radius;
+
+	uint64_t start = host_time_us();
+	build_primitives();
+	build_turning();
+	build_us = (uint32_t)(host_time_us() - start);
+}
+
+/**
+ * One step of the vehicle_model's kinematics, with distance in place of time: the
+ * trailer turns with the hitch point's velocity across it.
+ */
+void hybrid_astar::advance(plan_pose &pose, float steer, float distance) const
+{
+	float v = distance < 0.0f ? -1.0f : 1.0f;
+	float d = fabsf(distance);
+	float yaw_rate = v * tanf(steer) / geometry.wheelbase;
+	float trailer_rate = (-v * sinf(pose.hitch) - geometry.hitch_offset * yaw_rate * cosf(pose.hitch))
+	                     / geometry.trailer_length;
+	float mid = pose.heading + 0.5f * yaw_rate * d;
+	pose.x += v * cosf(mid) * d;
+	pose.y += v * sinf(mid) * d;
+	pose.heading += yaw_rate * d;
+	pose.hitch += (trailer_rate - yaw_rate) * d;
+}
+
+/**
+ * Integrates every primitive from the origin, then lays the end point
+ * and the footprint circles of each sample out for every heading bin. The circles for a
+ * state's primitives sit next to each other, as the search checks them in turn.
+ */
+void hybrid_astar::build_primitives()
+{
+	for (uint8_t i = 0; i < steer_count; i++) {
+		float level = config.steer_levels ? (float)((int)i - config.steer_levels) / config.steer_levels : 0.0f;
+		steer_angle.push_back(geometry.max_steer * level);
+	}
+
+	uint32_t local_count = (uint32_t)hitch_bins * primitives;
+	valid.assign(local_count, 0);
+	heading_step.assign(local_count, 0);
+	end_hitch.assign(local_count, 0.0f);
+	hitch_low.assign(local_count, 0.0f);
+	hitch_high.assign(local_count, 0.0f);
+	step_cost.assign(local_count, 0.0f);
+	local_x.assign(local_count * samples, 0.0f);
+	local_y.assign(local_count * samples, 0.0f);
+	local_heading.assign(local_count * samples, 0.0f);
+	local_hitch.assign(local_count * samples, 0.0f);
+
+	float dt = config.step_length / samples / SUBSTEPS;
+	float bin_width = 2.0f * (float)M_PI / config.heading_bins;
+	for (uint8_t k = 0; k < hitch_bins; k++) {
+		for (uint8_t p = 0; p < primitives; p++) {
+			uint32_t index = (uint32_t)k * primitives + p;
+			bool reverse = p >= steer_count;
+			float v = reverse ? -1.0f : 1.0f;
+			float steer = steer_angle[p % steer_count];
+
+			plan_pose state = {0.0f, 0.0f, 0.0f, bin_hitch(k), reverse};
+			float low = state.hitch, high = state.hitch, hitch_sum = 0.0f;
+			for (uint8_t s = 0; s < samples; s++) {
+				for (uint8_t j = 0; j < SUBSTEPS; j++)
+					advance(state, steer, v * dt);
+				uint32_t at = index * samples + s;
+				local_x[at] = state.x;
+				local_y[at] = state.y;
+				local_heading[at] = state.heading;
+				local_hitch[at] = state.hitch;
+				low = std::min(low, state.hitch);
+				high = std::max(high, state.hitch);
+				hitch_sum += fabsf(state.hitch);
+			}
+
+			valid[index] = low >= -config.hitch_limit && high <= config.hitch_limit;
+			heading_step[index] = (int16_t)lroundf(state.heading / bin_width);
+			end_hitch[index] = state.hitch;
+			hitch_low[index] = low;
+			hitch_high[index] = high;
+			step_cost[index] = config.step_length * ((reverse ? config.reverse_cost : 1.0f)
+			                                         + config.steer_cost * fabsf(steer)
+			                                         + config.hitch_cost * hitch_sum / samples);
+			primitive_count += valid[index];
+		}
+	}
+
+	uint32_t rotated_count = (uint32_t)config.heading_bins * local_count;
+	end_x.assign(rotated_count, 0.0f);
+	end_y.assign(rotated_count, 0.0f);
+	circle_x.assign((size_t)rotated_count * samples * circles, 0.0f);
+	circle_y.assign((size_t)rotated_count * samples * circles, 0.0f);
+	for (uint16_t h = 0; h < config.heading_bins; h++) {
+		float base = bin_heading(h);
+		float c = cosf(base), s = sinf(base);
+		for (uint32_t index = 0; index < local_count; index++) {
+			uint32_t rotated = (uint32_t)h * local_count + index;
+			uint32_t last = index * samples + samples - 1;
+			end_x[rotated] = c * local_x[last] - s * local_y[last];
+			end_y[rotated] = s * local_x[last] + c * local_y[last];
+
+			for (uint8_t i = 0; i < samples; i++) {
+				uint32_t at = index * samples + i;
+				float px = c * local_x[at] - s * local_y[at];
+				float py = s * local_x[at] + c * local_y[at];
+				float heading = base + local_heading[at];
+				float trailer_heading = heading + local_hitch[at];
+				float kx = px - geometry.hitch_offset * cosf(heading);
+				float ky = py - geometry.hitch_offset * sinf(heading);
+				float *cx = &circle_x[((size_t)rotated * samples + i) * circles];
+				float *cy = &circle_y[((size_t)rotated * samples + i) * circles];
+				for (uint8_t j = 0; j < tractor_circles; j++) {
+					cx[j] = px + circle_offset[j] * cosf(heading);
+					cy[j] = py + circle_offset[j] * sinf(heading);
+				}
+				for (uint8_t j = tractor_circles; j < circles; j++) {
+					cx[j] = kx - circle_offset[j] * cosf(trailer_heading);
+					cy[j] = ky - circle_offset[j] * sinf(trailer_heading);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Dijkstra's algorithm backwards from a goal at the origin facing along x with the hitch
+ * straight. Each primitive has the hitch angle change in proportion to the distance
+ * driven, so a state's predecessors are found exactly by driving the opposite way with
+ * the same steering from it, and the cost is that of the primitive the right way round.
+ * Like the search itself, each cell of the table keeps the exact state that reached it
+ * first and grows from there, so the costs belong to paths that can really be driven.
+ */
+void hybrid_astar::build_turning()
+{
+	float res = config.turning_resolution;
+	turning_cells = (uint32_t)ceilf(config.turning_window / res) | 1;
+	turning_hitch_bins = (uint8_t)(2 * lroundf(config.hitch_limit / config.turning_hitch_resolution) + 1);
+	size_t count = (size_t)turning_cells * turning_cells * config.heading_bins * turning_hitch_bins;
+	turning.assign(count, INFINITY);
+	std::vector<float> seed_x(count), seed_y(count), seed_hitch(count);
+
+	uint32_t local_count = (uint32_t)hitch_bins * primitives;
+	typedef std::pair<float, uint32_t> entry;
+	std::priority_queue<entry, std::vector<entry>, std::greater<entry> > open;
+	uint32_t goal_state = (uint32_t)turning_state(0.0f, 0.0f, 0, 0.0f);
+	turning[goal_state] = 0.0f;
+	seed_x[goal_state] = 0.0f;
+	seed_y[goal_state] = 0.0f;
+	seed_hitch[goal_state] = 0.0f;
+	open.push(entry(0.0f, goal_state));
+	while (!open.empty()) {
+		entry top = open.top();
+		open.pop();
+		if (top.first > turning[top.second])
+			continue;
+		uint16_t heading = (uint16_t)(top.second / turning_hitch_bins % config.heading_bins);
+		float x = seed_x[top.second], y = seed_y[top.second], hitch = seed_hitch[top.second];
+		uint8_t k = hitch_bin(hitch);
+		float offset = hitch - bin_hitch(k);
+		for (uint8_t p = 0; p < primitives; p++) {
+			uint32_t back = (uint32_t)k * primitives + p;
+			if (!valid[back] || hitch_low[back] + offset < -config.hitch_limit
+			    || hitch_high[back] + offset > config.hitch_limit)
+				continue;
+			uint32_t rotated = (uint32_t)heading * local_count + back;
+			float from_x = x + end_x[rotated], from_y = y + end_y[rotated];
+			float from_hitch = end_hitch[back] + offset;
+			int32_t from = ((int32_t)heading + heading_step[back]) % (int32_t)config.heading_bins;
+			if (from < 0)
+				from += config.heading_bins;
+			int32_t state = turning_state(from_x, from_y, (uint16_t)from, from_hitch);
+			if (state < 0)
+				continue;
+
+			// The primitive the other way round, from the predecessor
+			uint8_t opposite = (uint8_t)((p + steer_count) % primitives);
+			float d = top.first + step_cost[(uint32_t)hitch_bin(from_hitch) * primitives + opposite];
+			if (d < turning[state]) {
+				turning[state] = d;
+				seed_x[state] = from_x;
+				seed_y[state] = from_y;
+				seed_hitch[state] = from_hitch;
+				open.push(entry(d, (uint32_t)state));
+			}
+		}
+	}
+}
+
+/**
+ * @return the index of a state in the turning heuristic table, for a pose relative to the
+ * goal, or -1 if it is outside the window
+ */
+int32_t hybrid_astar::turning_state(float x, float y, uint16_t heading, float hitch) const
+{
+	int32_t middle = (int32_t)turning_cells / 2;
+	int32_t cx = (int32_t)lroundf(x / config.turning_resolution) + middle;
+	int32_t cy = (int32_t)lroundf(y / config.turning_resolution) + middle;
+	int32_t k = (int32_t)lroundf(hitch / config.turning_hitch_resolution) + turning_hitch_bins / 2;
+	if (cx < 0 || cy < 0 || cx >= (int32_t)turning_cells || cy >= (int32_t)turning_cells || k < 0
+	    || k >= turning_hitch_bins)
+		return -1;
+	return (((cy * (int32_t)turning_cells + cx) * config.heading_bins) + heading) * turning_hitch_bins + k;
+}
+
+/**
+ * The distance map measures between cell centers, while a circle center can be anywhere
+ * in its cell and an obstacle fills its whole cell; each circle's needed value covers
+ * both, half a cell diagonal each.
+ */
+void hybrid_astar::set_map(const occupancy_grid &map_in)
+{
+	uint64_t start = host_time_us();
+	map = &map_in;
+	map->compute_distance(own_clearance, true);
+	clearance = &own_clearance[0];
+	for (uint8_t j = 0; j < circles; j++)
+		circle_clearance[j] = circle_radius[j] + map->get_resolution() * DIAGONAL;
+	map_us = (uint32_t)(host_time_us() - start);
+}
+
+/**
+ * The costmap's distances are exact up to its inflation radius and capped there, so
+ * they serve as long as no circle needs more room than that.
+ */
+bool hybrid_astar::set_costmap(const costmap &costmap_in)
+{
+	const costmap_config &settings = costmap_in.get_config();
+	float resolution = costmap_in.get_map().get_resolution();
+	for (uint8_t j = 0; j < circles; j++)
+		if (circle_radius[j] + resolution * DIAGONAL > settings.inflation_radius)
+			return false;
+	if (!settings.unknown_is_obstacle)
+		return false;
+
+	map = &costmap_in.get_map();
+	own_clearance.clear();
+	clearance = costmap_in.distances();
+	for (uint8_t j = 0; j < circles; j++)
+		circle_clearance[j] = circle_radius[j] + resolution * DIAGONAL;
+	map_us = 0;
+	return true;
+}
+
+/**
+ * Dijkstra's algorithm outward from the goal over a grid of heuristic_resolution cells,
+ * eight ways. A cell is blocked only if no point in it has room for the smallest circle,
+ * so the table never routes around a gap the truck could use.
+ */
+void hybrid_astar::build_heuristic()
+{
+	float res = config.heuristic_resolution;
+	heuristic_width = (uint32_t)ceilf(map->get_width() * map->get_resolution() / res);
+	heuristic_height = (uint32_t)ceilf(map->get_height() * map->get_resolution() / res);
+	heuristic.assign((size_t)heuristic_width * heuristic_height, INFINITY);
+
+	float smallest = *std::min_element(circle_clearance.begin(), circle_clearance.end());
+	std::vector<uint8_t> blocked((size_t)heuristic_width * heuristic_height);
+	for (uint32_t hy = 0; hy < heuristic_height; hy++) {
+		for (uint32_t hx = 0; hx < heuristic_width; hx++) {
+			int32_t cx, cy;
+			bool inside = map->world_to_cell(map->get_origin_x() + (hx + 0.5f) * res,
+			                                 map->get_origin_y() + (hy + 0.5f) * res, cx, cy);
+			float room = inside ? clearance[(uint32_t)cy * map->get_width() + cx] : 0.0f;
+			blocked[hy * heuristic_width + hx] = room + 0.5f * res * DIAGONAL < smallest;
+		}
+	}
+
+	int32_t gx = (int32_t)floorf((goal_x - map->get_origin_x()) / res);
+	int32_t gy = (int32_t)floorf((goal_y - map->get_origin_y()) / res);
+	if (gx < 0 || gy < 0 || gx >= (int32_t)heuristic_width || gy >= (int32_t)heuristic_height)
+		return;
+
+	typedef std::pair<float, uint32_t> entry;
+	std::priority_queue<entry, std::vector<entry>, std::greater<entry> > open;
+	uint32_t goal_cell = (uint32_t)gy * heuristic_width + gx;
+	heuristic[goal_cell] = 0.0f;
+	open.push(entry(0.0f, goal_cell));
+	static const int8_t dx[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+	static const int8_t dy[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+	while (!open.empty()) {
+		entry top = open.top();
+		open.pop();
+		if (top.first > heuristic[top.second])
+			continue;
+		int32_t x = top.second % heuristic_width, y = top.second / heuristic_width;
+		for (uint8_t i = 0; i < 8; i++) {
+			int32_t nx = x + dx[i], ny = y + dy[i];
+			if (nx < 0 || ny < 0 || nx >= (int32_t)heuristic_width || ny >= (int32_t)heuristic_height)
+				continue;
+			uint32_t next = (uint32_t)ny * heuristic_width + nx;
+			if (blocked[next])
+				continue;
+			float d = top.first + (i < 4 ? res : res * DIAGONAL);
+			if (d < heuristic[next]) {
+				heuristic[next] = d;
+				open.push(entry(d, next));
+			}
+		}
+	}
+}
+
+float hybrid_astar::heuristic_at(float x, float y, uint16_t heading, float hitch) const
+{
+	int32_t hx = (int32_t)floorf((x - map->get_origin_x()) / config.heuristic_resolution);
+	int32_t hy = (int32_t)floorf((y - map->get_origin_y()) / config.heuristic_resolution);
+	if (hx < 0 || hy < 0 || hx >= (int32_t)heuristic_width || hy >= (int32_t)heuristic_height)
+		return INFINITY;
+	float around = heuristic[(uint32_t)hy * heuristic_width + hx];
+
+	// Outside the window the state is moved to its edge and the distance added back, so the
+	// two tables meet without a step at the edge for the search to pile up against
+	float c = cosf(goal_heading), s = sinf(goal_heading);
+	float dx = x - goal_x, dy = y - goal_y;
+	float rx = c * dx + s * dy, ry = c * dy - s * dx;
+	float edge = (turning_cells / 2) * config.turning_resolution;
+	float cx = std::min(std::max(rx, -edge), edge), cy = std::min(std::max(ry, -edge), edge);
+	int32_t state = turning_state(cx, cy, heading_bin(bin_heading(heading) - goal_heading), hitch);
+	if (state < 0 || std::isinf(turning[state]))
+		return around;
+	return std::max(around, turning[state] + hypotf(rx - cx, ry - cy));
+}
+
+bool hybrid_astar::clear_at(float x, float y, float needed) const
+{
+	int32_t cx, cy;
+	if (!map->world_to_cell(x, y, cx, cy))
+		return false;
+	return clearance[(uint32_t)cy * map->get_width() + cx] >= needed;
+}
+
+bool hybrid_astar::primitive_is_free(float x, float y, uint32_t rotated) const
+{
+	const float *cx = &circle_x[(size_t)rotated * samples * circles];
+	const float *cy = &circle_y[(size_t)rotated * samples * circles];
+	for (uint8_t s = 0; s < samples; s++, cx += circles, cy += circles)
+		for (uint8_t j = 0; j < circles; j++)
+			if (!clear_at(x + cx[j], y + cy[j], circle_clearance[j]))
+				return false;
+	return true;
+}
+
+bool hybrid_astar::pose_is_free(const plan_pose &pose) const
+{
+	if (!map)
+		return false;
+	float trailer_heading = pose.heading + pose.hitch;
+	float kx = pose.x - geometry.hitch_offset * cosf(pose.heading);
+	float ky = pose.y - geometry.hitch_offset * sinf(pose.heading);
+	for (uint8_t j = 0; j < tractor_circles; j++)
+		if (!clear_at(pose.x + circle_offset[j] * cosf(pose.heading),
+		              pose.y + circle_offset[j] * sinf(pose.heading), circle_clearance[j]))
+			return false;
+	for (uint8_t j = tractor_circles; j < circles; j++)
+		if (!clear_at(kx - circle_offset[j] * cosf(trailer_heading),
+		              ky - circle_offset[j] * sinf(trailer_heading), circle_clearance[j]))
+			return false;
+	return true;
+}
+
+void hybrid_astar::trailer_axle(const plan_pose &pose, float &tx, float &ty) const
+{
+	float trailer_heading = pose.heading + pose.hitch;
+	tx = pose.x - geometry.hitch_offset * cosf(pose.heading) - geometry.trailer_length * cosf(trailer_heading);
+	ty = pose.y - geometry.hitch_offset * sinf(pose.heading) - geometry.trailer_length * sinf(trailer_heading);
+}
+
+uint64_t hybrid_astar::state_key(float x, float y, uint16_t heading, uint8_t hitch) const
+{
+	uint64_t cx = (uint64_t)((x - map->get_origin_x()) / config.xy_resolution);
+	uint64_t cy = (uint64_t)((y - map->get_origin_y()) / config.xy_resolution);
+	uint64_t columns = (uint64_t)(map->get_width() * map->get_resolution() / config.xy_resolution) + 1;
+	return ((cy * columns + cx) * config.heading_bins + heading) * hitch_bins + hitch;
+}
+
+uint16_t hybrid_astar::heading_bin(float heading) const
+{
+	float bin_width = 2.0f * (float)M_PI / config.heading_bins;
+	int32_t bin = (int32_t)lroundf(heading / bin_width) % config.heading_bins;
+	return (uint16_t)(bin < 0 ? bin + config.heading_bins : bin);
+}
+
+uint8_t hybrid_astar::hitch_bin(float hitch) const
+{
+	int32_t bin = (int32_t)lroundf(hitch / config.hitch_resolution) + hitch_bins / 2;
+	return (uint8_t)std::min(std::max(bin, (int32_t)0), (int32_t)hitch_bins - 1);
+}
+
+float hybrid_astar::bin_heading(uint16_t bin) const
+{
+	return wrap_angle(bin * 2.0f * (float)M_PI / config.heading_bins);
+}
+
+float hybrid_astar::bin_hitch(uint8_t bin) const
+{
+	return ((int32_t)bin - hitch_bins / 2) * config.hitch_resolution;
+}
+
+size_t hybrid_astar::get_table_bytes() const
+{
+	return turning.size() * sizeof(float) + valid.size() * sizeof(uint8_t) + heading_step.size() * sizeof(int16_t)
+	       + (end_hitch.size() + hitch_low.size() + hitch_high.size() + step_cost.size()) * sizeof(float)
+	       + (local_x.size() + local_y.size() + local_heading.size() + local_hitch.size()) * sizeof(float)
+	       + (end_x.size() + end_y.size() + circle_x.size() + circle_y.size()) * sizeof(float);
+}
+
+/**
+ * A* over the lattice with an open list that allows stale entries: a state reached
+ * again more cheaply is updated in place and pushed again, and since that entry comes
+ * out first the old one finds the state closed and is skipped. Each state expanded is
+ * tried for a shot onto the goal.
+ */
+bool hybrid_astar::plan(const plan_pose &start, const plan_pose &goal, plan_result &result)
+{
+	result.found = false;
+	result.poses.clear();
+	result.points.clear();
+	result.segments.clear();
+	result.cost = 0.0f;
+	result.length = 0.0f;
+	result.expanded = 0;
+	result.heuristic_us = 0;
+	result.search_us = 0;
+	if (!map)
+		return false;
+
+	uint64_t begin = host_time_us();
+	goal_x = goal.x;
+	goal_y = goal.y;
+	goal_heading = goal.heading;
+	build_heuristic();
+	uint64_t searching = host_time_us();
+	result.heuristic_us = (uint32_t)(searching - begin);
+
+	nodes.clear();
+	visited.clear();
+	search_node first;
+	first.x = start.x;
+	first.y = start.y;
+	first.hitch = start.hitch;
+	first.g = 0.0f;
+	first.parent = NO_PARENT;
+	first.heading = heading_bin(start.heading);
+	first.primitive = NO_PRIMITIVE;
+	first.closed = false;
+	plan_pose snapped = start;
+	snapped.heading = bin_heading(first.heading);
+	float h = heuristic_at(start.x, start.y, first.heading, first.hitch);
+	if (!pose_is_free(snapped) || fabsf(start.hitch) > config.hitch_limit || std::isinf(h)) {
+		result.search_us = (uint32_t)(host_time_us() - searching);
+		return false;
+	}
+	nodes.push_back(first);
+	visited[state_key(first.x, first.y, first.heading, hitch_bin(first.hitch))] = 0;
+
+	typedef std::pair<float, uint32_t> entry;
+	std::priority_queue<entry, std::vector<entry>, std::greater<entry> > open;
+	open.push(entry(config.heuristic_weight * h, 0));
+	uint32_t local_count = (uint32_t)hitch_bins * primitives;
+	uint32_t found = NO_PARENT;
+	while (!open.empty() && result.expanded < config.max_expansions) {
+		entry top = open.top();
+		open.pop();
+		search_node node = nodes[top.second];
+		if (node.closed)
+			continue;
+		nodes[top.second].closed = true;
+		result.expanded++;
+
+		if (try_shot(node, goal)) {
+			found = top.second;
+			break;
+		}
+
+		uint8_t k = hitch_bin(node.hitch);
+		float offset = node.hitch - bin_hitch(k);
+		bool was_reverse = node.primitive != NO_PRIMITIVE && node.primitive >= steer_count;
+		float was_steer = node.primitive != NO_PRIMITIVE ? steer_angle[node.primitive % steer_count] : 0.0f;
+		for (uint8_t p = 0; p < primitives; p++) {
+			uint32_t index = (uint32_t)k * primitives + p;
+			if (!valid[index] || hitch_low[index] + offset < -config.hitch_limit
+			    || hitch_high[index] + offset > config.hitch_limit)
+				continue;
+			uint32_t rotated = (uint32_t)node.heading * local_count + index;
+			if (!primitive_is_free(node.x, node.y, rotated))
+				continue;
+
+			search_node next;
+			next.x = node.x + end_x[rotated];
+			next.y = node.y + end_y[rotated];
+			next.hitch = end_hitch[index] + offset;
+			int32_t heading = ((int32_t)node.heading + heading_step[index]) % config.heading_bins;
+			next.heading = (uint16_t)(heading < 0 ? heading + config.heading_bins : heading);
+			next.primitive = p;
+			next.parent = top.second;
+			next.closed = false;
+			bool reverse = p >= steer_count;
+			next.g = node.g + step_cost[index]
+			         + config.steer_change_cost * fabsf(steer_angle[p % steer_count] - was_steer);
+			if (node.primitive != NO_PRIMITIVE && reverse != was_reverse)
+				next.g += config.switch_cost;
+
+			float to_goal = heuristic_at(next.x, next.y, next.heading, next.hitch);
+			if (std::isinf(to_goal))
+				continue;
+			uint64_t key = state_key(next.x, next.y, next.heading, hitch_bin(next.hitch));
+			std::unordered_map<uint64_t, uint32_t>::iterator there = visited.find(key);
+			uint32_t slot;
+			if (there == visited.end()) {
+				slot = (uint32_t)nodes.size();
+				visited[key] = slot;
+				nodes.push_back(next);
+			}
+			else {
+				slot = there->second;
+				if (nodes[slot].closed || nodes[slot].g <= next.g)
+					continue;
+				nodes[slot] = next;
+			}
+			open.push(entry(next.g + config.heuristic_weight * to_goal, slot));
+		}
+	}
+	result.search_us = (uint32_t)(host_time_us() - searching);
+	if (found == NO_PARENT)
+		return false;
+
+	result.found = true;
+	result.cost = nodes[found].g;
+	if (!shot.empty()) {
+		bool was_reverse = nodes[found].primitive != NO_PRIMITIVE && nodes[found].primitive >= steer_count;
+		result.cost += shot.size() * config.sample_spacing * (shot[0].reverse ? config.reverse_cost : 1.0f);
+		if (nodes[found].primitive != NO_PRIMITIVE && shot[0].reverse != was_reverse)
+			result.cost += config.switch_cost;
+	}
+	trace(found, result);
+	return true;
+}
+
+bool hybrid_astar::at_goal(const plan_pose &pose, const plan_pose &goal) const
+{
+	return hypotf(pose.x - goal.x, pose.y - goal.y) <= config.goal_distance
+	       && fabsf(wrap_angle(pose.heading - goal.heading)) <= config.goal_heading
+	       && fabsf(pose.hitch - goal.hitch) <= config.goal_hitch;
+}
+
+/**
+ * Forwards the tractor's rear axle follows the line through the goal along its heading;
+ * in reverse the trailer axle follows the line through the goal's trailer axle along the
+ * trailer's heading, with the hitch angle steered to the one that turns the trailer onto
+ * the pursuit arc, as in control_loop::reverse_steering(). The drive is simulated every
+ * sample_spacing until the tracked point draws level with the goal, and kept in shot if
+ * it ends there. A state already at the goal takes an empty shot.
+ * @return true if the drive reached the goal
+ */
+bool hybrid_astar::try_shot(const search_node &node, const plan_pose &goal)
+{
+	shot.clear();
+	plan_pose pose = {node.x, node.y, bin_heading(node.heading), node.hitch, false};
+	if (at_goal(pose, goal))
+		return true;
+
+	// Which way, if either, the goal is close enough in front to drive onto
+	float goal_tx, goal_ty, tx, ty;
+	trailer_axle(goal, goal_tx, goal_ty);
+	trailer_axle(pose, tx, ty);
+	float goal_trailer = goal.heading + goal.hitch;
+	float fc = cosf(goal.heading), fs = sinf(goal.heading);
+	float rc = cosf(goal_trailer), rs = sinf(goal_trailer);
+	float ahead = (goal.x - pose.x) * fc + (goal.y - pose.y) * fs;
+	float behind = (tx - goal_tx) * rc + (ty - goal_ty) * rs;
+	float ahead_across = (goal.y - pose.y) * fc - (goal.x - pose.x) * fs;
+	float behind_across = (ty - goal_ty) * rc - (tx - goal_tx) * rs;
+	if (ahead > fabsf(ahead_across) && ahead <= config.shot_length
+	    && fabsf(wrap_angle(pose.heading - goal.heading)) < SHOT_MAX_ANGLE)
+		pose.reverse = false;
+	else if (behind > fabsf(behind_across) && behind <= config.shot_length
+	         && fabsf(wrap_angle(pose.heading + pose.hitch - goal_trailer)) < SHOT_MAX_ANGLE)
+		pose.reverse = true;
+	else
+		return false;
+
+	float step = config.sample_spacing / SUBSTEPS;
+	float l2 = geometry.trailer_length;
+	uint32_t most = (uint32_t)(2.0f * config.shot_length / config.sample_spacing);
+	for (uint32_t i = 0; i < most; i++) {
+		for (uint8_t j = 0; j < SUBSTEPS; j++) {
+			float steer;
+			if (!pose.reverse) {
+				// Pure pursuit of the point a lookahead further along the line
+				float along = (pose.x - goal.x) * fc + (pose.y - goal.y) * fs + config.shot_lookahead;
+				float dx = goal.x + along * fc - pose.x, dy = goal.y + along * fs - pose.y;
+				float lateral = -sinf(pose.heading) * dx + cosf(pose.heading) * dy;
+				steer = atanf(2.0f * geometry.wheelbase * lateral / (dx * dx + dy * dy));
+			}
+			else {
+				// The same for the trailer as if it were driving the other way
+				trailer_axle(pose, tx, ty);
+				float along = (tx - goal_tx) * rc + (ty - goal_ty) * rs - config.shot_lookahead;
+				float dx = goal_tx + along * rc - tx, dy = goal_ty + along * rs - ty;
+				float back = pose.heading + pose.hitch + (float)M_PI;
+				float lateral = -sinf(back) * dx + cosf(back) * dy;
+				float target = atanf(l2 * 2.0f * lateral / (dx * dx + dy * dy));
+				target = std::min(std::max(target, -SHOT_HITCH_SHARE * config.hitch_limit),
+				                  SHOT_HITCH_SHARE * config.hitch_limit);
+				float h = pose.hitch;
+				float tan_steer = geometry.wheelbase * (-sinf(h) / l2 - config.shot_hitch_gain * (h - target))
+				                  / (1.0f + geometry.hitch_offset * cosf(h) / l2);
+				steer = atanf(tan_steer);
+			}
+			steer = std::min(std::max(steer, -geometry.max_steer), geometry.max_steer);
+			advance(pose, steer, pose.reverse ? -step : step);
+		}
+		if (fabsf(pose.hitch) > config.hitch_limit || !pose_is_free(pose)) {
+			shot.clear();
+			return false;
+		}
+		shot.push_back(pose);
+
+		// Done once the tracked point is level with the goal's
+		if (!pose.reverse && (goal.x - pose.x) * fc + (goal.y - pose.y) * fs <= 0.0f)
+			break;
+		if (pose.reverse) {
+			trailer_axle(pose, tx, ty);
+			if ((tx - goal_tx) * rc + (ty - goal_ty) * rs <= 0.0f)
+				break;
+		}
+	}
+	if (!at_goal(pose, goal)) {
+		shot.clear();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Replays the primitives from the start to the goal state to get the poses, then cuts
+ * them into segments at every change of direction. The pose at a change of direction
+ * ends one segment and starts the next, with the point each kind of segment tracks.
+ */
+void hybrid_astar::trace(uint32_t goal_node, plan_result &result) const
+{
+	std::vector<uint32_t> chain;
+	for (uint32_t i = goal_node; i != NO_PARENT; i = nodes[i].parent)
+		chain.push_back(i);
+	std::reverse(chain.begin(), chain.end());
+
+	const search_node &first = nodes[chain[0]];
+	plan_pose pose;
+	pose.x = first.x;
+	pose.y = first.y;
+	pose.heading = bin_heading(first.heading);
+	pose.hitch = first.hitch;
+	pose.reverse = chain.size() > 1 && nodes[chain[1]].primitive >= steer_count;
+	result.poses.push_back(pose);
+
+	for (size_t n = 1; n < chain.size(); n++) {
+		const search_node &from = nodes[nodes[chain[n]].parent];
+		uint8_t p = nodes[chain[n]].primitive;
+		uint8_t k = hitch_bin(from.hitch);
+		float offset = from.hitch - bin_hitch(k);
+		uint32_t index = (uint32_t)k * primitives + p;
+		float base = bin_heading(from.heading);
+		float c = cosf(base), s = sinf(base);
+		for (uint8_t i = 0; i < samples; i++) {
+			uint32_t at = index * samples + i;
+			pose.x = from.x + c * local_x[at] - s * local_y[at];
+			pose.y = from.y + s * local_x[at] + c * local_y[at];
+			pose.heading = wrap_angle(base + local_heading[at]);
+			pose.hitch = local_hitch[at] + offset;
+			pose.reverse = p >= steer_count;
+			result.poses.push_back(pose);
+		}
+		result.length += config.step_length;
+	}
+	for (size_t i = 0; i < shot.size(); i++) {
+		pose = shot[i];
+		pose.heading = wrap_angle(pose.heading);
+		result.poses.push_back(pose);
+		result.length += config.sample_spacing;
+	}
+	if (chain.size() == 1 && !shot.empty())
+		result.poses[0].reverse = shot[0].reverse;
+
+	size_t at = 1;
+	while (at < result.poses.size()) {
+		bool reverse = result.poses[at].reverse;
+		size_t end = at;
+		while (end < result.poses.size() && result.poses[end].reverse == reverse)
+			end++;
+
+		plan_segment segment;
+		segment.begin = (uint16_t)result.points.size();
+		segment.count = (uint16_t)(end - at + 1);
+		segment.reverse = reverse;
+		for (size_t i = at - 1; i < end; i++) {
+			path_point point;
+			if (reverse)
+				trailer_axle(result.poses[i], point.x, point.y);
+			else {
+				point.x = result.poses[i].x;
+				point.y = result.poses[i].y;
+			}
+			result.points.push_back(point);
+		}
+		result.segments.push_back(segment);
+		at = end;
+	}
+}
@@ -0,0 +1,344 @@
+/**
+ * The hybrid_astar planner finds paths the tractor and trailer can actually drive
+ * through the occupancy grid, such as backing the trailer into a dock or pulling it out
+ * and across the yard. It searches over states of the tractor's rear axle position,
+ * its heading and the hitch angle. Headings are snapped to a lattice of bins, and two
+ * states in the same position cell, heading bin and hitch angle bin count as the same
+ * state.
+ *
+ * States are joined by motion primitives: short arcs driven forwards or in reverse at a
+ * few fixed steering angles, with the hitch angle following the same off-axle hitch
+ * kinematics as the vehicle_model. The primitives only depend on the starting heading
+ * and hitch bin, so every one of them is integrated once when the planner is built,
+ * along with the footprint of both bodies at each sample along it, already rotated to
+ * its heading bin. Checking a primitive for collisions is then a handful of clearance
+ * lookups at fixed offsets from the state, and primitives that would fold the hitch past
+ * hitch_limit (short of the jackknife angle) are never offered at all. The hitch angle
+ * itself is carried exactly from state to state, adding the change the primitive makes
+ * from its bin: driving forwards it settles too slowly to ever leave a bin if it were
+ * snapped.
+ *
+ * The footprint of each body is covered by a row of circles, so a body is clear when the
+ * distance map has room for each circle. The distance map is either the planner's own,
+ * built for a fixed map, or that of a costmap kept up to date from the LiDAR. The search is A* guided by the larger of two
+ * heuristic tables. One is built for each goal: the shortest distance to the goal around
+ * the obstacles for a point that can move in any direction, found by Dijkstra's
+ * algorithm over a coarse grid, which steers the search around dead ends that a
+ * straight-line distance would run into. The other is built once with the primitives:
+ * the cheapest way for the truck to reach a goal at the origin from every cell, heading
+ * bin and hitch angle bin of a window around it, ignoring obstacles. Near the goal it is
+ * what tells the search it still has to turn and straighten the trailer to line up,
+ * which the first table cannot, and a tractor alone would badly underestimate it.
+ *
+ * Hitting the goal position and heading exactly from a lattice is slow, and backing a
+ * trailer in is the hardest way to do it, so every state expanded that faces roughly the
+ * right way with the goal not far in front of it (or behind its trailer) also tries
+ * driving onto the goal the way the control_loop would: a simulation of its pure pursuit
+ * forwards, or of its trailer pursuit in reverse, along the line through the goal. If
+ * that ends at the goal without hitting anything the search is over. Any state the
+ * control loop could back into the dock from is then a way in, not just the states on
+ * the lattice that happen to line up with it.
+ *
+ * The path comes back as poses every sample_spacing along it, and as segments between
+ * changes of direction with points ready for the control_loop: the tractor's rear axle
+ * when driving forwards and the trailer axle when reversing, as it expects.
+ */
+
+#ifndef ME507_HYBRID_ASTAR_H
+#define ME507_HYBRID_ASTAR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "control_loop.h"
+#include "costmap.h"
+#include "occupancy_grid.h"
+
+/**
+ * @brief Outline of the tractor and trailer, for collision checks.
+ * @var tractor_front distance from the rear axle forward to the front bumper (m)
+ * @var tractor_rear distance from the rear axle back to the tractor's rear (m)
+ * @var tractor_width width of the tractor (m)
+ * @var trailer_front distance from the kingpin back to the trailer's front face (m)
+ * @var trailer_rear distance from the kingpin back to the trailer's rear (m)
+ * @var trailer_width width of the trailer (m)
+ * @var margin clearance kept around both bodies (m)
+ */
+struct truck_footprint {
+	float tractor_front;
+	float tractor_rear;
+	float tractor_width;
+	float trailer_front;
+	float trailer_rear;
+	float trailer_width;
+	float margin;
+};
+
+/**
+ * @brief Settings of the planner.
+ * @var xy_resolution side of the position cells states are told apart by (m)
+ * @var heading_bins number of heading bins around the circle
+ * @var hitch_resolution width of a hitch angle bin (rad)
+ * @var hitch_limit largest hitch angle planned with; below the truck's max_hitch (rad)
+ * @var step_length distance the rear axle moves in one primitive (m)
+ * @var steer_levels steering angles on each side of straight, up to max_steer
+ * @var sample_spacing distance between footprint checks along a primitive (m)
+ * @var reverse_cost cost per meter in reverse, against 1 forwards
+ * @var switch_cost cost of a change of direction (m)
+ * @var steer_cost cost per meter per radian of steering
+ * @var steer_change_cost cost per radian the steering changes between primitives (m/rad)
+ * @var hitch_cost cost per meter per radian of hitch angle
+ * @var heuristic_resolution side of the obstacle heuristic table's cells (m)
+ * @var turning_window side of the square around the goal the turning heuristic covers (m)
+ * @var turning_resolution side of the turning heuristic table's cells (m)
+ * @var turning_hitch_resolution width of the turning heuristic table's hitch angle bins (rad)
+ * @var heuristic_weight weight on the heuristic; above 1 trades path cost for speed
+ * @var goal_distance distance from the goal position that counts as there (m)
+ * @var goal_heading heading error that counts as there (rad)
+ * @var goal_hitch hitch angle error that counts as there (rad)
+ * @var shot_length longest drive tried from a state onto the goal (m)
+ * @var shot_lookahead pure pursuit lookahead of the drive onto the goal (m)
+ * @var shot_hitch_gain how fast the drive onto the goal in reverse pulls the hitch angle to
+ * its target (1/m)
+ * @var max_expansions states expanded before giving up
+ */
+struct hybrid_astar_config {
+	float    xy_resolution;
+	uint16_t heading_bins;
+	float    hitch_resolution;
+	float    hitch_limit;
+	float    step_length;
+	uint8_t  steer_levels;
+	float    sample_spacing;
+	float    reverse_cost;
+	float    switch_cost;
+	float    steer_cost;
+	float    steer_change_cost;
+	float    hitch_cost;
+	float    heuristic_resolution;
+	float    turning_window;
+	float    turning_resolution;
+	float    turning_hitch_resolution;
+	float    heuristic_weight;
+	float    goal_distance;
+	float    goal_heading;
+	float    goal_hitch;
+	float    shot_length;
+	float    shot_lookahead;
+	float    shot_hitch_gain;
+	uint32_t max_expansions;
+};
+
+/**
+ * @brief A state of the truck.
+ * @var x x of the tractor's rear axle (m)
+ * @var y y of the tractor's rear axle (m)
+ * @var heading tractor heading, counterclockwise from the x axis (rad)
+ * @var hitch trailer heading minus tractor heading (rad)
+ * @var reverse true if the truck reaches this pose driving in reverse
+ */
+struct plan_pose {
+	float x;
+	float y;
+	float heading;
+	float hitch;
+	bool  reverse;
+};
+
+/**
+ * @brief A stretch of a path driven in one direction.
+ * @var begin index of its first point
+ * @var count number of points, the first being the last of the segment before
+ * @var reverse true if it is driven in reverse
+ */
+struct plan_segment {
+	uint16_t begin;
+	uint16_t count;
+	bool     reverse;
+};
+
+/**
+ * @brief A planned path and what it took to find it.
+ * @var found true if the goal was reached
+ * @var poses the truck's state every sample_spacing along the path
+ * @var points the points for the control_loop to track, segment after segment: the
+ * tractor's rear axle forwards, the trailer axle in reverse
+ * @var segments the stretches between changes of direction, each ready for set_path()
+ * @var cost total cost of the path
+ * @var length distance the rear axle drives (m)
+ * @var expanded states expanded by the search
+ * @var heuristic_us time spent building the obstacle heuristic table (us)
+ * @var search_us time spent searching (us)
+ */
+struct plan_result {
+	bool found;
+	std::vector<plan_pose> poses;
+	std::vector<path_point> points;
+	std::vector<plan_segment> segments;
+	float cost;
+	float length;
+	uint32_t expanded;
+	uint32_t heuristic_us;
+	uint32_t search_us;
+};
+
+class hybrid_astar {
+public:
+	/**
+	 * @brief The constructor for a planner; builds the motion primitive table.
+	 * @param geometry_in The truck's dimensions and steering and hitch limits
+	 * @param footprint_in The outline of the tractor and trailer
+	 * @param config_in The search settings
+	 */
+	hybrid_astar(const truck_geometry &geometry_in, const truck_footprint &footprint_in,
+	             const hybrid_astar_config &config_in);
+
+	/**
+	 * @brief Sets the map to plan in and builds its distance map. Cells that are
+	 * unknown count as obstacles.
+	 * @param map_in The map, which must outlive the planner or the next set_map()
+	 */
+	void set_map(const occupancy_grid &map_in);
+
+	/**
+	 * @brief Sets a costmap to plan in, using its distances instead of building a
+	 * distance map. It should be updated before each plan() and count unknown cells as
+	 * obstacles.
+	 * @param costmap_in The costmap, which must outlive the planner or the next set_map()
+	 * @return false, leaving the map as it was, if the costmap does not count unknown
+	 * cells as obstacles or its inflation radius is less than the room a circle needs
+	 */
+	bool set_costmap(const costmap &costmap_in);
+
+	/**
+	 * @brief Plans a path from one state to another.
+	 * @param start Where the truck is; reverse is ignored
+	 * @param goal Where it should end up; reverse is ignored
+	 * @param result Filled with the path, or with found false and the search counters
+	 * @return true if a path was found
+	 */
+	bool plan(const plan_pose &start, const plan_pose &goal, plan_result &result);
+
+	/**
+	 * @brief Checks a state against the map with the same circles the search uses.
+	 * @return true if both bodies are clear of obstacles and inside the map
+	 */
+	bool pose_is_free(const plan_pose &pose) const;
+
+	/**
+	 * @brief Works out where the trailer axle is for a state.
+	 * @param pose The state
+	 * @param tx Set to x of the trailer axle (m)
+	 * @param ty Set to y of the trailer axle (m)
+	 */
+	void trailer_axle(const plan_pose &pose, float &tx, float &ty) const;
+
+	/// Number of primitives in the table that stay within hitch_limit
+	uint32_t get_primitive_count() const { return primitive_count; }
+	/// Memory used by the primitive and turning heuristic tables (bytes)
+	size_t get_table_bytes() const;
+	/// Time taken to build the primitive and turning heuristic tables (us)
+	uint32_t get_build_us() const { return build_us; }
+	/// Time taken to build the last distance map, or 0 for a costmap's (us)
+	uint32_t get_map_us() const { return map_us; }
+
+private:
+	struct search_node {
+		float    x;
+		float    y;
+		float    hitch;
+		float    g;
+		uint32_t parent;
+		uint16_t heading;       // heading bin
+		uint8_t  primitive;     // primitive that led here, or NO_PRIMITIVE at the start
+		bool     closed;
+	};
+
+	truck_geometry geometry;
+	truck_footprint footprint;
+	hybrid_astar_config config;
+	const occupancy_grid *map;
+
+	uint8_t hitch_bins;
+	uint8_t steer_count;        // steering angles, straight included
+	uint8_t primitives;         // per heading and hitch bin: each steering angle, both ways
+	uint8_t samples;            // footprint checks along each primitive
+	uint8_t circles;            // tractor circles, then trailer circles
+	uint8_t tractor_circles;
+	uint32_t primitive_count;
+	uint32_t build_us;
+	uint32_t map_us;
+
+	// Per steering angle
+	std::vector<float> steer_angle;
+	// Circle centers along each body, their radii and the distance map value each needs
+	std::vector<float> circle_offset;
+	std::vector<float> circle_radius;
+	std::vector<float> circle_clearance;
+
+	// Per hitch bin and primitive: whether it stays in limits, its heading change in bins,
+	// end hitch angle, lowest and highest hitch angle along it, cost, and the state at
+	// each sample in the frame of its start
+	std::vector<uint8_t> valid;
+	std::vector<int16_t> heading_step;
+	std::vector<float> end_hitch;
+	std::vector<float> hitch_low;
+	std::vector<float> hitch_high;
+	std::vector<float> step_cost;
+	std::vector<float> local_x;
+	std::vector<float> local_y;
+	std::vector<float> local_heading;
+	std::vector<float> local_hitch;
+
+	// Per heading bin, hitch bin and primitive: the end position, and every circle
+	// center at every sample, relative to the start position
+	std::vector<float> end_x;
+	std::vector<float> end_y;
+	std::vector<float> circle_x;
+	std::vector<float> circle_y;
+
+	// Distance map of the current map: own_clearance, or the costmap's distances
+	std::vector<float> own_clearance;
+	const float *clearance;
+
+	// Heuristic table for the current goal
+	std::vector<float> heuristic;
+	uint32_t heuristic_width;
+	uint32_t heuristic_height;
+
+	// Turning heuristic, per cell of the window, heading bin relative to the goal and
+	// hitch angle bin
+	std::vector<float> turning;
+	uint32_t turning_cells;     // along each side of the window
+	uint8_t turning_hitch_bins;
+	float goal_x;
+	float goal_y;
+	float goal_heading;
+
+	// States found by the current search, and where each state's cell and bins are
+	std::vector<search_node> nodes;
+	std::unordered_map<uint64_t, uint32_t> visited;
+	std::vector<plan_pose> shot; // drive onto the goal that ended the last search
+
+
+	void build_primitives();
+	void build_turning();
+	void build_heuristic();
+	float heuristic_at(float x, float y, uint16_t heading, float hitch) const;
+	int32_t turning_state(float x, float y, uint16_t heading, float hitch) const;
+	bool primitive_is_free(float x, float y, uint32_t index) const;
+	bool clear_at(float x, float y, float needed) const;
+	uint64_t state_key(float x, float y, uint16_t heading, uint8_t hitch) const;
+	uint16_t heading_bin(float heading) const;
+	uint8_t hitch_bin(float hitch) const;
+	float bin_heading(uint16_t bin) const;
+	float bin_hitch(uint8_t bin) const;
+	bool try_shot(const search_node &node, const plan_pose &goal);
+	bool at_goal(const plan_pose &pose, const plan_pose &goal) const;
+	void advance(plan_pose &pose, float steer, float distance) const;
+	void trace(uint32_t goal_node, plan_result &result) const;
+};
+
+
+#endif //ME507_HYBRID_ASTAR_H
@@ -0,0 +1,70 @@
+/**
+ * The lidar_scan structure holds one sweep of the Hokuyo LiDAR in the sensor's own
+ * polar form, along with a flag byte for every ray that later stages use to mark
+ * points which are not obstacles (for example the truck's own trailer). It is a plain
+ * fixed-size structure so scans can be passed between threads, logged and replayed
+ * without any allocation.
+ */
+
+#ifndef ME507_LIDAR_SCAN_H
+#define ME507_LIDAR_SCAN_H
+
+#include <cstdint>
+
+/// Enough rays for a 270 degree sweep at 0.25 degrees; the UBG-04LX uses 683 of them
+#define LIDAR_MAX_POINTS 1081
+
+/// Flag bit: the point hits the truck's own trailer and is not an obstacle
+#define SCAN_FLAG_TRAILER 0x01
+/// Flag bit: the range is missing or outside the sensor's valid range
+#define SCAN_FLAG_INVALID 0x02
+
+/**
+ * @brief One LiDAR sweep.
+ * @var time_us time the first ray was measured, in microseconds
+ * @var sweep_us time between the first and the last ray, in microseconds
+ * @var angle_min angle of the first ray in the sensor frame (rad, counterclockwise)
+ * @var angle_increment angle between consecutive rays (rad)
+ * @var range_min shortest range the sensor reports reliably (m)
+ * @var range_max longest range the sensor reports reliably (m)
+ * @var count number of rays that are filled in
+ * @var ranges measured range of every ray (m)
+ * @var flags SCAN_FLAG_ bits for every ray
+ */
+struct lidar_scan {
+	uint64_t time_us;
+	uint32_t sweep_us;
+	float    angle_min;
+	float    angle_increment;
+	float    range_min;
+	float    range_max;
+	uint16_t count;
+	float    ranges[LIDAR_MAX_POINTS];
+	uint8_t  flags[LIDAR_MAX_POINTS];
+};
+
+/**
+ * @brief Checks whether a ray holds a usable range.
+ * @param scan The scan the ray belongs to
+ * @param i The index of the ray
+ * @return true if the range is inside the sensor's valid range and not flagged invalid
+ */
+inline bool scan_point_valid(const lidar_scan &scan, uint16_t i)
+{
+	float r = scan.ranges[i];
+	return !(scan.flags[i] & SCAN_FLAG_INVALID) && r >= scan.range_min && r <= scan.range_max;
+}
+
+/**
+ * @brief Checks whether a ray should be treated as an obstacle.
+ * @param scan The scan the ray belongs to
+ * @param i The index of the ray
+ * @return true if the ray is valid and has not been masked out
+ */
+inline bool scan_point_is_obstacle(const lidar_scan &scan, uint16_t i)
+{
+	return scan_point_valid(scan, i) && !(scan.flags[i] & SCAN_FLAG_TRAILER);
+}
+
+
+#endif //ME507_LIDAR_SCAN_H
@@ -0,0 +1,84 @@
+//
+// Precomputed likelihood field for scoring LiDAR points; see likelihood_field.h.
+//
+
+#include <cstring>
+#include "likelihood_field.h"
+
+likelihood_field::likelihood_field(const occupancy_grid &map, const likelihood_config &config_in)
+{
+	config = config_in;
+	width = map.get_width();
+	height = map.get_height();
+	resolution = map.get_resolution();
+	inv_resolution = 1.0f / resolution;
+	origin_x = map.get_origin_x();
+	origin_y = map.get_origin_y();
+	tiles_x = (width + LIKELIHOOD_TILE - 1) / LIKELIHOOD_TILE;
+	tiles_y = (height + LIKELIHOOD_TILE - 1) / LIKELIHOOD_TILE;
+	tile_stride = LIKELIHOOD_TILE * LIKELIHOOD_TILE;
+
+	std::vector<float> distance;
+	map.compute_distance(distance);
+
+	float uniform = config.z_rand / config.max_range;
+	float norm = config.z_hit / (config.sigma_hit * sqrtf(2.0f * (float)M_PI));
+	float inv_two_var = 1.0f / (2.0f * config.sigma_hit * config.sigma_hit);
+	outside = logf(uniform);
+	own_table.assign((size_t)tiles_x * tiles_y * tile_stride, outside);
+	for (uint32_t cy = 0; cy < height; cy++) {
+		for (uint32_t cx = 0; cx < width; cx++) {
+			float d = distance[(size_t)cy * width + cx];
+			uint32_t tile = (cy >> LIKELIHOOD_TILE_SHIFT) * tiles_x + (cx >> LIKELIHOOD_TILE_SHIFT);
+			own_table[(size_t)tile * tile_stride + ((cy & (LIKELIHOOD_TILE - 1)) << LIKELIHOOD_TILE_SHIFT)
+			          + (cx & (LIKELIHOOD_TILE - 1))] = logf(norm * expf(-d * d * inv_two_var) + uniform);
+		}
+	}
+	table = &own_table[0];
+}
+
+likelihood_field::likelihood_field(const tiled_map &file, const likelihood_config &config_in)
+{
+	config = config_in;
+	outside = logf(config.z_rand / config.max_range);
+	const tiled_map_info &info = file.get_info();
+	bool usable = file.is_open() && info.layer == MAP_LAYER_LIKELIHOOD && info.value_size == sizeof(float)
+	              && info.tile_size == LIKELIHOOD_TILE && file.get_tile_stride() % sizeof(float) == 0;
+	width = usable ? info.width : 0;
+	height = usable ? info.height : 0;
+	resolution = usable ? info.resolution : 1.0f;
+	inv_resolution = 1.0f / resolution;
+	origin_x = info.origin_x;
+	origin_y = info.origin_y;
+	tiles_x = usable ? file.get_tiles_x() : 0;
+	tiles_y = usable ? file.get_tiles_y() : 0;
+	tile_stride = (uint32_t)(file.get_tile_stride() / sizeof(float));
+	table = usable ? (const float *)file.tiles() : NULL;
+}
+
+bool likelihood_field::save(const char *path) const
+{
+	tiled_map_info layer;
+	layer.layer = MAP_LAYER_LIKELIHOOD;
+	layer.value_size = sizeof(float);
+	layer.tile_size = LIKELIHOOD_TILE;
+	layer.width = width;
+	layer.height = height;
+	layer.resolution = resolution;
+	layer.origin_x = origin_x;
+	layer.origin_y = origin_y;
+	tiled_map file;
+	if (is_empty() || !tiled_map::create(path, layer) || !file.open(path, true))
+		return false;
+	size_t tile_bytes = (size_t)LIKELIHOOD_TILE * LIKELIHOOD_TILE * sizeof(float);
+	for (uint32_t ty = 0; ty < tiles_y; ty++) {
+		for (uint32_t tx = 0; tx < tiles_x; tx++) {
+			memcpy(file.tile(tx, ty), table + (size_t)(ty * tiles_x + tx) * tile_stride, tile_bytes);
+			file.mark_dirty(tx * LIKELIHOOD_TILE, ty * LIKELIHOOD_TILE);
+		}
+	}
+	file.flush();
+	bool ok = file.wait_flushed();
+	file.close();
+	return ok;
+}
@@ -0,0 +1,104 @@
+/**
+ * The likelihood_field is the sensor model the particle filter scores scans with. A
+ * LiDAR point that lands near a mapped obstacle is likely and one in open space is not,
+ * so for every cell of the map the log-likelihood of a point ending there is worked
+ * out once, from the distance to the nearest obstacle: a Gaussian of that distance plus
+ * a constant floor for unexplained returns. Scoring a point is then a single table
+ * lookup, which is what makes thousands of particles per scan affordable.
+ *
+ * The table is kept in square tiles of LIKELIHOOD_TILE cells, one page each, the layout
+ * a tiled_map stores it in. A field can be saved once and then used straight from the
+ * memory-mapped file on later boots, so startup neither works the table out again nor
+ * reads more of it than the particles land on.
+ */
+
+#ifndef ME507_LIKELIHOOD_FIELD_H
+#define ME507_LIKELIHOOD_FIELD_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "occupancy_grid.h"
+#include "tiled_map.h"
+
+/// Cells along each side of a tile of the table; 32 x 32 floats fill a 4 kB page
+#define LIKELIHOOD_TILE 32
+#define LIKELIHOOD_TILE_SHIFT 5
+
+/**
+ * @brief Parameters of the likelihood field sensor model.
+ * @var sigma_hit standard deviation of a return around the obstacle it hit (m)
+ * @var z_hit weight of the Gaussian part
+ * @var z_rand weight of the uniform part, for returns the map does not explain
+ * @var max_range range the uniform part is spread over (m)
+ */
+struct likelihood_config {
+	float sigma_hit;
+	float z_hit;
+	float z_rand;
+	float max_range;
+};
+
+class likelihood_field {
+public:
+	/**
+	 * @brief Builds the field for a map.
+	 * @param map The map; it is only read during construction
+	 * @param config_in The sensor model
+	 */
+	likelihood_field(const occupancy_grid &map, const likelihood_config &config_in);
+
+	/**
+	 * @brief Uses a field saved with save() straight from its file, without copying it.
+	 * If the file does not hold a likelihood field the field is empty: is_empty() is
+	 * true and every point scores as off the map.
+	 * @param file The open file, which must outlive the field
+	 * @param config_in The sensor model the field was saved with
+	 */
+	likelihood_field(const tiled_map &file, const likelihood_config &config_in);
+
+	/**
+	 * @brief Writes the field to a new tiled_map file.
+	 * @param path Where to write it
+	 * @return false if the file could not be written
+	 */
+	bool save(const char *path) const;
+
+	/// True if the field has no cells, as one made from an unsuitable file
+	bool is_empty() const { return width == 0; }
+
+	/**
+	 * @brief Looks up the log-likelihood of a point.
+	 * @param x World x of the point (m)
+	 * @param y World y of the point (m)
+	 * @return the log-likelihood; points off the map get that of the uniform part alone
+	 */
+	float log_likelihood(float x, float y) const
+	{
+		int32_t cx = (int32_t)floorf((x - origin_x) * inv_resolution);
+		int32_t cy = (int32_t)floorf((y - origin_y) * inv_resolution);
+		if ((uint32_t)cx >= width || (uint32_t)cy >= height)
+			return outside;
+		uint32_t tile = ((uint32_t)cy >> LIKELIHOOD_TILE_SHIFT) * tiles_x + ((uint32_t)cx >> LIKELIHOOD_TILE_SHIFT);
+		return table[tile * tile_stride + ((cy & (LIKELIHOOD_TILE - 1)) << LIKELIHOOD_TILE_SHIFT)
+		             + (cx & (LIKELIHOOD_TILE - 1))];
+	}
+
+private:
+	likelihood_config config;
+	uint32_t width;
+	uint32_t height;
+	float resolution;
+	float inv_resolution;
+	float origin_x;
+	float origin_y;
+	float outside;
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	uint32_t tile_stride;       // floats from the start of one tile to the next
+	const float *table;         // own_table, or the tiles of a mapped file
+	std::vector<float> own_table;
+};
+
+
+#endif //ME507_LIKELIHOOD_FIELD_H
@@ -0,0 +1,197 @@
+//
+// Deadline-aware load shedding; see load_shedder.h.
+//
+
+#include <cstdio>
+#include "load_shedder.h"
+
+load_shedder::load_shedder(const load_shedder_config &config_in)
+		: level(0)
+{
+	config = config_in;
+	if (config.levels < 1)
+		config.levels = 1;
+	if (config.levels > SHED_MAX_LEVELS)
+		config.levels = SHED_MAX_LEVELS;
+	if (config.max_misses == 0)
+		config.max_misses = 1;
+
+	window_start_us = 0;
+	window_cycles = 0;
+	window_misses = 0;
+	window_headroom_sum = 0.0f;
+	window_headroom_samples = 0;
+	good_since_us = 0;
+	cycles = 0;
+	misses = 0;
+	for (uint8_t i = 0; i < SHED_REASONS; i++)
+		counts[i] = 0;
+	log_head = 0;
+	log_count = 0;
+}
+
+void load_shedder::report_cycle(uint64_t time_us, uint32_t latency_us)
+{
+	shed_event event;
+	bool changed;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (window_start_us == 0)
+			start_window(time_us);
+		cycles++;
+		window_cycles++;
+		if (latency_us > config.deadline_us) {
+			misses++;
+			window_misses++;
+		}
+		changed = judge(time_us, time_us >= window_start_us + config.window_us, event);
+	}
+	if (changed && logger)
+		logger(event);
+}
+
+void load_shedder::report_headroom(uint64_t time_us, float headroom)
+{
+	shed_event event;
+	bool changed;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (window_start_us == 0)
+			start_window(time_us);
+		window_headroom_sum += headroom;
+		window_headroom_samples++;
+		changed = judge(time_us, time_us >= window_start_us + config.window_us, event);
+	}
+	if (changed && logger)
+		logger(event);
+}
+
+uint8_t load_shedder::get_log(shed_event *out) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	for (uint8_t i = 0; i < log_count; i++)
+		out[i] = log[(log_head + i) % SHED_LOG_SIZE];
+	return log_count;
+}
+
+uint32_t load_shedder::get_count(shed_reason reason) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return reason < SHED_REASONS ? counts[reason] : 0;
+}
+
+uint32_t load_shedder::get_cycles() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return cycles;
+}
+
+uint32_t load_shedder::get_misses() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return misses;
+}
+
+/**
+ * Steps down at once when a window collects max_misses deadline misses. Otherwise each
+ * window is judged when it ends: too little headroom steps down, and a window with no
+ * misses and headroom to spare is good; after restore_hold_us of nothing but good
+ * windows the level steps up one, and the hold starts over for the next step.
+ */
+bool load_shedder::judge(uint64_t time_us, bool window_over, shed_event &event)
+{
+	uint8_t current = level.load();
+	if (window_misses >= config.max_misses) {
+		bool changed = current + 1 < config.levels;
+		if (changed)
+			change_level(time_us, current + 1, SHED_DEADLINE_MISSES, event);
+		good_since_us = 0;
+		start_window(time_us);
+		return changed;
+	}
+	if (!window_over)
+		return false;
+
+	float headroom = window_headroom_samples ? window_headroom_sum / window_headroom_samples : -1.0f;
+	bool changed = false;
+	if (headroom >= 0.0f && headroom < config.min_headroom) {
+		good_since_us = 0;
+		if (current + 1 < config.levels) {
+			change_level(time_us, current + 1, SHED_LOW_HEADROOM, event);
+			changed = true;
+		}
+	}
+	else if (window_misses == 0 && (headroom < 0.0f || headroom >= config.restore_headroom)) {
+		if (good_since_us == 0)
+			good_since_us = window_start_us;
+		if (current > 0 && time_us - good_since_us >= config.restore_hold_us) {
+			change_level(time_us, current - 1, SHED_RESTORED, event);
+			good_since_us = time_us;
+			changed = true;
+		}
+	}
+	else {
+		good_since_us = 0;
+	}
+	start_window(time_us);
+	return changed;
+}
+
+void load_shedder::change_level(uint64_t time_us, uint8_t to, shed_reason reason, shed_event &event)
+{
+	event.time_us = time_us;
+	event.from = level.load();
+	event.to = to;
+	event.reason = reason;
+	event.misses = window_misses;
+	event.cycles = window_cycles;
+	event.headroom = window_headroom_samples ? window_headroom_sum / window_headroom_samples : -1.0f;
+
+	counts[reason]++;
+	if (log_count == SHED_LOG_SIZE) {
+		log_head = (log_head + 1) % SHED_LOG_SIZE;
+		log_count--;
+	}
+	log[(log_head + log_count) % SHED_LOG_SIZE] = event;
+	log_count++;
+	level.store(to);
+}
+
+void load_shedder::start_window(uint64_t time_us)
+{
+	window_start_us = time_us;
+	window_cycles = 0;
+	window_misses = 0;
+	window_headroom_sum = 0.0f;
+	window_headroom_samples = 0;
+}
+
+cpu_monitor::cpu_monitor()
+{
+	last_idle = 0;
+	last_total = 0;
+	primed = false;
+}
+
+bool cpu_monitor::sample(float &headroom)
+{
+	FILE *stat = fopen("/proc/stat", "r");
+	if (!stat)
+		return false;
+	unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
+	int fields = fscanf(stat, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+	                    &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+	fclose(stat);
+	if (fields != 8)
+		return false;
+
+	uint64_t idle_now = idle + iowait;
+	uint64_t total_now = user + nice + system + idle + iowait + irq + softirq + steal;
+	bool ready = primed && total_now > last_total;
+	if (ready)
+		headroom = (float)(idle_now - last_idle) / (float)(total_now - last_total);
+	last_idle = idle_now;
+	last_total = total_now;
+	primed = true;
+	return ready;
+}
@@ -0,0 +1,187 @@
+/**
+ * The load_shedder keeps the control cycle on time when the Pi is overloaded by making
+ * perception coarser. A late command is worse than one computed from a thinner scan or
+ * fewer particles, so when the scan-to-command latency misses its deadline too often,
+ * or the CPU has too little idle time left, it steps down one level: each level scores
+ * fewer beams of a scan, updates the map from fewer scans and runs fewer particles than
+ * the one before. Once the deadline has been met with headroom to spare for a while, it
+ * steps back up one level at a time, and the hold time before each step up keeps it
+ * from flapping between two levels.
+ *
+ * The control cycle reports every command's latency and a cpu_monitor (or anything
+ * else) reports the idle fraction; both are judged over short windows. The stages that
+ * do the work read get_settings() before each scan, which is a single atomic load. Every
+ * change of level is counted by its reason, kept in a short log, and passed to an
+ * optional logger function.
+ */
+
+#ifndef ME507_LOAD_SHEDDER_H
+#define ME507_LOAD_SHEDDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+/// Most shedding levels, the first being full quality
+#define SHED_MAX_LEVELS 4
+/// Level changes kept in the log
+#define SHED_LOG_SIZE 32
+
+/**
+ * @brief What the perception stages do at one level.
+ * @var beam_stride only every beam_stride-th ray of a scan is scored
+ * @var particles particles the localizer runs
+ * @var map_update_stride only every map_update_stride-th scan updates the map
+ */
+struct shed_settings {
+	uint16_t beam_stride;
+	uint32_t particles;
+	uint8_t  map_update_stride;
+};
+
+/**
+ * @brief Settings of a load_shedder.
+ * @var deadline_us longest a command may take from its scan reaching the Pi (us)
+ * @var levels number of levels in use, from 1 to SHED_MAX_LEVELS
+ * @var settings what each level does; level 0 is full quality
+ * @var window_us length of the windows misses and headroom are judged over (us)
+ * @var max_misses deadline misses in one window that step down a level
+ * @var min_headroom mean idle CPU fraction in a window below which a level is stepped down
+ * @var restore_headroom idle CPU fraction that, with no misses, counts as good
+ * @var restore_hold_us how long windows must all be good before stepping up a level (us)
+ */
+struct load_shedder_config {
+	uint32_t deadline_us;
+	uint8_t  levels;
+	shed_settings settings[SHED_MAX_LEVELS];
+	uint32_t window_us;
+	uint16_t max_misses;
+	float    min_headroom;
+	float    restore_headroom;
+	uint32_t restore_hold_us;
+};
+
+/// Why the level changed
+enum shed_reason {
+	SHED_DEADLINE_MISSES,   ///< stepped down for missed deadlines
+	SHED_LOW_HEADROOM,      ///< stepped down for lack of idle CPU
+	SHED_RESTORED,          ///< stepped up after the hold time
+	SHED_REASONS
+};
+
+/**
+ * @brief One change of level.
+ * @var time_us when it happened (us)
+ * @var from the level before
+ * @var to the level after
+ * @var reason why
+ * @var misses deadline misses in the window that decided it
+ * @var cycles control cycles in that window
+ * @var headroom mean idle CPU fraction in that window, or -1 if none was reported
+ */
+struct shed_event {
+	uint64_t    time_us;
+	uint8_t     from;
+	uint8_t     to;
+	shed_reason reason;
+	uint16_t    misses;
+	uint16_t    cycles;
+	float       headroom;
+};
+
+class load_shedder {
+public:
+	/**
+	 * @brief The constructor for a load_shedder at full quality.
+	 * @param config_in The deadline, levels and thresholds
+	 */
+	load_shedder(const load_shedder_config &config_in);
+
+	/**
+	 * @brief Reports one control cycle's command.
+	 * @param time_us When the command went out (us)
+	 * @param latency_us How long after its scan reached the Pi (us)
+	 */
+	void report_cycle(uint64_t time_us, uint32_t latency_us);
+
+	/**
+	 * @brief Reports how much of the CPU was idle lately.
+	 * @param time_us When it was measured (us)
+	 * @param headroom Idle fraction, from 0 to 1
+	 */
+	void report_headroom(uint64_t time_us, float headroom);
+
+	/**
+	 * @brief Sets a function called with every change of level, outside the lock.
+	 * Must be set before any reports.
+	 */
+	void set_logger(const std::function<void(const shed_event &)> &logger_in) { logger = logger_in; }
+
+	/// What the perception stages should do now; safe from any thread
+	const shed_settings &get_settings() const { return config.settings[level.load()]; }
+	/// The current level, 0 being full quality
+	uint8_t get_level() const { return level.load(); }
+
+	/**
+	 * @brief Copies the logged changes of level, oldest first.
+	 * @param out Where to copy them, room for SHED_LOG_SIZE
+	 * @return the number copied
+	 */
+	uint8_t get_log(shed_event *out) const;
+
+	/// Number of level changes for a reason since the start
+	uint32_t get_count(shed_reason reason) const;
+	/// Control cycles reported since the start
+	uint32_t get_cycles() const;
+	/// Deadline misses since the start
+	uint32_t get_misses() const;
+
+private:
+	load_shedder_config config;
+	std::atomic<uint8_t> level;
+	std::function<void(const shed_event &)> logger;
+
+	mutable std::mutex lock;
+	uint64_t window_start_us;
+	uint16_t window_cycles;
+	uint16_t window_misses;
+	float    window_headroom_sum;
+	uint16_t window_headroom_samples;
+	uint64_t good_since_us;         // start of the run of good windows, 0 if the last one was not
+
+	uint32_t cycles;
+	uint32_t misses;
+	uint32_t counts[SHED_REASONS];
+	shed_event log[SHED_LOG_SIZE];
+	uint8_t log_head;
+	uint8_t log_count;
+
+	bool judge(uint64_t time_us, bool window_over, shed_event &event);
+	void change_level(uint64_t time_us, uint8_t to, shed_reason reason, shed_event &event);
+	void start_window(uint64_t time_us);
+};
+
+/**
+ * The cpu_monitor measures how much of the CPU was idle between two samples, from the
+ * totals Linux keeps in /proc/stat.
+ */
+class cpu_monitor {
+public:
+	cpu_monitor();
+
+	/**
+	 * @brief Reads the CPU totals and works out the idle fraction since the last call.
+	 * @param headroom Set to the idle fraction, from 0 to 1
+	 * @return false on the first call, or if /proc/stat could not be read
+	 */
+	bool sample(float &headroom);
+
+private:
+	uint64_t last_idle;
+	uint64_t last_total;
+	bool primed;
+};
+
+
+#endif //ME507_LOAD_SHEDDER_H
@@ -0,0 +1,416 @@
+//
+// Model-predictive steering along a path; see mpc_steering.h.
+//
+
+#include <cmath>
+#include "mpc_steering.h"
+#include "host_clock.h"
+
+#define MIN_PLAN_SPEED 0.05f    // m/s the plan assumes at least, so the model never stalls
+#define MIN_SEGMENT 1e-6f       // m under which a path segment has no direction of its own
+#define MIN_ROW_NORM 1e-9f
+
+static float wrap_angle(float a)
+{
+	while (a > (float)M_PI)
+		a -= 2.0f * (float)M_PI;
+	while (a < -(float)M_PI)
+		a += 2.0f * (float)M_PI;
+	return a;
+}
+
+mpc_steering::mpc_steering(const truck_geometry &geometry_in, const mpc_config &config_in)
+		: solver(config_in.solver)
+{
+	geometry = geometry_in;
+	config = config_in;
+	if (config.horizon < 1)
+		config.horizon = 1;
+	else if (config.horizon > MPC_MAX_HORIZON)
+		config.horizon = MPC_MAX_HORIZON;
+	result = qp_result();
+	reset_stats();
+	reset();
+}
+
+void mpc_steering::reset()
+{
+	solver.reset();
+	planned = false;
+	last_curvature = 0.0f;
+	elapsed = 0.0f;
+	last_time_us = 0;
+	hitch_reference = 0.0f;
+}
+
+void mpc_steering::reset_stats()
+{
+	stats = mpc_stats();
+}
+
+float mpc_steering::steer(const control_input &in, const path_point *points, uint16_t count, uint16_t closest,
+                          bool reverse, float target)
+{
+	uint64_t start = host_time_us();
+	uint8_t N = config.horizon;
+	float dt = planned ? (in.time_us - last_time_us) * 1e-6f : 0.0f;
+	last_time_us = in.time_us;
+
+	float v = target;
+	if (fabsf(v) < MIN_PLAN_SPEED)
+		v = reverse ? -MIN_PLAN_SPEED : MIN_PLAN_SPEED;
+
+	float lateral, heading;
+	if (!path_reference(in, points, count, closest, reverse, fabsf(v) * config.step, lateral, heading))
+		return 0.0f;
+	for (uint8_t k = 0; k < N; k++)
+		steady_turn(reference_curvature[k], reverse, steady_curvature[k], steady_hitch[k]);
+	hitch_reference = steady_hitch[0];
+
+	float z0[MPC_STATES] = {lateral, heading, in.hitch_angle};
+	predict(z0, reverse, v);
+
+	// Start from the last plan, moved on by the steps that have gone by since
+	if (!config.warm_start) {
+		solver.reset();
+	}
+	else if (planned) {
+		elapsed += dt;
+		for (uint8_t k = 0; elapsed >= config.step && k < N; k++) {
+			solver.shift(1, config.hitch_limit > 0.0f ? 3 : 2);
+			elapsed -= config.step;
+		}
+		if (elapsed >= config.step)
+			elapsed = 0.0f;
+	}
+
+	build_problem(in.hitch_angle);
+	float max_rate = config.max_steer_rate / geometry.wheelbase;
+	if (planned && dt > 0.0f) {
+		problem.lower[N] = last_curvature - max_rate * dt;
+		problem.upper[N] = last_curvature + max_rate * dt;
+	}
+	result = solver.solve(problem);
+
+	// Keep to the limits even if the solve stopped short
+	float curvature = solver.get_x()[0];
+	for (uint8_t r = 0; r < 2 * N; r += N) {
+		if (curvature < problem.lower[r])
+			curvature = problem.lower[r];
+		else if (curvature > problem.upper[r])
+			curvature = problem.upper[r];
+	}
+	last_curvature = curvature;
+	planned = true;
+
+	uint32_t run_us = (uint32_t)(host_time_us() - start);
+	stats.solves++;
+	if (!result.converged)
+		stats.unconverged++;
+	stats.last_iterations = result.iterations;
+	if (result.iterations > stats.max_iterations)
+		stats.max_iterations = result.iterations;
+	stats.total_iterations += result.iterations;
+	stats.last_solve_us = run_us;
+	if (run_us > stats.max_solve_us)
+		stats.max_solve_us = run_us;
+	stats.total_solve_us += run_us;
+
+	return atanf(curvature * geometry.wheelbase);
+}
+
+/**
+ * Projects the tracked body onto the path next to the closest point, and finds the
+ * path's heading every distance_step from there on. The heading is taken as turning
+ * evenly from the middle of one segment to the middle of the next, so the path's
+ * curvature over a step is the heading change over the step divided by its length,
+ * however the steps fall against the points. Headings are unwrapped as the path is
+ * walked, so they never jump by 2 pi. The body's heading is that of the trailer when
+ * reversing, which points against the direction of travel along the path, so its
+ * reference heading is the path's turned by pi and its curvature is the path's negated.
+ */
+bool mpc_steering::path_reference(const control_input &in, const path_point *points, uint16_t count,
+                                  uint16_t closest, bool reverse, float distance_step, float &lateral,
+                                  float &heading)
+{
+	if (!points || count < 2)
+		return false;
+
+	float bx = in.x, by = in.y, body_heading = in.heading;
+	if (reverse) {
+		float hx = in.x - geometry.hitch_offset * cosf(in.heading);
+		float hy = in.y - geometry.hitch_offset * sinf(in.heading);
+		body_heading = in.heading + in.hitch_angle;
+		bx = hx - geometry.trailer_length * cosf(body_heading);
+		by = hy - geometry.trailer_length * sinf(body_heading);
+	}
+
+	// The nearer of the segments either side of the closest point
+	uint16_t seg = closest + 1 < count ? closest : count - 2;
+	float best = 1e30f, t_best = 0.0f;
+	uint16_t first = seg > 0 ? seg - 1 : seg;
+	for (uint16_t i = first; i <= seg; i++) {
+		float sx = points[i + 1].x - points[i].x, sy = points[i + 1].y - points[i].y;
+		float len2 = sx * sx + sy * sy;
+		float t = len2 > MIN_SEGMENT * MIN_SEGMENT ? ((bx - points[i].x) * sx + (by - points[i].y) * sy) / len2 : 0.0f;
+		if (t < 0.0f)
+			t = 0.0f;
+		else if (t > 1.0f)
+			t = 1.0f;
+		float dx = bx - points[i].x - t * sx, dy = by - points[i].y - t * sy;
+		float d2 = dx * dx + dy * dy;
+		if (d2 < best) {
+			best = d2;
+			seg = i;
+			t_best = t;
+		}
+	}
+
+	// Walk the midpoints from the segment before it, with s from the start of seg, so
+	// the first midpoint is behind the body; a is the midpoint at or behind s, b the next
+	uint16_t a = seg > 0 ? seg - 1 : seg;
+	float ax = points[a + 1].x - points[a].x, ay = points[a + 1].y - points[a].y;
+	float a_len = sqrtf(ax * ax + ay * ay);
+	float a_psi = atan2f(ay, ax);
+	float a_mid = a < seg ? -0.5f * a_len : 0.5f * a_len;
+	float b_len = 0.0f, b_psi = a_psi, b_mid = a_mid;
+	bool b_valid = false;
+
+	float seg_x = points[seg + 1].x - points[seg].x, seg_y = points[seg + 1].y - points[seg].y;
+	float seg_len = sqrtf(seg_x * seg_x + seg_y * seg_y);
+	float s = t_best * seg_len;
+	float path_heading[MPC_MAX_HORIZON + 1];
+	for (uint8_t k = 0; k <= config.horizon; k++, s += distance_step) {
+		while (true) {
+			if (!b_valid && a + 2 < count) {
+				float cx = points[a + 2].x - points[a + 1].x, cy = points[a + 2].y - points[a + 1].y;
+				b_len = sqrtf(cx * cx + cy * cy);
+				b_psi = b_len > MIN_SEGMENT ? a_psi + wrap_angle(atan2f(cy, cx) - a_psi) : a_psi;
+				b_mid = a_mid + 0.5f * (a_len + b_len);
+				b_valid = true;
+			}
+			if (!b_valid || s <= b_mid)
+				break;
+			a++;
+			a_len = b_len;
+			a_psi = b_psi;
+			a_mid = b_mid;
+			b_valid = false;
+		}
+		if (b_valid && s > a_mid && b_mid > a_mid)
+			path_heading[k] = a_psi + (b_psi - a_psi) * (s - a_mid) / (b_mid - a_mid);
+		else
+			path_heading[k] = a_psi;
+	}
+
+	for (uint8_t k = 0; k < config.horizon; k++) {
+		float curvature = (path_heading[k + 1] - path_heading[k]) / distance_step;
+		reference_curvature[k] = reverse ? -curvature : curvature;
+	}
+
+	float reference = (seg_len > MIN_SEGMENT ? atan2f(seg_y, seg_x) : path_heading[0]) + (reverse ? (float)M_PI : 0.0f);
+	float dx = bx - points[seg].x - t_best * seg_x, dy = by - points[seg].y - t_best * seg_y;
+	lateral = -sinf(reference) * dx + cosf(reference) * dy;
+	heading = wrap_angle(body_heading - (path_heading[0] + (reverse ? (float)M_PI : 0.0f)));
+	return true;
+}
+
+/**
+ * In a steady turn the tractor's rear axle, the fifth wheel and the trailer axle go
+ * round the same center, with the fifth wheel hitch_offset behind the axle and the
+ * trailer at right angles to its own radius. Driving forwards the tractor follows the
+ * path, so its curvature is the path's. Reversing the trailer does, at radius R_t, and
+ * the tractor's radius is then sqrt(R_t^2 + trailer_length^2 - hitch_offset^2). Either
+ * way the hitch angle holds still where sin h + a k cos h = -l k, with a the hitch
+ * offset, l the trailer length and k the tractor's curvature.
+ */
+void mpc_steering::steady_turn(float curvature, bool reverse, float &kappa, float &hitch) const
+{
+	float a = geometry.hitch_offset, l = geometry.trailer_length;
+	kappa = curvature;
+	if (reverse) {
+		float extra = l * l - a * a;
+		kappa = curvature / sqrtf(1.0f + (extra > 0.0f ? extra : 0.0f) * curvature * curvature);
+	}
+	float max_curvature = tanf(geometry.max_steer) / geometry.wheelbase;
+	if (kappa > max_curvature)
+		kappa = max_curvature;
+	else if (kappa < -max_curvature)
+		kappa = -max_curvature;
+
+	float s = -l * kappa / sqrtf(1.0f + a * a * kappa * kappa);
+	if (s > 1.0f)
+		s = 1.0f;
+	else if (s < -1.0f)
+		s = -1.0f;
+	hitch = asinf(s) - atanf(a * kappa);
+}
+
+/**
+ * With the tractor at speed v and curvature k, the hitch angle changes at
+ *   h' = v g(h, k),   g = -sin h / l - k (1 + a cos h / l)
+ * and the trailer turns at v p(h, k), p = -(sin h + a k cos h) / l. Driving forwards
+ * the tractor's errors change at e' = v eps and eps' = v (k - k_ref). Reversing, the
+ * trailer's do, at e' = v c eps, with c = cos h - a k sin h the trailer's speed over
+ * the tractor's, and eps' = v (p - c k_ref). Each step is linearized about its steady
+ * turn and taken forwards by one Euler step of length step:
+ *   z+ = z + T (A (z - z_op) + B (u - u_op) + f_op)
+ * The predicted states are then free + G u, built up step by step.
+ */
+void mpc_steering::predict(const float z0[MPC_STATES], bool reverse, float v)
+{
+	uint8_t N = config.horizon;
+	float a = geometry.hitch_offset, l = geometry.trailer_length, T = config.step;
+
+	for (uint8_t s = 0; s < MPC_STATES; s++) {
+		free[0][s] = z0[s];
+		for (uint8_t j = 0; j < N; j++)
+			G[0][s][j] = 0.0f;
+	}
+
+	for (uint8_t k = 0; k < N; k++) {
+		float h = steady_hitch[k], kappa = steady_curvature[k], ref = reference_curvature[k];
+		float ch = cosf(h), sh = sinf(h);
+		float g = -sh / l - kappa * (1.0f + a * ch / l);
+		float g_h = -ch / l + kappa * a * sh / l;
+		float g_k = -(1.0f + a * ch / l);
+
+		// A and B in the order lateral, heading, hitch; only these entries are not zero
+		float A_e_eps, A_eps_h, B_eps, f_eps;
+		if (!reverse) {
+			A_e_eps = v;
+			A_eps_h = 0.0f;
+			B_eps = v;
+			f_eps = v * (kappa - ref);
+		}
+		else {
+			float c = ch - a * kappa * sh;
+			float p = -(sh + a * kappa * ch) / l;
+			A_e_eps = v * c;
+			A_eps_h = v * (-ch + a * kappa * sh) / l;
+			B_eps = -v * a * ch / l;
+			f_eps = v * (p - c * ref);
+		}
+		float A_h_h = v * g_h, B_h = v * g_k, f_h = v * g;
+
+		// z_op = (0, 0, h) and u_op = kappa
+		const float *z = free[k];
+		free[k + 1][0] = z[0] + T * A_e_eps * z[1];
+		free[k + 1][1] = z[1] + T * (A_eps_h * (z[2] - h) - B_eps * kappa + f_eps);
+		free[k + 1][2] = z[2] + T * (A_h_h * (z[2] - h) - B_h * kappa + f_h);
+		for (uint8_t j = 0; j < k; j++) {
+			float e = G[k][0][j], eps = G[k][1][j], hh = G[k][2][j];
+			G[k + 1][0][j] = e + T * A_e_eps * eps;
+			G[k + 1][1][j] = eps + T * A_eps_h * hh;
+			G[k + 1][2][j] = hh + T * A_h_h * hh;
+		}
+		G[k + 1][0][k] = 0.0f;
+		G[k + 1][1][k] = T * B_eps;
+		G[k + 1][2][k] = T * B_h;
+		for (uint8_t j = k + 1; j < N; j++) {
+			G[k + 1][0][j] = 0.0f;
+			G[k + 1][1][j] = 0.0f;
+			G[k + 1][2][j] = 0.0f;
+		}
+	}
+}
+
+/**
+ * The cost is, over the horizon,
+ *   1/2 sum (z_k - r_k)' Q (z_k - r_k) + 1/2 w_k (u_k - k_op)^2 + 1/2 w_r (u_k - u_k-1)^2
+ * with r_k = (0, 0, steady hitch) and Q counted terminal_weight times at the end. With
+ * z_k = free_k + G_k u this is 1/2 u' P u + q' u for
+ *   P = sum G_k' Q G_k + w_k I + w_r D' D,   q = sum G_k' Q (free_k - r_k) - w_k k_op - ...
+ * where the change of the first step is from the curvature last applied. The rows of C
+ * are the curvatures themselves, their changes from step to step and, if there is a
+ * hitch limit, the predicted hitch angles scaled to unit norm. The hitch limit is
+ * widened to the hitch angle now if that is already past it, so the problem stays
+ * feasible while the plan pulls it back in.
+ */
+void mpc_steering::build_problem(float hitch_now)
+{
+	uint8_t N = config.horizon;
+	problem.n = N;
+	problem.m = config.hitch_limit > 0.0f ? 3 * N : 2 * N;
+
+	for (uint8_t i = 0; i < N; i++) {
+		for (uint8_t j = 0; j <= i; j++)
+			problem.P[i][j] = 0.0f;
+		problem.q[i] = 0.0f;
+	}
+
+	for (uint8_t k = 1; k <= N; k++) {
+		float scale = k == N ? config.terminal_weight : 1.0f;
+		float Q[MPC_STATES] = {scale * config.lateral_weight, scale * config.heading_weight,
+		                       scale * config.hitch_weight};
+		float error[MPC_STATES] = {free[k][0], free[k][1], free[k][2] - steady_hitch[k - 1]};
+		for (uint8_t s = 0; s < MPC_STATES; s++) {
+			if (Q[s] == 0.0f)
+				continue;
+			const float *g = G[k][s];
+			for (uint8_t i = 0; i < k; i++) {
+				float qg = Q[s] * g[i];
+				problem.q[i] += qg * error[s];
+				for (uint8_t j = 0; j <= i; j++)
+					problem.P[i][j] += qg * g[j];
+			}
+		}
+	}
+
+	for (uint8_t i = 0; i < N; i++) {
+		problem.P[i][i] += config.curvature_weight + config.rate_weight;
+		problem.q[i] -= config.curvature_weight * steady_curvature[i];
+		if (i > 0) {
+			problem.P[i - 1][i - 1] += config.rate_weight;
+			problem.P[i][i - 1] -= config.rate_weight;
+		}
+	}
+	if (planned)
+		problem.q[0] -= config.rate_weight * last_curvature;
+	else
+		problem.P[0][0] -= config.rate_weight;
+
+	float max_curvature = tanf(geometry.max_steer) / geometry.wheelbase;
+	float max_change = config.max_steer_rate / geometry.wheelbase * config.step;
+	for (uint8_t r = 0; r < problem.m; r++)
+		for (uint8_t j = 0; j < N; j++)
+			problem.C[r][j] = 0.0f;
+	for (uint8_t i = 0; i < N; i++) {
+		problem.C[i][i] = 1.0f;
+		problem.lower[i] = -max_curvature;
+		problem.upper[i] = max_curvature;
+
+		problem.C[N + i][i] = 1.0f;
+		if (i > 0) {
+			problem.C[N + i][i - 1] = -1.0f;
+			problem.lower[N + i] = -max_change;
+			problem.upper[N + i] = max_change;
+		}
+		else {
+			// Set against the curvature last applied by steer(), if there is one
+			problem.lower[N] = -QP_INFINITY;
+			problem.upper[N] = QP_INFINITY;
+		}
+	}
+
+	if (config.hitch_limit <= 0.0f)
+		return;
+	float limit = fabsf(hitch_now) > config.hitch_limit ? fabsf(hitch_now) : config.hitch_limit;
+	for (uint8_t i = 0; i < N; i++) {
+		uint8_t r = 2 * N + i;
+		const float *g = G[i + 1][2];
+		float norm = 0.0f;
+		for (uint8_t j = 0; j <= i; j++)
+			norm += g[j] * g[j];
+		norm = sqrtf(norm);
+		if (norm < MIN_ROW_NORM) {
+			problem.lower[r] = -QP_INFINITY;
+			problem.upper[r] = QP_INFINITY;
+			continue;
+		}
+		for (uint8_t j = 0; j <= i; j++)
+			problem.C[r][j] = g[j] / norm;
+		problem.lower[r] = (-limit - free[i + 1][2]) / norm;
+		problem.upper[r] = (limit - free[i + 1][2]) / norm;
+	}
+}
@@ -0,0 +1,153 @@
+/**
+ * The mpc_steering is a model-predictive steering controller the control_loop can use
+ * in place of pure pursuit. Pure pursuit looks at one goal point, so it cuts corners,
+ * reacts to a bend only once it is in it, and knows nothing about the servo's limits or
+ * about the trailer. The MPC plans the steering over the next horizon steps instead,
+ * against a linear model of the whole truck along the path ahead, and applies the first
+ * step of the plan, replanning every control period.
+ *
+ * The model's state is the lateral and heading error of the tracked body against the
+ * path (the tractor driving forwards, the trailer reversing) and the hitch angle; its
+ * input is the tractor's path curvature. At each step of the horizon it is linearized
+ * about the steady turn that follows the path's curvature there, at the speed the
+ * control_loop is aiming for, so the curvature of the path, the speed and the trailer's
+ * response are all in the same plan. The plan is bounded by the steering limit, by how
+ * fast the servo can move, and by a hitch angle limit that keeps the trailer from
+ * jackknifing.
+ *
+ * The states are eliminated, leaving a quadratic program in the horizon curvatures only,
+ * which a qp_solver solves with no allocation. The solver starts from the last plan,
+ * moved on by one step whenever a step's worth of time has gone by, so in steady
+ * driving it needs only a few iterations. Every solve is timed and its iterations kept.
+ */
+
+#ifndef ME507_MPC_STEERING_H
+#define ME507_MPC_STEERING_H
+
+#include <cstdint>
+#include "control_loop.h"
+#include "qp_solver.h"
+
+/// Most steps the horizon may have
+#define MPC_MAX_HORIZON QP_MAX_VARIABLES
+/// Lateral error, heading error and hitch angle
+#define MPC_STATES 3
+
+/**
+ * @brief Settings of an mpc_steering.
+ * @var horizon steps planned ahead, at most MPC_MAX_HORIZON
+ * @var step time between steps of the plan (s); a few control periods
+ * @var lateral_weight cost of lateral error (1/m^2)
+ * @var heading_weight cost of heading error (1/rad^2)
+ * @var hitch_weight cost of the hitch angle's distance from its steady value (1/rad^2)
+ * @var terminal_weight how many times the state costs are counted at the last step
+ * @var curvature_weight cost of steering away from the path's own curvature (m^2)
+ * @var rate_weight cost of a change of curvature from one step to the next (m^2)
+ * @var max_steer_rate fastest the servo moves the front wheels (rad/s)
+ * @var hitch_limit largest hitch angle the plan may reach (rad); 0 for no limit
+ * @var warm_start true to start each solve from the last plan, false to start from zero
+ * @var solver settings of the qp_solver
+ */
+struct mpc_config {
+	uint8_t     horizon;
+	float       step;
+	float       lateral_weight;
+	float       heading_weight;
+	float       hitch_weight;
+	float       terminal_weight;
+	float       curvature_weight;
+	float       rate_weight;
+	float       max_steer_rate;
+	float       hitch_limit;
+	bool        warm_start;
+	qp_settings solver;
+};
+
+/**
+ * @brief Counters kept over the solves since the last reset_stats().
+ * @var solves solves run
+ * @var unconverged solves that stopped at max_iterations
+ * @var last_iterations iterations of the last solve
+ * @var max_iterations most iterations of any solve
+ * @var total_iterations iterations of all solves together
+ * @var last_solve_us run time of the last solve, setting up the problem included (us)
+ * @var max_solve_us longest run time of any solve (us)
+ * @var total_solve_us run time of all solves together (us)
+ */
+struct mpc_stats {
+	uint32_t solves;
+	uint32_t unconverged;
+	uint16_t last_iterations;
+	uint16_t max_iterations;
+	uint64_t total_iterations;
+	uint32_t last_solve_us;
+	uint32_t max_solve_us;
+	uint64_t total_solve_us;
+};
+
+class mpc_steering {
+public:
+	/**
+	 * @brief The constructor for an mpc_steering with no plan yet.
+	 * @param geometry_in The dimensions of the truck
+	 * @param config_in The controller settings
+	 */
+	mpc_steering(const truck_geometry &geometry_in, const mpc_config &config_in);
+
+	/**
+	 * @brief Forgets the last plan, for a new path. The counters are kept.
+	 */
+	void reset();
+
+	/**
+	 * @brief Plans the steering from the truck's current state and returns its first step.
+	 * @param in The current state of the truck
+	 * @param points The path being followed
+	 * @param count The number of points in the path
+	 * @param closest Index of the path point nearest the tracked body
+	 * @param reverse true if the trailer is being backed along the path
+	 * @param target The speed being aimed for (m/s, negative in reverse)
+	 * @return the front wheel angle to steer (rad)
+	 */
+	float steer(const control_input &in, const path_point *points, uint16_t count, uint16_t closest,
+	            bool reverse, float target);
+
+	/// Hitch angle of the steady turn the path calls for at the truck (rad)
+	float get_hitch_reference() const { return hitch_reference; }
+	/// How the last solve went
+	const qp_result &get_result() const { return result; }
+	const mpc_stats &get_stats() const { return stats; }
+	void reset_stats();
+	const mpc_config &get_config() const { return config; }
+
+private:
+	truck_geometry geometry;
+	mpc_config config;
+	qp_solver solver;
+	qp_problem problem;
+	qp_result result;
+	mpc_stats stats;
+
+	bool planned;               // true once there is a last plan to start from
+	float last_curvature;       // 1/m, the curvature last applied
+	float elapsed;              // s since the plan was last moved on by a step
+	uint64_t last_time_us;
+	float hitch_reference;
+
+	// Path curvature in the body's terms, steady input and hitch angle at each step
+	float reference_curvature[MPC_MAX_HORIZON];
+	float steady_curvature[MPC_MAX_HORIZON];
+	float steady_hitch[MPC_MAX_HORIZON];
+	// Each predicted state is free + G u: its response with no input and to each input
+	float free[MPC_MAX_HORIZON + 1][MPC_STATES];
+	float G[MPC_MAX_HORIZON + 1][MPC_STATES][MPC_MAX_HORIZON];
+
+	bool path_reference(const control_input &in, const path_point *points, uint16_t count, uint16_t closest,
+	                    bool reverse, float distance_step, float &lateral, float &heading);
+	void steady_turn(float curvature, bool reverse, float &kappa, float &hitch) const;
+	void predict(const float z0[MPC_STATES], bool reverse, float v);
+	void build_problem(float hitch_now);
+};
+
+
+#endif //ME507_MPC_STEERING_H
@@ -0,0 +1,167 @@
+//
+// Occupancy grid map of the yard; see occupancy_grid.h.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "occupancy_grid.h"
+
+occupancy_grid::occupancy_grid(uint16_t width_in, uint16_t height_in, float resolution_in,
+                               float origin_x_in, float origin_y_in)
+{
+	width = width_in;
+	height = height_in;
+	resolution = resolution_in;
+	origin_x = origin_x_in;
+	origin_y = origin_y_in;
+	cells.assign((size_t)width * height, CELL_FREE);
+}
+
+bool occupancy_grid::world_to_cell(float x, float y, int32_t &cx, int32_t &cy) const
+{
+	cx = (int32_t)floorf((x - origin_x) / resolution);
+	cy = (int32_t)floorf((y - origin_y) / resolution);
+	return contains(cx, cy);
+}
+
+void occupancy_grid::fill_rect(float x0, float y0, float x1, float y1, uint8_t value)
+{
+	int32_t cx0, cy0, cx1, cy1;
+	world_to_cell(x0 + resolution / 2, y0 + resolution / 2, cx0, cy0);
+	world_to_cell(x1 - resolution / 2, y1 - resolution / 2, cx1, cy1);
+	for (int32_t cy = cy0 > 0 ? cy0 : 0; cy <= cy1 && cy < height; cy++)
+		for (int32_t cx = cx0 > 0 ? cx0 : 0; cx <= cx1 && cx < width; cx++)
+			set(cx, cy, value);
+}
+
+/**
+ * Walks the cells the ray passes through in order (Amanatides and Woo), so no obstacle
+ * cell can be stepped over however thin it is.
+ */
+float occupancy_grid::raycast(float x, float y, float angle, float max_range) const
+{
+	int32_t cx, cy;
+	world_to_cell(x, y, cx, cy);
+	if (contains(cx, cy) && is_obstacle(get(cx, cy)))
+		return 0.0f;
+
+	float dx = cosf(angle), dy = sinf(angle);
+	int32_t step_x = dx > 0.0f ? 1 : -1;
+	int32_t step_y = dy > 0.0f ? 1 : -1;
+
+	// Distance along the ray to the next vertical and horizontal cell boundary
+	float gx = (x - origin_x) / resolution, gy = (y - origin_y) / resolution;
+	float next_x = dx > 0.0f ? (cx + 1 - gx) : (gx - cx);
+	float next_y = dy > 0.0f ? (cy + 1 - gy) : (gy - cy);
+	float delta_x = fabsf(dx) > 1e-9f ? 1.0f / fabsf(dx) : 1e30f;
+	float delta_y = fabsf(dy) > 1e-9f ? 1.0f / fabsf(dy) : 1e30f;
+	float t_x = next_x * delta_x, t_y = next_y * delta_y;
+	float t_max = max_range / resolution;
+
+	for (;;) {
+		float t;
+		if (t_x < t_y) {
+			t = t_x;
+			t_x += delta_x;
+			cx += step_x;
+		}
+		else {
+			t = t_y;
+			t_y += delta_y;
+			cy += step_y;
+		}
+		if (t >= t_max)
+			return max_range;
+		if (!contains(cx, cy)) {
+			// Past the edge of the map nothing more can be hit
+			if ((step_x > 0 ? cx >= width : cx < 0) || (step_y > 0 ? cy >= height : cy < 0))
+				return max_range;
+			continue;
+		}
+		if (is_obstacle(get(cx, cy)))
+			return t * resolution;
+	}
+}
+
+/**
+ * The squared distance map of the whole grid, then its square root in meters. Cells of
+ * a grid with no obstacles at all are given the grid's width plus its height.
+ */
+void occupancy_grid::compute_distance(std::vector<float> &distance, bool unknown_is_obstacle) const
+{
+	distance.resize((size_t)width * height);
+	for (uint32_t i = 0; i < (uint32_t)width * height; i++) {
+		bool blocked = is_obstacle(cells[i]) || (unknown_is_obstacle && cells[i] == CELL_UNKNOWN);
+		distance[i] = blocked ? 0.0f : DISTANCE_FAR;
+	}
+
+	distance_scratch scratch;
+	distance_transform(&distance[0], width, height, scratch);
+	float far = (width + height) * resolution;
+	for (uint32_t i = 0; i < (uint32_t)width * height; i++)
+		distance[i] = std::min(sqrtf(distance[i]) * resolution, far);
+}
+
+/**
+ * The lower envelope of the parabolas (q - i)^2 + f(i) rooted at every i, worked out in
+ * one pass and then read off in another (Felzenszwalb and Huttenlocher). Parabolas are
+ * added left to right; any that the new one undercuts everywhere right of where it
+ * took over are dropped, so each is added and dropped at most once.
+ */
+static void transform_line(const float *f, float *d, uint32_t n, int32_t *parabolas, float *bounds)
+{
+	uint32_t k = 0;
+	parabolas[0] = 0;
+	bounds[0] = -INFINITY;
+	bounds[1] = INFINITY;
+	for (uint32_t q = 1; q < n; q++) {
+		float s;
+		for (;;) {
+			int32_t v = parabolas[k];
+			s = ((f[q] + (float)q * q) - (f[v] + (float)v * v)) / (2.0f * q - 2.0f * v);
+			if (s > bounds[k] || k == 0)
+				break;
+			k--;
+		}
+		if (s <= bounds[k])
+			s = bounds[k];
+		k++;
+		parabolas[k] = (int32_t)q;
+		bounds[k] = s;
+		bounds[k + 1] = INFINITY;
+	}
+	k = 0;
+	for (uint32_t q = 0; q < n; q++) {
+		while (bounds[k + 1] < (float)q)
+			k++;
+		float offset = (float)q - parabolas[k];
+		d[q] = offset * offset + f[parabolas[k]];
+	}
+}
+
+/**
+ * A squared Euclidean distance separates into a sum over the axes, so the transform is
+ * one along every column followed by one along every row of the result.
+ */
+void occupancy_grid::distance_transform(float *squared, uint32_t columns, uint32_t rows, distance_scratch &scratch)
+{
+	uint32_t longest = std::max(columns, rows);
+	scratch.line.resize(longest);
+	scratch.result.resize(longest);
+	scratch.bounds.resize(longest + 1);
+	scratch.parabolas.resize(longest);
+	float *line = &scratch.line[0], *result = &scratch.result[0];
+
+	for (uint32_t x = 0; x < columns; x++) {
+		for (uint32_t y = 0; y < rows; y++)
+			line[y] = squared[y * columns + x];
+		transform_line(line, result, rows, &scratch.parabolas[0], &scratch.bounds[0]);
+		for (uint32_t y = 0; y < rows; y++)
+			squared[y * columns + x] = result[y];
+	}
+	for (uint32_t y = 0; y < rows; y++) {
+		float *row = squared + (size_t)y * columns;
+		std::copy(row, row + columns, line);
+		transform_line(line, row, columns, &scratch.parabolas[0], &scratch.bounds[0]);
+	}
+}
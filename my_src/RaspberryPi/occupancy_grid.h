@@ -0,0 +1,138 @@
+/**
+ * The occupancy_grid is a 2D map of the yard: a row-major array of cells, each holding
+ * how likely it is to be occupied, on a fixed square grid placed in the world frame.
+ * Cell (0, 0) is the cell whose lower left corner is at the origin, x increases along
+ * a row and y from row to row. It is the prior map the localization scores scans
+ * against, and the base layer for anything that plans around obstacles.
+ */
+
+#ifndef ME507_OCCUPANCY_GRID_H
+#define ME507_OCCUPANCY_GRID_H
+
+#include <cstdint>
+#include <vector>
+
+/// Cell value of free space
+#define CELL_FREE 0
+/// Cell value of a certain obstacle; values in between are degrees of belief
+#define CELL_OCCUPIED 100
+/// Cell value of space nothing is known about
+#define CELL_UNKNOWN 255
+/// Cells at or above this value (and below CELL_UNKNOWN) count as obstacles
+#define CELL_OBSTACLE_THRESHOLD 50
+/// Squared distance distance_transform() gives cells with no obstacle anywhere
+#define DISTANCE_FAR 1e20f
+
+/**
+ * @brief Buffers for occupancy_grid::distance_transform(), kept between calls so that
+ * transforming many blocks does not allocate.
+ */
+struct distance_scratch {
+	std::vector<float> line;
+	std::vector<float> result;
+	std::vector<float> bounds;
+	std::vector<int32_t> parabolas;
+};
+
+class occupancy_grid {
+public:
+	/**
+	 * @brief The constructor for a grid of free cells.
+	 * @param width_in Number of cells along x
+	 * @param height_in Number of cells along y
+	 * @param resolution_in Side of one cell (m)
+	 * @param origin_x_in World x of the grid's lower left corner (m)
+	 * @param origin_y_in World y of the grid's lower left corner (m)
+	 */
+	occupancy_grid(uint16_t width_in, uint16_t height_in, float resolution_in,
+	               float origin_x_in, float origin_y_in);
+
+	/**
+	 * @brief Finds the cell that holds a world point.
+	 * @param x World x (m)
+	 * @param y World y (m)
+	 * @param cx Set to the cell's column, even if it is outside the grid
+	 * @param cy Set to the cell's row, even if it is outside the grid
+	 * @return true if the cell is inside the grid
+	 */
+	bool world_to_cell(float x, float y, int32_t &cx, int32_t &cy) const;
+
+	/**
+	 * @brief Checks whether a cell is inside the grid.
+	 */
+	bool contains(int32_t cx, int32_t cy) const
+	{
+		return cx >= 0 && cy >= 0 && cx < width && cy < height;
+	}
+
+	/// The value of a cell, which must be inside the grid
+	uint8_t get(int32_t cx, int32_t cy) const { return cells[(uint32_t)cy * width + cx]; }
+	/// Sets the value of a cell, which must be inside the grid
+	void set(int32_t cx, int32_t cy, uint8_t value) { cells[(uint32_t)cy * width + cx] = value; }
+
+	/// True if a cell value counts as an obstacle
+	static bool is_obstacle(uint8_t value)
+	{
+		return value >= CELL_OBSTACLE_THRESHOLD && value != CELL_UNKNOWN;
+	}
+
+	/**
+	 * @brief Sets every cell whose center is inside a world rectangle.
+	 * @param x0 Lowest x (m)
+	 * @param y0 Lowest y (m)
+	 * @param x1 Highest x (m)
+	 * @param y1 Highest y (m)
+	 * @param value The cell value
+	 */
+	void fill_rect(float x0, float y0, float x1, float y1, uint8_t value);
+
+	/**
+	 * @brief Follows a ray through the grid to the first obstacle cell.
+	 * @param x World x of the ray's start (m)
+	 * @param y World y of the ray's start (m)
+	 * @param angle Direction of the ray in the world frame (rad)
+	 * @param max_range Longest distance to follow the ray (m)
+	 * @return the distance to the obstacle, or max_range if there is none in range or
+	 * the ray leaves the grid first
+	 */
+	float raycast(float x, float y, float angle, float max_range) const;
+
+	/**
+	 * @brief Works out the exact Euclidean distance from every cell's center to the
+	 * center of the nearest obstacle cell.
+	 * @param distance Resized to one value per cell, row-major like the cells (m)
+	 * @param unknown_is_obstacle true to count unknown cells as obstacles, as a planner
+	 * should
+	 */
+	void compute_distance(std::vector<float> &distance, bool unknown_is_obstacle = false) const;
+
+	/**
+	 * @brief Exact squared Euclidean distance transform of a block of values, in time
+	 * linear in its size.
+	 * @param squared Row-major block; on entry 0 at obstacles and DISTANCE_FAR elsewhere,
+	 * on return the squared distance in cells to the nearest obstacle, or about
+	 * DISTANCE_FAR if the block has none
+	 * @param columns Values in a row
+	 * @param rows Number of rows
+	 * @param scratch Buffers to work in
+	 */
+	static void distance_transform(float *squared, uint32_t columns, uint32_t rows, distance_scratch &scratch);
+
+	uint16_t get_width() const { return width; }
+	uint16_t get_height() const { return height; }
+	float get_resolution() const { return resolution; }
+	float get_origin_x() const { return origin_x; }
+	float get_origin_y() const { return origin_y; }
+	const uint8_t *data() const { return &cells[0]; }
+
+private:
+	uint16_t width;
+	uint16_t height;
+	float resolution;
+	float origin_x;
+	float origin_y;
+	std::vector<uint8_t> cells;
+};
+
+
+#endif //ME507_OCCUPANCY_GRID_H
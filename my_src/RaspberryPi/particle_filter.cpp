@@ -0,0 +1,208 @@
+//
+// Monte Carlo localization against a prior map; see particle_filter.h.
+//
+
+#include <cmath>
+#include "particle_filter.h"
+
+particle_filter::particle_filter(const likelihood_field &field_in, const particle_filter_config &config_in)
+		: field(field_in), rng(config_in.seed), normal(0.0f, 1.0f), uniform(0.0f, 1.0f)
+{
+	config = config_in;
+	if (config.particles == 0)
+		config.particles = 1;
+	if (config.beam_stride == 0)
+		config.beam_stride = 1;
+	if (config.grain == 0)
+		config.grain = 1;
+	count = config.particles;
+
+	x.assign(count, 0.0f);
+	y.assign(count, 0.0f);
+	heading.assign(count, 0.0f);
+	weight.assign(count, 1.0f / count);
+	score.assign(count, 0.0f);
+	next_x.assign(count, 0.0f);
+	next_y.assign(count, 0.0f);
+	next_heading.assign(count, 0.0f);
+	beam_x.assign(LIDAR_MAX_POINTS, 0.0f);
+	beam_y.assign(LIDAR_MAX_POINTS, 0.0f);
+	beam_count = 0;
+
+	moved_distance = 0.0f;
+	moved_angle = 0.0f;
+	effective_count = (float)count;
+	resample_count = 0;
+}
+
+void particle_filter::init(float x0, float y0, float heading0, float position_spread, float heading_spread)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		x[i] = x0 + position_spread * normal(rng);
+		y[i] = y0 + position_spread * normal(rng);
+		heading[i] = heading0 + heading_spread * normal(rng);
+		weight[i] = 1.0f / count;
+	}
+	moved_distance = 0.0f;
+	moved_angle = 0.0f;
+	effective_count = (float)count;
+}
+
+/**
+ * Odometry motion model: each particle drives the measured distance along the mean of
+ * its old and new heading, with the distance and the turn each disturbed by noise
+ * proportional to how far the truck drove and turned.
+ */
+void particle_filter::predict(float distance, float turn)
+{
+	float abs_d = fabsf(distance), abs_t = fabsf(turn);
+	float rot_sigma = config.rot_per_rot * abs_t + config.rot_per_trans * abs_d;
+	float trans_sigma = config.trans_per_trans * abs_d + config.trans_per_rot * abs_t;
+
+	for (uint32_t i = 0; i < count; i++) {
+		float t = turn + rot_sigma * normal(rng);
+		float d = distance + trans_sigma * normal(rng);
+		float mid = heading[i] + t / 2;
+		x[i] += d * cosf(mid);
+		y[i] += d * sinf(mid);
+		heading[i] += t;
+	}
+
+	moved_distance += abs_d;
+	moved_angle += abs_t;
+}
+
+bool particle_filter::update(const lidar_scan &scan, work_pool *pool)
+{
+	if (moved_distance < config.update_distance && moved_angle < config.update_angle)
+		return false;
+	moved_distance = 0.0f;
+	moved_angle = 0.0f;
+
+	// The beam end points relative to the LiDAR are the same for every particle, so
+	// they are worked out once; each particle then only has to rotate and shift them
+	beam_count = 0;
+	for (uint16_t i = 0; i < scan.count; i += config.beam_stride) {
+		if (!scan_point_is_obstacle(scan, i))
+			continue;
+		float angle = config.sensor_yaw + scan.angle_min + i * scan.angle_increment;
+		beam_x[beam_count] = config.sensor_x + scan.ranges[i] * cosf(angle);
+		beam_y[beam_count] = config.sensor_y + scan.ranges[i] * sinf(angle);
+		beam_count++;
+	}
+	if (beam_count == 0)
+		return false;
+
+	if (pool && pool->size() > 1 && count > config.grain)
+		pool->parallel_for(count, config.grain, [this](size_t begin, size_t end) { score_range(begin, end); });
+	else
+		score_range(0, count);
+
+	// Multiply the weights by the scan likelihood, shifted by the best score so the
+	// exponentials cannot underflow all at once
+	float best = score[0];
+	for (uint32_t i = 1; i < count; i++)
+		if (score[i] > best)
+			best = score[i];
+	float total = 0.0f;
+	for (uint32_t i = 0; i < count; i++) {
+		weight[i] *= expf(score[i] - best);
+		total += weight[i];
+	}
+	if (!(total > 0.0f)) {
+		// Every particle with any weight left scored far below the best one
+		for (uint32_t i = 0; i < count; i++)
+			weight[i] = expf(score[i] - best);
+		total = 0.0f;
+		for (uint32_t i = 0; i < count; i++)
+			total += weight[i];
+	}
+
+	float sum_sq = 0.0f;
+	for (uint32_t i = 0; i < count; i++) {
+		weight[i] /= total;
+		sum_sq += weight[i] * weight[i];
+	}
+	effective_count = 1.0f / sum_sq;
+
+	if (effective_count < config.resample_ratio * count)
+		resample(count);
+	return true;
+}
+
+void particle_filter::score_range(size_t begin, size_t end)
+{
+	const float *bx = &beam_x[0];
+	const float *by = &beam_y[0];
+	for (size_t i = begin; i < end; i++) {
+		float c = cosf(heading[i]), s = sinf(heading[i]);
+		float px = x[i], py = y[i];
+		float sum = 0.0f;
+		for (uint16_t k = 0; k < beam_count; k++)
+			sum += field.log_likelihood(px + c * bx[k] - s * by[k], py + s * bx[k] + c * by[k]);
+		score[i] = config.beam_weight * sum;
+	}
+}
+
+void particle_filter::set_particle_count(uint32_t particles)
+{
+	if (particles == 0)
+		particles = 1;
+	if (particles > config.particles)
+		particles = config.particles;
+	if (particles != count)
+		resample(particles);
+}
+
+/**
+ * Low-variance resampling: one random offset, then new_count evenly spaced pointers
+ * into the running sum of the weights. A particle with weight w is copied new_count * w
+ * times give or take one, in a single pass and with no random draws per particle.
+ */
+void particle_filter::resample(uint32_t new_count)
+{
+	float step = 1.0f / new_count;
+	float u = uniform(rng) * step;
+	float cumulative = weight[0];
+	uint32_t source = 0;
+	for (uint32_t i = 0; i < new_count; i++) {
+		while (u > cumulative && source + 1 < count)
+			cumulative += weight[++source];
+		next_x[i] = x[source];
+		next_y[i] = y[source];
+		next_heading[i] = heading[source];
+		u += step;
+	}
+
+	x.swap(next_x);
+	y.swap(next_y);
+	heading.swap(next_heading);
+	count = new_count;
+	for (uint32_t i = 0; i < count; i++)
+		weight[i] = step;
+	resample_count++;
+}
+
+pose_estimate particle_filter::get_estimate() const
+{
+	double sx = 0.0, sy = 0.0, sc = 0.0, ss = 0.0;
+	for (uint32_t i = 0; i < count; i++) {
+		sx += weight[i] * x[i];
+		sy += weight[i] * y[i];
+		sc += weight[i] * cosf(heading[i]);
+		ss += weight[i] * sinf(heading[i]);
+	}
+
+	pose_estimate est;
+	est.x = (float)sx;
+	est.y = (float)sy;
+	est.heading = (float)atan2(ss, sc);
+
+	double var = 0.0;
+	for (uint32_t i = 0; i < count; i++) {
+		float dx = x[i] - est.x, dy = y[i] - est.y;
+		var += weight[i] * (dx * dx + dy * dy);
+	}
+	est.spread = (float)sqrt(var);
+	return est;
+}
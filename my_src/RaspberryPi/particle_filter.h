@@ -0,0 +1,197 @@
+/**
+ * The particle_filter localizes the truck in a prior map of the yard by Monte Carlo
+ * localization. Each particle is a guess of the tractor's pose (the middle of the rear
+ * axle and the heading); the guesses are moved by the odometry with added noise, then
+ * weighed by how well the LiDAR scan seen from each of them fits the map, and redrawn
+ * in proportion to those weights once too few of them carry most of the weight.
+ *
+ * The particles are kept as separate arrays of x, y, heading and weight rather than an
+ * array of structures, so the scoring loop streams through exactly the data it needs.
+ * Scoring uses a likelihood_field, so every beam costs one table lookup, and particles
+ * are scored in chunks on a work_pool. All arrays are sized once in the constructor
+ * for the configured particle count; predicting, scoring, resampling and running with
+ * fewer particles never allocate.
+ *
+ * Headings are counterclockwise from the world x axis (rad), as in control_input.
+ */
+
+#ifndef ME507_PARTICLE_FILTER_H
+#define ME507_PARTICLE_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "lidar_scan.h"
+#include "likelihood_field.h"
+#include "work_pool.h"
+
+/**
+ * @brief Settings of the particle filter.
+ * @var particles number of particles
+ * @var rot_per_rot heading noise per radian turned (rad/rad)
+ * @var rot_per_trans heading noise per meter driven (rad/m)
+ * @var trans_per_trans distance noise per meter driven (m/m)
+ * @var trans_per_rot distance noise per radian turned (m/rad)
+ * @var beam_stride only every beam_stride-th ray of a scan is scored
+ * @var beam_weight scale on each beam's log-likelihood; below 1 it makes up for
+ * neighboring beams not being independent, which would otherwise make the weights
+ * far too confident
+ * @var sensor_x x of the LiDAR ahead of the rear axle (m)
+ * @var sensor_y y of the LiDAR to the left of the tractor's center line (m)
+ * @var sensor_yaw angle of the LiDAR's x axis from the tractor's (rad)
+ * @var update_distance distance to drive between scans that are scored (m)
+ * @var update_angle angle to turn between scans that are scored (rad)
+ * @var resample_ratio resample once the effective number of particles falls below
+ * this fraction of the particle count
+ * @var grain particles scored in each chunk handed to a worker
+ * @var seed seed for the motion noise and resampling
+ */
+struct particle_filter_config {
+	uint32_t particles;
+	float    rot_per_rot;
+	float    rot_per_trans;
+	float    trans_per_trans;
+	float    trans_per_rot;
+	uint16_t beam_stride;
+	float    beam_weight;
+	float    sensor_x;
+	float    sensor_y;
+	float    sensor_yaw;
+	float    update_distance;
+	float    update_angle;
+	float    resample_ratio;
+	size_t   grain;
+	uint32_t seed;
+};
+
+/**
+ * @brief The filter's estimate of the tractor's pose.
+ * @var x weighted mean x of the rear axle (m)
+ * @var y weighted mean y of the rear axle (m)
+ * @var heading weighted circular mean heading (rad)
+ * @var spread weighted RMS distance of the particles from (x, y) (m)
+ */
+struct pose_estimate {
+	float x;
+	float y;
+	float heading;
+	float spread;
+};
+
+class particle_filter {
+public:
+	/**
+	 * @brief The constructor for a particle_filter; allocates every array it will use.
+	 * @param field_in The map's likelihood field, which must outlive the filter
+	 * @param config_in The filter settings
+	 */
+	particle_filter(const likelihood_field &field_in, const particle_filter_config &config_in);
+
+	/**
+	 * @brief Scatters the particles around a known pose with equal weights.
+	 * @param x Rear axle x (m)
+	 * @param y Rear axle y (m)
+	 * @param heading Heading (rad)
+	 * @param position_spread Standard deviation of the position (m)
+	 * @param heading_spread Standard deviation of the heading (rad)
+	 */
+	void init(float x, float y, float heading, float position_spread, float heading_spread);
+
+	/**
+	 * @brief Moves every particle by the odometry since the last call.
+	 * @param distance Distance the rear axle drove, negative in reverse (m)
+	 * @param turn Change of heading (rad)
+	 */
+	void predict(float distance, float turn);
+
+	/**
+	 * @brief Weighs the particles against a scan and resamples them if needed.
+	 * Scans are skipped until the truck has moved update_distance or turned
+	 * update_angle since the last scan that was scored, so a truck standing still does
+	 * not keep sharpening the weights on the same view.
+	 * @param scan The scan, with rays that are not part of the map (such as the
+	 * trailer) flagged
+	 * @param pool Workers to score the particles on, or NULL to score them on the
+	 * calling thread
+	 * @return true if the scan was scored
+	 */
+	bool update(const lidar_scan &scan, work_pool *pool);
+
+	/**
+	 * @brief Works out the current pose estimate from the particles.
+	 * @return the estimate
+	 */
+	pose_estimate get_estimate() const;
+
+	/**
+	 * @brief Changes how many particles are used, from 1 up to the configured count.
+	 * The particles are redrawn to the new count in proportion to their weights, so the
+	 * estimate stays where it was; used to trade accuracy for time when the Pi is
+	 * overloaded.
+	 * @param particles The new particle count
+	 */
+	void set_particle_count(uint32_t particles);
+
+	/**
+	 * @brief Changes which rays are scored; only every stride-th ray is.
+	 * @param stride The new beam stride, at least 1
+	 */
+	void set_beam_stride(uint16_t stride) { config.beam_stride = stride ? stride : 1; }
+
+	uint16_t get_beam_stride() const { return config.beam_stride; }
+
+	/**
+	 * @brief Gets the effective number of particles after the last scored scan, before
+	 * any resampling.
+	 * @return 1 / sum(w^2) for the normalized weights
+	 */
+	float get_effective_count() const { return effective_count; }
+
+	/**
+	 * @brief Gets how many times the particles have been resampled.
+	 */
+	uint32_t get_resample_count() const { return resample_count; }
+
+	uint32_t get_particle_count() const { return count; }
+	const float *get_x() const { return &x[0]; }
+	const float *get_y() const { return &y[0]; }
+	const float *get_heading() const { return &heading[0]; }
+	const float *get_weight() const { return &weight[0]; }
+
+private:
+	const likelihood_field &field;
+	particle_filter_config config;
+	uint32_t count;
+
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> heading;
+	std::vector<float> weight;
+	std::vector<float> score;
+
+	// Particles drawn by resampling, swapped with the arrays above afterwards
+	std::vector<float> next_x;
+	std::vector<float> next_y;
+	std::vector<float> next_heading;
+
+	// Scored beam end points in the LiDAR frame
+	std::vector<float> beam_x;
+	std::vector<float> beam_y;
+	uint16_t beam_count;
+
+	float moved_distance;
+	float moved_angle;
+	float effective_count;
+	uint32_t resample_count;
+
+	std::mt19937 rng;
+	std::normal_distribution<float> normal;
+	std::uniform_real_distribution<float> uniform;
+
+	void score_range(size_t begin, size_t end);
+	void resample(uint32_t new_count);
+};
+
+
+#endif //ME507_PARTICLE_FILTER_H
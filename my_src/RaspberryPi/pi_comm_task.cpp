@@ -1,17 +1,83 @@
 #include "pi_comm_task.h"
 
 #define PI_USART_PORT 0
+#define PI_COMM_PERIOD_MS 20    // one command per control loop period
 
 pi_comm_task::pi_comm_task(const char* a_name, unsigned portBASE_TYPE a_priority,
-		size_t a_stack_size, emstream* p_ser_dev, uint16_t baud, uint8_t port)
+		size_t a_stack_size, emstream* p_ser_dev, uint16_t baud, uint8_t port,
+		semi_truck_data_t *semi_data_in)
 		: TaskBase::TaskBase(a_name, a_priority, a_stack_size, p_ser_dev),
 		rs232::rs232(baud, port)
 {
-
+	semi_data = semi_data_in;
 }
 
 void pi_comm_task::run()
 {
+	for (;;) {
+		write_to_mega();
+		read_from_mega();
+		delay_ms(PI_COMM_PERIOD_MS);
+	}
+}
+
+void pi_comm_task::write_to_mega()
+{
+	std::lock_guard<std::mutex> hold(send_lock);
+	send_frame(semi_data->motor_output);
+}
+
+void pi_comm_task::send_brake()
+{
+	std::lock_guard<std::mutex> hold(send_lock);
+	send_frame(MOTOR_OUTPUT_BRAKE);
+}
 
+void pi_comm_task::send_frame(int16_t motor_output)
+{
+	write_16bit_val(motor_output);
+	write_16bit_val(semi_data->steer_output);
+	putchar(semi_data->desired_gear);
+	putchar(semi_data->desired_5th);
 }
 
+void pi_comm_task::read_from_mega()
+{
+	int16_t wheel_speed = 0;
+	uint16_t imu_angle = 0;
+	int8_t actual_gear = 0;
+	bool actual_5th = false;
+	bool received = false;
+
+	// Only whole frames are read, so none of these getchar() calls waits; a frame still
+	// arriving is left for the next period
+	while (available() >= MEGA_FRAME_BYTES) {
+		wheel_speed = read_16bit_val();
+		imu_angle = (uint16_t)read_16bit_val();
+		actual_gear = getchar();
+		actual_5th = getchar();
+		received = true;
+	}
+
+	if (received) {
+		portENTER_CRITICAL ();
+		semi_data->wheel_speed = wheel_speed;
+		semi_data->imu_angle = imu_angle;
+		semi_data->actual_gear = actual_gear;
+		semi_data->actual_5th = actual_5th;
+		portEXIT_CRITICAL ();
+	}
+}
+
+void pi_comm_task::write_16bit_val(int16_t write_val)
+{
+	putchar((char)(write_val & 0xFF));
+	putchar((char)((uint16_t)write_val >> 8));
+}
+
+int16_t pi_comm_task::read_16bit_val()
+{
+	uint16_t low = (uint8_t)getchar();
+	uint16_t high = (uint8_t)getchar();
+	return (int16_t)(low | (high << 8));
+}
@@ -10,26 +10,53 @@
 #define ME507_PI_COMM_TASK_H
 
 
+#include <mutex>
 #include <ridgely_inc/taskbase.h>
 #include <ridgely_inc/rs232int.h>
+#include "../semi_truck_data_t.h"
+
+#define MEGA_FRAME_BYTES 6  // wheel_speed, imu_angle, actual_gear, actual_5th
 
 class pi_comm_task : public TaskBase, public rs232 {
+private:
+	/**
+	 * semi_data is the data shared with the control loop: the outputs it holds are sent
+	 * to the ATMega, and the sensor values the ATMega sends back are stored in it.
+	 */
+	semi_truck_data_t *semi_data;
+
+	/**
+	 * send_lock keeps whole frames together on the line: send_brake() runs on the LiDAR's
+	 * thread while run() sends every period, and as the frame has no sync byte, bytes of
+	 * the two mixed together would leave the ATMega reading out of step for good.
+	 */
+	std::mutex send_lock;
 
 	/**
-     * @brief The constructor for a mega_comm_task object communicates with the Rasp-Pi.
+	 * @brief Sends one frame with the given motor output and the rest from semi_data;
+	 * send_lock must be held.
+	 * @param motor_output The motor_output to send in place of semi_data's
+	 */
+	void send_frame(int16_t motor_output);
+
+public:
+	/**
+     * @brief The constructor for a pi_comm_task object communicates with the ATMega.
      * @param a_name the name of the task
      * @param a_priority The priority given to this task
      * @param a_stack_size The amount of bytes given to the task
      * @param p_ser_dev A serial device that this tasks output is sent to
-     * @param baud The baud rate for the UART port that the mega communicates with
+     * @param baud The baud rate for the UART port that the pi communicates with
      * @param port The UART port number
+     * @param semi_data_in A pointer to the semi truck data shared with the control loop
      */
     pi_comm_task(const char* a_name,
     			unsigned portBASE_TYPE a_priority = 0,
     			size_t a_stack_size = configMINIMAL_STACK_SIZE,
 			    emstream* p_ser_dev = NULL,
 			    uint16_t baud = 9600,
-			    uint8_t port = 0);
+			    uint8_t port = 0,
+			    semi_truck_data_t *semi_data_in = NULL);
 
     /**
 	 * @brief Runs the code for the Raspberry Pi to transmit and receive data from the ATMega
@@ -40,6 +67,41 @@ class pi_comm_task : public TaskBase, public rs232 {
 	 */
     void run();
 
+	/**
+	 * @brief Sends the control loop outputs to the ATMega, in the order that
+	 * mega_comm_task::read_from_pi() reads them. Safe to call from any thread.
+	 */
+	void write_to_mega();
+
+	/**
+	 * @brief Sends a brake command to the ATMega straight away.
+	 * Sends a frame with MOTOR_OUTPUT_BRAKE in place of the control loop's motor_output
+	 * without waiting for the next period, so an emergency stop is only held up by the
+	 * serial link. semi_data is not written, as the control loop owns it. Called from
+	 * the collision_guard on the LiDAR's thread; the control loop keeps the brake on in
+	 * the frames after this one while the guard is braking (control_loop::set_guard()).
+	 */
+	void send_brake();
+
+	/**
+	 * @brief Reads every report the ATMega has sent since the last call.
+	 * The ATMega reports more often than the Pi sends commands, so all of the waiting
+	 * reports are read and the newest one is kept; otherwise the receive buffer would
+	 * fill up and the Pi would fall further and further behind. Nothing is read until a
+	 * whole frame is buffered, and only copying it into semi_data is done in the critical
+	 * section, so a frame cut short on the line never holds up the other tasks.
+	 */
+	void read_from_mega();
+
+	/**
+	 * @brief writes a 16 bit value to the rs232 port, low byte first.
+	 */
+	void write_16bit_val(int16_t write_val);
+
+	/**
+	 * @brief reads a 16 bit value from the rs232 port, low byte first.
+	 */
+	int16_t read_16bit_val();
 };
 
 
@@ -0,0 +1,194 @@
+//
+// Bounded single-producer single-consumer queue; see pipe_queue.h.
+//
+
+#include <chrono>
+#include "host_clock.h"
+#include "pipe_queue.h"
+
+pipe_edge::pipe_edge(const char *name_in, pipe_policy policy_in, uint8_t capacity_in)
+		: head(0), tail(0), free_head(0), free_tail(0), sleepers(0), closed(false), published(0),
+		  dropped(0), blocked(0), sum_blocked_us(0), max_blocked_us(0), max_depth(0)
+{
+	name = name_in;
+	policy = policy_in;
+	capacity = capacity_in < 1 ? 1 : capacity_in > PIPE_MAX_CAPACITY ? PIPE_MAX_CAPACITY : capacity_in;
+	filling = -1;
+	holding = -1;
+	last_blocked_us = 0;
+
+	queued.reset(new std::atomic<uint8_t>[capacity]);
+	for (uint8_t i = 0; i < capacity; i++)
+		queued[i].store(0);
+	free_ring.reset(new uint8_t[capacity + 1]);
+	origin_us.reset(new uint64_t[capacity + 1]);
+	published_us.reset(new uint64_t[capacity + 1]);
+	for (uint16_t i = 0; i <= capacity; i++) {
+		free_ring[i] = (uint8_t)i;
+		origin_us[i] = 0;
+		published_us[i] = 0;
+	}
+	free_head.store(capacity + 1);
+}
+
+void pipe_edge::close()
+{
+	closed.store(true);
+	std::lock_guard<std::mutex> guard(wait_lock);
+	changed.notify_all();
+}
+
+edge_stats pipe_edge::get_stats() const
+{
+	edge_stats s;
+	s.published = published.load();
+	s.dropped = dropped.load();
+	s.blocked = blocked.load();
+	s.sum_blocked_us = sum_blocked_us.load();
+	s.max_blocked_us = max_blocked_us.load();
+	s.max_depth = max_depth.load();
+	return s;
+}
+
+/**
+ * Gives the producer a free buffer. With room in the queue there is always one: of the
+ * capacity + 1 buffers, fewer than capacity are queued and the consumer holds at most
+ * one more. A full queue under PIPE_DROP_OLDEST hands back its oldest buffer instead.
+ */
+bool pipe_edge::claim(uint32_t timeout_us)
+{
+	last_blocked_us = 0;
+	if (filling >= 0)
+		return true;
+	if (closed.load())
+		return false;
+
+	if (!has_room()) {
+		if (policy == PIPE_DROP_OLDEST) {
+			uint8_t buffer;
+			if (pop_queued(buffer)) {
+				filling = buffer;
+				dropped++;
+				return true;
+			}
+			// The consumer took it first, so there is room now
+		}
+		else {
+			uint64_t start = host_time_us();
+			bool room = sleep_until(&pipe_edge::has_room, start + timeout_us);
+			last_blocked_us = (uint32_t)(host_time_us() - start);
+			blocked++;
+			sum_blocked_us += last_blocked_us;
+			if (last_blocked_us > max_blocked_us.load())
+				max_blocked_us.store(last_blocked_us);
+			if (!room || closed.load())
+				return false;
+		}
+	}
+
+	uint32_t f = free_tail.load(std::memory_order_relaxed);
+	if (f == free_head.load(std::memory_order_acquire))
+		return false;
+	filling = free_ring[f % (capacity + 1)];
+	free_tail.store(f + 1, std::memory_order_release);
+	return true;
+}
+
+void pipe_edge::commit(uint64_t origin)
+{
+	if (filling < 0)
+		return;
+	origin_us[filling] = origin;
+	published_us[filling] = host_time_us();
+
+	uint32_t h = head.load();
+	queued[h % capacity].store((uint8_t)filling, std::memory_order_relaxed);
+	head.store(h + 1);
+	filling = -1;
+	published++;
+
+	uint8_t depth = (uint8_t)(h + 1 - tail.load());
+	if (depth > max_depth.load())
+		max_depth.store(depth);
+	wake();
+	if (ready_hook)
+		ready_hook();
+}
+
+bool pipe_edge::take(uint32_t timeout_us)
+{
+	if (holding >= 0)
+		give_back();
+
+	uint64_t deadline = 0;
+	for (;;) {
+		uint8_t buffer;
+		if (pop_queued(buffer)) {
+			holding = buffer;
+			wake();
+			return true;
+		}
+		if (closed.load() || timeout_us == 0)
+			return false;
+		if (deadline == 0)
+			deadline = host_time_us() + timeout_us;
+		// The producer may drop the item again before it is popped, so loop until the deadline
+		if (!sleep_until(&pipe_edge::has_item, deadline))
+			return false;
+	}
+}
+
+void pipe_edge::give_back()
+{
+	if (holding < 0)
+		return;
+	uint32_t h = free_head.load(std::memory_order_relaxed);
+	free_ring[h % (capacity + 1)] = (uint8_t)holding;
+	free_head.store(h + 1, std::memory_order_release);
+	holding = -1;
+}
+
+/**
+ * Pops the oldest queued buffer. The consumer and a dropping producer may both pop, so
+ * the index is read first and only kept if the tail is still where it was read from;
+ * the producer cannot have reused that slot yet, since it only writes a slot once the
+ * tail has moved past it.
+ */
+bool pipe_edge::pop_queued(uint8_t &buffer)
+{
+	uint32_t t = tail.load();
+	for (;;) {
+		if (t == head.load())
+			return false;
+		buffer = queued[t % capacity].load(std::memory_order_relaxed);
+		if (tail.compare_exchange_weak(t, t + 1))
+			return true;
+	}
+}
+
+/**
+ * Sleeps until ready() holds, the queue is closed or the deadline passes. The counters
+ * and sleepers are sequentially consistent, so either the side that changes them sees
+ * a sleeper and notifies it, or the sleeper sees the change before it waits.
+ */
+bool pipe_edge::sleep_until(bool (pipe_edge::*ready)() const, uint64_t deadline_us)
+{
+	std::unique_lock<std::mutex> lock(wait_lock);
+	sleepers++;
+	while (!(this->*ready)() && !closed.load()) {
+		uint64_t now = host_time_us();
+		if (now >= deadline_us)
+			break;
+		changed.wait_for(lock, std::chrono::microseconds(deadline_us - now));
+	}
+	sleepers--;
+	return (this->*ready)();
+}
+
+void pipe_edge::wake()
+{
+	if (sleepers.load() == 0)
+		return;
+	std::lock_guard<std::mutex> guard(wait_lock);
+	changed.notify_all();
+}
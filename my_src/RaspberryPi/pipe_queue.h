@@ -0,0 +1,213 @@
+/**
+ * The pipe_queue is a bounded queue between two stages of a pipeline, with one thread
+ * producing into it and one consuming from it. Items are never copied: the queue owns
+ * capacity + 1 buffers, the producer fills one in place between acquire() and
+ * publish(), and the consumer reads one in place between receive() and release().
+ * The one buffer more than the capacity is the one the consumer holds, so a full queue
+ * still leaves the producer something to drop into.
+ *
+ * Which buffers are queued is kept in a ring of buffer indices with atomic head and
+ * tail counters, and which ones are free in a second ring going back the other way, so
+ * neither side takes a lock to hand over an item. When the queue is full the producer
+ * either waits for the consumer (PIPE_BLOCK), or takes the oldest queued item back and
+ * reuses its buffer (PIPE_DROP_OLDEST); only then, or when the consumer runs dry, does
+ * a thread go to sleep on the queue's condition variable.
+ *
+ * Every item carries the time its data originated (for example when its scan reached
+ * the Pi) and the time it was published, so the stages it passes through can tell how
+ * long it waited in each queue and how old it is when they finish with it.
+ */
+
+#ifndef ME507_PIPE_QUEUE_H
+#define ME507_PIPE_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Largest capacity of a pipe_queue, so a buffer index fits in a byte
+#define PIPE_MAX_CAPACITY 254
+
+/// What a producer does when its queue is full
+enum pipe_policy {
+	PIPE_BLOCK,         ///< wait for the consumer to make room
+	PIPE_DROP_OLDEST    ///< drop the oldest queued item and reuse its buffer
+};
+
+/**
+ * @brief Counters of one queue.
+ * @var published items the producer handed over
+ * @var dropped items dropped to make room for newer ones
+ * @var blocked times the producer had to wait for room
+ * @var sum_blocked_us total time the producer waited for room (us)
+ * @var max_blocked_us longest the producer waited for room at once (us)
+ * @var max_depth most items queued at once
+ */
+struct edge_stats {
+	uint32_t published;
+	uint32_t dropped;
+	uint32_t blocked;
+	uint64_t sum_blocked_us;
+	uint32_t max_blocked_us;
+	uint8_t  max_depth;
+};
+
+/**
+ * The part of a pipe_queue that does not depend on the item type: the index rings,
+ * the timestamps, the waiting and the counters.
+ */
+class pipe_edge {
+public:
+	/**
+	 * @brief The constructor for an empty queue.
+	 * @param name_in Name used in telemetry; the string must outlive the queue
+	 * @param policy_in What the producer does when the queue is full
+	 * @param capacity_in Most items queued at once, from 1 to PIPE_MAX_CAPACITY
+	 */
+	pipe_edge(const char *name_in, pipe_policy policy_in, uint8_t capacity_in);
+
+	virtual ~pipe_edge() {}
+
+	/**
+	 * @brief Wakes both sides and makes every later acquire() and receive() fail.
+	 */
+	void close();
+
+	/**
+	 * @brief Sets a function called on the producer's thread after every publish().
+	 * The pipeline uses it to schedule a consumer that runs on a work_pool. Must be set
+	 * before the producer starts.
+	 */
+	void set_ready_hook(const std::function<void()> &hook) { ready_hook = hook; }
+
+	/// Number of items queued
+	uint8_t size() const { return (uint8_t)(head.load() - tail.load()); }
+	bool is_closed() const { return closed.load(); }
+	const char *get_name() const { return name; }
+	pipe_policy get_policy() const { return policy; }
+	uint8_t get_capacity() const { return capacity; }
+
+	/// Origin time of the item the consumer holds (us)
+	uint64_t get_origin_us() const { return origin_us[holding]; }
+	/// Time the item the consumer holds was published (us)
+	uint64_t get_published_us() const { return published_us[holding]; }
+	/// Time the producer's last acquire() spent waiting for room (us)
+	uint32_t get_last_blocked_us() const { return last_blocked_us; }
+
+	/**
+	 * @brief Gets a copy of the queue's counters.
+	 */
+	edge_stats get_stats() const;
+
+protected:
+	int16_t filling;            // buffer the producer holds, or -1
+	int16_t holding;            // buffer the consumer holds, or -1
+
+	bool claim(uint32_t timeout_us);
+	void commit(uint64_t origin);
+	bool take(uint32_t timeout_us);
+	void give_back();
+
+private:
+	const char *name;
+	pipe_policy policy;
+	uint8_t capacity;
+
+	// Queued buffers, oldest at tail; both the consumer and a dropping producer pop
+	std::unique_ptr<std::atomic<uint8_t>[]> queued;
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+
+	// Free buffers, pushed by the consumer and popped by the producer
+	std::unique_ptr<uint8_t[]> free_ring;
+	std::atomic<uint32_t> free_head;
+	std::atomic<uint32_t> free_tail;
+
+	std::unique_ptr<uint64_t[]> origin_us;
+	std::unique_ptr<uint64_t[]> published_us;
+	uint32_t last_blocked_us;
+	std::function<void()> ready_hook;
+
+	std::mutex wait_lock;
+	std::condition_variable changed;
+	std::atomic<uint16_t> sleepers;
+	std::atomic<bool> closed;
+
+	std::atomic<uint32_t> published;
+	std::atomic<uint32_t> dropped;
+	std::atomic<uint32_t> blocked;
+	std::atomic<uint64_t> sum_blocked_us;
+	std::atomic<uint32_t> max_blocked_us;
+	std::atomic<uint8_t> max_depth;
+
+	bool has_room() const { return head.load() - tail.load() < capacity; }
+	bool has_item() const { return head.load() != tail.load(); }
+	bool pop_queued(uint8_t &buffer);
+	bool sleep_until(bool (pipe_edge::*ready)() const, uint64_t deadline_us);
+	void wake();
+};
+
+template <class T>
+class pipe_queue : public pipe_edge {
+public:
+	/**
+	 * @brief The constructor for an empty queue; allocates every buffer it will use.
+	 * @param name_in Name used in telemetry; the string must outlive the queue
+	 * @param policy_in What the producer does when the queue is full
+	 * @param capacity_in Most items queued at once, from 1 to PIPE_MAX_CAPACITY
+	 */
+	pipe_queue(const char *name_in, pipe_policy policy_in, uint8_t capacity_in)
+			: pipe_edge(name_in, policy_in, capacity_in), buffers(get_capacity() + 1)
+	{
+	}
+
+	/**
+	 * @brief Gets a buffer for the producer to fill. Producer only.
+	 * Calling it again before publish() returns the same buffer, so a producer that
+	 * decides not to publish simply fills it again next time.
+	 * @param timeout_us Longest to wait for room under PIPE_BLOCK (us)
+	 * @return the buffer, or NULL on timeout or once the queue is closed
+	 */
+	T *acquire(uint32_t timeout_us)
+	{
+		return claim(timeout_us) ? &buffers[filling] : NULL;
+	}
+
+	/**
+	 * @brief Queues the buffer from acquire(). Producer only.
+	 * @param origin When the item's data originated, on the host clock (us)
+	 */
+	void publish(uint64_t origin)
+	{
+		commit(origin);
+	}
+
+	/**
+	 * @brief Takes the oldest queued item. Consumer only.
+	 * Releases the item taken before, if it was not released already.
+	 * @param timeout_us Longest to wait for an item (us)
+	 * @return the item, or NULL on timeout or once the queue is closed
+	 */
+	const T *receive(uint32_t timeout_us)
+	{
+		return take(timeout_us) ? &buffers[holding] : NULL;
+	}
+
+	/**
+	 * @brief Hands the item from receive() back to the producer. Consumer only.
+	 */
+	void release()
+	{
+		give_back();
+	}
+
+private:
+	std::vector<T> buffers;
+};
+
+
+#endif //ME507_PIPE_QUEUE_H
@@ -0,0 +1,220 @@
+//
+// Staged perception and control pipeline; see pipeline.h.
+//
+
+#include <cstdio>
+#include <cstring>
+#include "pipeline.h"
+
+#define STAGE_POLL_US 50000     // longest a stage's thread waits before checking for stop()
+
+pipeline_stage::pipeline_stage(const char *name_in, pipe_edge *input_in, pipe_edge *output_in, bool pooled_in)
+		: scheduled(false)
+{
+	name = name_in;
+	input = input_in;
+	output = output_in;
+	pooled = pooled_in;
+	memset(&stats, 0, sizeof(stats));
+	stats.name = name;
+}
+
+stage_stats pipeline_stage::get_stats() const
+{
+	stage_stats s;
+	{
+		std::lock_guard<std::mutex> guard(stats_lock);
+		s = stats;
+	}
+	if (input)
+		s.dropped = input->get_stats().dropped;
+	if (output) {
+		edge_stats out = output->get_stats();
+		s.blocked = out.blocked;
+		s.sum_blocked_us = out.sum_blocked_us;
+	}
+	return s;
+}
+
+void pipeline_stage::record(uint64_t origin_us, uint64_t published_us, uint64_t start_us, uint32_t blocked_us,
+                            bool passed_on)
+{
+	uint64_t end = host_time_us();
+	uint32_t wait = start_us > published_us ? (uint32_t)(start_us - published_us) : 0;
+	uint32_t busy = (uint32_t)(end - start_us);
+	busy = busy > blocked_us ? busy - blocked_us : 0;
+	uint32_t latency = end > origin_us ? (uint32_t)(end - origin_us) : 0;
+
+	std::lock_guard<std::mutex> guard(stats_lock);
+	if (!passed_on) {
+		stats.rejected++;
+		return;
+	}
+	stats.processed++;
+	stats.sum_busy_us += busy;
+	if (busy > stats.max_busy_us)
+		stats.max_busy_us = busy;
+	stats.sum_wait_us += wait;
+	if (wait > stats.max_wait_us)
+		stats.max_wait_us = wait;
+	stats.sum_latency_us += latency;
+	if (latency > stats.max_latency_us)
+		stats.max_latency_us = latency;
+}
+
+pipeline::pipeline(work_pool *pool_in)
+		: running(false), in_flight(0)
+{
+	pool = pool_in;
+	last_report_us = 0;
+}
+
+pipeline::~pipeline()
+{
+	stop();
+}
+
+void pipeline::add(pipeline_stage *stage)
+{
+	if (!running.load())
+		stages.push_back(stage);
+}
+
+bool pipeline::start()
+{
+	if (running.load())
+		return true;
+	for (size_t i = 0; i < stages.size(); i++) {
+		pipeline_stage *s = stages[i];
+		if (s->pooled && (!pool || !s->input || (s->output && s->output->get_policy() != PIPE_DROP_OLDEST)))
+			return false;
+	}
+
+	running.store(true);
+	last_report.clear();
+	for (size_t i = 0; i < stages.size(); i++) {
+		stage_stats zero;
+		memset(&zero, 0, sizeof(zero));
+		last_report.push_back(zero);
+	}
+	last_report_us = host_time_us();
+
+	for (size_t i = 0; i < stages.size(); i++) {
+		pipeline_stage *s = stages[i];
+		if (s->pooled)
+			s->input->set_ready_hook([this, s] { schedule(s); });
+	}
+	for (size_t i = 0; i < stages.size(); i++) {
+		pipeline_stage *s = stages[i];
+		if (s->pooled) {
+			if (s->input->size() > 0)
+				schedule(s);
+		}
+		else {
+			threads.push_back(std::thread(&pipeline::run_stage, this, s));
+		}
+	}
+	return true;
+}
+
+void pipeline::stop()
+{
+	if (!running.exchange(false))
+		return;
+	for (size_t i = 0; i < stages.size(); i++) {
+		if (stages[i]->input)
+			stages[i]->input->close();
+		if (stages[i]->output)
+			stages[i]->output->close();
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	threads.clear();
+
+	std::unique_lock<std::mutex> lock(drained_lock);
+	drained.wait(lock, [this] { return in_flight.load() == 0; });
+}
+
+std::vector<stage_stats> pipeline::get_stats() const
+{
+	std::vector<stage_stats> all;
+	for (size_t i = 0; i < stages.size(); i++)
+		all.push_back(stages[i]->get_stats());
+	return all;
+}
+
+size_t pipeline::write_telemetry(char *buffer, size_t size)
+{
+	if (size == 0)
+		return 0;
+	buffer[0] = '\0';
+	uint64_t now = host_time_us();
+	double seconds = (now - last_report_us) * 1e-6;
+	last_report_us = now;
+
+	size_t length = 0;
+	for (size_t i = 0; i < stages.size() && length < size; i++) {
+		stage_stats s = stages[i]->get_stats();
+		stage_stats &last = last_report[i];
+		uint32_t n = s.processed - last.processed;
+		uint32_t mean_busy = n ? (uint32_t)((s.sum_busy_us - last.sum_busy_us) / n) : 0;
+		uint32_t mean_wait = n ? (uint32_t)((s.sum_wait_us - last.sum_wait_us) / n) : 0;
+		uint32_t mean_latency = n ? (uint32_t)((s.sum_latency_us - last.sum_latency_us) / n) : 0;
+
+		// The worst cases are since the start; the rest are since the last report
+		int written = snprintf(buffer + length, size - length,
+		                       "%-10s n %5u %6.1f Hz  busy %6u/%6u us  wait %6u/%6u us  age %6u/%6u us"
+		                       "  rejected %u  dropped %u  blocked %llu us\n",
+		                       s.name, n, seconds > 0.0 ? n / seconds : 0.0,
+		                       mean_busy, s.max_busy_us, mean_wait, s.max_wait_us, mean_latency, s.max_latency_us,
+		                       s.rejected - last.rejected, s.dropped - last.dropped,
+		                       (unsigned long long)(s.sum_blocked_us - last.sum_blocked_us));
+		if (written < 0)
+			break;
+		length += (size_t)written;
+		last = s;
+	}
+	return length < size ? length : size - 1;
+}
+
+void pipeline::run_stage(pipeline_stage *stage)
+{
+	while (running.load())
+		stage->step(STAGE_POLL_US);
+}
+
+void pipeline::schedule(pipeline_stage *stage)
+{
+	if (stage->scheduled.exchange(true))
+		return;
+	// Counted before running is checked, so stop() either sees it or it sees stop()
+	in_flight++;
+	if (!running.load()) {
+		stage->scheduled.store(false);
+		finish_drain();
+		return;
+	}
+	pool->submit([this, stage] { drain(stage); });
+}
+
+void pipeline::drain(pipeline_stage *stage)
+{
+	for (;;) {
+		while (running.load() && stage->step(0))
+			;
+		stage->scheduled.store(false);
+		// An item published after the last step() found nothing saw the stage still
+		// scheduled and did not schedule it again, so check once more
+		if (!running.load() || stage->input->size() == 0 || stage->scheduled.exchange(true))
+			break;
+	}
+	finish_drain();
+}
+
+void pipeline::finish_drain()
+{
+	if (--in_flight == 0) {
+		std::lock_guard<std::mutex> guard(drained_lock);
+		drained.notify_all();
+	}
+}
@@ -0,0 +1,313 @@
+/**
+ * The pipeline runs the Pi's perception and control as a chain of stages joined by
+ * pipe_queues, instead of one loop calling each step in turn: acquiring a scan,
+ * preprocessing it, localizing, controlling and sending the command. Each stage only
+ * waits on its own input, so a slow stage makes the queue in front of it fill up
+ * rather than stalling everything else, and what happens then is chosen per queue:
+ * under PIPE_DROP_OLDEST the stage simply works on newer data once it catches up,
+ * under PIPE_BLOCK the stage before it is held back.
+ *
+ * A stage runs either on a thread of its own, which suits stages that block on a
+ * device or take long, or on a shared work_pool, which suits short stages: a pooled
+ * stage is scheduled when an item is published to its input and runs until the input
+ * is empty. A pooled stage must never block, so its output queue has to drop the
+ * oldest item, and it must not wait on the pool itself (parallel_for).
+ *
+ * Every stage times every item it handles: how long the item waited in its input
+ * queue, how long the stage worked on it, how long it was held back by a full output,
+ * and how old the item was when the stage finished with it, measured from when its data
+ * originated. For the last stage that age is the scan-to-command latency, and the
+ * differences between the stages show exactly where it goes. write_telemetry() sums
+ * them up as text, one line per stage.
+ */
+
+#ifndef ME507_PIPELINE_H
+#define ME507_PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "host_clock.h"
+#include "pipe_queue.h"
+#include "work_pool.h"
+
+/**
+ * @brief Timing and loss counters of one stage.
+ * @var name the stage's name
+ * @var processed items the stage finished and passed on
+ * @var rejected items the stage's work rejected, so nothing was passed on
+ * @var dropped items its input queue dropped before the stage got to them
+ * @var blocked times the stage had to wait for room on its output
+ * @var sum_blocked_us total time it waited for room on its output (us)
+ * @var sum_busy_us total time it spent working on items (us)
+ * @var max_busy_us longest it spent on one item (us)
+ * @var sum_wait_us total time items waited in its input queue (us)
+ * @var max_wait_us longest an item waited in its input queue (us)
+ * @var sum_latency_us total age of the items when the stage finished them (us)
+ * @var max_latency_us oldest an item was when the stage finished it (us)
+ */
+struct stage_stats {
+	const char *name;
+	uint32_t processed;
+	uint32_t rejected;
+	uint32_t dropped;
+	uint32_t blocked;
+	uint64_t sum_blocked_us;
+	uint64_t sum_busy_us;
+	uint32_t max_busy_us;
+	uint64_t sum_wait_us;
+	uint32_t max_wait_us;
+	uint64_t sum_latency_us;
+	uint32_t max_latency_us;
+};
+
+/**
+ * One stage of a pipeline. The typed stages below connect the queues to the stage's
+ * work; this class keeps the counters and lets the pipeline run any stage alike.
+ */
+class pipeline_stage {
+public:
+	/**
+	 * @brief The constructor for a stage.
+	 * @param name_in Name used in telemetry; the string must outlive the stage
+	 * @param input_in The queue the stage reads from, or NULL for a source
+	 * @param output_in The queue the stage writes to, or NULL for a sink
+	 * @param pooled_in true to run the stage on the pipeline's work_pool
+	 */
+	pipeline_stage(const char *name_in, pipe_edge *input_in, pipe_edge *output_in, bool pooled_in);
+
+	virtual ~pipeline_stage() {}
+
+	/**
+	 * @brief Handles at most one item.
+	 * @param timeout_us Longest to wait for an input item, or for room on the output
+	 * under PIPE_BLOCK before checking whether the pipeline is stopping (us)
+	 * @return true if an item was handled
+	 */
+	virtual bool step(uint32_t timeout_us) = 0;
+
+	/**
+	 * @brief Gets a copy of the stage's counters, including its queues'.
+	 */
+	stage_stats get_stats() const;
+
+	const char *get_name() const { return name; }
+	pipe_edge *get_input() const { return input; }
+	pipe_edge *get_output() const { return output; }
+	bool is_pooled() const { return pooled; }
+
+protected:
+	/**
+	 * @brief Adds one handled item to the counters.
+	 * @param origin_us When the item's data originated (us)
+	 * @param published_us When the item was put in the input queue, or start_us for a
+	 * source (us)
+	 * @param start_us When the stage took the item (us)
+	 * @param blocked_us Time spent waiting for room on the output (us)
+	 * @param passed_on true if an item was published to the output
+	 */
+	void record(uint64_t origin_us, uint64_t published_us, uint64_t start_us, uint32_t blocked_us, bool passed_on);
+
+private:
+	friend class pipeline;
+
+	const char *name;
+	pipe_edge *input;
+	pipe_edge *output;
+	bool pooled;
+	std::atomic<bool> scheduled;    // a pooled stage is queued on or running in the pool
+
+	mutable std::mutex stats_lock;
+	stage_stats stats;
+};
+
+/**
+ * A stage that makes items, such as reading scans from a LiDAR. The work fills the
+ * output buffer and may set the item's origin time, which is when the work started
+ * unless it says otherwise; it returns false if it had nothing to pass on.
+ */
+template <class Out>
+class pipe_source : public pipeline_stage {
+public:
+	typedef std::function<bool(Out &, uint64_t &)> work_t;
+
+	pipe_source(const char *name_in, pipe_queue<Out> *output_in, const work_t &work_in)
+			: pipeline_stage(name_in, NULL, output_in, false), output(output_in), work(work_in)
+	{
+	}
+
+	bool step(uint32_t timeout_us)
+	{
+		Out *out = output->acquire(timeout_us);
+		if (!out)
+			return false;
+		uint32_t blocked_us = output->get_last_blocked_us();
+		uint64_t start = host_time_us();
+		uint64_t origin = start;
+		bool made = work(*out, origin);
+		if (made)
+			output->publish(origin);
+		record(origin, start, start, blocked_us, made);
+		return made;
+	}
+
+private:
+	pipe_queue<Out> *output;
+	work_t work;
+};
+
+/**
+ * A stage that turns each input item into an output item. The work returns false to
+ * pass nothing on for that input.
+ */
+template <class In, class Out>
+class pipe_stage : public pipeline_stage {
+public:
+	typedef std::function<bool(const In &, Out &)> work_t;
+
+	pipe_stage(const char *name_in, pipe_queue<In> *input_in, pipe_queue<Out> *output_in, const work_t &work_in,
+	           bool pooled_in = false)
+			: pipeline_stage(name_in, input_in, output_in, pooled_in), input(input_in), output(output_in),
+			  work(work_in)
+	{
+	}
+
+	bool step(uint32_t timeout_us)
+	{
+		const In *in = input->receive(timeout_us);
+		if (!in)
+			return false;
+		uint64_t start = host_time_us();
+
+		// A full output under PIPE_BLOCK holds this stage back until there is room
+		Out *out;
+		uint32_t blocked_us = 0;
+		while (!(out = output->acquire(timeout_us))) {
+			blocked_us += output->get_last_blocked_us();
+			if (output->is_closed()) {
+				input->release();
+				return false;
+			}
+		}
+		blocked_us += output->get_last_blocked_us();
+
+		uint64_t origin = input->get_origin_us();
+		bool made = work(*in, *out);
+		if (made)
+			output->publish(origin);
+		record(origin, input->get_published_us(), start, blocked_us, made);
+		input->release();
+		return true;
+	}
+
+private:
+	pipe_queue<In> *input;
+	pipe_queue<Out> *output;
+	work_t work;
+};
+
+/**
+ * The last stage, which uses each item up, such as sending the command to the ATMega.
+ * Its latency counters give the age of the items when they leave the pipeline. The work
+ * also gets the item's origin time, so it can check the item against a deadline.
+ */
+template <class In>
+class pipe_sink : public pipeline_stage {
+public:
+	typedef std::function<void(const In &, uint64_t)> work_t;
+
+	pipe_sink(const char *name_in, pipe_queue<In> *input_in, const work_t &work_in, bool pooled_in = false)
+			: pipeline_stage(name_in, input_in, NULL, pooled_in), input(input_in), work(work_in)
+	{
+	}
+
+	bool step(uint32_t timeout_us)
+	{
+		const In *in = input->receive(timeout_us);
+		if (!in)
+			return false;
+		uint64_t start = host_time_us();
+		work(*in, input->get_origin_us());
+		record(input->get_origin_us(), input->get_published_us(), start, 0, true);
+		input->release();
+		return true;
+	}
+
+private:
+	pipe_queue<In> *input;
+	work_t work;
+};
+
+class pipeline {
+public:
+	/**
+	 * @brief The constructor for an empty pipeline.
+	 * @param pool_in Workers for the pooled stages, or NULL if there are none
+	 */
+	pipeline(work_pool *pool_in = NULL);
+
+	/**
+	 * @brief Stops the pipeline if it is still running.
+	 */
+	~pipeline();
+
+	/**
+	 * @brief Adds a stage, which must outlive the pipeline. Only before start().
+	 */
+	void add(pipeline_stage *stage);
+
+	/**
+	 * @brief Starts a thread for every stage that is not pooled.
+	 * @return false, starting nothing, if a pooled stage has no pool or no input, or an
+	 * output queue that can block
+	 */
+	bool start();
+
+	/**
+	 * @brief Closes every queue, then waits for the stages' threads and any pooled
+	 * stage still running. A source's work should return within its poll time.
+	 */
+	void stop();
+
+	/**
+	 * @brief Gets a copy of every stage's counters, in the order they were added.
+	 */
+	std::vector<stage_stats> get_stats() const;
+
+	/**
+	 * @brief Writes the counters since the last call as text, one line per stage:
+	 * items passed on and their rate, mean and worst work time, queue wait and age at
+	 * the end of the stage, items dropped and time held back by a full output.
+	 * @param buffer Where to write; always terminated
+	 * @param size Size of the buffer
+	 * @return the length of the text, without the terminator
+	 */
+	size_t write_telemetry(char *buffer, size_t size);
+
+private:
+	work_pool *pool;
+	std::vector<pipeline_stage *> stages;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running;
+
+	// Pooled stages queued on or running in the pool
+	std::atomic<uint32_t> in_flight;
+	std::mutex drained_lock;
+	std::condition_variable drained;
+
+	std::vector<stage_stats> last_report;
+	uint64_t last_report_us;
+
+	void run_stage(pipeline_stage *stage);
+	void schedule(pipeline_stage *stage);
+	void drain(pipeline_stage *stage);
+	void finish_drain();
+};
+
+
+#endif //ME507_PIPELINE_H
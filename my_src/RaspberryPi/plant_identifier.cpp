@@ -0,0 +1,205 @@
+//
+// Online identification of the steering and drive; see plant_identifier.h.
+//
+
+#include <cmath>
+#include <cstring>
+#include "plant_identifier.h"
+
+static float wrap_angle(float a)
+{
+	while (a > (float)M_PI)
+		a -= 2.0f * (float)M_PI;
+	while (a <= -(float)M_PI)
+		a += 2.0f * (float)M_PI;
+	return a;
+}
+
+plant_identifier::plant_identifier(const truck_geometry &geometry_in, const identifier_config &config_in)
+{
+	geometry = geometry_in;
+	config = config_in;
+	if (config.max_delay > IDENT_MAX_DELAY)
+		config.max_delay = IDENT_MAX_DELAY;
+	reset();
+}
+
+void plant_identifier::reset()
+{
+	reset_channel(steering);
+	reset_channel(motor);
+	last_time_us = 0;
+	last_heading = 0.0f;
+	last_speed = 0.0f;
+	started = false;
+}
+
+void plant_identifier::reset_channel(rls_channel &channel)
+{
+	memset(&channel, 0, sizeof(channel));
+	for (uint8_t d = 0; d <= IDENT_MAX_DELAY; d++)
+		for (uint8_t i = 0; i < IDENT_PARAMETERS; i++)
+			channel.covariance[d][i][i] = config.initial_covariance;
+}
+
+void plant_identifier::restart_history(rls_channel &channel)
+{
+	channel.inputs_known = 0;
+	channel.output_known = false;
+}
+
+void plant_identifier::update(uint64_t time_us, int16_t steer_output, int16_t motor_output, int16_t wheel_speed,
+                              uint16_t imu_angle)
+{
+	float heading = control_loop::imu_angle_to_heading(imu_angle);
+	float speed = wheel_speed / WHEEL_SPEED_PER_M_S;
+
+	if (started) {
+		uint64_t gap = time_us - last_time_us;
+		if (2 * gap < config.period_us || 2 * gap > 3 * (uint64_t)config.period_us) {
+			restart_history(steering);
+			restart_history(motor);
+		}
+		else {
+			fit(motor, speed);
+
+			// The wheel angle that turns the truck at the measured yaw rate; it says
+			// nothing at a crawl, where the yaw rate is lost in the IMU's resolution
+			if (fabsf(speed) >= config.min_speed && fabsf(last_speed) >= config.min_speed) {
+				float yaw_rate = wrap_angle(heading - last_heading) / (gap * 1e-6f);
+				fit(steering, atanf(geometry.wheelbase * yaw_rate / (0.5f * (speed + last_speed))));
+			}
+			else {
+				steering.output_known = false;
+			}
+		}
+	}
+
+	// The servo cannot go past its travel, so neither does the input it is modelled with
+	float steer = steer_output / STEER_OUTPUT_PER_RAD;
+	if (steer > geometry.max_steer)
+		steer = geometry.max_steer;
+	else if (steer < -geometry.max_steer)
+		steer = -geometry.max_steer;
+	push_input(steering, steer);
+	// Braking is not the lag being fitted
+	if (motor_output == MOTOR_OUTPUT_BRAKE)
+		restart_history(motor);
+	else
+		push_input(motor, (float)motor_output / MOTOR_OUTPUT_FULL);
+
+	last_time_us = time_us;
+	last_heading = heading;
+	last_speed = speed;
+	started = true;
+}
+
+/**
+ * One step of recursive least squares with instrumental variables for every dead time,
+ * with phi = (y[k-1], u[k-1-d], u[k-2-d]) and the instrument z the same but for the
+ * model's output in place of y[k-1]:
+ *   K = P z / (lambda + phi' P z),  theta += K (y - phi' theta),
+ *   P = (P - K phi' P) / lambda
+ * P is no longer symmetric, so phi' P is worked out on its own. The division by lambda
+ * is what forgets; it is skipped once the trace of P reaches max_covariance, since with
+ * no new information coming in P would otherwise grow without bound and the next step
+ * after standing still would throw the fit away.
+ */
+void plant_identifier::fit(rls_channel &channel, float output)
+{
+	if (!channel.output_known) {
+		// Nothing to fit yet; start the models' outputs from the measured one
+		for (uint8_t d = 0; d <= IDENT_MAX_DELAY; d++)
+			channel.model_output[d] = output;
+	}
+	else if (channel.inputs_known >= config.max_delay + 2) {
+		double lambda = config.forgetting;
+		for (uint8_t d = 0; d <= config.max_delay; d++) {
+			double phi[IDENT_PARAMETERS] = {channel.last_output, channel.inputs[d], channel.inputs[d + 1]};
+			double z[IDENT_PARAMETERS] = {channel.model_output[d], channel.inputs[d], channel.inputs[d + 1]};
+			double *theta = channel.theta[d];
+			double (*p)[IDENT_PARAMETERS] = channel.covariance[d];
+
+			double p_z[IDENT_PARAMETERS], phi_p[IDENT_PARAMETERS];
+			double denominator = lambda, predicted = 0.0;
+			for (uint8_t i = 0; i < IDENT_PARAMETERS; i++) {
+				p_z[i] = 0.0;
+				phi_p[i] = 0.0;
+				for (uint8_t j = 0; j < IDENT_PARAMETERS; j++) {
+					p_z[i] += p[i][j] * z[j];
+					phi_p[i] += phi[j] * p[j][i];
+				}
+			}
+			for (uint8_t i = 0; i < IDENT_PARAMETERS; i++) {
+				denominator += phi[i] * p_z[i];
+				predicted += theta[i] * phi[i];
+			}
+			double error = output - predicted;
+			for (uint8_t i = 0; i < IDENT_PARAMETERS; i++)
+				theta[i] += p_z[i] / denominator * error;
+
+			double trace = 0.0;
+			for (uint8_t i = 0; i < IDENT_PARAMETERS; i++) {
+				for (uint8_t j = 0; j < IDENT_PARAMETERS; j++)
+					p[i][j] -= p_z[i] * phi_p[j] / denominator;
+				trace += p[i][i];
+			}
+			if (trace < config.max_covariance)
+				for (uint8_t i = 0; i < IDENT_PARAMETERS; i++)
+					for (uint8_t j = 0; j < IDENT_PARAMETERS; j++)
+						p[i][j] /= lambda;
+
+			// The model runs on the inputs alone; a is held inside the stable range so a
+			// bad start cannot make it run away
+			double a = theta[0] < 0.0 ? 0.0 : (theta[0] > 0.999 ? 0.999 : theta[0]);
+			channel.model_output[d] = a * channel.model_output[d] + theta[1] * phi[1] + theta[2] * phi[2];
+
+			channel.error[d] += (float)((error * error - channel.error[d]) * (1.0 - lambda));
+		}
+		channel.updates++;
+	}
+	channel.last_output = output;
+	channel.output_known = true;
+}
+
+void plant_identifier::push_input(rls_channel &channel, float input)
+{
+	for (uint8_t i = IDENT_MAX_DELAY + 1; i > 0; i--)
+		channel.inputs[i] = channel.inputs[i - 1];
+	channel.inputs[0] = input;
+	if (channel.inputs_known < IDENT_MAX_DELAY + 2)
+		channel.inputs_known++;
+}
+
+/**
+ * A first order lag y' = (gain u - y) / tau sampled every T gives a = exp(-T / tau) and
+ * b0 + b1 = gain (1 - a). How the input's weight splits between b0 and b1 places the dead
+ * time between d and d + 1 periods.
+ */
+actuator_estimate plant_identifier::estimate(const rls_channel &channel) const
+{
+	uint8_t best = 0;
+	for (uint8_t d = 1; d <= config.max_delay; d++)
+		if (channel.error[d] < channel.error[best])
+			best = d;
+	const double *theta = channel.theta[best];
+	double a = theta[0], b = theta[1] + theta[2];
+	float period = config.period_us * 1e-6f;
+
+	actuator_estimate out;
+	out.updates = channel.updates;
+	out.rms_error = sqrtf(channel.error[best]);
+	out.valid = false;
+	out.gain = 0.0f;
+	out.tau = 0.0f;
+	out.delay = best * period;
+	if (a <= 0.0 || a >= 1.0 || b == 0.0)
+		return out;
+
+	out.gain = (float)(b / (1.0 - a));
+	out.tau = (float)(-period / log(a));
+	float fraction = (float)(theta[2] / b);
+	out.delay += period * (fraction < 0.0f ? 0.0f : (fraction > 1.0f ? 1.0f : fraction));
+	out.valid = channel.updates >= config.min_updates && out.gain > 0.0f;
+	return out;
+}
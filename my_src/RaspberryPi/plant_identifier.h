@@ -0,0 +1,157 @@
+/**
+ * The plant_identifier keeps track of how the steering servo and the drive motor
+ * actually respond, which drifts with battery voltage and load. It runs once per control
+ * period on what the Pi already has: the steer_output and motor_output it sent and the
+ * wheel_speed and imu_angle the ATMega reported back.
+ *
+ * Each actuator is modelled as a first order lag behind some dead time, which sampled
+ * once per period gives y[k] = a y[k-1] + b0 u[k-1-d] + b1 u[k-2-d]. The second input
+ * term takes up the part of the dead time that is not a whole number of periods. For
+ * the motor, u is motor_output as a fraction of full and y is the wheel speed; for the
+ * steering, u is the commanded wheel angle and y is the wheel angle the yaw rate implies
+ * at the current speed. Recursive least squares with exponential forgetting fits a, b0
+ * and b1 for every dead time from 0 to max_delay periods side by side, and the dead time
+ * whose one-step predictions have been best recently is the one reported. Both outputs
+ * are coarsely quantized (the wheel speed to the stripe sensor's steps, the yaw rate to
+ * the IMU's resolution over one period), and plain least squares with a noisy y[k-1] on
+ * the right hand side pulls a towards 0 and reads the lag as dead time. So the fit uses
+ * instrumental variables: y[k-1] is correlated against the model's own output driven by
+ * the inputs alone, which follows the true output but not its noise.
+ *
+ * An update costs a few hundred flops and never allocates, so it can run inside the
+ * control loop. The estimates can be handed back to the control_loop through
+ * control_loop::set_actuator_model().
+ */
+
+#ifndef ME507_PLANT_IDENTIFIER_H
+#define ME507_PLANT_IDENTIFIER_H
+
+#include <cstdint>
+#include "control_loop.h"
+
+/// Parameters fitted for each actuator and dead time: a, b0 and b1
+#define IDENT_PARAMETERS 3
+/// Most dead time tried, in control periods
+#define IDENT_MAX_DELAY 4
+
+/**
+ * @brief Settings of a plant_identifier.
+ * @var period_us control period the updates come at (us)
+ * @var forgetting weight kept by a sample after each later one, just below 1; the
+ * estimates follow changes over about 1 / (1 - forgetting) periods
+ * @var initial_covariance covariance the fit starts from; large means no prior
+ * @var max_covariance trace of the covariance at which forgetting stops, so it cannot
+ * blow up while the truck holds still and nothing new is learned
+ * @var min_speed slowest speed at which the yaw rate says anything about the steering (m/s)
+ * @var max_delay dead times tried, from 0 to this many periods, at most IDENT_MAX_DELAY
+ * @var min_updates fits an actuator needs before its estimate counts as valid
+ */
+struct identifier_config {
+	uint32_t period_us;
+	float    forgetting;
+	float    initial_covariance;
+	float    max_covariance;
+	float    min_speed;
+	uint8_t  max_delay;
+	uint16_t min_updates;
+};
+
+/**
+ * @brief What has been identified of one actuator.
+ * @var valid true once enough data has been fitted and the fit is a stable lag
+ * @var gain steady output per unit of input: wheel angle per commanded angle for the
+ * steering, speed at full motor_output for the motor (m/s)
+ * @var tau time constant of the lag (s)
+ * @var delay dead time from the command being sent to the output starting to move (s)
+ * @var rms_error recent RMS error of the one-step prediction, in the output's units
+ * @var updates fits done since the last reset
+ */
+struct actuator_estimate {
+	bool     valid;
+	float    gain;
+	float    tau;
+	float    delay;
+	float    rms_error;
+	uint32_t updates;
+};
+
+class plant_identifier {
+public:
+	/**
+	 * @brief The constructor for a plant_identifier that knows nothing yet.
+	 * @param geometry_in The dimensions of the truck, for the wheelbase and steering limit
+	 * @param config_in The identifier settings
+	 */
+	plant_identifier(const truck_geometry &geometry_in, const identifier_config &config_in);
+
+	/**
+	 * @brief Forgets everything identified so far.
+	 */
+	void reset();
+
+	/**
+	 * @brief Adds one control period of data.
+	 * Call it after the control_loop has run, with the command just computed. A gap of
+	 * more than half a period off the expected time restarts the input history, but
+	 * keeps the fits.
+	 * @param time_us Time of the control period (us)
+	 * @param steer_output The steering command being sent, as in semi_truck_data_t
+	 * @param motor_output The motor command being sent, as in semi_truck_data_t
+	 * @param wheel_speed The wheel_speed last reported by the ATMega
+	 * @param imu_angle The imu_angle last reported by the ATMega
+	 */
+	void update(uint64_t time_us, int16_t steer_output, int16_t motor_output, int16_t wheel_speed,
+	            uint16_t imu_angle);
+
+	/// The steering servo, from commanded to actual front wheel angle
+	actuator_estimate get_steering() const { return estimate(steering); }
+	/// The motor, from motor_output to wheel speed
+	actuator_estimate get_motor() const { return estimate(motor); }
+
+private:
+	/**
+	 * @brief The fits of one actuator and the samples they need.
+	 * @var theta a, b0 and b1 for each dead time
+	 * @var covariance covariance of theta for each dead time, scaled by the noise
+	 * @var model_output the output each fit gives at the previous period from the inputs
+	 * alone, the instrument for y[k-1]
+	 * @var error smoothed squared one-step prediction error for each dead time
+	 * @var inputs the last inputs, most recent first
+	 * @var inputs_known how many of inputs are filled in
+	 * @var last_output the output at the previous period
+	 * @var output_known true if last_output can be used
+	 * @var updates fits done since the last reset
+	 */
+	struct rls_channel {
+		// In double: the covariance is updated by subtraction every period, and in
+		// float it drifts off over a long drive
+		double   theta[IDENT_MAX_DELAY + 1][IDENT_PARAMETERS];
+		double   covariance[IDENT_MAX_DELAY + 1][IDENT_PARAMETERS][IDENT_PARAMETERS];
+		double   model_output[IDENT_MAX_DELAY + 1];
+		float    error[IDENT_MAX_DELAY + 1];
+		float    inputs[IDENT_MAX_DELAY + 2];
+		uint8_t  inputs_known;
+		float    last_output;
+		bool     output_known;
+		uint32_t updates;
+	};
+
+	truck_geometry geometry;
+	identifier_config config;
+	rls_channel steering;
+	rls_channel motor;
+
+	uint64_t last_time_us;
+	float last_heading;
+	float last_speed;
+	bool started;
+
+	void reset_channel(rls_channel &channel);
+	void restart_history(rls_channel &channel);
+	void fit(rls_channel &channel, float output);
+	void push_input(rls_channel &channel, float input);
+	actuator_estimate estimate(const rls_channel &channel) const;
+};
+
+
+#endif //ME507_PLANT_IDENTIFIER_H
@@ -0,0 +1,155 @@
+//
+// Batched point cloud transforms; see point_cloud.h.
+//
+
+#include "point_cloud.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define POINT_CLOUD_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define POINT_CLOUD_SSE
+#endif
+
+rigid_transform make_transform(const imu::Quaternion &q, float tx, float ty, float tz)
+{
+	// Same terms as Quaternion::toMatrix(), divided by |q|^2 so a slightly
+	// denormalized attitude still gives a pure rotation
+	double w = q.w(), x = q.x(), y = q.y(), z = q.z();
+	double n = w*w + x*x + y*y + z*z;
+	double s = n > 0.0 ? 2.0 / n : 0.0;
+
+	rigid_transform tf;
+	tf.rot[0] = (float)(1 - s*(y*y + z*z));
+	tf.rot[1] = (float)(s*(x*y - w*z));
+	tf.rot[2] = (float)(s*(x*z + w*y));
+	tf.rot[3] = (float)(s*(x*y + w*z));
+	tf.rot[4] = (float)(1 - s*(x*x + z*z));
+	tf.rot[5] = (float)(s*(y*z - w*x));
+	tf.rot[6] = (float)(s*(x*z - w*y));
+	tf.rot[7] = (float)(s*(y*z + w*x));
+	tf.rot[8] = (float)(1 - s*(x*x + y*y));
+	tf.trans[0] = tx;
+	tf.trans[1] = ty;
+	tf.trans[2] = tz;
+	return tf;
+}
+
+rigid_transform make_transform(const imu::Matrix<3> &m, float tx, float ty, float tz)
+{
+	rigid_transform tf;
+	for (uint8_t i = 0; i < 3; i++)
+		for (uint8_t j = 0; j < 3; j++)
+			tf.rot[i*3 + j] = (float)m(i, j);
+	tf.trans[0] = tx;
+	tf.trans[1] = ty;
+	tf.trans[2] = tz;
+	return tf;
+}
+
+/**
+ * @brief Scalar transform of points [start, count); used for leftovers and as the
+ * fallback on targets without NEON or SSE.
+ */
+static void transform_scalar(const rigid_transform &tf, const float *xi, const float *yi, const float *zi,
+                             float *xo, float *yo, float *zo, size_t start, size_t count)
+{
+	const float *r = tf.rot;
+	for (size_t i = start; i < count; i++) {
+		float px = xi[i];
+		float py = yi[i];
+		float pz = zi ? zi[i] : 0.0f;
+		xo[i] = r[0]*px + r[1]*py + r[2]*pz + tf.trans[0];
+		yo[i] = r[3]*px + r[4]*py + r[5]*pz + tf.trans[1];
+		zo[i] = r[6]*px + r[7]*py + r[8]*pz + tf.trans[2];
+	}
+}
+
+/**
+ * @brief Vector transform of as many whole groups of four points as fit in count.
+ * A NULL zi means every z is zero.
+ * @return the number of points transformed
+ */
+static size_t transform_simd(const rigid_transform &tf, const float *xi, const float *yi, const float *zi,
+                             float *xo, float *yo, float *zo, size_t count)
+{
+	size_t blocks = count & ~(size_t)3;
+#if defined(POINT_CLOUD_NEON)
+	float32x4_t r0 = vdupq_n_f32(tf.rot[0]), r1 = vdupq_n_f32(tf.rot[1]), r2 = vdupq_n_f32(tf.rot[2]);
+	float32x4_t r3 = vdupq_n_f32(tf.rot[3]), r4 = vdupq_n_f32(tf.rot[4]), r5 = vdupq_n_f32(tf.rot[5]);
+	float32x4_t r6 = vdupq_n_f32(tf.rot[6]), r7 = vdupq_n_f32(tf.rot[7]), r8 = vdupq_n_f32(tf.rot[8]);
+	float32x4_t t0 = vdupq_n_f32(tf.trans[0]), t1 = vdupq_n_f32(tf.trans[1]), t2 = vdupq_n_f32(tf.trans[2]);
+
+	for (size_t i = 0; i < blocks; i += 4) {
+		float32x4_t px = vld1q_f32(xi + i);
+		float32x4_t py = vld1q_f32(yi + i);
+		float32x4_t ox = vmlaq_f32(vmlaq_f32(t0, r0, px), r1, py);
+		float32x4_t oy = vmlaq_f32(vmlaq_f32(t1, r3, px), r4, py);
+		float32x4_t oz = vmlaq_f32(vmlaq_f32(t2, r6, px), r7, py);
+		if (zi) {
+			float32x4_t pz = vld1q_f32(zi + i);
+			ox = vmlaq_f32(ox, r2, pz);
+			oy = vmlaq_f32(oy, r5, pz);
+			oz = vmlaq_f32(oz, r8, pz);
+		}
+		vst1q_f32(xo + i, ox);
+		vst1q_f32(yo + i, oy);
+		vst1q_f32(zo + i, oz);
+	}
+	return blocks;
+#elif defined(POINT_CLOUD_SSE)
+	__m128 r0 = _mm_set1_ps(tf.rot[0]), r1 = _mm_set1_ps(tf.rot[1]), r2 = _mm_set1_ps(tf.rot[2]);
+	__m128 r3 = _mm_set1_ps(tf.rot[3]), r4 = _mm_set1_ps(tf.rot[4]), r5 = _mm_set1_ps(tf.rot[5]);
+	__m128 r6 = _mm_set1_ps(tf.rot[6]), r7 = _mm_set1_ps(tf.rot[7]), r8 = _mm_set1_ps(tf.rot[8]);
+	__m128 t0 = _mm_set1_ps(tf.trans[0]), t1 = _mm_set1_ps(tf.trans[1]), t2 = _mm_set1_ps(tf.trans[2]);
+
+	for (size_t i = 0; i < blocks; i += 4) {
+		__m128 px = _mm_loadu_ps(xi + i);
+		__m128 py = _mm_loadu_ps(yi + i);
+		__m128 ox = _mm_add_ps(t0, _mm_add_ps(_mm_mul_ps(r0, px), _mm_mul_ps(r1, py)));
+		__m128 oy = _mm_add_ps(t1, _mm_add_ps(_mm_mul_ps(r3, px), _mm_mul_ps(r4, py)));
+		__m128 oz = _mm_add_ps(t2, _mm_add_ps(_mm_mul_ps(r6, px), _mm_mul_ps(r7, py)));
+		if (zi) {
+			__m128 pz = _mm_loadu_ps(zi + i);
+			ox = _mm_add_ps(ox, _mm_mul_ps(r2, pz));
+			oy = _mm_add_ps(oy, _mm_mul_ps(r5, pz));
+			oz = _mm_add_ps(oz, _mm_mul_ps(r8, pz));
+		}
+		_mm_storeu_ps(xo + i, ox);
+		_mm_storeu_ps(yo + i, oy);
+		_mm_storeu_ps(zo + i, oz);
+	}
+	return blocks;
+#else
+	(void)tf; (void)xi; (void)yi; (void)zi; (void)xo; (void)yo; (void)zo; (void)blocks;
+	return 0;
+#endif
+}
+
+void transform_points(const rigid_transform &tf, const point_cloud &in, point_cloud &out)
+{
+	// Every point is loaded before any of its outputs are stored, so in == out is safe
+	size_t done = transform_simd(tf, in.x, in.y, in.z, out.x, out.y, out.z, in.count);
+	transform_scalar(tf, in.x, in.y, in.z, out.x, out.y, out.z, done, in.count);
+	out.count = in.count;
+}
+
+void transform_points_scalar(const rigid_transform &tf, const point_cloud &in, point_cloud &out)
+{
+	transform_scalar(tf, in.x, in.y, in.z, out.x, out.y, out.z, 0, in.count);
+	out.count = in.count;
+}
+
+void rotate_points(const imu::Quaternion &q, point_cloud &cloud)
+{
+	transform_points(make_transform(q), cloud, cloud);
+}
+
+void transform_planar_points(const rigid_transform &tf, const float *x_in, const float *y_in,
+                             point_cloud &out, size_t count)
+{
+	size_t done = transform_simd(tf, x_in, y_in, NULL, out.x, out.y, out.z, count);
+	transform_scalar(tf, x_in, y_in, NULL, out.x, out.y, out.z, done, count);
+	out.count = count;
+}
@@ -0,0 +1,100 @@
+/**
+ * Batched rotation and rigid transformation of LiDAR point clouds by the IMU attitude.
+ * Calling imu::Quaternion::rotateVector() once per point works on one double precision
+ * imu::Vector<3> at a time and memsets every temporary, which is far too slow for a
+ * whole scan. These kernels instead work on a structure-of-arrays float buffer: the
+ * rotation is converted to a 3x3 float matrix once per call, then the whole buffer is
+ * swept four points at a time with NEON on the Raspberry Pi or SSE on an x86 host.
+ * Any points left over, or the whole cloud on other targets, use a plain scalar loop.
+ */
+
+#ifndef ME507_POINT_CLOUD_H
+#define ME507_POINT_CLOUD_H
+
+#include <cstddef>
+#include <cstdint>
+#include "quaternion.h"
+
+/**
+ * @brief A structure-of-arrays view of a set of 3D points.
+ * The buffers are owned by the caller; each must hold at least count floats. Two
+ * dimensional scans may leave z pointing at a buffer of zeros.
+ */
+struct point_cloud {
+	float *x;
+	float *y;
+	float *z;
+	size_t count;
+};
+
+/**
+ * @brief A rotation matrix and translation applied as p' = R p + t.
+ * The rotation is stored row-major.
+ */
+struct rigid_transform {
+	float rot[9];
+	float trans[3];
+};
+
+/**
+ * @brief Builds a rigid_transform from an IMU attitude and an offset.
+ * @param q The attitude; it does not need to be exactly normalized
+ * @param tx The x translation applied after the rotation
+ * @param ty The y translation applied after the rotation
+ * @param tz The z translation applied after the rotation
+ * @return the matching rigid_transform
+ */
+rigid_transform make_transform(const imu::Quaternion &q, float tx = 0.0f, float ty = 0.0f, float tz = 0.0f);
+
+/**
+ * @brief Builds a rigid_transform from a rotation matrix and an offset.
+ * @param m The rotation matrix
+ * @param tx The x translation applied after the rotation
+ * @param ty The y translation applied after the rotation
+ * @param tz The z translation applied after the rotation
+ * @return the matching rigid_transform
+ */
+rigid_transform make_transform(const imu::Matrix<3> &m, float tx = 0.0f, float ty = 0.0f, float tz = 0.0f);
+
+/**
+ * @brief Applies a rigid transform to every point of a cloud.
+ * in and out may be the same cloud to transform in place; otherwise their buffers
+ * must not overlap.
+ * @param tf The transform to apply
+ * @param in The points to transform
+ * @param out Where the transformed points are written; must hold in.count points
+ */
+void transform_points(const rigid_transform &tf, const point_cloud &in, point_cloud &out);
+
+/**
+ * @brief Applies a rigid transform with the plain scalar loop only.
+ * This is the loop transform_points() finishes with and falls back to; it is exposed
+ * so the vector paths can be checked and timed against it.
+ * @param tf The transform to apply
+ * @param in The points to transform
+ * @param out Where the transformed points are written; may be in
+ */
+void transform_points_scalar(const rigid_transform &tf, const point_cloud &in, point_cloud &out);
+
+/**
+ * @brief Rotates every point of a cloud in place by a quaternion.
+ * This gives the same result as calling q.rotateVector() on each point.
+ * @param q The rotation to apply
+ * @param cloud The points to rotate
+ */
+void rotate_points(const imu::Quaternion &q, point_cloud &cloud);
+
+/**
+ * @brief Applies a rigid transform to a planar scan, treating every z as zero.
+ * This saves the loads for a z buffer that would be all zeros.
+ * @param tf The transform to apply
+ * @param x_in The x coordinates of the scan
+ * @param y_in The y coordinates of the scan
+ * @param out Where the transformed points are written; must hold count points
+ * @param count The number of points in the scan
+ */
+void transform_planar_points(const rigid_transform &tf, const float *x_in, const float *y_in,
+                             point_cloud &out, size_t count);
+
+
+#endif //ME507_POINT_CLOUD_H
@@ -0,0 +1,366 @@
+//
+// ADMM quadratic program solver; see qp_solver.h.
+//
+
+#include <cmath>
+#include "qp_solver.h"
+
+#define MIN_RHO 1e-6f
+#define MAX_RHO 1e6f
+#define RHO_CHANGE 5.0f         // ratio rho must be off by before it is changed
+#define MIN_NORM 1e-6f          // row or column norm under which it is left unscaled
+#define MAX_SCALING 1e4f        // most a row or column is scaled up or down by in all
+
+qp_solver::qp_solver(const qp_settings &settings_in)
+{
+	settings = settings_in;
+	if (settings.check_every < 1)
+		settings.check_every = 1;
+	rho = settings.rho;
+	reset();
+}
+
+void qp_solver::reset()
+{
+	n = 0;
+	m = 0;
+	for (uint8_t i = 0; i < QP_MAX_VARIABLES; i++)
+		x[i] = 0.0f;
+	for (uint8_t i = 0; i < QP_MAX_CONSTRAINTS; i++) {
+		z[i] = 0.0f;
+		y[i] = 0.0f;
+	}
+}
+
+void qp_solver::shift(uint8_t stage_variables, uint8_t stage_blocks)
+{
+	if (stage_variables > 0 && n > stage_variables) {
+		for (uint8_t i = 0; i + stage_variables < n; i++)
+			x[i] = x[i + stage_variables];
+	}
+	if (stage_blocks == 0 || m % stage_blocks)
+		return;
+	uint8_t rows = m / stage_blocks;
+	for (uint8_t b = 0; b < stage_blocks; b++) {
+		float *zb = z + b * rows;
+		float *yb = y + b * rows;
+		for (uint8_t i = 0; i + 1 < rows; i++) {
+			zb[i] = zb[i + 1];
+			yb[i] = yb[i + 1];
+		}
+	}
+}
+
+/**
+ * The problem is first equilibrated, as OSQP does: a few passes of Ruiz scaling bring
+ * every column and row of [P C'; C 0] to about unit infinity norm, with the variables
+ * scaled by D and the rows by E, and the cost is then scaled by c so that neither P nor
+ * q dominates. A trailer reversing is unstable, and the far end of a horizon responds to
+ * the first steps tens of times more than to the last, which without the scaling leaves
+ * P too ill-conditioned for ADMM to converge in any useful number of iterations.
+ *
+ * Each iteration, on the scaled problem, with K = P + sigma I + rho C'C:
+ *   K x~ = sigma x - q + C' (rho z - y),   z~ = C x~
+ *   x = a x~ + (1 - a) x
+ *   z+ = clamp(a z~ + (1 - a) z + y / rho, lower, upper)
+ *   y += rho (a z~ + (1 - a) z - z+),   z = z+
+ * The residuals are checked unscaled, against the problem as given. On each check rho is
+ * moved towards rho sqrt(primal / dual), with both residuals relative to their own
+ * scale, when that is more than RHO_CHANGE away; only the factorization changes with it.
+ */
+qp_result qp_solver::solve(const qp_problem &problem)
+{
+	qp_result out;
+	out.converged = false;
+	out.iterations = 0;
+	out.factorizations = 0;
+	out.primal_residual = 0.0f;
+	out.dual_residual = 0.0f;
+
+	if (problem.n != n || problem.m != m) {
+		reset();
+		n = problem.n;
+		m = problem.m;
+	}
+	if (n == 0)
+		return out;
+
+	scale(problem);
+	for (uint8_t i = 0; i < n; i++)
+		xs[i] = x[i] / D[i];
+	for (uint8_t r = 0; r < m; r++) {
+		zs[r] = E[r] * z[r];
+		ys[r] = cost_scale * y[r] / E[r];
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+		for (uint8_t j = 0; j <= i; j++)
+			CtC[i][j] = 0.0f;
+	for (uint8_t r = 0; r < m; r++) {
+		for (uint8_t i = first[r]; i < last[r]; i++) {
+			float c = Cs[r][i];
+			for (uint8_t j = first[r]; j <= i; j++)
+				CtC[i][j] += c * Cs[r][j];
+		}
+	}
+	if (!factor()) {
+		unscale();
+		return out;
+	}
+	out.factorizations++;
+
+	float alpha = settings.alpha;
+	for (uint16_t it = 1; it <= settings.max_iterations; it++) {
+		for (uint8_t i = 0; i < n; i++)
+			rhs[i] = settings.sigma * xs[i] - qs[i];
+		for (uint8_t r = 0; r < m; r++) {
+			float w = rho * zs[r] - ys[r];
+			for (uint8_t i = first[r]; i < last[r]; i++)
+				rhs[i] += Cs[r][i] * w;
+		}
+		back_substitute(rhs);
+		for (uint8_t i = 0; i < n; i++) {
+			x_tilde[i] = rhs[i];
+			xs[i] = alpha * x_tilde[i] + (1.0f - alpha) * xs[i];
+		}
+		for (uint8_t r = 0; r < m; r++) {
+			float s = 0.0f;
+			for (uint8_t i = first[r]; i < last[r]; i++)
+				s += Cs[r][i] * x_tilde[i];
+			float relaxed = alpha * s + (1.0f - alpha) * zs[r];
+			float next = relaxed + ys[r] / rho;
+			if (next < ls[r])
+				next = ls[r];
+			else if (next > us[r])
+				next = us[r];
+			ys[r] += rho * (relaxed - next);
+			zs[r] = next;
+		}
+		out.iterations = it;
+
+		if (it % settings.check_every && it != settings.max_iterations)
+			continue;
+		float primal, dual, primal_scale, dual_scale;
+		residuals(primal, dual, primal_scale, dual_scale);
+		out.primal_residual = primal;
+		out.dual_residual = dual;
+		if (primal <= settings.eps_abs + settings.eps_rel * primal_scale &&
+		    dual <= settings.eps_abs + settings.eps_rel * dual_scale) {
+			out.converged = true;
+			break;
+		}
+
+		float ratio = sqrtf((primal / (primal_scale + 1e-9f)) / (dual / (dual_scale + 1e-9f) + 1e-9f));
+		if ((ratio > RHO_CHANGE || ratio * RHO_CHANGE < 1.0f) && it != settings.max_iterations) {
+			float next = rho * ratio;
+			if (next < MIN_RHO)
+				next = MIN_RHO;
+			else if (next > MAX_RHO)
+				next = MAX_RHO;
+			if (next != rho) {
+				float last = rho;
+				rho = next;
+				if (!factor()) {
+					rho = last;
+					factor();
+				}
+				out.factorizations++;
+			}
+		}
+	}
+	unscale();
+	return out;
+}
+
+/**
+ * Ruiz equilibration: each pass divides every column and row of [P C'; C 0] by the
+ * square root of its infinity norm. A pass is one sweep over P and C. The span of
+ * nonzeros of each row of C is noted on the way, and every product with C afterwards
+ * only runs over it: the curvature and rate rows of the MPC have one or two nonzeros,
+ * and its hitch rows are zero after their own step.
+ */
+void qp_solver::scale(const qp_problem &problem)
+{
+	for (uint8_t i = 0; i < n; i++) {
+		for (uint8_t j = 0; j <= i; j++)
+			Ps[i][j] = problem.P[i][j];
+		qs[i] = problem.q[i];
+		D[i] = 1.0f;
+	}
+	for (uint8_t r = 0; r < m; r++) {
+		first[r] = n;
+		last[r] = n;
+		for (uint8_t i = 0; i < n; i++) {
+			Cs[r][i] = problem.C[r][i];
+			if (Cs[r][i] != 0.0f) {
+				if (first[r] == n)
+					first[r] = i;
+				last[r] = i + 1;
+			}
+		}
+		E[r] = 1.0f;
+	}
+
+	for (uint8_t pass = 0; pass < settings.scaling_passes; pass++) {
+		float d[QP_MAX_VARIABLES];
+		for (uint8_t j = 0; j < n; j++)
+			d[j] = 0.0f;
+		for (uint8_t i = 0; i < n; i++) {
+			for (uint8_t j = 0; j <= i; j++) {
+				float a = fabsf(Ps[i][j]);
+				if (a > d[i])
+					d[i] = a;
+				if (a > d[j])
+					d[j] = a;
+			}
+		}
+		float e[QP_MAX_CONSTRAINTS];
+		for (uint8_t r = 0; r < m; r++) {
+			e[r] = 0.0f;
+			for (uint8_t i = first[r]; i < last[r]; i++) {
+				float a = fabsf(Cs[r][i]);
+				if (a > e[r])
+					e[r] = a;
+				if (a > d[i])
+					d[i] = a;
+			}
+		}
+		for (uint8_t j = 0; j < n; j++)
+			d[j] = scale_factor(d[j]);
+		for (uint8_t r = 0; r < m; r++) {
+			float f = scale_factor(e[r]);
+			E[r] *= f;
+			for (uint8_t i = first[r]; i < last[r]; i++)
+				Cs[r][i] *= f * d[i];
+		}
+		for (uint8_t i = 0; i < n; i++) {
+			for (uint8_t j = 0; j <= i; j++)
+				Ps[i][j] *= d[i] * d[j];
+			qs[i] *= d[i];
+			D[i] *= d[i];
+		}
+	}
+
+	float mean_norm = 0.0f, q_norm = 0.0f;
+	for (uint8_t j = 0; j < n; j++) {
+		float norm = 0.0f;
+		for (uint8_t i = 0; i < n; i++)
+			norm = fmaxf(norm, fabsf(i >= j ? Ps[i][j] : Ps[j][i]));
+		mean_norm += norm / n;
+		q_norm = fmaxf(q_norm, fabsf(qs[j]));
+	}
+	cost_scale = scale_factor(fmaxf(mean_norm, q_norm));
+	cost_scale *= cost_scale;
+	for (uint8_t i = 0; i < n; i++) {
+		for (uint8_t j = 0; j <= i; j++)
+			Ps[i][j] *= cost_scale;
+		qs[i] *= cost_scale;
+	}
+
+	for (uint8_t r = 0; r < m; r++) {
+		ls[r] = problem.lower[r] <= -QP_INFINITY ? -QP_INFINITY : E[r] * problem.lower[r];
+		us[r] = problem.upper[r] >= QP_INFINITY ? QP_INFINITY : E[r] * problem.upper[r];
+	}
+}
+
+/**
+ * The factor a row or column of infinity norm norm is multiplied by: 1 / sqrt(norm),
+ * left at 1 for an empty one and kept within MAX_SCALING either way.
+ */
+float qp_solver::scale_factor(float norm)
+{
+	if (norm < MIN_NORM)
+		return 1.0f;
+	float f = 1.0f / sqrtf(norm);
+	if (f > MAX_SCALING)
+		f = MAX_SCALING;
+	else if (f < 1.0f / MAX_SCALING)
+		f = 1.0f / MAX_SCALING;
+	return f;
+}
+
+void qp_solver::unscale()
+{
+	for (uint8_t i = 0; i < n; i++)
+		x[i] = D[i] * xs[i];
+	for (uint8_t r = 0; r < m; r++) {
+		z[r] = zs[r] / E[r];
+		y[r] = E[r] * ys[r] / cost_scale;
+	}
+}
+
+/**
+ * Cholesky factorization of P + sigma I + rho C'C into L, lower triangle only.
+ */
+bool qp_solver::factor()
+{
+	for (uint8_t j = 0; j < n; j++) {
+		float d = Ps[j][j] + settings.sigma + rho * CtC[j][j];
+		for (uint8_t k = 0; k < j; k++)
+			d -= L[j][k] * L[j][k];
+		if (d <= 0.0f)
+			return false;
+		d = sqrtf(d);
+		L[j][j] = d;
+		float inv_d = 1.0f / d;
+		for (uint8_t i = j + 1; i < n; i++) {
+			float s = Ps[i][j] + rho * CtC[i][j];
+			for (uint8_t k = 0; k < j; k++)
+				s -= L[i][k] * L[j][k];
+			L[i][j] = s * inv_d;
+		}
+	}
+	return true;
+}
+
+void qp_solver::back_substitute(float *b) const
+{
+	// L w = b, then L' x = w
+	for (uint8_t i = 0; i < n; i++) {
+		float s = b[i];
+		for (uint8_t k = 0; k < i; k++)
+			s -= L[i][k] * b[k];
+		b[i] = s / L[i][i];
+	}
+	for (int i = n - 1; i >= 0; i--) {
+		float s = b[i];
+		for (uint8_t k = i + 1; k < n; k++)
+			s -= L[k][i] * b[k];
+		b[i] = s / L[i][i];
+	}
+}
+
+/**
+ * The residuals of the problem as given: the primal C x - z is the scaled one divided by
+ * E, the dual P x + q + C' y the scaled one divided by c D.
+ */
+void qp_solver::residuals(float &primal, float &dual, float &primal_scale, float &dual_scale) const
+{
+	primal = 0.0f;
+	primal_scale = 0.0f;
+	for (uint8_t r = 0; r < m; r++) {
+		float s = 0.0f;
+		for (uint8_t i = first[r]; i < last[r]; i++)
+			s += Cs[r][i] * xs[i];
+		primal = fmaxf(primal, fabsf(s - zs[r]) / E[r]);
+		primal_scale = fmaxf(primal_scale, fmaxf(fabsf(s), fabsf(zs[r])) / E[r]);
+	}
+
+	float px_max = 0.0f, cty_max = 0.0f, q_max = 0.0f;
+	dual = 0.0f;
+	for (uint8_t i = 0; i < n; i++) {
+		float px = 0.0f;
+		for (uint8_t j = 0; j < n; j++)
+			px += (j <= i ? Ps[i][j] : Ps[j][i]) * xs[j];
+		float cty = 0.0f;
+		for (uint8_t r = 0; r < m; r++)
+			if (i >= first[r] && i < last[r])
+				cty += Cs[r][i] * ys[r];
+		float unscale = 1.0f / (cost_scale * D[i]);
+		dual = fmaxf(dual, fabsf(px + qs[i] + cty) * unscale);
+		px_max = fmaxf(px_max, fabsf(px) * unscale);
+		cty_max = fmaxf(cty_max, fabsf(cty) * unscale);
+		q_max = fmaxf(q_max, fabsf(qs[i]) * unscale);
+	}
+	dual_scale = fmaxf(px_max, fmaxf(cty_max, q_max));
+}
@@ -0,0 +1,173 @@
+/**
+ * The qp_solver solves the small quadratic programs the model-predictive steering sets up
+ * every control period:
+ *
+ *   minimize 1/2 x' P x + q' x   subject to   lower <= C x <= upper
+ *
+ * with the alternating direction method of multipliers, in the form OSQP uses. Each
+ * iteration solves one linear system with the fixed matrix P + sigma I + rho C' C, which
+ * is factored once per solve by Cholesky, and projects C x onto the bounds. An iteration
+ * is a few thousand flops at the sizes used here, so a solve is bounded by
+ * max_iterations and takes the same time whether or not the bounds are active.
+ *
+ * The problem is equilibrated before each solve, so rows and variables of very different
+ * sizes, as a reversing trailer's horizon has, still converge.
+ *
+ * Every array is sized for QP_MAX_VARIABLES and QP_MAX_CONSTRAINTS at compile time, so
+ * nothing is allocated, and the solver is meant to be kept from one period to the next:
+ * solve() starts from where the last solve ended. Problems laid out stage by stage, as
+ * the MPC's are, can move that start one stage on with shift() first. rho is adapted to
+ * balance the residuals, but only when it is off by a wide margin, as each change costs
+ * a new factorization.
+ */
+
+#ifndef ME507_QP_SOLVER_H
+#define ME507_QP_SOLVER_H
+
+#include <cstdint>
+
+/// Most variables a problem may have
+#define QP_MAX_VARIABLES 30
+/// Most constraint rows a problem may have
+#define QP_MAX_CONSTRAINTS 90
+/// A bound at or beyond this is taken as no bound at all
+#define QP_INFINITY 1e20f
+
+/**
+ * @brief Settings of a qp_solver.
+ * @var rho starting step size of the constraint penalty; kept between solves once adapted
+ * @var sigma small regularization that keeps the system positive definite
+ * @var alpha relaxation, between 1 and 2; 1.6 is usually fastest
+ * @var eps_abs absolute tolerance on the primal and dual residuals
+ * @var eps_rel tolerance on the residuals relative to the size of the terms in them
+ * @var max_iterations most iterations per solve
+ * @var check_every iterations between checks of the residuals
+ * @var scaling_passes passes of Ruiz equilibration before each solve; 0 for none
+ */
+struct qp_settings {
+	float    rho;
+	float    sigma;
+	float    alpha;
+	float    eps_abs;
+	float    eps_rel;
+	uint16_t max_iterations;
+	uint16_t check_every;
+	uint8_t  scaling_passes;
+};
+
+/**
+ * @brief One quadratic program. Only the first n columns and m rows are used.
+ * @var n number of variables, at most QP_MAX_VARIABLES
+ * @var m number of constraint rows, at most QP_MAX_CONSTRAINTS
+ * @var P the cost's Hessian; symmetric and positive semidefinite, only the lower
+ * triangle is read
+ * @var q the cost's linear term
+ * @var C the constraint rows
+ * @var lower lower bound of each row, -QP_INFINITY for none
+ * @var upper upper bound of each row, QP_INFINITY for none
+ */
+struct qp_problem {
+	uint8_t n;
+	uint8_t m;
+	float   P[QP_MAX_VARIABLES][QP_MAX_VARIABLES];
+	float   q[QP_MAX_VARIABLES];
+	float   C[QP_MAX_CONSTRAINTS][QP_MAX_VARIABLES];
+	float   lower[QP_MAX_CONSTRAINTS];
+	float   upper[QP_MAX_CONSTRAINTS];
+};
+
+/**
+ * @brief How a solve went.
+ * @var converged true if both residuals got under their tolerances
+ * @var iterations iterations run
+ * @var factorizations Cholesky factorizations done, one plus one per change of rho
+ * @var primal_residual largest violation of C x = z at the end
+ * @var dual_residual largest element of P x + q + C' y at the end
+ */
+struct qp_result {
+	bool     converged;
+	uint16_t iterations;
+	uint8_t  factorizations;
+	float    primal_residual;
+	float    dual_residual;
+};
+
+class qp_solver {
+public:
+	/**
+	 * @brief The constructor for a solver that starts its first solve from zero.
+	 * @param settings_in The solver settings
+	 */
+	qp_solver(const qp_settings &settings_in);
+
+	/**
+	 * @brief Forgets the last solution, so the next solve starts from zero.
+	 */
+	void reset();
+
+	/**
+	 * @brief Moves the last solution on by one stage, for a problem made of equal
+	 * stages of variables and of constraints, such as one step of a horizon each.
+	 * Each stage takes the values of the one after it and the last stage keeps its own.
+	 * @param stage_variables Variables in one stage
+	 * @param stage_blocks Number of blocks the constraint rows are split into; the rows
+	 * of each block are one per stage and are moved within their block
+	 */
+	void shift(uint8_t stage_variables, uint8_t stage_blocks);
+
+	/**
+	 * @brief Solves a problem, starting from the last solution if it had the same size.
+	 * If it does not converge in max_iterations the last iterate is kept; the projected
+	 * z always meets the bounds, even then.
+	 * @param problem The problem
+	 * @return how the solve went
+	 */
+	qp_result solve(const qp_problem &problem);
+
+	/// The solution of the last solve
+	const float *get_x() const { return x; }
+	/// C x projected onto the bounds, from the last solve
+	const float *get_z() const { return z; }
+	float get_rho() const { return rho; }
+
+private:
+	qp_settings settings;
+	float rho;
+	uint8_t n;                  // size of the last problem solved, 0 before the first
+	uint8_t m;
+
+	float x[QP_MAX_VARIABLES];
+	float z[QP_MAX_CONSTRAINTS];
+	float y[QP_MAX_CONSTRAINTS];
+
+	// The problem scaled, its scaling and the iterates on it; kept as members so solve()
+	// never allocates or needs a large stack
+	float Ps[QP_MAX_VARIABLES][QP_MAX_VARIABLES];
+	float qs[QP_MAX_VARIABLES];
+	float Cs[QP_MAX_CONSTRAINTS][QP_MAX_VARIABLES];
+	float ls[QP_MAX_CONSTRAINTS];
+	float us[QP_MAX_CONSTRAINTS];
+	float D[QP_MAX_VARIABLES];
+	float E[QP_MAX_CONSTRAINTS];
+	float cost_scale;
+	uint8_t first[QP_MAX_CONSTRAINTS];   // span of each row's nonzeros, first to last - 1
+	uint8_t last[QP_MAX_CONSTRAINTS];
+	float xs[QP_MAX_VARIABLES];
+	float zs[QP_MAX_CONSTRAINTS];
+	float ys[QP_MAX_CONSTRAINTS];
+
+	float CtC[QP_MAX_VARIABLES][QP_MAX_VARIABLES];
+	float L[QP_MAX_VARIABLES][QP_MAX_VARIABLES];
+	float rhs[QP_MAX_VARIABLES];
+	float x_tilde[QP_MAX_VARIABLES];
+
+	void scale(const qp_problem &problem);
+	static float scale_factor(float norm);
+	void unscale();
+	bool factor();
+	void back_substitute(float *b) const;
+	void residuals(float &primal, float &dual, float &primal_scale, float &dual_scale) const;
+};
+
+
+#endif //ME507_QP_SOLVER_H
@@ -0,0 +1,238 @@
+//
+// Motion deskewing of LiDAR sweeps; see scan_deskew.h.
+//
+
+#include <chrono>
+#include <cmath>
+#include "control_loop.h"
+#include "scan_deskew.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCAN_DESKEW_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define SCAN_DESKEW_SSE
+#endif
+
+scan_deskew::scan_deskew(uint32_t max_extrapolation_us_in)
+{
+	max_extrapolation_us = max_extrapolation_us_in;
+	head = 0;
+	count = 0;
+	last_run_us = 0;
+	max_run_us = 0;
+	extrapolated_count = 0;
+	skipped_count = 0;
+}
+
+void scan_deskew::add_odometry(uint64_t time_us, uint16_t imu_angle, int16_t wheel_speed)
+{
+	float heading = control_loop::imu_angle_to_heading(imu_angle);
+	float speed = wheel_speed / WHEEL_SPEED_PER_M_S;
+
+	std::lock_guard<std::mutex> guard(lock);
+	pose_sample next;
+	next.time_us = time_us;
+	next.speed = speed;
+	if (count == 0) {
+		next.x = 0.0f;
+		next.y = 0.0f;
+		next.heading = heading;
+		next.turn_rate = 0.0f;
+	}
+	else {
+		const pose_sample &prev = at(count - 1);
+		if (time_us <= prev.time_us)
+			return;
+		float dt = (time_us - prev.time_us) * 1e-6f;
+
+		// Unwrap against the last heading, then drive the mean speed along the mean heading
+		float turn = heading - prev.heading;
+		turn -= 2.0f * (float)M_PI * floorf((turn + (float)M_PI) / (2.0f * (float)M_PI));
+		next.heading = prev.heading + turn;
+		float distance = 0.5f * (prev.speed + speed) * dt;
+		float mid = prev.heading + turn / 2;
+		next.x = prev.x + distance * cosf(mid);
+		next.y = prev.y + distance * sinf(mid);
+		next.turn_rate = turn / dt;
+	}
+
+	if (count == ODOMETRY_CAPACITY) {
+		head = (head + 1) % ODOMETRY_CAPACITY;
+		count--;
+	}
+	samples[(head + count) % ODOMETRY_CAPACITY] = next;
+	count++;
+}
+
+bool scan_deskew::pose_at(uint64_t time_us, float &x, float &y, float &heading, bool &extrapolated) const
+{
+	extrapolated = false;
+	if (count == 0 || time_us < at(0).time_us)
+		return false;
+
+	const pose_sample &last = at(count - 1);
+	if (time_us >= last.time_us) {
+		uint64_t ahead = time_us - last.time_us;
+		if (ahead > max_extrapolation_us)
+			return false;
+		float dt = ahead * 1e-6f;
+		float mid = last.heading + 0.5f * last.turn_rate * dt;
+		x = last.x + last.speed * dt * cosf(mid);
+		y = last.y + last.speed * dt * sinf(mid);
+		heading = last.heading + last.turn_rate * dt;
+		extrapolated = ahead > 0;
+		return true;
+	}
+
+	// The first sample newer than time_us, by binary search
+	uint16_t lo = 1, hi = count - 1;
+	while (lo < hi) {
+		uint16_t mid = lo + (hi - lo) / 2;
+		if (at(mid).time_us <= time_us)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	const pose_sample &a = at(lo - 1);
+	const pose_sample &b = at(lo);
+	float f = (float)(time_us - a.time_us) / (float)(b.time_us - a.time_us);
+	x = a.x + f * (b.x - a.x);
+	y = a.y + f * (b.y - a.y);
+	heading = a.heading + f * (b.heading - a.heading);
+	return true;
+}
+
+bool scan_deskew::motion(uint64_t from_us, uint64_t to_us, float &dx, float &dy, float &dtheta)
+{
+	float x0, y0, h0, x1, y1, h1;
+	bool e0, e1;
+	std::lock_guard<std::mutex> guard(lock);
+	if (!pose_at(from_us, x0, y0, h0, e0) || !pose_at(to_us, x1, y1, h1, e1))
+		return false;
+	float c = cosf(h0), s = sinf(h0);
+	dx = c * (x1 - x0) + s * (y1 - y0);
+	dy = -s * (x1 - x0) + c * (y1 - y0);
+	dtheta = h1 - h0;
+	return true;
+}
+
+/**
+ * Applies p' = R(theta) p + t with theta, tx and ty linear in the point's fraction of
+ * the sweep. The turn over one sweep is a few hundredths of a radian at most, so the
+ * sine and cosine are short Taylor series, good to 1e-6 up to 0.3 rad.
+ */
+static void correct_segment(const float *f, float *x, float *y, uint16_t begin, uint16_t end, float f0,
+                            float theta0, float theta_slope, float tx0, float tx_slope, float ty0, float ty_slope)
+{
+	uint16_t i = begin;
+#if defined(SCAN_DESKEW_NEON)
+	float32x4_t vf0 = vdupq_n_f32(f0);
+	float32x4_t vt0 = vdupq_n_f32(theta0), vts = vdupq_n_f32(theta_slope);
+	float32x4_t vx0 = vdupq_n_f32(tx0), vxs = vdupq_n_f32(tx_slope);
+	float32x4_t vy0 = vdupq_n_f32(ty0), vys = vdupq_n_f32(ty_slope);
+	float32x4_t one = vdupq_n_f32(1.0f), half = vdupq_n_f32(0.5f);
+	float32x4_t c24 = vdupq_n_f32(1.0f / 24), c6 = vdupq_n_f32(1.0f / 6), c120 = vdupq_n_f32(1.0f / 120);
+	for (; i + 4 <= end; i += 4) {
+		float32x4_t d = vsubq_f32(vld1q_f32(f + i), vf0);
+		float32x4_t th = vmlaq_f32(vt0, vts, d);
+		float32x4_t tx = vmlaq_f32(vx0, vxs, d);
+		float32x4_t ty = vmlaq_f32(vy0, vys, d);
+		float32x4_t t2 = vmulq_f32(th, th);
+		float32x4_t c = vmlaq_f32(vmlsq_f32(one, half, t2), c24, vmulq_f32(t2, t2));
+		float32x4_t s = vmulq_f32(th, vmlaq_f32(vmlsq_f32(one, c6, t2), c120, vmulq_f32(t2, t2)));
+		float32x4_t px = vld1q_f32(x + i), py = vld1q_f32(y + i);
+		vst1q_f32(x + i, vaddq_f32(tx, vmlsq_f32(vmulq_f32(c, px), s, py)));
+		vst1q_f32(y + i, vaddq_f32(ty, vmlaq_f32(vmulq_f32(s, px), c, py)));
+	}
+#elif defined(SCAN_DESKEW_SSE)
+	__m128 vf0 = _mm_set1_ps(f0);
+	__m128 vt0 = _mm_set1_ps(theta0), vts = _mm_set1_ps(theta_slope);
+	__m128 vx0 = _mm_set1_ps(tx0), vxs = _mm_set1_ps(tx_slope);
+	__m128 vy0 = _mm_set1_ps(ty0), vys = _mm_set1_ps(ty_slope);
+	__m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+	__m128 c24 = _mm_set1_ps(1.0f / 24), c6 = _mm_set1_ps(1.0f / 6), c120 = _mm_set1_ps(1.0f / 120);
+	for (; i + 4 <= end; i += 4) {
+		__m128 d = _mm_sub_ps(_mm_loadu_ps(f + i), vf0);
+		__m128 th = _mm_add_ps(vt0, _mm_mul_ps(vts, d));
+		__m128 tx = _mm_add_ps(vx0, _mm_mul_ps(vxs, d));
+		__m128 ty = _mm_add_ps(vy0, _mm_mul_ps(vys, d));
+		__m128 t2 = _mm_mul_ps(th, th);
+		__m128 t4 = _mm_mul_ps(t2, t2);
+		__m128 c = _mm_add_ps(_mm_sub_ps(one, _mm_mul_ps(half, t2)), _mm_mul_ps(c24, t4));
+		__m128 s = _mm_mul_ps(th, _mm_add_ps(_mm_sub_ps(one, _mm_mul_ps(c6, t2)), _mm_mul_ps(c120, t4)));
+		__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i);
+		_mm_storeu_ps(x + i, _mm_add_ps(tx, _mm_sub_ps(_mm_mul_ps(c, px), _mm_mul_ps(s, py))));
+		_mm_storeu_ps(y + i, _mm_add_ps(ty, _mm_add_ps(_mm_mul_ps(s, px), _mm_mul_ps(c, py))));
+	}
+#endif
+	for (; i < end; i++) {
+		float d = f[i] - f0;
+		float th = theta0 + theta_slope * d;
+		float t2 = th * th;
+		float c = 1.0f - 0.5f * t2 + t2 * t2 / 24;
+		float s = th * (1.0f - t2 / 6 + t2 * t2 / 120);
+		float px = x[i], py = y[i];
+		x[i] = tx0 + tx_slope * d + c * px - s * py;
+		y[i] = ty0 + ty_slope * d + s * px + c * py;
+	}
+}
+
+bool scan_deskew::correct(uint64_t time_us, uint32_t sweep_us, const float *fraction, float *x, float *y,
+                          uint16_t count_in)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// The truck's pose at each knot, relative to where it was at the start of the sweep
+	float kx[DESKEW_KNOTS + 1], ky[DESKEW_KNOTS + 1], kt[DESKEW_KNOTS + 1];
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		float x0, y0, h0;
+		bool extrapolated, any = false;
+		if (!pose_at(time_us, x0, y0, h0, extrapolated)) {
+			skipped_count++;
+			return false;
+		}
+		float c = cosf(h0), s = sinf(h0);
+		for (uint8_t k = 0; k <= DESKEW_KNOTS; k++) {
+			float x1, y1, h1;
+			if (!pose_at(time_us + (uint64_t)sweep_us * k / DESKEW_KNOTS, x1, y1, h1, extrapolated)) {
+				skipped_count++;
+				return false;
+			}
+			any = any || extrapolated;
+			kx[k] = c * (x1 - x0) + s * (y1 - y0);
+			ky[k] = -s * (x1 - x0) + c * (y1 - y0);
+			kt[k] = h1 - h0;
+		}
+		if (any)
+			extrapolated_count++;
+	}
+
+	uint16_t begin = 0;
+	for (uint8_t k = 0; k < DESKEW_KNOTS && begin < count_in; k++) {
+		float f0 = (float)k / DESKEW_KNOTS;
+		float limit = (float)(k + 1) / DESKEW_KNOTS;
+		uint16_t end = begin;
+		if (k + 1 == DESKEW_KNOTS)
+			end = count_in;
+		else
+			while (end < count_in && fraction[end] < limit)
+				end++;
+		float scale = (float)DESKEW_KNOTS;
+		correct_segment(fraction, x, y, begin, end, f0,
+		                kt[k], (kt[k + 1] - kt[k]) * scale,
+		                kx[k], (kx[k + 1] - kx[k]) * scale,
+		                ky[k], (ky[k + 1] - ky[k]) * scale);
+		begin = end;
+	}
+
+	uint32_t run_us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	std::lock_guard<std::mutex> guard(lock);
+	last_run_us = run_us;
+	if (run_us > max_run_us)
+		max_run_us = run_us;
+	return true;
+}
@@ -0,0 +1,106 @@
+/**
+ * The scan_deskew removes the smear a sweep picks up while the truck moves. The Hokuyo
+ * measures its rays one after another over 25 to 40 ms, so in a turn the last rays are
+ * taken from a noticeably different pose than the first and a straight wall comes out
+ * bent. The Mega's imu_angle and wheel_speed are dead-reckoned into a short history of
+ * poses; for a scan, the truck's motion from the start of the sweep is looked up at a
+ * few knots across it and every point is moved back by the motion at its own time,
+ * interpolated linearly between the knots. The points then all read as if they had
+ * been measured at the start of the sweep, which is the scan's time_us.
+ *
+ * The correction runs on the points in the truck frame, four at a time with NEON on
+ * the Pi or SSE on an x86 host. It never waits for odometry: when the newest sample is
+ * older than the end of the sweep, the motion is extrapolated from the last speed and
+ * turn rate, at most max_extrapolation_us ahead. So the only latency it adds is its own
+ * run time, which it measures.
+ */
+
+#ifndef ME507_SCAN_DESKEW_H
+#define ME507_SCAN_DESKEW_H
+
+#include <cstdint>
+#include <mutex>
+
+/// Odometry samples kept; at the Pi's 20 ms link period this is about 2.5 s
+#define ODOMETRY_CAPACITY 128
+/// Points where the motion is looked up across a sweep; it is linear in between
+#define DESKEW_KNOTS 5
+
+class scan_deskew {
+public:
+	/**
+	 * @brief The constructor for a scan_deskew with no odometry yet.
+	 * @param max_extrapolation_us_in Longest past the newest odometry sample the motion
+	 * may be extrapolated (us)
+	 */
+	scan_deskew(uint32_t max_extrapolation_us_in);
+
+	/**
+	 * @brief Adds an odometry sample from the Mega. Safe to call from any thread.
+	 * @param time_us When it was measured, on the host clock (us)
+	 * @param imu_angle The BNO055 heading, as in semi_truck_data_t
+	 * @param wheel_speed The wheel speed, as in semi_truck_data_t
+	 */
+	void add_odometry(uint64_t time_us, uint16_t imu_angle, int16_t wheel_speed);
+
+	/**
+	 * @brief Gets how the truck moved between two times.
+	 * @param from_us The earlier time (us)
+	 * @param to_us The later time (us)
+	 * @param dx Set to the rear axle's move forward, in the truck frame at from_us (m)
+	 * @param dy Set to the rear axle's move to the left, in the same frame (m)
+	 * @param dtheta Set to the change of heading (rad)
+	 * @return false if the odometry does not cover both times
+	 */
+	bool motion(uint64_t from_us, uint64_t to_us, float &dx, float &dy, float &dtheta);
+
+	/**
+	 * @brief Moves the points of one sweep to where they were at its start.
+	 * @param time_us Start of the sweep, on the host clock (us)
+	 * @param sweep_us Time from the first ray to the last (us)
+	 * @param fraction How far through the sweep each point was measured, from 0 to 1;
+	 * must not decrease from one point to the next
+	 * @param x x of every point in the truck frame, corrected in place (m)
+	 * @param y y of every point in the truck frame, corrected in place (m)
+	 * @param count Number of points
+	 * @return false, leaving the points as they were, if there is no odometry for the
+	 * sweep
+	 */
+	bool correct(uint64_t time_us, uint32_t sweep_us, const float *fraction, float *x, float *y, uint16_t count);
+
+	/// Run time of the last correct() (us)
+	uint32_t get_last_run_us() const { return last_run_us; }
+	/// Longest run time of correct() so far (us)
+	uint32_t get_max_run_us() const { return max_run_us; }
+	/// Number of sweeps whose end was past the newest odometry
+	uint32_t get_extrapolated_count() const { return extrapolated_count; }
+	/// Number of sweeps left uncorrected for lack of odometry
+	uint32_t get_skipped_count() const { return skipped_count; }
+
+private:
+	struct pose_sample {
+		uint64_t time_us;
+		float x;
+		float y;
+		float heading;        // unwrapped, so it can be interpolated
+		float speed;
+		float turn_rate;
+	};
+
+	uint32_t max_extrapolation_us;
+	pose_sample samples[ODOMETRY_CAPACITY];
+	uint16_t head;            // index of the oldest sample
+	uint16_t count;
+	std::mutex lock;
+
+	uint32_t last_run_us;
+	uint32_t max_run_us;
+	uint32_t extrapolated_count;
+	uint32_t skipped_count;
+
+	const pose_sample &at(uint16_t i) const { return samples[(head + i) % ODOMETRY_CAPACITY]; }
+	bool pose_at(uint64_t time_us, float &x, float &y, float &heading, bool &extrapolated) const;
+};
+
+
+#endif //ME507_SCAN_DESKEW_H
@@ -0,0 +1,154 @@
+//
+// Time-aligned merging of several LiDARs' scans; see scan_merger.h.
+//
+
+#include <cstring>
+#include "scan_merger.h"
+
+scan_merger::scan_merger(uint8_t sensor_count_in, uint32_t max_wait_us_in, uint32_t sync_window_us_in)
+{
+	sensor_count = sensor_count_in > MAX_LIDARS ? MAX_LIDARS : sensor_count_in;
+	max_wait_us = max_wait_us_in;
+	sync_window_us = sync_window_us_in;
+	for (uint8_t i = 0; i < MAX_LIDARS; i++) {
+		back[i] = &buffers[i][0];
+		ready[i] = &buffers[i][1];
+		merging[i] = &buffers[i][2];
+	}
+	ready_mask = 0;
+	first_arrival_us = 0;
+	stopping = false;
+	memset(&stats, 0, sizeof(stats));
+}
+
+sensor_points &scan_merger::back_buffer(uint8_t sensor)
+{
+	return *back[sensor];
+}
+
+void scan_merger::push(uint8_t sensor)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		uint8_t bit = (uint8_t)(1 << sensor);
+		if (ready_mask & bit)
+			stats.overwritten_scans++;
+		sensor_points *t = ready[sensor];
+		ready[sensor] = back[sensor];
+		back[sensor] = t;
+		if (!ready_mask)
+			first_arrival_us = ready[sensor]->arrival_us;
+		ready_mask |= bit;
+	}
+	arrived.notify_one();
+}
+
+bool scan_merger::wait(merged_scan &out, uint32_t timeout_us)
+{
+	uint8_t all = (uint8_t)((1 << sensor_count) - 1);
+	uint8_t mask;
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		uint64_t give_up = host_time_us() + timeout_us;
+		for (;;) {
+			if (stopping)
+				return false;
+			uint64_t now = host_time_us();
+			if (ready_mask == all)
+				break;
+			uint64_t until = ready_mask ? first_arrival_us + max_wait_us : give_up;
+			if (now >= until) {
+				if (ready_mask)
+					break;
+				return false;
+			}
+			arrived.wait_for(guard, std::chrono::microseconds(until - now));
+		}
+
+		// Take the ready scans; the sensors go on pushing into the other two buffers
+		// while they are copied out
+		mask = ready_mask;
+		for (uint8_t i = 0; i < sensor_count; i++) {
+			if (mask & (1 << i)) {
+				sensor_points *t = merging[i];
+				merging[i] = ready[i];
+				ready[i] = t;
+			}
+		}
+		ready_mask = 0;
+	}
+
+	merge(merging, mask, host_time_us(), out);
+	return true;
+}
+
+void scan_merger::merge(const sensor_points *const *scans, uint8_t mask, uint64_t now_us, merged_scan &out)
+{
+	uint64_t newest = 0;
+	for (uint8_t i = 0; i < sensor_count; i++)
+		if ((mask & (1 << i)) && scans[i]->time_us > newest)
+			newest = scans[i]->time_us;
+
+	uint8_t stale = 0;
+	uint64_t oldest = newest, first_arrival = now_us;
+	out.time_us = newest;
+	out.sources = 0;
+	out.count = 0;
+	for (uint8_t i = 0; i < sensor_count; i++) {
+		if (!(mask & (1 << i)))
+			continue;
+		const sensor_points &s = *scans[i];
+		if (newest - s.time_us > sync_window_us) {
+			stale++;
+			continue;
+		}
+		out.sources |= (uint8_t)(1 << i);
+		out.source_time_us[i] = s.time_us;
+		out.source_sweep_us[i] = s.sweep_us;
+		out.source_begin[i] = out.count;
+		memcpy(&out.x[out.count], s.x, s.count * sizeof(float));
+		memcpy(&out.y[out.count], s.y, s.count * sizeof(float));
+		memcpy(&out.flags[out.count], s.flags, s.count);
+		memset(&out.source[out.count], i, s.count);
+		out.count += s.count;
+		if (s.time_us < oldest)
+			oldest = s.time_us;
+		if (s.arrival_us < first_arrival)
+			first_arrival = s.arrival_us;
+	}
+
+	// Measure after the copy, so the figures include everything the merge added
+	uint64_t done_us = host_time_us();
+	uint32_t waited = (uint32_t)(done_us - first_arrival);
+	uint32_t age = (uint32_t)(done_us - oldest);
+	uint32_t skew = (uint32_t)(newest - oldest);
+
+	std::lock_guard<std::mutex> guard(lock);
+	stats.merges++;
+	if (out.sources != (uint8_t)((1 << sensor_count) - 1))
+		stats.partial_merges++;
+	stats.stale_scans += stale;
+	stats.sum_wait_us += waited;
+	if (waited > stats.max_wait_us)
+		stats.max_wait_us = waited;
+	stats.sum_age_us += age;
+	if (age > stats.max_age_us)
+		stats.max_age_us = age;
+	if (skew > stats.max_skew_us)
+		stats.max_skew_us = skew;
+}
+
+void scan_merger::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	arrived.notify_all();
+}
+
+merger_stats scan_merger::get_stats() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
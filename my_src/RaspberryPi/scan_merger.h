@@ -0,0 +1,175 @@
+/**
+ * The scan_merger fuses the scans of several LiDARs into one set of points in the truck
+ * frame (x forward from the tractor's rear axle, y to the left). Each LiDAR_sensor
+ * thread converts its own scans to the truck frame and pushes them in; the consumer
+ * calls wait() and gets a merged_scan holding the newest scan of every sensor.
+ *
+ * A merge goes out as soon as every sensor has delivered a scan since the last one,
+ * or max_wait_us after the first of them arrived, whichever is sooner. A sensor that is
+ * late or has stopped therefore delays the others by at most max_wait_us, and its scan
+ * is simply left out. Keeping max_wait_us a little under the scan period bounds the
+ * added latency by one period and lets a merge without the missing sensor go out
+ * before the next scan of the others arrives and would replace the waiting one. Scans
+ * taken more than sync_window_us before the newest one are left out as well, so one
+ * merge never mixes views from far apart in time.
+ *
+ * Every merge records how long the scans waited in the merger and how old they were,
+ * so the added latency can be checked against the scan period while the truck runs.
+ */
+
+#ifndef ME507_SCAN_MERGER_H
+#define ME507_SCAN_MERGER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include "host_clock.h"
+#include "lidar_scan.h"
+
+/// Most LiDARs one merger accepts
+#define MAX_LIDARS 4
+/// Most points in a merged scan
+#define MERGED_MAX_POINTS (LIDAR_MAX_POINTS * MAX_LIDARS)
+
+/**
+ * @brief The points of one LiDAR's scan in the truck frame.
+ * @var time_us when the sweep started, on the host clock (us)
+ * @var arrival_us when the scan reached the Pi, on the host clock (us)
+ * @var sweep_us time from the first ray to the last (us)
+ * @var count number of points
+ * @var x x of every point in the truck frame (m)
+ * @var y y of every point in the truck frame (m)
+ * @var flags SCAN_FLAG_ bits of every point
+ */
+struct sensor_points {
+	uint64_t time_us;
+	uint64_t arrival_us;
+	uint32_t sweep_us;
+	uint16_t count;
+	float    x[LIDAR_MAX_POINTS];
+	float    y[LIDAR_MAX_POINTS];
+	uint8_t  flags[LIDAR_MAX_POINTS];
+};
+
+/**
+ * @brief The points of all LiDARs, merged.
+ * @var time_us start of the newest sweep in the merge, on the host clock (us)
+ * @var sources bit i is set if sensor i's scan is in the merge
+ * @var source_time_us start of each included sensor's sweep (us)
+ * @var source_sweep_us sweep time of each included sensor (us)
+ * @var source_begin index of each included sensor's first point
+ * @var count total number of points
+ * @var x x of every point in the truck frame (m)
+ * @var y y of every point in the truck frame (m)
+ * @var flags SCAN_FLAG_ bits of every point
+ * @var source the sensor every point came from
+ */
+struct merged_scan {
+	uint64_t time_us;
+	uint8_t  sources;
+	uint64_t source_time_us[MAX_LIDARS];
+	uint32_t source_sweep_us[MAX_LIDARS];
+	uint16_t source_begin[MAX_LIDARS];
+	uint16_t count;
+	float    x[MERGED_MAX_POINTS];
+	float    y[MERGED_MAX_POINTS];
+	uint8_t  flags[MERGED_MAX_POINTS];
+	uint8_t  source[MERGED_MAX_POINTS];
+};
+
+/**
+ * @brief Latency and loss counters of a scan_merger.
+ * @var merges number of merged scans handed out
+ * @var partial_merges merges that went out without every sensor
+ * @var stale_scans scans left out for being outside the sync window
+ * @var overwritten_scans scans replaced by a newer one before they were merged
+ * @var sum_wait_us total over merges of the time the first scan waited (us)
+ * @var max_wait_us longest the first scan of a merge waited (us)
+ * @var sum_age_us total over merges of the age of the oldest scan (us)
+ * @var max_age_us oldest any scan was when its merge went out (us)
+ * @var max_skew_us largest time between the oldest and newest sweep in a merge (us)
+ */
+struct merger_stats {
+	uint32_t merges;
+	uint32_t partial_merges;
+	uint32_t stale_scans;
+	uint32_t overwritten_scans;
+	uint64_t sum_wait_us;
+	uint32_t max_wait_us;
+	uint64_t sum_age_us;
+	uint32_t max_age_us;
+	uint32_t max_skew_us;
+};
+
+class scan_merger {
+public:
+	/**
+	 * @brief The constructor for a scan_merger.
+	 * @param sensor_count_in Number of LiDARs, at most MAX_LIDARS
+	 * @param max_wait_us_in Longest a scan may wait for the other sensors' (us)
+	 * @param sync_window_us_in Longest time between the oldest and newest sweep merged
+	 * together (us)
+	 */
+	scan_merger(uint8_t sensor_count_in, uint32_t max_wait_us_in, uint32_t sync_window_us_in);
+
+	/**
+	 * @brief Gets the buffer a sensor fills with its next scan.
+	 * Only the sensor's own thread may use it, and only until it calls push().
+	 * @param sensor The sensor's index
+	 * @return the sensor's back buffer
+	 */
+	sensor_points &back_buffer(uint8_t sensor);
+
+	/**
+	 * @brief Hands over the scan in a sensor's back buffer.
+	 * The back buffer is swapped with the one the merger reads, so no points are copied
+	 * while the lock is held.
+	 * @param sensor The sensor's index
+	 */
+	void push(uint8_t sensor);
+
+	/**
+	 * @brief Waits for the next merged scan.
+	 * @param out Filled with the merge
+	 * @param timeout_us Longest to wait if no sensor delivers anything (us)
+	 * @return true if a merge was made, false on timeout or after stop()
+	 */
+	bool wait(merged_scan &out, uint32_t timeout_us);
+
+	/**
+	 * @brief Wakes any thread in wait() and makes every later call return false.
+	 */
+	void stop();
+
+	/**
+	 * @brief Gets a copy of the latency and loss counters.
+	 */
+	merger_stats get_stats() const;
+
+	uint8_t get_sensor_count() const { return sensor_count; }
+	uint32_t get_max_wait_us() const { return max_wait_us; }
+
+private:
+	uint8_t sensor_count;
+	uint32_t max_wait_us;
+	uint32_t sync_window_us;
+
+	// Each sensor has three buffers: the one its thread fills, the newest pushed scan,
+	// and the one being copied out by the merge; pushes only ever swap pointers
+	sensor_points buffers[MAX_LIDARS][3];
+	sensor_points *back[MAX_LIDARS];
+	sensor_points *ready[MAX_LIDARS];
+	sensor_points *merging[MAX_LIDARS];
+	uint8_t ready_mask;
+	uint64_t first_arrival_us;
+	bool stopping;
+
+	mutable std::mutex lock;
+	std::condition_variable arrived;
+	merger_stats stats;
+
+	void merge(const sensor_points *const *scans, uint8_t mask, uint64_t now_us, merged_scan &out);
+};
+
+
+#endif //ME507_SCAN_MERGER_H
@@ -0,0 +1,245 @@
+/**
+ * The state_buffer holds a short, time-ordered history of estimator states and the
+ * measurements that produced them. IMU samples, wheel speed and LiDAR scans reach the
+ * Raspberry Pi with different latencies, so a measurement may arrive after newer ones
+ * have already been fused. Instead of ignoring it or restarting the filter, the late
+ * measurement is inserted at its true timestamp and only the entries after it are
+ * re-propagated.
+ *
+ * The buffer is a fixed-capacity ring, so it never allocates after construction. The
+ * amount of re-propagation done for one late measurement is capped by max_replay; a
+ * measurement that would need more work than that is dropped and counted instead.
+ *
+ * The estimator is supplied as a template parameter and must provide:
+ * @code
+ * struct my_filter {
+ *     typedef ... state_t;
+ *     typedef ... measurement_t;
+ *     void predict(state_t &state, uint64_t dt_us);
+ *     void update(state_t &state, const measurement_t &meas);
+ * };
+ * @endcode
+ */
+
+#ifndef ME507_STATE_BUFFER_H
+#define ME507_STATE_BUFFER_H
+
+#include <cstdint>
+
+template <class Filter, uint16_t CAPACITY>
+class state_buffer {
+public:
+	typedef typename Filter::state_t state_t;
+	typedef typename Filter::measurement_t measurement_t;
+
+	/**
+	 * @brief The constructor for a state_buffer attached to an estimator.
+	 * @param filter_in The estimator used to predict and update states
+	 * @param max_replay_in The most entries a single late measurement may re-propagate
+	 */
+	state_buffer(Filter *filter_in, uint16_t max_replay_in = CAPACITY)
+	{
+		filter = filter_in;
+		max_replay = max_replay_in;
+		head = 0;
+		count = 0;
+		clear_stats();
+	}
+
+	/**
+	 * @brief Empties the buffer and starts it again from a known state.
+	 * @param initial The state of the estimator at time_us
+	 * @param time_us The timestamp of the initial state in microseconds
+	 */
+	void reset(const state_t &initial, uint64_t time_us)
+	{
+		head = 0;
+		count = 1;
+		entries[0].time_us = time_us;
+		entries[0].state = initial;
+		entries[0].has_meas = false;
+	}
+
+	/**
+	 * @brief Fuses a measurement at its own timestamp.
+	 * In-order measurements are simply predicted to and applied at the end of the
+	 * buffer. Late measurements are inserted in time order and every later entry is
+	 * re-propagated from the new one. Measurements older than the buffer, or that would
+	 * need more than max_replay re-propagation steps, are dropped.
+	 * @param meas The measurement to fuse
+	 * @param time_us The time the measurement was taken in microseconds
+	 * @return true if the measurement was fused, false if it was dropped
+	 */
+	bool insert(const measurement_t &meas, uint64_t time_us)
+	{
+		if (count == 0 || time_us < at(0).time_us) {
+			dropped_count++;
+			return false;
+		}
+
+		// Fast path: the measurement is the newest one seen
+		if (time_us >= at(count - 1).time_us) {
+			if (count == CAPACITY)
+				pop_oldest();
+			entry &prev = at(count - 1);
+			entry &next = at(count);
+			next.time_us = time_us;
+			next.meas = meas;
+			next.has_meas = true;
+			next.state = prev.state;
+			filter->predict(next.state, time_us - prev.time_us);
+			filter->update(next.state, meas);
+			count++;
+			return true;
+		}
+
+		// Late measurement; the first entry strictly newer than it is where it goes
+		uint16_t index = upper_bound(time_us);
+		uint16_t replay = count - index + 1;
+		if (replay > max_replay || (count == CAPACITY && index == 1)) {
+			dropped_count++;
+			return false;
+		}
+
+		if (count == CAPACITY) {
+			pop_oldest();
+			index--;
+		}
+		for (uint16_t i = count; i > index; i--)
+			at(i) = at(i - 1);
+		count++;
+
+		entry &slot = at(index);
+		slot.time_us = time_us;
+		slot.meas = meas;
+		slot.has_meas = true;
+		repropagate(index);
+
+		late_count++;
+		replayed_steps += replay;
+		if (replay > max_replay_seen)
+			max_replay_seen = replay;
+		return true;
+	}
+
+	/**
+	 * @brief Gets the newest estimate in the buffer.
+	 * @return the state after all fused measurements
+	 */
+	const state_t &latest_state() const
+	{
+		return at(count - 1).state;
+	}
+
+	/**
+	 * @brief Gets the time of the newest estimate in the buffer.
+	 * @return the timestamp of latest_state() in microseconds
+	 */
+	uint64_t latest_time() const
+	{
+		return at(count - 1).time_us;
+	}
+
+	/**
+	 * @brief Gets the time of the oldest entry; anything older than this is dropped.
+	 * @return the timestamp of the oldest buffered state in microseconds
+	 */
+	uint64_t oldest_time() const
+	{
+		return at(0).time_us;
+	}
+
+	uint16_t size() const { return count; }
+
+	/// Number of measurements that arrived out of order and were re-propagated
+	uint32_t get_late_count() const { return late_count; }
+	/// Number of measurements that were too old or too expensive to fuse
+	uint32_t get_dropped_count() const { return dropped_count; }
+	/// Total predict/update steps spent on re-propagation
+	uint32_t get_replayed_steps() const { return replayed_steps; }
+	/// Largest single re-propagation seen since the last clear_stats()
+	uint16_t get_max_replay_seen() const { return max_replay_seen; }
+
+	/**
+	 * @brief Zeros the late, dropped and re-propagation counters.
+	 */
+	void clear_stats()
+	{
+		late_count = 0;
+		dropped_count = 0;
+		replayed_steps = 0;
+		max_replay_seen = 0;
+	}
+
+private:
+	struct entry {
+		uint64_t time_us;
+		state_t state;        // posterior state after this entry's measurement
+		measurement_t meas;
+		bool has_meas;
+	};
+
+	Filter *filter;
+	entry entries[CAPACITY];
+	uint16_t head;            // physical index of the oldest entry
+	uint16_t count;
+	uint16_t max_replay;
+
+	uint32_t late_count;
+	uint32_t dropped_count;
+	uint32_t replayed_steps;
+	uint16_t max_replay_seen;
+
+	entry &at(uint16_t i)
+	{
+		return entries[(head + i) % CAPACITY];
+	}
+
+	const entry &at(uint16_t i) const
+	{
+		return entries[(head + i) % CAPACITY];
+	}
+
+	void pop_oldest()
+	{
+		head = (head + 1) % CAPACITY;
+		count--;
+	}
+
+	/**
+	 * @brief Finds the first entry newer than a timestamp by binary search.
+	 * Equal timestamps keep arrival order, so the new entry goes after them.
+	 */
+	uint16_t upper_bound(uint64_t time_us) const
+	{
+		uint16_t lo = 0;
+		uint16_t hi = count;
+		while (lo < hi) {
+			uint16_t mid = lo + (hi - lo) / 2;
+			if (at(mid).time_us <= time_us)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	/**
+	 * @brief Recomputes every state from index to the end of the buffer.
+	 * The entry before index is assumed to be correct already.
+	 */
+	void repropagate(uint16_t index)
+	{
+		for (uint16_t i = index; i < count; i++) {
+			const entry &prev = at(i - 1);
+			entry &cur = at(i);
+			cur.state = prev.state;
+			filter->predict(cur.state, cur.time_us - prev.time_us);
+			if (cur.has_meas)
+				filter->update(cur.state, cur.meas);
+		}
+	}
+};
+
+
+#endif //ME507_STATE_BUFFER_H
@@ -0,0 +1,348 @@
+//
+// Tiled, memory-mapped map file; see tiled_map.h.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tiled_map.h"
+
+#define MAP_MAGIC "ME507MAP"
+#define MAP_VERSION 1
+
+/**
+ * @brief The start of the file.
+ * @var magic MAP_MAGIC, without a terminator
+ * @var version MAP_VERSION
+ * @var info the layer
+ * @var index_offset where the index of tile offsets starts (bytes)
+ * @var data_offset where the first tile starts (bytes)
+ */
+struct map_header {
+	char     magic[8];
+	uint32_t version;
+	tiled_map_info info;
+	uint64_t index_offset;
+	uint64_t data_offset;
+};
+
+static size_t round_up(size_t value, size_t step)
+{
+	return (value + step - 1) / step * step;
+}
+
+tiled_map::tiled_map()
+{
+	memset(&info, 0, sizeof(info));
+	tiles_x = 0;
+	tiles_y = 0;
+	tile_shift = 0;
+	tile_stride = 0;
+	data_offset = 0;
+	fd = -1;
+	base = NULL;
+	length = 0;
+	index = NULL;
+	writing = 0;
+	write_failed = false;
+	stopping = false;
+}
+
+tiled_map::~tiled_map()
+{
+	close();
+}
+
+bool tiled_map::layout(const tiled_map_info &info, uint32_t &tiles_x, uint32_t &tiles_y, uint32_t &shift,
+                       size_t &stride, size_t &data_offset)
+{
+	if (info.value_size == 0 || info.tile_size == 0 || (info.tile_size & (info.tile_size - 1)) != 0
+	    || info.width == 0 || info.height == 0 || !(info.resolution > 0.0f))
+		return false;
+	shift = 0;
+	while ((1u << shift) < info.tile_size)
+		shift++;
+	tiles_x = (info.width + info.tile_size - 1) / info.tile_size;
+	tiles_y = (info.height + info.tile_size - 1) / info.tile_size;
+	stride = round_up((size_t)info.tile_size * info.tile_size * info.value_size, MAP_TILE_ALIGN);
+	size_t index_offset = round_up(sizeof(map_header), sizeof(uint64_t));
+	data_offset = round_up(index_offset + (size_t)tiles_x * tiles_y * sizeof(uint64_t), MAP_TILE_ALIGN);
+	return true;
+}
+
+/**
+ * The tiles are left as a hole in the file, which reads as zeros and takes no disk space
+ * until it is written.
+ */
+bool tiled_map::create(const char *path, const tiled_map_info &info)
+{
+	uint32_t tiles_x, tiles_y, shift;
+	size_t stride, data_offset;
+	if (!layout(info, tiles_x, tiles_y, shift, stride, data_offset))
+		return false;
+
+	map_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAP_MAGIC, sizeof(header.magic));
+	header.version = MAP_VERSION;
+	header.info = info;
+	header.index_offset = round_up(sizeof(map_header), sizeof(uint64_t));
+	header.data_offset = data_offset;
+	std::vector<uint64_t> offsets((size_t)tiles_x * tiles_y);
+	for (size_t i = 0; i < offsets.size(); i++)
+		offsets[i] = data_offset + i * stride;
+
+	int out = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (out < 0)
+		return false;
+	bool ok = pwrite(out, &header, sizeof(header), 0) == (ssize_t)sizeof(header)
+	          && pwrite(out, &offsets[0], offsets.size() * sizeof(uint64_t), (off_t)header.index_offset)
+	             == (ssize_t)(offsets.size() * sizeof(uint64_t))
+	          && ftruncate(out, (off_t)(data_offset + offsets.size() * stride)) == 0;
+	ok = ::close(out) == 0 && ok;
+	return ok;
+}
+
+bool tiled_map::save(const char *path, const occupancy_grid &map, uint32_t tile_size)
+{
+	tiled_map_info layer;
+	layer.layer = MAP_LAYER_OCCUPANCY;
+	layer.value_size = 1;
+	layer.tile_size = tile_size;
+	layer.width = map.get_width();
+	layer.height = map.get_height();
+	layer.resolution = map.get_resolution();
+	layer.origin_x = map.get_origin_x();
+	layer.origin_y = map.get_origin_y();
+	tiled_map file;
+	if (!create(path, layer) || !file.open(path, true))
+		return false;
+	const uint8_t *cells = map.data();
+	for (uint32_t ty = 0; ty < file.tiles_y; ty++) {
+		for (uint32_t tx = 0; tx < file.tiles_x; tx++) {
+			uint8_t *out = file.tile(tx, ty);
+			uint32_t cx = tx * tile_size, columns = std::min(tile_size, layer.width - cx);
+			for (uint32_t y = 0; y < tile_size && ty * tile_size + y < layer.height; y++)
+				memcpy(out + (size_t)y * tile_size, cells + (size_t)(ty * tile_size + y) * layer.width + cx, columns);
+		}
+	}
+	std::fill(file.dirty.begin(), file.dirty.end(), 1);
+	file.flush();
+	bool ok = file.wait_flushed();
+	file.close();
+	return ok;
+}
+
+bool tiled_map::open(const char *path, bool writable)
+{
+	close();
+	fd = ::open(path, writable ? O_RDWR : O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat status;
+	map_header header;
+	if (fstat(fd, &status) != 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+	    || memcmp(header.magic, MAP_MAGIC, sizeof(header.magic)) != 0 || header.version != MAP_VERSION
+	    || !layout(header.info, tiles_x, tiles_y, tile_shift, tile_stride, data_offset)
+	    || header.data_offset != data_offset
+	    || (size_t)status.st_size < data_offset + (size_t)tiles_x * tiles_y * tile_stride) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	info = header.info;
+	length = (size_t)status.st_size;
+	void *mapped = mmap(NULL, length, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	base = (uint8_t *)mapped;
+	index = (const uint64_t *)(base + header.index_offset);
+
+	// Tiles have to be where the layout puts them, for readers that go by the stride
+	for (uint32_t i = 0; i < tiles_x * tiles_y; i++) {
+		if (index[i] != data_offset + (size_t)i * tile_stride) {
+			munmap(base, length);
+			::close(fd);
+			base = NULL;
+			fd = -1;
+			return false;
+		}
+	}
+
+	// Read-ahead would page in whole rows of tiles the truck is nowhere near
+	madvise(base + data_offset, length - data_offset, MADV_RANDOM);
+	dirty.assign((size_t)tiles_x * tiles_y, 0);
+	prefetched.assign((size_t)tiles_x * tiles_y, 0);
+	if (writable) {
+		stopping = false;
+		write_failed = false;
+		writer = std::thread(&tiled_map::write_back, this);
+	}
+	return true;
+}
+
+void tiled_map::close()
+{
+	if (!base)
+		return;
+	if (writer.joinable()) {
+		flush();
+		wait_flushed();
+		{
+			std::lock_guard<std::mutex> lock(writer_lock);
+			stopping = true;
+		}
+		writer_wake.notify_all();
+		writer.join();
+	}
+	munmap(base, length);
+	::close(fd);
+	base = NULL;
+	index = NULL;
+	fd = -1;
+	length = 0;
+}
+
+uint8_t *tiled_map::tile(uint32_t tx, uint32_t ty) const
+{
+	if (tx >= tiles_x || ty >= tiles_y)
+		return NULL;
+	return base + index[ty * tiles_x + tx];
+}
+
+void tiled_map::mark_dirty(uint32_t cx, uint32_t cy)
+{
+	if (cx >= info.width || cy >= info.height)
+		return;
+	dirty[(cy >> tile_shift) * tiles_x + (cx >> tile_shift)] = 1;
+}
+
+uint32_t tiled_map::flush()
+{
+	uint32_t handed = 0;
+	if (!writer.joinable())
+		return 0;
+	{
+		std::lock_guard<std::mutex> lock(writer_lock);
+		for (uint32_t i = 0; i < tiles_x * tiles_y; i++) {
+			if (dirty[i]) {
+				pending.push_back(i);
+				dirty[i] = 0;
+				handed++;
+			}
+		}
+	}
+	if (handed)
+		writer_wake.notify_one();
+	return handed;
+}
+
+bool tiled_map::wait_flushed()
+{
+	std::unique_lock<std::mutex> lock(writer_lock);
+	writer_done.wait(lock, [this] { return pending.empty() && writing == 0; });
+	bool ok = !write_failed;
+	write_failed = false;
+	return ok;
+}
+
+/**
+ * Tiles are synced one at a time with the lock released, so flush() never waits on the
+ * disk. The tiles start on MAP_TILE_ALIGN boundaries, which msync() needs to be page
+ * boundaries as well.
+ */
+void tiled_map::write_back()
+{
+	std::vector<uint32_t> batch;
+	std::unique_lock<std::mutex> lock(writer_lock);
+	for (;;) {
+		writer_wake.wait(lock, [this] { return stopping || !pending.empty(); });
+		if (pending.empty())
+			return;
+		batch.swap(pending);
+		writing = (uint32_t)batch.size();
+		lock.unlock();
+
+		bool failed = false;
+		for (size_t i = 0; i < batch.size(); i++)
+			failed = msync(base + index[batch[i]], tile_stride, MS_SYNC) != 0 || failed;
+		batch.clear();
+
+		lock.lock();
+		writing = 0;
+		write_failed = write_failed || failed;
+		writer_done.notify_all();
+	}
+}
+
+uint32_t tiled_map::prefetch(float x, float y, float radius)
+{
+	float side = info.tile_size * info.resolution;
+	float gx = x - info.origin_x, gy = y - info.origin_y;
+	uint32_t asked = 0;
+	for (uint32_t ty = 0; ty < tiles_y; ty++) {
+		for (uint32_t tx = 0; tx < tiles_x; tx++) {
+			// Distance from the point to the nearest point of the tile
+			float dx = std::max(std::max(tx * side - gx, gx - (tx + 1) * side), 0.0f);
+			float dy = std::max(std::max(ty * side - gy, gy - (ty + 1) * side), 0.0f);
+			float d = hypotf(dx, dy);
+			uint32_t i = ty * tiles_x + tx;
+			if (d <= radius && !prefetched[i]) {
+				madvise(base + index[i], tile_stride, MADV_WILLNEED);
+				prefetched[i] = 1;
+				asked++;
+			}
+			else if (d > 2.0f * radius && prefetched[i] && !dirty[i]) {
+				madvise(base + index[i], tile_stride, MADV_DONTNEED);
+				prefetched[i] = 0;
+			}
+		}
+	}
+	return asked;
+}
+
+uint32_t tiled_map::count_resident() const
+{
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t bytes = (size_t)tiles_x * tiles_y * tile_stride;
+	std::vector<unsigned char> pages((bytes + page - 1) / page);
+	if (mincore(base + data_offset, bytes, &pages[0]) != 0)
+		return 0;
+	uint32_t resident = 0;
+	for (uint32_t i = 0; i < tiles_x * tiles_y; i++) {
+		size_t first = i * tile_stride / page, last = ((i + 1) * tile_stride - 1) / page;
+		for (size_t p = first; p <= last; p++) {
+			if (pages[p] & 1) {
+				resident++;
+				break;
+			}
+		}
+	}
+	return resident;
+}
+
+bool tiled_map::load(occupancy_grid &map) const
+{
+	if (!base || info.layer != MAP_LAYER_OCCUPANCY || info.value_size != 1 || info.width > 0xFFFF
+	    || info.height > 0xFFFF)
+		return false;
+	map = occupancy_grid((uint16_t)info.width, (uint16_t)info.height, info.resolution, info.origin_x,
+	                     info.origin_y);
+	for (uint32_t ty = 0; ty < tiles_y; ty++) {
+		for (uint32_t tx = 0; tx < tiles_x; tx++) {
+			const uint8_t *in = tile(tx, ty);
+			for (uint32_t y = 0; y < info.tile_size && ty * info.tile_size + y < info.height; y++)
+				for (uint32_t x = 0; x < info.tile_size && tx * info.tile_size + x < info.width; x++)
+					map.set((int32_t)(tx * info.tile_size + x), (int32_t)(ty * info.tile_size + y),
+					        in[y * info.tile_size + x]);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,217 @@
+/**
+ * The tiled_map keeps a map layer on disk so the Pi does not rebuild it on every boot.
+ * The layer is cut into square tiles of a fixed number of cells, each tile stored
+ * row-major and padded to a whole number of pages, all in a single file: a header with
+ * the grid's placement, an index giving where each tile starts, then the tiles.
+ *
+ * open() memory-maps the file and reads nothing else, so startup costs the same however
+ * large the map is; the kernel pages tiles in when they are first touched. prefetch()
+ * asks for the tiles around the truck ahead of time and lets go of those it has driven
+ * away from, so only the neighborhood of the truck needs to stay in RAM. Cells written
+ * through the mapping go to the page cache at once; their tiles are marked dirty, and
+ * flush() hands them to a writer thread that syncs them to the file while the caller
+ * carries on.
+ */
+
+#ifndef ME507_TILED_MAP_H
+#define ME507_TILED_MAP_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "occupancy_grid.h"
+
+/// Layer of occupancy_grid cell values, one byte each
+#define MAP_LAYER_OCCUPANCY 1
+/// Layer of likelihood_field log-likelihoods, one float each
+#define MAP_LAYER_LIKELIHOOD 2
+
+/// Tiles start and end on multiples of this many bytes in the file
+#define MAP_TILE_ALIGN 4096
+
+/**
+ * @brief What the file says about the layer.
+ * @var layer MAP_LAYER_ kind of the values
+ * @var value_size bytes per cell
+ * @var tile_size cells along each side of a tile, a power of two
+ * @var width cells along x
+ * @var height cells along y
+ * @var resolution side of one cell (m)
+ * @var origin_x world x of the grid's lower left corner (m)
+ * @var origin_y world y of the grid's lower left corner (m)
+ */
+struct tiled_map_info {
+	uint32_t layer;
+	uint32_t value_size;
+	uint32_t tile_size;
+	uint32_t width;
+	uint32_t height;
+	float    resolution;
+	float    origin_x;
+	float    origin_y;
+};
+
+class tiled_map {
+public:
+	/**
+	 * @brief The constructor for a tiled_map with no file open.
+	 */
+	tiled_map();
+
+	/**
+	 * @brief Flushes and closes the file if one is open.
+	 */
+	~tiled_map();
+
+	/**
+	 * @brief Writes a new file with every cell zero.
+	 * @param path Where to write it; an existing file is replaced
+	 * @param info The layer; tile_size must be a power of two
+	 * @return false if the file could not be written or the layer is not valid
+	 */
+	static bool create(const char *path, const tiled_map_info &info);
+
+	/**
+	 * @brief Writes an occupancy_grid to a new file.
+	 * @param path Where to write it
+	 * @param map The map
+	 * @param tile_size Cells along each side of a tile, a power of two
+	 * @return false if the file could not be written
+	 */
+	static bool save(const char *path, const occupancy_grid &map, uint32_t tile_size);
+
+	/**
+	 * @brief Maps a file into memory; nothing is read from it but the header and index.
+	 * @param path The file
+	 * @param writable true to be able to change cells and flush them back
+	 * @return false, leaving nothing open, if the file cannot be mapped or is not a valid
+	 * map file
+	 */
+	bool open(const char *path, bool writable);
+
+	/**
+	 * @brief Flushes dirty tiles, waits for them and unmaps the file.
+	 */
+	void close();
+
+	bool is_open() const { return base != NULL; }
+	const tiled_map_info &get_info() const { return info; }
+	uint32_t get_tiles_x() const { return tiles_x; }
+	uint32_t get_tiles_y() const { return tiles_y; }
+	/// Bytes from the start of one tile to the start of the next
+	size_t get_tile_stride() const { return tile_stride; }
+
+	/**
+	 * @brief Gets a tile's cells in the mapping; touching them pages the tile in.
+	 * @param tx The tile's column
+	 * @param ty The tile's row
+	 * @return the tile's first cell, or NULL if the tile is off the map
+	 */
+	uint8_t *tile(uint32_t tx, uint32_t ty) const;
+
+	/**
+	 * @brief Gets the first tile, for readers that address tiles by stride. The tiles
+	 * follow each other in rows of tiles, get_tile_stride() apart.
+	 */
+	const uint8_t *tiles() const { return base + data_offset; }
+
+	/**
+	 * @brief Gets a cell in the mapping.
+	 * @param cx The cell's column
+	 * @param cy The cell's row
+	 * @return the cell's first byte, or NULL if the cell is off the map
+	 */
+	uint8_t *cell(uint32_t cx, uint32_t cy) const
+	{
+		// The last row and column of tiles may run past the map's edge
+		if (cx >= info.width || cy >= info.height)
+			return NULL;
+		uint32_t mask = info.tile_size - 1;
+		return tile(cx >> tile_shift, cy >> tile_shift)
+		       + (((size_t)(cy & mask) << tile_shift) + (cx & mask)) * info.value_size;
+	}
+
+	/**
+	 * @brief Marks a cell's tile as changed, to be written back by the next flush().
+	 * A cell off the map is ignored.
+	 */
+	void mark_dirty(uint32_t cx, uint32_t cy);
+
+	/**
+	 * @brief Hands every dirty tile to the writer thread and returns at once.
+	 * @return the number of tiles handed over, always 0 for a file opened read-only
+	 */
+	uint32_t flush();
+
+	/**
+	 * @brief Waits until every tile handed to the writer is on disk.
+	 * @return false if any of them failed to sync
+	 */
+	bool wait_flushed();
+
+	/**
+	 * @brief Asks the kernel to page in the tiles within a radius of a point, and
+	 * releases tiles it was asked for before that are now more than twice the radius
+	 * away and not dirty.
+	 * @param x World x (m)
+	 * @param y World y (m)
+	 * @param radius Radius to have paged in (m)
+	 * @return the number of tiles newly asked for
+	 */
+	uint32_t prefetch(float x, float y, float radius);
+
+	/**
+	 * @brief Counts the tiles that have any page in RAM.
+	 */
+	uint32_t count_resident() const;
+
+	/**
+	 * @brief Copies an occupancy layer into a grid.
+	 * @param map Set to a grid of the layer's size and placement
+	 * @return false if the file is not an occupancy layer
+	 */
+	bool load(occupancy_grid &map) const;
+
+private:
+	tiled_map_info info;
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	uint32_t tile_shift;
+	size_t tile_stride;
+	size_t data_offset;
+	int fd;
+	uint8_t *base;
+	size_t length;
+	const uint64_t *index;
+
+	std::vector<uint8_t> dirty;
+	std::vector<uint8_t> prefetched;
+
+	// Writer thread and the tiles waiting for it
+	std::thread writer;
+	std::mutex writer_lock;
+	std::condition_variable writer_wake;
+	std::condition_variable writer_done;
+	std::vector<uint32_t> pending;
+	uint32_t writing;
+	bool write_failed;
+	bool stopping;
+
+	/**
+	 * @brief Syncs pending tiles until close() stops it.
+	 */
+	void write_back();
+
+	/**
+	 * @brief Works out the tile layout of a layer.
+	 * @return false if the layer is not valid
+	 */
+	static bool layout(const tiled_map_info &info, uint32_t &tiles_x, uint32_t &tiles_y, uint32_t &shift,
+	                   size_t &stride, size_t &data_offset);
+};
+
+
+#endif //ME507_TILED_MAP_H
@@ -0,0 +1,413 @@
+//
+// LiDAR kingpin detection and autonomous coupling; see trailer_coupler.h.
+//
+
+#include <cmath>
+#include "trailer_coupler.h"
+#include "host_clock.h"
+
+#define CORNER_SCALE 3      // a cluster bends at a corner if it strays this many inlier distances
+
+trailer_coupler::trailer_coupler(const truck_geometry &geometry_in, const coupler_config &config_in,
+                                 control_loop *controller_in)
+{
+	geometry = geometry_in;
+	config = config_in;
+	controller = controller_in;
+	state = COUPLER_IDLE;
+	estimate = kingpin_estimate();
+	tracked = kingpin_estimate();
+	attempts = 0;
+	gap = 0.0f;
+	lateral_error = 0.0f;
+	heading_error = 0.0f;
+	axle_offset = 0.0f;
+	last_steer = 0.0f;
+	travelled = 0.0f;
+	state_time_us = 0;
+	last_time_us = 0;
+	max_run_us = 0;
+	point_count = 0;
+}
+
+void trailer_coupler::start()
+{
+	state = COUPLER_APPROACH;
+	tracked.valid = false;
+	attempts = 1;
+	travelled = 0.0f;
+	state_time_us = 0;      // set by the first update
+	last_time_us = 0;
+}
+
+void trailer_coupler::stop()
+{
+	state = COUPLER_IDLE;
+}
+
+coupler_state trailer_coupler::update(const lidar_scan &scan, int16_t wheel_speed, bool actual_5th,
+                                      semi_truck_data_t *out_data)
+{
+	uint64_t start_us = host_time_us();
+	uint64_t now = scan.time_us + scan.sweep_us;
+	if (state_time_us == 0)
+		state_time_us = now;
+	if (last_time_us) {
+		float distance = wheel_speed / WHEEL_SPEED_PER_M_S * (now - last_time_us) * 1e-6f;
+		travelled += distance;
+		if (tracked.valid)
+			predict(distance);
+	}
+	last_time_us = now;
+
+	rays.update(scan);
+	find_kingpin(scan);
+	if (estimate.valid) {
+		if (!tracked.valid || scan.time_us - tracked.time_us > config.lost_timeout_us) {
+			tracked = estimate;
+		}
+		else {
+			float g = config.filter_gain;
+			float turn = estimate.angle - tracked.angle;
+			tracked.x += g * (estimate.x - tracked.x);
+			tracked.y += g * (estimate.y - tracked.y);
+			tracked.angle += g * atan2f(sinf(turn), cosf(turn));
+			tracked.rms_error = estimate.rms_error;
+			tracked.inliers = estimate.inliers;
+			tracked.time_us = estimate.time_us;
+		}
+	}
+	uint64_t fix_age = tracked.valid ? scan.time_us - tracked.time_us : now - state_time_us;
+	bool fixed = tracked.valid && fix_age <= config.lost_timeout_us;
+	if (fixed)
+		measure_alignment();
+
+	float l = config.align_length;
+	switch (state) {
+	case COUPLER_IDLE:
+		break;
+
+	case COUPLER_APPROACH:
+		out_data->desired_5th = false;
+		if (!fixed) {
+			brake(now, wheel_speed, out_data);
+			if (fix_age > config.lost_timeout_us)
+				enter(COUPLER_FAILED, now);
+		}
+		else if (gap <= config.contact_distance) {
+			brake(now, wheel_speed, out_data);
+			enter(COUPLER_LOCKING, now);
+		}
+		else if (gap <= config.standoff
+		         && (fabsf(lateral_error) > config.lateral_tolerance || fabsf(heading_error) > config.heading_tolerance)) {
+			brake(now, wheel_speed, out_data);
+			enter(COUPLER_PULL_FORWARD, now);
+		}
+		else {
+			float target = gap > config.creep_distance ? config.approach_speed : config.creep_speed;
+			command(now, wheel_speed, -axle_offset / (l * l) + 2.0f * heading_error / l, -target, out_data);
+		}
+		break;
+
+	case COUPLER_PULL_FORWARD:
+		out_data->desired_5th = false;
+		if (travelled >= config.pull_distance) {
+			brake(now, wheel_speed, out_data);
+			if (attempts >= config.max_attempts) {
+				enter(COUPLER_FAILED, now);
+			}
+			else {
+				attempts++;
+				enter(COUPLER_APPROACH, now);
+			}
+		}
+		else {
+			float curvature = fixed ? -axle_offset / (l * l) - 2.0f * heading_error / l : 0.0f;
+			command(now, wheel_speed, curvature, config.approach_speed, out_data);
+		}
+		break;
+
+	case COUPLER_LOCKING:
+		brake(now, wheel_speed, out_data);
+		if (wheel_speed != 0)
+			break;
+		out_data->desired_5th = true;
+		if (actual_5th) {
+			enter(COUPLER_TUG, now);
+		}
+		else if (now - state_time_us > config.lock_timeout_us) {
+			out_data->desired_5th = false;
+			enter(COUPLER_PULL_FORWARD, now);
+		}
+		break;
+
+	case COUPLER_TUG:
+		out_data->desired_5th = true;
+		if (!fixed || fabsf(gap) > config.tug_tolerance) {
+			// The face fell behind: the jaw closed on nothing
+			out_data->desired_5th = false;
+			brake(now, wheel_speed, out_data);
+			enter(COUPLER_PULL_FORWARD, now);
+		}
+		else if (travelled >= config.tug_distance) {
+			brake(now, wheel_speed, out_data);
+			enter(COUPLER_COUPLED, now);
+		}
+		else {
+			command(now, wheel_speed, 0.0f, config.creep_speed, out_data);
+		}
+		break;
+
+	case COUPLER_COUPLED:
+	case COUPLER_FAILED:
+		brake(now, wheel_speed, out_data);
+		break;
+	}
+
+	uint32_t run_us = (uint32_t)(host_time_us() - start_us);
+	if (run_us > max_run_us)
+		max_run_us = run_us;
+	return state;
+}
+
+void trailer_coupler::enter(coupler_state next, uint64_t now_us)
+{
+	state = next;
+	state_time_us = now_us;
+	travelled = 0.0f;
+}
+
+void trailer_coupler::command(uint64_t now_us, int16_t wheel_speed, float curvature, float target,
+                              semi_truck_data_t *out_data)
+{
+	last_steer = atanf(geometry.wheelbase * curvature);
+	control_input in = control_input();
+	in.time_us = now_us;
+	in.wheel_speed = wheel_speed;
+	controller->drive(in, last_steer, target, out_data);
+}
+
+void trailer_coupler::brake(uint64_t now_us, int16_t wheel_speed, semi_truck_data_t *out_data)
+{
+	command(now_us, wheel_speed, 0.0f, 0.0f, out_data);
+	out_data->motor_output = MOTOR_OUTPUT_BRAKE;
+}
+
+/**
+ * Moves the tracked kingpin by the truck's motion over distance driven: the rear axle
+ * goes straight ahead by distance and the tractor turns by distance tan(steer) / L about
+ * it, so in the LiDAR frame the kingpin moves the opposite way.
+ */
+void trailer_coupler::predict(float distance)
+{
+	float turn = distance * tanf(last_steer) / geometry.wheelbase;
+	float ax = config.hitch.hitch_x + geometry.hitch_offset, ay = config.hitch.hitch_y;
+	float dx = tracked.x - ax - distance, dy = tracked.y - ay;
+	float c = cosf(turn), s = sinf(turn);
+	tracked.x = ax + c * dx + s * dy;
+	tracked.y = ay - s * dx + c * dy;
+	tracked.angle -= turn;
+}
+
+/**
+ * Puts the fifth wheel and the rear axle in the trailer's frame: the kingpin at the
+ * origin and x along the trailer's axis towards its front. The tractor's heading in that
+ * frame is minus the hitch angle.
+ */
+void trailer_coupler::measure_alignment()
+{
+	float c = cosf(tracked.angle), s = sinf(tracked.angle);
+	float fx = config.hitch.hitch_x - tracked.x, fy = config.hitch.hitch_y - tracked.y;
+	gap = c * fx + s * fy;
+	lateral_error = -s * fx + c * fy;
+	axle_offset = -s * (fx + geometry.hitch_offset) + c * fy;
+	heading_error = -tracked.angle;
+}
+
+void trailer_coupler::find_kingpin(const lidar_scan &scan)
+{
+	const hitch_config &h = config.hitch;
+	estimate.valid = false;
+	estimate.time_us = scan.time_us;
+
+	bool tracking = tracked.valid && scan.time_us - tracked.time_us <= config.lost_timeout_us;
+	if (tracking ? !collect_near_last(scan) : !collect_cluster(scan))
+		return;
+	if (!tracking)
+		split_at_corner();
+
+	float nx = 0.0f, ny = 0.0f, offset = 0.0f, rms;
+	uint16_t used;
+	bool ok = fit_face(point_x, point_y, point_count, 0.0f, nx, ny, offset, used, rms);
+	for (uint8_t i = 0; ok && i < FIT_REFINEMENTS; i++)
+		ok = fit_face(point_x, point_y, point_count, h.inlier_distance, nx, ny, offset, used, rms);
+	if (!ok || used < h.min_points)
+		return;
+
+	// The ends of the face are the extreme inliers along it, and the kingpin is ahead of
+	// the middle by face_distance
+	float low = 1e30f, high = -1e30f;
+	for (uint16_t i = 0; i < point_count; i++) {
+		if (fabsf(nx * point_x[i] + ny * point_y[i] - offset) > h.inlier_distance)
+			continue;
+		float along = -ny * point_x[i] + nx * point_y[i];
+		if (along < low)
+			low = along;
+		if (along > high)
+			high = along;
+	}
+	float angle = atan2f(ny, nx);
+	if (fabsf(high - low - h.trailer_width) > h.face_tolerance || fabsf(angle) > h.max_hitch_angle)
+		return;
+
+	float middle = 0.5f * (low + high);
+	estimate.valid = true;
+	estimate.x = offset * nx - middle * ny + h.face_distance * nx;
+	estimate.y = offset * ny + middle * nx + h.face_distance * ny;
+	estimate.angle = angle;
+	estimate.rms_error = rms;
+	estimate.inliers = used;
+}
+
+/**
+ * Keeps the points near where the face was on the last fix, within the gate of its line
+ * and not far past its ends.
+ */
+bool trailer_coupler::collect_near_last(const lidar_scan &scan)
+{
+	const hitch_config &h = config.hitch;
+	float gate = SEED_GATE_SCALE * h.inlier_distance;
+	float nx = cosf(tracked.angle), ny = sinf(tracked.angle);
+	float cx = tracked.x - h.face_distance * nx, cy = tracked.y - h.face_distance * ny;
+	float half = 0.5f * h.trailer_width + gate;
+
+	point_count = 0;
+	for (uint16_t i = 0; i < scan.count; i++) {
+		if (!scan_point_valid(scan, i))
+			continue;
+		float x = rays.x(scan, i), y = rays.y(scan, i);
+		float dx = x - cx, dy = y - cy;
+		if (fabsf(nx * dx + ny * dy) > gate || fabsf(-ny * dx + nx * dy) > half)
+			continue;
+		point_x[point_count] = x;
+		point_y[point_count] = y;
+		point_count++;
+	}
+	return point_count >= 2;
+}
+
+/**
+ * Splits the points behind the fifth wheel, in ray order, into clusters wherever two
+ * neighbors are more than cluster_gap apart, and keeps the one nearest the fifth wheel
+ * that is at least as wide as the trailer.
+ */
+bool trailer_coupler::collect_cluster(const lidar_scan &scan)
+{
+	const hitch_config &h = config.hitch;
+	float far_x = h.hitch_x - config.search_distance;
+	float gap2 = config.cluster_gap * config.cluster_gap;
+	float min_width = h.trailer_width - h.face_tolerance;
+
+	int32_t best_first = -1, best_last = -1;
+	float best_distance = 1e30f;
+	int32_t first = -1, last = -1;
+	float first_x = 0.0f, first_y = 0.0f, last_x = 0.0f, last_y = 0.0f, nearest = 1e30f;
+	for (int32_t i = 0; i <= (int32_t)scan.count; i++) {
+		bool in_region = false;
+		float x = 0.0f, y = 0.0f;
+		if (i < (int32_t)scan.count && scan_point_valid(scan, (uint16_t)i)) {
+			x = rays.x(scan, (uint16_t)i);
+			y = rays.y(scan, (uint16_t)i);
+			in_region = x <= h.hitch_x && x >= far_x && fabsf(y - h.hitch_y) <= config.search_width;
+		}
+		if (!in_region && i < (int32_t)scan.count)
+			continue;
+
+		float dx = x - last_x, dy = y - last_y;
+		bool joins = in_region && first >= 0 && dx * dx + dy * dy <= gap2;
+		if (!joins && first >= 0) {
+			float wx = last_x - first_x, wy = last_y - first_y;
+			if (wx * wx + wy * wy >= min_width * min_width && nearest < best_distance) {
+				best_distance = nearest;
+				best_first = first;
+				best_last = last;
+			}
+			first = -1;
+		}
+		if (!in_region)
+			break;
+		if (first < 0) {
+			first = i;
+			first_x = x;
+			first_y = y;
+			nearest = 1e30f;
+		}
+		last = i;
+		last_x = x;
+		last_y = y;
+		float d = hypotf(x - h.hitch_x, y - h.hitch_y);
+		if (d < nearest)
+			nearest = d;
+	}
+	if (best_first < 0)
+		return false;
+
+	// The cluster's rays were all in the region, but some may have been invalid
+	point_count = 0;
+	for (int32_t i = best_first; i <= best_last; i++) {
+		if (!scan_point_valid(scan, (uint16_t)i))
+			continue;
+		float x = rays.x(scan, (uint16_t)i), y = rays.y(scan, (uint16_t)i);
+		if (x > h.hitch_x || x < far_x || fabsf(y - h.hitch_y) > config.search_width)
+			continue;
+		point_x[point_count] = x;
+		point_y[point_count] = y;
+		point_count++;
+	}
+	return point_count >= 2;
+}
+
+/**
+ * Seen from off its axis, one side of the trailer shows beside the face. If the cluster
+ * bends, it is cut at the point farthest from the line between its ends, and the part
+ * seen most nearly head on is kept as the face.
+ */
+void trailer_coupler::split_at_corner()
+{
+	if (point_count < 3)
+		return;
+	float ex = point_x[point_count - 1] - point_x[0], ey = point_y[point_count - 1] - point_y[0];
+	float length = hypotf(ex, ey);
+	if (length <= 0.0f)
+		return;
+
+	uint16_t corner = 0;
+	float farthest = 0.0f;
+	for (uint16_t i = 1; i + 1 < point_count; i++) {
+		float d = fabsf((point_x[i] - point_x[0]) * ey - (point_y[i] - point_y[0]) * ex) / length;
+		if (d > farthest) {
+			farthest = d;
+			corner = i;
+		}
+	}
+	if (farthest <= CORNER_SCALE * config.hitch.inlier_distance)
+		return;
+
+	// How head on each part is seen: the cosine between its chord's normal and the
+	// direction to its middle
+	uint16_t from[2] = {0, corner}, to[2] = {corner, (uint16_t)(point_count - 1)};
+	float facing[2];
+	for (uint8_t k = 0; k < 2; k++) {
+		float cx = point_x[to[k]] - point_x[from[k]], cy = point_y[to[k]] - point_y[from[k]];
+		float mx = 0.5f * (point_x[to[k]] + point_x[from[k]]), my = 0.5f * (point_y[to[k]] + point_y[from[k]]);
+		float norm = hypotf(cx, cy) * hypotf(mx, my);
+		facing[k] = norm > 0.0f ? fabsf(cx * my - cy * mx) / norm : 0.0f;
+	}
+	uint8_t keep = facing[1] > facing[0] ? 1 : 0;
+	uint16_t n = 0;
+	for (uint16_t i = from[keep]; i <= to[keep]; i++, n++) {
+		point_x[n] = point_x[i];
+		point_y[n] = point_y[i];
+	}
+	point_count = n;
+}
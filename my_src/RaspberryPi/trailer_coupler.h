@@ -0,0 +1,208 @@
+/**
+ * The trailer_coupler backs the tractor under a parked trailer and locks the fifth wheel
+ * on its kingpin, which is otherwise done by hand, one attempt after another. It runs
+ * once per scan of the rear LiDAR, perception and control together, and writes the
+ * commands straight into the semi_truck_data_t sent to the ATMega.
+ *
+ * Perception: the trailer's front face is found behind the tractor and a line is fitted
+ * to it with fit_face(), the total least squares fit the hitch_estimator uses too. The
+ * first time, the points behind the fifth wheel are split into clusters wherever the
+ * range jumps. The nearest cluster wide enough to be the trailer is taken, and cut in
+ * two at a corner if a side of the trailer shows too. After that, only points near the
+ * last face are used. The face's visible ends must be the trailer's width apart, and
+ * its middle, moved face_distance along the normal, is the kingpin. The face's normal
+ * is the trailer's axis, so its angle is the hitch angle the truck would have if coupled
+ * right now. Seen from a couple of meters, a face a foot wide gives its angle only to a
+ * degree or so, which swings the axis by centimeters at the tractor. So the kingpin is tracked:
+ * between scans it is moved by the truck's own motion, from the wheel speed and the
+ * steering, and each new fix is blended in with filter_gain.
+ *
+ * Control: in the trailer's frame, with the kingpin at the origin and x along the axis
+ * towards the tractor, the rear axle is at lateral offset y and heading error theta.
+ * Reversing a distance s, y'' = curvature to first order, so steering for a curvature
+ * of -y / l^2 + 2 theta / l brings y and theta to zero together over a few l without
+ * overshoot. The truck slows to a creep for the last stretch and brakes when the fifth
+ * wheel reaches the kingpin. If it is still out of line with the kingpin at the standoff
+ * distance, it pulls forward, aligning with the same law, and tries again.
+ *
+ * Coupling: once stopped, desired_5th is set to lock, and the lock must be confirmed by
+ * actual_5th. The truck then pulls forward a few centimeters. If the trailer really is
+ * on the fifth wheel, the face stays where it is when coupled; if the jaw closed on
+ * nothing, the face falls behind, the fifth wheel is unlocked and the truck tries again.
+ *
+ * All geometry is in the LiDAR frame used by the hitch_estimator: x forward, y to the
+ * left, with the LiDAR's x axis along the tractor's.
+ */
+
+#ifndef ME507_TRAILER_COUPLER_H
+#define ME507_TRAILER_COUPLER_H
+
+#include <cstdint>
+#include "control_loop.h"
+#include "face_fit.h"
+#include "hitch_estimator.h"
+#include "lidar_scan.h"
+
+/**
+ * @brief Settings of a trailer_coupler.
+ * @var hitch where the fifth wheel is in the LiDAR frame and the trailer's size; the
+ * window, inlier_distance and face_tolerance are used as by the hitch_estimator
+ * @var search_distance farthest behind the fifth wheel the face is looked for (m)
+ * @var search_width farthest either side of the tractor's center line it is looked for (m)
+ * @var cluster_gap jump in range between neighboring points that starts a new cluster (m)
+ * @var filter_gain weight of each new fix against the tracked kingpin, from 0 to 1
+ * @var approach_speed reversing speed towards the trailer (m/s)
+ * @var creep_speed reversing speed over the last creep_distance (m/s)
+ * @var creep_distance distance from the kingpin at which the truck slows to creep_speed (m)
+ * @var align_length distance over which the approach brings the offset down (m)
+ * @var standoff distance from the kingpin at which the truck must be in line with it (m)
+ * @var lateral_tolerance largest offset of the fifth wheel from the axis at standoff (m)
+ * @var heading_tolerance largest heading error at standoff (rad)
+ * @var contact_distance distance from the kingpin at which the truck stops to lock (m)
+ * @var pull_distance how far the truck pulls forward before trying again (m)
+ * @var lock_timeout_us longest wait for actual_5th to confirm the lock (us)
+ * @var tug_distance how far the truck pulls forward to check the trailer came with it (m)
+ * @var tug_tolerance farthest the kingpin may move from the fifth wheel in the tug (m)
+ * @var lost_timeout_us longest the face may go unseen before the truck stops (us)
+ * @var max_attempts approaches tried before giving up
+ */
+struct coupler_config {
+	hitch_config hitch;
+	float    search_distance;
+	float    search_width;
+	float    cluster_gap;
+	float    filter_gain;
+	float    approach_speed;
+	float    creep_speed;
+	float    creep_distance;
+	float    align_length;
+	float    standoff;
+	float    lateral_tolerance;
+	float    heading_tolerance;
+	float    contact_distance;
+	float    pull_distance;
+	uint32_t lock_timeout_us;
+	float    tug_distance;
+	float    tug_tolerance;
+	uint32_t lost_timeout_us;
+	uint8_t  max_attempts;
+};
+
+/// What the coupler is doing
+enum coupler_state {
+	COUPLER_IDLE,           ///< not started, or stopped with stop()
+	COUPLER_APPROACH,       ///< reversing towards the kingpin
+	COUPLER_PULL_FORWARD,   ///< pulling forward to try again
+	COUPLER_LOCKING,        ///< stopped at the kingpin, waiting for actual_5th
+	COUPLER_TUG,            ///< pulling forward to check the trailer came along
+	COUPLER_COUPLED,        ///< done; the trailer is on the fifth wheel
+	COUPLER_FAILED          ///< gave up; see get_attempts()
+};
+
+/**
+ * @brief Where the kingpin of the parked trailer was found in one scan.
+ * @var valid true if the face was found and passed its checks
+ * @var x x of the kingpin in the LiDAR frame (m)
+ * @var y y of the kingpin in the LiDAR frame (m)
+ * @var angle trailer heading minus tractor heading, as a hitch angle (rad)
+ * @var rms_error RMS distance of the face points from the fitted line (m)
+ * @var inliers number of points in the fit
+ * @var time_us timestamp of the scan
+ */
+struct kingpin_estimate {
+	bool     valid;
+	float    x;
+	float    y;
+	float    angle;
+	float    rms_error;
+	uint16_t inliers;
+	uint64_t time_us;
+};
+
+class trailer_coupler {
+public:
+	/**
+	 * @brief The constructor for an idle trailer_coupler.
+	 * @param geometry_in The dimensions of the truck, for the wheelbase and steering limit
+	 * @param config_in The coupler settings
+	 * @param controller_in The control loop whose speed loop drives the truck; it must
+	 * outlive the coupler
+	 */
+	trailer_coupler(const truck_geometry &geometry_in, const coupler_config &config_in,
+	                control_loop *controller_in);
+
+	/**
+	 * @brief Starts coupling from wherever the truck is. The trailer must be behind it.
+	 */
+	void start();
+
+	/**
+	 * @brief Stops coupling. The coupler writes no more commands, so whatever drives the
+	 * truck next must stop it.
+	 */
+	void stop();
+
+	/**
+	 * @brief Runs perception and control on one scan of the rear LiDAR.
+	 * @param scan The scan, in the LiDAR frame
+	 * @param wheel_speed The wheel_speed last reported by the ATMega
+	 * @param actual_5th The state of the fifth wheel last reported by the ATMega
+	 * @param out_data The data sent to the ATMega; steer_output, motor_output,
+	 * speed_setpoint and desired_5th are written unless the coupler is idle
+	 * @return the coupler's state after the update
+	 */
+	coupler_state update(const lidar_scan &scan, int16_t wheel_speed, bool actual_5th, semi_truck_data_t *out_data);
+
+	coupler_state get_state() const { return state; }
+	/// The kingpin as found in the last scan
+	const kingpin_estimate &get_estimate() const { return estimate; }
+	/// The kingpin as tracked over the scans so far
+	const kingpin_estimate &get_tracked() const { return tracked; }
+	/// Approaches started so far
+	uint8_t get_attempts() const { return attempts; }
+	/// Distance from the fifth wheel to the kingpin along the trailer's axis at the last fix (m)
+	float get_gap() const { return gap; }
+	/// Offset of the fifth wheel from the trailer's axis at the last fix (m)
+	float get_lateral_error() const { return lateral_error; }
+	/// Longest an update has taken (us)
+	uint32_t get_max_run_us() const { return max_run_us; }
+
+private:
+	truck_geometry geometry;
+	coupler_config config;
+	control_loop *controller;
+
+	coupler_state state;
+	kingpin_estimate estimate;
+	kingpin_estimate tracked;
+	uint8_t attempts;
+	float gap;
+	float lateral_error;
+	float heading_error;
+	float axle_offset;
+	float last_steer;               // rad, the steering last commanded
+	float travelled;                // m driven since the current move started
+	uint64_t state_time_us;         // when the current state was entered
+	uint64_t last_time_us;
+	uint32_t max_run_us;
+
+	ray_table rays;
+
+	// Cartesian points that may be on the face; kept as members so update() never allocates
+	float point_x[LIDAR_MAX_POINTS];
+	float point_y[LIDAR_MAX_POINTS];
+	uint16_t point_count;
+
+	void predict(float distance);
+	void find_kingpin(const lidar_scan &scan);
+	bool collect_near_last(const lidar_scan &scan);
+	bool collect_cluster(const lidar_scan &scan);
+	void split_at_corner();
+	void measure_alignment();
+	void enter(coupler_state next, uint64_t now_us);
+	void command(uint64_t now_us, int16_t wheel_speed, float curvature, float target, semi_truck_data_t *out_data);
+	void brake(uint64_t now_us, int16_t wheel_speed, semi_truck_data_t *out_data);
+};
+
+
+#endif //ME507_TRAILER_COUPLER_H
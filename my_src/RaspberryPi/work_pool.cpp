@@ -0,0 +1,155 @@
+//
+// Work-stealing thread pool; see work_pool.h.
+//
+
+#include "work_pool.h"
+
+/// Index of the worker running on this thread, or -1 on threads outside any pool
+static thread_local int current_worker = -1;
+/// The pool that current_worker belongs to
+static thread_local const work_pool *current_pool = NULL;
+
+work_pool::work_pool(unsigned n_threads)
+	: queued(0), pending(0), next_queue(0), steals(0), stopping(false)
+{
+	if (n_threads == 0)
+		n_threads = std::thread::hardware_concurrency();
+	if (n_threads == 0)
+		n_threads = 1;
+
+	for (unsigned i = 0; i < n_threads; i++)
+		queues.push_back(std::unique_ptr<worker_queue>(new worker_queue));
+	for (unsigned i = 0; i < n_threads; i++)
+		threads.push_back(std::thread(&work_pool::worker_main, this, i));
+}
+
+work_pool::~work_pool()
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> guard(wake_lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+void work_pool::submit(const std::function<void()> &task)
+{
+	unsigned index;
+	if (current_pool == this && current_worker >= 0)
+		index = (unsigned)current_worker;
+	else
+		index = next_queue++ % queues.size();
+
+	pending++;
+	{
+		std::lock_guard<std::mutex> guard(queues[index]->lock);
+		queues[index]->tasks.push_back(task);
+	}
+	{
+		// Counting under wake_lock means a worker that is about to sleep cannot miss it
+		std::lock_guard<std::mutex> guard(wake_lock);
+		queued++;
+	}
+	wake.notify_one();
+}
+
+void work_pool::wait()
+{
+	std::unique_lock<std::mutex> lock(wake_lock);
+	idle.wait(lock, [this] { return pending == 0; });
+}
+
+void work_pool::parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body)
+{
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	// A latch local to this call, so unrelated tasks in the pool are not waited for
+	std::mutex done_lock;
+	std::condition_variable done;
+	size_t remaining = (count - 1) / grain;
+
+	for (size_t begin = grain; begin < count; begin += grain) {
+		size_t end = begin + grain < count ? begin + grain : count;
+		submit([&, begin, end] {
+			body(begin, end);
+			std::lock_guard<std::mutex> guard(done_lock);
+			if (--remaining == 0)
+				done.notify_one();
+		});
+	}
+
+	body(0, grain < count ? grain : count);
+
+	std::unique_lock<std::mutex> lock(done_lock);
+	done.wait(lock, [&] { return remaining == 0; });
+}
+
+unsigned work_pool::size() const
+{
+	return (unsigned)threads.size();
+}
+
+uint64_t work_pool::get_steal_count() const
+{
+	return steals;
+}
+
+void work_pool::worker_main(unsigned index)
+{
+	current_worker = (int)index;
+	current_pool = this;
+
+	std::function<void()> task;
+	for (;;) {
+		if (try_pop(index, task)) {
+			task();
+			task = nullptr;
+			if (--pending == 0) {
+				std::lock_guard<std::mutex> guard(wake_lock);
+				idle.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(wake_lock);
+		wake.wait(lock, [this] { return stopping || queued > 0; });
+		if (stopping && queued == 0)
+			return;
+	}
+}
+
+bool work_pool::try_pop(unsigned index, std::function<void()> &task)
+{
+	// Own queue first, newest task first, since its data is most likely still in cache
+	{
+		worker_queue &own = *queues[index];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+
+	// Then steal the oldest task from the other workers, starting with the next one
+	size_t n = queues.size();
+	for (size_t k = 1; k < n; k++) {
+		worker_queue &victim = *queues[(index + k) % n];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			queued--;
+			steals++;
+			return true;
+		}
+	}
+	return false;
+}
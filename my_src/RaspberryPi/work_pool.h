@@ -0,0 +1,98 @@
+/**
+ * The work_pool is a fixed set of worker threads that share work by stealing. Every
+ * worker owns a double-ended queue: it pushes and pops its own tasks at the back, and
+ * when it runs dry it steals from the front of another worker's queue. Long batches of
+ * uneven jobs (closed-loop simulations, particle weights) therefore keep every core
+ * busy without a single shared queue becoming the bottleneck.
+ *
+ * Tasks are submitted from any thread. wait() and parallel_for() block the caller, so
+ * they must be called from outside the pool's own workers.
+ */
+
+#ifndef ME507_WORK_POOL_H
+#define ME507_WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class work_pool {
+public:
+	/**
+	 * @brief The constructor for a work_pool; starts the worker threads.
+	 * @param n_threads The number of workers, or 0 for one per hardware thread
+	 */
+	work_pool(unsigned n_threads = 0);
+
+	/**
+	 * @brief Finishes every queued task, then stops and joins the workers.
+	 */
+	~work_pool();
+
+	/**
+	 * @brief Queues a task to run on one of the workers.
+	 * A task submitted from inside a worker goes on that worker's own queue; otherwise
+	 * tasks are spread across the queues in turn.
+	 * @param task The work to do
+	 */
+	void submit(const std::function<void()> &task);
+
+	/**
+	 * @brief Blocks until every task submitted so far has finished.
+	 */
+	void wait();
+
+	/**
+	 * @brief Runs body over [0, count) split into chunks of about grain items.
+	 * The calling thread runs the first chunk itself and then waits for the rest.
+	 * @param count The number of items
+	 * @param grain The number of items in each chunk handed to a worker
+	 * @param body Called as body(begin, end) once for each chunk
+	 */
+	void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+	/**
+	 * @brief Gets the number of worker threads.
+	 * @return the number of workers
+	 */
+	unsigned size() const;
+
+	/**
+	 * @brief Gets the number of tasks that were run by a worker other than the one
+	 * whose queue they were put on.
+	 * @return the number of steals since the pool started
+	 */
+	uint64_t get_steal_count() const;
+
+private:
+	struct worker_queue {
+		std::mutex lock;
+		std::deque<std::function<void()> > tasks;
+	};
+
+	std::vector<std::unique_ptr<worker_queue> > queues;
+	std::vector<std::thread> threads;
+
+	std::mutex wake_lock;
+	std::condition_variable wake;     // signalled when a task is queued or on shutdown
+	std::condition_variable idle;     // signalled when pending reaches zero
+
+	std::atomic<size_t> queued;       // tasks sitting in a queue
+	std::atomic<size_t> pending;      // tasks queued or running
+	std::atomic<unsigned> next_queue;
+	std::atomic<uint64_t> steals;
+	bool stopping;
+
+	void worker_main(unsigned index);
+	bool try_pop(unsigned index, std::function<void()> &task);
+};
+
+
+#endif //ME507_WORK_POOL_H
@@ -14,11 +14,14 @@
 
 class communication_data : public TaskShare<semi_truck_data_t> {
 private:
-	semi_truck_data_t data_for_tasks;
+	semi_truck_data_t *data_for_tasks;
 
 
 public:
-	""""this is a doc""""
+	/**
+	 * The constructor for the shared data; every get and set goes straight to semi_data.
+	 * @param semi_data The semi truck data shared by all of the tasks
+	 */
 	communication_data(semi_truck_data_t *semi_data);
 
      /**
@@ -0,0 +1,105 @@
+//
+// Fixed point versions of the fast maths functions; see fast_math.h.
+//
+
+#include "fast_math.h"
+
+#define CORDIC_ITERATIONS 16
+
+/// atan(2^-i) as binary angles with 8 extra fraction bits (2^24 counts per turn)
+static const int32_t cordic_atan_table[CORDIC_ITERATIONS] = {
+	2097152, 1238021, 654136, 332050, 166669, 83416, 41718, 20860,
+	10430, 5215, 2608, 1304, 652, 326, 163, 81
+};
+
+uint16_t isqrt32(uint32_t x)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;   // the highest power of four that fits in 32 bits
+
+	while (bit > x)
+		bit >>= 2;
+
+	while (bit != 0) {
+		if (x >= root + bit) {
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint16_t)root;
+}
+
+uint32_t inv_sqrt_q16(uint32_t x)
+{
+	if (x == 0)
+		return UINT32_MAX;
+
+	// Shift by pairs of bits so the square root keeps a full 16 bits of precision
+	uint8_t shift = 0;
+	while (x < (1UL << 30)) {
+		x <<= 2;
+		shift++;
+	}
+	uint32_t root = isqrt32(x);            // sqrt(x_real) * 2^(8 + shift)
+	uint32_t q = (1UL << 31) / root;       // 2^(23 - shift) / sqrt(x_real)
+
+	if (shift >= 7)
+		return q << (shift - 7);
+	return q >> (7 - shift);
+}
+
+int16_t atan2_bam(int16_t y, int16_t x)
+{
+	if (x == 0 && y == 0)
+		return 0;
+
+	// Work in 32 bits, scaling small vectors up so the shifts below do not run out of
+	// resolution; 2^24 leaves room for the CORDIC gain of 1.65 without overflowing
+	int32_t xi = x;
+	int32_t yi = y;
+	while (xi > -(1L << 23) && xi < (1L << 23) && yi > -(1L << 23) && yi < (1L << 23)) {
+		xi <<= 1;
+		yi <<= 1;
+	}
+	int32_t angle = 0;
+
+	// Rotate into the right half plane first, since CORDIC only converges within +-pi/2
+	if (xi < 0) {
+		xi = -xi;
+		yi = -yi;
+		angle = 32768L << 8;
+	}
+
+	for (uint8_t i = 0; i < CORDIC_ITERATIONS; i++) {
+		int32_t x_shift = xi >> i;
+		int32_t y_shift = yi >> i;
+		if (yi > 0) {
+			xi += y_shift;
+			yi -= x_shift;
+			angle += cordic_atan_table[i];
+		}
+		else {
+			xi -= y_shift;
+			yi += x_shift;
+			angle -= cordic_atan_table[i];
+		}
+	}
+	// Round away the extra fraction bits; the cast wraps the half-plane offset into +-pi
+	return (int16_t)(uint16_t)((angle + 128) >> 8);
+}
+
+int16_t asin_bam(int16_t x_q14)
+{
+	int32_t x = x_q14;
+	if (x > 16384)
+		x = 16384;
+	else if (x < -16384)
+		x = -16384;
+
+	uint16_t cosine = isqrt32((1UL << 28) - (uint32_t)(x * x));   // Q14
+	return atan2_bam((int16_t)x, (int16_t)cosine);
+}
@@ -0,0 +1,171 @@
+/**
+ * Fast approximations of the transcendental functions used to turn IMU quaternions
+ * into Euler angles. On the ATMega every float operation is done in software, so the
+ * libm atan2(), asin() and sqrt() calls in imu::Quaternion::toEuler() and
+ * imu::Vector::magnitude() cost far more than the rest of the IMU task combined.
+ *
+ * Two families are provided:
+ *  - float versions built from short polynomials and the bit-level inverse square
+ *    root, for code that already works in floating point;
+ *  - fixed point versions built from CORDIC and integer square roots, for code that
+ *    works on the raw int16_t values read from the BNO055 and never needs a float.
+ *
+ * Each function documents its worst case error, measured against libm in double
+ * precision over its whole input range. fast_math_policy wraps the float versions so
+ * they can be plugged into the imu:: maths classes, for example
+ * @code
+ * imu::Vector<3> euler = quat.toEuler<fast_math_policy>();
+ * @endcode
+ */
+
+#ifndef ME507_FAST_MATH_H
+#define ME507_FAST_MATH_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define FAST_PI      3.14159265f
+#define FAST_HALF_PI 1.57079633f
+
+/**
+ * @brief Approximates 1/sqrt(x) with a bit-level first guess and two Newton steps.
+ * Maximum relative error is 4.8e-6 for all positive normal x.
+ * @param x A positive number
+ * @return an approximation of 1/sqrt(x)
+ */
+inline float fast_inv_sqrt(float x)
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));      // memcpy instead of a cast keeps this legal C++
+	bits = 0x5f375a86UL - (bits >> 1);
+	float y;
+	memcpy(&y, &bits, sizeof(y));
+
+	float half_x = 0.5f * x;
+	y = y * (1.5f - half_x * y * y);
+	y = y * (1.5f - half_x * y * y);
+	return y;
+}
+
+/**
+ * @brief Approximates sqrt(x) as x * fast_inv_sqrt(x).
+ * Maximum relative error is 4.8e-6; an input of zero or less returns zero.
+ * @param x A number that is not negative
+ * @return an approximation of sqrt(x)
+ */
+inline float fast_sqrt(float x)
+{
+	if (x <= 0.0f)
+		return 0.0f;
+	return x * fast_inv_sqrt(x);
+}
+
+/**
+ * @brief Approximates atan(x) for x between -1 and 1 with an odd 11th order polynomial.
+ * Maximum error is 2.0e-6 rad inside that range.
+ */
+inline float fast_atan_unit(float x)
+{
+	float x2 = x * x;
+	return x * (0.99997726f + x2 * (-0.33262347f + x2 * (0.19354346f
+		+ x2 * (-0.11643287f + x2 * (0.05265332f + x2 * -0.01172120f)))));
+}
+
+/**
+ * @brief Approximates atan2(y, x) by folding the argument into one octant.
+ * Maximum error is 2.0e-6 rad (0.0001 degrees) over all quadrants; atan2(0, 0)
+ * returns 0 like libm does.
+ * @param y The y (numerator) component
+ * @param x The x (denominator) component
+ * @return the angle of (x, y) in radians, between -pi and pi
+ */
+inline float fast_atan2(float y, float x)
+{
+	float abs_x = x < 0.0f ? -x : x;
+	float abs_y = y < 0.0f ? -y : y;
+	if (abs_x == 0.0f && abs_y == 0.0f)
+		return 0.0f;
+
+	float angle;
+	if (abs_y <= abs_x)
+		angle = fast_atan_unit(abs_y / abs_x);
+	else
+		angle = FAST_HALF_PI - fast_atan_unit(abs_x / abs_y);
+
+	if (x < 0.0f)
+		angle = FAST_PI - angle;
+	return y < 0.0f ? -angle : angle;
+}
+
+/**
+ * @brief Approximates asin(x) using Abramowitz and Stegun 4.4.45.
+ * Maximum error is 7.5e-5 rad (0.004 degrees). Inputs are clamped to [-1, 1] so that
+ * a slightly denormalized quaternion cannot produce a NaN.
+ * @param x The sine of the angle
+ * @return the angle in radians, between -pi/2 and pi/2
+ */
+inline float fast_asin(float x)
+{
+	bool negative = x < 0.0f;
+	if (negative)
+		x = -x;
+	if (x > 1.0f)
+		x = 1.0f;
+
+	float poly = 1.5707288f + x * (-0.2121144f + x * (0.0742610f + x * -0.0187293f));
+	float angle = FAST_HALF_PI - fast_sqrt(1.0f - x) * poly;
+	return negative ? -angle : angle;
+}
+
+
+/**
+ * @brief Integer square root, rounded down.
+ * Exact for every input; uses only shifts, adds and compares.
+ * @param x The number to take the square root of
+ * @return floor(sqrt(x))
+ */
+uint16_t isqrt32(uint32_t x);
+
+/**
+ * @brief Fixed point 1/sqrt(x) with x and the result in Q16.16.
+ * The input is normalized before the integer square root, so the error is at most
+ * 3.1e-5 relative or one count of the Q16.16 result, whichever is larger. An input of
+ * zero returns UINT32_MAX.
+ * @param x A positive Q16.16 number
+ * @return 1/sqrt(x) in Q16.16
+ */
+uint32_t inv_sqrt_q16(uint32_t x);
+
+/**
+ * @brief Fixed point atan2 computed with 16 CORDIC iterations.
+ * Angles are binary angles: the full int16_t range covers one turn, so 16384 is pi/2
+ * and -32768 is -pi. Maximum error is 1 count (9.6e-5 rad) for any inputs.
+ * @param y The y component, for example a raw BNO055 reading
+ * @param x The x component
+ * @return the angle of (x, y) as a binary angle
+ */
+int16_t atan2_bam(int16_t y, int16_t x);
+
+/**
+ * @brief Fixed point asin with the input in Q14 (16384 is 1.0) and a binary angle out.
+ * Uses atan2_bam(x, sqrt(1 - x^2)); maximum error is 2 counts (1.9e-4 rad). Inputs
+ * beyond +-1.0 are clamped.
+ * @param x_q14 The sine of the angle in Q14
+ * @return the angle as a binary angle, between -16384 and 16384
+ */
+int16_t asin_bam(int16_t x_q14);
+
+
+/**
+ * @brief Maths policy that routes the imu:: classes through the fast float functions.
+ * It has the same static members as imu::StdMath, so either can be passed where the
+ * imu:: classes take a maths policy.
+ */
+struct fast_math_policy {
+	static double sqrt(double x) { return fast_sqrt((float)x); }
+	static double inv_sqrt(double x) { return fast_inv_sqrt((float)x); }
+	static double atan2(double y, double x) { return fast_atan2((float)y, (float)x); }
+	static double asin(double x) { return fast_asin((float)x); }
+};
+
+#endif //ME507_FAST_MATH_H
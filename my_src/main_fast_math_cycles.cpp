@@ -0,0 +1,184 @@
+//
+// Counts the ATMega cycles each fast_math.h function takes, and its libm counterpart,
+// with timer 1 running at the CPU clock. Every function is called on the same spread of
+// inputs, read through volatiles so the compiler cannot fold them; the cost of reading
+// the timer around an empty call is subtracted. Results are sent on USART 0 at 9600
+// baud, one line per function with the fewest and most cycles seen, and the CPU then
+// sleeps with interrupts off, which ends a run under simavr. From the repository root:
+//
+//   avr-g++ -mmcu=atmega64 -DF_CPU=16000000UL -Os -std=gnu++11 -Imy_src -o fast_math_cycles.elf
+//           my_src/main_fast_math_cycles.cpp my_src/fast_math.cpp -lm       (one command)
+//   simavr -m atmega64 -f 16000000 fast_math_cycles.elf
+//
+// The same .elf gives the board's own counts when flashed, with a terminal on USART 0.
+//
+
+#include <stdint.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "fast_math.h"
+
+#define CYCLES_BAUD 9600UL
+#define INPUT_COUNT 8
+
+static volatile float float_inputs[INPUT_COUNT] = {
+	0.001f, 0.25f, 0.5f, 0.7071f, 0.9f, 1.0f, 42.0f, 1000.0f
+};
+static volatile float unit_inputs[INPUT_COUNT] = {
+	-1.0f, -0.9f, -0.5f, -0.01f, 0.0f, 0.3f, 0.8660f, 0.999f
+};
+static volatile int16_t raw_inputs[INPUT_COUNT] = {
+	-32768, -16000, -900, -1, 1, 700, 12000, 32767
+};
+static volatile float float_sink;
+static volatile int32_t int_sink;
+
+/// Sends a character on USART 0, waiting for the data register to empty
+static void send_char(char a_char)
+{
+	while (!(UCSR0A & (1 << UDRE)))
+		;
+	UCSR0A |= (1 << TXC);       // cleared here so it is set again once this byte has gone
+	UDR0 = (uint8_t)a_char;
+}
+
+static void send_string(const char *text)
+{
+	while (*text)
+		send_char(*text++);
+}
+
+static void send_number(uint16_t value, uint8_t width)
+{
+	char digits[5];
+	uint8_t count = 0;
+	do {
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	while (width-- > count)
+		send_char(' ');
+	while (count > 0)
+		send_char(digits[--count]);
+}
+
+/// Fewest and most cycles over the calls measured since the last reset
+struct cycle_range {
+	uint16_t fewest;
+	uint16_t most;
+
+	void reset() { fewest = UINT16_MAX; most = 0; }
+
+	void add(uint16_t cycles)
+	{
+		if (cycles < fewest)
+			fewest = cycles;
+		if (cycles > most)
+			most = cycles;
+	}
+};
+
+static uint16_t overhead;
+
+/// Measures one call; the expression is evaluated between two reads of TCNT1
+#define COUNT_CYCLES(range, call)                             \
+	do {                                                      \
+		uint16_t start = TCNT1;                               \
+		call;                                                 \
+		uint16_t stop = TCNT1;                                \
+		(range).add((uint16_t)(stop - start - overhead));     \
+	} while (0)
+
+static void report(const char *name, const cycle_range &range)
+{
+	send_string(name);
+	send_number(range.fewest, 8);
+	send_number(range.most, 8);
+	send_string("\r\n");
+}
+
+int main()
+{
+	uint16_t divisor = (uint16_t)(F_CPU / (16UL * CYCLES_BAUD) - 1);
+	UBRR0H = (uint8_t)(divisor >> 8);
+	UBRR0L = (uint8_t)divisor;
+	UCSR0C = (1 << UCSZ1) | (1 << UCSZ0);
+	UCSR0B = (1 << TXEN);
+
+	TCCR1A = 0;
+	TCCR1B = (1 << CS10);       // counting at the CPU clock, no prescaler
+
+	cycle_range range;
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, (void)0);
+	overhead = range.fewest;
+
+	send_string("cycles          fewest    most\r\n");
+
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, float_sink = fast_inv_sqrt(float_inputs[i]));
+	report("fast_inv_sqrt", range);
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, float_sink = 1.0f / sqrtf(float_inputs[i]));
+	report("1 / sqrtf    ", range);
+
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, float_sink = fast_sqrt(float_inputs[i]));
+	report("fast_sqrt    ", range);
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, float_sink = sqrtf(float_inputs[i]));
+	report("sqrtf        ", range);
+
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, float_sink = fast_atan2(unit_inputs[i], float_inputs[i]));
+	report("fast_atan2   ", range);
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, float_sink = atan2f(unit_inputs[i], float_inputs[i]));
+	report("atan2f       ", range);
+
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, float_sink = fast_asin(unit_inputs[i]));
+	report("fast_asin    ", range);
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, float_sink = asinf(unit_inputs[i]));
+	report("asinf        ", range);
+
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, int_sink = isqrt32((uint32_t)(uint16_t)raw_inputs[i] << 15));
+	report("isqrt32      ", range);
+
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, int_sink = (int32_t)inv_sqrt_q16((uint32_t)(uint16_t)raw_inputs[i] << 8));
+	report("inv_sqrt_q16 ", range);
+
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, int_sink = atan2_bam(raw_inputs[i], raw_inputs[INPUT_COUNT - 1 - i]));
+	report("atan2_bam    ", range);
+
+	range.reset();
+	for (uint8_t i = 0; i < INPUT_COUNT; i++)
+		COUNT_CYCLES(range, int_sink = asin_bam((int16_t)(raw_inputs[i] / 2)));
+	report("asin_bam     ", range);
+
+	while (!(UCSR0A & (1 << TXC)))       // let the last byte leave before sleeping
+		;
+	cli();
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	sleep_enable();
+	sleep_cpu();
+	return 0;
+}
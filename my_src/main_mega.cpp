@@ -3,9 +3,8 @@
 //
 
 #include <iostream>
-#include <ridgely_inc/rs232int.h>
-#include "Adafruit_BNO055.h"
 #include "communication_data.h"
+#include "ATMega/mega_hal_avr.h"
 #include "ATMega/imu_task.h"
 #include "ATMega/fifth_wheel.h"
 #include "ATMega/gear_shifter.h"
@@ -18,21 +17,29 @@ using namespace std;
 
 const uint8_t N_MULTI_TASKS = 8;
 
+/// The peripherals each task drives; the servos share timer 1's three channels and the
+/// ESC has timer 3
+typedef avr_uart<1> pi_uart;
+typedef avr_servo<avr_timer16<1>, AVR_CHANNEL_A> steering_pwm;
+typedef avr_servo<avr_timer16<1>, AVR_CHANNEL_B> fifth_wheel_pwm;
+typedef avr_servo<avr_timer16<1>, AVR_CHANNEL_C> gear_shifter_pwm;
+typedef avr_servo<avr_timer16<3>, AVR_CHANNEL_A> motor_pwm;
+
+AVR_UART_RECEIVER(1, USART1_RX_vect)
+
 int main() {
 
     /// a bunch of initialization code
 
     static semi_truck_data_t semi_truck_data = {0};
     auto comm_data = new communication_data(&semi_truck_data);
-    auto *p_ser_port = new rs232 (9600, 1);
-    
-
-    auto fifth = new fifth_wheel("fifth_wheel", 1, 200, nullptr, &semi_truck_data);
-    auto shifter = new gear_shifter("gear_shifter", 1, 200, nullptr, &semi_truck_data);
-    auto imu = new imu_task("imu", 5, 400, nullptr, 0, 0, nullptr);
-    auto comm = new mega_comm_task("communicator", 5, 500, nullptr, 9600, 1, comm_data); // works with non-reference to comm data?
-    auto motor = new motor_driver("motor", 6, 400, nullptr, &semi_truck_data);
-    auto steering = new steer_servo("steering", 6, 400, nullptr, nullptr);
+
+    auto fifth = new fifth_wheel<fifth_wheel_pwm>("fifth_wheel", 1, 200, nullptr, &semi_truck_data);
+    auto shifter = new gear_shifter<gear_shifter_pwm>("gear_shifter", 1, 200, nullptr, &semi_truck_data);
+    auto imu = new imu_task<avr_twi>("imu", 5, 400, nullptr, BNO055_ADDRESS_A, nullptr);
+    auto comm = new mega_comm_task<pi_uart>("communicator", 5, 500, nullptr, 9600, comm_data); // works with non-reference to comm data?
+    auto motor = new motor_driver<motor_pwm>("motor", 6, 400, nullptr, &semi_truck_data);
+    auto steering = new steer_servo<steering_pwm>("steering", 6, 400, nullptr, nullptr);
     auto speed = new wheel_speed("speed sensor", 9, 400, nullptr, nullptr);
 
 
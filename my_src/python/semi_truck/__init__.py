@@ -0,0 +1,5 @@
+"""Python access to the truck's recordings and simulator, for analysis and tuning scripts.
+
+blackbox reads the flight_recorder's files as numpy arrays over the mapped file; sim
+steps the C++ simulator in batches through the truck_sim library. Both need numpy.
+"""
@@ -0,0 +1,170 @@
+"""Reads the files the Pi's flight_recorder writes (see RaspberryPi/flight_recorder.h).
+
+The file is memory-mapped and every ring is a numpy structured array laid straight over
+the mapping, so opening even a long recording copies nothing: ``rec.scans['ranges']`` is
+a (count, 1081) float32 view of the file itself, and a script pays only for the parts it
+reads. The layouts below mirror the C++ structures and are checked against the item
+sizes the file records, so a file from a build with different structures is refused
+rather than read wrong.
+
+usage: python -m semi_truck.blackbox file...
+"""
+
+import mmap
+import sys
+
+import numpy as np
+
+RECORDER_MAGIC = 0x584F4242
+RECORDER_VERSION = 1
+LIDAR_MAX_POINTS = 1081
+
+#: recorder_trigger, by value
+TRIGGERS = ('failsafe', 'deadline_miss', 'emergency_brake', 'operator')
+#: recorder_ring, in the order the rings are written
+RINGS = ('scans', 'telemetry', 'commands', 'cycles')
+
+LIDAR_SCAN = np.dtype([
+    ('time_us', '<u8'),
+    ('sweep_us', '<u4'),
+    ('angle_min', '<f4'),
+    ('angle_increment', '<f4'),
+    ('range_min', '<f4'),
+    ('range_max', '<f4'),
+    ('count', '<u2'),
+    ('ranges', '<f4', (LIDAR_MAX_POINTS,)),
+    ('flags', 'u1', (LIDAR_MAX_POINTS,)),
+], align=True)
+
+SEMI_TRUCK_DATA = np.dtype([
+    ('motor_output', '<i2'),
+    ('speed_setpoint', '<i2'),
+    ('steer_output', '<i2'),
+    ('wheel_speed', '<i2'),
+    ('imu_angle', '<u2'),
+    ('desired_gear', 'i1'),
+    ('actual_gear', 'i1'),
+    ('desired_5th', '?'),
+    ('actual_5th', '?'),
+], align=True)
+
+RECORDER_CYCLE = np.dtype([
+    ('latency_us', '<u4'),
+    ('deadline_us', '<u4'),
+    ('shed_level', 'u1'),
+    ('steer_output', '<i2'),
+    ('motor_output', '<i2'),
+], align=True)
+
+RECORDER_FILE_HEADER = np.dtype([
+    ('magic', '<u4'),
+    ('version', '<u2'),
+    ('reason', 'u1'),
+    ('triggers', 'u1'),
+    ('trigger_us', '<u8'),
+    ('frozen_us', '<u8'),
+    ('counts', '<u4', (len(RINGS),)),
+    ('item_sizes', '<u4', (len(RINGS),)),
+    ('skipped', '<u4', (len(RINGS),)),
+    ('status_size', '<u4'),
+], align=True)
+
+ITEMS = (LIDAR_SCAN, SEMI_TRUCK_DATA, SEMI_TRUCK_DATA, RECORDER_CYCLE)
+
+
+def record_dtype(item):
+    """The layout of one record in a file: its time, then the item as it is in memory.
+
+    Records follow each other with no padding, so the fields of the item are flattened
+    next to the record's time, ``record_us``, at their own offsets; numpy reads the
+    unaligned ones itself.
+    """
+    names = ['record_us'] + list(item.names)
+    formats = ['<u8'] + [item.fields[n][0] for n in item.names]
+    offsets = [0] + [8 + item.fields[n][1] for n in item.names]
+    return np.dtype({'names': names, 'formats': formats, 'offsets': offsets, 'itemsize': 8 + item.itemsize})
+
+
+class Recording(object):
+    """One incident written by the flight_recorder, mapped read-only.
+
+    ``scans``, ``telemetry``, ``commands`` and ``cycles`` are structured arrays over the
+    file with a ``record_us`` field, the time each was recorded, and the fields of their
+    C++ structure, oldest record first. They stay valid until close(); copy what must
+    outlive it.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self._file = open(path, 'rb')
+        self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+        if len(self._map) < RECORDER_FILE_HEADER.itemsize:
+            raise ValueError('%s: too short for a recorder file' % path)
+        header = np.frombuffer(self._map, RECORDER_FILE_HEADER, 1)[0]
+        if header['magic'] != RECORDER_MAGIC or header['version'] != RECORDER_VERSION:
+            raise ValueError('%s: not a version %d recorder file' % (path, RECORDER_VERSION))
+
+        self.reason = TRIGGERS[header['reason']]
+        self.triggers = [name for bit, name in enumerate(TRIGGERS) if header['triggers'] & (1 << bit)]
+        self.trigger_us = int(header['trigger_us'])
+        self.frozen_us = int(header['frozen_us'])
+        self.skipped = dict(zip(RINGS, (int(n) for n in header['skipped'])))
+
+        offset = RECORDER_FILE_HEADER.itemsize
+        for i, (name, item) in enumerate(zip(RINGS, ITEMS)):
+            if header['item_sizes'][i] != item.itemsize:
+                raise ValueError('%s: %s are %d bytes in the file, %d here'
+                                 % (path, name, header['item_sizes'][i], item.itemsize))
+            records = record_dtype(item)
+            count = int(header['counts'][i])
+            setattr(self, name, np.frombuffer(self._map, records, count, offset))
+            offset += count * records.itemsize
+        size = int(header['status_size'])
+        self.status = self._map[offset:offset + size].decode('ascii', 'replace')
+
+    def close(self):
+        """Unmaps the file. Every array taken from it must have been let go first."""
+        for name in RINGS:
+            setattr(self, name, None)
+        self._map.close()
+        self._file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def seconds(self, ring):
+        """Times of a ring's records in seconds from the trigger, negative before it."""
+        return (getattr(self, ring)['record_us'].astype(np.int64) - self.trigger_us) * 1e-6
+
+    def scan_points(self, index):
+        """The x and y of every valid ray of one scan, in the sensor frame (m)."""
+        scan = self.scans[index]
+        n = int(scan['count'])
+        ranges = scan['ranges'][:n]
+        angles = scan['angle_min'] + scan['angle_increment'] * np.arange(n, dtype=np.float32)
+        valid = (ranges >= scan['range_min']) & (ranges <= scan['range_max']) & ((scan['flags'][:n] & 0x02) == 0)
+        return ranges[valid] * np.cos(angles[valid]), ranges[valid] * np.sin(angles[valid])
+
+
+def main(paths):
+    for path in paths:
+        with Recording(path) as rec:
+            print('%s: %s (%s)' % (path, rec.reason, ', '.join(rec.triggers)))
+            for name in RINGS:
+                t = rec.seconds(name)
+                span = '%.2f to %.2f s' % (t[0], t[-1]) if len(t) else 'empty'
+                print('  %-9s %5d records, %s' % (name, len(t), span))
+            cycles = rec.cycles
+            if len(cycles):
+                late = cycles['latency_us'] > cycles['deadline_us']
+                print('  %d of %d commands late, worst %d us' % (late.sum(), len(cycles), cycles['latency_us'].max()))
+            if rec.status:
+                print('  ' + rec.status.rstrip().replace('\n', '\n  '))
+            del cycles, t
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,201 @@
+"""Steps the C++ simulator from Python through the truck_sim library (see sim/sim_bindings.h).
+
+Every call covers a whole batch, so the loops run in C++: a Batch steps any number of
+trucks any number of steps per call, and run_scenarios() runs closed-loop maneuvers on
+every core. Arrays cross as pointers to numpy's own memory, and a Batch's commands are
+numpy views of the library's arrays, so setting them is a plain assignment with no copy.
+
+The library is looked for in $SEMI_TRUCK_SIM_LIB, then in the usual build directories of
+the repository; load() takes an explicit path.
+"""
+
+import ctypes
+import os
+
+import numpy as np
+from numpy.ctypeslib import ndpointer
+
+SIM_BINDINGS_VERSION = 1
+
+#: The fields of vehicle_state, one column each in a state array
+STATE_FIELDS = ('x', 'y', 'heading', 'hitch', 'steer', 'speed')
+
+#: scenario_kind, by value
+LANE_CHANGE, FORWARD_CURVE, REVERSE_STRAIGHT, REVERSE_CURVE = range(4)
+
+CONTROL_GAINS = np.dtype([
+    ('lookahead', '<f4'),
+    ('reverse_lookahead', '<f4'),
+    ('hitch_gain', '<f4'),
+    ('speed_kp', '<f4'),
+    ('speed_ki', '<f4'),
+    ('speed_ff', '<f4'),
+], align=True)
+
+SCENARIO = np.dtype([
+    ('kind', '<i4'),
+    ('gains', CONTROL_GAINS),
+    ('speed', '<f4'),
+    ('initial_offset', '<f4'),
+    ('initial_heading', '<f4'),
+    ('initial_hitch', '<f4'),
+    ('position_noise', '<f4'),
+    ('hitch_noise', '<f4'),
+    ('seed', '<u4'),
+], align=True)
+
+RUN_METRICS = np.dtype([
+    ('rms_error', '<f4'),
+    ('max_error', '<f4'),
+    ('settling_time', '<f4'),
+    ('jackknife_events', '<u2'),
+    ('max_hitch', '<f4'),
+    ('completed', '?'),
+    ('duration', '<f4'),
+], align=True)
+
+# sim_struct, with the layout each one must have
+_STRUCTS = ((0, 4 * len(STATE_FIELDS)), (1, SCENARIO.itemsize), (2, RUN_METRICS.itemsize))
+_BUILD_DIRS = ('build', 'cmake-build-debug', 'cmake-build-release')
+
+_lib = None
+
+
+def _floats(ndim):
+    return ndpointer(np.float32, ndim=ndim, flags='C_CONTIGUOUS')
+
+
+def load(path=None):
+    """Loads the library, from path or the first place it is found, and checks it matches."""
+    global _lib
+    if _lib is not None and path is None:
+        return _lib
+    if path is None:
+        path = os.environ.get('SEMI_TRUCK_SIM_LIB')
+    if path is None:
+        root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..', '..', '..'))
+        for d in _BUILD_DIRS:
+            candidate = os.path.join(root, d, 'libtruck_sim.so')
+            if os.path.exists(candidate):
+                path = candidate
+                break
+        else:
+            raise OSError('libtruck_sim.so not found; build the truck_sim target or set SEMI_TRUCK_SIM_LIB')
+    lib = ctypes.CDLL(path)
+
+    lib.sim_bindings_version.restype = ctypes.c_uint32
+    lib.sim_struct_size.argtypes = [ctypes.c_int]
+    lib.sim_struct_size.restype = ctypes.c_size_t
+    if lib.sim_bindings_version() != SIM_BINDINGS_VERSION:
+        raise OSError('%s is version %d, these bindings are version %d'
+                      % (path, lib.sim_bindings_version(), SIM_BINDINGS_VERSION))
+    for which, size in _STRUCTS:
+        if lib.sim_struct_size(which) != size:
+            raise OSError('%s: structure %d is %d bytes, %d here' % (path, which, lib.sim_struct_size(which), size))
+
+    lib.sim_batch_create.argtypes = [ctypes.c_size_t]
+    lib.sim_batch_create.restype = ctypes.c_void_p
+    lib.sim_batch_destroy.argtypes = [ctypes.c_void_p]
+    lib.sim_batch_size.argtypes = [ctypes.c_void_p]
+    lib.sim_batch_size.restype = ctypes.c_size_t
+    lib.sim_batch_reset.argtypes = [ctypes.c_void_p, _floats(2)]
+    lib.sim_batch_states.argtypes = [ctypes.c_void_p, _floats(2)]
+    lib.sim_batch_steer_outputs.argtypes = [ctypes.c_void_p]
+    lib.sim_batch_steer_outputs.restype = ctypes.POINTER(ctypes.c_int16)
+    lib.sim_batch_motor_outputs.argtypes = [ctypes.c_void_p]
+    lib.sim_batch_motor_outputs.restype = ctypes.POINTER(ctypes.c_int16)
+    lib.sim_batch_wheel_speeds.argtypes = [ctypes.c_void_p, ndpointer(np.int16, ndim=1, flags='C_CONTIGUOUS')]
+    lib.sim_batch_run.argtypes = [ctypes.c_void_p, ctypes.c_float, ctypes.c_uint32, ctypes.c_uint32,
+                                  ctypes.c_void_p]
+    lib.sim_default_gains.argtypes = [ctypes.c_void_p]
+    lib.sim_run_scenarios.argtypes = [ndpointer(SCENARIO, flags='C_CONTIGUOUS'), ctypes.c_size_t,
+                                      ndpointer(RUN_METRICS, flags='C_CONTIGUOUS'), ctypes.c_uint]
+    _lib = lib
+    return lib
+
+
+class Batch(object):
+    """A batch of simulated trucks with the nominal parameters, all at rest at the origin.
+
+    ``steer`` and ``motor`` are the commands, in the units of semi_truck_data_t, as int16
+    views of the library's own arrays: assign to them and the next run() uses them. The
+    views must not be used after close().
+    """
+
+    def __init__(self, count):
+        self._lib = load()
+        self._batch = self._lib.sim_batch_create(count)
+        if not self._batch:
+            raise ValueError('a batch needs at least one truck')
+        self.count = count
+        self.steer = np.ctypeslib.as_array(self._lib.sim_batch_steer_outputs(self._batch), (count,))
+        self.motor = np.ctypeslib.as_array(self._lib.sim_batch_motor_outputs(self._batch), (count,))
+
+    def close(self):
+        if self._batch:
+            self.steer = self.motor = None
+            self._lib.sim_batch_destroy(self._batch)
+            self._batch = None
+
+    def __del__(self):
+        self.close()
+
+    def reset(self, states):
+        """Puts every truck in a state; states is (count, 6) in STATE_FIELDS order."""
+        states = np.ascontiguousarray(states, np.float32).reshape(self.count, len(STATE_FIELDS))
+        self._lib.sim_batch_reset(self._batch, states)
+
+    def states(self, out=None):
+        """Every truck's state as a (count, 6) float32 array, filled in place if out is given."""
+        if out is None:
+            out = np.empty((self.count, len(STATE_FIELDS)), np.float32)
+        self._lib.sim_batch_states(self._batch, out)
+        return out
+
+    def wheel_speeds(self):
+        """Every truck's wheel speed sensor reading, as in semi_truck_data_t."""
+        out = np.empty(self.count, np.int16)
+        self._lib.sim_batch_wheel_speeds(self._batch, out)
+        return out
+
+    def run(self, steps, dt, keep_every=0):
+        """Steps every truck steps times, holding the commands.
+
+        Returns the states after every keep_every-th step as a
+        (steps // keep_every, count, 6) array, or None if keep_every is 0.
+        """
+        trajectory = None
+        pointer = None
+        if keep_every:
+            trajectory = np.empty((steps // keep_every, self.count, len(STATE_FIELDS)), np.float32)
+            pointer = trajectory.ctypes.data
+        self._lib.sim_batch_run(self._batch, dt, steps, keep_every, pointer)
+        return trajectory
+
+
+def default_gains():
+    """The nominal gains, as default_gains() in C++, in a CONTROL_GAINS record."""
+    gains = np.zeros(1, CONTROL_GAINS)
+    load().sim_default_gains(gains.ctypes.data)
+    return gains[0]
+
+
+def scenarios(count, kind=LANE_CHANGE, speed=0.5):
+    """A SCENARIO array of count runs with the nominal gains and no noise, to fill in."""
+    out = np.zeros(count, SCENARIO)
+    out['kind'] = kind
+    out['gains'] = default_gains()
+    out['speed'] = speed
+    out['seed'] = np.arange(1, count + 1)
+    return out
+
+
+def run_scenarios(runs, threads=0):
+    """Runs every scenario in a SCENARIO array, on threads threads (0 for one per core).
+
+    Returns a RUN_METRICS array with one record per scenario.
+    """
+    runs = np.ascontiguousarray(runs, SCENARIO)
+    metrics = np.zeros(len(runs), RUN_METRICS)
+    load().sim_run_scenarios(runs, len(runs), metrics, threads)
+    return metrics
@@ -0,0 +1,452 @@
+/**
+ * Fixed-size rectangular matrices for the state estimators, built to sit next to
+ * imu::Matrix from the BNO055 maths library. imu::Matrix<N> is square only, and its
+ * determinant() expands by minors, which is O(N!), and invert() divides by that
+ * determinant. That is fine for the 3x3 rotation matrices the IMU code uses but is
+ * unusable for a 5-9 state Kalman filter.
+ *
+ * imu::RectMatrix<R, C> has its dimensions fixed at compile time, never touches the
+ * heap, and provides in-place LU (partial pivoting) and Cholesky decompositions plus
+ * the symmetric helpers a Kalman filter needs (A P A^T, P - K S K^T, symmetrize).
+ * Everything is O(N^3) or better. The cell type defaults to double, which the AVR
+ * compiler treats as float, so small sizes are usable on the ATMega as well as the Pi.
+ */
+
+#ifndef ME507_RECT_MATRIX_H
+#define ME507_RECT_MATRIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "matrix.h"
+
+namespace imu
+{
+
+template <uint8_t R, uint8_t C, typename T = double> class RectMatrix
+{
+public:
+    static constexpr uint8_t rows = R;
+    static constexpr uint8_t cols = C;
+
+    RectMatrix()
+    {
+        fill(0);
+    }
+
+    /**
+     * @brief Copies a square imu::Matrix into a RectMatrix of the same size.
+     * @param m The matrix to copy
+     */
+    explicit RectMatrix(const Matrix<R>& m)
+    {
+        static_assert(R == C, "only a square RectMatrix can be built from imu::Matrix");
+        for (uint8_t i = 0; i < R; i++)
+            for (uint8_t j = 0; j < C; j++)
+                cell(i, j) = m(i, j);
+    }
+
+    static RectMatrix identity()
+    {
+        RectMatrix ret;
+        for (uint8_t i = 0; i < R && i < C; i++)
+            ret.cell(i, i) = 1;
+        return ret;
+    }
+
+    void fill(T value)
+    {
+        for (uint16_t ij = 0; ij < R*C; ++ij)
+            _cell_data[ij] = value;
+    }
+
+    T operator()(uint8_t i, uint8_t j) const
+    {
+        return cell(i, j);
+    }
+    T& operator()(uint8_t i, uint8_t j)
+    {
+        return cell(i, j);
+    }
+
+    T cell(uint8_t i, uint8_t j) const
+    {
+        return _cell_data[i*C+j];
+    }
+    T& cell(uint8_t i, uint8_t j)
+    {
+        return _cell_data[i*C+j];
+    }
+
+    T* data() { return _cell_data; }
+    const T* data() const { return _cell_data; }
+
+    /**
+     * @brief Copies a square RectMatrix back into an imu::Matrix.
+     * @return the same values as an imu::Matrix<R>
+     */
+    Matrix<R> to_matrix() const
+    {
+        static_assert(R == C, "only a square RectMatrix can become an imu::Matrix");
+        Matrix<R> ret;
+        for (uint8_t i = 0; i < R; i++)
+            for (uint8_t j = 0; j < C; j++)
+                ret(i, j) = cell(i, j);
+        return ret;
+    }
+
+    RectMatrix operator+(const RectMatrix& m) const
+    {
+        RectMatrix ret;
+        for (uint16_t ij = 0; ij < R*C; ++ij)
+            ret._cell_data[ij] = _cell_data[ij] + m._cell_data[ij];
+        return ret;
+    }
+
+    RectMatrix operator-(const RectMatrix& m) const
+    {
+        RectMatrix ret;
+        for (uint16_t ij = 0; ij < R*C; ++ij)
+            ret._cell_data[ij] = _cell_data[ij] - m._cell_data[ij];
+        return ret;
+    }
+
+    RectMatrix& operator+=(const RectMatrix& m)
+    {
+        for (uint16_t ij = 0; ij < R*C; ++ij)
+            _cell_data[ij] += m._cell_data[ij];
+        return *this;
+    }
+
+    RectMatrix& operator-=(const RectMatrix& m)
+    {
+        for (uint16_t ij = 0; ij < R*C; ++ij)
+            _cell_data[ij] -= m._cell_data[ij];
+        return *this;
+    }
+
+    RectMatrix operator*(T scalar) const
+    {
+        RectMatrix ret;
+        for (uint16_t ij = 0; ij < R*C; ++ij)
+            ret._cell_data[ij] = _cell_data[ij] * scalar;
+        return ret;
+    }
+
+    template <uint8_t K>
+    RectMatrix<R, K, T> operator*(const RectMatrix<C, K, T>& m) const
+    {
+        RectMatrix<R, K, T> ret;
+        for (uint8_t i = 0; i < R; i++)
+        {
+            for (uint8_t k = 0; k < C; k++)
+            {
+                // i-k-j order walks both operands row by row
+                T a = cell(i, k);
+                for (uint8_t j = 0; j < K; j++)
+                    ret(i, j) += a * m(k, j);
+            }
+        }
+        return ret;
+    }
+
+    RectMatrix<C, R, T> transpose() const
+    {
+        RectMatrix<C, R, T> ret;
+        for (uint8_t i = 0; i < R; i++)
+            for (uint8_t j = 0; j < C; j++)
+                ret(j, i) = cell(i, j);
+        return ret;
+    }
+
+    T trace() const
+    {
+        T tr = 0;
+        for (uint8_t i = 0; i < R && i < C; ++i)
+            tr += cell(i, i);
+        return tr;
+    }
+
+    /**
+     * @brief Computes the determinant through an LU decomposition of a copy.
+     * @return the determinant, or 0 if the matrix is singular
+     */
+    T determinant() const
+    {
+        static_assert(R == C, "determinant() needs a square matrix");
+        RectMatrix lu = *this;
+        uint8_t piv[R];
+        int8_t sign;
+        if (!lu_decompose(lu, piv, &sign))
+            return 0;
+        return lu_determinant(lu, sign);
+    }
+
+    /**
+     * @brief Inverts a square matrix through an LU decomposition.
+     * @param out Where the inverse is written
+     * @return true on success, false if the matrix is singular
+     */
+    bool invert(RectMatrix& out) const
+    {
+        static_assert(R == C, "invert() needs a square matrix");
+        RectMatrix lu = *this;
+        uint8_t piv[R];
+        int8_t sign;
+        if (!lu_decompose(lu, piv, &sign))
+            return false;
+        out = identity();
+        lu_solve(lu, piv, out);
+        return true;
+    }
+
+private:
+    T _cell_data[R*C];
+};
+
+
+/**
+ * @brief Factors a square matrix in place into L and U with partial pivoting.
+ * On return the strict lower triangle holds L (whose diagonal is all ones) and the
+ * upper triangle holds U, for the row-permuted matrix given by piv.
+ * @param a The matrix to factor; overwritten with L and U
+ * @param piv Filled with the row that was swapped into each position
+ * @param sign If not NULL, set to +1 or -1 depending on the parity of the row swaps
+ * @return true on success, false if a zero pivot shows the matrix is singular
+ */
+template <uint8_t N, typename T>
+bool lu_decompose(RectMatrix<N, N, T>& a, uint8_t piv[N], int8_t* sign = NULL)
+{
+    int8_t s = 1;
+    for (uint8_t k = 0; k < N; k++)
+    {
+        uint8_t p = k;
+        T best = fabs(a(k, k));
+        for (uint8_t i = k + 1; i < N; i++)
+        {
+            T v = fabs(a(i, k));
+            if (v > best)
+            {
+                best = v;
+                p = i;
+            }
+        }
+        piv[k] = p;
+        if (best == 0)
+            return false;
+
+        if (p != k)
+        {
+            for (uint8_t j = 0; j < N; j++)
+            {
+                T tmp = a(k, j);
+                a(k, j) = a(p, j);
+                a(p, j) = tmp;
+            }
+            s = -s;
+        }
+
+        T inv_pivot = 1 / a(k, k);
+        for (uint8_t i = k + 1; i < N; i++)
+        {
+            T f = a(i, k) * inv_pivot;
+            a(i, k) = f;
+            for (uint8_t j = k + 1; j < N; j++)
+                a(i, j) -= f * a(k, j);
+        }
+    }
+    if (sign)
+        *sign = s;
+    return true;
+}
+
+/**
+ * @brief Solves A X = B in place using the output of lu_decompose().
+ * @param lu The factored matrix from lu_decompose()
+ * @param piv The pivot rows from lu_decompose()
+ * @param b The right hand side; overwritten with the solution X
+ */
+template <uint8_t N, uint8_t K, typename T>
+void lu_solve(const RectMatrix<N, N, T>& lu, const uint8_t piv[N], RectMatrix<N, K, T>& b)
+{
+    for (uint8_t k = 0; k < N; k++)
+    {
+        if (piv[k] != k)
+        {
+            for (uint8_t j = 0; j < K; j++)
+            {
+                T tmp = b(k, j);
+                b(k, j) = b(piv[k], j);
+                b(piv[k], j) = tmp;
+            }
+        }
+    }
+
+    // forward substitution with the unit lower triangle
+    for (uint8_t i = 1; i < N; i++)
+        for (uint8_t k = 0; k < i; k++)
+        {
+            T f = lu(i, k);
+            for (uint8_t j = 0; j < K; j++)
+                b(i, j) -= f * b(k, j);
+        }
+
+    // back substitution with the upper triangle
+    for (int8_t i = N - 1; i >= 0; i--)
+    {
+        for (uint8_t k = i + 1; k < N; k++)
+        {
+            T f = lu(i, k);
+            for (uint8_t j = 0; j < K; j++)
+                b(i, j) -= f * b(k, j);
+        }
+        T inv_diag = 1 / lu(i, i);
+        for (uint8_t j = 0; j < K; j++)
+            b(i, j) *= inv_diag;
+    }
+}
+
+/**
+ * @brief Gets the determinant of a matrix already factored by lu_decompose().
+ * @param lu The factored matrix
+ * @param sign The permutation sign returned by lu_decompose()
+ * @return the determinant of the original matrix
+ */
+template <uint8_t N, typename T>
+T lu_determinant(const RectMatrix<N, N, T>& lu, int8_t sign)
+{
+    T det = sign;
+    for (uint8_t i = 0; i < N; i++)
+        det *= lu(i, i);
+    return det;
+}
+
+/**
+ * @brief Factors a symmetric positive definite matrix in place as L L^T.
+ * Only the lower triangle of a is read. On return it holds L and the strict upper
+ * triangle is zeroed, so a can be used directly as L.
+ * @param a The matrix to factor; overwritten with L
+ * @return true on success, false if a is not positive definite
+ */
+template <uint8_t N, typename T>
+bool cholesky_decompose(RectMatrix<N, N, T>& a)
+{
+    for (uint8_t j = 0; j < N; j++)
+    {
+        T d = a(j, j);
+        for (uint8_t k = 0; k < j; k++)
+            d -= a(j, k) * a(j, k);
+        if (d <= 0)
+            return false;
+        d = sqrt(d);
+        a(j, j) = d;
+
+        T inv_d = 1 / d;
+        for (uint8_t i = j + 1; i < N; i++)
+        {
+            T s = a(i, j);
+            for (uint8_t k = 0; k < j; k++)
+                s -= a(i, k) * a(j, k);
+            a(i, j) = s * inv_d;
+            a(j, i) = 0;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Solves A X = B in place using the output of cholesky_decompose().
+ * @param l The Cholesky factor L of A
+ * @param b The right hand side; overwritten with the solution X
+ */
+template <uint8_t N, uint8_t K, typename T>
+void cholesky_solve(const RectMatrix<N, N, T>& l, RectMatrix<N, K, T>& b)
+{
+    // L Y = B
+    for (uint8_t i = 0; i < N; i++)
+    {
+        for (uint8_t k = 0; k < i; k++)
+        {
+            T f = l(i, k);
+            for (uint8_t j = 0; j < K; j++)
+                b(i, j) -= f * b(k, j);
+        }
+        T inv_diag = 1 / l(i, i);
+        for (uint8_t j = 0; j < K; j++)
+            b(i, j) *= inv_diag;
+    }
+
+    // L^T X = Y
+    for (int8_t i = N - 1; i >= 0; i--)
+    {
+        for (uint8_t k = i + 1; k < N; k++)
+        {
+            T f = l(k, i);
+            for (uint8_t j = 0; j < K; j++)
+                b(i, j) -= f * b(k, j);
+        }
+        T inv_diag = 1 / l(i, i);
+        for (uint8_t j = 0; j < K; j++)
+            b(i, j) *= inv_diag;
+    }
+}
+
+/**
+ * @brief Forces a matrix to be exactly symmetric by averaging it with its transpose.
+ * Rounding slowly breaks the symmetry of a covariance matrix; calling this after each
+ * update keeps the Cholesky decomposition from failing on it.
+ * @param p The matrix to symmetrize in place
+ */
+template <uint8_t N, typename T>
+void symmetrize(RectMatrix<N, N, T>& p)
+{
+    for (uint8_t i = 0; i < N; i++)
+        for (uint8_t j = i + 1; j < N; j++)
+        {
+            T avg = (p(i, j) + p(j, i)) / 2;
+            p(i, j) = avg;
+            p(j, i) = avg;
+        }
+}
+
+/**
+ * @brief Computes A P A^T for a symmetric P, such as F P F^T or H P H^T.
+ * Only the upper triangle of the result is computed and then mirrored, so the result
+ * is exactly symmetric.
+ * @param a The left hand matrix
+ * @param p A symmetric matrix
+ * @param out Where A P A^T is written
+ */
+template <uint8_t R, uint8_t N, typename T>
+void sandwich(const RectMatrix<R, N, T>& a, const RectMatrix<N, N, T>& p, RectMatrix<R, R, T>& out)
+{
+    RectMatrix<R, N, T> ap = a * p;
+    for (uint8_t i = 0; i < R; i++)
+        for (uint8_t j = i; j < R; j++)
+        {
+            T s = 0;
+            for (uint8_t k = 0; k < N; k++)
+                s += ap(i, k) * a(j, k);
+            out(i, j) = s;
+            out(j, i) = s;
+        }
+}
+
+/**
+ * @brief Subtracts K S K^T from a symmetric P, as in the covariance update P - K S K^T.
+ * @param p The symmetric matrix to update in place
+ * @param k The gain matrix
+ * @param s A symmetric matrix, such as the innovation covariance
+ */
+template <uint8_t N, uint8_t M, typename T>
+void subtract_sandwich(RectMatrix<N, N, T>& p, const RectMatrix<N, M, T>& k, const RectMatrix<M, M, T>& s)
+{
+    RectMatrix<N, N, T> ksk;
+    sandwich(k, s, ksk);
+    p -= ksk;
+}
+
+} // namespace
+
+#endif //ME507_RECT_MATRIX_H
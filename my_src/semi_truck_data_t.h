@@ -7,6 +7,17 @@
 
 #include <cstdint>
 
+/// steer_output is the commanded front wheel angle in milliradians (positive turns left)
+#define STEER_OUTPUT_PER_RAD 1000.0f
+/// motor_output runs from -MOTOR_OUTPUT_FULL (full reverse) to MOTOR_OUTPUT_FULL
+#define MOTOR_OUTPUT_FULL 1000
+/// motor_output that tells the motor driver to brake to a stop rather than drive
+#define MOTOR_OUTPUT_BRAKE (-32768)
+/// speed_setpoint and wheel_speed are in millimeters per second
+#define WHEEL_SPEED_PER_M_S 1000.0f
+/// imu_angle is the raw BNO055 Euler heading, 16 counts per degree
+#define IMU_ANGLE_PER_DEG 16
+
 /**
  * @brief a data structure that holds all of the information of what state the semi-truck is in at any
  * given time.
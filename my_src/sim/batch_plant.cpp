@@ -0,0 +1,209 @@
+//
+// Structure-of-arrays batch of tractor-trailer models; see batch_plant.h.
+//
+
+#include <cmath>
+#include <cstring>
+#include "batch_plant.h"
+
+#define BLOCK 4     // vehicles per vector
+
+#if defined(__GNUC__)
+#define BATCH_PLANT_VECTOR
+
+typedef float v4f __attribute__((vector_size(16)));
+
+static inline v4f load(const float *p)
+{
+	v4f v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store(float *p, v4f v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline v4f splat(float f)
+{
+	v4f v = {f, f, f, f};
+	return v;
+}
+
+static inline v4f load_command(const int16_t *p)
+{
+	v4f v = {(float)p[0], (float)p[1], (float)p[2], (float)p[3]};
+	return v;
+}
+
+static inline v4f clamp(v4f a, v4f lo, v4f hi)
+{
+	a = a < lo ? lo : a;
+	return a > hi ? hi : a;
+}
+
+/// Wraps an angle that is at most one turn out of range back into [-pi, pi]
+static inline v4f wrap(v4f a)
+{
+	v4f two_pi = splat(2.0f * (float)M_PI);
+	a = a > splat((float)M_PI) ? a - two_pi : a;
+	return a < splat(-(float)M_PI) ? a + two_pi : a;
+}
+
+/// sin for angles in [-pi, pi]: folded into [-pi/2, pi/2], then a 9th order polynomial
+static inline v4f vsin(v4f a)
+{
+	v4f pi = splat((float)M_PI);
+	v4f half_pi = splat((float)M_PI / 2);
+	a = a > half_pi ? pi - a : a;
+	a = a < -half_pi ? -pi - a : a;
+	v4f a2 = a * a;
+	return a * (splat(1.0f) + a2 * (splat(-1.0f / 6) + a2 * (splat(1.0f / 120)
+		+ a2 * (splat(-1.0f / 5040) + a2 * splat(1.0f / 362880)))));
+}
+
+static inline v4f vcos(v4f a)
+{
+	return vsin(wrap(a + splat((float)M_PI / 2)));
+}
+#endif
+
+batch_plant::batch_plant(const vehicle_params &params_in, size_t count_in)
+{
+	params = params_in;
+	count = count_in;
+	padded = (count_in + BLOCK - 1) / BLOCK * BLOCK;
+
+	// Padding vehicles are stepped along with the rest but never read
+	x.assign(padded, 0.0f);
+	y.assign(padded, 0.0f);
+	heading.assign(padded, 0.0f);
+	hitch.assign(padded, 0.0f);
+	steer.assign(padded, 0.0f);
+	speed.assign(padded, 0.0f);
+	steer_output.assign(padded, 0);
+	motor_output.assign(padded, 0);
+}
+
+void batch_plant::reset(size_t i, const vehicle_state &state)
+{
+	x[i] = state.x;
+	y[i] = state.y;
+	heading[i] = state.heading;
+	hitch[i] = state.hitch;
+	steer[i] = state.steer;
+	speed[i] = state.speed;
+}
+
+vehicle_state batch_plant::get_state(size_t i) const
+{
+	vehicle_state state = {x[i], y[i], heading[i], hitch[i], steer[i], speed[i]};
+	return state;
+}
+
+void batch_plant::set_command(size_t i, const semi_truck_data_t &data)
+{
+	steer_output[i] = data.steer_output;
+	motor_output[i] = data.motor_output;
+}
+
+void batch_plant::step(float dt)
+{
+#if defined(BATCH_PLANT_VECTOR)
+	const truck_geometry &g = params.geometry;
+	v4f v_dt = splat(dt);
+	v4f max_steer = splat(g.max_steer);
+	v4f min_steer = splat(-g.max_steer);
+	v4f rate_max = splat(params.steer_rate_max);
+	v4f rate_min = splat(-params.steer_rate_max);
+	v4f steer_scale = splat(1.0f / STEER_OUTPUT_PER_RAD);
+	v4f steer_gain = splat(params.steer_gain);
+	v4f inv_steer_tau = splat(1.0f / params.steer_tau);
+	v4f motor_scale = splat(params.top_speed / MOTOR_OUTPUT_FULL);
+	v4f motor_alpha = splat(dt / params.motor_tau);
+	v4f brake_command = splat((float)MOTOR_OUTPUT_BRAKE);
+	v4f brake_max = splat(params.brake_decel * dt);
+	v4f brake_min = splat(-params.brake_decel * dt);
+	v4f inv_wheelbase = splat(1.0f / g.wheelbase);
+	v4f inv_trailer = splat(1.0f / g.trailer_length);
+	v4f hitch_offset = splat(g.hitch_offset);
+
+	for (size_t i = 0; i < padded; i += BLOCK) {
+		v4f s = load(&steer[i]);
+		v4f steer_cmd = clamp(load_command(&steer_output[i]) * steer_scale, min_steer, max_steer) * steer_gain;
+		s += clamp((steer_cmd - s) * inv_steer_tau, rate_min, rate_max) * v_dt;
+
+		v4f v = load(&speed[i]);
+		v4f motor_cmd = load_command(&motor_output[i]);
+		v = motor_cmd == brake_command ? v - clamp(v, brake_min, brake_max)
+		                               : v + (motor_cmd * motor_scale - v) * motor_alpha;
+
+		v4f h = load(&heading[i]);
+		v4f k = load(&hitch[i]);
+		v4f sin_h = vsin(h), cos_h = vcos(h);
+		v4f k_wrapped = wrap(k);
+		v4f sin_k = vsin(k_wrapped), cos_k = vcos(k_wrapped);
+		v4f tan_s = vsin(s) / vcos(s);
+
+		v4f yaw_rate = v * tan_s * inv_wheelbase;
+		v4f trailer_rate = (-v * sin_k - hitch_offset * yaw_rate * cos_k) * inv_trailer;
+
+		store(&x[i], load(&x[i]) + v * cos_h * v_dt);
+		store(&y[i], load(&y[i]) + v * sin_h * v_dt);
+		store(&heading[i], wrap(h + yaw_rate * v_dt));
+		store(&hitch[i], k + (trailer_rate - yaw_rate) * v_dt);
+		store(&steer[i], s);
+		store(&speed[i], v);
+	}
+#else
+	step_scalar(dt);
+#endif
+}
+
+/**
+ * The same update as vehicle_model::step(), one vehicle at a time; used when the
+ * compiler has no vector extensions.
+ */
+void batch_plant::step_scalar(float dt)
+{
+	const truck_geometry &g = params.geometry;
+	for (size_t i = 0; i < count; i++) {
+		float steer_cmd = steer_output[i] / STEER_OUTPUT_PER_RAD;
+		steer_cmd = steer_cmd > g.max_steer ? g.max_steer : (steer_cmd < -g.max_steer ? -g.max_steer : steer_cmd);
+		steer_cmd *= params.steer_gain;
+		float rate = (steer_cmd - steer[i]) / params.steer_tau;
+		rate = rate > params.steer_rate_max ? params.steer_rate_max
+		       : (rate < -params.steer_rate_max ? -params.steer_rate_max : rate);
+		steer[i] += rate * dt;
+
+		if (motor_output[i] == MOTOR_OUTPUT_BRAKE) {
+			float brake = params.brake_decel * dt;
+			speed[i] -= speed[i] > brake ? brake : (speed[i] < -brake ? -brake : speed[i]);
+		}
+		else {
+			float speed_cmd = params.top_speed * motor_output[i] / MOTOR_OUTPUT_FULL;
+			speed[i] += (speed_cmd - speed[i]) * dt / params.motor_tau;
+		}
+
+		float v = speed[i];
+		float yaw_rate = v * tanf(steer[i]) / g.wheelbase;
+		float trailer_rate = (-v * sinf(hitch[i]) - g.hitch_offset * yaw_rate * cosf(hitch[i])) / g.trailer_length;
+		x[i] += v * cosf(heading[i]) * dt;
+		y[i] += v * sinf(heading[i]) * dt;
+		heading[i] += yaw_rate * dt;
+		hitch[i] += (trailer_rate - yaw_rate) * dt;
+		if (heading[i] > (float)M_PI)
+			heading[i] -= 2.0f * (float)M_PI;
+		else if (heading[i] <= -(float)M_PI)
+			heading[i] += 2.0f * (float)M_PI;
+	}
+}
+
+void batch_plant::measure_wheel_speeds(int16_t *out) const
+{
+	for (size_t i = 0; i < count; i++) {
+		float steps = roundf(speed[i] / params.speed_resolution);
+		out[i] = (int16_t)lroundf(steps * params.speed_resolution * WHEEL_SPEED_PER_M_S);
+	}
+}
@@ -0,0 +1,92 @@
+/**
+ * The batch_plant steps many copies of the tractor-trailer model at once. It follows the
+ * same equations as vehicle_model, but keeps every state variable in its own array
+ * (structure of arrays) so one step updates four vehicles per instruction. The vector
+ * code uses GCC vector extensions, which become SSE on an x86 host and NEON on the
+ * Raspberry Pi; sin and cos are replaced by short polynomials with a maximum error of
+ * 4e-6, so trajectories match vehicle_model closely but not bit for bit. Other compilers
+ * fall back to a scalar loop. Without optimization the vector code is worked element by
+ * element through memory and is slower than vehicle_model; batch_plant_bench compares
+ * the two.
+ *
+ * Every vehicle shares one set of vehicle_params. Commands are given per vehicle in the
+ * same units as steer_output and motor_output in semi_truck_data_t.
+ */
+
+#ifndef ME507_BATCH_PLANT_H
+#define ME507_BATCH_PLANT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../semi_truck_data_t.h"
+#include "vehicle_model.h"
+
+class batch_plant {
+public:
+	/**
+	 * @brief The constructor for a batch of vehicles, all at rest at the origin.
+	 * @param params_in The physical parameters shared by every vehicle
+	 * @param count_in The number of vehicles
+	 */
+	batch_plant(const vehicle_params &params_in, size_t count_in);
+
+	/**
+	 * @brief Puts one vehicle in a given state.
+	 * @param i The index of the vehicle
+	 * @param state The new state
+	 */
+	void reset(size_t i, const vehicle_state &state);
+
+	/**
+	 * @brief Reads back the state of one vehicle.
+	 * @param i The index of the vehicle
+	 * @return the vehicle's state
+	 */
+	vehicle_state get_state(size_t i) const;
+
+	/**
+	 * @brief Sets the commands of one vehicle from the data the Pi sends to the Mega.
+	 * @param i The index of the vehicle
+	 * @param data Its steer_output and motor_output are used
+	 */
+	void set_command(size_t i, const semi_truck_data_t &data);
+
+	/// Steering commands of every vehicle, as steer_output in semi_truck_data_t
+	int16_t *steer_outputs() { return &steer_output[0]; }
+	/// Motor commands of every vehicle, as motor_output in semi_truck_data_t
+	int16_t *motor_outputs() { return &motor_output[0]; }
+
+	/**
+	 * @brief Advances every vehicle by one time step.
+	 * @param dt The time step (s)
+	 */
+	void step(float dt);
+
+	/**
+	 * @brief Reads every vehicle's wheel speed sensor.
+	 * @param out Filled with one wheel_speed value per vehicle, as in semi_truck_data_t
+	 */
+	void measure_wheel_speeds(int16_t *out) const;
+
+	size_t size() const { return count; }
+
+private:
+	vehicle_params params;
+	size_t count;
+	size_t padded;      // count rounded up to a whole number of vector blocks
+
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> heading;
+	std::vector<float> hitch;
+	std::vector<float> steer;
+	std::vector<float> speed;
+	std::vector<int16_t> steer_output;
+	std::vector<int16_t> motor_output;
+
+	void step_scalar(float dt);
+};
+
+
+#endif //ME507_BATCH_PLANT_H
@@ -0,0 +1,34 @@
+/**
+ * Host port of JRR's emstream for the software-in-the-loop simulation. Only the
+ * character I/O and the few << operators the tasks use are kept; text written to an
+ * emstream that has no device behind it is simply dropped.
+ */
+
+#ifndef ME507_HOST_EMSTREAM_H
+#define ME507_HOST_EMSTREAM_H
+
+#include <cstdint>
+
+class emstream {
+private:
+	emstream(const emstream &);
+	emstream &operator=(const emstream &);
+
+public:
+	emstream() {}
+	virtual ~emstream() {}
+
+	virtual void putchar(char a_char) = 0;
+	virtual bool check_for_char() { return false; }
+	virtual char getchar() { return '\0'; }
+
+	void puts(const char *str);
+
+	emstream &operator<<(const char *str);
+	emstream &operator<<(char ch);
+	emstream &operator<<(int32_t num);
+	emstream &operator<<(uint32_t num);
+};
+
+
+#endif //ME507_HOST_EMSTREAM_H
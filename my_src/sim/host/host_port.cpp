@@ -0,0 +1,200 @@
+//
+// Host port of the embedded libraries the firmware tasks use; see the headers in this
+// directory. Everything that would wait on hardware waits on the virtual_rtos clock.
+//
+
+#include <cstdio>
+#include "taskbase.h"
+#include "rs232int.h"
+#include "../virtual_rtos.h"
+#include "../serial_link.h"
+
+#define US_PER_TICK (1000000UL / configTICK_RATE_HZ)
+
+// emstream
+
+void emstream::puts(const char *str)
+{
+	while (*str)
+		putchar(*str++);
+}
+
+emstream &emstream::operator<<(const char *str)
+{
+	puts(str);
+	return *this;
+}
+
+emstream &emstream::operator<<(char ch)
+{
+	putchar(ch);
+	return *this;
+}
+
+emstream &emstream::operator<<(int32_t num)
+{
+	char text[12];
+	snprintf(text, sizeof(text), "%ld", (long)num);
+	puts(text);
+	return *this;
+}
+
+emstream &emstream::operator<<(uint32_t num)
+{
+	char text[12];
+	snprintf(text, sizeof(text), "%lu", (unsigned long)num);
+	puts(text);
+	return *this;
+}
+
+// TaskBase
+
+TaskBase::TaskBase(const char *a_name, unsigned portBASE_TYPE a_priority, size_t a_stack_size,
+                   emstream *p_ser_dev)
+{
+	(void)a_stack_size;
+	name = a_name;
+	p_serial = p_ser_dev;
+	state = 0;
+	previous_state = 0;
+	runs = 0;
+
+	virtual_rtos *rtos = virtual_rtos::get_current();
+	if (rtos)
+		rtos->add_task(this, a_priority);
+}
+
+void host_enter_critical()
+{
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	if (rtos)
+		rtos->enter_critical();
+}
+
+void host_exit_critical()
+{
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	if (rtos)
+		rtos->exit_critical();
+}
+
+void TaskBase::transition_to(uint8_t new_state)
+{
+	previous_state = state;
+	state = new_state;
+}
+
+void TaskBase::delay(TickType_t duration)
+{
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	if (rtos)
+		rtos->sleep_until(rtos->get_time_us() + (uint64_t)duration * US_PER_TICK);
+}
+
+void TaskBase::delay_ms(TickType_t duration_ms)
+{
+	delay((TickType_t)((uint32_t)duration_ms * configTICK_RATE_HZ / 1000UL));
+}
+
+void TaskBase::delay_from_for(TickType_t &from_ticks, TickType_t for_how_long)
+{
+	from_ticks += for_how_long;
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	if (rtos)
+		rtos->sleep_until((uint64_t)from_ticks * US_PER_TICK);
+}
+
+void TaskBase::delay_from_for_ms(TickType_t &from_ticks, TickType_t millisec)
+{
+	delay_from_for(from_ticks, (TickType_t)((uint32_t)millisec * configTICK_RATE_HZ / 1000UL));
+}
+
+TickType_t TaskBase::get_tick_count()
+{
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	return rtos ? rtos->get_tick_count() : 0;
+}
+
+void TaskBase::print_status(emstream &ser_dev)
+{
+	ser_dev << name << '\t' << (uint32_t)state << '\t' << runs << '\n';
+}
+
+// rs232
+
+rs232::rs232(uint16_t baud, uint8_t port)
+{
+	(void)baud;
+	link = NULL;
+	end = 0;
+	port_number = port;
+}
+
+void rs232::connect(serial_link *link_in, uint8_t end_in)
+{
+	link = link_in;
+	end = end_in;
+}
+
+void rs232::putchar(char a_char)
+{
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	if (link && rtos)
+		link->send(end, a_char, rtos->get_time_us());
+}
+
+bool rs232::check_for_char()
+{
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	return link && rtos && link->available(end, rtos->get_time_us());
+}
+
+uint16_t rs232::available()
+{
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	return link && rtos ? link->buffered(end, rtos->get_time_us()) : 0;
+}
+
+/**
+ * Waits for a byte like the real getchar(): until the next byte on the wire arrives,
+ * or a tick at a time while the line is idle. Outside a task there is no way to wait,
+ * so 0 is returned instead.
+ */
+char rs232::getchar()
+{
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	if (link == NULL || rtos == NULL)
+		return '\0';
+
+	while (!link->available(end, rtos->get_time_us())) {
+		if (!rtos->in_task())
+			return '\0';
+		uint64_t arrival;
+		if (link->next_arrival(end, arrival))
+			rtos->sleep_until(arrival, false);
+		else
+			rtos->sleep_until(rtos->get_time_us() + US_PER_TICK, false);
+	}
+	return link->receive(end, rtos->get_time_us());
+}
+
+bool rs232::wait_for(uint16_t count, TickType_t ticks)
+{
+	virtual_rtos *rtos = virtual_rtos::get_active();
+	if (link == NULL || rtos == NULL)
+		return false;
+
+	// Wakes once, when the last of the bytes comes in, as avr_uart's semaphore would
+	uint64_t deadline = rtos->get_time_us() + (uint64_t)ticks * US_PER_TICK;
+	uint16_t have;
+	while ((have = link->buffered(end, rtos->get_time_us())) < count) {
+		if (!rtos->in_task() || rtos->get_time_us() >= deadline)
+			return false;
+		uint64_t arrival;
+		if (link->next_arrival(end, arrival, (uint16_t)(count - have)) && arrival < deadline)
+			rtos->sleep_until(arrival, false);
+		else
+			rtos->sleep_until(deadline, false);
+	}
+	return true;
+}
@@ -0,0 +1,2 @@
+// Host port: the firmware includes this header as <ridgely_code/rs232int.h>; see ../rs232int.h.
+#include "../rs232int.h"
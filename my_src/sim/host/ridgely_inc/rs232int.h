@@ -0,0 +1,2 @@
+// Host port: the firmware includes this header as <ridgely_inc/rs232int.h>; see ../rs232int.h.
+#include "../rs232int.h"
@@ -0,0 +1,2 @@
+// Host port: the firmware includes this header as <ridgely_inc/taskbase.h>; see ../taskbase.h.
+#include "../taskbase.h"
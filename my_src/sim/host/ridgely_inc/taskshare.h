@@ -0,0 +1,2 @@
+// Host port: the firmware includes this header as <ridgely_inc/taskshare.h>; see ../taskshare.h.
+#include "../taskshare.h"
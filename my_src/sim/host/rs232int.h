@@ -0,0 +1,55 @@
+/**
+ * Host port of JRR's interrupt-driven rs232 class for the software-in-the-loop
+ * simulation. Instead of a UART, each port is one end of a serial_link, which delivers
+ * bytes after their transmission time at the link's baud rate and may lose some.
+ * putchar() never blocks; getchar() and wait_for() wait on the virtual clock until a
+ * byte arrives, like the real class waits for its receive interrupt.
+ */
+
+#ifndef ME507_HOST_RS232INT_H
+#define ME507_HOST_RS232INT_H
+
+#include <cstdint>
+#include "emstream.h"
+#include "taskbase.h"
+
+class serial_link;
+
+class rs232 : public emstream {
+public:
+	/**
+	 * @brief Creates a port that is not yet connected to anything.
+	 * @param baud Ignored; the serial_link sets the baud rate of both ends
+	 * @param port The UART number, kept only for reference
+	 */
+	rs232(uint16_t baud = 9600, uint8_t port = 0);
+
+	/**
+	 * @brief Connects this port to one end of a simulated serial line.
+	 * @param link_in The line
+	 * @param end_in Which end of the line this port is (0 or 1)
+	 */
+	void connect(serial_link *link_in, uint8_t end_in);
+
+	void putchar(char a_char);
+	bool check_for_char();
+	/// Bytes received and not yet read (host only; the ATMega's avr_uart has the same)
+	uint16_t available();
+	char getchar();
+	/**
+	 * @brief Waits until count bytes are received and not yet read (host only; the
+	 * ATMega's avr_uart has the same). The wait is part of the running task's release.
+	 * @param count The number of bytes to wait for
+	 * @param ticks The longest time to wait (ticks)
+	 * @return true if the bytes are there, false on the timeout or outside a task
+	 */
+	bool wait_for(uint16_t count, TickType_t ticks);
+
+private:
+	serial_link *link;
+	uint8_t end;
+	uint8_t port_number;
+};
+
+
+#endif //ME507_HOST_RS232INT_H
@@ -0,0 +1,79 @@
+/**
+ * Host port of JRR's TaskBase for the software-in-the-loop simulation. Tasks keep the
+ * constructor and run() method they have on the ATMega, but instead of FreeRTOS they
+ * are scheduled by the virtual_rtos on simulated time: every delay suspends the task
+ * until the virtual clock reaches its wake-up time, so a task's code runs unchanged
+ * and takes no simulated time itself. Only the parts of TaskBase and the FreeRTOS
+ * configuration that the tasks in my_src use are provided.
+ */
+
+#ifndef ME507_HOST_TASKBASE_H
+#define ME507_HOST_TASKBASE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "emstream.h"
+
+typedef uint32_t TickType_t;
+
+#define portBASE_TYPE char
+#define configTICK_RATE_HZ 1000
+#define configMINIMAL_STACK_SIZE 100
+
+// Tasks only switch when one of them delays or waits, so there is nothing to lock out;
+// the critical sections are only timed, for the virtual_rtos's task profiles
+#define portENTER_CRITICAL() host_enter_critical()
+#define portEXIT_CRITICAL() host_exit_critical()
+
+/// Tells the running virtual_rtos that the running task entered a critical section
+void host_enter_critical();
+/// Tells the running virtual_rtos that the running task left its critical section
+void host_exit_critical();
+
+class TaskBase {
+private:
+	TaskBase(const TaskBase &);
+	TaskBase &operator=(const TaskBase &);
+
+protected:
+	const char *name;
+	emstream *p_serial;
+	uint8_t state;
+	uint8_t previous_state;
+	uint32_t runs;
+
+	uint32_t get_loop_runs() { return runs; }
+
+public:
+	/**
+	 * @brief Creates the task and registers it with the current virtual_rtos.
+	 * @param a_name the name of the task
+	 * @param a_priority The priority given to this task; higher numbers run first
+	 * @param a_stack_size Ignored; host tasks get the virtual_rtos stack size
+	 * @param p_ser_dev A serial device for debugging output, or NULL
+	 */
+	explicit TaskBase(const char *a_name,
+	                  unsigned portBASE_TYPE a_priority = 0,
+	                  size_t a_stack_size = configMINIMAL_STACK_SIZE,
+	                  emstream *p_ser_dev = NULL);
+
+	virtual ~TaskBase() {}
+
+	virtual void run() = 0;
+
+	void transition_to(uint8_t new_state);
+
+	void delay(TickType_t duration);
+	void delay_ms(TickType_t duration_ms);
+	void delay_from_for(TickType_t &from_ticks, TickType_t for_how_long);
+	void delay_from_for_ms(TickType_t &from_ticks, TickType_t millisec);
+	TickType_t get_tick_count();
+
+	const char *get_name() const { return name; }
+	uint8_t get_state() const { return state; }
+
+	virtual void print_status(emstream &ser_dev);
+};
+
+
+#endif //ME507_HOST_TASKBASE_H
@@ -0,0 +1,24 @@
+/**
+ * Host port of JRR's TaskShare for the software-in-the-loop simulation. Simulated tasks
+ * cannot interrupt each other, so the share is just the data item.
+ */
+
+#ifndef ME507_HOST_TASKSHARE_H
+#define ME507_HOST_TASKSHARE_H
+
+template <class DataType> class TaskShare {
+protected:
+	const char *name;
+	DataType the_data;
+
+public:
+	TaskShare(const char *p_name) : name(p_name), the_data() {}
+
+	void put(DataType new_data) { the_data = new_data; }
+	void ISR_put(DataType new_data) { the_data = new_data; }
+	DataType get() { return the_data; }
+	DataType ISR_get() { return the_data; }
+};
+
+
+#endif //ME507_HOST_TASKSHARE_H
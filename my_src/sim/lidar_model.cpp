@@ -0,0 +1,120 @@
+//
+// Simulated LiDAR scans of the trailer and the yard; see lidar_model.h.
+//
+
+#include <cmath>
+#include "lidar_model.h"
+
+lidar_model::lidar_model(const lidar_model_config &config_in, const hitch_config &trailer_in)
+		: rng(config_in.seed), noise(0.0f, config_in.range_noise > 0.0f ? config_in.range_noise : 1e-9f)
+{
+	config = config_in;
+	trailer = trailer_in;
+	map = NULL;
+	parked = false;
+	parked_x = 0.0f;
+	parked_y = 0.0f;
+	parked_heading = 0.0f;
+	if (config.count > LIDAR_MAX_POINTS)
+		config.count = LIDAR_MAX_POINTS;
+}
+
+void lidar_model::set_map(const occupancy_grid *map_in)
+{
+	map = map_in;
+}
+
+void lidar_model::park_trailer(float kingpin_x, float kingpin_y, float heading)
+{
+	parked = true;
+	parked_x = kingpin_x;
+	parked_y = kingpin_y;
+	parked_heading = heading;
+}
+
+void lidar_model::scan(const vehicle_state &state, uint64_t time_us, lidar_scan &out)
+{
+	scan(state, state, time_us, out);
+}
+
+void lidar_model::scan(const vehicle_state &start, const vehicle_state &end, uint64_t time_us, lidar_scan &out)
+{
+	float hitch = start.hitch;
+	out.time_us = time_us;
+	out.sweep_us = config.sweep_us;
+	out.angle_min = config.angle_min;
+	out.angle_increment = config.angle_increment;
+	out.range_min = config.range_min;
+	out.range_max = config.range_max;
+	out.count = config.count;
+
+	// The pivot and the trailer's axis in the LiDAR frame: on the fifth wheel, or where
+	// the trailer is parked as seen from where the LiDAR is at the start of the sweep
+	float pivot_x = trailer.hitch_x, pivot_y = trailer.hitch_y;
+	if (parked) {
+		float c = cosf(start.heading), s = sinf(start.heading);
+		float sensor_heading = start.heading + config.mount_yaw;
+		float dx = parked_x - (start.x + c * config.mount_x - s * config.mount_y);
+		float dy = parked_y - (start.y + s * config.mount_x + c * config.mount_y);
+		pivot_x = cosf(sensor_heading) * dx + sinf(sensor_heading) * dy;
+		pivot_y = -sinf(sensor_heading) * dx + cosf(sensor_heading) * dy;
+		hitch = parked_heading - sensor_heading;
+	}
+
+	// Corners of the trailer, going around; the axis points from the trailer to the pivot
+	float ax = cosf(hitch), ay = sinf(hitch);
+	float w = trailer.trailer_width / 2;
+	float fx = pivot_x - trailer.face_distance * ax;
+	float fy = pivot_y - trailer.face_distance * ay;
+	float bx = fx - trailer.trailer_length * ax;
+	float by = fy - trailer.trailer_length * ay;
+	float corners[4][2] = {
+		{fx - ay * w, fy + ax * w}, {fx + ay * w, fy - ax * w},
+		{bx + ay * w, by - ax * w}, {bx - ay * w, by + ax * w}
+	};
+
+	float turn = end.heading - start.heading;
+	turn -= 2.0f * (float)M_PI * floorf((turn + (float)M_PI) / (2.0f * (float)M_PI));
+	float per_ray = config.count > 1 ? 1.0f / (config.count - 1) : 0.0f;
+
+	for (uint16_t i = 0; i < config.count; i++) {
+		float angle = config.angle_min + i * config.angle_increment;
+		float dx = cosf(angle), dy = sinf(angle);
+		float best = config.range_max;
+		bool hit = false;
+
+		if (map) {
+			// Where the LiDAR is in the world when this ray is measured
+			float f = i * per_ray;
+			float heading = start.heading + f * turn;
+			float x = start.x + f * (end.x - start.x), y = start.y + f * (end.y - start.y);
+			float c = cosf(heading), s = sinf(heading);
+			float sensor_x = x + c * config.mount_x - s * config.mount_y;
+			float sensor_y = y + s * config.mount_x + c * config.mount_y;
+			float sensor_heading = heading + config.mount_yaw;
+
+			float range = map->raycast(sensor_x, sensor_y, sensor_heading + angle, config.range_max);
+			if (range < config.range_max) {
+				best = range;
+				hit = true;
+			}
+		}
+
+		for (uint8_t e = 0; e < 4; e++) {
+			float x1 = corners[e][0], y1 = corners[e][1];
+			float ex = corners[(e + 1) % 4][0] - x1, ey = corners[(e + 1) % 4][1] - y1;
+			float den = dx * ey - dy * ex;
+			if (fabsf(den) < 1e-9f)
+				continue;
+			float t = (x1 * ey - y1 * ex) / den;        // distance along the ray
+			float u = (x1 * dy - y1 * dx) / den;        // position along the edge
+			if (t > 0.0f && u >= 0.0f && u <= 1.0f && t < best) {
+				best = t;
+				hit = true;
+			}
+		}
+
+		out.ranges[i] = hit ? best + noise(rng) : 0.0f;
+		out.flags[i] = 0;
+	}
+}
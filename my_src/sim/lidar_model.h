@@ -0,0 +1,111 @@
+/**
+ * The lidar_model produces the scans the LiDAR would see in simulation. Every ray is
+ * cast against the truck's own trailer at the current hitch angle, or where it is
+ * parked if it has been left in the yard, and, if a map of the yard is set, through the
+ * map from where the LiDAR is on the tractor; the nearer hit
+ * wins, and rays that hit nothing return no range, as the Hokuyo reports them. Ranges
+ * get Gaussian noise from a seeded generator, so scans can be repeated exactly.
+ *
+ * Scans are in the LiDAR frame used by the hitch_estimator: x forward, y to the left.
+ */
+
+#ifndef ME507_LIDAR_MODEL_H
+#define ME507_LIDAR_MODEL_H
+
+#include <cstdint>
+#include <random>
+#include "../RaspberryPi/lidar_scan.h"
+#include "../RaspberryPi/hitch_estimator.h"
+#include "../RaspberryPi/occupancy_grid.h"
+#include "vehicle_model.h"
+
+/**
+ * @brief The simulated scanner.
+ * @var angle_min angle of the first ray (rad)
+ * @var angle_increment angle between rays (rad)
+ * @var count number of rays, at most LIDAR_MAX_POINTS
+ * @var range_min shortest valid range (m)
+ * @var range_max longest valid range (m)
+ * @var sweep_us time from the first ray to the last (us)
+ * @var range_noise standard deviation of the range noise (m)
+ * @var mount_x x of the LiDAR ahead of the tractor's rear axle (m)
+ * @var mount_y y of the LiDAR to the left of the tractor's center line (m)
+ * @var mount_yaw angle of the LiDAR's x axis from the tractor's (rad)
+ * @var seed seed for the noise
+ */
+struct lidar_model_config {
+	float    angle_min;
+	float    angle_increment;
+	uint16_t count;
+	float    range_min;
+	float    range_max;
+	uint32_t sweep_us;
+	float    range_noise;
+	float    mount_x;
+	float    mount_y;
+	float    mount_yaw;
+	uint32_t seed;
+};
+
+class lidar_model {
+public:
+	/**
+	 * @brief The constructor for a simulated LiDAR.
+	 * @param config_in The scanner
+	 * @param trailer_in Where the trailer is; only the pivot, face distance, width and
+	 * length are used
+	 */
+	lidar_model(const lidar_model_config &config_in, const hitch_config &trailer_in);
+
+	/**
+	 * @brief Sets the map of the yard the rays are cast through.
+	 * @param map_in The map, which must outlive the lidar_model, or NULL for none
+	 */
+	void set_map(const occupancy_grid *map_in);
+
+	/**
+	 * @brief Leaves the trailer parked in the yard instead of on the fifth wheel.
+	 * @param kingpin_x x of the trailer's kingpin in the world (m)
+	 * @param kingpin_y y of the trailer's kingpin in the world (m)
+	 * @param heading heading of the trailer, from its rear towards the kingpin (rad)
+	 */
+	void park_trailer(float kingpin_x, float kingpin_y, float heading);
+
+	/**
+	 * @brief Puts the trailer back on the fifth wheel, at the hitch angle in the state.
+	 */
+	void attach_trailer() { parked = false; }
+
+	/**
+	 * @brief Produces one scan.
+	 * @param state The true state of the truck
+	 * @param time_us The time of the first ray (us)
+	 * @param out Filled with the scan; all flags are cleared
+	 */
+	void scan(const vehicle_state &state, uint64_t time_us, lidar_scan &out);
+
+	/**
+	 * @brief Produces one scan taken while the truck moves, as the real sweep is.
+	 * Each ray is cast from the pose interpolated to its own time between the start
+	 * and the end of the sweep; the hitch angle is taken from the start.
+	 * @param start The true state when the first ray is measured
+	 * @param end The true state when the last ray is measured
+	 * @param time_us The time of the first ray (us)
+	 * @param out Filled with the scan; all flags are cleared
+	 */
+	void scan(const vehicle_state &start, const vehicle_state &end, uint64_t time_us, lidar_scan &out);
+
+private:
+	lidar_model_config config;
+	hitch_config trailer;
+	const occupancy_grid *map;
+	bool parked;
+	float parked_x;
+	float parked_y;
+	float parked_heading;
+	std::mt19937 rng;
+	std::normal_distribution<float> noise;
+};
+
+
+#endif //ME507_LIDAR_MODEL_H
@@ -0,0 +1,68 @@
+//
+// Measures how many vehicle steps per second the plant models manage on this machine,
+// stepping the same randomized fleet with vehicle_model one at a time and with
+// batch_plant all at once, and reports how far apart the two end up.
+//
+// usage: batch_plant_bench [vehicles] [steps]
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "batch_plant.h"
+#include "scenario.h"
+
+int main(int argc, char **argv)
+{
+	size_t vehicles = argc > 1 ? (size_t)atol(argv[1]) : 10000;
+	uint32_t steps = argc > 2 ? (uint32_t)atol(argv[2]) : 1000;
+	const float dt = 0.001f;
+
+	vehicle_params params = default_sim_config().vehicle;
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> steer(-500, 500);
+	std::uniform_int_distribution<int> motor(-300, 300);
+
+	std::vector<vehicle_model> singles(vehicles, vehicle_model(params));
+	batch_plant batch(params, vehicles);
+	for (size_t i = 0; i < vehicles; i++) {
+		semi_truck_data_t cmd = semi_truck_data_t();
+		cmd.steer_output = (int16_t)steer(rng);
+		cmd.motor_output = (int16_t)motor(rng);
+		batch.set_command(i, cmd);
+	}
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (uint32_t k = 0; k < steps; k++)
+		for (size_t i = 0; i < vehicles; i++)
+			singles[i].step(dt, batch.steer_outputs()[i], batch.motor_outputs()[i]);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	for (uint32_t k = 0; k < steps; k++)
+		batch.step(dt);
+	std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+	double single_s = std::chrono::duration<double>(t1 - t0).count();
+	double batch_s = std::chrono::duration<double>(t2 - t1).count();
+	double total = (double)vehicles * steps;
+
+	float worst = 0.0f;
+	for (size_t i = 0; i < vehicles; i++) {
+		vehicle_state a = singles[i].get_state();
+		vehicle_state b = batch.get_state(i);
+		float d = hypotf(a.x - b.x, a.y - b.y);
+		if (d > worst)
+			worst = d;
+	}
+
+#ifndef __OPTIMIZE__
+	printf("warning: built without optimization; batch_plant relies on it, so this understates it\n");
+#endif
+	printf("%zu vehicles x %u steps\n", vehicles, steps);
+	printf("vehicle_model: %.3g vehicle-steps/s\n", total / single_s);
+	printf("batch_plant:   %.3g vehicle-steps/s (%.1fx)\n", total / batch_s, single_s / batch_s);
+	printf("largest position difference after %.1f s: %.2e m\n", steps * dt, worst);
+	return 0;
+}
@@ -0,0 +1,247 @@
+//
+// Checks the collision_guard's emergency stop. A box is left in the middle of an aisle
+// of the dock yard and the truck drives straight at it at several speeds, with a LiDAR
+// on its front bumper. The guard checks every scan the moment the sweep ends and, when
+// it brakes, the Pi's pi_comm_task sends the brake frame to the ATMega's mega_comm_task
+// straight away, over a simulated serial line on the virtual clock; each drive is then
+// repeated with the same decision held for the next control period, as a brake coming
+// out of the control loop would be. Prints how long the checks took on this machine,
+// the time from the end of the triggering scan to the brake frame being sent and to the
+// Mega's motor_driver driving the ESC with it, and the gap left to the box. Past the
+// send, the wait is the serial transfer and the Mega's few milliseconds to read the frame
+// and pass it to the motor_driver, which no Pi-side path avoids.
+// A last drive passes beside the box, which must not brake at all.
+//
+// usage: brake_check [brake_ttc]
+//   brake_ttc  time to collision the guard brakes at (default 0.6 s)
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+#include "sil_harness.h"
+#include "sim_hal.h"
+#include "yard_map.h"
+#include "../communication_data.h"
+#include "../ATMega/mega_comm_task.h"
+#include "../ATMega/motor_driver.h"
+#include "../RaspberryPi/collision_guard.h"
+#include "../RaspberryPi/pi_comm_task.h"
+
+#define AISLE_Y 25.0f           // y of the aisle driven down (m)
+#define START_X 6.0f            // x the truck starts from (m)
+#define BOX_X 26.0f             // x of the near face of the box (m)
+#define BOX_SIZE 0.4f           // m, both ways
+#define PASS_OFFSET 0.8f        // y of the box off the path for the drive beside it (m)
+#define DRIVE_TIME 60.0f        // s before a drive is given up on
+#define FRONT_MOUNT_X 0.45f     // m ahead of the rear axle, on the bumper
+#define MEGA_END 0              // serial_link ends, as in the sil_harness
+#define PI_END 1
+#define RUN_SLICE_US 10000      // how far the clock runs between checks for the end of a drive
+
+static const float speeds[] = {0.5f, 1.0f, 1.5f};
+
+/**
+ * @brief How one drive ended.
+ * @var braked true if the guard braked
+ * @var sent_us time from the end of the scan that braked to the brake frame being sent
+ * (simulated us)
+ * @var latency_us time from the end of the scan that braked to the Mega's motor_driver
+ * acting on the brake (simulated us)
+ * @var gap distance left between the front bumper and the box once stopped, or at the
+ * end of the drive (m); negative if the truck hit it
+ * @var check_mean_us mean run time of a check on this machine (us)
+ * @var check_max_us longest run time of a check on this machine (us)
+ */
+struct brake_result {
+	bool     braked;
+	uint64_t sent_us;
+	uint64_t latency_us;
+	float    gap;
+	float    check_mean_us;
+	uint32_t check_max_us;
+};
+
+static guard_config default_guard_config(const sil_config &sil, const lidar_model_config &lidar, float brake_ttc)
+{
+	const truck_geometry &g = sil.sim.vehicle.geometry;
+	guard_config config;
+	config.sensor_x = lidar.mount_x;
+	config.sensor_y = lidar.mount_y;
+	config.sensor_yaw = lidar.mount_yaw;
+	config.wheelbase = g.wheelbase;
+	config.front = FRONT_MOUNT_X;
+	config.rear = g.hitch_offset + g.trailer_length;
+	config.half_width = 0.2f;
+	config.brake_ttc = brake_ttc;
+	config.release_distance = 1.0f;
+	config.min_speed = 0.05f;
+	config.max_distance = 5.0f;
+	config.min_points = 3;
+	return config;
+}
+
+/**
+ * Drives down the aisle with the box offset from the path by box_offset. The Pi and the
+ * Mega talk through their real communication tasks over a simulated serial line, on the
+ * virtual clock: with priority set the guard brakes through pi_comm_task::send_brake()
+ * as soon as a scan calls for it; otherwise the brake goes into the control loop's
+ * outputs and waits for the pi_comm_task's next period.
+ */
+static brake_result drive(const sil_config &sil, float brake_ttc, float speed, float box_offset, bool priority)
+{
+	const sim_config &sim = sil.sim;
+	occupancy_grid map = make_dock_yard_grid();
+	build_dock_yard(map);
+	float box_y = AISLE_Y + box_offset;
+	map.fill_rect(BOX_X, box_y - 0.5f * BOX_SIZE, BOX_X + BOX_SIZE, box_y + 0.5f * BOX_SIZE, CELL_OCCUPIED);
+
+	lidar_model_config front = sil.lidar;
+	front.angle_min = -3.0f * (float)M_PI / 4;
+	front.mount_x = FRONT_MOUNT_X;
+	lidar_model lidar(front, sil.hitch);
+	lidar.set_map(&map);
+	lidar_scan *scan = new lidar_scan;
+
+	vehicle_model plant(sim.vehicle);
+	vehicle_state start = {START_X, AISLE_Y, 0.0f, 0.0f, 0.0f, 0.0f};
+	plant.reset(start);
+	control_loop controller(sim.vehicle.geometry, default_gains());
+	std::vector<path_point> path;
+	for (float x = START_X; x < DOCK_YARD_SIZE - 2.0f; x += 0.1f) {
+		path_point p = {x, AISLE_Y};
+		path.push_back(p);
+	}
+	controller.set_path(&path[0], (uint16_t)path.size(), false, speed);
+
+	// The communication tasks register with the scheduler as they are built, with the
+	// priorities main_mega and the sil_harness give them
+	virtual_rtos rtos;
+	rtos.make_current();
+	serial_link link(sil.link);
+	semi_truck_data_t mega_data = semi_truck_data_t();
+	semi_truck_data_t pi_data = semi_truck_data_t();
+	pi_data.desired_gear = 1;
+	communication_data comm_data(&mega_data);
+	mega_comm_task<sim_uart> mega_comm("communicator", 5, 500, NULL, (uint16_t)sil.link.baud, &comm_data);
+	motor_driver<sim_servo> motor("motor", 6, 400, NULL, &mega_data);
+	pi_comm_task pi_comm("pi_comm", 5, 500, NULL, (uint16_t)sil.link.baud, 0, &pi_data);
+	mega_comm.get_uart().connect(&link, MEGA_END);
+	pi_comm.connect(&link, PI_END);
+
+	brake_result out;
+	out.braked = false;
+	out.sent_us = 0;
+	out.latency_us = 0;
+	uint64_t check_sum_us = 0, triggered_us = 0;
+	bool brake_set = false, brake_sent = false, done = false;
+	uint64_t bytes_before_brake = 0;
+	// Notes the bytes sent before the brake went into the Pi's outputs; the next byte
+	// handed to the line is the start of the frame that carries it
+	std::function<void()> set_brake = [&]() {
+		if (!brake_set) {
+			bytes_before_brake = link.get_sent(PI_END);
+			brake_set = true;
+		}
+	};
+
+	collision_guard guard(default_guard_config(sil, front, brake_ttc));
+	controller.set_guard(&guard);
+	guard.set_brake_function([&]() {
+		if (priority) {
+			set_brake();
+			pi_comm.send_brake();
+		}
+	});
+
+	// Within one instant: sense, then control, then move the plant, then the tasks run
+	rtos.add_periodic(sil.lidar.sweep_us, [&](uint64_t now) {
+		if (now < sil.lidar.sweep_us)
+			return;     // the first sweep ends one sweep in
+		guard.set_motion(pi_data.wheel_speed, pi_data.steer_output);
+		lidar.scan(plant.get_state(), now - sil.lidar.sweep_us, *scan);
+		guard_result result = guard.check(*scan);
+		check_sum_us += result.check_us;
+		if (result.triggered) {
+			out.braked = true;
+			triggered_us = now;
+		}
+	});
+
+	rtos.add_periodic(sim.control_period_us, [&](uint64_t now) {
+		const vehicle_state &s = plant.get_state();
+		control_input in;
+		in.time_us = now;
+		in.x = s.x;
+		in.y = s.y;
+		in.heading = control_loop::imu_angle_to_heading(pi_data.imu_angle);
+		in.hitch_angle = s.hitch;
+		in.wheel_speed = pi_data.wheel_speed;
+		controller.update(in, &pi_data);
+		if (pi_data.motor_output == MOTOR_OUTPUT_BRAKE)
+			set_brake();
+	});
+
+	uint64_t plant_step_us = (uint64_t)(sim.plant_dt * 1e6f + 0.5f);
+	rtos.add_periodic(plant_step_us, [&](uint64_t now) {
+		mega_data.wheel_speed = plant.measure_wheel_speed();
+		mega_data.imu_angle = plant.measure_imu_angle();
+
+		if (brake_set && !brake_sent && link.get_sent(PI_END) > bytes_before_brake) {
+			out.sent_us = now - triggered_us;
+			brake_sent = true;
+		}
+		if (out.braked && !out.latency_us && motor.get_applied() == MOTOR_OUTPUT_BRAKE)
+			out.latency_us = now - triggered_us;
+		plant.step(sim.plant_dt, mega_data.steer_output, motor.get_applied());
+
+		const vehicle_state &s = plant.get_state();
+		if ((out.braked && out.latency_us && s.speed == 0.0f) || s.x + FRONT_MOUNT_X > BOX_X + BOX_SIZE + 1.0f)
+			done = true;
+	});
+
+	uint64_t end_us = (uint64_t)(DRIVE_TIME * 1e6f);
+	while (!done && rtos.get_time_us() < end_us) {
+		uint64_t next = rtos.get_time_us() + RUN_SLICE_US;
+		rtos.run_until(next < end_us ? next : end_us);
+	}
+
+	out.gap = BOX_X - (plant.get_state().x + FRONT_MOUNT_X);
+	out.check_mean_us = guard.get_check_count() ? (float)check_sum_us / guard.get_check_count() : 0.0f;
+	out.check_max_us = guard.get_max_check_us();
+	delete scan;
+	return out;
+}
+
+int main(int argc, char **argv)
+{
+	float brake_ttc = argc > 1 ? (float)atof(argv[1]) : 0.6f;
+	sil_config sil = default_sil_config();
+
+	bool ok = true;
+	printf("%5s  %-8s  %6s  %8s  %8s  %8s  %10s\n", "speed", "path", "gap", "sent", "at motor", "check",
+	       "check max");
+	for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+		for (int priority = 1; priority >= 0; priority--) {
+			brake_result r = drive(sil, brake_ttc, speeds[i], 0.0f, priority != 0);
+			printf("%5.1f  %-8s  %6.3f  %5.1f ms  %5.1f ms  %5.1f us  %7u us\n", speeds[i],
+			       priority ? "priority" : "control", r.gap, r.sent_us * 1e-3f, r.latency_us * 1e-3f, r.check_mean_us,
+			       r.check_max_us);
+			if (!r.braked || r.gap < 0.0f) {
+				printf("FAILED: %s\n", r.braked ? "hit the box" : "never braked");
+				ok = false;
+			}
+		}
+	}
+
+	brake_result beside = drive(sil, brake_ttc, speeds[sizeof(speeds) / sizeof(speeds[0]) - 1], PASS_OFFSET, true);
+	printf("beside the box: %s\n", beside.braked ? "braked" : "drove past");
+	if (beside.braked) {
+		printf("FAILED: braked for a box off the path\n");
+		ok = false;
+	}
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+//
+// Times the costmap on the dock yard. The whole layer is built once with the distance
+// transform and once by stamping a disc around every obstacle cell, the way inflation
+// is often done, and the two are compared. Then the truck drives along the aisle
+// between the middle container rows with the simulated LiDAR looking at a yard that
+// differs from the map: pallets have been left in the aisle and one container has gone.
+// Each scan is folded into the map and the costmap updated, timing the update and
+// counting the tiles it touched; at the end the incrementally updated layer has to match
+// one built from scratch on the same cells exactly.
+//
+// usage: costmap_bench [tile] [radius]
+//   tile    cells along each side of a tile (default 32)
+//   radius  inflation radius (default 0.6 m)
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "sil_harness.h"
+#include "lidar_model.h"
+#include "yard_map.h"
+#include "../RaspberryPi/costmap.h"
+#include "../RaspberryPi/hitch_estimator.h"
+#include "../RaspberryPi/host_clock.h"
+
+#define DRIVE_Y 25.0f           // y of the aisle the truck drives along (m)
+#define DRIVE_X0 3.0f           // where it starts (m)
+#define DRIVE_X1 46.0f          // where it stops (m)
+#define DRIVE_SPEED 1.0f        // m/s
+#define PALLET_SIZE 0.8f        // m
+#define GONE_X0 16.0f           // the container that is in the map but not the yard (m)
+#define GONE_Y0 18.0f
+#define GONE_X1 22.0f
+#define GONE_Y1 20.4f
+
+static costmap_config bench_config(uint16_t tile, float radius)
+{
+	costmap_config config;
+	config.tile_size = tile;
+	config.inscribed_radius = 0.15f;
+	config.inflation_radius = radius;
+	config.cost_scaling = 5.0f;
+	config.unknown_is_obstacle = true;
+	return config;
+}
+
+/**
+ * Distances capped at the radius by the textbook method: every obstacle cell lowers the
+ * distance of each cell in the disc of the radius around it.
+ */
+static void stamp_distance(const occupancy_grid &map, float radius, std::vector<float> &distance)
+{
+	int32_t width = map.get_width(), height = map.get_height();
+	float resolution = map.get_resolution();
+	int32_t reach = (int32_t)ceilf(radius / resolution);
+	std::vector<float> squared((size_t)width * height, DISTANCE_FAR);
+	for (int32_t cy = 0; cy < height; cy++) {
+		for (int32_t cx = 0; cx < width; cx++) {
+			uint8_t value = map.get(cx, cy);
+			if (!occupancy_grid::is_obstacle(value) && value != CELL_UNKNOWN)
+				continue;
+			for (int32_t dy = -reach; dy <= reach; dy++) {
+				int32_t y = cy + dy;
+				if (y < 0 || y >= height)
+					continue;
+				for (int32_t dx = -reach; dx <= reach; dx++) {
+					int32_t x = cx + dx;
+					if (x < 0 || x >= width)
+						continue;
+					float &d = squared[(size_t)y * width + x];
+					d = std::min(d, (float)(dx * dx + dy * dy));
+				}
+			}
+		}
+	}
+	distance.resize(squared.size());
+	for (size_t i = 0; i < squared.size(); i++)
+		distance[i] = std::min(sqrtf(squared[i]) * resolution, radius);
+}
+
+static float max_difference(const float *a, const float *b, size_t count)
+{
+	float worst = 0.0f;
+	for (size_t i = 0; i < count; i++)
+		worst = std::max(worst, fabsf(a[i] - b[i]));
+	return worst;
+}
+
+/**
+ * Number of obstacle cells in a world rectangle.
+ */
+static uint32_t obstacles_in(const occupancy_grid &map, float x0, float y0, float x1, float y1)
+{
+	int32_t cx0, cy0, cx1, cy1;
+	map.world_to_cell(x0, y0, cx0, cy0);
+	map.world_to_cell(x1, y1, cx1, cy1);
+	uint32_t count = 0;
+	for (int32_t cy = cy0; cy <= cy1; cy++)
+		for (int32_t cx = cx0; cx <= cx1; cx++)
+			count += map.contains(cx, cy) && occupancy_grid::is_obstacle(map.get(cx, cy));
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	uint16_t tile = argc > 1 ? (uint16_t)atoi(argv[1]) : 32;
+	float radius = argc > 2 ? (float)atof(argv[2]) : 0.6f;
+	if (tile < 1)
+		tile = 1;
+
+	occupancy_grid map = make_dock_yard_grid();
+	build_dock_yard(map);
+	costmap_config config = bench_config(tile, radius);
+	size_t cells = (size_t)map.get_width() * map.get_height();
+
+	uint64_t start = host_time_us();
+	costmap layer(map, config);
+	double transform_ms = (host_time_us() - start) / 1000.0;
+	std::vector<float> stamped;
+	start = host_time_us();
+	stamp_distance(map, radius, stamped);
+	double stamp_ms = (host_time_us() - start) / 1000.0;
+	float full_error = max_difference(layer.distances(), &stamped[0], cells);
+	printf("%ux%u cells, %u tiles of %u, radius %.2f m\n", map.get_width(), map.get_height(),
+	       layer.get_tile_count(), tile, radius);
+	printf("full build: transform %.1f ms, disc stamping %.1f ms, largest difference %.4f m\n", transform_ms,
+	       stamp_ms, full_error);
+
+	// The yard as it really is
+	occupancy_grid yard = map;
+	float pallets[3][2] = {{15.0f, 26.6f}, {26.0f, 23.2f}, {38.0f, 27.0f}};
+	for (uint8_t i = 0; i < 3; i++)
+		yard.fill_rect(pallets[i][0], pallets[i][1], pallets[i][0] + PALLET_SIZE, pallets[i][1] + PALLET_SIZE,
+		               CELL_OCCUPIED);
+	yard.fill_rect(GONE_X0, GONE_Y0, GONE_X1, GONE_Y1, CELL_FREE);
+	uint32_t gone_before = obstacles_in(map, GONE_X0, GONE_Y0, GONE_X1, GONE_Y1);
+
+	sil_config sil = default_sil_config();
+	lidar_model lidar(sil.lidar, sil.hitch);
+	lidar.set_map(&yard);
+	hitch_estimator estimator(sil.hitch);
+	lidar_scan scan;
+
+	uint32_t scans = 0, worst_us = 0, most_tiles = 0;
+	uint64_t sum_us = 0, sum_tiles = 0, sum_changed = 0;
+	float step = DRIVE_SPEED * sil.lidar.sweep_us * 1e-6f;
+	for (float x = DRIVE_X0; x <= DRIVE_X1; x += step) {
+		vehicle_state state = {x, DRIVE_Y, 0.0f, 0.0f, 0.0f, DRIVE_SPEED};
+		uint64_t now = (uint64_t)scans * sil.lidar.sweep_us;
+		lidar.scan(state, now, scan);
+		estimator.process(scan);
+
+		float heading = state.heading + sil.lidar.mount_yaw;
+		float sx = state.x + sil.lidar.mount_x * cosf(state.heading) - sil.lidar.mount_y * sinf(state.heading);
+		float sy = state.y + sil.lidar.mount_x * sinf(state.heading) + sil.lidar.mount_y * cosf(state.heading);
+		sum_changed += layer.add_scan(scan, sx, sy, heading);
+		uint32_t tiles = layer.update();
+		sum_tiles += tiles;
+		most_tiles = std::max(most_tiles, tiles);
+		sum_us += layer.get_update_us();
+		worst_us = std::max(worst_us, layer.get_update_us());
+		scans++;
+	}
+
+	printf("%u scans: %.1f cells changed and %.1f tiles (%.1f%%) updated per scan, at most %u\n", scans,
+	       (double)sum_changed / scans, (double)sum_tiles / scans, 100.0 * sum_tiles / scans / layer.get_tile_count(),
+	       most_tiles);
+	printf("update: mean %.2f ms, max %.2f ms, against %.1f ms for the whole map\n", sum_us / 1000.0 / scans,
+	       worst_us / 1000.0, transform_ms);
+
+	bool seen = true;
+	for (uint8_t i = 0; i < 3; i++) {
+		uint32_t found = obstacles_in(map, pallets[i][0], pallets[i][1], pallets[i][0] + PALLET_SIZE,
+		                              pallets[i][1] + PALLET_SIZE);
+		printf("pallet at (%.1f, %.1f): %u obstacle cells\n", pallets[i][0], pallets[i][1], found);
+		seen = seen && found > 0;
+	}
+	printf("container that has gone: %u of %u obstacle cells left\n",
+	       obstacles_in(map, GONE_X0, GONE_Y0, GONE_X1, GONE_Y1), gone_before);
+
+	occupancy_grid copy = map;
+	costmap fresh(copy, config);
+	float distance_error = max_difference(layer.distances(), fresh.distances(), cells);
+	uint32_t cost_errors = 0;
+	for (size_t i = 0; i < cells; i++)
+		cost_errors += layer.costs()[i] != fresh.costs()[i];
+	printf("incremental against rebuilt: largest difference %.4f m, %u costs differ\n", distance_error, cost_errors);
+
+	bool ok = full_error == 0.0f && distance_error == 0.0f && cost_errors == 0 && seen;
+	printf("%s\n", ok ? "costmap exact" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+//
+// Couples the tractor to a parked trailer with the trailer_coupler, from several starting
+// poses in front of it in the dock yard. The rear LiDAR is simulated with the trailer
+// parked, the coupler runs on every scan and sends its commands as soon as it has them,
+// and the fifth wheel only catches the kingpin if it closes within a couple of
+// centimeters of it. Prints, for each start, how many approaches it took, where the
+// fifth wheel was against the kingpin when it locked, the coupler's own idea of that,
+// and how long the updates took. The last start is too close and too far off the axis
+// to line up in time, so the coupler has to pull forward and try again.
+//
+// usage: couple_sim [noise]
+//   noise  standard deviation of the LiDAR range noise (default 0.01 m)
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "sil_harness.h"
+#include "yard_map.h"
+#include "../RaspberryPi/trailer_coupler.h"
+
+#define KINGPIN_X 24.0f         // where the trailer is parked in the dock yard (m)
+#define KINGPIN_Y 25.0f
+#define CAPTURE_RADIUS 0.02f    // m from the kingpin within which the fifth wheel catches it
+#define OVERRUN 0.05f           // m past the kingpin at which the tractor has hit the trailer
+#define TIME_LIMIT 60.0f        // s before a coupling is given up on
+
+/**
+ * @brief Where the truck starts, relative to the parked trailer.
+ * @var distance distance from the fifth wheel to the kingpin along the trailer's axis (m)
+ * @var offset offset of the fifth wheel from the trailer's axis, to the left (m)
+ * @var yaw tractor heading minus trailer heading (rad)
+ * @var trailer_heading heading the trailer is parked at (rad)
+ */
+struct coupling_start {
+	float distance;
+	float offset;
+	float yaw;
+	float trailer_heading;
+};
+
+static const coupling_start starts[] = {
+	{1.5f,  0.00f,  0.00f, 0.0f},
+	{1.5f,  0.15f,  0.10f, 0.0f},
+	{2.0f, -0.30f, -0.15f, 0.0f},
+	{2.0f,  0.20f,  0.30f, 0.5f},
+	{2.5f, -0.40f,  0.00f, -0.3f},
+	{0.8f,  0.35f,  0.00f, 0.0f},
+};
+
+/**
+ * @brief How one coupling went.
+ * @var state the coupler's state at the end
+ * @var attempts approaches it took
+ * @var coupled true if the trailer ended up on the fifth wheel
+ * @var along distance of the fifth wheel ahead of the kingpin when it locked (m)
+ * @var lateral offset of the fifth wheel from the kingpin across the trailer when it locked (m)
+ * @var seen_along the coupler's gap at the lock (m)
+ * @var seen_lateral the coupler's lateral error at the lock (m)
+ * @var time time until coupled or given up (s)
+ * @var max_run_us longest update on this machine (us)
+ */
+struct coupling_result {
+	coupler_state state;
+	uint8_t  attempts;
+	bool     coupled;
+	float    along;
+	float    lateral;
+	float    seen_along;
+	float    seen_lateral;
+	float    time;
+	uint32_t max_run_us;
+};
+
+static coupler_config default_coupler_config(const sil_config &sil)
+{
+	coupler_config config;
+	config.hitch = sil.hitch;
+	config.search_distance = 3.5f;
+	config.search_width = 1.0f;
+	config.cluster_gap = 0.08f;
+	config.filter_gain = 0.2f;
+	config.approach_speed = 0.3f;
+	config.creep_speed = 0.08f;
+	config.creep_distance = 0.25f;
+	config.align_length = 0.3f;
+	config.standoff = 0.4f;
+	config.lateral_tolerance = 0.02f;
+	config.heading_tolerance = 0.08f;
+	config.contact_distance = 0.004f;
+	config.pull_distance = 1.2f;
+	config.lock_timeout_us = 500000;
+	config.tug_distance = 0.05f;
+	config.tug_tolerance = 0.02f;
+	config.lost_timeout_us = 500000;
+	config.max_attempts = 3;
+	return config;
+}
+
+/**
+ * The fifth wheel against the kingpin, in the trailer's frame: along its axis, positive
+ * while still ahead of the kingpin, and across it.
+ */
+static void fifth_wheel_offset(const vehicle_state &s, const truck_geometry &g, float trailer_heading,
+                               float &along, float &lateral)
+{
+	float fx = s.x - g.hitch_offset * cosf(s.heading) - KINGPIN_X;
+	float fy = s.y - g.hitch_offset * sinf(s.heading) - KINGPIN_Y;
+	float c = cosf(trailer_heading), sn = sinf(trailer_heading);
+	along = c * fx + sn * fy;
+	lateral = -sn * fx + c * fy;
+}
+
+static coupling_result couple(const sil_config &sil, const occupancy_grid &map, const coupling_start &from)
+{
+	const sim_config &sim = sil.sim;
+	const truck_geometry &g = sim.vehicle.geometry;
+
+	lidar_model lidar(sil.lidar, sil.hitch);
+	lidar.set_map(&map);
+	lidar.park_trailer(KINGPIN_X, KINGPIN_Y, from.trailer_heading);
+	lidar_scan *scan = new lidar_scan;
+
+	// Put the fifth wheel at the start point, then the rear axle ahead of it
+	float c = cosf(from.trailer_heading), sn = sinf(from.trailer_heading);
+	float heading = from.trailer_heading + from.yaw;
+	float fx = KINGPIN_X + c * from.distance - sn * from.offset;
+	float fy = KINGPIN_Y + sn * from.distance + c * from.offset;
+	vehicle_state start = {fx + g.hitch_offset * cosf(heading), fy + g.hitch_offset * sinf(heading), heading,
+	                       0.0f, 0.0f, 0.0f};
+	vehicle_model plant(sim.vehicle);
+	plant.reset(start);
+	mega_model mega(sim.mega);
+	control_loop controller(g, default_gains());
+	trailer_coupler coupler(g, default_coupler_config(sil), &controller);
+	coupler.start();
+
+	semi_truck_data_t command = semi_truck_data_t();
+	command.desired_gear = 1;
+	coupling_result out = coupling_result();
+	bool attached = false, locked = false;
+
+	uint64_t plant_step_us = (uint64_t)(sim.plant_dt * 1e6f + 0.5f);
+	uint64_t end_us = (uint64_t)(TIME_LIMIT * 1e6f);
+	uint64_t sweep_start_us = 0;
+	vehicle_state sweep_start = plant.get_state();
+	uint64_t now = 0;
+	for (; now < end_us; now += plant_step_us) {
+		mega.step(now, plant);
+
+		if (now >= sweep_start_us + sil.lidar.sweep_us) {
+			lidar.scan(sweep_start, plant.get_state(), sweep_start_us, *scan);
+			sweep_start_us = now;
+			sweep_start = plant.get_state();
+			const semi_truck_data_t &telemetry = mega.get_telemetry();
+			coupler_state state = coupler.update(*scan, telemetry.wheel_speed, telemetry.actual_5th, &command);
+			mega.send_command(command, now);
+			if (state == COUPLER_COUPLED || state == COUPLER_FAILED)
+				break;
+		}
+
+		// The jaw closes when the Mega acts on desired_5th, on the kingpin or on nothing
+		const semi_truck_data_t &act = mega.get_actuators();
+		if (act.desired_5th && !locked) {
+			vehicle_state s = plant.get_state();
+			fifth_wheel_offset(s, g, from.trailer_heading, out.along, out.lateral);
+			out.seen_along = coupler.get_gap();
+			out.seen_lateral = coupler.get_lateral_error();
+			if (!attached && hypotf(out.along, out.lateral) <= CAPTURE_RADIUS) {
+				float hitch = from.trailer_heading - s.heading;
+				s.hitch = atan2f(sinf(hitch), cosf(hitch));
+				plant.reset(s);
+				lidar.attach_trailer();
+				attached = true;
+			}
+		}
+		locked = act.desired_5th;
+		plant.step(sim.plant_dt, act.steer_output, act.motor_output);
+
+		if (!attached) {
+			float along, lateral;
+			fifth_wheel_offset(plant.get_state(), g, from.trailer_heading, along, lateral);
+			if (along < -OVERRUN && fabsf(lateral) < 0.5f * sil.hitch.trailer_width)
+				break;
+		}
+	}
+
+	out.state = coupler.get_state();
+	out.attempts = coupler.get_attempts();
+	out.coupled = attached && out.state == COUPLER_COUPLED;
+	out.time = now * 1e-6f;
+	out.max_run_us = coupler.get_max_run_us();
+	delete scan;
+	return out;
+}
+
+int main(int argc, char **argv)
+{
+	sil_config sil = default_sil_config();
+	if (argc > 1)
+		sil.lidar.range_noise = (float)atof(argv[1]);
+	occupancy_grid map = make_dock_yard_grid();
+	build_dock_yard(map);
+
+	bool ok = true;
+	printf("%5s %6s %6s %6s  %-8s %3s  %7s %7s  %7s %7s  %6s  %6s\n", "dist", "offset", "yaw", "parked", "result",
+	       "try", "along", "across", "seen", "seen", "time", "max");
+	for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); i++) {
+		const coupling_start &from = starts[i];
+		coupling_result r = couple(sil, map, from);
+		printf("%5.2f %6.2f %6.2f %6.2f  %-8s %3u  %5.1fmm %5.1fmm  %5.1fmm %5.1fmm  %5.1fs  %4uus\n", from.distance,
+		       from.offset, from.yaw, from.trailer_heading, r.coupled ? "coupled" : "FAILED", r.attempts,
+		       r.along * 1e3f, r.lateral * 1e3f, r.seen_along * 1e3f, r.seen_lateral * 1e3f, r.time, r.max_run_us);
+		if (!r.coupled)
+			ok = false;
+	}
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
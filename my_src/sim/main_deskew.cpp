@@ -0,0 +1,155 @@
+//
+// Drives the truck in a steady turn through the yard with a LiDAR whose rays are each
+// cast from the pose at their own time, and measures how far the points land from
+// where they really were at the start of their sweep, both as measured and after
+// scan_deskew. The deskew only gets the odometry the Pi would have when the scan
+// arrives: imu_angle and wheel_speed every 20 ms, up to a transfer delay past the end
+// of the sweep.
+//
+// usage: deskew_check [seconds] [speed] [steer]
+//   seconds  length of the drive (default 20)
+//   speed    speed in m/s (default 1.0)
+//   steer    steer_output, as in semi_truck_data_t (default 300)
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "sil_harness.h"
+#include "yard_map.h"
+#include "../RaspberryPi/scan_deskew.h"
+
+#define ODOMETRY_PERIOD_US 20000
+#define TRANSFER_DELAY_US 2000
+#define MAX_EXTRAPOLATION_US 50000
+#define TRIAL_RUNS 100      // times each sweep is corrected for the timing figures
+
+struct point_error {
+	double sum_sq;
+	float worst;
+	uint32_t count;
+};
+
+static void add_error(point_error &e, float dx, float dy)
+{
+	float d2 = dx * dx + dy * dy;
+	e.sum_sq += d2;
+	if (sqrtf(d2) > e.worst)
+		e.worst = sqrtf(d2);
+	e.count++;
+}
+
+int main(int argc, char **argv)
+{
+	float seconds = argc > 1 ? (float)atof(argv[1]) : 20.0f;
+	float speed = argc > 2 ? (float)atof(argv[2]) : 1.0f;
+	int16_t steer = argc > 3 ? (int16_t)atoi(argv[3]) : 300;
+
+	sil_config config = default_sil_config();
+	const vehicle_params &params = config.sim.vehicle;
+	occupancy_grid map = make_yard_grid();
+	build_yard(map);
+	lidar_model lidar(config.lidar, config.hitch);
+	lidar.set_map(&map);
+	const lidar_model_config &lc = config.lidar;
+
+	// Start in the open corner of the yard already in the turn
+	vehicle_model plant(params);
+	float tan_steer = tanf(steer / STEER_OUTPUT_PER_RAD);
+	vehicle_state start = {20.0f, 11.0f, 0.0f, 0.0f, steer / STEER_OUTPUT_PER_RAD, speed};
+	plant.reset(start);
+	int16_t motor = (int16_t)lroundf(speed / params.top_speed * MOTOR_OUTPUT_FULL);
+
+	// The true state every plant step, so a sweep can be scanned once it is over
+	uint32_t plant_us = (uint32_t)lroundf(config.sim.plant_dt * 1e6f);
+	uint64_t end_us = (uint64_t)(seconds * 1e6f);
+	std::vector<vehicle_state> states;
+	states.reserve((size_t)(end_us / plant_us) + 1);
+	for (uint64_t now = 0; now <= end_us; now += plant_us) {
+		states.push_back(plant.get_state());
+		plant.step(config.sim.plant_dt, steer, motor);
+	}
+
+	scan_deskew deskew(MAX_EXTRAPOLATION_US);
+	lidar_scan scan;
+	std::vector<float> fraction(LIDAR_MAX_POINTS), x(LIDAR_MAX_POINTS), y(LIDAR_MAX_POINTS);
+	std::vector<float> px(LIDAR_MAX_POINTS), py(LIDAR_MAX_POINTS);
+	point_error raw = {0.0, 0.0f, 0}, fixed = {0.0, 0.0f, 0};
+	uint64_t next_odometry = 0;
+	uint32_t sweeps = 0, corrected = 0;
+	double total_us = 0.0;
+	float mc = cosf(lc.mount_yaw), ms = sinf(lc.mount_yaw);
+
+	for (uint64_t t0 = 0; t0 + lc.sweep_us + TRANSFER_DELAY_US <= end_us; t0 += lc.sweep_us) {
+		const vehicle_state &s0 = states[t0 / plant_us];
+		const vehicle_state &s1 = states[(t0 + lc.sweep_us) / plant_us];
+		lidar.scan(s0, s1, t0, scan);
+
+		// The odometry that has arrived by the time the scan has
+		uint64_t arrival = t0 + lc.sweep_us + TRANSFER_DELAY_US;
+		for (; next_odometry <= arrival; next_odometry += ODOMETRY_PERIOD_US) {
+			vehicle_model sample(params);
+			sample.reset(states[next_odometry / plant_us]);
+			deskew.add_odometry(next_odometry, sample.measure_imu_angle(), sample.measure_wheel_speed());
+		}
+
+		// Points in the truck frame as measured, and where they really were relative to
+		// the truck at the start of the sweep
+		uint16_t n = 0;
+		float per_ray = 1.0f / (scan.count - 1);
+		float turn = s1.heading - s0.heading;
+		turn -= 2.0f * (float)M_PI * floorf((turn + (float)M_PI) / (2.0f * (float)M_PI));
+		float c0 = cosf(s0.heading), sn0 = sinf(s0.heading);
+		for (uint16_t i = 0; i < scan.count; i++) {
+			if (!scan_point_valid(scan, i))
+				continue;
+			float angle = lc.angle_min + i * lc.angle_increment;
+			float sx = scan.ranges[i] * cosf(angle), sy = scan.ranges[i] * sinf(angle);
+			float tx = lc.mount_x + mc * sx - ms * sy, ty = lc.mount_y + ms * sx + mc * sy;
+			float f = i * per_ray;
+			float h = s0.heading + f * turn;
+			float wx = s0.x + f * (s1.x - s0.x) + cosf(h) * tx - sinf(h) * ty;
+			float wy = s0.y + f * (s1.y - s0.y) + sinf(h) * tx + cosf(h) * ty;
+			if (fabsf(tx) < 1.5f && fabsf(ty) < 0.5f)
+				continue;       // the trailer moves with the truck and is not smeared
+			fraction[n] = f;
+			x[n] = tx;
+			y[n] = ty;
+			px[n] = c0 * (wx - s0.x) + sn0 * (wy - s0.y);
+			py[n] = -sn0 * (wx - s0.x) + c0 * (wy - s0.y);
+			n++;
+		}
+		for (uint16_t i = 0; i < n; i++)
+			add_error(raw, x[i] - px[i], y[i] - py[i]);
+
+		std::vector<float> cx(x), cy(y);
+		bool ok = deskew.correct(t0, lc.sweep_us, &fraction[0], &cx[0], &cy[0], n);
+		if (ok) {
+			// Correcting the same points over and over costs the same as the first time
+			std::vector<float> tx(x), ty(y);
+			std::chrono::steady_clock::time_point a = std::chrono::steady_clock::now();
+			for (uint32_t k = 0; k < TRIAL_RUNS; k++)
+				deskew.correct(t0, lc.sweep_us, &fraction[0], &tx[0], &ty[0], n);
+			total_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - a).count();
+
+			for (uint16_t i = 0; i < n; i++)
+				add_error(fixed, cx[i] - px[i], cy[i] - py[i]);
+			corrected++;
+		}
+		sweeps++;
+	}
+
+	float yaw_rate = speed * tan_steer / params.geometry.wheelbase;
+	printf("%u sweeps of %u us at %.2f m/s turning %.2f rad/s, odometry every %u us\n",
+	       sweeps, lc.sweep_us, speed, yaw_rate, ODOMETRY_PERIOD_US);
+	printf("as measured: rms %.4f m, max %.4f m over %u points\n",
+	       raw.count ? sqrt(raw.sum_sq / raw.count) : 0.0, raw.worst, raw.count);
+	printf("deskewed:    rms %.4f m, max %.4f m over %u points (%u sweeps, %u extrapolated)\n",
+	       fixed.count ? sqrt(fixed.sum_sq / fixed.count) : 0.0, fixed.worst, fixed.count,
+	       corrected, deskew.get_extrapolated_count() / (TRIAL_RUNS + 1));
+	printf("added latency: mean %.1f us per sweep, worst single sweep %u us\n",
+	       corrected ? total_us / ((double)corrected * TRIAL_RUNS) : 0.0, deskew.get_max_run_us());
+	return 0;
+}
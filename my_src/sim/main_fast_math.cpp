@@ -0,0 +1,195 @@
+//
+// Sweeps every function in fast_math.h over its input range against libm in double
+// precision and checks that the worst error found is within the maximum the header
+// documents; isqrt32 must be exact. Then each function and its libm counterpart are
+// timed on this machine. The host's hardware floating point makes the float versions
+// look little faster than libm here; what they are for is the ATMega, whose cycle
+// counts main_fast_math_cycles.cpp measures.
+//
+// usage: fast_math_bench
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "../fast_math.h"
+
+// The maximum errors documented in fast_math.h
+#define INV_SQRT_MAX_RELATIVE 4.8e-6
+#define SQRT_MAX_RELATIVE 4.8e-6
+#define ATAN2_MAX_RAD 2.0e-6
+#define ASIN_MAX_RAD 7.5e-5
+#define INV_SQRT_Q16_MAX_RELATIVE 3.1e-5
+#define ATAN2_BAM_MAX_COUNTS 1
+#define ASIN_BAM_MAX_COUNTS 2
+
+#define BAM_PER_RAD (32768.0 / M_PI)
+#define TIMED_CALLS 4000000
+
+static volatile float float_sink;   // keeps the timed results from being optimized away
+static volatile int32_t int_sink;
+
+/// Counts between two binary angles, the short way round the circle
+static int32_t bam_difference(int16_t a, double b_counts)
+{
+	double d = fmod(a - b_counts, 65536.0);
+	if (d > 32768.0)
+		d -= 65536.0;
+	if (d < -32768.0)
+		d += 65536.0;
+	return (int32_t)fabs(round(d));
+}
+
+static bool report(const char *name, double worst, double allowed, const char *unit)
+{
+	bool ok = worst <= allowed;
+	printf("%-13s  %9.2e  %9.2e %-6s %s\n", name, worst, allowed, unit, ok ? "" : "FAILED");
+	return ok;
+}
+
+/// Nanoseconds per call of f over the inputs, which are cycled through
+template <class T, class F>
+static double time_calls(const T *inputs, uint32_t count, F f)
+{
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < TIMED_CALLS; i++)
+		f(inputs[i % count]);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(t1 - t0).count() / TIMED_CALLS;
+}
+
+int main()
+{
+	bool ok = true;
+	printf("function       max error    allowed\n");
+
+	// Every 1021st positive normal float, which covers every exponent and mantissa pattern
+	double inv_sqrt_worst = 0;
+	double sqrt_worst = 0;
+	for (uint32_t bits = 0x00800000UL; bits < 0x7f800000UL; bits += 1021) {
+		float x;
+		memcpy(&x, &bits, sizeof(x));
+		double exact = sqrt((double)x);
+		inv_sqrt_worst = fmax(inv_sqrt_worst, fabs(fast_inv_sqrt(x) * exact - 1.0));
+		sqrt_worst = fmax(sqrt_worst, fabs(fast_sqrt(x) / exact - 1.0));
+	}
+	ok = report("fast_inv_sqrt", inv_sqrt_worst, INV_SQRT_MAX_RELATIVE, "") && ok;
+	ok = report("fast_sqrt", sqrt_worst, SQRT_MAX_RELATIVE, "") && ok;
+
+	// Every direction at a spread of radii, and random points
+	double atan2_worst = 0;
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> coordinate(-1000.0f, 1000.0f);
+	for (uint32_t i = 0; i < 2000000; i++) {
+		float y, x;
+		if (i < 1000000) {
+			double angle = -M_PI + 2.0 * M_PI * (i / 1000.0) / 1000.0;
+			double radius = pow(10.0, (int)(i % 1000) / 100.0 - 5.0);
+			y = (float)(radius * sin(angle));
+			x = (float)(radius * cos(angle));
+		}
+		else {
+			y = coordinate(rng);
+			x = coordinate(rng);
+		}
+		double d = fabs(fast_atan2(y, x) - atan2((double)y, (double)x));
+		atan2_worst = fmax(atan2_worst, fmin(d, 2.0 * M_PI - d));   // -pi and pi are one angle
+	}
+	ok = report("fast_atan2", atan2_worst, ATAN2_MAX_RAD, "rad") && ok;
+
+	double asin_worst = 0;
+	for (int32_t i = -1000000; i <= 1000000; i++) {
+		float x = i / 1000000.0f;
+		asin_worst = fmax(asin_worst, fabs(fast_asin(x) - asin((double)x)));
+	}
+	ok = report("fast_asin", asin_worst, ASIN_MAX_RAD, "rad") && ok;
+
+	// isqrt32 at and either side of every perfect square, and across the whole range
+	uint32_t isqrt_wrong = 0;
+	for (uint32_t k = 1; k < 65536; k++) {
+		uint32_t square = k * k;
+		isqrt_wrong += isqrt32(square) != k;
+		isqrt_wrong += isqrt32(square - 1) != k - 1;
+		isqrt_wrong += isqrt32(square + 1) != k;
+	}
+	isqrt_wrong += isqrt32(0) != 0;
+	isqrt_wrong += isqrt32(UINT32_MAX) != 65535;
+	for (uint32_t x = 0; x < UINT32_MAX - 997; x += 997)
+		isqrt_wrong += isqrt32(x) != (uint32_t)floor(sqrt((double)x));
+	ok = report("isqrt32", isqrt_wrong, 0, "wrong") && ok;
+
+	// The error allowed is 3.1e-5 relative or one count, whichever is larger
+	double q16_worst = 0;
+	for (uint32_t x = 1; x < UINT32_MAX - 4093; x += (x < 65536 ? 1 : 4093)) {
+		double exact = 65536.0 / sqrt(x / 65536.0);
+		double error = fabs(inv_sqrt_q16(x) - exact);
+		if (error > 1.0)
+			q16_worst = fmax(q16_worst, error / exact);
+	}
+	ok = report("inv_sqrt_q16", q16_worst, INV_SQRT_Q16_MAX_RELATIVE, "") && ok;
+
+	int32_t atan2_bam_worst = 0;
+	for (int32_t y = -32768; y < 32768; y += 37)
+		for (int32_t x = -32768; x < 32768; x += 37) {
+			if (x == 0 && y == 0)
+				continue;
+			double exact = atan2((double)y, (double)x) * BAM_PER_RAD;
+			int32_t error = bam_difference(atan2_bam((int16_t)y, (int16_t)x), exact);
+			if (error > atan2_bam_worst)
+				atan2_bam_worst = error;
+		}
+	ok = report("atan2_bam", atan2_bam_worst, ATAN2_BAM_MAX_COUNTS, "counts") && ok;
+
+	int32_t asin_bam_worst = 0;
+	for (int32_t x = -16384; x <= 16384; x++) {
+		double exact = asin(x / 16384.0) * BAM_PER_RAD;
+		int32_t error = bam_difference(asin_bam((int16_t)x), exact);
+		if (error > asin_bam_worst)
+			asin_bam_worst = error;
+	}
+	ok = report("asin_bam", asin_bam_worst, ASIN_BAM_MAX_COUNTS, "counts") && ok;
+
+	// Timing, against the libm float functions
+	static float positive[4096], unit[4096], ys[4096], xs[4096];
+	static int16_t raw_y[4096], raw_x[4096];
+	static uint32_t q16[4096];
+	std::uniform_real_distribution<float> above_zero(0.001f, 1000.0f);
+	std::uniform_real_distribution<float> in_unit(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> raw(-32768, 32767);
+	for (int i = 0; i < 4096; i++) {
+		positive[i] = above_zero(rng);
+		unit[i] = in_unit(rng);
+		ys[i] = coordinate(rng);
+		xs[i] = coordinate(rng);
+		raw_y[i] = (int16_t)raw(rng);
+		raw_x[i] = (int16_t)raw(rng);
+		q16[i] = (uint32_t)(positive[i] * 65536.0f);
+	}
+	uint32_t k = 0;
+	printf("\nns per call on this machine   fast    libm\n");
+	printf("inv_sqrt                    %6.2f  %6.2f\n",
+	       time_calls(positive, 4096, [](float x) { float_sink = fast_inv_sqrt(x); }),
+	       time_calls(positive, 4096, [](float x) { float_sink = 1.0f / sqrtf(x); }));
+	printf("sqrt                        %6.2f  %6.2f\n",
+	       time_calls(positive, 4096, [](float x) { float_sink = fast_sqrt(x); }),
+	       time_calls(positive, 4096, [](float x) { float_sink = sqrtf(x); }));
+	printf("atan2                       %6.2f  %6.2f\n",
+	       time_calls(ys, 4096, [&](float y) { float_sink = fast_atan2(y, xs[k++ % 4096]); }),
+	       time_calls(ys, 4096, [&](float y) { float_sink = atan2f(y, xs[k++ % 4096]); }));
+	printf("asin                        %6.2f  %6.2f\n",
+	       time_calls(unit, 4096, [](float x) { float_sink = fast_asin(x); }),
+	       time_calls(unit, 4096, [](float x) { float_sink = asinf(x); }));
+	printf("isqrt32                     %6.2f\n",
+	       time_calls(q16, 4096, [](uint32_t x) { int_sink = isqrt32(x); }));
+	printf("inv_sqrt_q16                %6.2f\n",
+	       time_calls(q16, 4096, [](uint32_t x) { int_sink = (int32_t)inv_sqrt_q16(x); }));
+	printf("atan2_bam                   %6.2f\n",
+	       time_calls(raw_y, 4096, [&](int16_t y) { int_sink = atan2_bam(y, raw_x[k++ % 4096]); }));
+	printf("asin_bam                    %6.2f\n",
+	       time_calls(raw_y, 4096, [](int16_t x) { int_sink = asin_bam((int16_t)(x / 2)); }));
+
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
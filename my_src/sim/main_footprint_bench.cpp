@@ -0,0 +1,170 @@
+//
+// Measures how many collision checks of the tractor and trailer outline per second the
+// footprint_mask does against a bit_grid, compared with rasterizing both rectangles for
+// every pose and looking each cell up in the occupancy_grid. Poses are drawn at random
+// all over the dock yard, with any heading and hitch angle within the limit, and a
+// second set is drawn in the open aisles, where most checks come out clear and neither
+// method can stop early. The masks must call every pose blocked that the rasterization
+// calls blocked; the bench counts how many more they call blocked.
+//
+// usage: footprint_bench [poses] [heading bins]
+//   poses         random poses in each set (default 200000)
+//   heading bins  heading bins of the masks (default 72)
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "scenario.h"
+#include "yard_map.h"
+#include "../RaspberryPi/bit_grid.h"
+#include "../RaspberryPi/footprint_mask.h"
+#include "../RaspberryPi/host_clock.h"
+
+#define HITCH_LIMIT 0.8f        // rad
+#define SEED 507
+
+static truck_footprint bench_footprint()
+{
+	truck_footprint footprint;
+	footprint.tractor_front = 0.45f;
+	footprint.tractor_rear = 0.10f;
+	footprint.tractor_width = 0.26f;
+	footprint.trailer_front = 0.15f;
+	footprint.trailer_rear = 0.95f;
+	footprint.trailer_width = 0.30f;
+	footprint.margin = 0.05f;
+	return footprint;
+}
+
+/**
+ * True if the center of any cell inside the rectangle reaching front ahead of (x, y)
+ * and rear behind it is blocked, walking every cell of the rectangle's bounding box.
+ */
+static bool rectangle_hits(const occupancy_grid &map, float x, float y, float heading, float front, float rear,
+                           float width)
+{
+	float c = cosf(heading), s = sinf(heading);
+	float half = 0.5f * width;
+	float corner_x[4] = {front, front, -rear, -rear}, corner_y[4] = {half, -half, half, -half};
+	float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+	for (uint8_t i = 0; i < 4; i++) {
+		float wx = x + corner_x[i] * c - corner_y[i] * s, wy = y + corner_x[i] * s + corner_y[i] * c;
+		x0 = std::min(x0, wx);
+		y0 = std::min(y0, wy);
+		x1 = std::max(x1, wx);
+		y1 = std::max(y1, wy);
+	}
+	int32_t cx0, cy0, cx1, cy1;
+	map.world_to_cell(x0, y0, cx0, cy0);
+	map.world_to_cell(x1, y1, cx1, cy1);
+	float resolution = map.get_resolution();
+	for (int32_t cy = cy0; cy <= cy1; cy++) {
+		for (int32_t cx = cx0; cx <= cx1; cx++) {
+			float dx = map.get_origin_x() + (cx + 0.5f) * resolution - x;
+			float dy = map.get_origin_y() + (cy + 0.5f) * resolution - y;
+			float along = dx * c + dy * s, across = dy * c - dx * s;
+			if (along < -rear || along > front || fabsf(across) > half)
+				continue;
+			if (!map.contains(cx, cy))
+				return true;
+			uint8_t value = map.get(cx, cy);
+			if (occupancy_grid::is_obstacle(value) || value == CELL_UNKNOWN)
+				return true;
+		}
+	}
+	return false;
+}
+
+static bool rasterized_hits(const occupancy_grid &map, const truck_geometry &geometry,
+                            const truck_footprint &footprint, const plan_pose &p)
+{
+	float m = footprint.margin;
+	if (rectangle_hits(map, p.x, p.y, p.heading, footprint.tractor_front + m, footprint.tractor_rear + m,
+	                   footprint.tractor_width + 2.0f * m))
+		return true;
+	float kx = p.x - geometry.hitch_offset * cosf(p.heading);
+	float ky = p.y - geometry.hitch_offset * sinf(p.heading);
+	return rectangle_hits(map, kx, ky, p.heading + p.hitch, m - footprint.trailer_front, footprint.trailer_rear + m,
+	                      footprint.trailer_width + 2.0f * m);
+}
+
+/**
+ * Checks one set of poses both ways and prints the rates.
+ * @return the number of poses the masks passed that the rasterization did not
+ */
+static uint32_t compare(const char *name, const std::vector<plan_pose> &poses, const occupancy_grid &map,
+                        const bit_grid &grid, const truck_geometry &geometry, const truck_footprint &footprint,
+                        const footprint_mask &masks)
+{
+	std::vector<uint8_t> rasterized(poses.size()), masked(poses.size());
+	uint64_t start = host_time_us();
+	for (size_t i = 0; i < poses.size(); i++)
+		rasterized[i] = rasterized_hits(map, geometry, footprint, poses[i]);
+	double rasterized_s = (host_time_us() - start) * 1e-6;
+	start = host_time_us();
+	for (size_t i = 0; i < poses.size(); i++)
+		masked[i] = masks.collides(grid, poses[i]);
+	double masked_s = (host_time_us() - start) * 1e-6;
+
+	uint32_t blocked = 0, missed = 0, extra = 0;
+	for (size_t i = 0; i < poses.size(); i++) {
+		blocked += rasterized[i];
+		missed += rasterized[i] && !masked[i];
+		extra += masked[i] && !rasterized[i];
+	}
+	printf("%-8s %7.1f%% %12.0f %12.0f %7.1fx %7u %7u\n", name, 100.0 * blocked / poses.size(),
+	       poses.size() / rasterized_s, poses.size() / masked_s, rasterized_s / masked_s, extra, missed);
+	return missed;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t count = argc > 1 ? (uint32_t)atoi(argv[1]) : 200000;
+	uint16_t heading_bins = argc > 2 ? (uint16_t)atoi(argv[2]) : 72;
+	if (count < 1)
+		count = 1;
+	if (heading_bins < 1)
+		heading_bins = 1;
+
+	truck_geometry geometry = default_sim_config().vehicle.geometry;
+	truck_footprint footprint = bench_footprint();
+	occupancy_grid map = make_dock_yard_grid();
+	build_dock_yard(map);
+
+	uint64_t start = host_time_us();
+	bit_grid grid(map);
+	uint32_t pack_us = (uint32_t)(host_time_us() - start);
+	footprint_mask masks(geometry, footprint, map.get_resolution(), heading_bins);
+	printf("grid packed in %.1f ms, %.0f kB; %u heading bins of masks in %.1f ms, %.0f kB\n", pack_us / 1000.0,
+	       grid.get_bytes() / 1024.0, heading_bins, masks.get_build_us() / 1000.0, masks.get_bytes() / 1024.0);
+
+	std::mt19937 rng(SEED);
+	std::uniform_real_distribution<float> anywhere(0.0f, DOCK_YARD_SIZE);
+	std::uniform_real_distribution<float> aisle(2.0f, DOCK_YARD_SIZE - 2.0f);
+	std::uniform_real_distribution<float> across(-0.6f, 0.6f);
+	std::uniform_real_distribution<float> heading(-(float)M_PI, (float)M_PI);
+	std::uniform_real_distribution<float> hitch(-HITCH_LIMIT, HITCH_LIMIT);
+	std::vector<plan_pose> yard(count), open(count);
+	for (uint32_t i = 0; i < count; i++) {
+		plan_pose p = {anywhere(rng), anywhere(rng), heading(rng), hitch(rng), false};
+		yard[i] = p;
+		// Along the aisles at y = 13, 25 and 37 m, or down the one at x = 46 m
+		float rows[3] = {13.0f, 25.0f, 37.0f};
+		if (i % 4 == 3)
+			p = {46.0f + across(rng), aisle(rng), heading(rng), 0.3f * hitch(rng), false};
+		else
+			p = {aisle(rng), rows[i % 4] + across(rng), heading(rng), 0.3f * hitch(rng), false};
+		open[i] = p;
+	}
+
+	printf("%-8s %8s %12s %12s %8s %7s %7s\n", "poses", "blocked", "raster /s", "masks /s", "speedup", "extra",
+	       "missed");
+	uint32_t missed = compare("yard", yard, map, grid, geometry, footprint, masks);
+	missed += compare("aisles", open, map, grid, geometry, footprint, masks);
+	printf("%s\n", missed == 0 ? "no blocked pose passed" : "FAILED: blocked poses passed");
+	return missed == 0 ? 0 : 1;
+}
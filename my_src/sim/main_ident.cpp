@@ -0,0 +1,264 @@
+//
+// Checks that the plant_identifier follows the steering and drive as they drift. The
+// truck weaves down a long slalom with its target speed changing every few seconds, and
+// halfway through the battery sags: the motor gets weaker and slower and the servo
+// slower and shorter of its command. The drive is logged the way the Pi sees it (the
+// commands it sent and the wheel_speed and imu_angle that came back) and the log is
+// replayed through the identifier, printing its estimates next to the true values and
+// the time an update takes. Then the drive is repeated with the identifier running in
+// the loop and its estimates handed to the control_loop, to show what tracking the
+// drift is worth after the sag.
+//
+// usage: ident_replay [seconds] [forgetting]
+//   seconds     length of the drive, the sag coming halfway (default 80)
+//   forgetting  the identifier's forgetting factor (default 0.998)
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "scenario.h"
+#include "../RaspberryPi/host_clock.h"
+#include "../RaspberryPi/plant_identifier.h"
+
+#define SLALOM_RADIUS 3.0f      // m
+#define SLALOM_SWEEP 0.7f       // rad turned by each arc
+#define SPEED_HOLD 3.0f         // s each target speed is held
+#define SEARCH_WINDOW 100       // path points searched ahead for the nearest one
+#define REPORT_PERIOD 10.0f     // s between rows of the replay table
+#define SETTLE_TIME 20.0f       // s after the sag left out of the tracking comparison
+#define GAIN_TOLERANCE 0.1f     // fraction of the true gain the final estimates must be within
+
+static const float target_speeds[] = {0.6f, 1.0f, 0.4f, 0.8f, 1.2f, 0.5f};
+
+/**
+ * @brief What the Pi has after one control period.
+ * @var time_us time of the period (us)
+ * @var steer_output the steering command sent
+ * @var motor_output the motor command sent
+ * @var wheel_speed the wheel_speed reported by the ATMega
+ * @var imu_angle the imu_angle reported by the ATMega
+ */
+struct log_entry {
+	uint64_t time_us;
+	int16_t  steer_output;
+	int16_t  motor_output;
+	int16_t  wheel_speed;
+	uint16_t imu_angle;
+};
+
+/**
+ * @brief How well one drive was tracked after the sag.
+ * @var speed_rms RMS error of the wheel speed from the speed setpoint (m/s)
+ * @var track_rms RMS cross-track error (m)
+ */
+struct drive_metrics {
+	float speed_rms;
+	float track_rms;
+};
+
+static identifier_config default_identifier_config(const sim_config &sim, float forgetting)
+{
+	identifier_config config;
+	config.period_us = sim.control_period_us;
+	config.forgetting = forgetting;
+	config.initial_covariance = 100.0f;
+	config.max_covariance = 1000.0f;
+	config.min_speed = 0.2f;
+	config.max_delay = 3;
+	config.min_updates = 200;
+	return config;
+}
+
+/**
+ * The truck after its battery has sagged.
+ */
+static vehicle_params sagged(const vehicle_params &nominal)
+{
+	vehicle_params p = nominal;
+	p.top_speed = 0.75f * nominal.top_speed;
+	p.motor_tau = 1.4f * nominal.motor_tau;
+	p.steer_gain = 0.85f * nominal.steer_gain;
+	p.steer_tau = 1.8f * nominal.steer_tau;
+	return p;
+}
+
+static void build_slalom(float length, std::vector<path_point> &path)
+{
+	path.clear();
+	path_point origin = {0.0f, 0.0f};
+	path.push_back(origin);
+	float x = 0.0f, y = 0.0f, heading = -0.5f * SLALOM_SWEEP;
+	float radius = SLALOM_RADIUS;
+	while (SLALOM_RADIUS * SLALOM_SWEEP * path.size() / 20.0f < length) {
+		add_path_arc(path, x, y, heading, radius, SLALOM_SWEEP);
+		x = path.back().x;
+		y = path.back().y;
+		heading += radius > 0.0f ? SLALOM_SWEEP : -SLALOM_SWEEP;
+		radius = -radius;
+	}
+}
+
+static uint16_t nearest(const std::vector<path_point> &path, uint16_t from, float x, float y)
+{
+	uint16_t best = from;
+	float best_d2 = 1e30f;
+	for (uint16_t i = from; i < path.size() && i < from + SEARCH_WINDOW; i++) {
+		float dx = path[i].x - x, dy = path[i].y - y;
+		if (dx * dx + dy * dy < best_d2) {
+			best_d2 = dx * dx + dy * dy;
+			best = i;
+		}
+	}
+	return best;
+}
+
+/**
+ * Drives the slalom, logging every control period. With an identifier, it runs in the
+ * loop and its valid estimates are handed to the control_loop.
+ */
+static drive_metrics drive(const sim_config &sim, float seconds, plant_identifier *identifier,
+                           std::vector<log_entry> &log)
+{
+	std::vector<path_point> path;
+	build_slalom(seconds * 1.2f + 5.0f, path);
+
+	vehicle_model plant(sim.vehicle);
+	vehicle_state start = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+	plant.reset(start);
+	mega_model mega(sim.mega);
+	control_loop controller(sim.vehicle.geometry, default_gains());
+
+	uint64_t plant_step_us = (uint64_t)(sim.plant_dt * 1e6f + 0.5f);
+	uint64_t end_us = (uint64_t)(seconds * 1e6f);
+	uint64_t sag_us = end_us / 2;
+	uint64_t settled_us = sag_us + (uint64_t)(SETTLE_TIME * 1e6f);
+	uint64_t hold_us = (uint64_t)(SPEED_HOLD * 1e6f);
+	uint64_t next_control_us = 0, next_speed_us = 0;
+	uint16_t closest = 0;
+	uint32_t speed_index = 0;
+	bool sagged_yet = false;
+	double speed_sq = 0.0, track_sq = 0.0;
+	uint32_t samples = 0;
+	semi_truck_data_t command = semi_truck_data_t();
+	command.desired_gear = 1;
+
+	log.clear();
+	log.reserve((size_t)(end_us / sim.control_period_us) + 1);
+	for (uint64_t now = 0; now < end_us; now += plant_step_us) {
+		if (!sagged_yet && now >= sag_us) {
+			plant.set_params(sagged(sim.vehicle));
+			sagged_yet = true;
+		}
+		mega.step(now, plant);
+
+		if (now >= next_control_us) {
+			next_control_us += sim.control_period_us;
+			const vehicle_state &s = plant.get_state();
+			const semi_truck_data_t &telemetry = mega.get_telemetry();
+			closest = nearest(path, closest, s.x, s.y);
+			if (now >= next_speed_us) {
+				float speed = target_speeds[speed_index++ % (sizeof(target_speeds) / sizeof(target_speeds[0]))];
+				controller.set_path(&path[closest], (uint16_t)(path.size() - closest), false, speed);
+				next_speed_us += hold_us;
+			}
+
+			control_input in;
+			in.time_us = now;
+			in.x = s.x;
+			in.y = s.y;
+			in.heading = control_loop::imu_angle_to_heading(telemetry.imu_angle);
+			in.hitch_angle = s.hitch;
+			in.wheel_speed = telemetry.wheel_speed;
+			controller.update(in, &command);
+			mega.send_command(command, now);
+
+			log_entry entry = {now, command.steer_output, command.motor_output, telemetry.wheel_speed,
+			                   telemetry.imu_angle};
+			log.push_back(entry);
+			if (identifier) {
+				identifier->update(now, command.steer_output, command.motor_output, telemetry.wheel_speed,
+				                   telemetry.imu_angle);
+				actuator_estimate steering = identifier->get_steering();
+				actuator_estimate motor = identifier->get_motor();
+				controller.set_actuator_model(steering.valid ? steering.gain : 1.0f,
+				                              motor.valid ? motor.gain : 0.0f);
+			}
+
+			if (now >= settled_us) {
+				float speed_error = (telemetry.wheel_speed - command.speed_setpoint) / WHEEL_SPEED_PER_M_S;
+				speed_sq += (double)speed_error * speed_error;
+				track_sq += (double)controller.get_cross_track_error() * controller.get_cross_track_error();
+				samples++;
+			}
+		}
+
+		const semi_truck_data_t &act = mega.get_actuators();
+		plant.step(sim.plant_dt, act.steer_output, act.motor_output);
+	}
+
+	drive_metrics m;
+	m.speed_rms = samples ? (float)sqrt(speed_sq / samples) : 0.0f;
+	m.track_rms = samples ? (float)sqrt(track_sq / samples) : 0.0f;
+	return m;
+}
+
+static void print_row(float t, const vehicle_params &truth, const actuator_estimate &steering,
+                      const actuator_estimate &motor)
+{
+	printf("%6.1f  %5.2f %5.2f %5.0f %5.0f %5.0f  |  %5.2f %5.2f %5.0f %5.0f %5.0f\n", t, truth.steer_gain,
+	       steering.valid ? steering.gain : NAN, truth.steer_tau * 1e3f, steering.valid ? steering.tau * 1e3f : NAN,
+	       steering.delay * 1e3f, truth.top_speed, motor.valid ? motor.gain : NAN, truth.motor_tau * 1e3f,
+	       motor.valid ? motor.tau * 1e3f : NAN, motor.delay * 1e3f);
+}
+
+int main(int argc, char **argv)
+{
+	float seconds = argc > 1 ? (float)atof(argv[1]) : 80.0f;
+	float forgetting = argc > 2 ? (float)atof(argv[2]) : 0.998f;
+	if (seconds < 2.0f * SETTLE_TIME)
+		seconds = 2.0f * SETTLE_TIME;
+
+	sim_config sim = default_sim_config();
+	identifier_config config = default_identifier_config(sim, forgetting);
+	vehicle_params after = sagged(sim.vehicle);
+
+	std::vector<log_entry> log;
+	drive_metrics fixed = drive(sim, seconds, NULL, log);
+
+	// Replay the log through the identifier, timing only the updates
+	plant_identifier identifier(sim.vehicle.geometry, config);
+	printf("%6s  %5s %5s %5s %5s %5s  |  %5s %5s %5s %5s %5s\n", "time", "steer", "gain", "tau", "ms", "delay",
+	       "top", "speed", "tau", "ms", "delay");
+	uint64_t update_us = 0;
+	float next_report = REPORT_PERIOD;
+	for (size_t i = 0; i < log.size(); i++) {
+		const log_entry &e = log[i];
+		uint64_t start = host_time_us();
+		identifier.update(e.time_us, e.steer_output, e.motor_output, e.wheel_speed, e.imu_angle);
+		update_us += host_time_us() - start;
+		float t = e.time_us * 1e-6f;
+		if (t >= next_report || i + 1 == log.size()) {
+			print_row(t, t < 0.5f * seconds ? sim.vehicle : after, identifier.get_steering(),
+			          identifier.get_motor());
+			next_report += REPORT_PERIOD;
+		}
+	}
+	printf("%zu updates, %.0f ns each\n", log.size(), 1e3 * update_us / log.size());
+
+	std::vector<log_entry> adaptive_log;
+	plant_identifier live(sim.vehicle.geometry, config);
+	drive_metrics adaptive = drive(sim, seconds, &live, adaptive_log);
+	printf("after the sag    speed rms   track rms\n");
+	printf("nominal model   %6.3f m/s %8.3f m\n", fixed.speed_rms, fixed.track_rms);
+	printf("identified      %6.3f m/s %8.3f m\n", adaptive.speed_rms, adaptive.track_rms);
+
+	actuator_estimate steering = identifier.get_steering();
+	actuator_estimate motor = identifier.get_motor();
+	bool ok = steering.valid && motor.valid
+	          && fabsf(steering.gain - after.steer_gain) < GAIN_TOLERANCE * after.steer_gain
+	          && fabsf(motor.gain - after.top_speed) < GAIN_TOLERANCE * after.top_speed;
+	printf("%s\n", ok ? "ok" : "FAILED: the final gains are off");
+	return ok ? 0 : 1;
+}
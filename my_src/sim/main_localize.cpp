@@ -0,0 +1,225 @@
+//
+// Records a drive around a simulated container yard (the true poses, the odometry the
+// Pi would get from the wheel speed and the IMU, and the LiDAR scans with the trailer
+// masked by the hitch_estimator), then replays it through the particle_filter with
+// several particle counts. For each count it prints how far the estimate was from the
+// true pose and how long scoring a scan took, against the LiDAR's sweep period.
+//
+// usage: localize_replay [seconds] [threads] [seed]
+//   seconds  length of the recorded drive (default 60)
+//   threads  workers used to score particles, 0 for one per core (default 0)
+//   seed     seed for the LiDAR noise and the filter (default 1)
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "sil_harness.h"
+#include "yard_map.h"
+#include "../RaspberryPi/particle_filter.h"
+
+#define LOOP_STRAIGHT 12.0f     // m
+#define LOOP_RADIUS 4.0f        // m
+#define DRIVE_SPEED 0.5f        // m/s
+#define SETTLE_TIME 2.0f        // s of the replay left out of the error, while the filter converges
+#define START_ERROR 0.3f        // m the filter's starting guess is off by
+#define START_HEADING_ERROR 0.1f
+#define MAX_PATH_POINTS 65000
+
+/**
+ * @brief One LiDAR sweep of the recorded drive.
+ * @var truth the true state when the sweep started
+ * @var distance distance the odometry reported since the last sweep (m)
+ * @var turn heading change the IMU reported since the last sweep (rad)
+ * @var scan the scan, with the trailer flagged
+ */
+struct replay_frame {
+	vehicle_state truth;
+	float distance;
+	float turn;
+	lidar_scan scan;
+};
+
+static float wrap_angle(float a)
+{
+	while (a > (float)M_PI)
+		a -= 2.0f * (float)M_PI;
+	while (a <= -(float)M_PI)
+		a += 2.0f * (float)M_PI;
+	return a;
+}
+
+/**
+ * Drives the loop with the control loop given the true pose, recording a frame at the
+ * start of every LiDAR sweep.
+ */
+static void record(const sil_config &config, const occupancy_grid &map, float seconds,
+                   std::vector<replay_frame> &frames)
+{
+	const sim_config &sim = config.sim;
+	std::vector<path_point> path;
+	float x0 = 6.0f, y0 = 4.0f;
+	path_point origin = {x0, y0};
+	path.push_back(origin);
+	float lap = 2.0f * LOOP_STRAIGHT + 2.0f * (float)M_PI * LOOP_RADIUS;
+	uint32_t laps = (uint32_t)ceilf(seconds * DRIVE_SPEED / lap) + 1;
+	for (uint32_t i = 0; i < laps && path.size() < MAX_PATH_POINTS; i++) {
+		add_path_line(path, x0, y0, 0.0f, LOOP_STRAIGHT);
+		add_path_arc(path, x0 + LOOP_STRAIGHT, y0, 0.0f, LOOP_RADIUS, (float)M_PI);
+		add_path_line(path, x0 + LOOP_STRAIGHT, y0 + 2.0f * LOOP_RADIUS, (float)M_PI, LOOP_STRAIGHT);
+		add_path_arc(path, x0, y0 + 2.0f * LOOP_RADIUS, (float)M_PI, LOOP_RADIUS, (float)M_PI);
+	}
+	if (path.size() > MAX_PATH_POINTS)
+		path.resize(MAX_PATH_POINTS);
+
+	vehicle_model plant(sim.vehicle);
+	vehicle_state start = {x0, y0, 0.0f, 0.0f, 0.0f, 0.0f};
+	plant.reset(start);
+	control_loop controller(sim.vehicle.geometry, default_gains());
+	controller.set_path(&path[0], (uint16_t)path.size(), false, DRIVE_SPEED);
+	lidar_model lidar(config.lidar, config.hitch);
+	lidar.set_map(&map);
+	hitch_estimator estimator(config.hitch);
+
+	uint32_t plant_us = (uint32_t)lroundf(sim.plant_dt * 1e6f);
+	uint64_t end_us = (uint64_t)(seconds * 1e6f);
+	uint64_t next_control = 0, next_scan = 0;
+	semi_truck_data_t data = semi_truck_data_t();
+	float distance = 0.0f, turn = 0.0f;
+	float last_heading = control_loop::imu_angle_to_heading(plant.measure_imu_angle());
+	uint64_t last_odometry = 0;
+
+	frames.reserve((size_t)(end_us / config.lidar.sweep_us) + 1);
+	for (uint64_t now = 0; now < end_us; now += plant_us) {
+		if (now >= next_control) {
+			const vehicle_state &s = plant.get_state();
+			hitch_estimate hitch = estimator.get_last_valid();
+			control_input in;
+			in.time_us = now;
+			in.x = s.x;
+			in.y = s.y;
+			in.heading = s.heading;
+			in.hitch_angle = hitch.valid ? hitch.angle : 0.0f;
+			in.wheel_speed = plant.measure_wheel_speed();
+			controller.update(in, &data);
+
+			// Odometry as the Pi sees it: the wheel speed over the last period and the
+			// change of the IMU heading
+			float heading = control_loop::imu_angle_to_heading(plant.measure_imu_angle());
+			distance += in.wheel_speed / WHEEL_SPEED_PER_M_S * (now - last_odometry) * 1e-6f;
+			turn += wrap_angle(heading - last_heading);
+			last_heading = heading;
+			last_odometry = now;
+			next_control += sim.control_period_us;
+		}
+		if (now >= next_scan) {
+			frames.push_back(replay_frame());
+			replay_frame &f = frames.back();
+			f.truth = plant.get_state();
+			f.distance = distance;
+			f.turn = turn;
+			lidar.scan(f.truth, now, f.scan);
+			estimator.process(f.scan);
+			distance = 0.0f;
+			turn = 0.0f;
+			next_scan += config.lidar.sweep_us;
+		}
+		plant.step(sim.plant_dt, data.steer_output, data.motor_output);
+	}
+}
+
+static particle_filter_config default_filter_config(const sil_config &config, uint32_t particles, uint32_t seed)
+{
+	particle_filter_config pf;
+	pf.particles = particles;
+	pf.rot_per_rot = 0.05f;
+	pf.rot_per_trans = 0.05f;
+	pf.trans_per_trans = 0.2f;
+	pf.trans_per_rot = 0.01f;
+	pf.beam_stride = 10;
+	pf.beam_weight = 0.2f;
+	pf.sensor_x = config.lidar.mount_x;
+	pf.sensor_y = config.lidar.mount_y;
+	pf.sensor_yaw = config.lidar.mount_yaw;
+	pf.update_distance = 0.005f;
+	pf.update_angle = 0.005f;
+	pf.resample_ratio = 0.5f;
+	pf.grain = 128;
+	pf.seed = seed;
+	return pf;
+}
+
+int main(int argc, char **argv)
+{
+	float seconds = argc > 1 ? (float)atof(argv[1]) : 60.0f;
+	unsigned threads = argc > 2 ? (unsigned)atoi(argv[2]) : 0;
+	uint32_t seed = argc > 3 ? (uint32_t)atol(argv[3]) : 1;
+
+	sil_config config = default_sil_config();
+	config.lidar.seed = seed;
+
+	occupancy_grid map = make_yard_grid();
+	build_yard(map);
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	likelihood_config sensor;
+	sensor.sigma_hit = 0.1f;
+	sensor.z_hit = 0.9f;
+	sensor.z_rand = 0.1f;
+	sensor.max_range = config.lidar.range_max;
+	likelihood_field field(map, sensor);
+	double field_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	std::vector<replay_frame> frames;
+	record(config, map, seconds, frames);
+
+	work_pool pool(threads);
+	printf("%.0f s drive, %zu scans, %u x %u map built in %.1f ms, %u workers\n",
+	       seconds, frames.size(), map.get_width(), map.get_height(), field_ms, pool.size());
+	printf("particles  rms pos (m)  max pos (m)  rms heading (deg)  mean update (ms)  max update (ms)  load\n");
+
+	const uint32_t counts[] = {250, 500, 1000, 2000, 4000, 8000};
+	for (uint32_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		particle_filter filter(field, default_filter_config(config, counts[c], seed));
+		const vehicle_state &s0 = frames[0].truth;
+		filter.init(s0.x + START_ERROR, s0.y - START_ERROR, s0.heading + START_HEADING_ERROR,
+		            START_ERROR, START_HEADING_ERROR);
+
+		double sum_sq = 0.0, sum_sq_heading = 0.0, total_ms = 0.0, max_ms = 0.0;
+		float max_error = 0.0f;
+		uint32_t scored = 0, measured = 0;
+		for (size_t k = 0; k < frames.size(); k++) {
+			const replay_frame &f = frames[k];
+			filter.predict(f.distance, f.turn);
+			std::chrono::steady_clock::time_point a = std::chrono::steady_clock::now();
+			bool updated = filter.update(f.scan, &pool);
+			pose_estimate est = filter.get_estimate();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - a).count();
+			if (updated) {
+				total_ms += ms;
+				if (ms > max_ms)
+					max_ms = ms;
+				scored++;
+			}
+
+			if (k * config.lidar.sweep_us < SETTLE_TIME * 1e6f)
+				continue;
+			float e = hypotf(est.x - f.truth.x, est.y - f.truth.y);
+			float eh = wrap_angle(est.heading - f.truth.heading);
+			sum_sq += (double)e * e;
+			sum_sq_heading += (double)eh * eh;
+			if (e > max_error)
+				max_error = e;
+			measured++;
+		}
+
+		double mean_ms = scored ? total_ms / scored : 0.0;
+		printf("%9u  %11.3f  %11.3f  %17.2f  %16.3f  %15.3f  %3.0f%%\n", counts[c],
+		       measured ? sqrt(sum_sq / measured) : 0.0, max_error,
+		       measured ? sqrt(sum_sq_heading / measured) * 180.0 / M_PI : 0.0,
+		       mean_ms, max_ms, 100.0 * mean_ms * 1000.0 / config.lidar.sweep_us);
+	}
+	return 0;
+}
@@ -0,0 +1,269 @@
+//
+// Compares booting the localizer from a saved tiled_map file with building its
+// likelihood field from the occupancy grid, on a square site made of copies of the dock
+// yard side by side. First the occupancy grid and the likelihood field are saved and
+// dropped from the page cache, so the file starts cold. Then a short drive along an
+// aisle of the first yard is recorded, and the particle filter is started on it twice:
+// once on a field worked out from the grid, once on the field mapped from the file with
+// the tiles around the truck prefetched. For each it prints the time from start until
+// the estimate has converged on the true pose, and for the file how much of it ended up
+// in RAM. Last, a few cells of the saved grid are changed and flushed in the background,
+// and the file is read back to check they arrived.
+//
+// usage: map_store_bench [size] [directory]
+//   size       side of the site, rounded to whole dock yards (default 200 m)
+//   directory  where to write the map files (default /tmp)
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sil_harness.h"
+#include "yard_map.h"
+#include "../RaspberryPi/hitch_estimator.h"
+#include "../RaspberryPi/particle_filter.h"
+#include "../RaspberryPi/tiled_map.h"
+
+#define TILE_SIZE 64            // cells along a tile of the occupancy file
+#define DRIVE_Y 25.0f           // y of the aisle driven along (m)
+#define DRIVE_X0 4.0f           // where the drive starts (m)
+#define DRIVE_SPEED 1.0f        // m/s
+#define DRIVE_TIME 4.0f         // s
+#define START_ERROR 0.3f        // m the filter's starting guess is off by
+#define START_HEADING_ERROR 0.1f
+#define LOCALIZED_ERROR 0.1f    // m from the true pose that counts as localized
+#define LOCALIZED_SPREAD 0.1f   // m of particle spread that counts as converged
+#define PREFETCH_RADIUS 32.0f   // m around the estimate kept paged in; beyond the LiDAR's range
+#define PARTICLES 1000
+
+/**
+ * @brief One LiDAR sweep of the recorded drive.
+ * @var truth the true state when the sweep started
+ * @var distance distance driven since the last sweep (m)
+ * @var scan the scan, with the trailer flagged
+ */
+struct drive_frame {
+	vehicle_state truth;
+	float distance;
+	lidar_scan scan;
+};
+
+static double ms_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Makes the site out of copies of the dock yard.
+ */
+static occupancy_grid make_site(uint32_t yards)
+{
+	occupancy_grid yard = make_dock_yard_grid();
+	build_dock_yard(yard);
+	uint32_t side = yard.get_width();
+	occupancy_grid site((uint16_t)(side * yards), (uint16_t)(side * yards), yard.get_resolution(), 0.0f, 0.0f);
+	for (uint32_t by = 0; by < yards; by++)
+		for (uint32_t bx = 0; bx < yards; bx++)
+			for (uint32_t cy = 0; cy < side; cy++)
+				for (uint32_t cx = 0; cx < side; cx++)
+					site.set(bx * side + cx, by * side + cy, yard.get(cx, cy));
+	return site;
+}
+
+/**
+ * Writes a file's pages out and drops them from the page cache, as after a reboot.
+ */
+static void drop_cache(const std::string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+static size_t file_size(const std::string &path)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f)
+		return 0;
+	fseek(f, 0, SEEK_END);
+	size_t size = (size_t)ftell(f);
+	fclose(f);
+	return size;
+}
+
+static particle_filter_config filter_config(const sil_config &config)
+{
+	particle_filter_config pf;
+	pf.particles = PARTICLES;
+	pf.rot_per_rot = 0.05f;
+	pf.rot_per_trans = 0.05f;
+	pf.trans_per_trans = 0.2f;
+	pf.trans_per_rot = 0.01f;
+	pf.beam_stride = 10;
+	pf.beam_weight = 0.2f;
+	pf.sensor_x = config.lidar.mount_x;
+	pf.sensor_y = config.lidar.mount_y;
+	pf.sensor_yaw = config.lidar.mount_yaw;
+	pf.update_distance = 0.005f;
+	pf.update_angle = 0.005f;
+	pf.resample_ratio = 0.5f;
+	pf.grain = 128;
+	pf.seed = 1;
+	return pf;
+}
+
+/**
+ * Runs the filter over the drive until it has converged on the true pose.
+ * @param file The mapped file to prefetch around the estimate, or NULL
+ * @param scans Set to the number of scans it took
+ * @return true if it converged before the drive ran out
+ */
+static bool localize(const likelihood_field &field, const sil_config &config, const std::vector<drive_frame> &frames,
+                     tiled_map *file, uint32_t &scans)
+{
+	particle_filter filter(field, filter_config(config));
+	const vehicle_state &s0 = frames[0].truth;
+	filter.init(s0.x + START_ERROR, s0.y - START_ERROR, s0.heading + START_HEADING_ERROR, START_ERROR,
+	            START_HEADING_ERROR);
+	for (scans = 0; scans < frames.size(); scans++) {
+		const drive_frame &f = frames[scans];
+		pose_estimate est = filter.get_estimate();
+		if (file)
+			file->prefetch(est.x, est.y, PREFETCH_RADIUS);
+		filter.predict(f.distance, 0.0f);
+		filter.update(f.scan, NULL);
+		est = filter.get_estimate();
+		if (est.spread < LOCALIZED_SPREAD && hypotf(est.x - f.truth.x, est.y - f.truth.y) < LOCALIZED_ERROR) {
+			scans++;
+			return true;
+		}
+	}
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	float size = argc > 1 ? (float)atof(argv[1]) : 200.0f;
+	std::string directory = argc > 2 ? argv[2] : "/tmp";
+	uint32_t yards = (uint32_t)std::max(1L, lroundf(size / DOCK_YARD_SIZE));
+	std::string grid_path = directory + "/map_store_grid.map";
+	std::string field_path = directory + "/map_store_field.map";
+
+	sil_config config = default_sil_config();
+	likelihood_config sensor;
+	sensor.sigma_hit = 0.1f;
+	sensor.z_hit = 0.9f;
+	sensor.z_rand = 0.1f;
+	sensor.max_range = config.lidar.range_max;
+
+	occupancy_grid site = make_site(yards);
+	printf("%.0f m site, %u x %u cells\n", yards * DOCK_YARD_SIZE, site.get_width(), site.get_height());
+
+	// Record the drive before anything is timed; the scans stand in for the LiDAR
+	std::vector<drive_frame> frames;
+	{
+		lidar_model lidar(config.lidar, config.hitch);
+		lidar.set_map(&site);
+		hitch_estimator estimator(config.hitch);
+		float step = DRIVE_SPEED * config.lidar.sweep_us * 1e-6f;
+		uint32_t count = (uint32_t)(DRIVE_TIME * 1e6f / config.lidar.sweep_us);
+		frames.resize(count);
+		for (uint32_t k = 0; k < count; k++) {
+			vehicle_state s = {DRIVE_X0 + k * step, DRIVE_Y, 0.0f, 0.0f, 0.0f, DRIVE_SPEED};
+			frames[k].truth = s;
+			frames[k].distance = k > 0 ? step : 0.0f;
+			lidar.scan(s, (uint64_t)k * config.lidar.sweep_us, frames[k].scan);
+			estimator.process(frames[k].scan);
+		}
+	}
+
+	// Boot by working the field out from the grid
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	likelihood_field built(site, sensor);
+	double build_ms = ms_since(start);
+	uint32_t built_scans = 0;
+	bool built_ok = localize(built, config, frames, NULL, built_scans);
+	double built_total_ms = ms_since(start);
+
+	start = std::chrono::steady_clock::now();
+	bool saved = tiled_map::save(grid_path.c_str(), site, TILE_SIZE) && built.save(field_path.c_str());
+	double save_ms = ms_since(start);
+	if (!saved) {
+		printf("could not write the map files in %s\n", directory.c_str());
+		return 1;
+	}
+	drop_cache(grid_path);
+	drop_cache(field_path);
+	printf("saved grid %.1f MB and field %.1f MB in %.0f ms\n", file_size(grid_path) / 1048576.0,
+	       file_size(field_path) / 1048576.0, save_ms);
+
+	// Boot from the file
+	start = std::chrono::steady_clock::now();
+	tiled_map file;
+	if (!file.open(field_path.c_str(), false)) {
+		printf("could not open %s\n", field_path.c_str());
+		return 1;
+	}
+	likelihood_field mapped(file, sensor);
+	double open_ms = ms_since(start);
+	uint32_t mapped_scans = 0;
+	bool mapped_ok = !mapped.is_empty() && localize(mapped, config, frames, &file, mapped_scans);
+	double mapped_total_ms = ms_since(start);
+	uint32_t tiles = file.get_tiles_x() * file.get_tiles_y();
+	uint32_t resident = file.count_resident();
+
+	printf("%-10s %10s %10s %7s %12s\n", "start", "ready ms", "scans", "found", "localized ms");
+	printf("%-10s %10.1f %10u %7s %12.1f\n", "build", build_ms, built_scans, built_ok ? "yes" : "no", built_total_ms);
+	printf("%-10s %10.1f %10u %7s %12.1f\n", "map file", open_ms, mapped_scans, mapped_ok ? "yes" : "no",
+	       mapped_total_ms);
+	printf("field tiles in RAM: %u of %u (%.1f of %.1f MB)\n", resident, tiles,
+	       resident * file.get_tile_stride() / 1048576.0, tiles * file.get_tile_stride() / 1048576.0);
+	file.close();
+
+	// Change a pallet's worth of cells in the saved grid and flush them in the background
+	tiled_map grid;
+	if (!grid.open(grid_path.c_str(), true)) {
+		printf("could not open %s\n", grid_path.c_str());
+		return 1;
+	}
+	int32_t cx0, cy0, cx1, cy1;
+	site.world_to_cell(DRIVE_X0 + 10.0f, DRIVE_Y + 1.0f, cx0, cy0);
+	site.world_to_cell(DRIVE_X0 + 10.8f, DRIVE_Y + 1.8f, cx1, cy1);
+	for (int32_t cy = cy0; cy <= cy1; cy++) {
+		for (int32_t cx = cx0; cx <= cx1; cx++) {
+			*grid.cell(cx, cy) = CELL_OCCUPIED;
+			grid.mark_dirty(cx, cy);
+			site.set(cx, cy, CELL_OCCUPIED);
+		}
+	}
+	start = std::chrono::steady_clock::now();
+	uint32_t flushed = grid.flush();
+	double flush_ms = ms_since(start);
+	bool synced = grid.wait_flushed();
+	double sync_ms = ms_since(start);
+	grid.close();
+
+	tiled_map reread;
+	occupancy_grid loaded = make_dock_yard_grid();
+	bool same = reread.open(grid_path.c_str(), false) && reread.load(loaded)
+	            && loaded.get_width() == site.get_width() && loaded.get_height() == site.get_height()
+	            && memcmp(loaded.data(), site.data(), (size_t)site.get_width() * site.get_height()) == 0;
+	printf("%u dirty tiles handed over in %.3f ms, on disk after %.1f ms; file %s the grid\n", flushed, flush_ms,
+	       sync_ms, same ? "matches" : "DIFFERS FROM");
+
+	remove(grid_path.c_str());
+	remove(field_path.c_str());
+	bool ok = built_ok && mapped_ok && synced && same;
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+//
+// Compares the MPC steering with pure pursuit on the standard maneuvers and times its
+// solves. Every maneuver starts off the path, with a heading error and the trailer
+// swung out, and the pose and hitch angle fed to the controller are noisy. Each is
+// driven with pure pursuit, with the MPC at three horizons, and with the longest
+// horizon again but every solve started from zero instead of the last plan. Prints the
+// tracking error, whether the drive finished and whether the trailer jackknifed, and
+// the run time and iterations of the solves on this machine. A Pi core is a few times
+// slower than a desktop one, so the longest solve must come in under half the control
+// period here.
+//
+// usage: mpc_bench [speed]
+//   speed  target speed of every maneuver (default 0.5 m/s)
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "scenario.h"
+
+#define INITIAL_OFFSET 0.2f     // m
+#define INITIAL_HEADING 0.1f    // rad
+#define INITIAL_HITCH 0.1f      // rad
+#define POSITION_NOISE 0.01f    // m
+#define HITCH_NOISE 0.01f       // rad
+#define SOLVE_BUDGET 0.5f       // share of the control period a solve may take here
+
+static const scenario_kind kinds[] = {
+	SCENARIO_LANE_CHANGE, SCENARIO_FORWARD_CURVE, SCENARIO_REVERSE_STRAIGHT, SCENARIO_REVERSE_CURVE
+};
+static const char *const kind_names[] = {"lane", "curve", "rev-line", "rev-curve"};
+
+/**
+ * @brief One controller under test.
+ * @var name label in the table
+ * @var horizon MPC horizon, 0 for pure pursuit
+ * @var warm_start true to start each solve from the last plan
+ */
+struct bench_controller {
+	const char *name;
+	uint8_t horizon;
+	bool warm_start;
+};
+
+static const bench_controller controllers[] = {
+	{"pursuit", 0, true},
+	{"mpc-10", 10, true},
+	{"mpc-20", 20, true},
+	{"mpc-30", 30, true},
+	{"mpc-30c", 30, false},
+};
+
+static mpc_config default_mpc_config(uint8_t horizon, bool warm_start)
+{
+	mpc_config config;
+	config.horizon = horizon;
+	config.step = 0.1f;
+	config.lateral_weight = 20.0f;
+	config.heading_weight = 4.0f;
+	config.hitch_weight = 0.5f;
+	config.terminal_weight = 5.0f;
+	config.curvature_weight = 0.02f;
+	config.rate_weight = 0.2f;
+	config.max_steer_rate = 5.0f;
+	config.hitch_limit = 0.8f;
+	config.warm_start = warm_start;
+	config.solver.rho = 0.1f;
+	config.solver.sigma = 1e-6f;
+	config.solver.alpha = 1.6f;
+	config.solver.eps_abs = 1e-5f;
+	config.solver.eps_rel = 1e-4f;
+	config.solver.max_iterations = 200;
+	config.solver.check_every = 5;
+	config.solver.scaling_passes = 10;
+	return config;
+}
+
+int main(int argc, char **argv)
+{
+	float speed = argc > 1 ? (float)atof(argv[1]) : 0.5f;
+	sim_config config = default_sim_config();
+	const truck_geometry &g = config.vehicle.geometry;
+	float budget_us = SOLVE_BUDGET * config.control_period_us;
+
+	bool ok = true;
+	printf("%-9s  %-8s  %7s  %7s  %-4s  %2s  %7s  %7s  %5s  %5s  %5s\n", "maneuver", "steering", "rms", "max",
+	       "done", "jk", "mean", "max", "it", "max", "unconv");
+	for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+		scenario sc;
+		sc.kind = kinds[i];
+		sc.gains = default_gains();
+		sc.speed = speed;
+		sc.initial_offset = INITIAL_OFFSET;
+		sc.initial_heading = INITIAL_HEADING;
+		sc.initial_hitch = INITIAL_HITCH;
+		sc.position_noise = POSITION_NOISE;
+		sc.hitch_noise = HITCH_NOISE;
+		sc.seed = (uint32_t)i + 1;
+
+		for (size_t c = 0; c < sizeof(controllers) / sizeof(controllers[0]); c++) {
+			const bench_controller &bc = controllers[c];
+			mpc_steering *mpc = bc.horizon ? new mpc_steering(g, default_mpc_config(bc.horizon, bc.warm_start)) : NULL;
+			run_metrics m = run_scenario(sc, config, mpc);
+
+			printf("%-9s  %-8s  %5.1fmm  %5.1fmm  %-4s  %2u", kind_names[i], bc.name, m.rms_error * 1e3f,
+			       m.max_error * 1e3f, m.completed ? "yes" : "NO", m.jackknife_events);
+			if (mpc) {
+				const mpc_stats &st = mpc->get_stats();
+				float mean_us = st.solves ? (float)st.total_solve_us / st.solves : 0.0f;
+				float mean_it = st.solves ? (float)st.total_iterations / st.solves : 0.0f;
+				printf("  %5.0fus  %5uus  %5.1f  %5u  %5u", mean_us, st.max_solve_us, mean_it, st.max_iterations,
+				       st.unconverged);
+				if (!m.completed || m.jackknife_events || st.max_solve_us > budget_us) {
+					printf("  FAILED");
+					ok = false;
+				}
+				delete mpc;
+			}
+			printf("\n");
+		}
+	}
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+//
+// Runs a front and a rear LiDAR in real time, each on its own LiDAR_sensor thread with
+// its own clock, phase and transfer delays, while the truck drives through the yard,
+// and merges their scans with a scan_merger. Prints how well each device's clock was
+// recovered and how much latency the merge added against the scan period. A stall
+// time makes the rear LiDAR stop partway, to show the merge going on without it.
+//
+// usage: multi_lidar [seconds] [stall]
+//   seconds  length of the run (default 5)
+//   stall    seconds after which the rear LiDAR stops, 0 for never (default 0)
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "sil_harness.h"
+#include "sim_lidar_device.h"
+#include "yard_map.h"
+
+#define DRIVE_SPEED 0.5f    // m/s
+#define WAIT_TIMEOUT_US 100000
+
+int main(int argc, char **argv)
+{
+	float seconds = argc > 1 ? (float)atof(argv[1]) : 5.0f;
+	float stall = argc > 2 ? (float)atof(argv[2]) : 0.0f;
+
+	sil_config config = default_sil_config();
+	occupancy_grid map = make_yard_grid();
+	build_yard(map);
+
+	// Straight along the bottom of the test loop
+	uint64_t start_us = host_time_us();
+	std::function<vehicle_state(uint64_t)> truth = [start_us](uint64_t now_us) {
+		vehicle_state s = {6.0f + DRIVE_SPEED * (now_us - start_us) * 1e-6f, 4.0f, 0.0f, 0.1f, 0.0f, DRIVE_SPEED};
+		return s;
+	};
+
+	// The rear LiDAR is the one the SIL uses and sees the trailer; the front one is on
+	// the bumper looking forward
+	lidar_model_config rear = config.lidar;
+	lidar_model_config front = config.lidar;
+	front.angle_min = -3.0f * (float)M_PI / 4;
+	front.mount_x = 0.45f;
+	front.seed = rear.seed + 10;
+
+	sim_device_timing front_timing = {0, 5000000, 30.0f, 3000, 0};
+	sim_device_timing rear_timing = {11000, -3000000, -50.0f, 3000, (uint64_t)(stall * 1e6f)};
+	sim_lidar_device front_device(front, config.hitch, &map, front_timing, truth);
+	sim_lidar_device rear_device(rear, config.hitch, &map, rear_timing, truth);
+
+	scan_merger merger(2, config.lidar.sweep_us * 3 / 4, config.lidar.sweep_us);
+	lidar_extrinsics front_mount = {front.mount_x, front.mount_y, front.mount_yaw};
+	lidar_extrinsics rear_mount = {rear.mount_x, rear.mount_y, rear.mount_yaw};
+	LiDAR_sensor front_sensor(&front_device, front_mount, &merger, 0);
+	LiDAR_sensor rear_sensor(&rear_device, rear_mount, &merger, 1);
+	hitch_estimator estimator(config.hitch);
+	rear_sensor.set_filter([&estimator](lidar_scan &scan) { estimator.process(scan); });
+	front_sensor.start();
+	rear_sensor.start();
+
+	merged_scan *merged = new merged_scan;
+	uint32_t both = 0, trailer_points = 0;
+	uint64_t end_us = start_us + (uint64_t)(seconds * 1e6f);
+	while (host_time_us() < end_us) {
+		if (!merger.wait(*merged, WAIT_TIMEOUT_US))
+			continue;
+		if (merged->sources == 3)
+			both++;
+		for (uint16_t i = 0; i < merged->count; i++)
+			if (merged->flags[i] & SCAN_FLAG_TRAILER)
+				trailer_points++;
+	}
+	merger.stop();
+	front_sensor.stop();
+	rear_sensor.stop();
+	uint64_t now = host_time_us();
+
+	merger_stats stats = merger.get_stats();
+	printf("%.1f s, 2 LiDARs at %u us per scan\n", seconds, config.lidar.sweep_us);
+	printf("front: %u scans, %u errors, clock offset error %lld us\n", front_sensor.get_scan_count(),
+	       front_sensor.get_error_count(),
+	       (long long)(front_sensor.get_clock_offset_us() - front_device.true_offset_us(now)));
+	printf("rear:  %u scans, %u errors, clock offset error %lld us, hitch estimate %.3f rad\n",
+	       rear_sensor.get_scan_count(), rear_sensor.get_error_count(),
+	       (long long)(rear_sensor.get_clock_offset_us() - rear_device.true_offset_us(now)),
+	       estimator.get_last_valid().angle);
+	if (rear_sensor.get_reset_count())
+		printf("rear:  %u resets, %s\n", rear_sensor.get_reset_count(),
+		       rear_sensor.has_failed() ? "given up on" : "reading again");
+	printf("merges: %u (%u with both, %u partial), %u stale, %u overwritten, %u trailer points flagged\n",
+	       stats.merges, both, stats.partial_merges, stats.stale_scans, stats.overwritten_scans, trailer_points);
+	if (stats.merges) {
+		printf("wait in merger: mean %.0f us, max %u us (%.2f scan periods)\n",
+		       (double)stats.sum_wait_us / stats.merges, stats.max_wait_us,
+		       (double)stats.max_wait_us / config.lidar.sweep_us);
+		printf("scan age at merge: mean %.0f us, max %u us; max skew between scans %u us\n",
+		       (double)stats.sum_age_us / stats.merges, stats.max_age_us, stats.max_skew_us);
+	}
+	delete merged;
+	return 0;
+}
@@ -0,0 +1,353 @@
+//
+// Runs the Pi's chain from LiDAR scan to motor command as a pipeline, in real time, on
+// a simulated LiDAR while the truck drives along the yard: acquire reads the scans,
+// preprocess masks the trailer with the hitch_estimator, localize runs the
+// particle_filter, control runs the control_loop on the work_pool, and send stands in
+// for pi_comm_task writing to the ATMega. Prints each stage's telemetry every second,
+// and at the end the scan-to-command latency and where it went. Making localize slower
+// than the scan period shows the queue in front of it dropping old scans, or with
+// "block", holding preprocess back so the scans are dropped in front of preprocess.
+//
+// A load_shedder watches the commands against a deadline and the CPU's idle time, and
+// localize scores fewer beams with fewer particles at the level it picks. Busy threads
+// can be started for part of the run, to load the CPU the way a stuck process would,
+// and watch the levels go down and come back.
+//
+// Given a directory, a flight_recorder keeps the last seconds of scans, commands and
+// cycle timing, and writes them there when a command misses its deadline.
+//
+// usage: pipeline_demo [seconds] [slow_ms] [drop|block] [load_from] [load_to] [record_dir]
+//   seconds    length of the run (default 5)
+//   slow_ms    extra time localize takes on every scan (default 0)
+//   policy     what the queue in front of localize does when full (default drop)
+//   load_from  seconds into the run the busy threads start (default 0)
+//   load_to    seconds into the run they stop, 0 for no load (default 0)
+//   record_dir where the recorder writes its files (default none, no recorder)
+//
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "sil_harness.h"
+#include "sim_lidar_device.h"
+#include "yard_map.h"
+#include "../RaspberryPi/flight_recorder.h"
+#include "../RaspberryPi/load_shedder.h"
+#include "../RaspberryPi/particle_filter.h"
+#include "../RaspberryPi/pipeline.h"
+
+#define DRIVE_SPEED 0.5f    // m/s
+#define PATH_LENGTH 20.0f   // m
+#define PARTICLES 1000
+#define TELEMETRY_BYTES 2048
+#define DEADLINE_US 5000        // scan-to-command budget
+#define MONITOR_MS 250          // period of the CPU headroom samples
+#define REPORT_EVERY 4          // telemetry printed every this many samples
+#define RECORD_SECONDS 2.0f     // history the recorder keeps before a late command
+#define RECORD_POST 0.5f        // and after it
+#define RECORD_MAX_FILES 3
+
+/**
+ * @brief What localize hands to control.
+ * @var time_us when localize finished (us)
+ * @var pose the particle filter's estimate
+ * @var hitch_angle the latest valid hitch angle (rad)
+ * @var wheel_speed the wheel speed, as in semi_truck_data_t
+ */
+struct localized_pose {
+	uint64_t time_us;
+	pose_estimate pose;
+	float hitch_angle;
+	int16_t wheel_speed;
+};
+
+static particle_filter_config demo_filter_config(const sil_config &config)
+{
+	particle_filter_config pf;
+	pf.particles = PARTICLES;
+	pf.rot_per_rot = 0.05f;
+	pf.rot_per_trans = 0.05f;
+	pf.trans_per_trans = 0.2f;
+	pf.trans_per_rot = 0.01f;
+	pf.beam_stride = 10;
+	pf.beam_weight = 0.2f;
+	pf.sensor_x = config.lidar.mount_x;
+	pf.sensor_y = config.lidar.mount_y;
+	pf.sensor_yaw = config.lidar.mount_yaw;
+	pf.update_distance = 0.005f;
+	pf.update_angle = 0.005f;
+	pf.resample_ratio = 0.5f;
+	pf.grain = 128;
+	pf.seed = 1;
+	return pf;
+}
+
+static load_shedder_config demo_shed_config()
+{
+	load_shedder_config ls;
+	ls.deadline_us = DEADLINE_US;
+	ls.levels = 4;
+	shed_settings full = {10, PARTICLES, 1};
+	shed_settings thinner = {20, PARTICLES, 2};
+	shed_settings fewer = {20, PARTICLES / 2, 4};
+	shed_settings least = {40, PARTICLES / 4, 8};
+	ls.settings[0] = full;
+	ls.settings[1] = thinner;
+	ls.settings[2] = fewer;
+	ls.settings[3] = least;
+	ls.window_us = 500000;
+	ls.max_misses = 3;
+	ls.min_headroom = 0.1f;
+	ls.restore_headroom = 0.3f;
+	ls.restore_hold_us = 2000000;
+	return ls;
+}
+
+static recorder_config demo_recorder_config(const sil_config &config, const char *directory)
+{
+	float scan_rate = 1e6f / config.lidar.sweep_us;
+	recorder_config rc;
+	rc.seconds = RECORD_SECONDS;
+	rc.post_seconds = RECORD_POST;
+	rc.rates[RECORDER_SCANS] = scan_rate;
+	rc.rates[RECORDER_TELEMETRY] = 0.0f;
+	rc.rates[RECORDER_COMMANDS] = scan_rate;
+	rc.rates[RECORDER_CYCLES] = scan_rate;
+	rc.max_dumps = RECORD_MAX_FILES;
+	rc.directory = directory;
+	return rc;
+}
+
+static const char *reason_name(shed_reason reason)
+{
+	switch (reason) {
+	case SHED_DEADLINE_MISSES:
+		return "deadline misses";
+	case SHED_LOW_HEADROOM:
+		return "low headroom";
+	default:
+		return "restored";
+	}
+}
+
+int main(int argc, char **argv)
+{
+	float seconds = argc > 1 ? (float)atof(argv[1]) : 5.0f;
+	uint32_t slow_ms = argc > 2 ? (uint32_t)atoi(argv[2]) : 0;
+	pipe_policy policy = argc > 3 && strcmp(argv[3], "block") == 0 ? PIPE_BLOCK : PIPE_DROP_OLDEST;
+	float load_from = argc > 4 ? (float)atof(argv[4]) : 0.0f;
+	float load_to = argc > 5 ? (float)atof(argv[5]) : 0.0f;
+	const char *record_dir = argc > 6 ? argv[6] : NULL;
+
+	sil_config config = default_sil_config();
+	occupancy_grid map = make_yard_grid();
+	build_yard(map);
+	likelihood_config sensor;
+	sensor.sigma_hit = 0.1f;
+	sensor.z_hit = 0.9f;
+	sensor.z_rand = 0.1f;
+	sensor.max_range = config.lidar.range_max;
+	likelihood_field field(map, sensor);
+
+	// Straight along the bottom of the test loop
+	uint64_t start_us = host_time_us();
+	std::function<vehicle_state(uint64_t)> truth = [start_us](uint64_t now_us) {
+		vehicle_state s = {6.0f + DRIVE_SPEED * (now_us - start_us) * 1e-6f, 4.0f, 0.0f, 0.0f, 0.0f, DRIVE_SPEED};
+		return s;
+	};
+	sim_device_timing timing = {0, 0, 0.0f, 3000, 0};
+	sim_lidar_device device(config.lidar, config.hitch, &map, timing, truth);
+
+	hitch_estimator estimator(config.hitch);
+	work_pool pool;
+	particle_filter filter(field, demo_filter_config(config));
+	vehicle_state s0 = truth(start_us);
+	filter.init(s0.x, s0.y, s0.heading, 0.05f, 0.02f);
+	vehicle_state last_odometry = s0;
+
+	load_shedder shedder(demo_shed_config());
+	shedder.set_logger([start_us](const shed_event &e) {
+		printf("** %.2f s: level %u -> %u, %s (%u of %u commands late, %.0f%% idle)\n",
+		       (e.time_us - start_us) * 1e-6, e.from, e.to, reason_name(e.reason), e.misses, e.cycles,
+		       100.0f * e.headroom);
+	});
+
+	std::unique_ptr<flight_recorder> recorder;
+	if (record_dir)
+		recorder.reset(new flight_recorder(demo_recorder_config(config, record_dir)));
+
+	std::vector<path_point> path;
+	add_path_line(path, s0.x, s0.y, 0.0f, PATH_LENGTH);
+	control_loop controller(config.sim.vehicle.geometry, default_gains());
+	controller.set_path(&path[0], (uint16_t)path.size(), false, DRIVE_SPEED);
+
+	pipe_queue<lidar_scan> raw("raw", PIPE_DROP_OLDEST, 2);
+	pipe_queue<lidar_scan> masked("masked", policy, 2);
+	pipe_queue<localized_pose> poses("poses", PIPE_DROP_OLDEST, 2);
+	pipe_queue<semi_truck_data_t> commands("commands", PIPE_DROP_OLDEST, 4);
+
+	// The scan's origin is when it reached the Pi, so the latency is all the Pi's own
+	pipe_source<lidar_scan> acquire("acquire", &raw, [&device, &recorder](lidar_scan &out, uint64_t &origin) {
+		if (!device.read_scan(out))
+			return false;
+		origin = host_time_us();
+		if (recorder)
+			recorder->record_scan(out, origin);
+		return true;
+	});
+	pipe_stage<lidar_scan, lidar_scan> preprocess("preprocess", &raw, &masked,
+	                                              [&estimator](const lidar_scan &in, lidar_scan &out) {
+		out = in;
+		estimator.process(out);
+		return true;
+	});
+	pipe_stage<lidar_scan, localized_pose> localize("localize", &masked, &poses,
+	                                                [&](const lidar_scan &in, localized_pose &out) {
+		const shed_settings &quality = shedder.get_settings();
+		filter.set_particle_count(quality.particles);
+		filter.set_beam_stride(quality.beam_stride);
+		vehicle_state now = truth(host_time_us());
+		filter.predict(now.x - last_odometry.x, now.heading - last_odometry.heading);
+		last_odometry = now;
+		filter.update(in, &pool);
+		if (slow_ms)
+			std::this_thread::sleep_for(std::chrono::milliseconds(slow_ms));
+		hitch_estimate hitch = estimator.get_last_valid();
+		out.time_us = host_time_us();
+		out.pose = filter.get_estimate();
+		out.hitch_angle = hitch.valid ? hitch.angle : 0.0f;
+		out.wheel_speed = (int16_t)lroundf(now.speed * WHEEL_SPEED_PER_M_S);
+		return true;
+	});
+	pipe_stage<localized_pose, semi_truck_data_t> control("control", &poses, &commands,
+	                                                      [&controller](const localized_pose &in,
+	                                                                    semi_truck_data_t &out) {
+		control_input ci;
+		ci.time_us = in.time_us;
+		ci.x = in.pose.x;
+		ci.y = in.pose.y;
+		ci.heading = in.pose.heading;
+		ci.hitch_angle = in.hitch_angle;
+		ci.wheel_speed = in.wheel_speed;
+		out = semi_truck_data_t();
+		controller.update(ci, &out);
+		return true;
+	}, true);
+	semi_truck_data_t last_command = semi_truck_data_t();
+	pipe_sink<semi_truck_data_t> send("send", &commands, [&](const semi_truck_data_t &in, uint64_t origin) {
+		last_command = in;
+		uint64_t now = host_time_us();
+		uint32_t latency = (uint32_t)(now - origin);
+		shedder.report_cycle(now, latency);
+		if (recorder) {
+			recorder_cycle cycle = {latency, DEADLINE_US, shedder.get_level(), in.steer_output, in.motor_output};
+			recorder->record_command(in, now);
+			recorder->record_cycle(cycle, now);
+			if (latency > DEADLINE_US)
+				recorder->trigger(RECORDER_DEADLINE_MISS, now);
+		}
+	});
+
+	pipeline chain(&pool);
+	chain.add(&acquire);
+	chain.add(&preprocess);
+	chain.add(&localize);
+	chain.add(&control);
+	chain.add(&send);
+	if (recorder) {
+		// Each file ends with every stage's counters since the start
+		recorder->set_status_function([&chain](char *buffer, size_t size) {
+			std::vector<stage_stats> stats = chain.get_stats();
+			size_t length = 0;
+			for (size_t i = 0; i < stats.size() && length < size; i++) {
+				const stage_stats &s = stats[i];
+				length += snprintf(buffer + length, size - length, "%s: %u passed on, %u dropped, busy max %u us, "
+				                   "age max %u us\n", s.name, s.processed, s.dropped, s.max_busy_us, s.max_latency_us);
+			}
+			return length;
+		});
+		recorder->start();
+	}
+	if (!chain.start()) {
+		printf("the pipeline is not set up right\n");
+		return 1;
+	}
+
+	printf("%.1f s, scans every %u us, localize %u ms slower, %s in front of it, %u workers\n", seconds,
+	       config.lidar.sweep_us, slow_ms, policy == PIPE_BLOCK ? "blocking" : "dropping", pool.size());
+	// Two busy threads for every core, so the pipeline gets at most a third of the CPU
+	std::atomic<bool> loaded(false), finished(false);
+	std::vector<std::thread> load;
+	unsigned cores = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+	for (unsigned i = 0; load_to > load_from && i < 2 * cores; i++)
+		load.push_back(std::thread([&loaded, &finished] {
+			volatile uint64_t spin = 0;
+			while (!finished.load()) {
+				if (loaded.load())
+					spin++;
+				else
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}));
+
+	char telemetry[TELEMETRY_BYTES];
+	cpu_monitor cpu;
+	float headroom;
+	uint64_t end_us = start_us + (uint64_t)(seconds * 1e6f);
+	uint32_t samples = 0;
+	while (host_time_us() < end_us) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(MONITOR_MS));
+		uint64_t now = host_time_us();
+		float t = (now - start_us) * 1e-6f;
+		loaded.store(t >= load_from && t < load_to);
+		if (cpu.sample(headroom))
+			shedder.report_headroom(now, headroom);
+		if (++samples % REPORT_EVERY == 0) {
+			chain.write_telemetry(telemetry, sizeof(telemetry));
+			printf("-- %.0f s, level %u%s\n%s", t, shedder.get_level(), loaded.load() ? ", loaded" : "", telemetry);
+		}
+	}
+	chain.stop();
+	finished.store(true);
+	if (recorder)
+		recorder->stop();
+	for (size_t i = 0; i < load.size(); i++)
+		load[i].join();
+
+	std::vector<stage_stats> stats = chain.get_stats();
+	printf("\nmean time in each stage, waiting in front of it and working on it:\n");
+	uint64_t before = 0;
+	for (size_t i = 0; i < stats.size(); i++) {
+		const stage_stats &s = stats[i];
+		if (!s.processed)
+			continue;
+		uint64_t age = s.sum_latency_us / s.processed;
+		printf("  %-10s %6llu us (waiting %6llu, working %6llu)\n", s.name,
+		       (unsigned long long)(age > before ? age - before : 0),
+		       (unsigned long long)(s.sum_wait_us / s.processed), (unsigned long long)(s.sum_busy_us / s.processed));
+		before = age;
+	}
+	const stage_stats &last = stats.back();
+	printf("scan-to-command: %u commands from %u scans, mean %llu us, max %u us\n", last.processed,
+	       stats[0].processed, (unsigned long long)(last.processed ? last.sum_latency_us / last.processed : 0),
+	       last.max_latency_us);
+	printf("deadline %u us: %u of %u commands late; stepped down %u times for misses, %u for headroom, "
+	       "up %u times; ended at level %u\n", DEADLINE_US, shedder.get_misses(), shedder.get_cycles(),
+	       shedder.get_count(SHED_DEADLINE_MISSES), shedder.get_count(SHED_LOW_HEADROOM),
+	       shedder.get_count(SHED_RESTORED), shedder.get_level());
+	pose_estimate est = filter.get_estimate();
+	if (recorder) {
+		recorder_stats rs = recorder->get_stats();
+		printf("recorder: %u late commands, %u files written to %s, %u not written\n",
+		       rs.triggers[RECORDER_DEADLINE_MISS], rs.dumps, record_dir, rs.failed + rs.suppressed);
+	}
+	printf("last command: steer %d, motor %d; estimate (%.2f, %.2f) against true (%.2f, %.2f)\n",
+	       last_command.steer_output, last_command.motor_output, est.x, est.y, last_odometry.x, last_odometry.y);
+	return 0;
+}
@@ -0,0 +1,232 @@
+//
+// Times the hybrid_astar planner on a set of maneuvers in the dock yard: crossing the
+// yard, backing a trailer into a dock bay from near and far, pulling out of one, turning
+// round between two container rows and backing into the parking space along the fence.
+// The planner checks collisions against a costmap of the yard. Each maneuver is planned
+// several times; the bench prints how long building the heuristic and searching took,
+// how many states were expanded and what the path was like, then checks every pose of
+// the path against the map with the truck's true outline, without the margin, and
+// against the hitch limit.
+//
+// usage: plan_bench [runs] [weight]
+//   runs    times each maneuver is planned (default 5)
+//   weight  heuristic weight (default 2.5)
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "scenario.h"
+#include "yard_map.h"
+#include "../RaspberryPi/costmap.h"
+#include "../RaspberryPi/hybrid_astar.h"
+
+#define TIME_BUDGET_MS 200.0f   // longest a dock approach may take to plan
+#define DOCK_GAP 0.25f          // m left between a docked trailer and the dock face
+
+/**
+ * @brief A maneuver to plan.
+ * @var name what it is
+ * @var start where the truck starts
+ * @var goal where it should end up
+ * @var docking true if it ends at a dock bay, and so has to meet TIME_BUDGET_MS
+ */
+struct maneuver {
+	const char *name;
+	plan_pose start;
+	plan_pose goal;
+	bool docking;
+};
+
+static truck_footprint bench_footprint()
+{
+	truck_footprint footprint;
+	footprint.tractor_front = 0.45f;
+	footprint.tractor_rear = 0.10f;
+	footprint.tractor_width = 0.26f;
+	footprint.trailer_front = 0.15f;
+	footprint.trailer_rear = 0.95f;
+	footprint.trailer_width = 0.30f;
+	footprint.margin = 0.05f;
+	return footprint;
+}
+
+static hybrid_astar_config bench_config(float weight)
+{
+	hybrid_astar_config config;
+	config.xy_resolution = 0.1f;
+	config.heading_bins = 72;
+	config.hitch_resolution = 0.05f;
+	config.hitch_limit = 0.8f;
+	config.step_length = 0.25f;
+	config.steer_levels = 2;
+	config.sample_spacing = 0.05f;
+	config.reverse_cost = 1.5f;
+	config.switch_cost = 2.0f;
+	config.steer_cost = 0.2f;
+	config.steer_change_cost = 0.3f;
+	config.hitch_cost = 0.5f;
+	config.heuristic_resolution = 0.2f;
+	config.turning_window = 10.0f;
+	config.turning_resolution = 0.25f;
+	config.turning_hitch_resolution = 0.25f;
+	config.heuristic_weight = weight;
+	config.goal_distance = 0.1f;
+	config.goal_heading = 0.06f;
+	config.goal_hitch = 0.08f;
+	config.shot_length = 6.0f;
+	config.shot_lookahead = 0.6f;
+	config.shot_hitch_gain = 4.0f;
+	config.max_expansions = 200000;
+	return config;
+}
+
+static costmap_config bench_costmap_config()
+{
+	costmap_config config;
+	config.tile_size = 32;
+	config.inscribed_radius = 0.15f;
+	config.inflation_radius = 0.6f;
+	config.cost_scaling = 5.0f;
+	config.unknown_is_obstacle = true;
+	return config;
+}
+
+static plan_pose pose(float x, float y, float heading)
+{
+	plan_pose p = {x, y, heading, 0.0f, false};
+	return p;
+}
+
+/**
+ * The tractor pose with the trailer straight behind it in bay i, its rear DOCK_GAP from
+ * the dock face and the tractor facing away from the warehouse.
+ */
+static plan_pose docked(const truck_geometry &geometry, const truck_footprint &footprint, uint8_t bay)
+{
+	float kingpin = DOCK_FACE_Y - DOCK_GAP - footprint.trailer_rear;
+	return pose(DOCK_BAY_X + (bay + 0.5f) * DOCK_BAY_WIDTH, kingpin - geometry.hitch_offset, -(float)M_PI / 2.0f);
+}
+
+/**
+ * True if every part of the body's rectangle is on known free cells of the map.
+ */
+static bool body_is_free(const occupancy_grid &map, float x, float y, float heading, float front, float rear,
+                         float width)
+{
+	float step = 0.5f * map.get_resolution();
+	float c = cosf(heading), s = sinf(heading);
+	for (float along = -rear; along <= front + 1e-4f; along += step) {
+		for (float across = -0.5f * width; across <= 0.5f * width + 1e-4f; across += step) {
+			int32_t cx, cy;
+			if (!map.world_to_cell(x + along * c - across * s, y + along * s + across * c, cx, cy))
+				return false;
+			uint8_t value = map.get(cx, cy);
+			if (occupancy_grid::is_obstacle(value) || value == CELL_UNKNOWN)
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Checks a path pose by pose with the true outline of both bodies, and checks the hitch
+ * angle and that consecutive poses are no further apart than one sample.
+ * @return the number of poses that failed
+ */
+static uint32_t verify(const occupancy_grid &map, const truck_geometry &geometry, const truck_footprint &footprint,
+                       const hybrid_astar_config &config, const plan_result &result)
+{
+	uint32_t failed = 0;
+	for (size_t i = 0; i < result.poses.size(); i++) {
+		const plan_pose &p = result.poses[i];
+		float kx = p.x - geometry.hitch_offset * cosf(p.heading);
+		float ky = p.y - geometry.hitch_offset * sinf(p.heading);
+		bool ok = body_is_free(map, p.x, p.y, p.heading, footprint.tractor_front, footprint.tractor_rear,
+		                       footprint.tractor_width)
+		          && body_is_free(map, kx, ky, p.heading + p.hitch + (float)M_PI, footprint.trailer_rear,
+		                          -footprint.trailer_front, footprint.trailer_width)
+		          && fabsf(p.hitch) <= config.hitch_limit + 1e-4f;
+		if (i > 0)
+			ok = ok && hypotf(p.x - result.poses[i - 1].x, p.y - result.poses[i - 1].y) <= 1.5f * config.sample_spacing;
+		failed += !ok;
+	}
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t runs = argc > 1 ? (uint32_t)atoi(argv[1]) : 5;
+	float weight = argc > 2 ? (float)atof(argv[2]) : 2.5f;
+	if (runs < 1)
+		runs = 1;
+
+	truck_geometry geometry = default_sim_config().vehicle.geometry;
+	truck_footprint footprint = bench_footprint();
+	hybrid_astar_config config = bench_config(weight);
+	occupancy_grid map = make_dock_yard_grid();
+	build_dock_yard(map);
+
+	hybrid_astar planner(geometry, footprint, config);
+	costmap layer(map, bench_costmap_config());
+	if (!planner.set_costmap(layer)) {
+		printf("the costmap's inflation radius is too small for the footprint\n");
+		return 1;
+	}
+	printf("primitives %u of %u in %.1f ms, table %.1f MB; costmap %.1f ms\n",
+	       planner.get_primitive_count(),
+	       (unsigned)(2 * (2 * config.steer_levels + 1) * (2 * lroundf(config.hitch_limit / config.hitch_resolution) + 1)),
+	       planner.get_build_us() / 1000.0f, planner.get_table_bytes() / 1048576.0f, layer.get_update_us() / 1000.0f);
+
+	float half_pi = (float)M_PI / 2.0f;
+	std::vector<maneuver> maneuvers;
+	maneuver m;
+	m = {"cross yard", pose(3.0f, 3.0f, 0.0f), pose(46.0f, 25.0f, half_pi), false};
+	maneuvers.push_back(m);
+	m = {"dock from apron", pose(16.0f, 38.0f, 0.0f), docked(geometry, footprint, 2), true};
+	maneuvers.push_back(m);
+	m = {"dock from gate", pose(3.0f, 3.0f, 0.0f), docked(geometry, footprint, 4), true};
+	maneuvers.push_back(m);
+	m = {"dock between rows", pose(24.0f, 25.0f, (float)M_PI), docked(geometry, footprint, 0), true};
+	maneuvers.push_back(m);
+	m = {"pull out of dock", docked(geometry, footprint, 3), pose(30.0f, 37.0f, 0.0f), false};
+	maneuvers.push_back(m);
+	m = {"turn round in aisle", pose(12.0f, 13.0f, 0.0f), pose(12.0f, 13.0f, (float)M_PI), false};
+	maneuvers.push_back(m);
+	m = {"back into parking", pose(4.0f, 6.0f, half_pi),
+	     pose(PARKING_X, PARKING_Y0 + DOCK_GAP + footprint.trailer_rear - geometry.hitch_offset, half_pi), false};
+	maneuvers.push_back(m);
+
+	printf("%-20s %5s %8s %8s %8s %8s %7s %5s %6s %5s\n", "maneuver", "found", "heur ms", "search ms",
+	       "max ms", "expanded", "len m", "turns", "hitch", "bad");
+	bool all_found = true, in_budget = true;
+	for (size_t i = 0; i < maneuvers.size(); i++) {
+		const maneuver &man = maneuvers[i];
+		plan_result result;
+		double sum_heuristic = 0.0, sum_search = 0.0, worst = 0.0;
+		for (uint32_t r = 0; r < runs; r++) {
+			planner.plan(man.start, man.goal, result);
+			sum_heuristic += result.heuristic_us / 1000.0;
+			sum_search += result.search_us / 1000.0;
+			double total = (result.heuristic_us + result.search_us) / 1000.0;
+			if (total > worst)
+				worst = total;
+		}
+
+		float max_hitch = 0.0f;
+		for (size_t j = 0; j < result.poses.size(); j++)
+			if (fabsf(result.poses[j].hitch) > max_hitch)
+				max_hitch = fabsf(result.poses[j].hitch);
+		uint32_t bad = result.found ? verify(map, geometry, footprint, config, result) : 0;
+		uint32_t turns = result.segments.empty() ? 0 : (uint32_t)result.segments.size() - 1;
+		printf("%-20s %5s %8.2f %8.2f %8.2f %8u %7.2f %5u %6.2f %5u\n", man.name, result.found ? "yes" : "no",
+		       sum_heuristic / runs, sum_search / runs, worst, result.expanded, result.length, turns, max_hitch, bad);
+		all_found = all_found && result.found && bad == 0;
+		if (man.docking && worst > TIME_BUDGET_MS)
+			in_budget = false;
+	}
+	printf("%s; dock approaches %s the %.0f ms budget\n", all_found ? "all paths found and clear" : "FAILED",
+	       in_budget ? "within" : "OVER", TIME_BUDGET_MS);
+	return all_found && in_budget ? 0 : 1;
+}
@@ -0,0 +1,298 @@
+//
+// Runs the flight_recorder with writers at the Pi's real rates, one thread each as on
+// the truck: scans every LiDAR sweep, the ATMega's reports, and a command with its cycle
+// timing for every scan. Partway through, the operator presses the button and the brake
+// latches just after, which must make one file; later a command misses its deadline,
+// which makes a second; then a failsafe, which max_dumps must stop from being written.
+// Every file is read back and checked: the right triggers, history from before the
+// trigger and after it, times in order, and no scan torn by the freeze. Then the cost of
+// recording on this machine is timed.
+//
+// usage: recorder_bench [directory]
+//   directory  where the files are written (default /tmp)
+//
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../RaspberryPi/flight_recorder.h"
+#include "../RaspberryPi/host_clock.h"
+
+#define SCAN_PERIOD_US 28000        // the UBG-04LX's sweep
+#define TELEMETRY_PERIOD_US 10000   // the ATMega's reports
+#define DEADLINE_US 5000            // scan-to-command budget
+#define HISTORY 1.0f                // s kept before a trigger
+#define POST 0.25f                  // s kept after it
+#define OPERATOR_AT 1.5f            // s into the run
+#define BRAKE_AT 1.55f
+#define MISS_AT 2.6f
+#define FAILSAFE_AT 3.6f
+#define RUN_TIME 4.2f
+#define TIME_SLACK_US 20000         // how far the history may fall short of HISTORY and POST
+#define TIMED_RECORDS 20000
+
+static recorder_config bench_recorder_config(const char *directory)
+{
+	recorder_config rc;
+	rc.seconds = HISTORY;
+	rc.post_seconds = POST;
+	rc.rates[RECORDER_SCANS] = 1e6f / SCAN_PERIOD_US;
+	rc.rates[RECORDER_TELEMETRY] = 1e6f / TELEMETRY_PERIOD_US;
+	rc.rates[RECORDER_COMMANDS] = 1e6f / SCAN_PERIOD_US;
+	rc.rates[RECORDER_CYCLES] = 1e6f / SCAN_PERIOD_US;
+	rc.max_dumps = 2;
+	rc.directory = directory;
+	return rc;
+}
+
+/**
+ * @brief Fills a scan so that a torn copy shows: every ray holds the sequence number.
+ */
+static void fill_scan(lidar_scan &scan, uint32_t seq, uint64_t now)
+{
+	scan.time_us = now;
+	scan.sweep_us = SCAN_PERIOD_US;
+	scan.angle_min = -2.09f;
+	scan.angle_increment = 0.00614f;
+	scan.range_min = 0.02f;
+	scan.range_max = 5.6f;
+	scan.count = LIDAR_MAX_POINTS;
+	for (uint16_t i = 0; i < LIDAR_MAX_POINTS; i++) {
+		scan.ranges[i] = (float)seq;
+		scan.flags[i] = (uint8_t)seq;
+	}
+}
+
+/**
+ * @brief Calls work every period_us until stop is set, on the host clock.
+ */
+template <class Work>
+static void every(uint32_t period_us, const std::atomic<bool> &stop, Work work)
+{
+	uint64_t next = host_time_us();
+	for (uint32_t seq = 0; !stop.load(); seq++) {
+		work(seq, host_time_us());
+		next += period_us;
+		uint64_t now = host_time_us();
+		if (next > now)
+			std::this_thread::sleep_for(std::chrono::microseconds(next - now));
+	}
+}
+
+/**
+ * @brief Waits until the recorder has dealt with a number of incidents, written or not.
+ */
+static void wait_incidents(const flight_recorder &recorder, uint16_t incidents)
+{
+	for (;;) {
+		recorder_stats st = recorder.get_stats();
+		if (st.dumps + st.failed + st.suppressed >= incidents)
+			return;
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+}
+
+/**
+ * @brief Reads one ring of a file and checks its times are in order and span the incident.
+ * @return false, with the reason printed, if the ring is not right
+ */
+template <class T, class Check>
+static bool check_ring(FILE *file, const recorder_file_header &header, recorder_ring ring, const char *name,
+                       Check check)
+{
+	uint64_t first = 0, last = 0;
+	for (uint32_t i = 0; i < header.counts[ring]; i++) {
+		uint64_t time_us;
+		T item;
+		if (fread(&time_us, sizeof(time_us), 1, file) != 1 || fread(&item, sizeof(item), 1, file) != 1) {
+			printf("  %s: file ends early\n", name);
+			return false;
+		}
+		if (i && time_us <= last) {
+			printf("  %s: record %u out of order\n", name, i);
+			return false;
+		}
+		if (!check(item)) {
+			printf("  %s: record %u is torn\n", name, i);
+			return false;
+		}
+		if (!i)
+			first = time_us;
+		last = time_us;
+	}
+	float before = header.trigger_us > first ? (header.trigger_us - first) * 1e-6f : 0.0f;
+	float after = last > header.trigger_us ? (last - header.trigger_us) * 1e-6f : 0.0f;
+	printf("  %-9s %4u records, %5.2f s before the trigger, %4.2f s after\n", name, header.counts[ring], before,
+	       after);
+	if (header.item_sizes[ring] != sizeof(T) || before < HISTORY - TIME_SLACK_US * 1e-6f
+	    || after < POST - TIME_SLACK_US * 1e-6f) {
+		printf("  %s: does not cover the incident\n", name);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Reads a file back and checks it.
+ * @return false if it is not what the incident should have left
+ */
+static bool check_file(const char *path, recorder_trigger reason, uint8_t triggers)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		printf("  cannot open %s\n", path);
+		return false;
+	}
+	recorder_file_header header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == RECORDER_MAGIC
+	          && header.version == RECORDER_VERSION;
+	if (ok) {
+		printf("%s: reason %u, triggers 0x%x, frozen %.2f s after the trigger\n", path, header.reason,
+		       header.triggers, (header.frozen_us - header.trigger_us) * 1e-6f);
+		ok = header.reason == reason && header.triggers == triggers;
+	}
+	ok = ok && check_ring<lidar_scan>(file, header, RECORDER_SCANS, "scans", [](const lidar_scan &s) {
+		for (uint16_t i = 1; i < s.count; i++)
+			if (s.ranges[i] != s.ranges[0] || s.flags[i] != s.flags[0])
+				return false;
+		return s.count == LIDAR_MAX_POINTS && s.flags[0] == (uint8_t)s.ranges[0];
+	});
+	ok = ok && check_ring<semi_truck_data_t>(file, header, RECORDER_TELEMETRY, "telemetry",
+	                                         [](const semi_truck_data_t &d) {
+		return d.speed_setpoint == (int16_t)(d.wheel_speed + 1);
+	});
+	ok = ok && check_ring<semi_truck_data_t>(file, header, RECORDER_COMMANDS, "commands",
+	                                         [](const semi_truck_data_t &d) {
+		return d.motor_output == (int16_t)-d.steer_output;
+	});
+	ok = ok && check_ring<recorder_cycle>(file, header, RECORDER_CYCLES, "cycles", [](const recorder_cycle &c) {
+		return c.deadline_us == DEADLINE_US && c.motor_output == (int16_t)-c.steer_output;
+	});
+	if (ok && header.status_size) {
+		ok = header.status_size <= RECORDER_STATUS_SIZE;
+		std::vector<char> status(ok ? header.status_size : 0);
+		ok = ok && fread(status.data(), 1, status.size(), file) == status.size();
+		if (ok) {
+			printf("  status: ");
+			fwrite(status.data(), 1, status.size(), stdout);
+		}
+	}
+	fclose(file);
+	if (!ok)
+		printf("  FAILED\n");
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	const char *directory = argc > 1 ? argv[1] : "/tmp";
+	recorder_config rc = bench_recorder_config(directory);
+	flight_recorder recorder(rc);
+	std::atomic<uint32_t> scans_sent(0), commands_sent(0);
+	recorder.set_status_function([&](char *buffer, size_t size) {
+		return (size_t)snprintf(buffer, size, "%u scans, %u commands since the start\n", scans_sent.load(),
+		                        commands_sent.load());
+	});
+	recorder.start();
+	printf("rings of %u scans, %u reports, %u commands and %u cycles; %.1f MB\n",
+	       recorder.get_ring(RECORDER_SCANS).get_capacity(), recorder.get_ring(RECORDER_TELEMETRY).get_capacity(),
+	       recorder.get_ring(RECORDER_COMMANDS).get_capacity(), recorder.get_ring(RECORDER_CYCLES).get_capacity(),
+	       recorder.get_ring(RECORDER_SCANS).get_capacity() * (sizeof(lidar_scan) + 8) / 1048576.0f);
+
+	uint64_t start_us = host_time_us();
+	uint64_t miss_us = start_us + (uint64_t)(MISS_AT * 1e6f);
+	std::atomic<bool> stop(false);
+	lidar_scan *scan = new lidar_scan;
+	std::thread lidar([&] {
+		every(SCAN_PERIOD_US, stop, [&](uint32_t seq, uint64_t now) {
+			fill_scan(*scan, seq, now);
+			recorder.record_scan(*scan, now);
+			scans_sent++;
+		});
+	});
+	std::thread comm([&] {
+		every(TELEMETRY_PERIOD_US, stop, [&](uint32_t seq, uint64_t now) {
+			semi_truck_data_t report = semi_truck_data_t();
+			report.wheel_speed = (int16_t)seq;
+			report.speed_setpoint = (int16_t)(seq + 1);
+			recorder.record_telemetry(report, now);
+		});
+	});
+	std::thread control([&] {
+		bool missed = false;
+		every(SCAN_PERIOD_US, stop, [&](uint32_t seq, uint64_t now) {
+			semi_truck_data_t command = semi_truck_data_t();
+			command.steer_output = (int16_t)seq;
+			command.motor_output = (int16_t)-command.steer_output;
+			recorder_cycle cycle;
+			cycle.latency_us = DEADLINE_US / 2;
+			cycle.deadline_us = DEADLINE_US;
+			cycle.shed_level = 0;
+			cycle.steer_output = command.steer_output;
+			cycle.motor_output = command.motor_output;
+			if (!missed && now >= miss_us) {
+				cycle.latency_us = 2 * DEADLINE_US;
+				missed = true;
+			}
+			recorder.record_command(command, now);
+			recorder.record_cycle(cycle, now);
+			if (cycle.latency_us > cycle.deadline_us)
+				recorder.trigger(RECORDER_DEADLINE_MISS, now);
+			commands_sent++;
+		});
+	});
+
+	bool ok = true;
+	auto at = [start_us](float t) {
+		int64_t wait = (int64_t)(start_us + (uint64_t)(t * 1e6f)) - (int64_t)host_time_us();
+		if (wait > 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(wait));
+	};
+	at(OPERATOR_AT);
+	ok = recorder.trigger(RECORDER_OPERATOR, host_time_us()) && ok;
+	at(BRAKE_AT);
+	ok = !recorder.trigger(RECORDER_EMERGENCY_BRAKE, host_time_us()) && ok;
+	wait_incidents(recorder, 1);
+	std::string first = recorder.get_last_path();
+	wait_incidents(recorder, 2);
+	std::string second = recorder.get_last_path();
+	at(FAILSAFE_AT);
+	ok = recorder.trigger(RECORDER_FAILSAFE, host_time_us()) && ok;
+	wait_incidents(recorder, 3);
+	at(RUN_TIME);
+	stop.store(true);
+	lidar.join();
+	comm.join();
+	control.join();
+	recorder.stop();
+
+	ok = check_file(first.c_str(), RECORDER_OPERATOR, (1 << RECORDER_OPERATOR) | (1 << RECORDER_EMERGENCY_BRAKE))
+	     && ok;
+	ok = first != second && check_file(second.c_str(), RECORDER_DEADLINE_MISS, 1 << RECORDER_DEADLINE_MISS) && ok;
+	recorder_stats st = recorder.get_stats();
+	printf("%u files, %u failed, %u suppressed, last took %u us; skipped while frozen: %u scans, %u reports\n",
+	       st.dumps, st.failed, st.suppressed, st.last_dump_us, recorder.get_ring(RECORDER_SCANS).get_skipped(),
+	       recorder.get_ring(RECORDER_TELEMETRY).get_skipped());
+	ok = ok && st.dumps == 2 && st.failed == 0 && st.suppressed == 1;
+
+	// The writers' cost, with nothing else running
+	uint64_t t0 = host_time_us();
+	for (uint32_t i = 0; i < TIMED_RECORDS; i++)
+		recorder.record_scan(*scan, t0 + i);
+	uint64_t t1 = host_time_us();
+	recorder_cycle cycle = {0, DEADLINE_US, 0, 0, 0};
+	for (uint32_t i = 0; i < TIMED_RECORDS; i++)
+		recorder.record_cycle(cycle, t1 + i);
+	uint64_t t2 = host_time_us();
+	printf("record a scan %.0f ns, a cycle %.0f ns\n", (t1 - t0) * 1e3 / TIMED_RECORDS,
+	       (t2 - t1) * 1e3 / TIMED_RECORDS);
+	delete scan;
+
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
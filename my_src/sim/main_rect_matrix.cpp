@@ -0,0 +1,158 @@
+//
+// Checks imu::RectMatrix against imu::Matrix for the 5 to 9 state sizes the estimators
+// use, on random symmetric positive definite matrices like a covariance: the LU
+// determinant() and invert() must agree with imu::Matrix's expansion by minors, the
+// Cholesky factor must multiply back to the matrix and solve the same system, and
+// sandwich() and subtract_sandwich() must match the plain products and be exactly
+// symmetric. Then the determinant and inverse are timed both ways on this machine.
+//
+// usage: rect_matrix_bench [seconds per timing]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "../rect_matrix.h"
+
+#define TOLERANCE 1e-9              // largest error allowed, relative to the largest value
+#define MEASUREMENTS 3              // rows of the measurement model in the sandwich checks
+
+static std::mt19937 rng(1);
+static volatile double sink;        // keeps the timed results from being optimized away
+
+/// Fills a matrix with values in -1 to 1
+template <uint8_t R, uint8_t C>
+static void randomize(imu::RectMatrix<R, C> &m)
+{
+	std::uniform_real_distribution<double> value(-1.0, 1.0);
+	for (uint8_t i = 0; i < R; i++)
+		for (uint8_t j = 0; j < C; j++)
+			m(i, j) = value(rng);
+}
+
+/// A random covariance: A A^T plus the identity, so it is well conditioned
+template <uint8_t N>
+static imu::RectMatrix<N, N> random_covariance()
+{
+	imu::RectMatrix<N, N> a;
+	randomize(a);
+	return a * a.transpose() + imu::RectMatrix<N, N>::identity();
+}
+
+template <uint8_t R, uint8_t C>
+static double largest(const imu::RectMatrix<R, C> &m)
+{
+	double worst = 0;
+	for (uint8_t i = 0; i < R; i++)
+		for (uint8_t j = 0; j < C; j++)
+			worst = std::max(worst, fabs(m(i, j)));
+	return worst;
+}
+
+template <uint8_t R, uint8_t C>
+static double largest_difference(const imu::RectMatrix<R, C> &a, const imu::RectMatrix<R, C> &b)
+{
+	return largest(a - b) / std::max(largest(a), 1.0);
+}
+
+template <uint8_t N>
+static bool exactly_symmetric(const imu::RectMatrix<N, N> &m)
+{
+	for (uint8_t i = 0; i < N; i++)
+		for (uint8_t j = i + 1; j < N; j++)
+			if (m(i, j) != m(j, i))
+				return false;
+	return true;
+}
+
+/// Seconds per call of f, calling it for about the given time in total
+template <class F>
+static double time_per_call(F f, double seconds)
+{
+	typedef std::chrono::steady_clock clock;
+	uint32_t calls = 0;
+	clock::time_point start = clock::now();
+	double elapsed = 0;
+	do {
+		f();
+		calls++;
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	} while (elapsed < seconds);
+	return elapsed / calls;
+}
+
+template <uint8_t N>
+static bool check_size(double seconds)
+{
+	bool ok = true;
+	imu::RectMatrix<N, N> p = random_covariance<N>();
+	imu::Matrix<N> old = p.to_matrix();
+
+	// determinant() and invert() against imu::Matrix
+	double det_error = fabs(p.determinant() - old.determinant()) / fabs(old.determinant());
+	imu::RectMatrix<N, N> inverse;
+	bool inverted = p.invert(inverse);
+	double inverse_error = largest_difference(imu::RectMatrix<N, N>(old.invert()), inverse);
+	double residual = largest_difference(imu::RectMatrix<N, N>::identity(), p * inverse);
+
+	// Cholesky: L L^T gives the matrix back and solves the same system as the inverse
+	imu::RectMatrix<N, N> l = p;
+	bool factored = cholesky_decompose(l);
+	double cholesky_error = largest_difference(p, l * l.transpose());
+	imu::RectMatrix<N, N> solved = imu::RectMatrix<N, N>::identity();
+	cholesky_solve(l, solved);
+	double solve_error = largest_difference(inverse, solved);
+
+	// sandwich() and subtract_sandwich() against the plain products
+	imu::RectMatrix<MEASUREMENTS, N> h;
+	randomize(h);
+	imu::RectMatrix<MEASUREMENTS, MEASUREMENTS> hph;
+	sandwich(h, p, hph);
+	double sandwich_error = largest_difference(h * p * h.transpose(), hph);
+	imu::RectMatrix<N, MEASUREMENTS> k;
+	randomize(k);
+	imu::RectMatrix<MEASUREMENTS, MEASUREMENTS> s = random_covariance<MEASUREMENTS>();
+	imu::RectMatrix<N, N> updated = p;
+	subtract_sandwich(updated, k, s);
+	double subtract_error = largest_difference(p - k * s * k.transpose(), updated);
+	bool symmetric = exactly_symmetric(hph) && exactly_symmetric(updated);
+
+	double worst = std::max(std::max(std::max(det_error, inverse_error), std::max(residual, cholesky_error)),
+	                        std::max(solve_error, std::max(sandwich_error, subtract_error)));
+	if (!inverted || !factored || !symmetric || worst > TOLERANCE) {
+		printf("  FAILED at %u states: det %.1e, inverse %.1e, residual %.1e, cholesky %.1e, "
+		       "solve %.1e, sandwich %.1e, subtract %.1e%s%s%s\n", N, det_error, inverse_error, residual,
+		       cholesky_error, solve_error, sandwich_error, subtract_error, inverted ? "" : ", not inverted",
+		       factored ? "" : ", not factored", symmetric ? "" : ", not symmetric");
+		ok = false;
+	}
+
+	double old_det = time_per_call([&]() { sink = old.determinant(); }, seconds);
+	double new_det = time_per_call([&]() { sink = p.determinant(); }, seconds);
+	double old_inv = time_per_call([&]() { sink = old.invert()(0, 0); }, seconds);
+	double new_inv = time_per_call([&]() { p.invert(inverse); sink = inverse(0, 0); }, seconds);
+	double chol = time_per_call([&]() { l = p; cholesky_decompose(l); sink = l(0, 0); }, seconds);
+	printf("%6u  %9.2f  %9.3f  %7.0fx  %9.2f  %9.3f  %7.0fx  %8.3f  %.1e\n", N,
+	       old_det * 1e6, new_det * 1e6, old_det / new_det, old_inv * 1e6, new_inv * 1e6,
+	       old_inv / new_inv, chol * 1e6, worst);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 0.1;
+
+	printf("                 determinant (us)             invert (us)         cholesky\n");
+	printf("states     Matrix  RectMatrix  speedup     Matrix  RectMatrix  speedup      (us)  error\n");
+	bool ok = check_size<5>(seconds);
+	ok = check_size<6>(seconds) && ok;
+	ok = check_size<7>(seconds) && ok;
+	ok = check_size<8>(seconds) && ok;
+	ok = check_size<9>(seconds) && ok;
+
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
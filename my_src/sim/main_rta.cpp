@@ -0,0 +1,176 @@
+//
+// Checks that the ATMega's tasks always meet their deadlines, and suggests priorities
+// under which they do. The task set is measured in the software-in-the-loop simulation:
+// the virtual_rtos profiles every firmware task while the truck drives, giving each
+// task's priority, the shortest time between its releases, and how long a release and
+// its critical sections run on this machine, which are scaled up to the ATMega by the
+// slowdown factor. A file of tasks timed on the truck itself replaces the simulated ones
+// of the same name. The task set used is printed in the file's form, so it can be saved,
+// edited and given back.
+//
+// Every task is analyzed at the priority it really gets, then at the suggested ones. The
+// deadline of each task is its period, so it must finish a release before the next.
+//
+// usage: rta_check [seconds] [slowdown] [tasks_file]
+//   seconds     simulated driving the tasks are profiled over (default 10)
+//   slowdown    how many times longer the ATMega takes to run the task code (default 100)
+//   tasks_file  tasks timed on the truck, in the form schedulability.h gives (default none)
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "schedulability.h"
+#include "sil_harness.h"
+
+#define MEGA_MAX_PRIORITIES 4   // configMAX_PRIORITIES in FreeRTOSConfig.h
+#define MEGA_TICK_US 1000       // configTICK_RATE_HZ of 1000
+#define MEGA_TICK_COST_US 15    // tick interrupt on a 16 MHz ATMega64, roughly
+#define MEGA_SWITCH_US 20       // context switch, saving and restoring 32 registers, roughly
+#define DRIVE_SPEED 0.5f        // m/s
+
+/// Tasks in the simulation that run on the Pi, not the ATMega
+static const char *const pi_tasks[] = {"pi_comm"};
+
+static rta_settings mega_settings()
+{
+	rta_settings settings;
+	settings.max_priorities = MEGA_MAX_PRIORITIES;
+	settings.tick_us = MEGA_TICK_US;
+	settings.tick_cost_us = MEGA_TICK_COST_US;
+	settings.switch_us = MEGA_SWITCH_US;
+	return settings;
+}
+
+static bool is_pi_task(const char *name)
+{
+	for (size_t i = 0; i < sizeof(pi_tasks) / sizeof(pi_tasks[0]); i++)
+		if (strcmp(name, pi_tasks[i]) == 0)
+			return true;
+	return false;
+}
+
+/**
+ * @brief Profiles the firmware tasks over a drive in the software-in-the-loop simulation.
+ * @param seconds Simulated time to drive for (s)
+ * @param slowdown How many times longer the ATMega takes than this machine
+ * @param tasks Filled with the tasks
+ * @return the number of tasks
+ */
+static uint8_t simulate_tasks(float seconds, float slowdown, rta_task *tasks)
+{
+	vehicle_state start = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+	sil_harness sil(default_sil_config(), default_gains(), start);
+	std::vector<path_point> path;
+	path_point origin = {0.0f, 0.0f};
+	path.push_back(origin);
+	add_path_line(path, 0.0f, 0.0f, 0.0f, DRIVE_SPEED * seconds + 1.0f);
+	sil.set_path(&path[0], (uint16_t)path.size(), false, DRIVE_SPEED);
+	sil.run(seconds);
+
+	std::vector<task_profile> profiles = sil.get_rtos().get_profiles();
+	uint8_t count = 0;
+	for (size_t i = 0; i < profiles.size() && count < RTA_MAX_TASKS; i++) {
+		const task_profile &p = profiles[i];
+		if (is_pi_task(p.name))
+			continue;
+		if (p.releases < 2) {
+			printf("%s was released %u times; left out\n", p.name, p.releases);
+			continue;
+		}
+		rta_task &t = tasks[count++];
+		strncpy(t.name, p.name, sizeof(t.name) - 1);
+		t.name[sizeof(t.name) - 1] = '\0';
+		t.period_us = (uint32_t)p.min_interval_us;
+		t.wcet_us = (uint32_t)ceilf(p.max_run_ns * slowdown * 1e-3f);
+		t.critical_us = (uint32_t)ceilf(p.max_critical_ns * slowdown * 1e-3f);
+		t.deadline_us = 0;
+		t.priority = p.priority;
+	}
+	return count;
+}
+
+/**
+ * @brief Replaces or adds the tasks read from a file.
+ * @return the new number of tasks, or 0 if the file cannot be read
+ */
+static uint8_t merge_tasks(const char *path, rta_task *tasks, uint8_t count)
+{
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		printf("cannot open %s\n", path);
+		return 0;
+	}
+	rta_task measured[RTA_MAX_TASKS];
+	uint8_t n = read_rta_tasks(file, measured, RTA_MAX_TASKS);
+	fclose(file);
+	for (uint8_t m = 0; m < n; m++) {
+		uint8_t i = 0;
+		while (i < count && strcmp(tasks[i].name, measured[m].name) != 0)
+			i++;
+		if (i < count)
+			tasks[i] = measured[m];
+		else if (count < RTA_MAX_TASKS)
+			tasks[count++] = measured[m];
+	}
+	printf("%u tasks from %s\n", n, path);
+	return count;
+}
+
+static bool print_analysis(const char *title, const rta_task *tasks, uint8_t count, const uint8_t *priorities,
+                           const rta_settings &settings)
+{
+	rta_result results[RTA_MAX_TASKS];
+	bool ok = analyze_response_times(tasks, count, priorities, settings, results);
+	printf("\n%s:\n", title);
+	printf("  %-14s %5s %4s %8s %8s %8s %8s %8s\n", "task", "given", "runs", "period", "wcet", "blocking",
+	       "response", "deadline");
+	double utilization = 0.0;
+	for (uint8_t i = 0; i < count; i++) {
+		const rta_task &t = tasks[i];
+		const rta_result &r = results[i];
+		utilization += (double)t.wcet_us / t.period_us;
+		printf("  %-14s %5u %4u %6luus %6luus %6luus %6luus %6luus%s\n", t.name,
+		       priorities ? priorities[i] : t.priority, r.priority, (unsigned long)t.period_us,
+		       (unsigned long)t.wcet_us, (unsigned long)r.blocking_us, (unsigned long)r.response_us,
+		       (unsigned long)(t.deadline_us ? t.deadline_us : t.period_us), r.schedulable ? "" : "  MISSES");
+	}
+	printf("  CPU %.0f%% busy; %s\n", 100.0 * utilization,
+	       ok ? "every deadline is met" : "deadlines can be missed");
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	float seconds = argc > 1 ? (float)atof(argv[1]) : 10.0f;
+	float slowdown = argc > 2 ? (float)atof(argv[2]) : 100.0f;
+	const char *file = argc > 3 ? argv[3] : NULL;
+	rta_settings settings = mega_settings();
+
+	rta_task tasks[RTA_MAX_TASKS];
+	uint8_t count = simulate_tasks(seconds, slowdown, tasks);
+	printf("%u tasks profiled over %.0f s of driving, %.0f times slower on the ATMega\n", count, seconds, slowdown);
+	if (file && !(count = merge_tasks(file, tasks, count)))
+		return 1;
+	printf("\n");
+	write_rta_tasks(stdout, tasks, count);
+
+	bool clamped = false;
+	for (uint8_t i = 0; i < count; i++)
+		clamped = clamped || effective_priority(tasks[i].priority, settings) != tasks[i].priority;
+	if (clamped)
+		printf("\npriorities of %u and up all run at %u, as configMAX_PRIORITIES is %u\n", MEGA_MAX_PRIORITIES,
+		       MEGA_MAX_PRIORITIES - 1, MEGA_MAX_PRIORITIES);
+	print_analysis("as given", tasks, count, NULL, settings);
+
+	uint8_t priorities[RTA_MAX_TASKS];
+	bool feasible = assign_priorities(tasks, count, settings, priorities);
+	if (feasible)
+		print_analysis("suggested", tasks, count, priorities, settings);
+	else
+		printf("\nno priorities meet every deadline; the tasks must be made shorter or less frequent\n");
+	printf("%s\n", feasible ? "ok" : "FAILED");
+	return feasible ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+//
+// Drives the truck around an oval for a given time with the full software-in-the-loop
+// simulation and prints how the run went.
+//
+// usage: sil_drive [minutes] [speed] [baud] [loss] [seed]
+//   minutes  length of the drive (default 10)
+//   speed    target speed in m/s (default 0.5)
+//   baud     serial link speed (default 9600)
+//   loss     chance of losing any one byte on the link (default 0)
+//   seed     seed for the link, LiDAR and position noise (default 1)
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "sil_harness.h"
+
+#define OVAL_STRAIGHT 4.0f  // m
+#define OVAL_RADIUS 1.5f    // m
+#define MAX_PATH_POINTS 65000
+
+int main(int argc, char **argv)
+{
+	float minutes = argc > 1 ? (float)atof(argv[1]) : 10.0f;
+	float speed = argc > 2 ? (float)atof(argv[2]) : 0.5f;
+	uint32_t baud = argc > 3 ? (uint32_t)atol(argv[3]) : 9600;
+	float loss = argc > 4 ? (float)atof(argv[4]) : 0.0f;
+	uint32_t seed = argc > 5 ? (uint32_t)atol(argv[5]) : 1;
+
+	sil_config config = default_sil_config();
+	config.link.baud = baud;
+	config.link.loss_rate = loss;
+	config.link.seed = seed;
+	config.lidar.seed = seed + 1;
+	config.seed = seed + 2;
+
+	// Enough laps of the oval to last the drive at the target speed
+	float lap = 2.0f * OVAL_STRAIGHT + 2.0f * (float)M_PI * OVAL_RADIUS;
+	uint32_t laps = (uint32_t)ceilf(minutes * 60.0f * speed / lap);
+	std::vector<path_point> path;
+	path_point origin = {0.0f, 0.0f};
+	path.push_back(origin);
+	for (uint32_t i = 0; i < laps && path.size() < MAX_PATH_POINTS; i++) {
+		add_path_line(path, 0.0f, 0.0f, 0.0f, OVAL_STRAIGHT);
+		add_path_arc(path, OVAL_STRAIGHT, 0.0f, 0.0f, OVAL_RADIUS, (float)M_PI);
+		add_path_line(path, OVAL_STRAIGHT, 2.0f * OVAL_RADIUS, (float)M_PI, OVAL_STRAIGHT);
+		add_path_arc(path, 0.0f, 2.0f * OVAL_RADIUS, (float)M_PI, OVAL_RADIUS, (float)M_PI);
+	}
+	if (path.size() > MAX_PATH_POINTS)
+		path.resize(MAX_PATH_POINTS);
+
+	vehicle_state start = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+	sil_harness sil(config, default_gains(), start);
+	sil.set_path(&path[0], (uint16_t)path.size(), false, speed);
+
+	printf("%u laps of a %.1f m oval at %.2f m/s, %u baud, %.3f byte loss\n",
+	       laps, lap, speed, baud, loss);
+	sil.run(minutes * 60.0f * 1.5f);
+	sil.print_report(stdout);
+	return 0;
+}
@@ -0,0 +1,267 @@
+//
+// Replays IMU, wheel speed and LiDAR measurements into a state_buffer at the rates and
+// latencies they reach the Pi with, so that every LiDAR pose and most wheel speeds
+// arrive after newer IMU samples have been fused. For each LiDAR latency and
+// re-propagation bound it reports how many measurements were late or dropped, the
+// re-propagation steps they cost, and the time spent fusing on this machine. With the
+// bound wide enough that nothing is dropped, the buffer's final estimate must match a
+// filter run over the same measurements in time order.
+//
+// usage: state_buffer_bench [seconds]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../RaspberryPi/state_buffer.h"
+
+#define IMU_PERIOD_US 10000         // the BNO055's fused output at 100 Hz
+#define IMU_LATENCY_US 2000         // I2C read and the ATMega's report
+#define WHEEL_PERIOD_US 20000
+#define WHEEL_LATENCY_US 15000      // averaged over a period on the ATMega, then the serial line
+#define LIDAR_PERIOD_US 28000       // the UBG-04LX's sweep
+#define LIDAR_LATENCY_US 40000      // from the middle of the sweep to the matched pose
+#define JITTER 0.25f                // each latency varies by this fraction either way
+#define BUFFER_CAPACITY 64
+#define MATCH_TOLERANCE 1e-4f
+
+#define STATE_X 0
+#define STATE_Y 1
+#define STATE_HEADING 2
+#define STATE_SPEED 3
+#define STATE_YAW_RATE 4
+#define STATE_SIZE 5
+
+enum bench_sensor { SENSOR_IMU, SENSOR_WHEEL, SENSOR_LIDAR };
+
+/**
+ * @brief A constant speed and yaw rate Kalman filter over the truck's planar pose, the
+ * size of the Pi's estimator, fusing each sensor as scalar updates of the states it sees.
+ */
+struct bench_filter {
+	struct state_t {
+		float x[STATE_SIZE];
+		float p[STATE_SIZE][STATE_SIZE];
+	};
+
+	struct measurement_t {
+		uint8_t sensor;
+		float z[3];
+	};
+
+	void predict(state_t &s, uint64_t dt_us)
+	{
+		float dt = dt_us * 1e-6f;
+		float c = cosf(s.x[STATE_HEADING]);
+		float n = sinf(s.x[STATE_HEADING]);
+		s.x[STATE_X] += s.x[STATE_SPEED] * c * dt;
+		s.x[STATE_Y] += s.x[STATE_SPEED] * n * dt;
+		s.x[STATE_HEADING] += s.x[STATE_YAW_RATE] * dt;
+
+		// P = F P F^T + Q, F being the identity but for the rows of x, y and heading
+		float f[STATE_SIZE][STATE_SIZE] = {};
+		for (int i = 0; i < STATE_SIZE; i++)
+			f[i][i] = 1.0f;
+		f[STATE_X][STATE_HEADING] = -s.x[STATE_SPEED] * n * dt;
+		f[STATE_X][STATE_SPEED] = c * dt;
+		f[STATE_Y][STATE_HEADING] = s.x[STATE_SPEED] * c * dt;
+		f[STATE_Y][STATE_SPEED] = n * dt;
+		f[STATE_HEADING][STATE_YAW_RATE] = dt;
+
+		float fp[STATE_SIZE][STATE_SIZE];
+		for (int i = 0; i < STATE_SIZE; i++)
+			for (int j = 0; j < STATE_SIZE; j++) {
+				float sum = 0.0f;
+				for (int k = 0; k < STATE_SIZE; k++)
+					sum += f[i][k] * s.p[k][j];
+				fp[i][j] = sum;
+			}
+		for (int i = 0; i < STATE_SIZE; i++)
+			for (int j = 0; j < STATE_SIZE; j++) {
+				float sum = 0.0f;
+				for (int k = 0; k < STATE_SIZE; k++)
+					sum += fp[i][k] * f[j][k];
+				s.p[i][j] = sum;
+			}
+		s.p[STATE_SPEED][STATE_SPEED] += 0.5f * dt;
+		s.p[STATE_YAW_RATE][STATE_YAW_RATE] += 0.2f * dt;
+	}
+
+	void update(state_t &s, const measurement_t &meas)
+	{
+		if (meas.sensor == SENSOR_IMU) {
+			update_one(s, STATE_YAW_RATE, meas.z[0], 1e-4f);
+		} else if (meas.sensor == SENSOR_WHEEL) {
+			update_one(s, STATE_SPEED, meas.z[0], 4e-3f);
+		} else {
+			update_one(s, STATE_X, meas.z[0], 1e-3f);
+			update_one(s, STATE_Y, meas.z[1], 1e-3f);
+			update_one(s, STATE_HEADING, meas.z[2], 4e-4f);
+		}
+	}
+
+	static void update_one(state_t &s, int index, float z, float variance)
+	{
+		float gain[STATE_SIZE];
+		float innovation = z - s.x[index];
+		float denominator = s.p[index][index] + variance;
+		for (int i = 0; i < STATE_SIZE; i++)
+			gain[i] = s.p[i][index] / denominator;
+		for (int i = 0; i < STATE_SIZE; i++)
+			s.x[i] += gain[i] * innovation;
+		float row[STATE_SIZE];
+		for (int j = 0; j < STATE_SIZE; j++)
+			row[j] = s.p[index][j];
+		for (int i = 0; i < STATE_SIZE; i++)
+			for (int j = 0; j < STATE_SIZE; j++)
+				s.p[i][j] -= gain[i] * row[j];
+	}
+};
+
+typedef state_buffer<bench_filter, BUFFER_CAPACITY> bench_buffer;
+
+/// A measurement, when it was taken and when it reaches the Pi
+struct bench_event {
+	uint64_t taken_us;
+	uint64_t arrives_us;
+	uint32_t order;             // position in the stream, to keep equal times in order
+	bench_filter::measurement_t meas;
+};
+
+static bool by_arrival(const bench_event &a, const bench_event &b)
+{
+	return a.arrives_us != b.arrives_us ? a.arrives_us < b.arrives_us : a.order < b.order;
+}
+
+/// Where the truck is at a time: a slow circle at 2 m/s
+static void true_pose(uint64_t t_us, float *x, float *y, float *heading)
+{
+	float t = t_us * 1e-6f;
+	*heading = 0.1f * t;
+	*x = 20.0f * sinf(*heading);
+	*y = 20.0f * (1.0f - cosf(*heading));
+}
+
+static void add_stream(std::vector<bench_event> &events, bench_sensor sensor, uint64_t period_us,
+                       uint64_t latency_us, uint64_t end_us, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<float> jitter(1.0f - JITTER, 1.0f + JITTER);
+	std::normal_distribution<float> noise(0.0f, 0.01f);
+	for (uint64_t t = period_us; t < end_us; t += period_us) {
+		bench_event e;
+		e.taken_us = t;
+		e.arrives_us = t + (uint64_t)(latency_us * jitter(rng));
+		e.meas.sensor = (uint8_t)sensor;
+		float x, y, heading;
+		true_pose(t, &x, &y, &heading);
+		if (sensor == SENSOR_IMU) {
+			e.meas.z[0] = 0.1f + noise(rng);
+		} else if (sensor == SENSOR_WHEEL) {
+			e.meas.z[0] = 2.0f + noise(rng);
+		} else {
+			e.meas.z[0] = x + noise(rng);
+			e.meas.z[1] = y + noise(rng);
+			e.meas.z[2] = heading + noise(rng);
+		}
+		events.push_back(e);
+	}
+}
+
+static bench_filter::state_t initial_state()
+{
+	bench_filter::state_t s = bench_filter::state_t();
+	for (int i = 0; i < STATE_SIZE; i++)
+		s.p[i][i] = 1.0f;
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	float seconds = argc > 1 ? (float)atof(argv[1]) : 60.0f;
+	uint64_t end_us = (uint64_t)(seconds * 1e6f);
+
+	struct bench_case {
+		float lidar_scale;      // LiDAR latency in units of LIDAR_LATENCY_US
+		uint16_t max_replay;
+		bool must_match;
+	};
+	const bench_case cases[] = {
+		{1.0f, BUFFER_CAPACITY, true},
+		{2.0f, BUFFER_CAPACITY, true},
+		{4.0f, BUFFER_CAPACITY, true},
+		{1.0f, 16, true},
+		{2.0f, 16, false},
+	};
+
+	bench_filter filter;
+	bool ok = true;
+	printf("%.0f s of IMU at %d Hz, wheel at %d Hz and LiDAR at %.1f Hz, buffer of %d\n",
+	       seconds, 1000000 / IMU_PERIOD_US, 1000000 / WHEEL_PERIOD_US,
+	       1e6 / LIDAR_PERIOD_US, BUFFER_CAPACITY);
+	printf("lidar ms  bound  fused   late  dropped  steps/late  max  us/meas  us/step  match\n");
+
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		std::mt19937 rng(1);
+		std::vector<bench_event> events;
+		add_stream(events, SENSOR_IMU, IMU_PERIOD_US, IMU_LATENCY_US, end_us, rng);
+		add_stream(events, SENSOR_WHEEL, WHEEL_PERIOD_US, WHEEL_LATENCY_US, end_us, rng);
+		add_stream(events, SENSOR_LIDAR, LIDAR_PERIOD_US,
+		           (uint64_t)(LIDAR_LATENCY_US * cases[c].lidar_scale), end_us, rng);
+		for (size_t i = 0; i < events.size(); i++)
+			events[i].order = (uint32_t)i;
+
+		std::vector<bench_event> in_time(events);
+		std::sort(events.begin(), events.end(), by_arrival);
+
+		bench_buffer buffer(&filter, cases[c].max_replay);
+		buffer.reset(initial_state(), 0);
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		uint32_t fused = 0;
+		for (size_t i = 0; i < events.size(); i++)
+			fused += buffer.insert(events[i].meas, events[i].taken_us);
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		double total_us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+
+		// The reference sees every measurement in the order it was taken; the buffer keeps
+		// measurements taken at the same time in the order they arrived, and so does it
+		std::sort(in_time.begin(), in_time.end(), [](const bench_event &a, const bench_event &b) {
+			return a.taken_us != b.taken_us ? a.taken_us < b.taken_us : by_arrival(a, b);
+		});
+		bench_filter::state_t reference = initial_state();
+		uint64_t last_us = 0;
+		for (size_t i = 0; i < in_time.size(); i++) {
+			filter.predict(reference, in_time[i].taken_us - last_us);
+			filter.update(reference, in_time[i].meas);
+			last_us = in_time[i].taken_us;
+		}
+		float worst = 0.0f;
+		for (int i = 0; i < STATE_SIZE; i++)
+			worst = std::max(worst, fabsf(reference.x[i] - buffer.latest_state().x[i]));
+
+		uint32_t late = buffer.get_late_count();
+		uint32_t steps = buffer.get_replayed_steps();
+		bool matched = worst <= MATCH_TOLERANCE;
+		printf("%8.0f  %5u  %5u  %5u  %7u  %10.1f  %3u  %7.2f  %7.3f  %s\n",
+		       LIDAR_LATENCY_US * cases[c].lidar_scale / 1000.0f, cases[c].max_replay, fused, late,
+		       buffer.get_dropped_count(), late ? (double)steps / late : 0.0,
+		       buffer.get_max_replay_seen(), total_us / events.size(), total_us / (fused + steps),
+		       matched ? "yes" : "no");
+
+		if (buffer.get_max_replay_seen() > cases[c].max_replay) {
+			printf("  FAILED: re-propagated %u steps for one measurement, bound %u\n",
+			       buffer.get_max_replay_seen(), cases[c].max_replay);
+			ok = false;
+		}
+		if (cases[c].must_match && (buffer.get_dropped_count() != 0 || !matched)) {
+			printf("  FAILED: %u dropped, %.2e from the in-order estimate\n", buffer.get_dropped_count(), worst);
+			ok = false;
+		}
+	}
+
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
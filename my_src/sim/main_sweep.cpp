@@ -0,0 +1,52 @@
+//
+// Runs a controller tuning sweep on the host and prints the best gain sets.
+//
+// usage: scenario_sweep [threads] [samples] [seed]
+//   threads  worker threads, 0 for one per core (default 0)
+//   samples  Monte Carlo gain sets to draw, 0 for a grid sweep (default 0)
+//   seed     seed for the gains, starting conditions and noise (default 1)
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include "scenario_sweep.h"
+
+int main(int argc, char **argv)
+{
+	unsigned threads = argc > 1 ? (unsigned)atoi(argv[1]) : 0;
+	uint32_t samples = argc > 2 ? (uint32_t)atoi(argv[2]) : 0;
+	uint32_t seed = argc > 3 ? (uint32_t)atoi(argv[3]) : 1;
+
+	static const scenario_kind kinds[] = {
+		SCENARIO_LANE_CHANGE, SCENARIO_FORWARD_CURVE, SCENARIO_REVERSE_STRAIGHT, SCENARIO_REVERSE_CURVE
+	};
+	sweep_conditions conditions;
+	conditions.kinds = kinds;
+	conditions.kind_count = sizeof(kinds) / sizeof(kinds[0]);
+	conditions.repeats = 8;
+	conditions.speed = 0.5f;
+	conditions.max_offset = 0.2f;
+	conditions.max_heading = 0.15f;
+	conditions.max_hitch = 0.15f;
+	conditions.position_noise = 0.01f;
+	conditions.hitch_noise = 0.01f;
+
+	scenario_sweep sweep(default_sim_config(), default_gains(), conditions);
+	sweep_axis lookahead = {"lookahead", &control_gains::lookahead, 0.3f, 1.2f, 7};
+	sweep_axis reverse_lookahead = {"rev_look", &control_gains::reverse_lookahead, 0.5f, 2.0f, 7};
+	sweep_axis hitch_gain = {"hitch_gain", &control_gains::hitch_gain, 1.0f, 10.0f, 7};
+	sweep.add_axis(lookahead);
+	sweep.add_axis(reverse_lookahead);
+	sweep.add_axis(hitch_gain);
+
+	work_pool pool(threads);
+	printf("%u worker threads\n", pool.size());
+	if (samples)
+		sweep.run_monte_carlo(pool, samples, seed);
+	else
+		sweep.run_grid(pool, seed);
+
+	sweep.print_summary(stdout, 20);
+	printf("%llu tasks stolen\n", (unsigned long long)pool.get_steal_count());
+	return 0;
+}
@@ -0,0 +1,68 @@
+//
+// Timing model of the ATMega firmware; see mega_model.h.
+//
+
+#include <cstring>
+#include "mega_model.h"
+
+#define BITS_PER_BYTE 10    // 8N1 framing: start bit, 8 data bits, stop bit
+
+mega_model::mega_model(const mega_model_config &config_in)
+{
+	config = config_in;
+	memset(&mega_data, 0, sizeof(mega_data));
+	memset(&pi_view, 0, sizeof(pi_view));
+	memset(&command_in_flight, 0, sizeof(command_in_flight));
+	memset(&telemetry_in_flight, 0, sizeof(telemetry_in_flight));
+	command_arrival_us = 0;
+	command_pending = false;
+	telemetry_arrival_us = 0;
+	telemetry_pending = false;
+	next_tick_us = 0;
+}
+
+void mega_model::send_command(const semi_truck_data_t &command, uint64_t now_us)
+{
+	// A newer command overwrites one still in flight, like the Mega's receive buffer
+	// being read only once per period
+	command_in_flight = command;
+	command_arrival_us = now_us + transfer_us(config.command_bytes);
+	command_pending = true;
+}
+
+void mega_model::step(uint64_t now_us, const vehicle_model &plant)
+{
+	while (next_tick_us <= now_us) {
+		// read_from_pi(): only a command that has fully arrived is seen
+		if (command_pending && command_arrival_us <= next_tick_us) {
+			mega_data.motor_output = command_in_flight.motor_output;
+			mega_data.steer_output = command_in_flight.steer_output;
+			mega_data.desired_gear = command_in_flight.desired_gear;
+			mega_data.desired_5th = command_in_flight.desired_5th;
+			command_pending = false;
+		}
+
+		// The sensor tasks have refreshed the shared data since the last period
+		mega_data.wheel_speed = plant.measure_wheel_speed();
+		mega_data.imu_angle = plant.measure_imu_angle();
+		mega_data.actual_gear = mega_data.desired_gear;
+		mega_data.actual_5th = mega_data.desired_5th;
+
+		// write_to_pi()
+		telemetry_in_flight = mega_data;
+		telemetry_arrival_us = next_tick_us + transfer_us(config.telemetry_bytes);
+		telemetry_pending = true;
+
+		next_tick_us += config.comm_period_us;
+	}
+
+	if (telemetry_pending && telemetry_arrival_us <= now_us) {
+		pi_view = telemetry_in_flight;
+		telemetry_pending = false;
+	}
+}
+
+uint32_t mega_model::transfer_us(uint8_t bytes) const
+{
+	return (uint32_t)((uint64_t)bytes * BITS_PER_BYTE * 1000000UL / config.baud);
+}
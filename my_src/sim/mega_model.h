@@ -0,0 +1,83 @@
+/**
+ * The mega_model stands in for the ATMega firmware in closed-loop simulations. It keeps
+ * the timing that matters to the controller: the mega_comm_task only exchanges data
+ * with the Raspberry Pi once per period, bytes take time to cross the serial link, the
+ * actuators hold the last command they were given, and the Pi only ever sees the
+ * quantized wheel_speed and imu_angle that the Mega reported.
+ */
+
+#ifndef ME507_MEGA_MODEL_H
+#define ME507_MEGA_MODEL_H
+
+#include <cstdint>
+#include "../semi_truck_data_t.h"
+#include "vehicle_model.h"
+
+/**
+ * @brief Timing of the simulated ATMega and serial link.
+ * @var comm_period_us period of the mega_comm_task loop (us)
+ * @var baud serial link speed (bits per second)
+ * @var command_bytes bytes the Pi sends for each command
+ * @var telemetry_bytes bytes the Mega sends back each period
+ */
+struct mega_model_config {
+	uint32_t comm_period_us;
+	uint32_t baud;
+	uint8_t  command_bytes;
+	uint8_t  telemetry_bytes;
+};
+
+class mega_model {
+public:
+	/**
+	 * @brief The constructor for a mega_model with no command received yet.
+	 * @param config_in The timing of the Mega and its link to the Pi
+	 */
+	mega_model(const mega_model_config &config_in);
+
+	/**
+	 * @brief Sends a command from the Pi; it arrives after the serial transfer time.
+	 * @param command The data sent by the Pi (motor_output, steer_output, gear, 5th wheel)
+	 * @param now_us The time the Pi sends it (us)
+	 */
+	void send_command(const semi_truck_data_t &command, uint64_t now_us);
+
+	/**
+	 * @brief Runs every Mega communication period up to now_us.
+	 * @param now_us The current simulated time (us)
+	 * @param plant The truck, read for the Mega's sensor values
+	 */
+	void step(uint64_t now_us, const vehicle_model &plant);
+
+	/**
+	 * @brief Gets the data the Pi has received from the Mega by now.
+	 * @return the latest telemetry that has finished crossing the link
+	 */
+	const semi_truck_data_t &get_telemetry() const { return pi_view; }
+
+	/**
+	 * @brief Gets what the Mega is currently driving its actuators with.
+	 * @return the Mega's own copy of the shared task data
+	 */
+	const semi_truck_data_t &get_actuators() const { return mega_data; }
+
+private:
+	mega_model_config config;
+	semi_truck_data_t mega_data;     // the Mega's semi_truck_data_t
+	semi_truck_data_t pi_view;       // what the Pi has received
+
+	semi_truck_data_t command_in_flight;
+	uint64_t command_arrival_us;
+	bool command_pending;
+
+	semi_truck_data_t telemetry_in_flight;
+	uint64_t telemetry_arrival_us;
+	bool telemetry_pending;
+
+	uint64_t next_tick_us;
+
+	uint32_t transfer_us(uint8_t bytes) const;
+};
+
+
+#endif //ME507_MEGA_MODEL_H
@@ -0,0 +1,218 @@
+//
+// Closed-loop scenario runs; see scenario.h.
+//
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include "scenario.h"
+
+#define PATH_SPACING 0.05f    // m between path points
+
+sim_config default_sim_config()
+{
+	sim_config config;
+	config.vehicle.geometry.wheelbase = 0.32f;
+	config.vehicle.geometry.hitch_offset = 0.03f;
+	config.vehicle.geometry.trailer_length = 0.75f;
+	config.vehicle.geometry.max_steer = 0.55f;
+	config.vehicle.geometry.max_hitch = 1.0f;
+	config.vehicle.steer_gain = 1.0f;
+	config.vehicle.steer_tau = 0.08f;
+	config.vehicle.steer_rate_max = 5.0f;
+	config.vehicle.motor_tau = 0.30f;
+	config.vehicle.top_speed = 3.0f;
+	config.vehicle.brake_decel = 4.0f;
+	config.vehicle.speed_resolution = 0.02f;
+
+	config.mega.comm_period_us = 10000;     // mega_comm_task delays 10 ms per loop
+	config.mega.baud = 9600;
+	config.mega.command_bytes = 6;
+	config.mega.telemetry_bytes = 6;
+
+	config.plant_dt = 0.001f;
+	config.control_period_us = 20000;
+	config.time_limit = 60.0f;
+	config.settle_band = 0.05f;
+	return config;
+}
+
+control_gains default_gains()
+{
+	control_gains gains;
+	gains.lookahead = 0.6f;
+	gains.reverse_lookahead = 0.9f;
+	gains.hitch_gain = 4.0f;
+	gains.speed_kp = 300.0f;
+	gains.speed_ki = 200.0f;
+	gains.speed_ff = 333.0f;
+	return gains;
+}
+
+void add_path_line(std::vector<path_point> &path, float x0, float y0, float heading, float length)
+{
+	uint16_t n = (uint16_t)(length / PATH_SPACING);
+	for (uint16_t i = 1; i <= n; i++) {
+		path_point p = {x0 + i * PATH_SPACING * cosf(heading), y0 + i * PATH_SPACING * sinf(heading)};
+		path.push_back(p);
+	}
+}
+
+void add_path_arc(std::vector<path_point> &path, float x0, float y0, float heading, float radius, float sweep)
+{
+	// Positive radius turns left, negative turns right
+	float cx = x0 - radius * sinf(heading);
+	float cy = y0 + radius * cosf(heading);
+	uint16_t n = (uint16_t)(fabsf(radius * sweep) / PATH_SPACING);
+	for (uint16_t i = 1; i <= n; i++) {
+		float a = heading + (radius > 0.0f ? 1.0f : -1.0f) * sweep * i / n;
+		path_point p = {cx + radius * sinf(a), cy - radius * cosf(a)};
+		path.push_back(p);
+	}
+}
+
+/**
+ * Builds the path for a maneuver. Forward paths are for the tractor's rear axle and
+ * start at the origin heading along x. Reverse paths are for the trailer axle and start
+ * where the trailer axle of a straight truck at the origin would be, heading along -x.
+ */
+static void build_path(scenario_kind kind, const truck_geometry &g, std::vector<path_point> &path)
+{
+	path.clear();
+	float start = -(g.hitch_offset + g.trailer_length);
+
+	switch (kind) {
+	case SCENARIO_LANE_CHANGE: {
+		path_point origin = {0.0f, 0.0f};
+		path.push_back(origin);
+		add_path_line(path, 0.0f, 0.0f, 0.0f, 2.0f);
+		// Half-cosine move of one 0.5 m lane over 3 m
+		uint16_t n = (uint16_t)(3.0f / PATH_SPACING);
+		for (uint16_t i = 1; i <= n; i++) {
+			float s = (float)i / n;
+			path_point p = {2.0f + 3.0f * s, 0.25f * (1.0f - cosf((float)M_PI * s))};
+			path.push_back(p);
+		}
+		add_path_line(path, 5.0f, 0.5f, 0.0f, 4.0f);
+		break;
+	}
+	case SCENARIO_FORWARD_CURVE: {
+		path_point origin = {0.0f, 0.0f};
+		path.push_back(origin);
+		add_path_line(path, 0.0f, 0.0f, 0.0f, 1.5f);
+		add_path_arc(path, 1.5f, 0.0f, 0.0f, 2.0f, (float)M_PI / 2);
+		add_path_line(path, 3.5f, 2.0f, (float)M_PI / 2, 2.0f);
+		break;
+	}
+	case SCENARIO_REVERSE_STRAIGHT: {
+		path_point origin = {start, 0.0f};
+		path.push_back(origin);
+		add_path_line(path, start, 0.0f, (float)M_PI, 6.0f);
+		break;
+	}
+	case SCENARIO_REVERSE_CURVE: {
+		path_point origin = {start, 0.0f};
+		path.push_back(origin);
+		add_path_line(path, start, 0.0f, (float)M_PI, 1.0f);
+		add_path_arc(path, start - 1.0f, 0.0f, (float)M_PI, -2.5f, (float)M_PI / 2);
+		add_path_line(path, start - 3.5f, 2.5f, (float)M_PI / 2, 2.0f);
+		break;
+	}
+	}
+}
+
+run_metrics run_scenario(const scenario &sc, const sim_config &config)
+{
+	return run_scenario(sc, config, NULL);
+}
+
+run_metrics run_scenario(const scenario &sc, const sim_config &config, mpc_steering *mpc)
+{
+	const truck_geometry &g = config.vehicle.geometry;
+	bool reverse = (sc.kind == SCENARIO_REVERSE_STRAIGHT || sc.kind == SCENARIO_REVERSE_CURVE);
+
+	std::vector<path_point> path;
+	build_path(sc.kind, g, path);
+
+	vehicle_model plant(config.vehicle);
+	vehicle_state start = {0.0f, sc.initial_offset, sc.initial_heading, sc.initial_hitch, 0.0f, 0.0f};
+	plant.reset(start);
+
+	mega_model mega(config.mega);
+	control_loop controller(g, sc.gains);
+	controller.set_mpc(mpc);
+	controller.set_path(&path[0], (uint16_t)path.size(), reverse, sc.speed);
+
+	std::mt19937 rng(sc.seed);
+	std::normal_distribution<float> position_noise(0.0f, sc.position_noise > 0.0f ? sc.position_noise : 1e-9f);
+	std::normal_distribution<float> hitch_noise(0.0f, sc.hitch_noise > 0.0f ? sc.hitch_noise : 1e-9f);
+
+	run_metrics m;
+	m.rms_error = 0.0f;
+	m.max_error = 0.0f;
+	m.settling_time = 0.0f;
+	m.jackknife_events = 0;
+	m.max_hitch = 0.0f;
+	m.completed = false;
+	m.duration = 0.0f;
+
+	uint64_t plant_step_us = (uint64_t)(config.plant_dt * 1e6f + 0.5f);
+	uint64_t limit_us = (uint64_t)(config.time_limit * 1e6f);
+	uint64_t next_control_us = 0;
+	double sum_sq = 0.0;
+	uint32_t samples = 0;
+	semi_truck_data_t command = semi_truck_data_t();
+	command.desired_gear = 1;
+	command.desired_5th = true;
+
+	uint64_t now = 0;
+	for (; now < limit_us; now += plant_step_us) {
+		mega.step(now, plant);
+
+		if (now >= next_control_us) {
+			next_control_us += config.control_period_us;
+			const vehicle_state &s = plant.get_state();
+			const semi_truck_data_t &telemetry = mega.get_telemetry();
+
+			control_input in;
+			in.time_us = now;
+			in.x = s.x + position_noise(rng);
+			in.y = s.y + position_noise(rng);
+			in.heading = control_loop::imu_angle_to_heading(telemetry.imu_angle);
+			in.hitch_angle = s.hitch + hitch_noise(rng);
+			in.wheel_speed = telemetry.wheel_speed;
+
+			controller.update(in, &command);
+			mega.send_command(command, now);
+
+			if (controller.is_finished()) {
+				m.completed = true;
+				break;
+			}
+
+			float e = fabsf(controller.get_cross_track_error());
+			sum_sq += (double)e * e;
+			samples++;
+			if (e > m.max_error)
+				m.max_error = e;
+			if (e > config.settle_band)
+				m.settling_time = now * 1e-6f;
+		}
+
+		const semi_truck_data_t &act = mega.get_actuators();
+		plant.step(config.plant_dt, act.steer_output, act.motor_output);
+
+		float hitch = fabsf(plant.get_state().hitch);
+		if (hitch > m.max_hitch)
+			m.max_hitch = hitch;
+		if (hitch > g.max_hitch) {
+			// A jackknifed truck cannot recover on its own, so the run ends here
+			m.jackknife_events++;
+			break;
+		}
+	}
+
+	m.duration = now * 1e-6f;
+	m.rms_error = samples ? (float)sqrt(sum_sq / samples) : 0.0f;
+	return m;
+}
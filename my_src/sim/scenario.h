@@ -0,0 +1,144 @@
+/**
+ * A scenario is one closed-loop drive in simulation: the Pi's control_loop drives the
+ * vehicle_model through the mega_model, at the rates they run at on the truck, along a
+ * standard maneuver. run_scenario() returns the metrics used to compare controller
+ * gains: how closely the path was tracked, how long it took to settle onto it, and
+ * whether the trailer jackknifed.
+ */
+
+#ifndef ME507_SCENARIO_H
+#define ME507_SCENARIO_H
+
+#include <cstdint>
+#include <vector>
+#include "vehicle_model.h"
+#include "mega_model.h"
+#include "../RaspberryPi/control_loop.h"
+#include "../RaspberryPi/mpc_steering.h"
+
+/// The standard maneuvers a scenario can drive
+enum scenario_kind {
+	SCENARIO_LANE_CHANGE,       ///< drive forwards and move over one lane
+	SCENARIO_FORWARD_CURVE,     ///< drive forwards around a quarter circle
+	SCENARIO_REVERSE_STRAIGHT,  ///< back the trailer down a straight line
+	SCENARIO_REVERSE_CURVE      ///< back the trailer around a quarter circle
+};
+
+/**
+ * @brief Everything needed to run one closed-loop simulation.
+ * @var kind which maneuver to drive
+ * @var gains the control loop gains under test
+ * @var speed target speed (m/s)
+ * @var initial_offset starting sideways offset from the path (m)
+ * @var initial_heading starting heading error (rad)
+ * @var initial_hitch starting hitch angle (rad)
+ * @var position_noise standard deviation of the pose fed to the controller (m)
+ * @var hitch_noise standard deviation of the hitch angle fed to the controller (rad)
+ * @var seed seed for the noise, so every run can be reproduced
+ */
+struct scenario {
+	scenario_kind kind;
+	control_gains gains;
+	float speed;
+	float initial_offset;
+	float initial_heading;
+	float initial_hitch;
+	float position_noise;
+	float hitch_noise;
+	uint32_t seed;
+};
+
+/**
+ * @brief Settings shared by every scenario in a batch.
+ * @var vehicle the simulated truck
+ * @var mega the simulated ATMega timing
+ * @var plant_dt plant integration step (s)
+ * @var control_period_us period of the Pi control loop (us)
+ * @var time_limit longest a run may take before it is stopped (s)
+ * @var settle_band cross-track error that counts as settled (m)
+ */
+struct sim_config {
+	vehicle_params vehicle;
+	mega_model_config mega;
+	float plant_dt;
+	uint32_t control_period_us;
+	float time_limit;
+	float settle_band;
+};
+
+/**
+ * @brief The outcome of one closed-loop run.
+ * @var rms_error RMS cross-track error over the run (m)
+ * @var max_error largest cross-track error (m)
+ * @var settling_time time after which the error stays inside settle_band (s)
+ * @var jackknife_events number of times the hitch angle went past max_hitch
+ * @var max_hitch largest hitch angle seen (rad)
+ * @var completed true if the end of the path was reached within the time limit
+ * @var duration simulated time of the run (s)
+ */
+struct run_metrics {
+	float rms_error;
+	float max_error;
+	float settling_time;
+	uint16_t jackknife_events;
+	float max_hitch;
+	bool completed;
+	float duration;
+};
+
+/**
+ * @brief Fills in a sim_config with the truck's nominal parameters.
+ * @return the default configuration
+ */
+sim_config default_sim_config();
+
+/**
+ * @brief Fills in a set of gains that drives the nominal truck reasonably.
+ * @return the default gains
+ */
+control_gains default_gains();
+
+/**
+ * @brief Appends a straight line to a path, in steps of the standard path spacing.
+ * @param path The path; the start point itself is not added
+ * @param x0 x of the start (m)
+ * @param y0 y of the start (m)
+ * @param heading Direction of the line (rad)
+ * @param length Length of the line (m)
+ */
+void add_path_line(std::vector<path_point> &path, float x0, float y0, float heading, float length);
+
+/**
+ * @brief Appends a circular arc to a path, in steps of the standard path spacing.
+ * @param path The path; the start point itself is not added
+ * @param x0 x of the start (m)
+ * @param y0 y of the start (m)
+ * @param heading Direction of travel at the start (rad)
+ * @param radius Radius of the arc; positive turns left, negative turns right (m)
+ * @param sweep Angle turned through (rad, positive)
+ */
+void add_path_arc(std::vector<path_point> &path, float x0, float y0, float heading, float radius, float sweep);
+
+/**
+ * @brief Runs one scenario to completion.
+ * Deterministic: the same scenario and config always give the same metrics. Safe to
+ * call from many threads at once.
+ * @param sc The scenario to run
+ * @param config The simulation settings
+ * @return the metrics of the run
+ */
+run_metrics run_scenario(const scenario &sc, const sim_config &config);
+
+/**
+ * @brief Runs one scenario to completion with the control_loop steering by an MPC.
+ * The MPC is reset for the run, but its counters are kept, so the solve times and
+ * iterations of several runs can be gathered in one.
+ * @param sc The scenario to run; its gains still set the speed loop
+ * @param config The simulation settings
+ * @param mpc The MPC to steer with, or NULL for pure pursuit
+ * @return the metrics of the run
+ */
+run_metrics run_scenario(const scenario &sc, const sim_config &config, mpc_steering *mpc);
+
+
+#endif //ME507_SCENARIO_H
@@ -0,0 +1,157 @@
+//
+// Parallel controller tuning sweeps; see scenario_sweep.h.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include "scenario_sweep.h"
+
+#define RUNS_PER_TASK 4     // runs handed to a worker at a time
+
+scenario_sweep::scenario_sweep(const sim_config &config_in, const control_gains &base_in,
+                               const sweep_conditions &conditions_in)
+{
+	config = config_in;
+	base = base_in;
+	conditions = conditions_in;
+	run_count = 0;
+	wall_time = 0.0;
+}
+
+void scenario_sweep::add_axis(const sweep_axis &axis)
+{
+	axes.push_back(axis);
+}
+
+void scenario_sweep::run_grid(work_pool &pool, uint32_t seed)
+{
+	std::vector<control_gains> sets(1, base);
+	for (size_t a = 0; a < axes.size(); a++) {
+		const sweep_axis &axis = axes[a];
+		std::vector<control_gains> next;
+		uint16_t steps = axis.steps > 1 ? axis.steps : 1;
+		for (size_t i = 0; i < sets.size(); i++) {
+			for (uint16_t k = 0; k < steps; k++) {
+				control_gains g = sets[i];
+				g.*axis.gain = steps > 1 ? axis.min + (axis.max - axis.min) * k / (steps - 1) : axis.min;
+				next.push_back(g);
+			}
+		}
+		sets.swap(next);
+	}
+	run_gain_sets(pool, sets, seed);
+}
+
+void scenario_sweep::run_monte_carlo(work_pool &pool, uint32_t samples, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::vector<control_gains> sets;
+	sets.reserve(samples);
+	for (uint32_t i = 0; i < samples; i++) {
+		control_gains g = base;
+		for (size_t a = 0; a < axes.size(); a++) {
+			std::uniform_real_distribution<float> value(axes[a].min, axes[a].max);
+			g.*axes[a].gain = value(rng);
+		}
+		sets.push_back(g);
+	}
+	run_gain_sets(pool, sets, seed + 1);
+}
+
+void scenario_sweep::run_gain_sets(work_pool &pool, const std::vector<control_gains> &sets, uint32_t seed)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Every gain set sees the same starting conditions, so they are compared fairly
+	uint32_t per_set = (uint32_t)conditions.kind_count * conditions.repeats;
+	std::vector<scenario> starts(per_set);
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (uint32_t i = 0; i < per_set; i++) {
+		scenario &sc = starts[i];
+		sc.kind = conditions.kinds[i / conditions.repeats];
+		sc.speed = conditions.speed;
+		sc.initial_offset = conditions.max_offset * unit(rng);
+		sc.initial_heading = conditions.max_heading * unit(rng);
+		sc.initial_hitch = conditions.max_hitch * unit(rng);
+		sc.position_noise = conditions.position_noise;
+		sc.hitch_noise = conditions.hitch_noise;
+		sc.seed = rng();
+	}
+
+	// Runs are written into their own slots, so workers never share a result
+	size_t total = sets.size() * per_set;
+	std::vector<run_metrics> metrics(total);
+	pool.parallel_for(total, RUNS_PER_TASK, [&](size_t begin, size_t end) {
+		for (size_t r = begin; r < end; r++) {
+			scenario sc = starts[r % per_set];
+			sc.gains = sets[r / per_set];
+			metrics[r] = run_scenario(sc, config);
+		}
+	});
+
+	results.clear();
+	results.reserve(sets.size());
+	for (size_t s = 0; s < sets.size(); s++) {
+		sweep_summary sum;
+		sum.gains = sets[s];
+		sum.runs = per_set;
+		sum.completed = 0;
+		sum.jackknifes = 0;
+		sum.mean_rms = 0.0f;
+		sum.worst_error = 0.0f;
+		sum.mean_settling = 0.0f;
+		sum.worst_settling = 0.0f;
+
+		for (uint32_t i = 0; i < per_set; i++) {
+			const run_metrics &m = metrics[s * per_set + i];
+			sum.completed += m.completed ? 1 : 0;
+			sum.jackknifes += m.jackknife_events ? 1 : 0;
+			sum.mean_rms += m.rms_error;
+			sum.mean_settling += m.settling_time;
+			sum.worst_error = std::max(sum.worst_error, m.max_error);
+			sum.worst_settling = std::max(sum.worst_settling, m.settling_time);
+		}
+		if (per_set) {
+			sum.mean_rms /= per_set;
+			sum.mean_settling /= per_set;
+		}
+		results.push_back(sum);
+	}
+
+	run_count = total;
+	wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool better(const sweep_summary &a, const sweep_summary &b)
+{
+	if (a.jackknifes != b.jackknifes)
+		return a.jackknifes < b.jackknifes;
+	if (a.completed != b.completed)
+		return a.completed > b.completed;
+	return a.mean_rms < b.mean_rms;
+}
+
+void scenario_sweep::print_summary(FILE *out, uint16_t rows) const
+{
+	std::vector<sweep_summary> ranked(results);
+	std::sort(ranked.begin(), ranked.end(), better);
+
+	fprintf(out, "%llu runs in %.2f s (%.0f runs/s)\n",
+	        (unsigned long long)run_count, wall_time, wall_time > 0.0 ? run_count / wall_time : 0.0);
+
+	for (size_t a = 0; a < axes.size(); a++)
+		fprintf(out, "%12s ", axes[a].name);
+	fprintf(out, "%6s %6s %6s %9s %9s %9s %9s\n",
+	        "runs", "done", "jack", "rms_m", "worst_m", "settle_s", "worst_s");
+
+	for (size_t r = 0; r < ranked.size() && r < rows; r++) {
+		const sweep_summary &s = ranked[r];
+		for (size_t a = 0; a < axes.size(); a++)
+			fprintf(out, "%12.3f ", s.gains.*axes[a].gain);
+		fprintf(out, "%6u %6u %6u %9.4f %9.4f %9.2f %9.2f\n",
+		        s.runs, s.completed, s.jackknifes, s.mean_rms, s.worst_error,
+		        s.mean_settling, s.worst_settling);
+	}
+}
@@ -0,0 +1,140 @@
+/**
+ * The scenario_sweep runs thousands of closed-loop scenarios to tune the control loop
+ * without driving the truck. A sweep is described by a set of axes, each naming one
+ * member of control_gains and a range for it. The axes are either stepped through as
+ * a full grid or sampled at random (Monte Carlo). Every gain set is run against several
+ * randomized starting conditions and noise seeds. The runs are spread over a
+ * work_pool, and the per-run metrics are reduced to one summary row per gain set.
+ */
+
+#ifndef ME507_SCENARIO_SWEEP_H
+#define ME507_SCENARIO_SWEEP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "scenario.h"
+#include "../RaspberryPi/work_pool.h"
+
+/**
+ * @brief One tuned gain and the range it is swept over.
+ * @var name label printed in the summary table
+ * @var gain the member of control_gains being swept
+ * @var min smallest value
+ * @var max largest value
+ * @var steps number of values for a grid sweep (ignored by Monte Carlo sampling)
+ */
+struct sweep_axis {
+	const char *name;
+	float control_gains::*gain;
+	float min;
+	float max;
+	uint16_t steps;
+};
+
+/**
+ * @brief The spread of starting conditions every gain set is tested against.
+ * @var kinds the maneuvers to drive
+ * @var kind_count number of entries in kinds
+ * @var repeats randomized runs of each maneuver per gain set
+ * @var speed target speed (m/s)
+ * @var max_offset starting offsets are drawn from +-max_offset (m)
+ * @var max_heading starting heading errors are drawn from +-max_heading (rad)
+ * @var max_hitch starting hitch angles are drawn from +-max_hitch (rad)
+ * @var position_noise pose noise fed to the controller (m)
+ * @var hitch_noise hitch angle noise fed to the controller (rad)
+ */
+struct sweep_conditions {
+	const scenario_kind *kinds;
+	uint8_t kind_count;
+	uint16_t repeats;
+	float speed;
+	float max_offset;
+	float max_heading;
+	float max_hitch;
+	float position_noise;
+	float hitch_noise;
+};
+
+/**
+ * @brief Aggregated results for one set of gains.
+ * @var gains the gains that were run
+ * @var runs number of runs
+ * @var completed runs that reached the end of their path
+ * @var jackknifes runs that ended jackknifed
+ * @var mean_rms mean of the runs' RMS cross-track errors (m)
+ * @var worst_error largest cross-track error in any run (m)
+ * @var mean_settling mean settling time (s)
+ * @var worst_settling longest settling time (s)
+ */
+struct sweep_summary {
+	control_gains gains;
+	uint32_t runs;
+	uint32_t completed;
+	uint32_t jackknifes;
+	float mean_rms;
+	float worst_error;
+	float mean_settling;
+	float worst_settling;
+};
+
+class scenario_sweep {
+public:
+	/**
+	 * @brief The constructor for a scenario_sweep around a base set of gains.
+	 * @param config_in The simulation settings shared by every run
+	 * @param base_in The gains used for every member that is not swept
+	 * @param conditions_in The starting conditions every gain set is tested against
+	 */
+	scenario_sweep(const sim_config &config_in, const control_gains &base_in,
+	               const sweep_conditions &conditions_in);
+
+	/**
+	 * @brief Adds a gain to sweep.
+	 * @param axis The gain and its range
+	 */
+	void add_axis(const sweep_axis &axis);
+
+	/**
+	 * @brief Runs every point of the full grid over all axes.
+	 * @param pool The threads to run on
+	 * @param seed Seed for the starting conditions and noise
+	 */
+	void run_grid(work_pool &pool, uint32_t seed);
+
+	/**
+	 * @brief Runs gain sets drawn uniformly at random from the axes' ranges.
+	 * @param pool The threads to run on
+	 * @param samples Number of gain sets to draw
+	 * @param seed Seed for the gains, starting conditions and noise
+	 */
+	void run_monte_carlo(work_pool &pool, uint32_t samples, uint32_t seed);
+
+	/**
+	 * @brief Prints the best gain sets, ranked by completion, jackknifes and RMS error.
+	 * @param out Where the table is printed
+	 * @param rows The most rows to print
+	 */
+	void print_summary(FILE *out, uint16_t rows) const;
+
+	const std::vector<sweep_summary> &get_results() const { return results; }
+
+	/// Number of closed-loop runs in the last sweep
+	uint64_t get_run_count() const { return run_count; }
+	/// Wall clock time the last sweep took (s)
+	double get_wall_time() const { return wall_time; }
+
+private:
+	sim_config config;
+	control_gains base;
+	sweep_conditions conditions;
+	std::vector<sweep_axis> axes;
+	std::vector<sweep_summary> results;
+	uint64_t run_count;
+	double wall_time;
+
+	void run_gain_sets(work_pool &pool, const std::vector<control_gains> &sets, uint32_t seed);
+};
+
+
+#endif //ME507_SCENARIO_SWEEP_H
@@ -0,0 +1,159 @@
+//
+// Response-time analysis of the ATMega's task set; see schedulability.h.
+//
+
+#include <cstring>
+#include "schedulability.h"
+
+#define RTA_LINE_SIZE 128
+
+uint8_t effective_priority(uint8_t priority, const rta_settings &settings)
+{
+	return priority < settings.max_priorities ? priority : (uint8_t)(settings.max_priorities - 1);
+}
+
+static uint64_t divide_up(uint64_t a, uint64_t b)
+{
+	return b ? (a + b - 1) / b : a;
+}
+
+/**
+ * Iterates the response time of task i from C + B up, each step adding the releases of
+ * the interfering tasks that fit in the time so far, until it stops growing or passes
+ * the deadline. It grows by at least one C_j per step, so the search ends quickly.
+ */
+static bool response_time(const rta_task *tasks, uint8_t count, const uint8_t *priorities, uint8_t i,
+                          const rta_settings &settings, rta_result &result)
+{
+	const rta_task &task = tasks[i];
+	uint64_t jitter = settings.tick_us;
+	uint64_t deadline = task.deadline_us ? task.deadline_us : task.period_us;
+
+	uint64_t blocking = 0;
+	for (uint8_t j = 0; j < count; j++)
+		if (priorities[j] < priorities[i] && tasks[j].critical_us > blocking)
+			blocking = tasks[j].critical_us;
+
+	uint64_t response = task.wcet_us + blocking;
+	bool schedulable = false;
+	for (;;) {
+		uint64_t next = task.wcet_us + blocking;
+		for (uint8_t j = 0; j < count; j++) {
+			if (j == i || priorities[j] < priorities[i])
+				continue;
+			uint64_t period = tasks[j].period_us ? tasks[j].period_us : 1;
+			next += divide_up(response + jitter, period) * (tasks[j].wcet_us + 2 * settings.switch_us);
+		}
+		if (settings.tick_us)
+			next += divide_up(response, settings.tick_us) * settings.tick_cost_us;
+		if (next + jitter > deadline) {
+			response = next;
+			break;
+		}
+		if (next == response) {
+			schedulable = true;
+			break;
+		}
+		response = next;
+	}
+
+	result.priority = priorities[i];
+	result.blocking_us = (uint32_t)blocking;
+	result.response_us = (uint32_t)(response + jitter);
+	result.schedulable = schedulable;
+	return schedulable;
+}
+
+bool analyze_response_times(const rta_task *tasks, uint8_t count, const uint8_t *priorities,
+                            const rta_settings &settings, rta_result *results)
+{
+	uint8_t effective[RTA_MAX_TASKS];
+	for (uint8_t i = 0; i < count; i++)
+		effective[i] = effective_priority(priorities ? priorities[i] : tasks[i].priority, settings);
+
+	bool all = true;
+	for (uint8_t i = 0; i < count; i++)
+		all = response_time(tasks, count, effective, i, settings, results[i]) && all;
+	return all;
+}
+
+/**
+ * A task that meets its deadline at a level with every other unplaced task interfering
+ * meets it wherever those tasks end up above it, so it can be placed there for good.
+ * Placing every such task at the lowest level it fits keeps them from interfering with
+ * the rest; all they can add above is their critical sections, which are never longer
+ * than the execution time they would otherwise have added.
+ */
+bool assign_priorities(const rta_task *tasks, uint8_t count, const rta_settings &settings, uint8_t *priorities)
+{
+	uint8_t top = (uint8_t)(settings.max_priorities - 1);
+	uint8_t trial[RTA_MAX_TASKS];
+	bool fits[RTA_MAX_TASKS];
+	memset(priorities, 0, count);
+
+	uint8_t placed = 0;
+	for (uint8_t level = 1; level <= top && placed < count; level++) {
+		for (uint8_t i = 0; i < count; i++)
+			trial[i] = priorities[i] ? priorities[i] : level;
+		uint8_t fitting = 0;
+		for (uint8_t i = 0; i < count; i++) {
+			rta_result r;
+			fits[i] = !priorities[i] && response_time(tasks, count, trial, i, settings, r);
+			fitting += fits[i] ? 1 : 0;
+		}
+		// The top level must take whatever is left, whether it fits or not
+		if (level == top) {
+			for (uint8_t i = 0; i < count; i++)
+				if (!priorities[i])
+					priorities[i] = level;
+			return fitting == count - placed;
+		}
+		if (!fitting)
+			return false;
+		for (uint8_t i = 0; i < count; i++) {
+			if (fits[i]) {
+				priorities[i] = level;
+				placed++;
+			}
+		}
+	}
+	return placed == count;
+}
+
+uint8_t read_rta_tasks(FILE *file, rta_task *tasks, uint8_t max)
+{
+	char line[RTA_LINE_SIZE];
+	uint8_t count = 0;
+	while (count < max && fgets(line, sizeof(line), file)) {
+		rta_task t;
+		unsigned long period, wcet, critical, deadline;
+		unsigned priority;
+		int name_at = 0;
+		if (line[0] == '#'
+		    || sscanf(line, "%lu %lu %lu %lu %u %n", &period, &wcet, &critical, &deadline, &priority, &name_at) < 5
+		    || !period || !line[name_at])
+			continue;
+		size_t length = strcspn(line + name_at, "\r\n");
+		if (length >= sizeof(t.name))
+			length = sizeof(t.name) - 1;
+		memcpy(t.name, line + name_at, length);
+		t.name[length] = '\0';
+		t.period_us = (uint32_t)period;
+		t.wcet_us = (uint32_t)wcet;
+		t.critical_us = (uint32_t)critical;
+		t.deadline_us = (uint32_t)deadline;
+		t.priority = (uint8_t)priority;
+		tasks[count++] = t;
+	}
+	return count;
+}
+
+void write_rta_tasks(FILE *file, const rta_task *tasks, uint8_t count)
+{
+	fprintf(file, "# period_us wcet_us critical_us deadline_us priority name\n");
+	for (uint8_t i = 0; i < count; i++) {
+		const rta_task &t = tasks[i];
+		fprintf(file, "%lu %lu %lu %lu %u %s\n", (unsigned long)t.period_us, (unsigned long)t.wcet_us,
+		        (unsigned long)t.critical_us, (unsigned long)t.deadline_us, t.priority, t.name);
+	}
+}
@@ -0,0 +1,142 @@
+/**
+ * The schedulability analysis checks whether the ATMega's tasks always meet their
+ * deadlines under FreeRTOS, by classic response-time analysis, and looks for a priority
+ * assignment under which they do, so the priorities in main_mega.cpp need not be found
+ * by trial and error.
+ *
+ * FreeRTOS runs the highest priority ready task, preempting at once, and shares the CPU
+ * round robin among ready tasks of equal priority, so tasks of the same priority are
+ * counted as interfering with each other just as higher ones do. Tasks are released on
+ * ticks, so a release may come up to one tick late (its jitter J). A critical section
+ * turns interrupts off, so a task can be held up by a lower priority task's longest one
+ * (its blocking B). With C the worst-case execution time and T the shortest time
+ * between releases, the worst-case response time R of a task is the least fixed point of
+ *
+ *   R = C + B + sum over interfering tasks j of ceil((R + J) / T_j) * (C_j + 2 S)
+ *             + ceil(R / tick) * K
+ *
+ * where S is the cost of a context switch and K that of the tick interrupt. The task
+ * meets its deadline D in every case if R + J <= D.
+ *
+ * Priorities at or above configMAX_PRIORITIES are cut down to configMAX_PRIORITIES - 1
+ * by xTaskCreate(), so they are analyzed as the ATMega will really run them, not as
+ * written. assign_priorities() uses Audsley's optimal assignment, filling the levels
+ * from the lowest up: each level takes every task still unplaced that meets its deadline
+ * with all the other unplaced tasks interfering.
+ *
+ * Task sets are read and written as text, one task per line, so the numbers can come
+ * from the virtual_rtos's task profiles or from timing on the truck itself:
+ *
+ *   period_us wcet_us critical_us deadline_us priority name
+ *
+ * with a deadline of 0 meaning the period, and the name running to the end of the line.
+ */
+
+#ifndef ME507_SCHEDULABILITY_H
+#define ME507_SCHEDULABILITY_H
+
+#include <cstdint>
+#include <cstdio>
+
+/// Most tasks in one analysis
+#define RTA_MAX_TASKS 16
+/// Longest task name kept, with its terminator
+#define RTA_NAME_SIZE 24
+
+/**
+ * @brief One task as the analysis sees it.
+ * @var name the task's name
+ * @var period_us shortest time between two releases (us)
+ * @var wcet_us longest one release runs for (us)
+ * @var critical_us longest critical section it holds (us)
+ * @var deadline_us time after its release it must have finished by (us); 0 for the period
+ * @var priority its priority as given to TaskBase
+ */
+struct rta_task {
+	char     name[RTA_NAME_SIZE];
+	uint32_t period_us;
+	uint32_t wcet_us;
+	uint32_t critical_us;
+	uint32_t deadline_us;
+	uint8_t  priority;
+};
+
+/**
+ * @brief The scheduler the task set runs under.
+ * @var max_priorities configMAX_PRIORITIES; levels 1 to max_priorities - 1 are assigned
+ * @var tick_us the tick period, and so the release jitter (us)
+ * @var tick_cost_us time the tick interrupt takes (us)
+ * @var switch_us time a context switch takes (us)
+ */
+struct rta_settings {
+	uint8_t  max_priorities;
+	uint32_t tick_us;
+	uint32_t tick_cost_us;
+	uint32_t switch_us;
+};
+
+/**
+ * @brief How one task fares.
+ * @var priority the priority it really runs at
+ * @var blocking_us longest it can be held up by lower priority critical sections (us)
+ * @var response_us worst-case time from its release to its finish, jitter included;
+ * once past the deadline the search stops, so it is only a lower bound (us)
+ * @var schedulable true if the response time is within the deadline
+ */
+struct rta_result {
+	uint8_t  priority;
+	uint32_t blocking_us;
+	uint32_t response_us;
+	bool     schedulable;
+};
+
+/**
+ * @brief Gets the priority FreeRTOS really runs a task at.
+ * @param priority The priority given to TaskBase
+ * @param settings The scheduler
+ * @return the priority, cut down to max_priorities - 1
+ */
+uint8_t effective_priority(uint8_t priority, const rta_settings &settings);
+
+/**
+ * @brief Runs response-time analysis on a task set.
+ * @param tasks The tasks
+ * @param count The number of tasks, at most RTA_MAX_TASKS
+ * @param priorities The priority of each task, or NULL for the tasks' own
+ * @param settings The scheduler
+ * @param results Filled with one result per task
+ * @return true if every task meets its deadline
+ */
+bool analyze_response_times(const rta_task *tasks, uint8_t count, const uint8_t *priorities,
+                            const rta_settings &settings, rta_result *results);
+
+/**
+ * @brief Looks for priorities under which every task meets its deadline.
+ * @param tasks The tasks
+ * @param count The number of tasks, at most RTA_MAX_TASKS
+ * @param settings The scheduler
+ * @param priorities Filled with a priority per task, from 1 to max_priorities - 1
+ * @return false if there are no such priorities; then priorities holds the levels
+ * that could be filled and 0 for the rest
+ */
+bool assign_priorities(const rta_task *tasks, uint8_t count, const rta_settings &settings, uint8_t *priorities);
+
+/**
+ * @brief Reads a task set written as text, skipping blank lines and lines starting with #.
+ * @param file The file to read
+ * @param tasks Filled with the tasks
+ * @param max The most tasks to read
+ * @return the number of tasks read
+ */
+uint8_t read_rta_tasks(FILE *file, rta_task *tasks, uint8_t max);
+
+/**
+ * @brief Writes a task set as text, in the form read_rta_tasks() reads.
+ * @param file The file to write to
+ * @param tasks The tasks
+ * @param count The number of tasks
+ */
+void write_rta_tasks(FILE *file, const rta_task *tasks, uint8_t count);
+
+
+#endif //ME507_SCHEDULABILITY_H
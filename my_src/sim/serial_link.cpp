@@ -0,0 +1,84 @@
+//
+// Byte-level simulation of the Pi to Mega serial line; see serial_link.h.
+//
+
+#include "serial_link.h"
+
+#define BITS_PER_BYTE 10    // start bit, 8 data bits, stop bit
+
+serial_link::serial_link(const serial_link_config &config_in)
+		: rng(config_in.seed), unit(0.0f, 1.0f)
+{
+	config = config_in;
+	byte_time_us = (uint32_t)((BITS_PER_BYTE * 1000000ULL + config.baud - 1) / config.baud);
+	for (uint8_t i = 0; i < 2; i++) {
+		lines[i].free_us = 0;
+		lines[i].sent = 0;
+		lines[i].lost = 0;
+		lines[i].overflows = 0;
+	}
+}
+
+void serial_link::send(uint8_t from, char c, uint64_t now_us)
+{
+	line &l = lines[from];
+	uint64_t start = l.free_us > now_us ? l.free_us : now_us;
+	l.free_us = start + byte_time_us;
+	l.sent++;
+
+	if (unit(rng) < config.loss_rate) {
+		l.lost++;
+		return;
+	}
+	byte_on_wire b = {l.free_us, c};
+	l.wire.push_back(b);
+}
+
+bool serial_link::available(uint8_t to, uint64_t now_us)
+{
+	line &l = lines[1 - to];
+	deliver(l, now_us);
+	return !l.buffer.empty();
+}
+
+uint16_t serial_link::buffered(uint8_t to, uint64_t now_us)
+{
+	line &l = lines[1 - to];
+	deliver(l, now_us);
+	return (uint16_t)l.buffer.size();
+}
+
+char serial_link::receive(uint8_t to, uint64_t now_us)
+{
+	line &l = lines[1 - to];
+	deliver(l, now_us);
+	if (l.buffer.empty())
+		return '\0';
+	char c = l.buffer.front();
+	l.buffer.pop_front();
+	return c;
+}
+
+bool serial_link::next_arrival(uint8_t to, uint64_t &arrival_us, uint16_t nth) const
+{
+	const line &l = lines[1 - to];
+	if (nth == 0 || l.wire.size() < nth)
+		return false;
+	arrival_us = l.wire[nth - 1].arrival_us;
+	return true;
+}
+
+/**
+ * Moves every byte that has arrived by now from the wire into the receive buffer, as
+ * the receive interrupt would have done when each one came in.
+ */
+void serial_link::deliver(line &l, uint64_t now_us)
+{
+	while (!l.wire.empty() && l.wire.front().arrival_us <= now_us) {
+		if (l.buffer.size() < config.buffer_size)
+			l.buffer.push_back(l.wire.front().c);
+		else
+			l.overflows++;
+		l.wire.pop_front();
+	}
+}
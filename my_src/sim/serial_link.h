@@ -0,0 +1,117 @@
+/**
+ * The serial_link simulates the RS-232 line between the Raspberry Pi and the ATMega
+ * byte by byte. Each direction is a separate wire: a byte starts as soon as the line
+ * is free and arrives one frame time later (10 bits at the baud rate), and the
+ * receiver keeps arrived bytes in a buffer of the size rs232int uses, losing any that
+ * arrive while it is full. Bytes can also be lost on the wire at random; a lost byte
+ * still takes up its time on the line. The random losses come from a seeded generator,
+ * so runs can be repeated exactly.
+ */
+
+#ifndef ME507_SERIAL_LINK_H
+#define ME507_SERIAL_LINK_H
+
+#include <cstdint>
+#include <deque>
+#include <random>
+
+/**
+ * @brief Settings of a simulated serial line.
+ * @var baud line speed, the same for both directions (bits per second)
+ * @var loss_rate chance that any one byte is lost on the wire (0 to 1)
+ * @var buffer_size bytes each receiver can hold before it starts losing them
+ * @var seed seed for the random losses
+ */
+struct serial_link_config {
+	uint32_t baud;
+	float    loss_rate;
+	uint16_t buffer_size;
+	uint32_t seed;
+};
+
+class serial_link {
+public:
+	/**
+	 * @brief The constructor for an idle serial line.
+	 * @param config_in The line settings
+	 */
+	serial_link(const serial_link_config &config_in);
+
+	/**
+	 * @brief Sends a byte from one end; it never blocks.
+	 * @param from The sending end (0 or 1)
+	 * @param c The byte
+	 * @param now_us The time the byte is handed to the UART (us)
+	 */
+	void send(uint8_t from, char c, uint64_t now_us);
+
+	/**
+	 * @brief Checks whether a byte is waiting at one end.
+	 * @param to The receiving end (0 or 1)
+	 * @param now_us The current time (us)
+	 * @return true if a byte has arrived and not been read
+	 */
+	bool available(uint8_t to, uint64_t now_us);
+
+	/**
+	 * @brief Counts the bytes waiting at one end.
+	 * @param to The receiving end (0 or 1)
+	 * @param now_us The current time (us)
+	 * @return the number of bytes that have arrived and not been read
+	 */
+	uint16_t buffered(uint8_t to, uint64_t now_us);
+
+	/**
+	 * @brief Takes the oldest received byte at one end.
+	 * @param to The receiving end (0 or 1)
+	 * @param now_us The current time (us)
+	 * @return the byte, or 0 if none has arrived
+	 */
+	char receive(uint8_t to, uint64_t now_us);
+
+	/**
+	 * @brief Finds when a byte still on the wire will arrive at one end.
+	 * @param to The receiving end (0 or 1)
+	 * @param arrival_us Set to the arrival time, if there is such a byte (us)
+	 * @param nth Which of the bytes on the way, 1 for the next one
+	 * @return false if fewer than nth bytes are on the way
+	 */
+	bool next_arrival(uint8_t to, uint64_t &arrival_us, uint16_t nth = 1) const;
+
+	/// Time one byte takes on the wire (us)
+	uint32_t get_byte_time_us() const { return byte_time_us; }
+
+	/// Bytes sent from one end
+	uint64_t get_sent(uint8_t from) const { return lines[from].sent; }
+	/// Bytes sent from one end that were lost on the wire
+	uint64_t get_lost(uint8_t from) const { return lines[from].lost; }
+	/// Bytes that reached one end while its buffer was full
+	uint64_t get_overflows(uint8_t to) const { return lines[1 - to].overflows; }
+
+private:
+	struct byte_on_wire {
+		uint64_t arrival_us;
+		char c;
+	};
+
+	// One direction of the link; lines[i] carries the bytes sent from end i
+	struct line {
+		std::deque<byte_on_wire> wire;
+		std::deque<char> buffer;
+		uint64_t free_us;
+		uint64_t sent;
+		uint64_t lost;
+		uint64_t overflows;
+	};
+
+	serial_link_config config;
+	uint32_t byte_time_us;
+	line lines[2];
+	std::mt19937 rng;
+	std::uniform_real_distribution<float> unit;
+
+	void deliver(line &l, uint64_t now_us);
+};
+
+
+#endif //ME507_SERIAL_LINK_H
@@ -0,0 +1,244 @@
+//
+// Software-in-the-loop simulation of the firmware, the Pi and the truck; see
+// sil_harness.h.
+//
+
+#include <chrono>
+#include <cmath>
+#include "sil_harness.h"
+#include "../communication_data.h"
+#include "../ATMega/fifth_wheel.h"
+#include "../ATMega/gear_shifter.h"
+#include "../ATMega/imu_task.h"
+#include "../ATMega/mega_comm_task.h"
+#include "../ATMega/motor_driver.h"
+#include "../ATMega/steer_servo.h"
+#include "../ATMega/wheel_speed.h"
+#include "../RaspberryPi/pi_comm_task.h"
+
+#define MEGA_END 0          // serial_link ends
+#define PI_END 1
+#define RUN_SLICE_US 10000  // how far the clock runs between checks for the end of a run
+#define BNO055_CHIP_ID 0xA0 // what the BNO055 answers in its chip ID register
+
+sil_config default_sil_config()
+{
+	sil_config config;
+	config.sim = default_sim_config();
+
+	config.link.baud = 9600;
+	config.link.loss_rate = 0.0f;
+	config.link.buffer_size = 32;           // RSINT_BUF_SIZE
+	config.link.seed = 1;
+
+	// A 270 degree scanner looking backwards, so the trailer is in the middle of the sweep
+	config.lidar.angle_min = (float)M_PI / 4;
+	config.lidar.angle_increment = (float)M_PI / 720;
+	config.lidar.count = 1081;
+	config.lidar.range_min = 0.02f;
+	config.lidar.range_max = 30.0f;
+	config.lidar.sweep_us = 25000;
+	config.lidar.range_noise = 0.01f;
+	config.lidar.mount_x = 0.27f;
+	config.lidar.mount_y = 0.0f;
+	config.lidar.mount_yaw = 0.0f;
+	config.lidar.seed = 2;
+
+	// The rear axle, and so the pivot, is behind the LiDAR
+	config.hitch.hitch_x = -config.lidar.mount_x - config.sim.vehicle.geometry.hitch_offset;
+	config.hitch.hitch_y = 0.0f;
+	config.hitch.face_distance = 0.15f;
+	config.hitch.trailer_width = 0.30f;
+	config.hitch.trailer_length = 0.80f;
+	config.hitch.window_min = (float)M_PI - 1.0f;
+	config.hitch.window_max = (float)M_PI + 1.0f;
+	config.hitch.max_hitch_angle = 1.2f;
+	config.hitch.inlier_distance = 0.02f;
+	config.hitch.face_tolerance = 0.03f;
+	config.hitch.mask_margin = 0.03f;
+	config.hitch.min_points = 10;
+	config.hitch.max_age_us = 200000;
+
+	config.position_noise = 0.01f;
+	config.seed = 3;
+	return config;
+}
+
+sil_harness::sil_harness(const sil_config &config_in, const control_gains &gains, const vehicle_state &start)
+		: config(config_in), link(config_in.link), plant(config_in.sim.vehicle),
+		  lidar(config_in.lidar, config_in.hitch), estimator(config_in.hitch),
+		  controller(config_in.sim.vehicle.geometry, gains), rng(config_in.seed),
+		  position_noise(0.0f, config_in.position_noise > 0.0f ? config_in.position_noise : 1e-9f)
+{
+	plant.reset(start);
+	mega_data = semi_truck_data_t();
+	pi_data = semi_truck_data_t();
+	pi_data.desired_gear = 1;
+	pi_data.desired_5th = true;
+
+	// Tasks register with the current scheduler as they are built, with the priorities
+	// main_mega gives them
+	rtos.make_current();
+	comm_data = new communication_data(&mega_data);
+	fifth = new fifth_wheel<sim_servo>("fifth_wheel", 1, 200, NULL, &mega_data);
+	shifter = new gear_shifter<sim_servo>("gear_shifter", 1, 200, NULL, &mega_data);
+	imu = new imu_task<sim_i2c>("imu", 5, 400, NULL, BNO055_ADDRESS_A, &mega_data);
+	mega_comm = new mega_comm_task<sim_uart>("communicator", 5, 500, NULL, (uint16_t)config.link.baud, comm_data);
+	motor = new motor_driver<sim_servo>("motor", 6, 400, NULL, &mega_data);
+	steering = new steer_servo<sim_servo>("steering", 6, 400, NULL, &mega_data);
+	speed_sensor = new wheel_speed("speed sensor", 9, 400, NULL, &mega_data);
+	pi_comm = new pi_comm_task("pi_comm", 5, 500, NULL, (uint16_t)config.link.baud, 0, &pi_data);
+
+	mega_comm->get_uart().connect(&link, MEGA_END);
+	imu->get_bus().add_device(BNO055_ADDRESS_A);
+	imu->get_bus().write_register(BNO055_ADDRESS_A, BNO055_CHIP_ID_ADDR, BNO055_CHIP_ID);
+	pi_comm->connect(&link, PI_END);
+
+	// Within one instant: sense, then control, then move the plant, then the tasks run
+	rtos.add_periodic(config.lidar.sweep_us, [this](uint64_t now) { lidar_step(now); });
+	rtos.add_periodic(config.sim.control_period_us, [this](uint64_t now) { control_step(now); });
+	uint64_t plant_step_us = (uint64_t)(config.sim.plant_dt * 1e6f + 0.5f);
+	rtos.add_periodic(plant_step_us, [this](uint64_t now) { plant_step(now); });
+
+	metrics = run_metrics();
+	stop = false;
+	sum_sq_error = 0.0;
+	error_samples = 0;
+	scans = 0;
+	valid_scans = 0;
+	sum_sq_hitch_error = 0.0;
+	wall_time = 0.0;
+}
+
+sil_harness::~sil_harness()
+{
+	delete pi_comm;
+	delete speed_sensor;
+	delete steering;
+	delete motor;
+	delete mega_comm;
+	delete imu;
+	delete shifter;
+	delete fifth;
+	delete comm_data;
+}
+
+void sil_harness::set_path(const path_point *points, uint16_t count, bool reverse, float speed)
+{
+	controller.set_path(points, count, reverse, speed);
+}
+
+run_metrics sil_harness::run(float time_limit)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	uint64_t begin_us = rtos.get_time_us();
+	uint64_t limit_us = begin_us + (uint64_t)(time_limit * 1e6f);
+
+	metrics = run_metrics();
+	stop = false;
+	sum_sq_error = 0.0;
+	error_samples = 0;
+
+	while (!stop && rtos.get_time_us() < limit_us) {
+		uint64_t next = rtos.get_time_us() + RUN_SLICE_US;
+		rtos.run_until(next < limit_us ? next : limit_us);
+	}
+
+	metrics.duration = (rtos.get_time_us() - begin_us) * 1e-6f;
+	metrics.rms_error = error_samples ? (float)sqrt(sum_sq_error / error_samples) : 0.0f;
+	wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return metrics;
+}
+
+void sil_harness::print_report(FILE *out) const
+{
+	fprintf(out, "simulated %.1f s in %.2f s (%.0fx real time)\n", metrics.duration, wall_time,
+	        wall_time > 0.0 ? metrics.duration / wall_time : 0.0);
+	fprintf(out, "path: %s, rms %.4f m, max %.4f m, settled after %.2f s, max hitch %.3f rad, %u jackknifes\n",
+	        metrics.completed ? "completed" : "not completed", metrics.rms_error, metrics.max_error,
+	        metrics.settling_time, metrics.max_hitch, metrics.jackknife_events);
+	fprintf(out, "hitch estimate: %u of %u scans valid, rms error %.4f rad\n", valid_scans, scans,
+	        valid_scans ? sqrt(sum_sq_hitch_error / valid_scans) : 0.0);
+	fprintf(out, "serial, %u us per byte:\n", link.get_byte_time_us());
+	fprintf(out, "  Pi to Mega: %llu bytes, %llu lost, %llu overflowed\n",
+	        (unsigned long long)link.get_sent(PI_END), (unsigned long long)link.get_lost(PI_END),
+	        (unsigned long long)link.get_overflows(MEGA_END));
+	fprintf(out, "  Mega to Pi: %llu bytes, %llu lost, %llu overflowed\n",
+	        (unsigned long long)link.get_sent(MEGA_END), (unsigned long long)link.get_lost(MEGA_END),
+	        (unsigned long long)link.get_overflows(PI_END));
+	fprintf(out, "tasks: %llu switches, %u tasks returned from run()\n",
+	        (unsigned long long)rtos.get_switch_count(), rtos.get_finished_count());
+}
+
+void sil_harness::lidar_step(uint64_t now_us)
+{
+	lidar.scan(plant.get_state(), now_us, scan);
+	hitch_estimate est = estimator.process(scan);
+	scans++;
+	if (est.valid) {
+		float e = est.angle - plant.get_state().hitch;
+		sum_sq_hitch_error += (double)e * e;
+		valid_scans++;
+	}
+}
+
+void sil_harness::control_step(uint64_t now_us)
+{
+	const vehicle_state &s = plant.get_state();
+	hitch_estimate hitch = estimator.get_last_valid();
+
+	control_input in;
+	in.time_us = now_us;
+	in.x = s.x + position_noise(rng);
+	in.y = s.y + position_noise(rng);
+	in.heading = control_loop::imu_angle_to_heading(pi_data.imu_angle);
+	in.hitch_angle = hitch.valid ? hitch.angle : 0.0f;
+	in.wheel_speed = pi_data.wheel_speed;
+	controller.update(in, &pi_data);
+
+	if (controller.is_finished()) {
+		metrics.completed = true;
+		stop = true;
+		return;
+	}
+
+	float e = fabsf(controller.get_cross_track_error());
+	sum_sq_error += (double)e * e;
+	error_samples++;
+	if (e > metrics.max_error)
+		metrics.max_error = e;
+	if (e > config.sim.settle_band)
+		metrics.settling_time = now_us * 1e-6f;
+}
+
+void sil_harness::write_euler(int16_t heading, int16_t roll, int16_t pitch)
+{
+	// Each angle is little-endian, as the I2C burst read of the LSB register returns it
+	const uint8_t lsb_addresses[3] = {BNO055_EULER_H_LSB_ADDR, BNO055_EULER_R_LSB_ADDR, BNO055_EULER_P_LSB_ADDR};
+	const int16_t values[3] = {heading, roll, pitch};
+	sim_i2c &bus = imu->get_bus();
+	for (uint8_t i = 0; i < 3; i++) {
+		bus.write_register(BNO055_ADDRESS_A, lsb_addresses[i], (uint8_t)(values[i] & 0xFF));
+		bus.write_register(BNO055_ADDRESS_A, (uint8_t)(lsb_addresses[i] + 1), (uint8_t)((uint16_t)values[i] >> 8));
+	}
+}
+
+void sil_harness::plant_step(uint64_t now_us)
+{
+	(void)now_us;
+
+	// The sensors see the truck as it is now; what the tasks command takes effect next step
+	write_euler((int16_t)plant.measure_imu_angle(), 0, 0);
+	mega_data.wheel_speed = plant.measure_wheel_speed();
+
+	plant.step(config.sim.plant_dt, steer_servo<sim_servo>::pulse_steer_output(steering->get_servo().get_pulse_us()),
+	           motor->get_applied());
+
+	float hitch = fabsf(plant.get_state().hitch);
+	if (hitch > metrics.max_hitch)
+		metrics.max_hitch = hitch;
+	if (hitch > config.sim.vehicle.geometry.max_hitch && !stop) {
+		metrics.jackknife_events++;
+		stop = true;
+	}
+}
@@ -0,0 +1,147 @@
+/**
+ * The sil_harness is the software-in-the-loop simulation: one host process running the
+ * actual firmware instead of models of it. The ATMega tasks (imu_task, gear_shifter,
+ * fifth_wheel, motor_driver, steer_servo, wheel_speed and mega_comm_task) are built
+ * against the host port in sim/host with the simulated peripherals of sim_hal.h, and
+ * scheduled by a virtual_rtos. They talk to the
+ * Pi's pi_comm_task byte by byte over a serial_link, and the Pi runs the control_loop
+ * and the hitch_estimator on scans from a lidar_model. The vehicle_model closes the
+ * loop: the steering servo and the motor_driver drive it, and its state is written into
+ * the BNO055 registers and the wheel speed.
+ *
+ * Everything runs on virtual time from seeded generators, so a run is repeatable and
+ * takes only as long as the code needs; a long drive simulates hundreds of times faster
+ * than real time. This makes it the place to measure any change to the protocol, the
+ * task timing or the control code end to end.
+ *
+ * The wheel_speed task is still empty on the truck, so the harness stands in for it and
+ * writes the measured wheel speed into the Mega's semi_truck_data_t directly. The robot's pose is not estimated
+ * on the Pi yet either, so the control loop gets the true position plus noise.
+ */
+
+#ifndef ME507_SIL_HARNESS_H
+#define ME507_SIL_HARNESS_H
+
+#include <cstdint>
+#include <cstdio>
+#include "scenario.h"
+#include "serial_link.h"
+#include "lidar_model.h"
+#include "virtual_rtos.h"
+#include "sim_hal.h"
+#include "../RaspberryPi/hitch_estimator.h"
+
+template <class PWM> class fifth_wheel;
+template <class PWM> class gear_shifter;
+template <class I2C> class imu_task;
+template <class UART> class mega_comm_task;
+template <class PWM> class motor_driver;
+template <class PWM> class steer_servo;
+class wheel_speed;
+class pi_comm_task;
+class communication_data;
+
+/**
+ * @brief Settings of a software-in-the-loop run.
+ * @var sim the truck, plant step, control period, time limit and settle band; the
+ * mega part is not used, since the real tasks run instead
+ * @var link the serial line between the Pi and the Mega
+ * @var lidar the simulated LiDAR
+ * @var hitch the trailer and LiDAR geometry, for both the lidar_model and the estimator
+ * @var position_noise standard deviation of the position given to the controller (m)
+ * @var seed seed for the position noise
+ */
+struct sil_config {
+	sim_config sim;
+	serial_link_config link;
+	lidar_model_config lidar;
+	hitch_config hitch;
+	float position_noise;
+	uint32_t seed;
+};
+
+/**
+ * @brief Fills in a sil_config for the nominal truck on a 9600 baud link.
+ * @return the default configuration
+ */
+sil_config default_sil_config();
+
+class sil_harness {
+public:
+	/**
+	 * @brief Builds the whole system with the truck at rest in a given state.
+	 * @param config_in The run settings
+	 * @param gains The control loop gains
+	 * @param start The starting state of the truck
+	 */
+	sil_harness(const sil_config &config_in, const control_gains &gains, const vehicle_state &start);
+
+	~sil_harness();
+
+	/**
+	 * @brief Gives the control loop a path to follow; see control_loop::set_path().
+	 */
+	void set_path(const path_point *points, uint16_t count, bool reverse, float speed);
+
+	/**
+	 * @brief Runs until the path is finished, the trailer jackknifes or time runs out.
+	 * @param time_limit The longest to run (s of simulated time)
+	 * @return the same metrics run_scenario() gives
+	 */
+	run_metrics run(float time_limit);
+
+	/**
+	 * @brief Prints the metrics of the last run with the link, estimator and task counters.
+	 * @param out Where to print
+	 */
+	void print_report(FILE *out) const;
+
+	const vehicle_model &get_plant() const { return plant; }
+	const serial_link &get_link() const { return link; }
+	const virtual_rtos &get_rtos() const { return rtos; }
+
+private:
+	sil_config config;
+	virtual_rtos rtos;
+	serial_link link;
+	vehicle_model plant;
+	lidar_model lidar;
+	hitch_estimator estimator;
+	control_loop controller;
+	lidar_scan scan;
+
+	semi_truck_data_t mega_data;    // the Mega's shared task data
+	semi_truck_data_t pi_data;      // shared by the Pi's control loop and pi_comm_task
+	communication_data *comm_data;
+
+	fifth_wheel<sim_servo> *fifth;
+	gear_shifter<sim_servo> *shifter;
+	imu_task<sim_i2c> *imu;
+	mega_comm_task<sim_uart> *mega_comm;
+	motor_driver<sim_servo> *motor;
+	steer_servo<sim_servo> *steering;
+	wheel_speed *speed_sensor;
+	pi_comm_task *pi_comm;
+
+	std::mt19937 rng;
+	std::normal_distribution<float> position_noise;
+
+	// Results of the run in progress
+	run_metrics metrics;
+	bool stop;
+	double sum_sq_error;
+	uint32_t error_samples;
+	uint32_t scans;
+	uint32_t valid_scans;
+	double sum_sq_hitch_error;
+	double wall_time;
+
+	void lidar_step(uint64_t now_us);
+	void control_step(uint64_t now_us);
+	void plant_step(uint64_t now_us);
+	/// Writes the Euler angle registers of the simulated BNO055: raw, 16 counts per degree
+	void write_euler(int16_t heading, int16_t roll, int16_t pitch);
+};
+
+
+#endif //ME507_SIL_HARNESS_H
@@ -0,0 +1,114 @@
+//
+// C interface to the host simulator for scripts; see sim_bindings.h.
+//
+
+#include "batch_plant.h"
+#include "sim_bindings.h"
+#include "../RaspberryPi/work_pool.h"
+
+#define RUNS_PER_TASK 4     // scenarios handed to a thread at a time
+
+struct sim_batch {
+	batch_plant plant;
+
+	sim_batch(const vehicle_params &params, size_t count) : plant(params, count) {}
+};
+
+uint32_t sim_bindings_version()
+{
+	return SIM_BINDINGS_VERSION;
+}
+
+size_t sim_struct_size(int which)
+{
+	switch (which) {
+	case SIM_STRUCT_VEHICLE_STATE:
+		return sizeof(vehicle_state);
+	case SIM_STRUCT_SCENARIO:
+		return sizeof(scenario);
+	case SIM_STRUCT_RUN_METRICS:
+		return sizeof(run_metrics);
+	default:
+		return 0;
+	}
+}
+
+sim_batch *sim_batch_create(size_t count)
+{
+	if (!count)
+		return NULL;
+	return new sim_batch(default_sim_config().vehicle, count);
+}
+
+void sim_batch_destroy(sim_batch *batch)
+{
+	delete batch;
+}
+
+size_t sim_batch_size(const sim_batch *batch)
+{
+	return batch->plant.size();
+}
+
+void sim_batch_reset(sim_batch *batch, const float *states)
+{
+	for (size_t i = 0; i < batch->plant.size(); i++) {
+		const float *row = states + i * SIM_STATE_FIELDS;
+		vehicle_state s = {row[0], row[1], row[2], row[3], row[4], row[5]};
+		batch->plant.reset(i, s);
+	}
+}
+
+void sim_batch_states(const sim_batch *batch, float *states)
+{
+	for (size_t i = 0; i < batch->plant.size(); i++) {
+		vehicle_state s = batch->plant.get_state(i);
+		float *row = states + i * SIM_STATE_FIELDS;
+		row[0] = s.x;
+		row[1] = s.y;
+		row[2] = s.heading;
+		row[3] = s.hitch;
+		row[4] = s.steer;
+		row[5] = s.speed;
+	}
+}
+
+int16_t *sim_batch_steer_outputs(sim_batch *batch)
+{
+	return batch->plant.steer_outputs();
+}
+
+int16_t *sim_batch_motor_outputs(sim_batch *batch)
+{
+	return batch->plant.motor_outputs();
+}
+
+void sim_batch_wheel_speeds(const sim_batch *batch, int16_t *out)
+{
+	batch->plant.measure_wheel_speeds(out);
+}
+
+void sim_batch_run(sim_batch *batch, float dt, uint32_t steps, uint32_t keep_every, float *trajectory)
+{
+	size_t block = batch->plant.size() * SIM_STATE_FIELDS;
+	for (uint32_t i = 1; i <= steps; i++) {
+		batch->plant.step(dt);
+		if (keep_every && trajectory && i % keep_every == 0)
+			sim_batch_states(batch, trajectory + (i / keep_every - 1) * block);
+	}
+}
+
+void sim_default_gains(control_gains *gains)
+{
+	*gains = default_gains();
+}
+
+void sim_run_scenarios(const scenario *scenarios, size_t count, run_metrics *metrics, unsigned threads)
+{
+	sim_config config = default_sim_config();
+	work_pool pool(threads);
+	pool.parallel_for(count, RUNS_PER_TASK, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			metrics[i] = run_scenario(scenarios[i], config);
+	});
+}
@@ -0,0 +1,125 @@
+/**
+ * The sim_bindings are a plain C interface to the host simulator, built as the shared
+ * library truck_sim so scripts can load it (my_src/python/semi_truck does, with ctypes).
+ * Every call works on whole batches, so a script crosses into C++ once per batch and not
+ * once per vehicle or per step, and every array crosses as a pointer to memory the
+ * caller owns, such as a numpy array's, so nothing is copied on the way in or out.
+ *
+ * A sim_batch is a batch_plant: the commands are read from two arrays the script can
+ * write straight into between runs, and sim_batch_run() steps every vehicle as many
+ * times as asked, holding the commands, and can keep the states every few steps.
+ * sim_run_scenarios() runs closed-loop scenarios on a work_pool, for tuning the gains
+ * from a script at the speed scenario_sweep runs them. The scenario and run_metrics
+ * structures are passed as they are laid out in C++; sim_struct_size() lets the caller
+ * check its own copies of the layouts against the library's.
+ */
+
+#ifndef ME507_SIM_BINDINGS_H
+#define ME507_SIM_BINDINGS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "scenario.h"
+
+/// Changes whenever a call or a structure passed through these bindings changes
+#define SIM_BINDINGS_VERSION 1
+/// Floats per vehicle in a state array: x, y, heading, hitch, steer, speed, as vehicle_state
+#define SIM_STATE_FIELDS 6
+
+/// The structures whose layout a caller may check
+enum sim_struct {
+	SIM_STRUCT_VEHICLE_STATE,   ///< vehicle_state
+	SIM_STRUCT_SCENARIO,        ///< scenario
+	SIM_STRUCT_RUN_METRICS,     ///< run_metrics
+	SIM_STRUCTS
+};
+
+extern "C" {
+
+/// A batch of simulated trucks; opaque to the caller
+struct sim_batch;
+
+/**
+ * @brief Gets the version the library was built at.
+ * @return SIM_BINDINGS_VERSION
+ */
+uint32_t sim_bindings_version();
+
+/**
+ * @brief Gets the size of one of the structures passed to the library.
+ * @param which A sim_struct
+ * @return its size in bytes, or 0 if which is out of range
+ */
+size_t sim_struct_size(int which);
+
+/**
+ * @brief Makes a batch of trucks with the nominal parameters, all at rest at the origin.
+ * @param count The number of trucks
+ * @return the batch, or NULL if count is 0
+ */
+sim_batch *sim_batch_create(size_t count);
+
+/**
+ * @brief Frees a batch and the command arrays it handed out.
+ */
+void sim_batch_destroy(sim_batch *batch);
+
+/// Number of trucks in a batch
+size_t sim_batch_size(const sim_batch *batch);
+
+/**
+ * @brief Puts every truck in a given state.
+ * @param batch The batch
+ * @param states count rows of SIM_STATE_FIELDS floats
+ */
+void sim_batch_reset(sim_batch *batch, const float *states);
+
+/**
+ * @brief Reads back every truck's state.
+ * @param batch The batch
+ * @param states Filled with count rows of SIM_STATE_FIELDS floats
+ */
+void sim_batch_states(const sim_batch *batch, float *states);
+
+/// Steering command of every truck, as steer_output in semi_truck_data_t; writable
+int16_t *sim_batch_steer_outputs(sim_batch *batch);
+/// Motor command of every truck, as motor_output in semi_truck_data_t; writable
+int16_t *sim_batch_motor_outputs(sim_batch *batch);
+
+/**
+ * @brief Reads every truck's wheel speed sensor.
+ * @param batch The batch
+ * @param out Filled with count wheel_speed values, as in semi_truck_data_t
+ */
+void sim_batch_wheel_speeds(const sim_batch *batch, int16_t *out);
+
+/**
+ * @brief Steps every truck, holding the commands.
+ * @param batch The batch
+ * @param dt The time step (s)
+ * @param steps The number of steps
+ * @param keep_every Keep the states after every keep_every-th step; 0 to keep none
+ * @param trajectory Filled with steps / keep_every blocks of count rows of
+ * SIM_STATE_FIELDS floats, or NULL if keep_every is 0
+ */
+void sim_batch_run(sim_batch *batch, float dt, uint32_t steps, uint32_t keep_every, float *trajectory);
+
+/**
+ * @brief Fills in the nominal gains, as default_gains().
+ */
+void sim_default_gains(control_gains *gains);
+
+/**
+ * @brief Runs closed-loop scenarios with the nominal truck, spread over threads.
+ * Each run is deterministic, so the metrics do not depend on the threads.
+ * @param scenarios The scenarios to run
+ * @param count The number of scenarios
+ * @param metrics Filled with one run_metrics per scenario
+ * @param threads Threads to run on; 0 for one per core
+ */
+void sim_run_scenarios(const scenario *scenarios, size_t count, run_metrics *metrics, unsigned threads);
+
+}
+
+
+#endif //ME507_SIM_BINDINGS_H
@@ -0,0 +1,49 @@
+//
+// Simulated peripherals for the ATMega tasks; see sim_hal.h.
+//
+
+#include <cstring>
+#include "sim_hal.h"
+
+sim_i2c::sim_i2c()
+{
+	memset(addresses, 0, sizeof(addresses));
+	memset(registers, 0, sizeof(registers));
+	device_count = 0;
+}
+
+bool sim_i2c::read_registers(uint8_t address, uint8_t reg, char *buffer, uint8_t len)
+{
+	int8_t device = find_device(address);
+	if (device < 0 || (uint16_t)reg + len > SIM_I2C_REGISTER_COUNT)
+		return false;
+	memcpy(buffer, &registers[device][reg], len);
+	return true;
+}
+
+bool sim_i2c::write_register(uint8_t address, uint8_t reg, uint8_t value)
+{
+	int8_t device = find_device(address);
+	if (device < 0 || reg >= SIM_I2C_REGISTER_COUNT)
+		return false;
+	registers[device][reg] = value;
+	return true;
+}
+
+bool sim_i2c::add_device(uint8_t address)
+{
+	if (device_count >= SIM_I2C_MAX_DEVICES)
+		return false;
+	addresses[device_count] = address;
+	memset(registers[device_count], 0, SIM_I2C_REGISTER_COUNT);
+	device_count++;
+	return true;
+}
+
+int8_t sim_i2c::find_device(uint8_t address) const
+{
+	for (uint8_t i = 0; i < device_count; i++)
+		if (addresses[i] == address)
+			return (int8_t)i;
+	return -1;
+}
@@ -0,0 +1,102 @@
+/**
+ * Simulated backends for the hardware abstraction in ATMega/mega_hal.h, which the
+ * software-in-the-loop simulation builds the ATMega tasks with. Each keeps its
+ * peripheral's state in the object, so several simulations can run side by side, and
+ * the simulation reaches it through the task that owns it:
+ *
+ *   sim_uart   one end of a serial_link, through the host port of rs232
+ *   sim_i2c    a bus of register files; the simulation writes a sensor's measurement
+ *              registers and the task reads them back as the I2C burst read would
+ *   sim_servo  drives nothing, and remembers the last value written
+ */
+
+#ifndef ME507_SIM_HAL_H
+#define ME507_SIM_HAL_H
+
+#include <cstdint>
+#include "host/rs232int.h"
+#include "../ATMega/mega_hal.h"
+
+#define SIM_I2C_MAX_DEVICES 4
+#define SIM_I2C_REGISTER_COUNT 0x80     // registers per device; the BNO055's page 0
+
+/**
+ * @brief A UART that is one end of a serial_link.
+ */
+class sim_uart {
+public:
+	void begin(uint16_t baud) { (void)baud; }     // the serial_link sets the baud rate
+	void putchar(char a_char) { port.putchar(a_char); }
+	bool check_for_char() { return port.check_for_char(); }
+	uint16_t available() { return port.available(); }
+	char getchar() { return port.getchar(); }
+	bool wait_for(uint16_t count, TickType_t ticks) { return port.wait_for(count, ticks); }
+
+	/**
+	 * @brief Connects the UART to one end of a simulated serial line.
+	 * @param link The line
+	 * @param end Which end of the line this is (0 or 1)
+	 */
+	void connect(serial_link *link, uint8_t end) { port.connect(link, end); }
+
+private:
+	rs232 port;
+};
+
+/**
+ * @brief An I2C bus whose devices are register files.
+ */
+class sim_i2c {
+public:
+	sim_i2c();
+
+	void begin() {}
+
+	/**
+	 * @brief Reads consecutive registers of a device.
+	 * @return false if no device has the address, or the read runs past its last register
+	 */
+	bool read_registers(uint8_t address, uint8_t reg, char *buffer, uint8_t len);
+
+	/**
+	 * @brief Writes one register of a device, from a task or from the simulation.
+	 * @return false if no device has the address, or there is no such register
+	 */
+	bool write_register(uint8_t address, uint8_t reg, uint8_t value);
+
+	/**
+	 * @brief Puts a device on the bus with every register 0 (host only).
+	 * @param address The device's 7-bit address
+	 * @return false if the bus is full
+	 */
+	bool add_device(uint8_t address);
+
+private:
+	uint8_t addresses[SIM_I2C_MAX_DEVICES];
+	uint8_t registers[SIM_I2C_MAX_DEVICES][SIM_I2C_REGISTER_COUNT];
+	uint8_t device_count;
+
+	int8_t find_device(uint8_t address) const;
+};
+
+/**
+ * @brief A servo that remembers the last value written.
+ */
+class sim_servo {
+public:
+	sim_servo() : value(0) {}
+
+	void begin() {}
+	void write(int value_in) { value = value_in; }
+
+	/// The last value given to write(), exactly as given
+	int get_written() const { return value; }
+	/// The pulse width the ATMega would be sending (us)
+	uint16_t get_pulse_us() const { return servo_pulse_us(value); }
+
+private:
+	int value;
+};
+
+
+#endif //ME507_SIM_HAL_H
@@ -0,0 +1,44 @@
+//
+// Real-time simulated LiDAR device; see sim_lidar_device.h.
+//
+
+#include <chrono>
+#include <thread>
+#include "sim_lidar_device.h"
+
+sim_lidar_device::sim_lidar_device(const lidar_model_config &model_in, const hitch_config &trailer,
+                                   const occupancy_grid *map, const sim_device_timing &timing_in,
+                                   const std::function<vehicle_state(uint64_t)> &truth_in)
+		: model(model_in, trailer), rng(model_in.seed + 1), delay(0, timing_in.max_delay_us)
+{
+	model.set_map(map);
+	timing = timing_in;
+	truth = truth_in;
+	sweep_us = model_in.sweep_us;
+	created_us = host_time_us();
+	next_sweep_us = created_us + timing.phase_us;
+}
+
+uint64_t sim_lidar_device::device_time(uint64_t host_us) const
+{
+	double elapsed = (double)(host_us - created_us);
+	return (uint64_t)((int64_t)host_us + timing.clock_offset_us + (int64_t)(elapsed * timing.clock_drift_ppm * 1e-6));
+}
+
+int64_t sim_lidar_device::true_offset_us(uint64_t host_us) const
+{
+	return (int64_t)host_us - (int64_t)device_time(host_us);
+}
+
+bool sim_lidar_device::read_scan(lidar_scan &out)
+{
+	uint64_t start = next_sweep_us;
+	next_sweep_us += sweep_us;
+	uint64_t deliver = start + sweep_us + delay(rng);
+	std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(deliver - host_time_us())));
+	if (timing.stall_after_us && start - created_us >= timing.stall_after_us)
+		return false;
+
+	model.scan(truth(start), truth(start + sweep_us), device_time(start), out);
+	return true;
+}
@@ -0,0 +1,71 @@
+/**
+ * The sim_lidar_device is a lidar_device that produces lidar_model scans in real time,
+ * so LiDAR_sensor threads and the scan_merger can be run exactly as on the truck. Like
+ * a real scanner it has its own free-running clock, which is offset from the host's
+ * and drifts at a set rate, its sweeps are spaced by the sweep time from a start phase
+ * of its own, and each scan reaches the host a random transfer delay after its sweep.
+ * It can also be told to stall, delivering nothing from a given time on.
+ */
+
+#ifndef ME507_SIM_LIDAR_DEVICE_H
+#define ME507_SIM_LIDAR_DEVICE_H
+
+#include <cstdint>
+#include <functional>
+#include <random>
+#include "lidar_model.h"
+#include "../RaspberryPi/LiDAR_sensor.h"
+
+/**
+ * @brief How a simulated device's timing differs from the ideal.
+ * @var phase_us start of the first sweep after the device is created (us)
+ * @var clock_offset_us device clock minus host clock at creation (us)
+ * @var clock_drift_ppm how much faster the device clock runs than the host's (ppm)
+ * @var max_delay_us longest transfer delay; delays are uniform from zero to this (us)
+ * @var stall_after_us stop delivering scans this long after creation, 0 for never (us)
+ */
+struct sim_device_timing {
+	uint32_t phase_us;
+	int64_t  clock_offset_us;
+	float    clock_drift_ppm;
+	uint32_t max_delay_us;
+	uint64_t stall_after_us;
+};
+
+class sim_lidar_device : public lidar_device {
+public:
+	/**
+	 * @brief The constructor for a simulated device.
+	 * @param model_in The scanner and its mount; sweeps are sweep_us apart
+	 * @param trailer The trailer it may see
+	 * @param map The yard, which must outlive the device, or NULL
+	 * @param timing_in The device's clock and delays
+	 * @param truth_in Gives the true state of the truck at a host time (us)
+	 */
+	sim_lidar_device(const lidar_model_config &model_in, const hitch_config &trailer, const occupancy_grid *map,
+	                 const sim_device_timing &timing_in, const std::function<vehicle_state(uint64_t)> &truth_in);
+
+	bool read_scan(lidar_scan &out);
+
+	/**
+	 * @brief Gets the true offset a LiDAR_sensor should find for this device.
+	 * @param host_us A host time (us)
+	 * @return host time minus device time at host_us (us)
+	 */
+	int64_t true_offset_us(uint64_t host_us) const;
+
+private:
+	lidar_model model;
+	sim_device_timing timing;
+	std::function<vehicle_state(uint64_t)> truth;
+	uint64_t created_us;
+	uint64_t next_sweep_us;
+	uint32_t sweep_us;
+	std::mt19937 rng;
+	std::uniform_int_distribution<uint32_t> delay;
+
+	uint64_t device_time(uint64_t host_us) const;
+};
+
+
+#endif //ME507_SIM_LIDAR_DEVICE_H
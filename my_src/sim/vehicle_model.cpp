@@ -0,0 +1,90 @@
+//
+// Tractor-trailer plant model; see vehicle_model.h.
+//
+
+#include <cmath>
+#include "vehicle_model.h"
+
+vehicle_model::vehicle_model(const vehicle_params &params_in)
+{
+	params = params_in;
+	vehicle_state zero = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+	state = zero;
+}
+
+void vehicle_model::reset(const vehicle_state &state_in)
+{
+	state = state_in;
+}
+
+void vehicle_model::step(float dt, int16_t steer_output, int16_t motor_output)
+{
+	const truck_geometry &g = params.geometry;
+
+	// Servo: first order lag towards the command, limited in rate and travel; the
+	// linkage scales the servo's travel into the wheel angle
+	float steer_cmd = steer_output / STEER_OUTPUT_PER_RAD;
+	if (steer_cmd > g.max_steer)
+		steer_cmd = g.max_steer;
+	else if (steer_cmd < -g.max_steer)
+		steer_cmd = -g.max_steer;
+	steer_cmd *= params.steer_gain;
+	float steer_rate = (steer_cmd - state.steer) / params.steer_tau;
+	if (steer_rate > params.steer_rate_max)
+		steer_rate = params.steer_rate_max;
+	else if (steer_rate < -params.steer_rate_max)
+		steer_rate = -params.steer_rate_max;
+	state.steer += steer_rate * dt;
+
+	// Motor: first order lag from throttle to speed, or braking down to a stop
+	if (motor_output == MOTOR_OUTPUT_BRAKE) {
+		float brake = params.brake_decel * dt;
+		state.speed -= state.speed > brake ? brake : (state.speed < -brake ? -brake : state.speed);
+	}
+	else {
+		float speed_cmd = params.top_speed * motor_output / MOTOR_OUTPUT_FULL;
+		state.speed += (speed_cmd - state.speed) * dt / params.motor_tau;
+	}
+
+	// Kinematics; the trailer rate comes from the hitch point's velocity across the trailer
+	float v = state.speed;
+	float yaw_rate = v * tanf(state.steer) / g.wheelbase;
+	float trailer_rate = (-v * sinf(state.hitch) - g.hitch_offset * yaw_rate * cosf(state.hitch))
+	                     / g.trailer_length;
+
+	state.x += v * cosf(state.heading) * dt;
+	state.y += v * sinf(state.heading) * dt;
+	state.heading += yaw_rate * dt;
+	state.hitch += (trailer_rate - yaw_rate) * dt;
+
+	if (state.heading > (float)M_PI)
+		state.heading -= 2.0f * (float)M_PI;
+	else if (state.heading <= -(float)M_PI)
+		state.heading += 2.0f * (float)M_PI;
+}
+
+int16_t vehicle_model::measure_wheel_speed() const
+{
+	float steps = roundf(state.speed / params.speed_resolution);
+	return (int16_t)lroundf(steps * params.speed_resolution * WHEEL_SPEED_PER_M_S);
+}
+
+uint16_t vehicle_model::measure_imu_angle() const
+{
+	// The BNO055 heading runs clockwise from 0 to 360 degrees
+	float degrees = -state.heading * (float)(180.0 / M_PI);
+	if (degrees < 0.0f)
+		degrees += 360.0f;
+	uint32_t raw = (uint32_t)lroundf(degrees * IMU_ANGLE_PER_DEG);
+	return (uint16_t)(raw % (360 * IMU_ANGLE_PER_DEG));
+}
+
+void vehicle_model::trailer_axle(float &tx, float &ty) const
+{
+	const truck_geometry &g = params.geometry;
+	float hx = state.x - g.hitch_offset * cosf(state.heading);
+	float hy = state.y - g.hitch_offset * sinf(state.heading);
+	float trailer_heading = state.heading + state.hitch;
+	tx = hx - g.trailer_length * cosf(trailer_heading);
+	ty = hy - g.trailer_length * sinf(trailer_heading);
+}
@@ -0,0 +1,113 @@
+/**
+ * The vehicle_model is a host-side model of the tractor-trailer used to test the control
+ * code without driving the truck. It uses kinematic bicycle motion for the tractor, the
+ * standard off-axle hitch model for the trailer, a first order lag for the steering
+ * servo and the motor, and quantizes the wheel speed the way the IR stripe sensor does.
+ * Commands are taken in the same units as steer_output and motor_output in
+ * semi_truck_data_t.
+ */
+
+#ifndef ME507_VEHICLE_MODEL_H
+#define ME507_VEHICLE_MODEL_H
+
+#include <cstdint>
+#include "../semi_truck_data_t.h"
+#include "../RaspberryPi/control_loop.h"
+
+/**
+ * @brief Physical parameters of the simulated truck.
+ * @var geometry dimensions shared with the control loop
+ * @var steer_gain front wheel angle the servo linkage reaches per radian commanded
+ * @var steer_tau time constant of the steering servo (s)
+ * @var steer_rate_max fastest the servo can turn the wheels (rad/s)
+ * @var motor_tau time constant from motor_output to speed (s)
+ * @var top_speed steady speed at full motor_output (m/s)
+ * @var brake_decel deceleration under MOTOR_OUTPUT_BRAKE (m/s^2)
+ * @var speed_resolution smallest step the wheel speed sensor can report (m/s)
+ */
+struct vehicle_params {
+	truck_geometry geometry;
+	float steer_gain;
+	float steer_tau;
+	float steer_rate_max;
+	float motor_tau;
+	float top_speed;
+	float brake_decel;
+	float speed_resolution;
+};
+
+/**
+ * @brief The state of the simulated truck.
+ * @var x x of the tractor's rear axle (m)
+ * @var y y of the tractor's rear axle (m)
+ * @var heading tractor heading, counterclockwise from the x axis (rad)
+ * @var hitch trailer heading minus tractor heading (rad)
+ * @var steer actual front wheel angle (rad)
+ * @var speed actual speed of the tractor's rear axle (m/s, negative in reverse)
+ */
+struct vehicle_state {
+	float x;
+	float y;
+	float heading;
+	float hitch;
+	float steer;
+	float speed;
+};
+
+class vehicle_model {
+public:
+	/**
+	 * @brief The constructor for a vehicle_model at rest at the origin.
+	 * @param params_in The physical parameters of the truck
+	 */
+	vehicle_model(const vehicle_params &params_in);
+
+	/**
+	 * @brief Puts the truck in a given state.
+	 * @param state_in The new state
+	 */
+	void reset(const vehicle_state &state_in);
+
+	/**
+	 * @brief Advances the model.
+	 * @param dt The time step (s)
+	 * @param steer_output The steering command, as in semi_truck_data_t
+	 * @param motor_output The motor command, as in semi_truck_data_t
+	 */
+	void step(float dt, int16_t steer_output, int16_t motor_output);
+
+	/**
+	 * @brief Reads the wheel speed sensor.
+	 * @return the speed rounded to the sensor resolution, as in semi_truck_data_t
+	 */
+	int16_t measure_wheel_speed() const;
+
+	/**
+	 * @brief Reads the BNO055 heading.
+	 * @return the heading in raw BNO055 units, as in semi_truck_data_t
+	 */
+	uint16_t measure_imu_angle() const;
+
+	const vehicle_state &get_state() const { return state; }
+	const vehicle_params &get_params() const { return params; }
+
+	/**
+	 * @brief Changes the physical parameters, e.g. as the battery runs down, keeping the state.
+	 * @param params_in The new parameters
+	 */
+	void set_params(const vehicle_params &params_in) { params = params_in; }
+
+	/**
+	 * @brief Computes where the trailer axle is.
+	 * @param tx Set to the x of the trailer axle (m)
+	 * @param ty Set to the y of the trailer axle (m)
+	 */
+	void trailer_axle(float &tx, float &ty) const;
+
+private:
+	vehicle_params params;
+	vehicle_state state;
+};
+
+
+#endif //ME507_VEHICLE_MODEL_H
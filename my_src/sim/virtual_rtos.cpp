@@ -0,0 +1,220 @@
+//
+// Deterministic coroutine scheduler on virtual time; see virtual_rtos.h.
+//
+
+#include <chrono>
+#include <cstring>
+#include "virtual_rtos.h"
+#include "host/taskbase.h"
+
+static uint64_t host_ns()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+virtual_rtos *virtual_rtos::current = NULL;
+virtual_rtos *virtual_rtos::active = NULL;
+
+virtual_rtos::virtual_rtos(size_t stack_bytes_in)
+{
+	stack_bytes = stack_bytes_in;
+	running = -1;
+	now_us = 0;
+	switches = 0;
+}
+
+virtual_rtos::~virtual_rtos()
+{
+	// Unfinished tasks are simply abandoned on their stacks, like at power off
+	for (size_t i = 0; i < tasks.size(); i++)
+		delete tasks[i];
+	if (current == this)
+		current = NULL;
+}
+
+void virtual_rtos::make_current()
+{
+	current = this;
+}
+
+virtual_rtos *virtual_rtos::get_current()
+{
+	return current;
+}
+
+virtual_rtos *virtual_rtos::get_active()
+{
+	return active;
+}
+
+void virtual_rtos::add_task(TaskBase *task, uint8_t priority)
+{
+	task_slot *slot = new task_slot;
+	slot->task = task;
+	slot->priority = priority;
+	slot->wake_us = now_us;
+	slot->started = false;
+	slot->finished = false;
+	memset(&slot->profile, 0, sizeof(slot->profile));
+	slot->profile.name = task->get_name();
+	slot->profile.priority = priority;
+	slot->released_us = now_us;
+	slot->release_ns = 0;
+	slot->release_ended = false;
+	slot->critical_start_ns = 0;
+	slot->critical_depth = 0;
+	tasks.push_back(slot);
+}
+
+void virtual_rtos::add_periodic(uint64_t period_us, const std::function<void(uint64_t)> &hook)
+{
+	periodic_hook h;
+	h.period_us = period_us;
+	h.next_us = now_us;
+	h.hook = hook;
+	hooks.push_back(h);
+}
+
+void virtual_rtos::run_until(uint64_t end_us)
+{
+	virtual_rtos *outer = active;
+	active = this;
+	for (;;) {
+		uint64_t next = UINT64_MAX;
+		for (size_t i = 0; i < hooks.size(); i++)
+			if (hooks[i].next_us < next)
+				next = hooks[i].next_us;
+		for (size_t i = 0; i < tasks.size(); i++)
+			if (!tasks[i]->finished && tasks[i]->wake_us < next)
+				next = tasks[i]->wake_us;
+		if (next > end_us)
+			break;
+		now_us = next;
+
+		for (size_t i = 0; i < hooks.size(); i++) {
+			if (hooks[i].next_us == now_us) {
+				hooks[i].next_us += hooks[i].period_us;
+				hooks[i].hook(now_us);
+			}
+		}
+
+		// A task woken here can only sleep again into the future, so this ends
+		for (;;) {
+			task_slot *best = NULL;
+			for (size_t i = 0; i < tasks.size(); i++) {
+				task_slot *slot = tasks[i];
+				if (!slot->finished && slot->wake_us <= now_us
+				    && (best == NULL || slot->priority > best->priority))
+					best = slot;
+			}
+			if (best == NULL)
+				break;
+			resume(best);
+		}
+	}
+	if (end_us > now_us)
+		now_us = end_us;
+	active = outer;
+}
+
+void virtual_rtos::sleep_until(uint64_t wake_us, bool release)
+{
+	if (running < 0)
+		return;
+	task_slot *slot = tasks[running];
+	slot->wake_us = wake_us > now_us ? wake_us : now_us + 1;
+	if (release) {
+		task_profile &p = slot->profile;
+		uint64_t interval = slot->wake_us - slot->released_us;
+		if (!p.releases || interval < p.min_interval_us)
+			p.min_interval_us = interval;
+		if (interval > p.max_interval_us)
+			p.max_interval_us = interval;
+		p.releases++;
+		slot->released_us = slot->wake_us;
+		slot->release_ended = true;
+	}
+	swapcontext(&slot->context, &scheduler_context);
+}
+
+void virtual_rtos::enter_critical()
+{
+	if (running < 0)
+		return;
+	task_slot *slot = tasks[running];
+	if (slot->critical_depth++ == 0)
+		slot->critical_start_ns = host_ns();
+}
+
+void virtual_rtos::exit_critical()
+{
+	if (running < 0)
+		return;
+	task_slot *slot = tasks[running];
+	if (!slot->critical_depth || --slot->critical_depth)
+		return;
+	uint64_t held = host_ns() - slot->critical_start_ns;
+	slot->profile.critical_sections++;
+	if (held > slot->profile.max_critical_ns)
+		slot->profile.max_critical_ns = held;
+}
+
+std::vector<task_profile> virtual_rtos::get_profiles() const
+{
+	std::vector<task_profile> out;
+	for (size_t i = 0; i < tasks.size(); i++)
+		out.push_back(tasks[i]->profile);
+	return out;
+}
+
+uint16_t virtual_rtos::get_finished_count() const
+{
+	uint16_t n = 0;
+	for (size_t i = 0; i < tasks.size(); i++)
+		n += tasks[i]->finished ? 1 : 0;
+	return n;
+}
+
+void virtual_rtos::resume(task_slot *slot)
+{
+	for (size_t i = 0; i < tasks.size(); i++)
+		if (tasks[i] == slot)
+			running = (int)i;
+
+	if (!slot->started) {
+		slot->started = true;
+		slot->stack.resize(stack_bytes);
+		getcontext(&slot->context);
+		slot->context.uc_stack.ss_sp = &slot->stack[0];
+		slot->context.uc_stack.ss_size = slot->stack.size();
+		slot->context.uc_link = &scheduler_context;
+		makecontext(&slot->context, &virtual_rtos::task_entry, 0);
+	}
+
+	switches++;
+	uint64_t start = host_ns();
+	swapcontext(&scheduler_context, &slot->context);
+	running = -1;
+
+	// The slice that just ended belongs to the current release, which it may have ended
+	slot->release_ns += host_ns() - start;
+	if (slot->release_ended || slot->finished) {
+		if (slot->release_ns > slot->profile.max_run_ns)
+			slot->profile.max_run_ns = slot->release_ns;
+		slot->profile.sum_run_ns += slot->release_ns;
+		slot->release_ns = 0;
+		slot->release_ended = false;
+	}
+}
+
+/**
+ * Every task starts here on its own stack. A task whose run() returns is finished, as
+ * if it had deleted itself; uc_link then brings the scheduler back.
+ */
+void virtual_rtos::task_entry()
+{
+	task_slot *slot = active->tasks[active->running];
+	slot->task->run();
+	slot->finished = true;
+}
@@ -0,0 +1,187 @@
+/**
+ * The virtual_rtos runs the host port of the firmware tasks on simulated time. Every
+ * task gets its own stack and runs as a coroutine: it keeps the CPU until it delays or
+ * waits for a serial byte, and then the scheduler moves the virtual clock straight to
+ * the next thing that is due. Nothing depends on the host's clock or threads, so a run
+ * is deterministic and goes as fast as the code itself allows.
+ *
+ * At each instant the periodic hooks run first, in the order they were added; they
+ * stand in for the physical world (the plant and the sensors). Then every task whose
+ * wake-up time has come runs, highest priority first, and in creation order among
+ * tasks of equal priority. Task code takes no simulated time.
+ *
+ * Tasks created while a virtual_rtos is current (see make_current()) register with it
+ * from the TaskBase constructor, as they would with xTaskCreate() on the ATMega.
+ *
+ * The scheduler also profiles every task for the schedulability analysis: how often it
+ * is released, how long each release runs on the host until the task delays again, and
+ * how long it holds critical sections. The run times are read off the host's clock, so
+ * they vary from run to run, but they are only ever reported; the schedule itself still
+ * depends on nothing but virtual time.
+ */
+
+#ifndef ME507_VIRTUAL_RTOS_H
+#define ME507_VIRTUAL_RTOS_H
+
+#include <ucontext.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class TaskBase;
+
+/**
+ * @brief What the scheduler saw of one task. A release is a wake-up after the task
+ * delayed; waiting for a serial byte is part of the release it happens in.
+ * @var name the task's name
+ * @var priority the priority it was created with
+ * @var releases releases that ran to the task's next delay
+ * @var min_interval_us shortest virtual time between two releases (us)
+ * @var max_interval_us longest virtual time between two releases (us)
+ * @var max_run_ns longest host time one release ran for, in all its slices (ns)
+ * @var sum_run_ns host time of all releases together (ns)
+ * @var critical_sections critical sections entered
+ * @var max_critical_ns longest host time spent in one critical section (ns)
+ */
+struct task_profile {
+	const char *name;
+	uint8_t  priority;
+	uint32_t releases;
+	uint64_t min_interval_us;
+	uint64_t max_interval_us;
+	uint64_t max_run_ns;
+	uint64_t sum_run_ns;
+	uint32_t critical_sections;
+	uint64_t max_critical_ns;
+};
+
+class virtual_rtos {
+public:
+	/**
+	 * @brief The constructor for a scheduler at time zero with no tasks.
+	 * @param stack_bytes_in The stack given to each task on the host (bytes)
+	 */
+	virtual_rtos(size_t stack_bytes_in = 64 * 1024);
+
+	~virtual_rtos();
+
+	/**
+	 * @brief Makes this the scheduler that newly created tasks register with.
+	 */
+	void make_current();
+
+	/**
+	 * @brief Gets the scheduler that newly created tasks register with.
+	 * @return the current scheduler, or NULL if there is none
+	 */
+	static virtual_rtos *get_current();
+
+	/**
+	 * @brief Gets the scheduler that is inside run_until(), for code such as a serial
+	 * port that is called from a task but does not know which scheduler runs it.
+	 * @return the running scheduler, or NULL if there is none
+	 */
+	static virtual_rtos *get_active();
+
+	/**
+	 * @brief Adds a task; called by the TaskBase constructor.
+	 * @param task The task; its run() method starts at the next scheduling point
+	 * @param priority Its priority; higher numbers run first
+	 */
+	void add_task(TaskBase *task, uint8_t priority);
+
+	/**
+	 * @brief Adds a function that is called at a fixed period of virtual time.
+	 * @param period_us The period (us)
+	 * @param hook Called with the current time; the first call is at the current time
+	 */
+	void add_periodic(uint64_t period_us, const std::function<void(uint64_t)> &hook);
+
+	/**
+	 * @brief Runs hooks and tasks until the virtual clock reaches a given time.
+	 * @param end_us The time to stop at (us); everything due at exactly end_us has run
+	 */
+	void run_until(uint64_t end_us);
+
+	/**
+	 * @brief Suspends the running task until a given time; only call it from a task.
+	 * A time that is not in the future wakes the task 1 us later, so a task that never
+	 * really blocks still lets the clock move.
+	 * @param wake_us The time to wake up at (us)
+	 * @param release true if this ends the task's release (a delay), false if the task
+	 * is waiting partway through one (for a serial byte)
+	 */
+	void sleep_until(uint64_t wake_us, bool release = true);
+
+	/**
+	 * @brief Marks the running task as entering a critical section, for its profile.
+	 * Called by the host portENTER_CRITICAL(); does nothing outside a task.
+	 */
+	void enter_critical();
+
+	/**
+	 * @brief Marks the running task as leaving its critical section.
+	 */
+	void exit_critical();
+
+	/**
+	 * @brief Gets the profile of every task, in the order they were created.
+	 */
+	std::vector<task_profile> get_profiles() const;
+
+	/// True while task code (rather than a hook or the caller of run_until) is running
+	bool in_task() const { return running >= 0; }
+
+	uint64_t get_time_us() const { return now_us; }
+
+	/// The FreeRTOS tick count: milliseconds since time zero
+	uint32_t get_tick_count() const { return (uint32_t)(now_us / 1000); }
+
+	/// How many times a task has been resumed since the scheduler started
+	uint64_t get_switch_count() const { return switches; }
+
+	/// How many tasks have returned from run()
+	uint16_t get_finished_count() const;
+
+private:
+	struct task_slot {
+		TaskBase *task;
+		uint8_t priority;
+		uint64_t wake_us;
+		bool started;
+		bool finished;
+		ucontext_t context;
+		std::vector<char> stack;
+
+		task_profile profile;
+		uint64_t released_us;       // wake-up time of the current release
+		uint64_t release_ns;        // host time the current release has run so far
+		bool release_ended;         // the task has just delayed, ending its release
+		uint64_t critical_start_ns; // host time the critical section was entered
+		uint8_t critical_depth;
+	};
+
+	struct periodic_hook {
+		uint64_t period_us;
+		uint64_t next_us;
+		std::function<void(uint64_t)> hook;
+	};
+
+	size_t stack_bytes;
+	std::vector<task_slot *> tasks;
+	std::vector<periodic_hook> hooks;
+	ucontext_t scheduler_context;
+	int running;                // index of the running task, -1 in the scheduler
+	uint64_t now_us;
+	uint64_t switches;
+
+	static virtual_rtos *current;
+	static virtual_rtos *active;
+
+	void resume(task_slot *slot);
+	static void task_entry();
+};
+
+
+#endif //ME507_VIRTUAL_RTOS_H
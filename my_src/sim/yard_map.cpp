@@ -0,0 +1,67 @@
+//
+// The simulated container yard; see yard_map.h.
+//
+
+#include <cmath>
+#include "yard_map.h"
+
+#define FENCE_THICKNESS 0.2f    // m
+
+occupancy_grid make_yard_grid()
+{
+	return occupancy_grid((uint16_t)lroundf(YARD_WIDTH / YARD_RESOLUTION),
+	                      (uint16_t)lroundf(YARD_HEIGHT / YARD_RESOLUTION), YARD_RESOLUTION, 0.0f, 0.0f);
+}
+
+void build_yard(occupancy_grid &map)
+{
+	map.fill_rect(0.0f, 0.0f, YARD_WIDTH, FENCE_THICKNESS, CELL_OCCUPIED);
+	map.fill_rect(0.0f, YARD_HEIGHT - FENCE_THICKNESS, YARD_WIDTH, YARD_HEIGHT, CELL_OCCUPIED);
+	map.fill_rect(0.0f, 0.0f, FENCE_THICKNESS, YARD_HEIGHT, CELL_OCCUPIED);
+	map.fill_rect(YARD_WIDTH - FENCE_THICKNESS, 0.0f, YARD_WIDTH, YARD_HEIGHT, CELL_OCCUPIED);
+
+	// Containers, one in the middle of the test loop and the rest around it
+	map.fill_rect(9.0f, 6.8f, 15.0f, 9.2f, CELL_OCCUPIED);
+	map.fill_rect(3.0f, 15.0f, 9.0f, 17.4f, CELL_OCCUPIED);
+	map.fill_rect(12.0f, 15.5f, 14.4f, 18.0f, CELL_OCCUPIED);
+	map.fill_rect(20.0f, 16.0f, 26.0f, 18.4f, CELL_OCCUPIED);
+	map.fill_rect(24.5f, 2.0f, 26.9f, 8.0f, CELL_OCCUPIED);
+	map.fill_rect(10.0f, 0.8f, 16.0f, 2.0f, CELL_OCCUPIED);
+}
+
+occupancy_grid make_dock_yard_grid()
+{
+	uint16_t cells = (uint16_t)lroundf(DOCK_YARD_SIZE / YARD_RESOLUTION);
+	return occupancy_grid(cells, cells, YARD_RESOLUTION, 0.0f, 0.0f);
+}
+
+void build_dock_yard(occupancy_grid &map)
+{
+	map.fill_rect(0.0f, 0.0f, DOCK_YARD_SIZE, FENCE_THICKNESS, CELL_OCCUPIED);
+	map.fill_rect(0.0f, DOCK_YARD_SIZE - FENCE_THICKNESS, DOCK_YARD_SIZE, DOCK_YARD_SIZE, CELL_OCCUPIED);
+	map.fill_rect(0.0f, 0.0f, FENCE_THICKNESS, DOCK_YARD_SIZE, CELL_OCCUPIED);
+	map.fill_rect(DOCK_YARD_SIZE - FENCE_THICKNESS, 0.0f, DOCK_YARD_SIZE, DOCK_YARD_SIZE, CELL_OCCUPIED);
+
+	// The warehouse, and the walls between its dock bays
+	map.fill_rect(14.0f, DOCK_FACE_Y, 40.0f, DOCK_YARD_SIZE, CELL_OCCUPIED);
+	for (uint8_t i = 0; i <= DOCK_BAYS; i++) {
+		float x = DOCK_BAY_X + i * DOCK_BAY_WIDTH;
+		map.fill_rect(x - 0.05f, DOCK_FACE_Y - DOCK_BAY_DEPTH, x + 0.05f, DOCK_FACE_Y, CELL_OCCUPIED);
+	}
+
+	// Three rows of containers, with gaps to drive through
+	map.fill_rect(5.0f, 30.0f, 11.0f, 32.4f, CELL_OCCUPIED);
+	map.fill_rect(13.0f, 30.0f, 19.0f, 32.4f, CELL_OCCUPIED);
+	map.fill_rect(27.0f, 30.0f, 33.0f, 32.4f, CELL_OCCUPIED);
+	map.fill_rect(35.0f, 30.0f, 41.0f, 32.4f, CELL_OCCUPIED);
+	map.fill_rect(8.0f, 18.0f, 14.0f, 20.4f, CELL_OCCUPIED);
+	map.fill_rect(16.0f, 18.0f, 22.0f, 20.4f, CELL_OCCUPIED);
+	map.fill_rect(30.0f, 18.0f, 36.0f, 20.4f, CELL_OCCUPIED);
+	map.fill_rect(5.0f, 6.0f, 11.0f, 8.4f, CELL_OCCUPIED);
+	map.fill_rect(20.0f, 6.0f, 26.0f, 8.4f, CELL_OCCUPIED);
+	map.fill_rect(35.0f, 6.0f, 41.0f, 8.4f, CELL_OCCUPIED);
+
+	// Parked trailers either side of the parking space along the left fence
+	map.fill_rect(PARKING_X - 0.15f, PARKING_Y0 - 0.8f, PARKING_X + 0.15f, PARKING_Y0, CELL_OCCUPIED);
+	map.fill_rect(PARKING_X - 0.15f, PARKING_Y1, PARKING_X + 0.15f, PARKING_Y1 + 0.8f, CELL_OCCUPIED);
+}
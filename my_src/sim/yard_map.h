@@ -0,0 +1,58 @@
+/**
+ * The container yard the host tools drive the truck around: a fenced 30 m by 20 m lot
+ * with a row of shipping containers, on a 5 cm occupancy_grid with its corner at the
+ * world origin. The truck's test loop runs anticlockwise around the container in the
+ * middle, with its lower straight along y = 4 m from x = 6 m.
+ *
+ * The dock yard is a larger 50 m square lot for planning maneuvers: a warehouse across
+ * the top with a row of loading dock bays in its face, rows of containers with gaps to
+ * drive through, and two parked trailers along the left fence with a parking space
+ * between them. A trailer is docked when its rear is at the dock face, between the two
+ * walls of a bay.
+ */
+
+#ifndef ME507_YARD_MAP_H
+#define ME507_YARD_MAP_H
+
+#include "../RaspberryPi/occupancy_grid.h"
+
+#define YARD_WIDTH 30.0f        // m
+#define YARD_HEIGHT 20.0f       // m
+#define YARD_RESOLUTION 0.05f   // m
+
+#define DOCK_YARD_SIZE 50.0f    // m, both ways
+#define DOCK_FACE_Y 44.0f       // y of the warehouse face the trailers back up to (m)
+#define DOCK_BAY_X 20.0f        // x of the first bay wall (m)
+#define DOCK_BAY_WIDTH 1.0f     // distance between bay walls (m)
+#define DOCK_BAY_DEPTH 1.0f     // length of the bay walls out from the face (m)
+#define DOCK_BAYS 6
+#define PARKING_X 0.85f         // x of the middle of the parking space (m)
+#define PARKING_Y0 10.8f        // lowest y of the parking space (m)
+#define PARKING_Y1 13.8f        // highest y of the parking space (m)
+
+/**
+ * @brief Makes an empty grid the size of the yard.
+ * @return the grid, with every cell free
+ */
+occupancy_grid make_yard_grid();
+
+/**
+ * @brief Draws the fence and the containers into a grid.
+ * @param map The grid, normally from make_yard_grid()
+ */
+void build_yard(occupancy_grid &map);
+
+/**
+ * @brief Makes an empty grid the size of the dock yard.
+ * @return the grid, with every cell free
+ */
+occupancy_grid make_dock_yard_grid();
+
+/**
+ * @brief Draws the fence, warehouse, dock bays, containers and parked trailers into a grid.
+ * @param map The grid, normally from make_dock_yard_grid()
+ */
+void build_dock_yard(occupancy_grid &map);
+
+
+#endif //ME507_YARD_MAP_H